@@ -13,3 +13,28 @@
 #import "NebulaJsonAPIs.h"
 #import "NebulaBLEAPIs.h"
 #import "NebulaWiFiConfig.h"
+#import "IOTCPresenceAPIs.h"
+#import "IOTCCipherAPIs.h"
+#import "IOTCPacerAPIs.h"
+#import "IOTCCreditAPIs.h"
+#import "IOTCHandoverAPIs.h"
+#import "AVFrameAPIs.h"
+#import "AVSendQueueAPIs.h"
+#import "AVStreamGroupAPIs.h"
+#import "AVJitterBufferAPIs.h"
+#import "AVGopGateAPIs.h"
+#import "AVFecAPIs.h"
+#import "AVCongestionAPIs.h"
+#import "AVBitrateAPIs.h"
+#import "AVStatsAPIs.h"
+#import "AVRecorderAPIs.h"
+#import "AVPlaybackAPIs.h"
+#import "AVPreRollAPIs.h"
+#import "AVNalScanAPIs.h"
+#import "AVAudioAggrAPIs.h"
+#import "AVAudioCodecAPIs.h"
+#import "AVIOCtrlRpcAPIs.h"
+#import "AVIOCtrlDispatchAPIs.h"
+#import "AVBufBudgetAPIs.h"
+#import "AVStandbyAPIs.h"
+#import "AVRecvEngineAPIs.h"
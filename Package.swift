@@ -13,7 +13,10 @@ let package = Package(
         // Products define the executables and libraries produced by a package, and make them visible to other packages.
         .library(
             name: "ValiSPM",
-            targets: ["ValiSPM"])
+            targets: ["ValiSPM"]),
+        .library(
+            name: "TUTKSDKExt",
+            targets: ["TUTKSDKExt"])
     ],
     dependencies: [
         // Dependencies declare other packages that this package depends on.
@@ -25,6 +28,33 @@ let package = Package(
         .target(
             name: "ValiSPM",
             dependencies: []),
+        // Helpers layered on the public IOTC/AV APIs. Their headers live next to
+        // the SDK headers in Sources/ValiSPM/include and are exported by Header.h.
+        .target(
+            name: "TUTKSDKExt",
+            dependencies: [],
+            cSettings: [
+                .headerSearchPath("../ValiSPM/include")
+            ],
+            linkerSettings: [
+                .linkedLibrary("pthread", .when(platforms: [.linux]))
+            ]),
+        // The checks in C, with stand-ins for the SDK entry points the module calls,
+        // so the tests build and run without the SDK libraries.
+        .target(
+            name: "TUTKSDKExtTestSupport",
+            dependencies: ["TUTKSDKExt"],
+            path: "Tests/TUTKSDKExtTestSupport",
+            cSettings: [
+                .headerSearchPath("../../Sources/ValiSPM/include"),
+                .headerSearchPath("../../Sources/TUTKSDKExt")
+            ],
+            linkerSettings: [
+                .linkedLibrary("m", .when(platforms: [.linux]))
+            ]),
+        .testTarget(
+            name: "TUTKSDKExtTests",
+            dependencies: ["TUTKSDKExtTestSupport"]),
 //        .target(name: "objc",
 //                dependencies: [],
 //                path: "Header/IOTCAPIs",
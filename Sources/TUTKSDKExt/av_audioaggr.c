@@ -0,0 +1,338 @@
+/*! \file av_audioaggr.c
+Audio aggregation, see AVAudioAggrAPIs.h.
+
+The sender packs frames into the bundle under the aggregator lock. Whoever
+sends a bundle takes send_lock before dropping the lock, so bundles leave
+in the order they were filled even when the flush thread and the caller
+send at the same time. The flush thread only wakes for a bundle that has
+a frame in it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVAudioAggrAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+
+typedef struct AudioAggr {
+	int av_index;
+	unsigned int max_delay_ms;
+	unsigned int max_frames;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_mutex_t send_lock;
+	pthread_t thread;
+	int stop;
+	unsigned char bundle[AV_MAX_AUDIO_DATA_SIZE];
+	int len;
+	unsigned int count;
+	unsigned char first_info[AV_AUDIO_AGGR_MAX_FRAME_INFO];
+	int first_info_size;
+	uint64_t first_ms;
+	AVAudioAggrStats stats;
+} AudioAggr;
+
+typedef struct AudioSplit {
+	unsigned char bundle[AV_MAX_AUDIO_DATA_SIZE];
+	int len;
+	int pos;
+	unsigned int left;
+	unsigned int frame_idx;
+} AudioSplit;
+
+static ExtTable gAudioAggrs = EXT_TABLE_INITIALIZER;
+static ExtTable gAudioSplits = EXT_TABLE_INITIALIZER;
+
+// Caller holds a->lock; returns with a->send_lock held instead, and the bundle emptied into out
+static int aggr_take_bundle(AudioAggr *a, unsigned char *out, unsigned char *info, int *info_size)
+{
+	int len = a->len;
+
+	a->bundle[5] = (unsigned char)a->count;
+	memcpy(out, a->bundle, (size_t)len);
+	memcpy(info, a->first_info, (size_t)a->first_info_size);
+	*info_size = a->first_info_size;
+	a->len = 0;
+	a->count = 0;
+	pthread_mutex_lock(&a->send_lock);
+	pthread_mutex_unlock(&a->lock);
+	return len;
+}
+
+// Caller holds a->send_lock; releases it
+static int aggr_send(AudioAggr *a, const unsigned char *data, int len, const unsigned char *info, int info_size,
+					 unsigned int frames)
+{
+	int ret = avSendAudioDataPaced(a->av_index, (const char *)data, len, info_size > 0 ? info : NULL, info_size);
+
+	pthread_mutex_unlock(&a->send_lock);
+	pthread_mutex_lock(&a->lock);
+	if (ret < 0) {
+		a->stats.lastError = ret;
+		a->stats.droppedFrames += frames;
+	} else {
+		a->stats.bundles++;
+	}
+	pthread_mutex_unlock(&a->lock);
+	return ret < 0 ? ret : AV_ER_NoERROR;
+}
+
+// Caller holds a->lock, which is released. Sends the current bundle if it has frames.
+static int aggr_flush_locked(AudioAggr *a)
+{
+	unsigned char out[AV_MAX_AUDIO_DATA_SIZE], info[AV_AUDIO_AGGR_MAX_FRAME_INFO];
+	unsigned int frames = a->count;
+	int len, info_size;
+
+	if (frames == 0) {
+		pthread_mutex_unlock(&a->lock);
+		return AV_ER_NoERROR;
+	}
+	len = aggr_take_bundle(a, out, info, &info_size);
+	return aggr_send(a, out, len, info, info_size, frames);
+}
+
+static void *aggr_thread(void *arg)
+{
+	AudioAggr *a = (AudioAggr *)arg;
+	uint64_t now;
+
+	pthread_mutex_lock(&a->lock);
+	while (!a->stop) {
+		if (a->count == 0) {
+			pthread_cond_wait(&a->cond, &a->lock);
+			continue;
+		}
+		now = ext_now_ms();
+		if (now < a->first_ms + a->max_delay_ms) {
+			ext_cond_wait_ms(&a->cond, &a->lock, (unsigned int)(a->first_ms + a->max_delay_ms - now));
+			continue;
+		}
+		a->stats.timerFlushes++;
+		aggr_flush_locked(a);
+		pthread_mutex_lock(&a->lock);
+	}
+	pthread_mutex_unlock(&a->lock);
+	return NULL;
+}
+
+static void aggr_free(AudioAggr *a)
+{
+	pthread_cond_destroy(&a->cond);
+	pthread_mutex_destroy(&a->lock);
+	pthread_mutex_destroy(&a->send_lock);
+	free(a);
+}
+
+int avAudioAggrAttach(int nAVChannelID, unsigned int nMaxDelayMs, unsigned int nMaxFrames)
+{
+	AudioAggr *a;
+
+	if (nAVChannelID < 0 || nMaxFrames > AV_AUDIO_AGGR_MAX_FRAMES)
+		return AV_ER_INVALID_ARG;
+	a = (AudioAggr *)calloc(1, sizeof(AudioAggr));
+	if (a == NULL)
+		return AV_ER_MEM_INSUFF;
+	a->av_index = nAVChannelID;
+	a->max_delay_ms = nMaxDelayMs > 0 ? nMaxDelayMs : AV_AUDIO_AGGR_DEFAULT_MAX_DELAY;
+	a->max_frames = nMaxFrames > 0 ? nMaxFrames : AV_AUDIO_AGGR_MAX_FRAMES;
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->cond, NULL);
+	pthread_mutex_init(&a->send_lock, NULL);
+
+	if (ext_table_set(&gAudioAggrs, nAVChannelID, a) < 0) {
+		aggr_free(a);
+		return AV_ER_INVALID_ARG;
+	}
+	if (pthread_create(&a->thread, NULL, aggr_thread, a) != 0) {
+		ext_table_take(&gAudioAggrs, nAVChannelID);
+		aggr_free(a);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avAudioAggrDetach(int nAVChannelID)
+{
+	AudioAggr *a = (AudioAggr *)ext_table_take(&gAudioAggrs, nAVChannelID);
+
+	if (a == NULL)
+		return;
+	pthread_mutex_lock(&a->lock);
+	a->stop = 1;
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->lock);
+	pthread_join(a->thread, NULL);
+	pthread_mutex_lock(&a->lock);
+	aggr_flush_locked(a);
+	aggr_free(a);
+}
+
+int avSendAudioDataAggr(int nAVChannelID, const char *cabAudioData, int nAudioDataSize,
+						const void *cabFrameInfo, int nFrameInfoSize)
+{
+	AudioAggr *a = (AudioAggr *)ext_table_get(&gAudioAggrs, nAVChannelID);
+	unsigned char *p;
+	int need, ret;
+
+	if (a == NULL || cabAudioData == NULL || nAudioDataSize <= 0 || nAudioDataSize > AV_MAX_AUDIO_DATA_SIZE ||
+		nFrameInfoSize < 0 || (nFrameInfoSize > 0 && cabFrameInfo == NULL))
+		return AV_ER_INVALID_ARG;
+	need = AV_AUDIO_AGGR_FRAME_HEADER_SIZE + nFrameInfoSize + nAudioDataSize;
+
+	pthread_mutex_lock(&a->lock);
+	a->stats.frames++;
+	if (nFrameInfoSize > AV_AUDIO_AGGR_MAX_FRAME_INFO ||
+		AV_AUDIO_AGGR_HEADER_SIZE + need > AV_MAX_AUDIO_DATA_SIZE) {
+		// Too large for any bundle: send what is buffered first to keep the order
+		a->stats.directFrames++;
+		aggr_flush_locked(a);
+		pthread_mutex_lock(&a->send_lock);
+		ret = avSendAudioDataPaced(nAVChannelID, cabAudioData, nAudioDataSize, cabFrameInfo, nFrameInfoSize);
+		pthread_mutex_unlock(&a->send_lock);
+		if (ret < 0) {
+			pthread_mutex_lock(&a->lock);
+			a->stats.lastError = ret;
+			a->stats.droppedFrames++;
+			pthread_mutex_unlock(&a->lock);
+			return ret;
+		}
+		return AV_ER_NoERROR;
+	}
+
+	ret = AV_ER_NoERROR;
+	if (a->count > 0 && a->len + need > AV_MAX_AUDIO_DATA_SIZE) {
+		ret = aggr_flush_locked(a);
+		pthread_mutex_lock(&a->lock);
+	}
+	if (a->count == 0) {
+		memcpy(a->bundle, AV_AUDIO_AGGR_MAGIC, 4);
+		a->bundle[4] = AV_AUDIO_AGGR_VERSION;
+		a->len = AV_AUDIO_AGGR_HEADER_SIZE;
+		if (nFrameInfoSize > 0)
+			memcpy(a->first_info, cabFrameInfo, (size_t)nFrameInfoSize);
+		a->first_info_size = nFrameInfoSize;
+		a->first_ms = ext_now_ms();
+		pthread_cond_signal(&a->cond);
+	}
+	p = a->bundle + a->len;
+	p[0] = (unsigned char)(nAudioDataSize & 0xff);
+	p[1] = (unsigned char)(nAudioDataSize >> 8);
+	p[2] = (unsigned char)nFrameInfoSize;
+	if (nFrameInfoSize > 0)
+		memcpy(p + AV_AUDIO_AGGR_FRAME_HEADER_SIZE, cabFrameInfo, (size_t)nFrameInfoSize);
+	memcpy(p + AV_AUDIO_AGGR_FRAME_HEADER_SIZE + nFrameInfoSize, cabAudioData, (size_t)nAudioDataSize);
+	a->len += need;
+	a->count++;
+
+	if (a->count >= a->max_frames || ext_now_ms() >= a->first_ms + a->max_delay_ms ||
+		a->len + AV_AUDIO_AGGR_FRAME_HEADER_SIZE >= AV_MAX_AUDIO_DATA_SIZE) {
+		int flush_ret = aggr_flush_locked(a);
+		return ret < 0 ? ret : flush_ret;
+	}
+	pthread_mutex_unlock(&a->lock);
+	return ret;
+}
+
+int avAudioAggrFlush(int nAVChannelID)
+{
+	AudioAggr *a = (AudioAggr *)ext_table_get(&gAudioAggrs, nAVChannelID);
+
+	if (a == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&a->lock);
+	return aggr_flush_locked(a);
+}
+
+int avAudioAggrGetStats(int nAVChannelID, AVAudioAggrStats *pStats)
+{
+	AudioAggr *a = (AudioAggr *)ext_table_get(&gAudioAggrs, nAVChannelID);
+
+	if (a == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&a->lock);
+	*pStats = a->stats;
+	pthread_mutex_unlock(&a->lock);
+	return AV_ER_NoERROR;
+}
+
+/* ============================================================================
+ * Receiver
+ * ============================================================================
+ */
+
+// Is data a well formed bundle? The sizes must add up to exactly len.
+static int split_is_bundle(const unsigned char *data, int len)
+{
+	unsigned int count, i;
+	int pos = AV_AUDIO_AGGR_HEADER_SIZE;
+
+	if (len < AV_AUDIO_AGGR_HEADER_SIZE || memcmp(data, AV_AUDIO_AGGR_MAGIC, 4) != 0 ||
+		data[4] != AV_AUDIO_AGGR_VERSION || data[5] == 0)
+		return 0;
+	count = data[5];
+	for (i = 0; i < count; i++) {
+		if (pos + AV_AUDIO_AGGR_FRAME_HEADER_SIZE > len)
+			return 0;
+		pos += AV_AUDIO_AGGR_FRAME_HEADER_SIZE + data[pos + 2] + (data[pos] | (data[pos + 1] << 8));
+	}
+	return pos == len;
+}
+
+// Returns the next frame of the bundle in s
+static int split_next(AudioSplit *s, char *data, int data_max, char *info, int info_max, unsigned int *frame_idx)
+{
+	const unsigned char *p = s->bundle + s->pos;
+	int size = p[0] | (p[1] << 8), info_size = p[2];
+
+	s->pos += AV_AUDIO_AGGR_FRAME_HEADER_SIZE + info_size + size;
+	s->left--;
+	if (frame_idx != NULL)
+		*frame_idx = s->frame_idx;
+	if (size > data_max || (info_size > 0 && (info == NULL || info_size > info_max)))
+		return AV_ER_BUFPARA_MAXSIZE_INSUFF;
+	if (info_size > 0)
+		memcpy(info, p + AV_AUDIO_AGGR_FRAME_HEADER_SIZE, (size_t)info_size);
+	memcpy(data, p + AV_AUDIO_AGGR_FRAME_HEADER_SIZE + info_size, (size_t)size);
+	return size;
+}
+
+int avRecvAudioDataAggr(int nAVChannelID, char *abAudioData, int nAudioDataMaxSize,
+						char *abFrameInfo, int nFrameInfoMaxSize, unsigned int *pnFrameIdx)
+{
+	AudioSplit *s = (AudioSplit *)ext_table_get(&gAudioSplits, nAVChannelID);
+	unsigned int idx = 0;
+	int ret;
+
+	if (s != NULL && s->left > 0)
+		return split_next(s, abAudioData, nAudioDataMaxSize, abFrameInfo, nFrameInfoMaxSize, pnFrameIdx);
+
+	ret = avRecvAudioData(nAVChannelID, abAudioData, nAudioDataMaxSize, abFrameInfo, nFrameInfoMaxSize, &idx);
+	if (pnFrameIdx != NULL)
+		*pnFrameIdx = idx;
+	if (ret < 0 || ret > AV_MAX_AUDIO_DATA_SIZE || !split_is_bundle((const unsigned char *)abAudioData, ret))
+		return ret;
+
+	if (s == NULL) {
+		s = (AudioSplit *)calloc(1, sizeof(AudioSplit));
+		if (s == NULL)
+			return AV_ER_MEM_INSUFF;
+		if (ext_table_set(&gAudioSplits, nAVChannelID, s) < 0) {
+			free(s);
+			return AV_ER_INVALID_ARG;
+		}
+	}
+	memcpy(s->bundle, abAudioData, (size_t)ret);
+	s->len = ret;
+	s->pos = AV_AUDIO_AGGR_HEADER_SIZE;
+	s->left = s->bundle[5];
+	s->frame_idx = idx;
+	return split_next(s, abAudioData, nAudioDataMaxSize, abFrameInfo, nFrameInfoMaxSize, pnFrameIdx);
+}
+
+void avAudioAggrRecvClose(int nAVChannelID)
+{
+	free(ext_table_take(&gAudioSplits, nAVChannelID));
+}
@@ -0,0 +1,676 @@
+/*! \file av_audiocodec.c
+G.711 kernels and the 8 kHz / 16 kHz resampler, see AVAudioCodecAPIs.h.
+
+The reference coders below follow the ITU-T G.711 reference code and fill
+the lookup tables of the portable engine. The SIMD engines compute the same
+thing in 16-bit lanes. The SSE2 engine leaves the segment search to the
+FPU: converted to float, a biased sample has the segment in its exponent
+and the 4 bits G.711 keeps at the top of its mantissa. Decoding builds
+1 << seg as the float 2^seg and multiplies. NEON shifts each lane by its
+own count, so it uses the segment directly.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "AVAudioCodecAPIs.h"
+#include "ext_platform.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+	#define AUDIO_HAVE_SSE2 1
+	#include <cpuid.h>
+	#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+	#define AUDIO_HAVE_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#define AUDIO_ULAW_CLIP			8159
+#define AUDIO_ULAW_BIAS			0x84
+
+static const short gSegUEnd[8] = { 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF };
+static const short gSegAEnd[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+
+static short gUlawDecode[256];
+static short gAlawDecode[256];
+static unsigned char gUlawEncode[16384];
+static unsigned char gAlawEncode[8192];
+static pthread_once_t gAudioOnce = PTHREAD_ONCE_INIT;
+static AVAudioEngine gDetectedEngine = AV_AUDIO_ENGINE_PORTABLE;
+static AVAudioEngine gForcedEngine = AV_AUDIO_ENGINE_AUTO;
+
+static int audio_detect_sse2(void)
+{
+#ifdef AUDIO_HAVE_SSE2
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// EDX bit 26: SSE2
+	return (edx & (1u << 26)) != 0;
+#else
+	return 0;
+#endif
+}
+
+static int audio_detect_neon(void)
+{
+#ifdef AUDIO_HAVE_NEON
+	// Advanced SIMD is mandatory on arm64
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* ============================================================================
+ * Reference coders
+ * ============================================================================
+ */
+
+static int audio_segment(int val, const short *ends)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		if (val <= ends[i])
+			return i;
+	}
+	return 8;
+}
+
+static unsigned char audio_ulaw_encode(short pcm)
+{
+	int val = pcm >> 2, mask, seg;
+
+	if (val < 0) {
+		val = -val;
+		mask = 0x7F;
+	} else {
+		mask = 0xFF;
+	}
+	if (val > AUDIO_ULAW_CLIP)
+		val = AUDIO_ULAW_CLIP;
+	val += AUDIO_ULAW_BIAS >> 2;
+	seg = audio_segment(val, gSegUEnd);
+	if (seg >= 8)
+		return (unsigned char)(0x7F ^ mask);
+	return (unsigned char)(((seg << 4) | ((val >> (seg + 1)) & 0xF)) ^ mask);
+}
+
+static unsigned char audio_alaw_encode(short pcm)
+{
+	int val = pcm >> 3, mask, seg, aval;
+
+	if (val >= 0) {
+		mask = 0xD5;
+	} else {
+		mask = 0x55;
+		val = -val - 1;
+	}
+	seg = audio_segment(val, gSegAEnd);
+	if (seg >= 8)
+		return (unsigned char)(0x7F ^ mask);
+	aval = seg << 4;
+	aval |= seg < 2 ? (val >> 1) & 0xF : (val >> seg) & 0xF;
+	return (unsigned char)(aval ^ mask);
+}
+
+static short audio_ulaw_decode(unsigned char u)
+{
+	int t;
+
+	u = (unsigned char)~u;
+	t = (((u & 0x0F) << 3) + AUDIO_ULAW_BIAS) << ((u & 0x70) >> 4);
+	return (short)((u & 0x80) ? AUDIO_ULAW_BIAS - t : t - AUDIO_ULAW_BIAS);
+}
+
+static short audio_alaw_decode(unsigned char a)
+{
+	int t, seg;
+
+	a ^= 0x55;
+	t = (a & 0x0F) << 4;
+	seg = (a & 0x70) >> 4;
+	if (seg == 0)
+		t += 8;
+	else
+		t = (t + 0x108) << (seg - 1);
+	return (short)((a & 0x80) ? t : -t);
+}
+
+static void audio_init_tables(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		gUlawDecode[i] = audio_ulaw_decode((unsigned char)i);
+		gAlawDecode[i] = audio_alaw_decode((unsigned char)i);
+	}
+	// Indexed by the sample with the bits the coder drops cut off
+	for (i = 0; i < 16384; i++)
+		gUlawEncode[i] = audio_ulaw_encode((short)(unsigned short)(i << 2));
+	for (i = 0; i < 8192; i++)
+		gAlawEncode[i] = audio_alaw_encode((short)(unsigned short)(i << 3));
+
+	if (audio_detect_neon())
+		gDetectedEngine = AV_AUDIO_ENGINE_NEON;
+	else if (audio_detect_sse2())
+		gDetectedEngine = AV_AUDIO_ENGINE_SSE2;
+	else
+		gDetectedEngine = AV_AUDIO_ENGINE_PORTABLE;
+}
+
+static void audio_init(void)
+{
+	pthread_once(&gAudioOnce, audio_init_tables);
+}
+
+/* ============================================================================
+ * Portable engine
+ * ============================================================================
+ */
+
+static void audio_portable_encode(AVG711Law law, const short *pcm, int n, unsigned char *out)
+{
+	int i;
+
+	if (law == AV_G711_ULAW) {
+		for (i = 0; i < n; i++)
+			out[i] = gUlawEncode[(unsigned short)pcm[i] >> 2];
+	} else {
+		for (i = 0; i < n; i++)
+			out[i] = gAlawEncode[(unsigned short)pcm[i] >> 3];
+	}
+}
+
+static void audio_portable_decode(AVG711Law law, const unsigned char *in, int n, short *pcm)
+{
+	const short *table = law == AV_G711_ULAW ? gUlawDecode : gAlawDecode;
+	int i;
+
+	for (i = 0; i < n; i++)
+		pcm[i] = table[in[i]];
+}
+
+/* ============================================================================
+ * SSE2 engine
+ * ============================================================================
+ */
+
+#ifdef AUDIO_HAVE_SSE2
+// Where m is set take b, else a
+#define AUDIO_SSE2_SELECT(m, a, b)	_mm_or_si128(_mm_andnot_si128((m), (a)), _mm_and_si128((m), (b)))
+
+// The exponent and top 4 mantissa bits of v as a float, (exponent + 127) << 4 | mantissa, for v in 16-bit lanes
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_float_bits(__m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+	__m128i hi = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+
+	return _mm_packs_epi32(_mm_srli_epi32(lo, 19), _mm_srli_epi32(hi, 19));
+}
+
+// 1 << e for e in 0..7 in 16-bit lanes, built as the float 2^e
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_pow2(__m128i e)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32(127);
+	__m128i lo = _mm_slli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(e, zero), bias), 23);
+	__m128i hi = _mm_slli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(e, zero), bias), 23);
+
+	return _mm_packs_epi32(_mm_cvttps_epi32(_mm_castsi128_ps(lo)), _mm_cvttps_epi32(_mm_castsi128_ps(hi)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_ulaw8(__m128i x)
+{
+	__m128i val = _mm_srai_epi16(x, 2);
+	__m128i neg = _mm_cmplt_epi16(val, _mm_setzero_si128());
+	__m128i u;
+
+	val = _mm_sub_epi16(_mm_xor_si128(val, neg), neg);
+	val = _mm_add_epi16(_mm_min_epi16(val, _mm_set1_epi16(AUDIO_ULAW_CLIP)), _mm_set1_epi16(AUDIO_ULAW_BIAS >> 2));
+	// val >= 0x21, so seg is the exponent - 5 and the next 4 bits are the mantissa.
+	// The clipped maximum 0x2000 gives segment 8, which becomes 0x7F.
+	u = _mm_sub_epi16(audio_sse2_float_bits(val), _mm_set1_epi16((127 + 5) << 4));
+	u = _mm_min_epi16(u, _mm_set1_epi16(0x7F));
+	// mask is 0xFF for positive samples, 0x7F for negative ones
+	return _mm_xor_si128(u, _mm_xor_si128(_mm_set1_epi16(0xFF), _mm_and_si128(neg, _mm_set1_epi16(0x80))));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_alaw8(__m128i x)
+{
+	__m128i val = _mm_srai_epi16(x, 3);
+	__m128i neg = _mm_cmplt_epi16(val, _mm_setzero_si128());
+	__m128i a;
+
+	// -val - 1 for negative samples
+	val = _mm_xor_si128(val, neg);
+	// From 32 on seg is the exponent - 4; below, segment 0 is val >> 1
+	a = _mm_sub_epi16(audio_sse2_float_bits(val), _mm_set1_epi16((127 + 4) << 4));
+	a = AUDIO_SSE2_SELECT(_mm_cmplt_epi16(val, _mm_set1_epi16(32)), a, _mm_srli_epi16(val, 1));
+	// mask is 0xD5 for positive samples, 0x55 for negative ones
+	return _mm_xor_si128(a, _mm_or_si128(_mm_set1_epi16(0x55), _mm_andnot_si128(neg, _mm_set1_epi16(0x80))));
+}
+
+__attribute__((target("sse2")))
+static void audio_sse2_encode(AVG711Law law, const short *pcm, int n, unsigned char *out)
+{
+	__m128i lo, hi;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		lo = _mm_loadu_si128((const __m128i *)(pcm + i));
+		hi = _mm_loadu_si128((const __m128i *)(pcm + i + 8));
+		if (law == AV_G711_ULAW) {
+			lo = audio_sse2_ulaw8(lo);
+			hi = audio_sse2_ulaw8(hi);
+		} else {
+			lo = audio_sse2_alaw8(lo);
+			hi = audio_sse2_alaw8(hi);
+		}
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+	}
+	audio_portable_encode(law, pcm + i, n - i, out + i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_ulaw_decode8(__m128i u)
+{
+	__m128i t, neg;
+
+	u = _mm_xor_si128(u, _mm_set1_epi16(0xFF));
+	t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x0F)), 3), _mm_set1_epi16(AUDIO_ULAW_BIAS));
+	t = _mm_mullo_epi16(t, audio_sse2_pow2(_mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi16(7))));
+	t = _mm_sub_epi16(t, _mm_set1_epi16(AUDIO_ULAW_BIAS));
+	neg = _mm_cmpeq_epi16(_mm_and_si128(u, _mm_set1_epi16(0x80)), _mm_set1_epi16(0x80));
+	return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i audio_sse2_alaw_decode8(__m128i a)
+{
+	__m128i t, seg, neg;
+
+	a = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+	seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi16(7));
+	// + 8 in segment 0, + 0x108 and << (seg - 1) above
+	t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0F)), 4), _mm_set1_epi16(8));
+	t = _mm_add_epi16(t, _mm_andnot_si128(_mm_cmpeq_epi16(seg, _mm_setzero_si128()), _mm_set1_epi16(0x100)));
+	t = _mm_mullo_epi16(t, audio_sse2_pow2(_mm_subs_epu16(seg, _mm_set1_epi16(1))));
+	// The sign bit set means positive in A-law
+	neg = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(0x80)), _mm_setzero_si128());
+	return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+__attribute__((target("sse2")))
+static void audio_sse2_decode(AVG711Law law, const unsigned char *in, int n, short *pcm)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v, lo, hi;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		lo = _mm_unpacklo_epi8(v, zero);
+		hi = _mm_unpackhi_epi8(v, zero);
+		if (law == AV_G711_ULAW) {
+			lo = audio_sse2_ulaw_decode8(lo);
+			hi = audio_sse2_ulaw_decode8(hi);
+		} else {
+			lo = audio_sse2_alaw_decode8(lo);
+			hi = audio_sse2_alaw_decode8(hi);
+		}
+		_mm_storeu_si128((__m128i *)(pcm + i), lo);
+		_mm_storeu_si128((__m128i *)(pcm + i + 8), hi);
+	}
+	audio_portable_decode(law, in + i, n - i, pcm + i);
+}
+#endif
+
+/* ============================================================================
+ * NEON engine
+ * ============================================================================
+ */
+
+#ifdef AUDIO_HAVE_NEON
+// NEON has per lane shifts, so the segment is used as a shift count directly
+static inline uint16x8_t audio_neon_ulaw8(int16x8_t x)
+{
+	int16x8_t val = vshrq_n_s16(x, 2);
+	uint16x8_t neg = vcltq_s16(val, vdupq_n_s16(0));
+	int16x8_t seg = vdupq_n_s16(0);
+	uint16x8_t u, mask;
+	int i;
+
+	val = vabsq_s16(val);
+	val = vaddq_s16(vminq_s16(val, vdupq_n_s16(AUDIO_ULAW_CLIP)), vdupq_n_s16(AUDIO_ULAW_BIAS >> 2));
+	for (i = 0; i < 7; i++)
+		seg = vsubq_s16(seg, vreinterpretq_s16_u16(vcgtq_s16(val, vdupq_n_s16(gSegUEnd[i]))));
+	u = vreinterpretq_u16_s16(vshlq_s16(val, vnegq_s16(vaddq_s16(seg, vdupq_n_s16(1)))));
+	u = vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(seg), 4), vandq_u16(u, vdupq_n_u16(0x0F)));
+	u = vbslq_u16(vcgtq_s16(val, vdupq_n_s16(gSegUEnd[7])), vdupq_n_u16(0x7F), u);
+	mask = veorq_u16(vdupq_n_u16(0xFF), vandq_u16(neg, vdupq_n_u16(0x80)));
+	return veorq_u16(u, mask);
+}
+
+static inline uint16x8_t audio_neon_alaw8(int16x8_t x)
+{
+	int16x8_t val = vshrq_n_s16(x, 3);
+	uint16x8_t neg = vcltq_s16(val, vdupq_n_s16(0));
+	int16x8_t seg = vdupq_n_s16(0), shift;
+	uint16x8_t a, mask;
+	int i;
+
+	val = veorq_s16(val, vreinterpretq_s16_u16(neg));
+	for (i = 0; i < 7; i++)
+		seg = vsubq_s16(seg, vreinterpretq_s16_u16(vcgtq_s16(val, vdupq_n_s16(gSegAEnd[i]))));
+	shift = vmaxq_s16(seg, vdupq_n_s16(1));
+	a = vandq_u16(vreinterpretq_u16_s16(vshlq_s16(val, vnegq_s16(shift))), vdupq_n_u16(0x0F));
+	a = vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(seg), 4), a);
+	mask = vorrq_u16(vdupq_n_u16(0x55), vbicq_u16(vdupq_n_u16(0x80), neg));
+	return veorq_u16(a, mask);
+}
+
+static void audio_neon_encode(AVG711Law law, const short *pcm, int n, unsigned char *out)
+{
+	uint16x8_t lo, hi;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		if (law == AV_G711_ULAW) {
+			lo = audio_neon_ulaw8(vld1q_s16(pcm + i));
+			hi = audio_neon_ulaw8(vld1q_s16(pcm + i + 8));
+		} else {
+			lo = audio_neon_alaw8(vld1q_s16(pcm + i));
+			hi = audio_neon_alaw8(vld1q_s16(pcm + i + 8));
+		}
+		vst1q_u8(out + i, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+	}
+	audio_portable_encode(law, pcm + i, n - i, out + i);
+}
+
+static inline int16x8_t audio_neon_ulaw_decode8(uint16x8_t u)
+{
+	int16x8_t t, exp;
+	uint16x8_t neg;
+
+	u = veorq_u16(u, vdupq_n_u16(0xFF));
+	t = vreinterpretq_s16_u16(vaddq_u16(vshlq_n_u16(vandq_u16(u, vdupq_n_u16(0x0F)), 3), vdupq_n_u16(AUDIO_ULAW_BIAS)));
+	exp = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(u, 4), vdupq_n_u16(7)));
+	t = vsubq_s16(vshlq_s16(t, exp), vdupq_n_s16(AUDIO_ULAW_BIAS));
+	neg = vtstq_u16(u, vdupq_n_u16(0x80));
+	return vbslq_s16(neg, vnegq_s16(t), t);
+}
+
+static inline int16x8_t audio_neon_alaw_decode8(uint16x8_t a)
+{
+	int16x8_t t, seg;
+	uint16x8_t pos;
+
+	a = veorq_u16(a, vdupq_n_u16(0x55));
+	seg = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(a, 4), vdupq_n_u16(7)));
+	t = vreinterpretq_s16_u16(vaddq_u16(vshlq_n_u16(vandq_u16(a, vdupq_n_u16(0x0F)), 4), vdupq_n_u16(8)));
+	t = vaddq_s16(t, vreinterpretq_s16_u16(vbicq_u16(vdupq_n_u16(0x100), vceqq_s16(seg, vdupq_n_s16(0)))));
+	t = vshlq_s16(t, vmaxq_s16(vsubq_s16(seg, vdupq_n_s16(1)), vdupq_n_s16(0)));
+	pos = vtstq_u16(a, vdupq_n_u16(0x80));
+	return vbslq_s16(pos, t, vnegq_s16(t));
+}
+
+static void audio_neon_decode(AVG711Law law, const unsigned char *in, int n, short *pcm)
+{
+	uint8x16_t v;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		v = vld1q_u8(in + i);
+		if (law == AV_G711_ULAW) {
+			vst1q_s16(pcm + i, audio_neon_ulaw_decode8(vmovl_u8(vget_low_u8(v))));
+			vst1q_s16(pcm + i + 8, audio_neon_ulaw_decode8(vmovl_u8(vget_high_u8(v))));
+		} else {
+			vst1q_s16(pcm + i, audio_neon_alaw_decode8(vmovl_u8(vget_low_u8(v))));
+			vst1q_s16(pcm + i + 8, audio_neon_alaw_decode8(vmovl_u8(vget_high_u8(v))));
+		}
+	}
+	audio_portable_decode(law, in + i, n - i, pcm + i);
+}
+#endif
+
+static void audio_encode(AVAudioEngine engine, AVG711Law law, const short *pcm, int n, unsigned char *out)
+{
+	switch (engine) {
+#ifdef AUDIO_HAVE_SSE2
+	case AV_AUDIO_ENGINE_SSE2:
+		audio_sse2_encode(law, pcm, n, out);
+		break;
+#endif
+#ifdef AUDIO_HAVE_NEON
+	case AV_AUDIO_ENGINE_NEON:
+		audio_neon_encode(law, pcm, n, out);
+		break;
+#endif
+	default:
+		audio_portable_encode(law, pcm, n, out);
+		break;
+	}
+}
+
+static void audio_decode(AVAudioEngine engine, AVG711Law law, const unsigned char *in, int n, short *pcm)
+{
+	switch (engine) {
+#ifdef AUDIO_HAVE_SSE2
+	case AV_AUDIO_ENGINE_SSE2:
+		audio_sse2_decode(law, in, n, pcm);
+		break;
+#endif
+#ifdef AUDIO_HAVE_NEON
+	case AV_AUDIO_ENGINE_NEON:
+		audio_neon_decode(law, in, n, pcm);
+		break;
+#endif
+	default:
+		audio_portable_decode(law, in, n, pcm);
+		break;
+	}
+}
+
+int avG711Encode(AVG711Law law, const short *pcm, int nSamples, unsigned char *pOut)
+{
+	if (pcm == NULL || pOut == NULL || nSamples < 0 || (law != AV_G711_ULAW && law != AV_G711_ALAW))
+		return AV_ER_INVALID_ARG;
+	audio_encode(avAudioGetEngine(), law, pcm, nSamples, pOut);
+	return AV_ER_NoERROR;
+}
+
+int avG711Decode(AVG711Law law, const unsigned char *cabIn, int nSamples, short *pPcm)
+{
+	if (cabIn == NULL || pPcm == NULL || nSamples < 0 || (law != AV_G711_ULAW && law != AV_G711_ALAW))
+		return AV_ER_INVALID_ARG;
+	audio_decode(avAudioGetEngine(), law, cabIn, nSamples, pPcm);
+	return AV_ER_NoERROR;
+}
+
+/* ============================================================================
+ * Resampler
+ * ============================================================================
+ */
+
+// The half-band filter (1, -5, 20, 20, -5, 1) / 32 between two samples
+#define RESAMPLE_BLOCK			256
+
+static short resample_clip(int v)
+{
+	return (short)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+// Upsample from b, which starts with 5 samples of history; gives 2 * n samples
+static void resample_up(const short *b, int n, short *out)
+{
+	int i, c;
+
+	for (i = 0; i < n; i++) {
+		c = i + 2;
+		out[2 * i] = b[c];
+		out[2 * i + 1] = resample_clip((20 * (b[c] + b[c + 1]) - 5 * (b[c - 1] + b[c + 2]) + b[c - 2] + b[c + 3] + 16) >> 5);
+	}
+}
+
+// Low pass and keep every other sample: (1, 0, -5, 0, 20, 32, 20, 0, -5, 0, 1) / 64 centered on b[c]
+static short resample_down_at(const short *b, int c)
+{
+	return resample_clip((32 * b[c] + 20 * (b[c - 1] + b[c + 1]) - 5 * (b[c - 3] + b[c + 3]) + b[c - 5] + b[c + 5] + 32) >> 6);
+}
+
+int avResamplerInit(AVResampler *pResampler, AVResampleMode mode)
+{
+	if (pResampler == NULL || (mode != AV_RESAMPLE_8K_TO_16K && mode != AV_RESAMPLE_16K_TO_8K))
+		return AV_ER_INVALID_ARG;
+	memset(pResampler, 0, sizeof(*pResampler));
+	pResampler->mode = mode;
+	// Start from silence: 5 samples for upsampling, the 5 left of the first center for downsampling
+	pResampler->historyCount = 5;
+	return AV_ER_NoERROR;
+}
+
+int avResample(AVResampler *pResampler, const short *pcm, int nSamples, short *pOut)
+{
+	short b[AV_RESAMPLE_HISTORY + RESAMPLE_BLOCK];
+	int h, n, done = 0, written = 0, c, len;
+
+	if (pResampler == NULL || pcm == NULL || pOut == NULL || nSamples < 0 ||
+		pResampler->historyCount < 0 || pResampler->historyCount > AV_RESAMPLE_HISTORY)
+		return AV_ER_INVALID_ARG;
+
+	while (done < nSamples) {
+		h = pResampler->historyCount;
+		n = nSamples - done < RESAMPLE_BLOCK ? nSamples - done : RESAMPLE_BLOCK;
+		memcpy(b, pResampler->history, (size_t)h * sizeof(short));
+		memcpy(b + h, pcm + done, (size_t)n * sizeof(short));
+		len = h + n;
+		done += n;
+
+		if (pResampler->mode == AV_RESAMPLE_8K_TO_16K) {
+			// Each output pair needs 2 samples before and 3 after; the history is always 5
+			resample_up(b, len - 5, pOut + written);
+			written += 2 * (len - 5);
+			h = 5;
+			memcpy(pResampler->history, b + len - 5, 5 * sizeof(short));
+		} else {
+			// Centers are every other sample from b[5], each needing 5 samples on both sides
+			for (c = 5; c + 5 < len; c += 2)
+				pOut[written++] = resample_down_at(b, c);
+			h = len - (c - 5);
+			memcpy(pResampler->history, b + c - 5, (size_t)h * sizeof(short));
+		}
+		pResampler->historyCount = h;
+	}
+	return written;
+}
+
+/* ============================================================================
+ * Engines
+ * ============================================================================
+ */
+
+int avAudioEngineSupported(AVAudioEngine engine)
+{
+	switch (engine) {
+	case AV_AUDIO_ENGINE_AUTO:
+	case AV_AUDIO_ENGINE_PORTABLE:
+		return 1;
+	case AV_AUDIO_ENGINE_SSE2:
+		return audio_detect_sse2();
+	case AV_AUDIO_ENGINE_NEON:
+		return audio_detect_neon();
+	default:
+		return 0;
+	}
+}
+
+AVAudioEngine avAudioGetEngine(void)
+{
+	audio_init();
+	return gForcedEngine != AV_AUDIO_ENGINE_AUTO ? gForcedEngine : gDetectedEngine;
+}
+
+int avAudioSetEngine(AVAudioEngine engine)
+{
+	if (engine < AV_AUDIO_ENGINE_AUTO || engine > AV_AUDIO_ENGINE_NEON || !avAudioEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	gForcedEngine = engine;
+	return AV_ER_NoERROR;
+}
+
+// Million samples per second of one kernel over 20 ms frames at 16 kHz
+static float audio_bench_run(AVAudioEngine engine, int kernel, unsigned int duration_ms, short *pcm,
+							 unsigned char *g711, short *out)
+{
+	const int n = 320, batch = 64;
+	AVResampler r;
+	uint64_t start, elapsed, samples = 0;
+	int i;
+
+	avResamplerInit(&r, kernel == 4 ? AV_RESAMPLE_8K_TO_16K : AV_RESAMPLE_16K_TO_8K);
+	start = ext_now_us();
+	do {
+		// A frame takes well under a microsecond, so read the clock once per batch
+		for (i = 0; i < batch; i++) {
+			switch (kernel) {
+			case 0:
+				audio_encode(engine, AV_G711_ULAW, pcm, n, g711);
+				break;
+			case 1:
+				audio_decode(engine, AV_G711_ULAW, g711, n, out);
+				break;
+			case 2:
+				audio_encode(engine, AV_G711_ALAW, pcm, n, g711);
+				break;
+			case 3:
+				audio_decode(engine, AV_G711_ALAW, g711, n, out);
+				break;
+			case 4:
+				avResample(&r, pcm, n / 2, out);
+				break;
+			default:
+				avResample(&r, pcm, n, out);
+				break;
+			}
+		}
+		samples += (uint64_t)batch * (uint64_t)(kernel == 4 ? n / 2 : n);
+		elapsed = ext_now_us() - start;
+	} while (elapsed < (uint64_t)duration_ms * 1000ULL);
+	return (float)((double)samples / (double)elapsed);
+}
+
+int avAudioCodecBenchmark(AVAudioEngine engine, unsigned int nDurationMs, AVAudioBenchmark *pResult)
+{
+	short pcm[320], out[640];
+	unsigned char g711[320];
+	unsigned int seed = 0x2545f491;
+	int i;
+
+	if (pResult == NULL || nDurationMs == 0 || !avAudioEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	if (engine == AV_AUDIO_ENGINE_AUTO)
+		engine = avAudioGetEngine();
+	audio_init();
+	for (i = 0; i < 320; i++) {
+		seed = seed * 1103515245 + 12345;
+		pcm[i] = (short)(seed >> 16);
+	}
+	audio_encode(engine, AV_G711_ULAW, pcm, 320, g711);
+
+	pResult->ulawEncode = audio_bench_run(engine, 0, nDurationMs, pcm, g711, out);
+	pResult->ulawDecode = audio_bench_run(engine, 1, nDurationMs, pcm, g711, out);
+	pResult->alawEncode = audio_bench_run(engine, 2, nDurationMs, pcm, g711, out);
+	pResult->alawDecode = audio_bench_run(engine, 3, nDurationMs, pcm, g711, out);
+	pResult->upsample = audio_bench_run(engine, 4, nDurationMs, pcm, g711, out);
+	pResult->downsample = audio_bench_run(engine, 5, nDurationMs, pcm, g711, out);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,294 @@
+/*! \file av_bitrate.c
+Bitrate controllers, see AVBitrateAPIs.h.
+
+Drops are immediate: as soon as the pacer rate says the path carries less
+than the target, the target goes a little under it, and a queue building up
+cuts it once per RTT. Rises wait until the path has been clear for the hold
+time and then go up one step, so a noisy estimate never moves the encoder
+back and forth.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVBitrateAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+#include "ext_pacer.h"
+
+#define BITRATE_DROP_MARGIN			95	// percent of the available bandwidth a drop goes to
+#define BITRATE_DELAY_CUT			85	// percent kept by a cut for queueing delay
+#define BITRATE_MIN_CUT_US			100000ULL
+#define BITRATE_MIN_RTT_WINDOW_US	10000000ULL
+
+typedef struct Bitrate {
+	int av_index;
+	AVBitrateConfig config;
+	AVBitrateRung *ladder;
+	avBitrateChangeFn change_fn;
+	void *user_data;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	pthread_t thread;
+	unsigned int rung;
+	unsigned int min_rtt_ms;
+	uint64_t min_rtt_stamp_us;
+	uint64_t last_cut_us;
+	uint64_t last_rise_us;
+	uint64_t clear_since_us;
+	ExtPacer *pacer;		// the last pacer sampled, kept pinned
+	unsigned int last_queue_full;
+	AVBitrateStats stats;
+} Bitrate;
+
+static ExtTable gBitrates = EXT_TABLE_INITIALIZER;
+
+static unsigned int bitrate_clamp(const Bitrate *b, double kbps)
+{
+	if (kbps < b->config.minKbps)
+		return b->config.minKbps;
+	if (kbps > b->config.maxKbps)
+		return b->config.maxKbps;
+	return (unsigned int)kbps;
+}
+
+// Moves one rung at a time, up only once the target clears the next rung by the hysteresis
+static unsigned int bitrate_fps(Bitrate *b, unsigned int kbps)
+{
+	if (b->ladder == NULL)
+		return b->config.maxFps;
+	while (b->rung > 0 && kbps < b->ladder[b->rung].nKbps)
+		b->rung--;
+	while (b->rung + 1 < b->config.ladderCount &&
+		   kbps >= (uint64_t)b->ladder[b->rung + 1].nKbps * (100 + AV_BITRATE_HYSTERESIS) / 100)
+		b->rung++;
+	return b->ladder[b->rung].nFps;
+}
+
+// Returns 1 if the application should be told. Takes over the pin on p.
+static int bitrate_update(Bitrate *b, ExtPacer *p)
+{
+	AVBitrateStats *st = &b->stats;
+	IOTCPacerStats pacer;
+	struct st_AvStatus status;
+	uint64_t now = ext_now_us(), rtt_us;
+	unsigned int rtt_ms = 0, target = st->targetKbps, fps, queue_full;
+	int congested, clear;
+
+	ext_pacer_get_stats(p, &pacer);
+	if (p != b->pacer) {
+		// The pacer of a new session after a reconnection counts from zero. Keeping the
+		// last one pinned means a new pacer can never be taken for it.
+		b->last_queue_full = pacer.queueFullCount;
+		ext_pacer_put(b->pacer);
+		b->pacer = p;
+	} else {
+		ext_pacer_put(p);
+	}
+	st->availableKbps = (unsigned int)((uint64_t)pacer.rate * 8 / 1000 * b->config.headroomPercent / 100);
+	queue_full = pacer.queueFullCount - b->last_queue_full;
+	b->last_queue_full = pacer.queueFullCount;
+
+	memset(&status, 0, sizeof(status));
+	if (avStatusCheck(b->av_index, &status) == AV_ER_NoERROR)
+		rtt_ms = status.LastRtt != 0 ? status.LastRtt : status.RoundTripTime;
+	if (rtt_ms > 0 && (b->min_rtt_ms == 0 || rtt_ms <= b->min_rtt_ms ||
+					   now - b->min_rtt_stamp_us > BITRATE_MIN_RTT_WINDOW_US)) {
+		b->min_rtt_ms = rtt_ms;
+		b->min_rtt_stamp_us = now;
+	}
+	st->queueDelayMs = rtt_ms > b->min_rtt_ms ? rtt_ms - b->min_rtt_ms : 0;
+	st->resendUsage = avResendBufUsageRate(b->av_index);
+	if (st->resendUsage < 0)
+		st->resendUsage = -1;
+
+	congested = st->queueDelayMs > b->config.delayThresholdMs || st->resendUsage >= AV_BITRATE_CONGESTED_USAGE ||
+				queue_full > 0;
+	clear = !congested && st->queueDelayMs <= b->config.delayThresholdMs / 2 &&
+			st->resendUsage < AV_BITRATE_CONGESTED_USAGE / 2;
+	rtt_us = (uint64_t)rtt_ms * 1000;
+
+	if (st->availableKbps < target) {
+		// The pacer already knows the path got slower, follow it right away
+		target = bitrate_clamp(b, (double)st->availableKbps * BITRATE_DROP_MARGIN / 100);
+	} else if (congested && now - b->last_cut_us >= (rtt_us > BITRATE_MIN_CUT_US ? rtt_us : BITRATE_MIN_CUT_US)) {
+		target = bitrate_clamp(b, (double)target * BITRATE_DELAY_CUT / 100);
+	}
+	if (target < st->targetKbps) {
+		b->last_cut_us = now;
+		b->clear_since_us = 0;
+		st->decreases++;
+	} else if (!clear) {
+		b->clear_since_us = 0;
+	} else if (b->clear_since_us == 0) {
+		b->clear_since_us = now;
+	} else if (now - b->clear_since_us >= (uint64_t)b->config.increaseHoldMs * 1000 &&
+			   now - b->last_rise_us >= (uint64_t)b->config.increaseHoldMs * 1000 &&
+			   target < b->config.maxKbps &&
+			   st->availableKbps >= (uint64_t)target * (100 + AV_BITRATE_HYSTERESIS) / 100) {
+		double step = (double)target * (100 + AV_BITRATE_INCREASE_STEP) / 100;
+		double room = (double)st->availableKbps * 100 / (100 + AV_BITRATE_HYSTERESIS);
+
+		target = bitrate_clamp(b, step < room ? step : room);
+		if (target > st->targetKbps) {
+			b->last_rise_us = now;
+			st->increases++;
+		}
+	}
+
+	fps = bitrate_fps(b, target);
+	if (target == st->targetKbps && fps == st->fps)
+		return 0;
+	st->targetKbps = target;
+	st->fps = fps;
+	return 1;
+}
+
+static void *bitrate_thread(void *arg)
+{
+	Bitrate *b = (Bitrate *)arg;
+	unsigned int kbps, fps;
+	int notify = 1;
+	ExtPacer *p;
+
+	pthread_mutex_lock(&b->lock);
+	while (!b->stop) {
+		if (notify) {
+			b->stats.notifications++;
+			kbps = b->stats.targetKbps;
+			fps = b->stats.fps;
+			pthread_mutex_unlock(&b->lock);
+			b->change_fn(b->av_index, kbps, fps, b->user_data);
+			pthread_mutex_lock(&b->lock);
+		}
+		ext_cond_wait_ms(&b->cond, &b->lock, AV_BITRATE_SAMPLE_INTERVAL);
+		if (b->stop)
+			break;
+		// Looked up every time since a reconnection moves the pacer to a new session
+		p = ext_pacer_get_av(b->av_index);
+		notify = p != NULL && bitrate_update(b, p);
+	}
+	pthread_mutex_unlock(&b->lock);
+	return NULL;
+}
+
+static void bitrate_free(Bitrate *b)
+{
+	pthread_cond_destroy(&b->cond);
+	pthread_mutex_destroy(&b->lock);
+	ext_pacer_put(b->pacer);
+	free(b->ladder);
+	free(b);
+}
+
+static int bitrate_config_valid(const AVBitrateConfig *c)
+{
+	unsigned int i;
+
+	if (c == NULL || c->cb != sizeof(AVBitrateConfig) || c->minKbps == 0 || c->maxKbps < c->minKbps ||
+		c->headroomPercent > 100)
+		return 0;
+	if (c->startKbps != 0 && (c->startKbps < c->minKbps || c->startKbps > c->maxKbps))
+		return 0;
+	if (c->ladder == NULL)
+		return c->maxFps > 0;
+	if (c->ladderCount == 0 || c->ladder[0].nKbps > c->minKbps)
+		return 0;
+	for (i = 0; i < c->ladderCount; i++)
+		if (c->ladder[i].nFps == 0 || (i > 0 && c->ladder[i].nKbps <= c->ladder[i - 1].nKbps))
+			return 0;
+	return 1;
+}
+
+int avBitrateAttach(int nAVChannelID, const AVBitrateConfig *pConfig, avBitrateChangeFn pfxChangeFn,
+					void *pUserData)
+{
+	IOTCPacerStats pacer;
+	Bitrate *b;
+	ExtPacer *p;
+
+	if (nAVChannelID < 0 || pfxChangeFn == NULL || !bitrate_config_valid(pConfig))
+		return AV_ER_INVALID_ARG;
+	p = ext_pacer_get_av(nAVChannelID);
+	if (p == NULL)
+		return AV_ER_INVALID_SID;
+
+	b = (Bitrate *)calloc(1, sizeof(Bitrate));
+	if (b == NULL) {
+		ext_pacer_put(p);
+		return AV_ER_MEM_INSUFF;
+	}
+	ext_pacer_get_stats(p, &pacer);
+	b->pacer = p;
+	b->av_index = nAVChannelID;
+	b->config = *pConfig;
+	if (b->config.startKbps == 0)
+		b->config.startKbps = b->config.minKbps;
+	if (b->config.headroomPercent == 0)
+		b->config.headroomPercent = AV_BITRATE_DEFAULT_HEADROOM;
+	if (b->config.delayThresholdMs == 0)
+		b->config.delayThresholdMs = AV_BITRATE_DEFAULT_DELAY_THRESHOLD;
+	if (b->config.increaseHoldMs == 0)
+		b->config.increaseHoldMs = AV_BITRATE_DEFAULT_INCREASE_HOLD;
+	if (pConfig->ladder != NULL) {
+		b->ladder = (AVBitrateRung *)malloc(pConfig->ladderCount * sizeof(AVBitrateRung));
+		if (b->ladder == NULL) {
+			ext_pacer_put(p);
+			free(b);
+			return AV_ER_MEM_INSUFF;
+		}
+		memcpy(b->ladder, pConfig->ladder, pConfig->ladderCount * sizeof(AVBitrateRung));
+	}
+	b->config.ladder = b->ladder;
+	b->change_fn = pfxChangeFn;
+	b->user_data = pUserData;
+	b->last_queue_full = pacer.queueFullCount;
+	b->stats.targetKbps = b->config.startKbps;
+	b->stats.resendUsage = -1;
+	// Start on the highest rung the start target reaches, without the hysteresis
+	if (b->ladder != NULL)
+		while (b->rung + 1 < b->config.ladderCount && b->config.startKbps >= b->ladder[b->rung + 1].nKbps)
+			b->rung++;
+	b->stats.fps = bitrate_fps(b, b->config.startKbps);
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->cond, NULL);
+
+	if (ext_table_set(&gBitrates, nAVChannelID, b) < 0) {
+		bitrate_free(b);
+		return AV_ER_INVALID_ARG;
+	}
+	if (pthread_create(&b->thread, NULL, bitrate_thread, b) != 0) {
+		ext_table_take(&gBitrates, nAVChannelID);
+		bitrate_free(b);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avBitrateDetach(int nAVChannelID)
+{
+	Bitrate *b = (Bitrate *)ext_table_take(&gBitrates, nAVChannelID);
+
+	if (b == NULL)
+		return;
+	pthread_mutex_lock(&b->lock);
+	b->stop = 1;
+	pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+	pthread_join(b->thread, NULL);
+	bitrate_free(b);
+}
+
+int avBitrateGetStats(int nAVChannelID, AVBitrateStats *pStats)
+{
+	Bitrate *b = (Bitrate *)ext_table_get(&gBitrates, nAVChannelID);
+
+	if (b == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&b->lock);
+	*pStats = b->stats;
+	pthread_mutex_unlock(&b->lock);
+	return AV_ER_NoERROR;
+}
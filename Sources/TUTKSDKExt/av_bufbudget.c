@@ -0,0 +1,442 @@
+/*! \file av_bufbudget.c
+Receive buffer budgets, see AVBufBudgetAPIs.h.
+
+Every AV_BUFBUDGET_INTERVAL the manager thread turns the bytes received
+since the last round into a bitrate, smoothed over a few rounds, and reads
+avClientRecvBufUsageRate(). The demand of an AV channel is its bitrate
+times bufferMs times its pressure, within minKB and maxKB. If the demands
+exceed the cap, every AV channel keeps minKB and the rest is shared by
+weighted max-min fairness: AV channels that need less than their share
+get what they need, and the others split what is left by weight.
+A budget is only reported when it moves by more than an eighth, so small
+bitrate changes do not call back every round. The thread exits when the
+last AV channel is detached.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVBufBudgetAPIs.h"
+#include "ext_platform.h"
+
+// The weight of a new bitrate measurement in the smoothed bitrate
+#define BUDGET_KBPS_ALPHA		0.3
+
+// Pressure grows by this factor per round with a high usage rate, and shrinks by the other one with a low rate
+#define BUDGET_PRESSURE_GROW	1.5f
+#define BUDGET_PRESSURE_DECAY	0.9f
+
+typedef struct Budget {
+	struct Budget *next;
+	int av_index;
+	unsigned int weight;
+	unsigned int expected_kbps;
+	unsigned int start_kb;
+	uint64_t bytes; // Received since the last round
+	double kbps;
+	int measured; // kbps is measured, not expected
+	float usage;
+	float pressure;
+	unsigned int demand_kb;
+	unsigned int alloc_kb; // This round
+	unsigned int budget_kb; // Last reported
+} Budget;
+
+typedef struct BudgetChange {
+	int av_index;
+	unsigned int kb;
+} BudgetChange;
+
+static pthread_mutex_t gBudgetLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gBudgetCond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t gBudgetStartLock = PTHREAD_MUTEX_INITIALIZER;
+static Budget *gBudgets = NULL;
+static int gBudgetThreadRunning = 0;
+static pthread_t gBudgetThread;
+static AVBufBudgetConfig gBudgetConfig = {
+	sizeof(AVBufBudgetConfig), AV_BUFBUDGET_DEFAULT_TOTAL_KB, AV_BUFBUDGET_DEFAULT_MIN_KB,
+	AV_BUFBUDGET_DEFAULT_MAX_KB, AV_BUFBUDGET_DEFAULT_BUFFER_MS, AV_BUFBUDGET_DEFAULT_CLIENT_BUF_KB
+};
+static avBufBudgetChangeFn gBudgetChangeFn = NULL;
+static void *gBudgetUserData = NULL;
+static AVBufBudgetStats gBudgetStats;
+
+// Caller holds gBudgetLock
+static Budget *budget_find_locked(int nAVChannelID)
+{
+	Budget *b;
+
+	for (b = gBudgets; b != NULL; b = b->next) {
+		if (b->av_index == nAVChannelID)
+			return b;
+	}
+	return NULL;
+}
+
+// Caller holds gBudgetLock
+static unsigned int budget_demand_locked(const Budget *b)
+{
+	double kbps = b->measured ? b->kbps : (double)b->expected_kbps;
+	double kb = kbps / 8.0 * (double)gBudgetConfig.bufferMs / 1000.0 * (double)b->pressure;
+
+	if (kb < (double)gBudgetConfig.minKB)
+		return gBudgetConfig.minKB;
+	if (kb > (double)gBudgetConfig.maxKB)
+		return gBudgetConfig.maxKB;
+	return (unsigned int)kb;
+}
+
+// Caller holds gBudgetLock. Sets alloc_kb of every budget from demand_kb within the cap.
+static void budget_fit_locked(void)
+{
+	unsigned int n = 0, total = gBudgetConfig.totalKB, min = gBudgetConfig.minKB, left, share;
+	unsigned long long weights, demand = 0;
+	int satisfied;
+	Budget *b;
+
+	for (b = gBudgets; b != NULL; b = b->next) {
+		n++;
+		demand += b->demand_kb;
+		b->alloc_kb = b->demand_kb;
+	}
+	gBudgetStats.channels = n;
+	gBudgetStats.totalKB = total;
+	gBudgetStats.demandKB = demand > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)demand;
+	if (n == 0 || demand <= total) {
+		gBudgetStats.allocatedKB = (unsigned int)demand;
+		return;
+	}
+	if ((unsigned long long)n * min >= total) {
+		for (b = gBudgets; b != NULL; b = b->next)
+			b->alloc_kb = total / n;
+		gBudgetStats.allocatedKB = total / n * n;
+		return;
+	}
+
+	// Everyone keeps min; share the rest, handing out full demands first
+	left = total - n * min;
+	for (b = gBudgets; b != NULL; b = b->next)
+		b->alloc_kb = min;
+	do {
+		satisfied = 0;
+		weights = 0;
+		for (b = gBudgets; b != NULL; b = b->next) {
+			if (b->alloc_kb < b->demand_kb)
+				weights += b->weight;
+		}
+		if (weights == 0)
+			break;
+		for (b = gBudgets; b != NULL; b = b->next) {
+			if (b->alloc_kb < b->demand_kb &&
+				b->demand_kb - b->alloc_kb <= (unsigned long long)left * b->weight / weights) {
+				left -= b->demand_kb - b->alloc_kb;
+				b->alloc_kb = b->demand_kb;
+				satisfied = 1;
+			}
+		}
+	} while (satisfied);
+	if (weights > 0) {
+		for (b = gBudgets; b != NULL; b = b->next) {
+			if (b->alloc_kb < b->demand_kb) {
+				share = (unsigned int)((unsigned long long)left * b->weight / weights);
+				b->alloc_kb += share;
+			}
+		}
+	}
+	gBudgetStats.allocatedKB = 0;
+	for (b = gBudgets; b != NULL; b = b->next)
+		gBudgetStats.allocatedKB += b->alloc_kb;
+}
+
+// Caller holds gBudgetLock. Measures one AV channel over elapsed_ms.
+static void budget_measure_locked(Budget *b, uint64_t elapsed_ms)
+{
+	double kbps;
+
+	if (b->bytes > 0 && elapsed_ms > 0) {
+		kbps = (double)b->bytes * 8.0 / (double)elapsed_ms;
+		b->kbps = b->measured ? b->kbps + BUDGET_KBPS_ALPHA * (kbps - b->kbps) : kbps;
+		b->measured = 1;
+	}
+	b->bytes = 0;
+
+	b->usage = avClientRecvBufUsageRate(b->av_index);
+	if (b->usage >= AV_BUFBUDGET_HIGH_USAGE) {
+		b->pressure *= BUDGET_PRESSURE_GROW;
+		if (b->pressure > AV_BUFBUDGET_MAX_PRESSURE)
+			b->pressure = AV_BUFBUDGET_MAX_PRESSURE;
+	} else if (b->usage >= 0.0f && b->usage <= AV_BUFBUDGET_LOW_USAGE) {
+		b->pressure *= BUDGET_PRESSURE_DECAY;
+		if (b->pressure < 1.0f)
+			b->pressure = 1.0f;
+	}
+	b->demand_kb = budget_demand_locked(b);
+}
+
+static void *budget_thread(void *arg)
+{
+	uint64_t last = ext_now_ms(), now;
+	BudgetChange *changes = NULL;
+	unsigned int n, i, cap = 0;
+	avBufBudgetChangeFn fn;
+	void *user;
+	Budget *b;
+
+	(void)arg;
+	pthread_mutex_lock(&gBudgetLock);
+	while (gBudgets != NULL) {
+		ext_cond_wait_ms(&gBudgetCond, &gBudgetLock, AV_BUFBUDGET_INTERVAL);
+		now = ext_now_ms();
+		if (now - last < AV_BUFBUDGET_INTERVAL)
+			continue;
+		for (b = gBudgets; b != NULL; b = b->next)
+			budget_measure_locked(b, now - last);
+		last = now;
+		budget_fit_locked();
+
+		n = 0;
+		for (b = gBudgets; b != NULL; b = b->next) {
+			if (b->alloc_kb == b->budget_kb ||
+				(b->alloc_kb > b->budget_kb ? b->alloc_kb - b->budget_kb : b->budget_kb - b->alloc_kb) <=
+					b->budget_kb / 8)
+				continue;
+			b->budget_kb = b->alloc_kb;
+			if (gBudgetChangeFn == NULL)
+				continue;
+			if (n == cap) {
+				BudgetChange *grown = (BudgetChange *)realloc(changes, (cap + 16) * sizeof(BudgetChange));
+				if (grown == NULL)
+					break;
+				changes = grown;
+				cap += 16;
+			}
+			changes[n].av_index = b->av_index;
+			changes[n].kb = b->budget_kb;
+			n++;
+		}
+		gBudgetStats.changes += n;
+		fn = gBudgetChangeFn;
+		user = gBudgetUserData;
+		pthread_mutex_unlock(&gBudgetLock);
+		for (i = 0; i < n; i++)
+			fn(changes[i].av_index, changes[i].kb, user);
+		pthread_mutex_lock(&gBudgetLock);
+	}
+	gBudgetThreadRunning = 0;
+	pthread_mutex_unlock(&gBudgetLock);
+	free(changes);
+	return NULL;
+}
+
+// Caller holds gBudgetLock. Adds a budget with an initial size; returns AV_ER_NoERROR or an error.
+static int budget_add_locked(int nAVChannelID, unsigned int nExpectedKbps, unsigned int nWeight, unsigned int start_kb,
+							 unsigned int budget_kb)
+{
+	Budget *b;
+
+	if (budget_find_locked(nAVChannelID) != NULL)
+		return AV_ER_INVALID_ARG;
+	b = (Budget *)calloc(1, sizeof(Budget));
+	if (b == NULL)
+		return AV_ER_MEM_INSUFF;
+	b->av_index = nAVChannelID;
+	b->weight = nWeight > 0 ? nWeight : 1;
+	b->expected_kbps = nExpectedKbps;
+	b->start_kb = start_kb;
+	b->pressure = 1.0f;
+	b->usage = -1.0f;
+	b->demand_kb = budget_demand_locked(b);
+	b->budget_kb = budget_kb;
+	b->alloc_kb = budget_kb;
+	b->next = gBudgets;
+	gBudgets = b;
+	gBudgetStats.channels++;
+
+	if (!gBudgetThreadRunning) {
+		if (pthread_create(&gBudgetThread, NULL, budget_thread, NULL) != 0) {
+			gBudgets = b->next;
+			gBudgetStats.channels--;
+			free(b);
+			return AV_ER_FAIL_CREATE_THREAD;
+		}
+		pthread_detach(gBudgetThread);
+		gBudgetThreadRunning = 1;
+	}
+	return AV_ER_NoERROR;
+}
+
+// Caller holds gBudgetLock. The budget a new AV channel gets now, without taking from the others yet;
+// 0 if they leave less than minKB under the cap.
+static unsigned int budget_initial_locked(unsigned int nExpectedKbps)
+{
+	Budget probe;
+	unsigned int used = 0, kb;
+	Budget *b;
+
+	memset(&probe, 0, sizeof(probe));
+	probe.expected_kbps = nExpectedKbps;
+	probe.pressure = 1.0f;
+	kb = budget_demand_locked(&probe);
+	for (b = gBudgets; b != NULL; b = b->next)
+		used += b->budget_kb;
+	if (used > gBudgetConfig.totalKB || gBudgetConfig.totalKB - used < gBudgetConfig.minKB)
+		return 0;
+	if (kb > gBudgetConfig.totalKB - used)
+		kb = gBudgetConfig.totalKB - used;
+	return kb;
+}
+
+int avBufBudgetSetup(const AVBufBudgetConfig *pConfig, avBufBudgetChangeFn pfxChangeFn, void *pUserData)
+{
+	AVBufBudgetConfig config = {
+		sizeof(AVBufBudgetConfig), AV_BUFBUDGET_DEFAULT_TOTAL_KB, AV_BUFBUDGET_DEFAULT_MIN_KB,
+		AV_BUFBUDGET_DEFAULT_MAX_KB, AV_BUFBUDGET_DEFAULT_BUFFER_MS, AV_BUFBUDGET_DEFAULT_CLIENT_BUF_KB
+	};
+
+	if (pConfig != NULL) {
+		if (pConfig->cb != sizeof(AVBufBudgetConfig))
+			return AV_ER_INVALID_ARG;
+		if (pConfig->totalKB != 0)
+			config.totalKB = pConfig->totalKB;
+		if (pConfig->minKB != 0)
+			config.minKB = pConfig->minKB;
+		if (pConfig->maxKB != 0)
+			config.maxKB = pConfig->maxKB;
+		if (pConfig->bufferMs != 0)
+			config.bufferMs = pConfig->bufferMs;
+		if (pConfig->clientBufKB != 0)
+			config.clientBufKB = pConfig->clientBufKB;
+	}
+	if (config.minKB > config.maxKB)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gBudgetLock);
+	gBudgetConfig = config;
+	gBudgetChangeFn = pfxChangeFn;
+	gBudgetUserData = pUserData;
+	pthread_mutex_unlock(&gBudgetLock);
+	return AV_ER_NoERROR;
+}
+
+int avClientStartBudgeted(LPCAVCLIENT_START_IN_CONFIG AVClientInConfig, LPAVCLIENT_START_OUT_CONFIG AVClientOutConfig,
+						  unsigned int nExpectedKbps, unsigned int nWeight)
+{
+	unsigned int kb, client_kb;
+	int av, ret;
+
+	// The buffer size is global to the AV module, so nothing else may start in between
+	pthread_mutex_lock(&gBudgetStartLock);
+	pthread_mutex_lock(&gBudgetLock);
+	kb = budget_initial_locked(nExpectedKbps);
+	client_kb = gBudgetConfig.clientBufKB;
+	pthread_mutex_unlock(&gBudgetLock);
+	if (kb == 0) {
+		pthread_mutex_unlock(&gBudgetStartLock);
+		return AV_ER_EXCEED_MAX_SIZE;
+	}
+	avClientSetMaxBufSize(kb);
+	av = avClientStartEx(AVClientInConfig, AVClientOutConfig);
+	// Starts made otherwise get the buffer of the application again
+	avClientSetMaxBufSize(client_kb);
+	pthread_mutex_unlock(&gBudgetStartLock);
+	if (av < 0)
+		return av;
+
+	pthread_mutex_lock(&gBudgetLock);
+	ret = budget_add_locked(av, nExpectedKbps, nWeight, kb, kb);
+	pthread_mutex_unlock(&gBudgetLock);
+	if (ret < 0) {
+		avClientStop(av);
+		return ret;
+	}
+	return av;
+}
+
+int avBufBudgetAttach(int nAVChannelID, unsigned int nExpectedKbps, unsigned int nWeight)
+{
+	unsigned int kb;
+	int ret;
+
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gBudgetLock);
+	if (budget_find_locked(nAVChannelID) != NULL)
+		ret = AV_ER_INVALID_ARG;
+	else if ((kb = budget_initial_locked(nExpectedKbps)) == 0)
+		ret = AV_ER_EXCEED_MAX_SIZE;
+	else
+		ret = budget_add_locked(nAVChannelID, nExpectedKbps, nWeight, 0, kb);
+	pthread_mutex_unlock(&gBudgetLock);
+	return ret;
+}
+
+void avBufBudgetDetach(int nAVChannelID)
+{
+	Budget **pp, *b;
+
+	pthread_mutex_lock(&gBudgetLock);
+	for (pp = &gBudgets; (b = *pp) != NULL; pp = &b->next) {
+		if (b->av_index == nAVChannelID) {
+			*pp = b->next;
+			gBudgetStats.channels--;
+			free(b);
+			break;
+		}
+	}
+	pthread_cond_signal(&gBudgetCond);
+	pthread_mutex_unlock(&gBudgetLock);
+}
+
+int avBufBudgetSetWeight(int nAVChannelID, unsigned int nWeight)
+{
+	Budget *b;
+
+	pthread_mutex_lock(&gBudgetLock);
+	b = budget_find_locked(nAVChannelID);
+	if (b != NULL)
+		b->weight = nWeight > 0 ? nWeight : 1;
+	pthread_mutex_unlock(&gBudgetLock);
+	return b != NULL ? AV_ER_NoERROR : AV_ER_INVALID_ARG;
+}
+
+void avBufBudgetReceived(int nAVChannelID, int nBytes)
+{
+	Budget *b;
+
+	if (nBytes <= 0)
+		return;
+	pthread_mutex_lock(&gBudgetLock);
+	b = budget_find_locked(nAVChannelID);
+	if (b != NULL)
+		b->bytes += (uint64_t)nBytes;
+	pthread_mutex_unlock(&gBudgetLock);
+}
+
+int avBufBudgetGetInfo(int nAVChannelID, AVBufBudgetInfo *pInfo)
+{
+	Budget *b;
+
+	if (pInfo == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gBudgetLock);
+	b = budget_find_locked(nAVChannelID);
+	if (b != NULL) {
+		pInfo->budgetKB = b->budget_kb;
+		pInfo->startKB = b->start_kb;
+		pInfo->kbps = (unsigned int)(b->measured ? b->kbps : (double)b->expected_kbps);
+		pInfo->usage = b->usage;
+		pInfo->pressure = b->pressure;
+		pInfo->weight = b->weight;
+	}
+	pthread_mutex_unlock(&gBudgetLock);
+	return b != NULL ? AV_ER_NoERROR : AV_ER_INVALID_ARG;
+}
+
+int avBufBudgetGetStats(AVBufBudgetStats *pStats)
+{
+	if (pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gBudgetLock);
+	*pStats = gBudgetStats;
+	pthread_mutex_unlock(&gBudgetLock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,558 @@
+/*! \file av_congestion.c
+Congestion controllers driving the session pacers, see AVCongestionAPIs.h.
+
+The AV module does not report individual ACKs, so a controller thread per AV
+channel polls avStatusCheck() and the pacer statistics every
+AV_CC_SAMPLE_INTERVAL and hands the result to the controller. The built-in
+controllers only see AVCongestionSample, which keeps them replayable.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVCongestionAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+#include "ext_pacer.h"
+
+#define CC_MIN_RTT_WINDOW_US	10000000ULL
+#define CC_NO_RTT_ROUND_US		100000ULL
+
+static unsigned int cc_clamp_rate(double rate)
+{
+	if (rate < IOTC_PACER_AUTO_MIN_RATE)
+		return IOTC_PACER_AUTO_MIN_RATE;
+	if (rate > IOTC_PACER_AUTO_MAX_RATE)
+		return IOTC_PACER_AUTO_MAX_RATE;
+	return (unsigned int)rate;
+}
+
+// Windowed minimum of the RTT. MinRTT of the AV module never expires, so it is
+// only used until the channel has reported an RTT of its own.
+typedef struct CcMinRtt {
+	unsigned int ms;
+	uint64_t stamp_us;
+} CcMinRtt;
+
+static unsigned int cc_min_rtt_update(CcMinRtt *m, const AVCongestionSample *s)
+{
+	if (s->rttMs > 0 && (m->ms == 0 || s->rttMs <= m->ms || s->timeUs - m->stamp_us > CC_MIN_RTT_WINDOW_US)) {
+		m->ms = s->rttMs;
+		m->stamp_us = s->timeUs;
+	}
+	if (m->ms == 0)
+		return s->minRttMs;
+	return m->ms;
+}
+
+/* ============================================================================
+ * Fixed rate
+ * ============================================================================
+ */
+
+static void *__stdcall cc_fixed_create(unsigned int nInitialRate, void *pUserData)
+{
+	unsigned int *rate = (unsigned int *)malloc(sizeof(unsigned int));
+
+	(void)pUserData;
+	if (rate != NULL)
+		*rate = nInitialRate;
+	return rate;
+}
+
+static unsigned int __stdcall cc_fixed_update(void *pState, const AVCongestionSample *pSample)
+{
+	(void)pSample;
+	return *(unsigned int *)pState;
+}
+
+static void __stdcall cc_fixed_destroy(void *pState)
+{
+	free(pState);
+}
+
+/* ============================================================================
+ * BBR-style
+ *
+ * Paces at gain x the bottleneck bandwidth, the max delivery rate over the last
+ * CC_BBR_ROUNDS rounds of one min RTT. Without ACKs the delivery rate is
+ * estimated as the send rate one RTT ago, scaled down by how far the RTT has
+ * risen over the min RTT, i.e. by how much of it went into a queue.
+ * ============================================================================
+ */
+
+#define CC_BBR_ROUNDS			10
+#define CC_BBR_HISTORY			64
+#define CC_BBR_STARTUP_GAIN		2.885
+#define CC_BBR_FULL_BW_GROWTH	1.25
+#define CC_BBR_FULL_BW_ROUNDS	3
+#define CC_BBR_RTT_SLACK		1.25
+#define CC_BBR_QUEUE_FULL_CUT	0.85
+
+enum { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW };
+
+static const double gBbrCycleGain[] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+typedef struct CcBbr {
+	int mode;
+	unsigned int rate;
+	CcMinRtt min_rtt;
+	double bw[CC_BBR_ROUNDS];
+	int round;
+	uint64_t round_start_us;
+	double full_bw;
+	int full_bw_rounds;
+	int cycle;
+	struct {
+		uint64_t time_us;
+		unsigned int send_rate;
+		unsigned int app_limited;
+	} history[CC_BBR_HISTORY];
+	int history_head;
+	int history_count;
+} CcBbr;
+
+static double cc_bbr_btlbw(const CcBbr *b)
+{
+	double max = 0;
+	int i;
+
+	for (i = 0; i < CC_BBR_ROUNDS; i++)
+		if (b->bw[i] > max)
+			max = b->bw[i];
+	return max;
+}
+
+// The newest history entry sent at least rtt_us before now, or -1
+static int cc_bbr_history_at(const CcBbr *b, uint64_t now_us, uint64_t rtt_us)
+{
+	int i, idx;
+
+	for (i = 0; i < b->history_count; i++) {
+		idx = (b->history_head - 1 - i + CC_BBR_HISTORY) % CC_BBR_HISTORY;
+		if (now_us - b->history[idx].time_us >= rtt_us)
+			return idx;
+	}
+	return -1;
+}
+
+static void *__stdcall cc_bbr_create(unsigned int nInitialRate, void *pUserData)
+{
+	CcBbr *b = (CcBbr *)calloc(1, sizeof(CcBbr));
+
+	(void)pUserData;
+	if (b != NULL) {
+		b->mode = BBR_STARTUP;
+		b->rate = nInitialRate;
+	}
+	return b;
+}
+
+static unsigned int __stdcall cc_bbr_update(void *pState, const AVCongestionSample *s)
+{
+	CcBbr *b = (CcBbr *)pState;
+	unsigned int min_rtt = cc_min_rtt_update(&b->min_rtt, s);
+	uint64_t round_us = min_rtt > 0 ? (uint64_t)min_rtt * 1000 : CC_NO_RTT_ROUND_US;
+	double btlbw, delivered, gain;
+	int idx, i;
+
+	if (round_us < AV_CC_SAMPLE_INTERVAL * 1000)
+		round_us = AV_CC_SAMPLE_INTERVAL * 1000;
+	if (b->round_start_us == 0)
+		b->round_start_us = s->timeUs;
+
+	// What arrives now was sent one RTT ago
+	idx = cc_bbr_history_at(b, s->timeUs, s->rttMs > 0 ? (uint64_t)s->rttMs * 1000 : round_us);
+	b->history[b->history_head].time_us = s->timeUs;
+	b->history[b->history_head].send_rate = s->sendRate;
+	b->history[b->history_head].app_limited = s->appLimited;
+	b->history_head = (b->history_head + 1) % CC_BBR_HISTORY;
+	if (b->history_count < CC_BBR_HISTORY)
+		b->history_count++;
+
+	btlbw = cc_bbr_btlbw(b);
+	if (idx >= 0) {
+		delivered = b->history[idx].send_rate;
+		if (min_rtt > 0 && s->rttMs > min_rtt * CC_BBR_RTT_SLACK)
+			delivered = delivered * min_rtt * CC_BBR_RTT_SLACK / s->rttMs;
+		// An app-limited sample only tells that the path can do at least that much
+		if ((!b->history[idx].app_limited || delivered > btlbw) && delivered > b->bw[b->round])
+			b->bw[b->round] = delivered;
+	}
+	if (s->queueFull > 0 && !s->appLimited) {
+		// The socket could not take the send rate, so the path cannot either
+		for (i = 0; i < CC_BBR_ROUNDS; i++)
+			if (b->bw[i] > s->sendRate * CC_BBR_QUEUE_FULL_CUT)
+				b->bw[i] = s->sendRate * CC_BBR_QUEUE_FULL_CUT;
+		if (b->mode == BBR_STARTUP)
+			b->mode = BBR_DRAIN;
+	}
+	btlbw = cc_bbr_btlbw(b);
+
+	if (s->timeUs - b->round_start_us >= round_us) {
+		b->round_start_us = s->timeUs;
+		if (b->mode == BBR_STARTUP && !s->appLimited) {
+			if (btlbw >= b->full_bw * CC_BBR_FULL_BW_GROWTH) {
+				b->full_bw = btlbw;
+				b->full_bw_rounds = 0;
+			} else if (++b->full_bw_rounds >= CC_BBR_FULL_BW_ROUNDS) {
+				b->mode = BBR_DRAIN;
+			}
+		} else if (b->mode == BBR_DRAIN) {
+			// One round at the drain gain empties what startup queued
+			b->mode = BBR_PROBE_BW;
+			b->cycle = 2;
+		} else if (b->mode == BBR_PROBE_BW) {
+			b->cycle = (b->cycle + 1) % (int)(sizeof(gBbrCycleGain) / sizeof(gBbrCycleGain[0]));
+		}
+		b->round = (b->round + 1) % CC_BBR_ROUNDS;
+		b->bw[b->round] = 0;
+	}
+	if (b->mode == BBR_DRAIN && min_rtt > 0 && s->rttMs > 0 && s->rttMs <= min_rtt * CC_BBR_RTT_SLACK) {
+		b->mode = BBR_PROBE_BW;
+		b->cycle = 2;
+	}
+
+	if (btlbw <= 0)
+		return b->rate;
+	if (b->mode == BBR_STARTUP)
+		gain = CC_BBR_STARTUP_GAIN;
+	else if (b->mode == BBR_DRAIN)
+		gain = 1 / CC_BBR_STARTUP_GAIN;
+	else
+		gain = gBbrCycleGain[b->cycle];
+	b->rate = cc_clamp_rate(btlbw * gain);
+	return b->rate;
+}
+
+static void __stdcall cc_bbr_destroy(void *pState)
+{
+	free(pState);
+}
+
+/* ============================================================================
+ * Delay-based
+ *
+ * Like LEDBAT: the rate grows while the queueing delay, RTT over min RTT, is
+ * under AV_CC_DELAY_TARGET and shrinks in proportion to how far it is over.
+ * Socket queue full and loss cut the rate at most once per RTT.
+ * ============================================================================
+ */
+
+#define CC_DELAY_GAIN_UP		0.1
+#define CC_DELAY_GAIN_DOWN		0.5
+#define CC_DELAY_LOSS_RATE		10
+#define CC_DELAY_LOSS_CUT		0.7
+#define CC_DELAY_MIN_CUT_US		100000ULL
+
+typedef struct CcDelay {
+	double rate;
+	CcMinRtt min_rtt;
+	uint64_t last_cut_us;
+} CcDelay;
+
+static void *__stdcall cc_delay_create(unsigned int nInitialRate, void *pUserData)
+{
+	CcDelay *d = (CcDelay *)calloc(1, sizeof(CcDelay));
+
+	(void)pUserData;
+	if (d != NULL)
+		d->rate = nInitialRate;
+	return d;
+}
+
+static unsigned int __stdcall cc_delay_update(void *pState, const AVCongestionSample *s)
+{
+	CcDelay *d = (CcDelay *)pState;
+	unsigned int min_rtt = cc_min_rtt_update(&d->min_rtt, s);
+	uint64_t rtt_us = (uint64_t)s->rttMs * 1000;
+	double off_target, fraction;
+
+	if (s->queueFull > 0 || s->lostRate >= CC_DELAY_LOSS_RATE) {
+		if (s->timeUs - d->last_cut_us >= (rtt_us > CC_DELAY_MIN_CUT_US ? rtt_us : CC_DELAY_MIN_CUT_US)) {
+			d->last_cut_us = s->timeUs;
+			d->rate = cc_clamp_rate(d->rate * CC_DELAY_LOSS_CUT);
+		}
+		return (unsigned int)d->rate;
+	}
+	// No delay signal to go by
+	if (s->rttMs == 0 || min_rtt == 0)
+		return (unsigned int)d->rate;
+
+	off_target = (AV_CC_DELAY_TARGET - ((double)s->rttMs - min_rtt)) / AV_CC_DELAY_TARGET;
+	if (off_target < -1)
+		off_target = -1;
+	// The gains are per RTT
+	fraction = rtt_us > 0 ? (double)s->intervalUs / rtt_us : 1;
+	if (fraction > 1)
+		fraction = 1;
+	if (off_target < 0)
+		d->rate = cc_clamp_rate(d->rate * (1 + CC_DELAY_GAIN_DOWN * off_target * fraction));
+	else if (!s->appLimited)
+		d->rate = cc_clamp_rate(d->rate * (1 + CC_DELAY_GAIN_UP * off_target * fraction));
+	return (unsigned int)d->rate;
+}
+
+static void __stdcall cc_delay_destroy(void *pState)
+{
+	free(pState);
+}
+
+static const AVCongestionOps gBuiltins[] = {
+	{ sizeof(AVCongestionOps), "fixed", cc_fixed_create, cc_fixed_update, cc_fixed_destroy },
+	{ sizeof(AVCongestionOps), "bbr", cc_bbr_create, cc_bbr_update, cc_bbr_destroy },
+	{ sizeof(AVCongestionOps), "delay", cc_delay_create, cc_delay_update, cc_delay_destroy },
+};
+
+const AVCongestionOps *avCongestionGetBuiltin(AVCongestionType eType)
+{
+	if ((unsigned int)eType >= sizeof(gBuiltins) / sizeof(gBuiltins[0]))
+		return NULL;
+	return &gBuiltins[eType];
+}
+
+static int cc_ops_valid(const AVCongestionOps *pOps)
+{
+	return pOps != NULL && pOps->cb == sizeof(AVCongestionOps) && pOps->create != NULL &&
+		   pOps->update != NULL && pOps->destroy != NULL;
+}
+
+/* ============================================================================
+ * Controller threads
+ * ============================================================================
+ */
+
+typedef struct CcChannel {
+	int av_index;
+	const AVCongestionOps *ops;
+	void *state;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	pthread_t thread;
+	avCongestionTraceFn trace_fn;
+	void *trace_user_data;
+	AVCongestionStats stats;
+	int saved_auto_rate;		// the pacer mode before the controller took over
+	unsigned int saved_rate;
+} CcChannel;
+
+static ExtTable gCcChannels = EXT_TABLE_INITIALIZER;
+
+static void *cc_thread(void *arg)
+{
+	CcChannel *c = (CcChannel *)arg;
+	IOTCPacerStats prev, cur;
+	AVCongestionSample s;
+	struct st_AvStatus status;
+	uint64_t last_us = ext_now_us();
+	ExtPacer *prev_p = NULL, *p;
+	unsigned int rate;
+	avCongestionTraceFn trace_fn;
+	void *trace_user_data;
+
+	memset(&prev, 0, sizeof(prev));
+	pthread_mutex_lock(&c->lock);
+	while (!c->stop) {
+		ext_cond_wait_ms(&c->cond, &c->lock, AV_CC_SAMPLE_INTERVAL);
+		if (c->stop)
+			break;
+		pthread_mutex_unlock(&c->lock);
+
+		memset(&s, 0, sizeof(s));
+		s.timeUs = ext_now_us();
+		s.intervalUs = (unsigned int)(s.timeUs - last_us);
+		last_us = s.timeUs;
+		// Looked up every time since a reconnection moves the pacer to a new session. The
+		// last pacer stays pinned, so a new one can never be mistaken for it.
+		p = ext_pacer_get_av(c->av_index);
+		if (p == NULL || s.intervalUs == 0) {
+			ext_pacer_put(p);
+			pthread_mutex_lock(&c->lock);
+			continue;
+		}
+		ext_pacer_get_stats(p, &cur);
+		if (p != prev_p) {
+			prev = cur;
+			ext_pacer_put(prev_p);
+			prev_p = p;
+		} else {
+			ext_pacer_put(p);
+		}
+
+		memset(&status, 0, sizeof(status));
+		if (avStatusCheck(c->av_index, &status) == AV_ER_NoERROR) {
+			s.rttMs = status.LastRtt != 0 ? status.LastRtt : status.RoundTripTime;
+			s.minRttMs = status.MinRTT;
+			s.lostRate = status.LostRate;
+			s.sdkBandwidth = status.LastBw;
+			s.sdkCwnd = status.LastCwnd;
+			s.inFlight = status.InFlight;
+		}
+		s.pacingRate = cur.rate;
+		s.sendRate = (unsigned int)((cur.sentBytes - prev.sentBytes) * 1000000ULL / s.intervalUs);
+		s.appLimited = cur.pacedCount == prev.pacedCount;
+		s.queueFull = cur.queueFullCount - prev.queueFullCount;
+		prev = cur;
+
+		rate = c->ops->update(c->state, &s);
+		if (rate == 0)
+			rate = cur.rate;
+		else if (rate != cur.rate)
+			ext_pacer_set_rate(p, rate, 0);
+
+		pthread_mutex_lock(&c->lock);
+		c->stats.rate = rate;
+		c->stats.sampleCount++;
+		if (rate != cur.rate)
+			c->stats.rateChanges++;
+		c->stats.lastSample = s;
+		trace_fn = c->trace_fn;
+		trace_user_data = c->trace_user_data;
+		if (trace_fn != NULL) {
+			pthread_mutex_unlock(&c->lock);
+			trace_fn(c->av_index, &s, rate, trace_user_data);
+			pthread_mutex_lock(&c->lock);
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	ext_pacer_put(prev_p);
+	return NULL;
+}
+
+static void cc_channel_free(CcChannel *c)
+{
+	if (c->state != NULL)
+		c->ops->destroy(c->state);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+/** Give the pacer, wherever a reconnection moved it, back the mode it had before attaching. */
+static void cc_pacer_restore(CcChannel *c)
+{
+	ExtPacer *p = ext_pacer_get_av(c->av_index);
+
+	if (p == NULL)
+		return;
+	// An adaptive pacer goes on from the current rate, a fixed one gets its rate back
+	ext_pacer_set_rate(p, c->saved_auto_rate ? 0 : c->saved_rate, c->saved_auto_rate);
+	ext_pacer_put(p);
+}
+
+int avCongestionAttach(int nAVChannelID, const AVCongestionOps *pOps, unsigned int nInitialRate,
+					   void *pUserData)
+{
+	IOTCPacerStats pacer;
+	CcChannel *c;
+	ExtPacer *p;
+
+	if (nAVChannelID < 0 || !cc_ops_valid(pOps))
+		return AV_ER_INVALID_ARG;
+	p = ext_pacer_get_av(nAVChannelID);
+	if (p == NULL)
+		return AV_ER_INVALID_SID;
+	if (nInitialRate == 0)
+		nInitialRate = IOTC_PACER_AUTO_INITIAL_RATE;
+
+	c = (CcChannel *)calloc(1, sizeof(CcChannel));
+	if (c == NULL) {
+		ext_pacer_put(p);
+		return AV_ER_MEM_INSUFF;
+	}
+	c->av_index = nAVChannelID;
+	c->ops = pOps;
+	c->stats.rate = nInitialRate;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	c->state = pOps->create(nInitialRate, pUserData);
+	if (c->state == NULL) {
+		ext_pacer_put(p);
+		cc_channel_free(c);
+		return AV_ER_MEM_INSUFF;
+	}
+	if (ext_table_set(&gCcChannels, nAVChannelID, c) < 0) {
+		ext_pacer_put(p);
+		cc_channel_free(c);
+		return AV_ER_INVALID_ARG;
+	}
+	ext_pacer_get_stats(p, &pacer);
+	c->saved_auto_rate = pacer.isAutoRate;
+	c->saved_rate = pacer.rate;
+	ext_pacer_set_rate(p, nInitialRate, 0);
+	if (pthread_create(&c->thread, NULL, cc_thread, c) != 0) {
+		ext_table_take(&gCcChannels, nAVChannelID);
+		cc_pacer_restore(c);
+		ext_pacer_put(p);
+		cc_channel_free(c);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	ext_pacer_put(p);
+	return AV_ER_NoERROR;
+}
+
+void avCongestionDetach(int nAVChannelID)
+{
+	CcChannel *c = (CcChannel *)ext_table_take(&gCcChannels, nAVChannelID);
+
+	if (c == NULL)
+		return;
+	pthread_mutex_lock(&c->lock);
+	c->stop = 1;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->thread, NULL);
+	cc_pacer_restore(c);
+	cc_channel_free(c);
+}
+
+int avCongestionSetTrace(int nAVChannelID, avCongestionTraceFn pfxTraceFn, void *pUserData)
+{
+	CcChannel *c = (CcChannel *)ext_table_get(&gCcChannels, nAVChannelID);
+
+	if (c == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&c->lock);
+	c->trace_fn = pfxTraceFn;
+	c->trace_user_data = pUserData;
+	pthread_mutex_unlock(&c->lock);
+	return AV_ER_NoERROR;
+}
+
+int avCongestionGetStats(int nAVChannelID, AVCongestionStats *pStats)
+{
+	CcChannel *c = (CcChannel *)ext_table_get(&gCcChannels, nAVChannelID);
+
+	if (c == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&c->lock);
+	*pStats = c->stats;
+	pthread_mutex_unlock(&c->lock);
+	return AV_ER_NoERROR;
+}
+
+int avCongestionReplay(const AVCongestionOps *pOps, unsigned int nInitialRate, void *pUserData,
+					   const AVCongestionSample *pSamples, unsigned int nCount, unsigned int *pRates)
+{
+	unsigned int i, rate;
+	void *state;
+
+	if (!cc_ops_valid(pOps) || (nCount > 0 && (pSamples == NULL || pRates == NULL)))
+		return AV_ER_INVALID_ARG;
+	if (nInitialRate == 0)
+		nInitialRate = IOTC_PACER_AUTO_INITIAL_RATE;
+	state = pOps->create(nInitialRate, pUserData);
+	if (state == NULL)
+		return AV_ER_MEM_INSUFF;
+	rate = nInitialRate;
+	for (i = 0; i < nCount; i++) {
+		unsigned int next = pOps->update(state, &pSamples[i]);
+
+		if (next != 0)
+			rate = next;
+		pRates[i] = rate;
+	}
+	pOps->destroy(state);
+	return AV_ER_NoERROR;
+}
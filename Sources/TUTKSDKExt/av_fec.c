@@ -0,0 +1,1117 @@
+/*! \file av_fec.c
+FEC channels, see AVFecAPIs.h.
+
+A frame, its info followed by its data, is cut into n shards of equal
+length, and the shards are split as evenly as possible into blocks of at
+most blockSize. Both sides derive the layout from the frame size and the
+shard length in every packet, so any packet of a block tells the client
+how many data shards the block has. The packets of all blocks are sent
+interleaved, so a burst loss hits many blocks once instead of one block
+many times.
+
+Packet header, big endian:
+	0  type			FEC_TYPE_SHARD
+	1  k			data shards in the block
+	2  m			parity shards in the block
+	3  index		shard index in the block, data first
+	4  frame		frame sequence number
+	8  size			info + data size of the frame
+	12 info size
+	14 shard length
+	16 block		block index in the frame
+	17 blocks		blocks in the frame
+	18 flags		FEC_FLAG_RESENT
+	19 reserved
+The client sends FEC_TYPE_NACK, listing the shards of a block it wants
+again, and FEC_TYPE_REPORT with the packet loss it saw, on the same channel.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVFecAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_fec.h"
+#include "ext_frame.h"
+#include "ext_platform.h"
+#include "ext_table.h"
+
+#define FEC_TYPE_SHARD			0xF1
+#define FEC_TYPE_NACK			0xF2
+#define FEC_TYPE_REPORT			0xF3
+#define FEC_FLAG_RESENT			0x01
+
+#define FEC_HEADER_SIZE			20
+#define FEC_NACK_HEADER_SIZE	8
+#define FEC_SHARD_MAX			(IOTC_MAX_PACKET_SIZE - FEC_HEADER_SIZE)
+#define FEC_MAX_BLOCKS			255
+
+#define FEC_READ_TIMEOUT		10		// ms, also how often the client checks deadlines
+#define FEC_SENDER_READ_TIMEOUT	100		// ms
+#define FEC_RX_WINDOW			64		// frames being rebuilt
+#define FEC_RX_QUEUE			64		// complete frames waiting for avFecRecvFrame()
+#define FEC_IDLE_US				20000	// no packet of a frame for this long: the rest is lost
+#define FEC_NACK_INTERVAL_US	60000
+#define FEC_MAX_NACKS			3
+#define FEC_STATUS_INTERVAL_US	500000	// how often the sender reads avStatusCheck()
+#define FEC_ACCT_FRAMES			128		// frames the loss accounting keeps counters for
+#define FEC_ACCT_LAG			8		// frames handed out this long ago have all their packets in
+
+/* ============================================================================
+ * Packet layout
+ * ============================================================================
+ */
+
+typedef struct FecHeader {
+	unsigned int type;
+	unsigned int k;
+	unsigned int m;
+	unsigned int index;
+	uint32_t frame;
+	unsigned int size;
+	unsigned int info_size;
+	unsigned int shard_len;
+	unsigned int block;
+	unsigned int blocks;
+	unsigned int flags;
+} FecHeader;
+
+static void fec_put16(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)(v >> 8);
+	p[1] = (unsigned char)v;
+}
+
+static void fec_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static unsigned int fec_get16(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static uint32_t fec_get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void fec_write_header(unsigned char *p, const FecHeader *h)
+{
+	p[0] = (unsigned char)h->type;
+	p[1] = (unsigned char)h->k;
+	p[2] = (unsigned char)h->m;
+	p[3] = (unsigned char)h->index;
+	fec_put32(p + 4, h->frame);
+	fec_put32(p + 8, h->size);
+	fec_put16(p + 12, h->info_size);
+	fec_put16(p + 14, h->shard_len);
+	p[16] = (unsigned char)h->block;
+	p[17] = (unsigned char)h->blocks;
+	p[18] = (unsigned char)h->flags;
+	p[19] = 0;
+}
+
+static void fec_read_header(const unsigned char *p, FecHeader *h)
+{
+	h->type = p[0];
+	h->k = p[1];
+	h->m = p[2];
+	h->index = p[3];
+	h->frame = fec_get32(p + 4);
+	h->size = fec_get32(p + 8);
+	h->info_size = fec_get16(p + 12);
+	h->shard_len = fec_get16(p + 14);
+	h->block = p[16];
+	h->blocks = p[17];
+	h->flags = p[18];
+}
+
+// The first shard of block b when n shards are split into blocks
+static int fec_block_start(int n, int blocks, int b)
+{
+	return (int)((int64_t)n * b / blocks);
+}
+
+static int fec_session_closed(int ret)
+{
+	switch (ret) {
+	case IOTC_ER_NOT_INITIALIZED:
+	case IOTC_ER_INVALID_SID:
+	case IOTC_ER_SESSION_CLOSE_BY_REMOTE:
+	case IOTC_ER_REMOTE_TIMEOUT_DISCONNECT:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int fec_check_config(const AVFecConfig *in, AVFecConfig *out)
+{
+	if (in != NULL && in->cb != sizeof(AVFecConfig))
+		return -1;
+	if (in != NULL) {
+		*out = *in;
+	} else {
+		memset(out, 0, sizeof(*out));
+		out->cb = sizeof(AVFecConfig);
+		out->minRedundancy = AV_FEC_DEFAULT_MIN_REDUNDANCY;
+	}
+	if (out->blockSize == 0)
+		out->blockSize = AV_FEC_DEFAULT_BLOCK_SIZE;
+	if (out->maxRedundancy == 0)
+		out->maxRedundancy = AV_FEC_DEFAULT_MAX_REDUNDANCY;
+	if (out->maxDelayMs == 0)
+		out->maxDelayMs = out->resend ? AV_FEC_DEFAULT_MAX_DELAY_RESEND : AV_FEC_DEFAULT_MAX_DELAY;
+	// m <= k keeps k + m within a block and m within the decoder's limit
+	if (out->blockSize > AV_FEC_MAX_BLOCK_PACKETS / 2 || out->maxRedundancy > 100 ||
+		out->minRedundancy > out->maxRedundancy)
+		return -1;
+	return 0;
+}
+
+/* ============================================================================
+ * Sender
+ * ============================================================================
+ */
+
+typedef struct FecSentFrame {
+	int valid;
+	uint32_t seq;
+	unsigned char *packets;		// packet i at i * IOTC_MAX_PACKET_SIZE
+	size_t capacity;			// packets that fit
+	int packet_len;
+	int blocks;
+	int block_first[FEC_MAX_BLOCKS + 1];	// the first packet of each block
+} FecSentFrame;
+
+typedef struct FecSender {
+	int sid;
+	unsigned char channel;
+	int av_index;
+	AVFecConfig cfg;
+	pthread_mutex_t lock;
+	uint32_t next_seq;
+	FecSentFrame *history;
+	int history_size;
+	unsigned int reported_loss;		// permille, from the client
+	unsigned int status_loss;		// permille, from avStatusCheck()
+	uint64_t status_us;
+	int stopping;
+	pthread_t thread;
+	AVFecSenderStats stats;
+} FecSender;
+
+static ExtTable gFecSenders = EXT_TABLE_INITIALIZER;
+
+// The probability that more than m of n packets are lost, each with probability p
+static double fec_block_loss(int n, int m, double p)
+{
+	double q = 1.0 - p, term = 1.0, sum = 0.0;
+	int x;
+
+	for (x = 0; x < n; x++)
+		term *= q;
+	for (x = 0; x <= m && x <= n; x++) {
+		sum += term;
+		term *= (double)(n - x) / (double)(x + 1) * p / q;
+	}
+	return 1.0 - sum;
+}
+
+// Caller holds s->lock. The fewest parity shards which keep the block loss under the target.
+static int fec_parity_count(FecSender *s, int k)
+{
+	unsigned int loss = s->reported_loss > s->status_loss ? s->reported_loss : s->status_loss;
+	int m_min = (k * (int)s->cfg.minRedundancy + 99) / 100;
+	int m_max = (k * (int)s->cfg.maxRedundancy + 99) / 100;
+	double p = (double)loss / 1000.0;
+	int m;
+
+	if (m_max > EXT_FEC_MAX_PARITY)
+		m_max = EXT_FEC_MAX_PARITY;
+	if (m_min > m_max)
+		m_min = m_max;
+	if (loss == 0)
+		return m_min;
+	if (loss >= 1000)
+		return m_max;
+	for (m = m_min; m < m_max; m++) {
+		if (fec_block_loss(k + m, m, p) <= AV_FEC_TARGET_BLOCK_LOSS)
+			break;
+	}
+	return m;
+}
+
+static void fec_sender_update_status(FecSender *s)
+{
+	struct st_AvStatus status;
+	uint64_t now = ext_now_us();
+	unsigned int loss;
+
+	if (s->av_index < 0 || now - s->status_us < FEC_STATUS_INTERVAL_US)
+		return;
+	s->status_us = now;
+	if (avStatusCheck(s->av_index, &status) != AV_ER_NoERROR)
+		return;
+	loss = (unsigned int)status.LostRate * 10;
+	pthread_mutex_lock(&s->lock);
+	s->status_loss = loss < 1000 ? loss : 1000;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void fec_sender_resend(FecSender *s, const unsigned char *pkt, int len)
+{
+	unsigned char out[IOTC_MAX_PACKET_SIZE];
+	uint32_t seq = fec_get32(pkt + 4);
+	unsigned int block = pkt[1], count = pkt[2], i;
+	FecSentFrame *f;
+
+	if (count > (unsigned int)(len - FEC_NACK_HEADER_SIZE))
+		return;
+	for (i = 0; i < count; i++) {
+		unsigned int index = pkt[FEC_NACK_HEADER_SIZE + i];
+		int out_len = 0, ret;
+
+		// Copy under the lock since avFecSendFrame() may reuse the slot
+		pthread_mutex_lock(&s->lock);
+		f = &s->history[seq % (uint32_t)s->history_size];
+		if (f->valid && f->seq == seq && (int)block < f->blocks &&
+			(int)index < f->block_first[block + 1] - f->block_first[block]) {
+			out_len = f->packet_len;
+			memcpy(out, f->packets + (size_t)(f->block_first[block] + (int)index) * IOTC_MAX_PACKET_SIZE, (size_t)out_len);
+		}
+		pthread_mutex_unlock(&s->lock);
+		if (out_len == 0)
+			continue;
+
+		out[18] |= FEC_FLAG_RESENT;
+		ret = IOTC_Session_Write_Paced(s->sid, (const char *)out, out_len, s->channel, NULL);
+		pthread_mutex_lock(&s->lock);
+		if (ret < 0)
+			s->stats.lastError = ret;
+		else
+			s->stats.resentPackets++;
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+static void *fec_sender_thread(void *arg)
+{
+	FecSender *s = (FecSender *)arg;
+	unsigned char pkt[IOTC_MAX_PACKET_SIZE];
+
+	for (;;) {
+		int ret, stopping;
+
+		pthread_mutex_lock(&s->lock);
+		stopping = s->stopping;
+		pthread_mutex_unlock(&s->lock);
+		if (stopping)
+			break;
+
+		ret = IOTC_Session_Read(s->sid, (char *)pkt, sizeof(pkt), FEC_SENDER_READ_TIMEOUT, s->channel);
+		if (ret == IOTC_ER_TIMEOUT)
+			continue;
+		if (ret < 0) {
+			if (fec_session_closed(ret))
+				break;
+			ext_sleep_ms(FEC_SENDER_READ_TIMEOUT);
+			continue;
+		}
+		if (ret >= FEC_NACK_HEADER_SIZE && pkt[0] == FEC_TYPE_NACK) {
+			fec_sender_resend(s, pkt, ret);
+		} else if (ret >= 3 && pkt[0] == FEC_TYPE_REPORT) {
+			unsigned int loss = fec_get16(pkt + 1);
+			if (loss > 1000)
+				loss = 1000;
+			// Follow a rising loss at once and a falling one slowly
+			pthread_mutex_lock(&s->lock);
+			s->reported_loss = loss >= s->reported_loss ? loss : (3 * s->reported_loss + loss) / 4;
+			pthread_mutex_unlock(&s->lock);
+		}
+	}
+	return NULL;
+}
+
+static void fec_sender_free(FecSender *s)
+{
+	int i;
+
+	for (i = 0; i < s->history_size; i++)
+		free(s->history[i].packets);
+	free(s->history);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+int avFecSenderCreate(int nIOTCSessionID, unsigned char nIOTCChannelID, int nAVChannelID,
+					  const AVFecConfig *pConfig)
+{
+	FecSender *s;
+	int id;
+
+	if (nIOTCSessionID < 0)
+		return AV_ER_INVALID_ARG;
+	s = (FecSender *)calloc(1, sizeof(FecSender));
+	if (s == NULL)
+		return AV_ER_MEM_INSUFF;
+	if (fec_check_config(pConfig, &s->cfg) < 0) {
+		free(s);
+		return AV_ER_INVALID_ARG;
+	}
+	s->sid = nIOTCSessionID;
+	s->channel = nIOTCChannelID;
+	s->av_index = nAVChannelID;
+	// Without resend only the frame being built is kept
+	s->history_size = s->cfg.resend ? AV_FEC_RESEND_HISTORY : 1;
+	s->history = (FecSentFrame *)calloc((size_t)s->history_size, sizeof(FecSentFrame));
+	if (s->history == NULL) {
+		free(s);
+		return AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+
+	if (pthread_create(&s->thread, NULL, fec_sender_thread, s) != 0) {
+		fec_sender_free(s);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	id = ext_table_add(&gFecSenders, s);
+	if (id < 0) {
+		pthread_mutex_lock(&s->lock);
+		s->stopping = 1;
+		pthread_mutex_unlock(&s->lock);
+		pthread_join(s->thread, NULL);
+		fec_sender_free(s);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avFecSenderDestroy(int nFecSenderID)
+{
+	FecSender *s = (FecSender *)ext_table_take(&gFecSenders, nFecSenderID);
+
+	if (s == NULL)
+		return;
+	pthread_mutex_lock(&s->lock);
+	s->stopping = 1;
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+	fec_sender_free(s);
+}
+
+int avFecSendFrame(int nFecSenderID, const char *cabFrameData, int nFrameDataSize,
+				   const void *cabFrameInfo, int nFrameInfoSize)
+{
+	FecSender *s = (FecSender *)ext_table_get(&gFecSenders, nFecSenderID);
+	const unsigned char *data[AV_FEC_MAX_BLOCK_PACKETS];
+	unsigned char *parity[EXT_FEC_MAX_PARITY];
+	AVFecEngine engine = avFecGetEngine();
+	unsigned int size, shard_len, copied;
+	int n, blocks, b, i, total, max_block = 0, ret = AV_ER_NoERROR;
+	unsigned int parity_count = 0;
+	FecSentFrame *f;
+	FecHeader h;
+
+	if (s == NULL || cabFrameData == NULL || nFrameDataSize <= 0 || nFrameInfoSize < 0 ||
+		nFrameInfoSize > AV_FRAME_INFO_MAX_SIZE || (nFrameInfoSize > 0 && cabFrameInfo == NULL))
+		return AV_ER_INVALID_ARG;
+
+	size = (unsigned int)nFrameInfoSize + (unsigned int)nFrameDataSize;
+	n = (int)((size + FEC_SHARD_MAX - 1) / FEC_SHARD_MAX);
+	shard_len = (size + (unsigned int)n - 1) / (unsigned int)n;
+	blocks = (n + (int)s->cfg.blockSize - 1) / (int)s->cfg.blockSize;
+	if (blocks > FEC_MAX_BLOCKS)
+		return AV_ER_EXCEED_MAX_SIZE;
+
+	fec_sender_update_status(s);
+
+	pthread_mutex_lock(&s->lock);
+	memset(&h, 0, sizeof(h));
+	h.type = FEC_TYPE_SHARD;
+	h.frame = s->next_seq++;
+	h.size = size;
+	h.info_size = (unsigned int)nFrameInfoSize;
+	h.shard_len = shard_len;
+	h.blocks = (unsigned int)blocks;
+
+	f = &s->history[h.frame % (uint32_t)s->history_size];
+	f->valid = 0;
+	f->seq = h.frame;
+	f->blocks = blocks;
+	f->packet_len = FEC_HEADER_SIZE + (int)shard_len;
+	total = 0;
+	for (b = 0; b < blocks; b++) {
+		int k = fec_block_start(n, blocks, b + 1) - fec_block_start(n, blocks, b);
+		int m = fec_parity_count(s, k);
+		f->block_first[b] = total;
+		total += k + m;
+		parity_count += (unsigned int)m;
+		if (k + m > max_block)
+			max_block = k + m;
+	}
+	f->block_first[blocks] = total;
+	s->stats.redundancy = parity_count * 100 / (unsigned int)n;
+	pthread_mutex_unlock(&s->lock);
+
+	// The slot is not valid, so resends leave it alone while it is built
+	if (f->capacity < (size_t)total) {
+		unsigned char *p = (unsigned char *)realloc(f->packets, (size_t)total * IOTC_MAX_PACKET_SIZE);
+		if (p == NULL)
+			return AV_ER_MEM_INSUFF;
+		f->packets = p;
+		f->capacity = (size_t)total;
+	}
+
+	copied = 0;
+	for (b = 0; b < blocks; b++) {
+		int k = fec_block_start(n, blocks, b + 1) - fec_block_start(n, blocks, b);
+		int m = f->block_first[b + 1] - f->block_first[b] - k;
+
+		h.block = (unsigned int)b;
+		h.k = (unsigned int)k;
+		h.m = (unsigned int)m;
+		for (i = 0; i < k + m; i++) {
+			unsigned char *pkt = f->packets + (size_t)(f->block_first[b] + i) * IOTC_MAX_PACKET_SIZE;
+			unsigned char *shard = pkt + FEC_HEADER_SIZE;
+
+			h.index = (unsigned int)i;
+			fec_write_header(pkt, &h);
+			if (i < k) {
+				unsigned int end = copied + shard_len, pos = copied, off = 0;
+
+				// The shard may straddle the info and the data; pad the last one with zeros
+				if (pos < h.info_size) {
+					unsigned int len = h.info_size - pos < shard_len ? h.info_size - pos : shard_len;
+					memcpy(shard, (const char *)cabFrameInfo + pos, len);
+					pos += len;
+					off = len;
+				}
+				if (pos < size && off < shard_len) {
+					unsigned int len = (end < size ? end : size) - pos;
+					memcpy(shard + off, cabFrameData + (pos - h.info_size), len);
+					off += len;
+				}
+				memset(shard + off, 0, shard_len - off);
+				copied = end;
+				data[i] = shard;
+			} else {
+				parity[i - k] = shard;
+			}
+		}
+		if (m > 0)
+			ext_fec_encode(engine, data, k, parity, m, (int)shard_len);
+	}
+
+	pthread_mutex_lock(&s->lock);
+	f->valid = 1;
+	pthread_mutex_unlock(&s->lock);
+
+	// Interleave the blocks: the i-th packet of every block, then the next
+	for (i = 0; i < max_block && ret == AV_ER_NoERROR; i++) {
+		for (b = 0; b < blocks; b++) {
+			int w;
+
+			if (i >= f->block_first[b + 1] - f->block_first[b])
+				continue;
+			w = IOTC_Session_Write_Paced(s->sid, (const char *)f->packets + (size_t)(f->block_first[b] + i) * IOTC_MAX_PACKET_SIZE,
+										 f->packet_len, s->channel, NULL);
+			pthread_mutex_lock(&s->lock);
+			if (w < 0) {
+				s->stats.lastError = w;
+			} else {
+				int k = fec_block_start(n, blocks, b + 1) - fec_block_start(n, blocks, b);
+				if (i < k)
+					s->stats.dataPackets++;
+				else
+					s->stats.parityPackets++;
+			}
+			pthread_mutex_unlock(&s->lock);
+			// A lost packet is what FEC is for; only a dead session ends the frame
+			if (w < 0 && fec_session_closed(w)) {
+				ret = w;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&s->lock);
+	if (ret == AV_ER_NoERROR)
+		s->stats.framesSent++;
+	pthread_mutex_unlock(&s->lock);
+	return ret;
+}
+
+int avFecSenderGetStats(int nFecSenderID, AVFecSenderStats *pStats)
+{
+	FecSender *s = (FecSender *)ext_table_get(&gFecSenders, nFecSenderID);
+
+	if (s == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&s->lock);
+	*pStats = s->stats;
+	pStats->lossPermille = s->reported_loss > s->status_loss ? s->reported_loss : s->status_loss;
+	pthread_mutex_unlock(&s->lock);
+	return AV_ER_NoERROR;
+}
+
+/* ============================================================================
+ * Receiver
+ * ============================================================================
+ */
+
+typedef struct FecRxBlock {
+	int k;
+	int m;						// -1 until a packet of the block arrives
+	int got;
+	int done;
+	unsigned char present[AV_FEC_MAX_BLOCK_PACKETS];
+	unsigned char *parity;		// m shards
+} FecRxBlock;
+
+typedef struct FecRxFrame {
+	int used;
+	uint32_t seq;
+	unsigned int size;
+	unsigned int info_size;
+	unsigned int shard_len;
+	int shards;
+	int blocks;
+	int blocks_done;
+	int recovered;
+	int resent;
+	int nacks;
+	uint64_t first_us;
+	uint64_t last_us;
+	uint64_t done_us;
+	uint64_t nack_us;
+	unsigned char *payload;		// shards * shard_len
+	size_t payload_capacity;
+	FecRxBlock *blk;
+	int blk_capacity;
+} FecRxFrame;
+
+typedef struct FecReceiver {
+	int sid;
+	unsigned char channel;
+	AVFecConfig cfg;
+	// Only the receive thread touches the window
+	FecRxFrame *win;
+	int started;
+	uint32_t next_seq;			// the next frame to hand out
+	uint32_t high_seq;			// the newest frame seen
+	uint64_t gap_us;			// when next_seq was found missing while newer frames arrived
+	// Packet counts per frame, summed into the report once no more packets of the frame are due
+	unsigned short acct_expected[FEC_ACCT_FRAMES];
+	unsigned short acct_received[FEC_ACCT_FRAMES];
+	uint32_t acct_seq;
+	unsigned int expected_packets;
+	unsigned int received_packets;
+	uint64_t report_us;
+	unsigned long long delay_sum_ms;
+	// The rest is protected by lock
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	AVFrame *queue[FEC_RX_QUEUE];
+	unsigned int head;
+	unsigned int count;
+	unsigned int skipped;		// frames lost since avFecRecvFrame() last returned
+	int stopping;
+	int closed_error;
+	pthread_t thread;
+	AVFecReceiverStats stats;
+} FecReceiver;
+
+static ExtTable gFecReceivers = EXT_TABLE_INITIALIZER;
+
+// Count the packets the frame should have had for the loss report and free its slot
+static void fec_rx_release(FecReceiver *r, FecRxFrame *f)
+{
+	unsigned int expected = 0;
+	int b;
+
+	for (b = 0; b < f->blocks; b++) {
+		FecRxBlock *blk = &f->blk[b];
+		expected += (unsigned int)(blk->k + (blk->m > 0 ? blk->m : 0));
+		free(blk->parity);
+		blk->parity = NULL;
+	}
+	r->acct_expected[f->seq % FEC_ACCT_FRAMES] = (unsigned short)expected;
+	f->used = 0;
+}
+
+// Caller holds r->lock
+static void fec_rx_push_locked(FecReceiver *r, AVFrame *frame)
+{
+	if (r->count == FEC_RX_QUEUE) {
+		// The application is not keeping up; drop the oldest complete frame
+		avFrameRelease(r->queue[r->head]);
+		r->head = (r->head + 1) % FEC_RX_QUEUE;
+		r->count--;
+		r->skipped++;
+		r->stats.framesLost++;
+	}
+	r->queue[(r->head + r->count) % FEC_RX_QUEUE] = frame;
+	r->count++;
+	pthread_cond_signal(&r->cond);
+}
+
+// Hand out or drop the frame at next_seq and move on
+static void fec_rx_advance(FecReceiver *r, int complete)
+{
+	FecRxFrame *f = &r->win[r->next_seq % FEC_RX_WINDOW];
+	AVFrame *frame = NULL;
+
+	if (!f->used || f->seq != r->next_seq)
+		f = NULL;
+	if (complete && f != NULL) {
+		frame = ext_frame_alloc((int)(f->size - f->info_size));
+		if (frame != NULL) {
+			memcpy(frame->info, f->payload, f->info_size);
+			frame->infoSize = (int)f->info_size;
+			memcpy(frame->data, f->payload + f->info_size, f->size - f->info_size);
+			frame->dataSize = (int)(f->size - f->info_size);
+			frame->expectedSize = frame->dataSize;
+			frame->frameIndex = f->seq;
+		}
+	}
+
+	pthread_mutex_lock(&r->lock);
+	if (frame != NULL) {
+		unsigned int delay_ms = (unsigned int)((f->done_us - f->first_us) / 1000ULL);
+		r->stats.framesReceived++;
+		if (f->recovered)
+			r->stats.framesRecovered++;
+		if (f->resent)
+			r->stats.framesResent++;
+		r->delay_sum_ms += delay_ms;
+		r->stats.avgDelayMs = (unsigned int)(r->delay_sum_ms / r->stats.framesReceived);
+		if (delay_ms > r->stats.maxDelayMs)
+			r->stats.maxDelayMs = delay_ms;
+		fec_rx_push_locked(r, frame);
+	} else {
+		r->skipped++;
+		r->stats.framesLost++;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	if (f != NULL)
+		fec_rx_release(r, f);
+	r->next_seq++;
+	r->gap_us = 0;
+}
+
+static void fec_rx_deliver(FecReceiver *r, uint64_t now)
+{
+	uint64_t max_delay = (uint64_t)r->cfg.maxDelayMs * 1000ULL;
+
+	while (r->started && (int32_t)(r->high_seq - r->next_seq) >= 0) {
+		FecRxFrame *f = &r->win[r->next_seq % FEC_RX_WINDOW];
+		int newer = (int32_t)(r->high_seq - r->next_seq) > 0;
+
+		if (f->used && f->seq == r->next_seq) {
+			if (f->blocks_done == f->blocks)
+				fec_rx_advance(r, 1);
+			else if (now - f->first_us >= max_delay ||
+					 (!r->cfg.resend && newer && now - f->last_us >= FEC_IDLE_US))
+				fec_rx_advance(r, 0);	// without resend, nothing more will come
+			else
+				break;
+		} else {
+			if (!newer)
+				break;
+			// Not a single packet of this frame arrived, so resend cannot help either
+			if (r->gap_us == 0)
+				r->gap_us = now;
+			if (now - r->gap_us < FEC_IDLE_US)
+				break;
+			fec_rx_advance(r, 0);
+		}
+	}
+}
+
+// Set up a slot for a new frame. Returns -1 if the layout in the header is not sane.
+static int fec_rx_frame_start(FecRxFrame *f, const FecHeader *h, uint64_t now)
+{
+	int n = (int)((h->size + h->shard_len - 1) / h->shard_len), b;
+	size_t need = (size_t)n * h->shard_len;
+
+	if (h->blocks == 0 || (int)h->blocks > n || h->info_size > h->size)
+		return -1;
+	for (b = 0; b < (int)h->blocks; b++) {
+		int k = fec_block_start(n, (int)h->blocks, b + 1) - fec_block_start(n, (int)h->blocks, b);
+		if (k > AV_FEC_MAX_BLOCK_PACKETS / 2)
+			return -1;
+	}
+	if (f->payload_capacity < need) {
+		unsigned char *p = (unsigned char *)realloc(f->payload, need);
+		if (p == NULL)
+			return -1;
+		f->payload = p;
+		f->payload_capacity = need;
+	}
+	if (f->blk_capacity < (int)h->blocks) {
+		FecRxBlock *p = (FecRxBlock *)realloc(f->blk, h->blocks * sizeof(FecRxBlock));
+		if (p == NULL)
+			return -1;
+		f->blk = p;
+		f->blk_capacity = (int)h->blocks;
+	}
+	f->used = 1;
+	f->seq = h->frame;
+	f->size = h->size;
+	f->info_size = h->info_size;
+	f->shard_len = h->shard_len;
+	f->shards = n;
+	f->blocks = (int)h->blocks;
+	f->blocks_done = 0;
+	f->recovered = 0;
+	f->resent = 0;
+	f->nacks = 0;
+	f->first_us = now;
+	f->last_us = now;
+	f->nack_us = 0;
+	for (b = 0; b < f->blocks; b++) {
+		FecRxBlock *blk = &f->blk[b];
+		blk->k = fec_block_start(n, f->blocks, b + 1) - fec_block_start(n, f->blocks, b);
+		blk->m = -1;
+		blk->got = 0;
+		blk->done = 0;
+		blk->parity = NULL;
+		memset(blk->present, 0, sizeof(blk->present));
+	}
+	return 0;
+}
+
+static void fec_rx_block_done(FecRxFrame *f, FecRxBlock *blk, int b, uint64_t now)
+{
+	unsigned char *shards[AV_FEC_MAX_BLOCK_PACKETS];
+	unsigned char *base = f->payload + (size_t)fec_block_start(f->shards, f->blocks, b) * f->shard_len;
+	int i, lost = 0;
+
+	for (i = 0; i < blk->k; i++) {
+		shards[i] = base + (size_t)i * f->shard_len;
+		lost += !blk->present[i];
+	}
+	if (lost > 0) {
+		for (i = 0; i < blk->m; i++)
+			shards[blk->k + i] = blk->parity + (size_t)i * f->shard_len;
+		if (ext_fec_decode(avFecGetEngine(), shards, blk->present, blk->k, blk->m, (int)f->shard_len) < 0)
+			return;
+		f->recovered = 1;
+	}
+	blk->done = 1;
+	if (++f->blocks_done == f->blocks)
+		f->done_us = now;
+}
+
+static void fec_rx_packet(FecReceiver *r, const unsigned char *pkt, int len, uint64_t now)
+{
+	FecHeader h;
+	FecRxFrame *f;
+	FecRxBlock *blk;
+
+	if (len < FEC_HEADER_SIZE || pkt[0] != FEC_TYPE_SHARD)
+		return;
+	fec_read_header(pkt, &h);
+	if (h.shard_len == 0 || h.shard_len > FEC_SHARD_MAX || len != FEC_HEADER_SIZE + (int)h.shard_len ||
+		h.block >= h.blocks || h.k == 0 || h.k + h.m > AV_FEC_MAX_BLOCK_PACKETS || h.index >= h.k + h.m ||
+		h.m > EXT_FEC_MAX_PARITY || h.info_size > AV_FRAME_INFO_MAX_SIZE || h.size == 0)
+		return;
+
+	pthread_mutex_lock(&r->lock);
+	r->stats.packetsReceived++;
+	pthread_mutex_unlock(&r->lock);
+	if (!r->started) {
+		r->started = 1;
+		r->next_seq = h.frame;
+		r->high_seq = h.frame;
+		r->acct_seq = h.frame;
+	}
+	// Parity which arrives after the frame is complete still counts as received,
+	// but resent packets would hide the loss the redundancy has to cover
+	if (!(h.flags & FEC_FLAG_RESENT) && (uint32_t)(h.frame - r->acct_seq) < FEC_ACCT_FRAMES)
+		r->acct_received[h.frame % FEC_ACCT_FRAMES]++;
+
+	if ((int32_t)(h.frame - r->next_seq) < 0)
+		return;		// the frame was already handed out or dropped
+	// Make room in the window for a frame far ahead
+	while ((int32_t)(h.frame - r->next_seq) >= FEC_RX_WINDOW)
+		fec_rx_advance(r, 0);
+	if ((int32_t)(h.frame - r->high_seq) > 0)
+		r->high_seq = h.frame;
+
+	f = &r->win[h.frame % FEC_RX_WINDOW];
+	if (!f->used && fec_rx_frame_start(f, &h, now) < 0)
+		return;
+	if (f->seq != h.frame || f->size != h.size || f->shard_len != h.shard_len || f->blocks != (int)h.blocks)
+		return;
+	blk = &f->blk[h.block];
+	if ((int)h.k != blk->k || (blk->m >= 0 && (int)h.m != blk->m))
+		return;
+	f->last_us = now;
+	if (blk->m < 0)
+		blk->m = (int)h.m;
+	if (blk->present[h.index])
+		return;
+	blk->present[h.index] = 1;
+	blk->got++;
+	if (blk->done)
+		return;		// late parity of a block already rebuilt, still counted as received
+	if (h.flags & FEC_FLAG_RESENT)
+		f->resent = 1;
+
+	if ((int)h.index < blk->k) {
+		size_t shard = (size_t)fec_block_start(f->shards, f->blocks, (int)h.block) + h.index;
+		memcpy(f->payload + shard * f->shard_len, pkt + FEC_HEADER_SIZE, f->shard_len);
+	} else {
+		if (blk->parity == NULL) {
+			blk->parity = (unsigned char *)malloc((size_t)blk->m * f->shard_len);
+			if (blk->parity == NULL) {
+				blk->present[h.index] = 0;
+				blk->got--;
+				return;
+			}
+		}
+		memcpy(blk->parity + (size_t)(h.index - h.k) * f->shard_len, pkt + FEC_HEADER_SIZE, f->shard_len);
+	}
+	if (blk->got >= blk->k)
+		fec_rx_block_done(f, blk, (int)h.block, now);
+}
+
+// Ask again for the shards of frames which stopped receiving packets
+static void fec_rx_nack(FecReceiver *r, uint64_t now)
+{
+	unsigned char pkt[IOTC_MAX_PACKET_SIZE];
+	uint32_t seq;
+
+	if (!r->started)
+		return;
+	for (seq = r->next_seq; (int32_t)(r->high_seq - seq) >= 0; seq++) {
+		FecRxFrame *f = &r->win[seq % FEC_RX_WINDOW];
+		int b;
+
+		if (!f->used || f->seq != seq || f->blocks_done == f->blocks || f->nacks >= FEC_MAX_NACKS ||
+			now - f->last_us < FEC_IDLE_US || (f->nacks > 0 && now - f->nack_us < FEC_NACK_INTERVAL_US))
+			continue;
+		for (b = 0; b < f->blocks; b++) {
+			FecRxBlock *blk = &f->blk[b];
+			int need = blk->k - blk->got, count = 0, i;
+
+			if (blk->done)
+				continue;
+			for (i = 0; i < blk->k && count < need; i++) {
+				if (!blk->present[i])
+					pkt[FEC_NACK_HEADER_SIZE + count++] = (unsigned char)i;
+			}
+			pkt[0] = FEC_TYPE_NACK;
+			pkt[1] = (unsigned char)b;
+			pkt[2] = (unsigned char)count;
+			pkt[3] = 0;
+			fec_put32(pkt + 4, seq);
+			IOTC_Session_Write(r->sid, (const char *)pkt, FEC_NACK_HEADER_SIZE + count, r->channel);
+		}
+		f->nacks++;
+		f->nack_us = now;
+	}
+}
+
+static void fec_rx_report(FecReceiver *r, uint64_t now)
+{
+	unsigned char pkt[3];
+	unsigned int loss;
+
+	while (r->started && (int32_t)(r->next_seq - r->acct_seq) > FEC_ACCT_LAG) {
+		unsigned int i = r->acct_seq % FEC_ACCT_FRAMES;
+		r->expected_packets += r->acct_expected[i];
+		r->received_packets += r->acct_received[i];
+		r->acct_expected[i] = 0;
+		r->acct_received[i] = 0;
+		r->acct_seq++;
+	}
+	if (now - r->report_us < (uint64_t)AV_FEC_REPORT_INTERVAL * 1000ULL || r->expected_packets == 0)
+		return;
+	r->report_us = now;
+	loss = r->received_packets >= r->expected_packets ? 0 :
+		(unsigned int)((uint64_t)(r->expected_packets - r->received_packets) * 1000ULL / r->expected_packets);
+	r->expected_packets = 0;
+	r->received_packets = 0;
+
+	pthread_mutex_lock(&r->lock);
+	r->stats.lossPermille = loss;
+	pthread_mutex_unlock(&r->lock);
+
+	pkt[0] = FEC_TYPE_REPORT;
+	fec_put16(pkt + 1, loss);
+	IOTC_Session_Write(r->sid, (const char *)pkt, sizeof(pkt), r->channel);
+}
+
+static void *fec_receiver_thread(void *arg)
+{
+	FecReceiver *r = (FecReceiver *)arg;
+	unsigned char pkt[IOTC_MAX_PACKET_SIZE];
+
+	for (;;) {
+		uint64_t now;
+		int ret, stopping;
+
+		pthread_mutex_lock(&r->lock);
+		stopping = r->stopping;
+		pthread_mutex_unlock(&r->lock);
+		if (stopping)
+			break;
+
+		ret = IOTC_Session_Read(r->sid, (char *)pkt, sizeof(pkt), FEC_READ_TIMEOUT, r->channel);
+		now = ext_now_us();
+		if (ret > 0) {
+			fec_rx_packet(r, pkt, ret, now);
+		} else if (ret < 0 && ret != IOTC_ER_TIMEOUT) {
+			if (fec_session_closed(ret)) {
+				pthread_mutex_lock(&r->lock);
+				r->closed_error = ret;
+				r->stats.lastError = ret;
+				pthread_cond_broadcast(&r->cond);
+				pthread_mutex_unlock(&r->lock);
+				break;
+			}
+			ext_sleep_ms(FEC_READ_TIMEOUT);
+		}
+		fec_rx_deliver(r, now);
+		if (r->cfg.resend)
+			fec_rx_nack(r, now);
+		fec_rx_report(r, now);
+	}
+	return NULL;
+}
+
+static void fec_receiver_free(FecReceiver *r)
+{
+	int i, b;
+
+	for (i = 0; i < FEC_RX_WINDOW; i++) {
+		for (b = 0; r->win[i].used && b < r->win[i].blocks; b++)
+			free(r->win[i].blk[b].parity);
+		free(r->win[i].blk);
+		free(r->win[i].payload);
+	}
+	while (r->count > 0) {
+		avFrameRelease(r->queue[r->head]);
+		r->head = (r->head + 1) % FEC_RX_QUEUE;
+		r->count--;
+	}
+	free(r->win);
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+}
+
+int avFecReceiverCreate(int nIOTCSessionID, unsigned char nIOTCChannelID, const AVFecConfig *pConfig)
+{
+	FecReceiver *r;
+	int id;
+
+	if (nIOTCSessionID < 0)
+		return AV_ER_INVALID_ARG;
+	r = (FecReceiver *)calloc(1, sizeof(FecReceiver));
+	if (r == NULL)
+		return AV_ER_MEM_INSUFF;
+	if (fec_check_config(pConfig, &r->cfg) < 0) {
+		free(r);
+		return AV_ER_INVALID_ARG;
+	}
+	r->win = (FecRxFrame *)calloc(FEC_RX_WINDOW, sizeof(FecRxFrame));
+	if (r->win == NULL) {
+		free(r);
+		return AV_ER_MEM_INSUFF;
+	}
+	r->sid = nIOTCSessionID;
+	r->channel = nIOTCChannelID;
+	r->report_us = ext_now_us();
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	if (pthread_create(&r->thread, NULL, fec_receiver_thread, r) != 0) {
+		fec_receiver_free(r);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	id = ext_table_add(&gFecReceivers, r);
+	if (id < 0) {
+		pthread_mutex_lock(&r->lock);
+		r->stopping = 1;
+		pthread_mutex_unlock(&r->lock);
+		pthread_join(r->thread, NULL);
+		fec_receiver_free(r);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avFecReceiverDestroy(int nFecReceiverID)
+{
+	FecReceiver *r = (FecReceiver *)ext_table_take(&gFecReceivers, nFecReceiverID);
+
+	if (r == NULL)
+		return;
+	pthread_mutex_lock(&r->lock);
+	r->stopping = 1;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+	fec_receiver_free(r);
+}
+
+int avFecRecvFrame(int nFecReceiverID, AVFrame **ppFrame, unsigned int nTimeout)
+{
+	FecReceiver *r = (FecReceiver *)ext_table_get(&gFecReceivers, nFecReceiverID);
+	uint64_t deadline = ext_now_us() + (uint64_t)nTimeout * 1000ULL;
+	int ret;
+
+	if (r == NULL || ppFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	*ppFrame = NULL;
+
+	pthread_mutex_lock(&r->lock);
+	for (;;) {
+		uint64_t now;
+
+		if (r->count > 0) {
+			*ppFrame = r->queue[r->head];
+			r->queue[r->head] = NULL;
+			r->head = (r->head + 1) % FEC_RX_QUEUE;
+			r->count--;
+			ret = r->skipped > 0 ? AV_ER_LOSED_THIS_FRAME : AV_ER_NoERROR;
+			r->skipped = 0;
+			break;
+		}
+		if (r->closed_error != 0) {
+			ret = r->closed_error;
+			break;
+		}
+		now = ext_now_us();
+		if (now >= deadline) {
+			ret = AV_ER_TIMEOUT;
+			break;
+		}
+		ext_cond_wait_ms(&r->cond, &r->lock, (unsigned int)((deadline - now + 999) / 1000));
+	}
+	pthread_mutex_unlock(&r->lock);
+	return ret;
+}
+
+int avFecReceiverGetStats(int nFecReceiverID, AVFecReceiverStats *pStats)
+{
+	FecReceiver *r = (FecReceiver *)ext_table_get(&gFecReceivers, nFecReceiverID);
+
+	if (r == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&r->lock);
+	*pStats = r->stats;
+	pthread_mutex_unlock(&r->lock);
+	return AV_ER_NoERROR;
+}
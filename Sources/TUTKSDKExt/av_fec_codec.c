@@ -0,0 +1,415 @@
+/*! \file av_fec_codec.c
+Reed-Solomon codec over GF(256) for the FEC channels, see AVFecAPIs.h and ext_fec.h.
+
+The code is systematic with a Cauchy parity matrix, C[i][j] = 1 / (x_i + y_j)
+with y_j = j and x_i = k + i. Every square submatrix of a Cauchy matrix is
+invertible, so any k of the k + m shards rebuild the block. Each column is
+scaled so that row 0 is all ones, which keeps that property and makes the
+first parity shard a plain XOR.
+
+All the work is in one kernel, dst ^= c * src over a shard. The portable
+engine looks up a full 64 KB product table. The SIMD engines split each
+source byte into two nibbles and look both up in 16-entry tables with one
+byte shuffle each, 16 bytes at a time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ext_fec.h"
+#include "ext_platform.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+	#define FEC_HAVE_SSSE3 1
+	#include <cpuid.h>
+	#include <tmmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+	#define FEC_HAVE_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#define FEC_POLY			0x11d
+
+static unsigned char gExp[512];
+static unsigned char gLog[256];
+static unsigned char gMul[256][256];
+static unsigned char gMulLo[256][16];
+static unsigned char gMulHi[256][16];
+static pthread_once_t gTableOnce = PTHREAD_ONCE_INIT;
+static AVFecEngine gDetectedEngine = AV_FEC_ENGINE_PORTABLE;
+static AVFecEngine gForcedEngine = AV_FEC_ENGINE_AUTO;
+
+static int fec_detect_ssse3(void)
+{
+#ifdef FEC_HAVE_SSSE3
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// ECX bit 9: SSSE3
+	return (ecx & (1u << 9)) != 0;
+#else
+	return 0;
+#endif
+}
+
+static int fec_detect_neon(void)
+{
+#ifdef FEC_HAVE_NEON
+	// Advanced SIMD is mandatory on arm64
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static unsigned char fec_mul(unsigned char a, unsigned char b)
+{
+	if (a == 0 || b == 0)
+		return 0;
+	return gExp[gLog[a] + gLog[b]];
+}
+
+static unsigned char fec_inv(unsigned char a)
+{
+	return gExp[255 - gLog[a]];
+}
+
+static void fec_init_tables(void)
+{
+	unsigned int x = 1;
+	int i, j;
+
+	for (i = 0; i < 255; i++) {
+		gExp[i] = (unsigned char)x;
+		gLog[x] = (unsigned char)i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= FEC_POLY;
+	}
+	// Doubled so gExp[log a + log b] needs no modulo
+	for (i = 255; i < 512; i++)
+		gExp[i] = gExp[i - 255];
+
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 256; j++)
+			gMul[i][j] = fec_mul((unsigned char)i, (unsigned char)j);
+		for (j = 0; j < 16; j++) {
+			gMulLo[i][j] = gMul[i][j];
+			gMulHi[i][j] = gMul[i][j << 4];
+		}
+	}
+
+	if (fec_detect_neon())
+		gDetectedEngine = AV_FEC_ENGINE_NEON;
+	else if (fec_detect_ssse3())
+		gDetectedEngine = AV_FEC_ENGINE_SSSE3;
+	else
+		gDetectedEngine = AV_FEC_ENGINE_PORTABLE;
+}
+
+static void fec_init(void)
+{
+	pthread_once(&gTableOnce, fec_init_tables);
+}
+
+// The parity matrix entry of parity row i and data column j in a block of k data shards
+static unsigned char fec_coef(int k, int i, int j)
+{
+	return fec_mul((unsigned char)(k ^ j), fec_inv((unsigned char)((k + i) ^ j)));
+}
+
+/* ============================================================================
+ * Kernels
+ * ============================================================================
+ */
+
+static void fec_xor(unsigned char *dst, const unsigned char *src, int len)
+{
+	int i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		uint64_t a, b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for (; i < len; i++)
+		dst[i] ^= src[i];
+}
+
+static void fec_portable_muladd(unsigned char *dst, const unsigned char *src, unsigned char c, int len)
+{
+	const unsigned char *t = gMul[c];
+	int i;
+
+	for (i = 0; i < len; i++)
+		dst[i] ^= t[src[i]];
+}
+
+#ifdef FEC_HAVE_SSSE3
+__attribute__((target("ssse3")))
+static void fec_ssse3_muladd(unsigned char *dst, const unsigned char *src, unsigned char c, int len)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)gMulLo[c]);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)gMulHi[c]);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(s, mask));
+		__m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+	}
+	fec_portable_muladd(dst + i, src + i, c, len - i);
+}
+#endif
+
+#ifdef FEC_HAVE_NEON
+static void fec_neon_muladd(unsigned char *dst, const unsigned char *src, unsigned char c, int len)
+{
+	const uint8x16_t lo = vld1q_u8(gMulLo[c]);
+	const uint8x16_t hi = vld1q_u8(gMulHi[c]);
+	const uint8x16_t mask = vdupq_n_u8(0x0f);
+	int i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t s = vld1q_u8(src + i);
+		uint8x16_t l = vqtbl1q_u8(lo, vandq_u8(s, mask));
+		uint8x16_t h = vqtbl1q_u8(hi, vshrq_n_u8(s, 4));
+		vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), veorq_u8(l, h)));
+	}
+	fec_portable_muladd(dst + i, src + i, c, len - i);
+}
+#endif
+
+static void fec_muladd(AVFecEngine engine, unsigned char *dst, const unsigned char *src, unsigned char c, int len)
+{
+	if (c == 0)
+		return;
+	if (c == 1) {
+		fec_xor(dst, src, len);
+		return;
+	}
+	switch (engine) {
+#ifdef FEC_HAVE_SSSE3
+	case AV_FEC_ENGINE_SSSE3:
+		fec_ssse3_muladd(dst, src, c, len);
+		break;
+#endif
+#ifdef FEC_HAVE_NEON
+	case AV_FEC_ENGINE_NEON:
+		fec_neon_muladd(dst, src, c, len);
+		break;
+#endif
+	default:
+		fec_portable_muladd(dst, src, c, len);
+		break;
+	}
+}
+
+/* ============================================================================
+ * Codec
+ * ============================================================================
+ */
+
+void ext_fec_encode(AVFecEngine engine, const unsigned char *const *data, int k,
+					unsigned char *const *parity, int m, int len)
+{
+	int i, j;
+
+	fec_init();
+	for (i = 0; i < m; i++) {
+		memset(parity[i], 0, (size_t)len);
+		for (j = 0; j < k; j++)
+			fec_muladd(engine, parity[i], data[j], fec_coef(k, i, j), len);
+	}
+}
+
+// Invert the n x n matrix a in place. Returns -1 if it is singular.
+static int fec_invert(unsigned char a[EXT_FEC_MAX_PARITY][EXT_FEC_MAX_PARITY], int n)
+{
+	unsigned char inv[EXT_FEC_MAX_PARITY][EXT_FEC_MAX_PARITY];
+	int r, c, p;
+
+	memset(inv, 0, sizeof(inv));
+	for (r = 0; r < n; r++)
+		inv[r][r] = 1;
+
+	for (c = 0; c < n; c++) {
+		unsigned char f;
+
+		for (p = c; p < n && a[p][c] == 0; p++)
+			;
+		if (p == n)
+			return -1;
+		for (r = 0; p != c && r < n; r++) {
+			unsigned char t = a[p][r];
+			a[p][r] = a[c][r];
+			a[c][r] = t;
+			t = inv[p][r];
+			inv[p][r] = inv[c][r];
+			inv[c][r] = t;
+		}
+		f = fec_inv(a[c][c]);
+		for (r = 0; r < n; r++) {
+			a[c][r] = gMul[f][a[c][r]];
+			inv[c][r] = gMul[f][inv[c][r]];
+		}
+		for (p = 0; p < n; p++) {
+			unsigned char g = a[p][c];
+			if (p == c || g == 0)
+				continue;
+			for (r = 0; r < n; r++) {
+				a[p][r] ^= gMul[g][a[c][r]];
+				inv[p][r] ^= gMul[g][inv[c][r]];
+			}
+		}
+	}
+	memcpy(a, inv, sizeof(inv));
+	return 0;
+}
+
+int ext_fec_decode(AVFecEngine engine, unsigned char *const *shards, const unsigned char *present,
+				   int k, int m, int len)
+{
+	unsigned char mat[EXT_FEC_MAX_PARITY][EXT_FEC_MAX_PARITY];
+	int lost[EXT_FEC_MAX_PARITY], rows[EXT_FEC_MAX_PARITY];
+	int e = 0, n = 0, i, j;
+
+	fec_init();
+	for (j = 0; j < k; j++) {
+		if (!present[j]) {
+			if (e == m || e == EXT_FEC_MAX_PARITY)
+				return -1;
+			lost[e++] = j;
+		}
+	}
+	if (e == 0)
+		return 0;
+	for (i = 0; i < m && n < e; i++) {
+		if (present[k + i])
+			rows[n++] = i;
+	}
+	if (n < e)
+		return -1;
+
+	// Turn each chosen parity shard into a syndrome of the lost data shards only
+	for (i = 0; i < e; i++) {
+		unsigned char *s = shards[k + rows[i]];
+		for (j = 0; j < k; j++) {
+			if (present[j])
+				fec_muladd(engine, s, shards[j], fec_coef(k, rows[i], j), len);
+		}
+		for (j = 0; j < e; j++)
+			mat[i][j] = fec_coef(k, rows[i], lost[j]);
+	}
+	if (fec_invert(mat, e) < 0)
+		return -1;
+
+	for (j = 0; j < e; j++) {
+		unsigned char *d = shards[lost[j]];
+		memset(d, 0, (size_t)len);
+		for (i = 0; i < e; i++)
+			fec_muladd(engine, d, shards[k + rows[i]], mat[j][i], len);
+	}
+	return 0;
+}
+
+/* ============================================================================
+ * Engines
+ * ============================================================================
+ */
+
+int avFecEngineSupported(AVFecEngine engine)
+{
+	fec_init();
+	switch (engine) {
+	case AV_FEC_ENGINE_AUTO:
+	case AV_FEC_ENGINE_PORTABLE:
+		return 1;
+	case AV_FEC_ENGINE_SSSE3:
+		return fec_detect_ssse3();
+	case AV_FEC_ENGINE_NEON:
+		return fec_detect_neon();
+	default:
+		return 0;
+	}
+}
+
+AVFecEngine avFecGetEngine(void)
+{
+	fec_init();
+	return gForcedEngine != AV_FEC_ENGINE_AUTO ? gForcedEngine : gDetectedEngine;
+}
+
+int avFecSetEngine(AVFecEngine engine)
+{
+	if (engine < AV_FEC_ENGINE_AUTO || engine > AV_FEC_ENGINE_NEON || !avFecEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	gForcedEngine = engine;
+	return AV_ER_NoERROR;
+}
+
+int avFecBenchmark(AVFecEngine engine, unsigned int nBlockSize, unsigned int nRedundancy,
+				   unsigned int nDurationMs, float *pfEncodeMBps, float *pfDecodeMBps)
+{
+	const int len = IOTC_MAX_PACKET_SIZE;
+	unsigned char *shards[AV_FEC_MAX_BLOCK_PACKETS], *buf, *saved, present[AV_FEC_MAX_BLOCK_PACKETS];
+	uint64_t start, elapsed, bytes;
+	int k = (int)nBlockSize, m, i;
+
+	if (pfEncodeMBps == NULL || pfDecodeMBps == NULL || nDurationMs == 0 || nRedundancy > 100 ||
+		k <= 0 || k > AV_FEC_MAX_BLOCK_PACKETS / 2 || !avFecEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	if (engine == AV_FEC_ENGINE_AUTO)
+		engine = avFecGetEngine();
+	m = (k * (int)nRedundancy + 99) / 100;
+	if (m == 0)
+		m = 1;
+
+	buf = (unsigned char *)malloc((size_t)(k + m) * (size_t)len);
+	saved = (unsigned char *)malloc((size_t)m * (size_t)len);
+	if (buf == NULL || saved == NULL) {
+		free(buf);
+		free(saved);
+		return AV_ER_MEM_INSUFF;
+	}
+	for (i = 0; i < k + m; i++)
+		shards[i] = buf + (size_t)i * (size_t)len;
+	for (i = 0; i < k * len; i++)
+		buf[i] = (unsigned char)(i * 131 + 7);
+
+	bytes = 0;
+	start = ext_now_us();
+	do {
+		ext_fec_encode(engine, (const unsigned char *const *)shards, k, shards + k, m, len);
+		bytes += (uint64_t)k * (uint64_t)len;
+		elapsed = ext_now_us() - start;
+	} while (elapsed < (uint64_t)nDurationMs * 1000ULL);
+	*pfEncodeMBps = (float)((double)bytes / (double)elapsed);
+
+	// Lose the first m data shards, the worst case the code still recovers from.
+	// Decoding uses the parity as scratch, so put it back before each run.
+	memcpy(saved, shards[k], (size_t)m * (size_t)len);
+	memset(present, 1, sizeof(present));
+	for (i = 0; i < m && i < k; i++)
+		present[i] = 0;
+	bytes = 0;
+	start = ext_now_us();
+	do {
+		memcpy(shards[k], saved, (size_t)m * (size_t)len);
+		ext_fec_decode(engine, shards, present, k, m, len);
+		bytes += (uint64_t)(m < k ? m : k) * (uint64_t)len;
+		elapsed = ext_now_us() - start;
+	} while (elapsed < (uint64_t)nDurationMs * 1000ULL);
+	*pfDecodeMBps = (float)((double)bytes / (double)elapsed);
+
+	free(buf);
+	free(saved);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,322 @@
+/*! \file av_frame.c
+Reference counted frames and the frame pool, see AVFrameAPIs.h.
+
+Buffers are power of two size classes from AV_FRAME_POOL_MIN_CLASS_SIZE to
+AV_FRAME_POOL_MAX_CLASS_SIZE. The frame header and its data share one
+allocation, and a released frame is pushed on the free list of its class
+unless that would keep more than the cache limit. The SDK cannot report the
+size of the next frame before receiving it, so each AV channel receives into
+the class of the largest frame it has seen. Frames made by avFrameWrap()
+only own their header, which is kept on a free list of its own and not
+counted in the pool statistics.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "AVFrameAPIs.h"
+#include "AVBufBudgetAPIs.h"
+#include "ext_frame.h"
+
+#define FRAME_CLASS_COUNT	12		// 4 KB .. 8 MB
+#define FRAME_NOT_POOLED	(-1)
+#define FRAME_WRAPPED		(-2)
+#define FRAME_MAX_FREE_WRAP	64
+
+typedef struct FrameBuf {
+	AVFrame frame;			// must be first, AVFrame pointers are cast back to FrameBuf
+	int refs;
+	int size_class;
+	avFrameReleaseFn release_fn;
+	void *user_data;
+	struct FrameBuf *next;	// free list link
+} FrameBuf;
+
+static pthread_mutex_t gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static FrameBuf *gFreeLists[FRAME_CLASS_COUNT];
+static FrameBuf *gFreeWraps = NULL;
+static int gFreeWrapCount = 0;
+static unsigned int gInitialSize = AV_FRAME_POOL_DEFAULT_INITIAL_SIZE;
+static unsigned long long gMaxCached = AV_FRAME_POOL_DEFAULT_MAX_CACHED;
+static AVFramePoolStats gStats;
+static int *gChannelSizes = NULL;
+static int gChannelCount = 0;
+
+static int frame_class_of(int size)
+{
+	int k, class_size = AV_FRAME_POOL_MIN_CLASS_SIZE;
+
+	for (k = 0; k < FRAME_CLASS_COUNT; k++, class_size <<= 1) {
+		if (size <= class_size)
+			return k;
+	}
+	return FRAME_NOT_POOLED;
+}
+
+// Caller holds gPoolLock
+static void frame_account_get(int capacity, int hit)
+{
+	gStats.getCount++;
+	if (hit)
+		gStats.hitCount++;
+	gStats.framesInUse++;
+	if (gStats.framesInUse > gStats.framesInUseHighWater)
+		gStats.framesInUseHighWater = gStats.framesInUse;
+	gStats.bytesInUse += (unsigned int)capacity;
+	if (gStats.bytesInUse > gStats.bytesInUseHighWater)
+		gStats.bytesInUseHighWater = gStats.bytesInUse;
+}
+
+AVFrame *ext_frame_alloc(int size)
+{
+	int k = frame_class_of(size);
+	int capacity = k == FRAME_NOT_POOLED ? size : AV_FRAME_POOL_MIN_CLASS_SIZE << k;
+	FrameBuf *b = NULL;
+
+	if (size < 0)
+		return NULL;
+
+	pthread_mutex_lock(&gPoolLock);
+	if (k != FRAME_NOT_POOLED && gFreeLists[k] != NULL) {
+		b = gFreeLists[k];
+		gFreeLists[k] = b->next;
+		gStats.bytesCached -= (unsigned int)capacity;
+		frame_account_get(capacity, 1);
+	}
+	pthread_mutex_unlock(&gPoolLock);
+
+	if (b == NULL) {
+		b = (FrameBuf *)malloc(sizeof(FrameBuf) + (size_t)capacity);
+		if (b == NULL)
+			return NULL;
+		b->size_class = k;
+		b->frame.data = (char *)(b + 1);
+		b->frame.capacity = capacity;
+		pthread_mutex_lock(&gPoolLock);
+		frame_account_get(capacity, 0);
+		pthread_mutex_unlock(&gPoolLock);
+	}
+
+	b->refs = 1;
+	b->release_fn = NULL;
+	b->user_data = NULL;
+	b->next = NULL;
+	b->frame.dataSize = 0;
+	b->frame.expectedSize = 0;
+	b->frame.infoSize = 0;
+	b->frame.frameIndex = 0;
+	return &b->frame;
+}
+
+int avFramePoolSetup(unsigned int nInitialFrameSize, unsigned int nMaxCachedBytes)
+{
+	pthread_mutex_lock(&gPoolLock);
+	gInitialSize = nInitialFrameSize != 0 ? nInitialFrameSize : AV_FRAME_POOL_DEFAULT_INITIAL_SIZE;
+	gMaxCached = nMaxCachedBytes != 0 ? nMaxCachedBytes : AV_FRAME_POOL_DEFAULT_MAX_CACHED;
+	pthread_mutex_unlock(&gPoolLock);
+	return AV_ER_NoERROR;
+}
+
+void avFramePoolTrim(void)
+{
+	FrameBuf *lists[FRAME_CLASS_COUNT], *wraps, *b;
+	int k;
+
+	pthread_mutex_lock(&gPoolLock);
+	memcpy(lists, gFreeLists, sizeof(lists));
+	memset(gFreeLists, 0, sizeof(gFreeLists));
+	gStats.bytesCached = 0;
+	wraps = gFreeWraps;
+	gFreeWraps = NULL;
+	gFreeWrapCount = 0;
+	pthread_mutex_unlock(&gPoolLock);
+
+	while ((b = wraps) != NULL) {
+		wraps = b->next;
+		free(b);
+	}
+
+	for (k = 0; k < FRAME_CLASS_COUNT; k++) {
+		while ((b = lists[k]) != NULL) {
+			lists[k] = b->next;
+			free(b);
+		}
+	}
+}
+
+int avFramePoolGetStats(AVFramePoolStats *pStats)
+{
+	if (pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gPoolLock);
+	*pStats = gStats;
+	pthread_mutex_unlock(&gPoolLock);
+	pStats->hitRate = pStats->getCount > 0 ? (float)((double)pStats->hitCount / (double)pStats->getCount) : 0.0f;
+	return AV_ER_NoERROR;
+}
+
+/** The receive size of an AV channel: the largest frame seen, or the initial size. */
+static int frame_channel_size(int nAVChannelID)
+{
+	int size;
+
+	pthread_mutex_lock(&gPoolLock);
+	size = nAVChannelID < gChannelCount && gChannelSizes[nAVChannelID] > 0 ?
+		gChannelSizes[nAVChannelID] : (int)gInitialSize;
+	pthread_mutex_unlock(&gPoolLock);
+	return size;
+}
+
+static void frame_channel_grow(int nAVChannelID, int size, int lost)
+{
+	pthread_mutex_lock(&gPoolLock);
+	if (lost)
+		gStats.resizeCount++;
+	if (nAVChannelID >= gChannelCount) {
+		int count = gChannelCount > 0 ? gChannelCount : 16;
+		int *sizes;
+		while (count <= nAVChannelID)
+			count *= 2;
+		sizes = (int *)realloc(gChannelSizes, (size_t)count * sizeof(int));
+		if (sizes == NULL) {
+			pthread_mutex_unlock(&gPoolLock);
+			return;
+		}
+		memset(sizes + gChannelCount, 0, (size_t)(count - gChannelCount) * sizeof(int));
+		gChannelSizes = sizes;
+		gChannelCount = count;
+	}
+	if (size > gChannelSizes[nAVChannelID])
+		gChannelSizes[nAVChannelID] = size;
+	pthread_mutex_unlock(&gPoolLock);
+}
+
+int avRecvFrameDataPooled(int nAVChannelID, AVFrame **ppFrame)
+{
+	AVFrame *f;
+	int size, ret, actual = 0, expected = 0, info_size = 0;
+	unsigned int frame_index = 0;
+
+	if (ppFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	*ppFrame = NULL;
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+
+	size = frame_channel_size(nAVChannelID);
+	f = ext_frame_alloc(size);
+	if (f == NULL)
+		return AV_ER_MEM_INSUFF;
+
+	ret = avRecvFrameData2(nAVChannelID, f->data, f->capacity, &actual, &expected,
+						   f->info, AV_FRAME_INFO_MAX_SIZE, &info_size, &frame_index);
+	if (expected > size)
+		frame_channel_grow(nAVChannelID, expected, ret == AV_ER_BUFPARA_MAXSIZE_INSUFF);
+	if (ret < 0 && ret != AV_ER_INCOMPLETE_FRAME) {
+		avFrameRelease(f);
+		return ret;
+	}
+
+	f->dataSize = ret >= 0 ? ret : actual;
+	f->expectedSize = expected;
+	f->infoSize = info_size;
+	f->frameIndex = frame_index;
+	*ppFrame = f;
+	avBufBudgetReceived(nAVChannelID, f->dataSize);
+	return ret;
+}
+
+void avFramePoolResetChannel(int nAVChannelID)
+{
+	pthread_mutex_lock(&gPoolLock);
+	if (nAVChannelID >= 0 && nAVChannelID < gChannelCount)
+		gChannelSizes[nAVChannelID] = 0;
+	pthread_mutex_unlock(&gPoolLock);
+}
+
+AVFrame *avFrameWrap(char *pData, int nDataSize, const void *cabFrameInfo, int nFrameInfoSize,
+					 avFrameReleaseFn pfxReleaseFn, void *pUserData)
+{
+	FrameBuf *b;
+
+	if ((pData == NULL && nDataSize > 0) || nDataSize < 0 || nFrameInfoSize < 0 ||
+		nFrameInfoSize > AV_FRAME_INFO_MAX_SIZE || (cabFrameInfo == NULL && nFrameInfoSize > 0))
+		return NULL;
+
+	pthread_mutex_lock(&gPoolLock);
+	b = gFreeWraps;
+	if (b != NULL) {
+		gFreeWraps = b->next;
+		gFreeWrapCount--;
+	}
+	pthread_mutex_unlock(&gPoolLock);
+	if (b == NULL) {
+		b = (FrameBuf *)malloc(sizeof(FrameBuf));
+		if (b == NULL)
+			return NULL;
+		b->size_class = FRAME_WRAPPED;
+	}
+
+	b->refs = 1;
+	b->release_fn = pfxReleaseFn;
+	b->user_data = pUserData;
+	b->next = NULL;
+	b->frame.data = pData;
+	b->frame.dataSize = nDataSize;
+	b->frame.capacity = nDataSize;
+	b->frame.expectedSize = nDataSize;
+	if (nFrameInfoSize > 0)
+		memcpy(b->frame.info, cabFrameInfo, (size_t)nFrameInfoSize);
+	b->frame.infoSize = nFrameInfoSize;
+	b->frame.frameIndex = 0;
+	return &b->frame;
+}
+
+AVFrame *avFrameRetain(AVFrame *pFrame)
+{
+	if (pFrame != NULL)
+		__atomic_add_fetch(&((FrameBuf *)pFrame)->refs, 1, __ATOMIC_RELAXED);
+	return pFrame;
+}
+
+void avFrameRelease(AVFrame *pFrame)
+{
+	FrameBuf *b = (FrameBuf *)pFrame;
+	int cached = 0;
+
+	if (b == NULL || __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	if (b->size_class == FRAME_WRAPPED) {
+		if (b->release_fn != NULL)
+			b->release_fn(b->frame.data, b->user_data);
+		pthread_mutex_lock(&gPoolLock);
+		if (gFreeWrapCount < FRAME_MAX_FREE_WRAP) {
+			b->next = gFreeWraps;
+			gFreeWraps = b;
+			gFreeWrapCount++;
+			cached = 1;
+		}
+		pthread_mutex_unlock(&gPoolLock);
+		if (!cached)
+			free(b);
+		return;
+	}
+
+	pthread_mutex_lock(&gPoolLock);
+	gStats.framesInUse--;
+	gStats.bytesInUse -= (unsigned int)b->frame.capacity;
+	if (b->size_class != FRAME_NOT_POOLED && gStats.bytesCached + (unsigned int)b->frame.capacity <= gMaxCached) {
+		b->next = gFreeLists[b->size_class];
+		gFreeLists[b->size_class] = b;
+		gStats.bytesCached += (unsigned int)b->frame.capacity;
+		if (gStats.bytesCached > gStats.bytesCachedHighWater)
+			gStats.bytesCachedHighWater = gStats.bytesCached;
+		cached = 1;
+	}
+	pthread_mutex_unlock(&gPoolLock);
+
+	if (!cached)
+		free(b);
+}
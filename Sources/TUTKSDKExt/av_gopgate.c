@@ -0,0 +1,191 @@
+/*! \file av_gopgate.c
+GOP gates, see AVGopGateAPIs.h.
+
+The gate has two states: passing, and dropping until the next keyframe. A
+flush runs avServResetBuffer() on its own thread, since it waits for the
+client, and the sender only blocks on it when a keyframe is ready to go out.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVGopGateAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_av.h"
+
+typedef struct GopGate {
+	int av_index;
+	float high_usage;
+	float critical_usage;
+	avKeyFrameRequestFn key_fn;
+	void *user_data;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int dropping;
+	int flushing;
+	int has_flush_thread;
+	pthread_t flush_thread;
+	AVGopGateStats stats;
+} GopGate;
+
+static ExtTable gGopGates = EXT_TABLE_INITIALIZER;
+
+static void *gopgate_flush_thread(void *arg)
+{
+	GopGate *g = (GopGate *)arg;
+	int ret = avServResetBuffer(g->av_index, RESET_VIDEO, AV_GOP_RESET_TIMEOUT);
+
+	pthread_mutex_lock(&g->lock);
+	if (ret >= 0)
+		g->stats.flushCount++;
+	g->flushing = 0;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+	return NULL;
+}
+
+// Caller holds g->lock
+static void gopgate_start_flush(GopGate *g)
+{
+	if (g->flushing)
+		return;
+	// The last flush thread has cleared flushing and is about to return
+	if (g->has_flush_thread)
+		pthread_join(g->flush_thread, NULL);
+	g->has_flush_thread = pthread_create(&g->flush_thread, NULL, gopgate_flush_thread, g) == 0;
+	g->flushing = g->has_flush_thread;
+}
+
+// Caller holds g->lock. Returns 1 if the encoder should be asked for a keyframe.
+static int gopgate_start_drop(GopGate *g, float usage)
+{
+	if (g->dropping)
+		return 0;
+	g->dropping = 1;
+	g->stats.skippedGops++;
+	if (usage >= g->critical_usage)
+		gopgate_start_flush(g);
+	if (g->key_fn == NULL)
+		return 0;
+	g->stats.keyFrameRequests++;
+	return 1;
+}
+
+int avGopGateAttach(int nAVChannelID, float fHighUsage, float fCriticalUsage,
+					avKeyFrameRequestFn pfxKeyFrameFn, void *pUserData)
+{
+	GopGate *g;
+
+	if (fHighUsage == 0)
+		fHighUsage = AV_GOP_DEFAULT_HIGH_USAGE;
+	if (fCriticalUsage == 0)
+		fCriticalUsage = fHighUsage > AV_GOP_DEFAULT_CRITICAL_USAGE ? fHighUsage : AV_GOP_DEFAULT_CRITICAL_USAGE;
+	if (nAVChannelID < 0 || fHighUsage < 0 || fHighUsage > 1 || fCriticalUsage < fHighUsage || fCriticalUsage > 1)
+		return AV_ER_INVALID_ARG;
+
+	g = (GopGate *)calloc(1, sizeof(GopGate));
+	if (g == NULL)
+		return AV_ER_MEM_INSUFF;
+	g->av_index = nAVChannelID;
+	g->high_usage = fHighUsage;
+	g->critical_usage = fCriticalUsage;
+	g->key_fn = pfxKeyFrameFn;
+	g->user_data = pUserData;
+	g->stats.lastUsage = -1;
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+
+	if (ext_table_set(&gGopGates, nAVChannelID, g) < 0) {
+		pthread_cond_destroy(&g->cond);
+		pthread_mutex_destroy(&g->lock);
+		free(g);
+		return AV_ER_INVALID_ARG;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avGopGateDetach(int nAVChannelID)
+{
+	GopGate *g = (GopGate *)ext_table_take(&gGopGates, nAVChannelID);
+
+	if (g == NULL)
+		return;
+	pthread_mutex_lock(&g->lock);
+	while (g->flushing)
+		pthread_cond_wait(&g->cond, &g->lock);
+	pthread_mutex_unlock(&g->lock);
+	if (g->has_flush_thread)
+		pthread_join(g->flush_thread, NULL);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g);
+}
+
+int ext_gopgate_attached(int nAVChannelID)
+{
+	return ext_table_get(&gGopGates, nAVChannelID) != NULL;
+}
+
+int avSendFrameDataGop(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+					   const void *cabFrameInfo, int nFrameInfoSize, int bKeyFrame)
+{
+	GopGate *g = (GopGate *)ext_table_get(&gGopGates, nAVChannelID);
+	int request_key = 0, ret;
+	float usage;
+
+	if (g == NULL)
+		return AV_ER_INVALID_ARG;
+
+	// Negative if resend is off, which never crosses a watermark
+	usage = avResendBufUsageRate(nAVChannelID);
+
+	pthread_mutex_lock(&g->lock);
+	g->stats.lastUsage = usage;
+	if (bKeyFrame) {
+		// Jump to this keyframe: drop what is still queued ahead of it, then send it
+		if (usage >= g->critical_usage)
+			gopgate_start_flush(g);
+		while (g->flushing)
+			pthread_cond_wait(&g->cond, &g->lock);
+		g->dropping = 0;
+	} else if (usage >= g->high_usage) {
+		request_key = gopgate_start_drop(g, usage);
+	}
+	if (g->dropping) {
+		g->stats.droppedFrames++;
+		pthread_mutex_unlock(&g->lock);
+		if (request_key)
+			g->key_fn(nAVChannelID, g->user_data);
+		return AV_ER_WAIT_KEY_FRAME;
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	ret = avSendFrameDataPaced(nAVChannelID, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize, NULL);
+
+	pthread_mutex_lock(&g->lock);
+	if (ret < 0 && ret != AV_ER_EXCEED_MAX_ALARM) {
+		// The client lost this frame, so the rest of the GOP cannot be decoded
+		if (!ext_av_channel_closed(ret))
+			request_key = gopgate_start_drop(g, usage);
+	} else {
+		g->stats.sentFrames++;
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	if (request_key)
+		g->key_fn(nAVChannelID, g->user_data);
+	return ret;
+}
+
+int avGopGateGetStats(int nAVChannelID, AVGopGateStats *pStats)
+{
+	GopGate *g = (GopGate *)ext_table_get(&gGopGates, nAVChannelID);
+
+	if (g == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&g->lock);
+	*pStats = g->stats;
+	pthread_mutex_unlock(&g->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,474 @@
+/*! \file av_ioctrldispatch.c
+IO control dispatcher, see AVIOCtrlDispatchAPIs.h.
+
+The poll thread sweeps the attached AV channels with avRecvIOCtrl() and a
+zero timeout. After a sweep which found nothing it sleeps, 1 ms at first
+and twice as long each time up to max_idle_ms, so an idle dispatcher costs
+little and a busy one polls without sleeping.
+Received IO controls go into the job queue of their AV channel. An AV
+channel with jobs is on the ready queue at most once; a worker takes it,
+runs one job and puts it back at the end if it has more. So the jobs of an
+AV channel run one at a time and in order, and busy AV channels take turns.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVIOCtrlDispatchAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+#include "ext_av.h"
+
+// A table whose types span at most this many times its entries, plus a little, is looked up in a dense array
+#define DISPATCH_DENSE_FACTOR	4
+#define DISPATCH_DENSE_SLACK	16
+
+// The most IO controls taken from one AV channel per sweep, so one channel cannot starve the others
+#define DISPATCH_SWEEP_BURST	8
+
+typedef struct DispatchJob {
+	struct DispatchJob *next;
+	unsigned int type;
+	int size;
+	char data[];
+} DispatchJob;
+
+struct Dispatcher;
+
+typedef struct DispatchChannel {
+	struct DispatchChannel *next; // In the channel list of the dispatcher
+	struct DispatchChannel *ready_next; // In the ready queue
+	struct Dispatcher *d;
+	int av_index;
+	void *user;
+	DispatchJob *jobs_head, *jobs_tail;
+	unsigned int job_count;
+	int scheduled; // On the ready queue or being run by a worker
+	int running;
+	int polling;
+	int detached;
+	int closed; // avRecvIOCtrl() returned an error after which nothing can be received
+} DispatchChannel;
+
+typedef struct Dispatcher {
+	const AVIOCtrlHandler *table; // Sorted by type
+	AVIOCtrlHandler *table_copy; // The sorted copy of an unsorted table, NULL if none
+	int count;
+	avIOCtrlHandlerFn *dense; // Indexed by type - dense_base, NULL for binary search
+	unsigned int dense_base;
+	unsigned int dense_size;
+	avIOCtrlHandlerFn default_fn;
+	unsigned int max_queue;
+	unsigned int max_idle_ms;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond; // Signalled when a channel is ready
+	pthread_cond_t poll_cond; // Signalled when a channel is attached
+	pthread_cond_t done_cond; // Signalled when a detached channel stops being run or polled
+	pthread_t poll_thread;
+	pthread_t workers[AV_IOCTRL_DISPATCH_MAX_WORKERS];
+	unsigned int worker_count;
+	int stop;
+	DispatchChannel *channels;
+	DispatchChannel *ready_head, *ready_tail;
+	AVIOCtrlDispatchStats stats;
+} Dispatcher;
+
+static ExtTable gDispatchers = EXT_TABLE_INITIALIZER;
+static ExtTable gDispatchChannels = EXT_TABLE_INITIALIZER;
+
+int ext_ioctrl_dispatched(int nAVChannelID)
+{
+	return ext_table_get(&gDispatchChannels, nAVChannelID) != NULL;
+}
+
+static int dispatch_cmp(const void *a, const void *b)
+{
+	unsigned int ta = ((const AVIOCtrlHandler *)a)->type, tb = ((const AVIOCtrlHandler *)b)->type;
+
+	return ta < tb ? -1 : ta > tb;
+}
+
+// Set up the lookup of d from the table. Returns AV_ER_NoERROR or an error.
+static int dispatch_build_table(Dispatcher *d, const AVIOCtrlHandler *table, int count)
+{
+	unsigned long long span;
+	unsigned int i;
+	int sorted = 1, k;
+
+	for (k = 0; k < count; k++) {
+		if (table[k].fn == NULL)
+			return AV_ER_INVALID_ARG;
+		if (k > 0 && table[k - 1].type >= table[k].type)
+			sorted = 0;
+	}
+	if (!sorted) {
+		d->table_copy = (AVIOCtrlHandler *)malloc((size_t)count * sizeof(AVIOCtrlHandler));
+		if (d->table_copy == NULL)
+			return AV_ER_MEM_INSUFF;
+		memcpy(d->table_copy, table, (size_t)count * sizeof(AVIOCtrlHandler));
+		qsort(d->table_copy, (size_t)count, sizeof(AVIOCtrlHandler), dispatch_cmp);
+		for (k = 1; k < count; k++) {
+			if (d->table_copy[k - 1].type == d->table_copy[k].type)
+				return AV_ER_INVALID_ARG;
+		}
+		table = d->table_copy;
+	}
+	d->table = table;
+	d->count = count;
+	if (count == 0)
+		return AV_ER_NoERROR;
+
+	// Up to 2^32 types, so not in unsigned int
+	span = (unsigned long long)table[count - 1].type - table[0].type + 1;
+	if (span > (unsigned long long)count * DISPATCH_DENSE_FACTOR + DISPATCH_DENSE_SLACK || span > 0xFFFFFFFFULL)
+		return AV_ER_NoERROR;
+	d->dense = (avIOCtrlHandlerFn *)calloc((size_t)span, sizeof(avIOCtrlHandlerFn));
+	if (d->dense == NULL)
+		return AV_ER_NoERROR; // Binary search works as well
+	d->dense_base = table[0].type;
+	d->dense_size = (unsigned int)span;
+	for (i = 0; i < (unsigned int)count; i++)
+		d->dense[table[i].type - d->dense_base] = table[i].fn;
+	d->stats.denseTable = 1;
+	return AV_ER_NoERROR;
+}
+
+static avIOCtrlHandlerFn dispatch_lookup(const Dispatcher *d, unsigned int type)
+{
+	int lo = 0, hi = d->count - 1, mid;
+
+	if (d->dense != NULL)
+		return type - d->dense_base < d->dense_size ? d->dense[type - d->dense_base] : NULL;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (d->table[mid].type == type)
+			return d->table[mid].fn;
+		if (d->table[mid].type < type)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+// Caller holds d->lock
+static void dispatch_ready_locked(Dispatcher *d, DispatchChannel *c)
+{
+	c->scheduled = 1;
+	c->ready_next = NULL;
+	if (d->ready_tail != NULL)
+		d->ready_tail->ready_next = c;
+	else
+		d->ready_head = c;
+	d->ready_tail = c;
+	pthread_cond_signal(&d->work_cond);
+}
+
+// Caller holds d->lock
+static void dispatch_push_locked(Dispatcher *d, DispatchChannel *c, unsigned int type, const char *data, int size)
+{
+	DispatchJob *j;
+
+	d->stats.received++;
+	if (c->job_count >= d->max_queue || (j = (DispatchJob *)malloc(sizeof(DispatchJob) + (size_t)size)) == NULL) {
+		d->stats.dropped++;
+		return;
+	}
+	j->next = NULL;
+	j->type = type;
+	j->size = size;
+	if (size > 0)
+		memcpy(j->data, data, (size_t)size);
+	if (c->jobs_tail != NULL)
+		c->jobs_tail->next = j;
+	else
+		c->jobs_head = j;
+	c->jobs_tail = j;
+	c->job_count++;
+	d->stats.queued++;
+	if (!c->scheduled)
+		dispatch_ready_locked(d, c);
+}
+
+static void *dispatch_poll_thread(void *arg)
+{
+	Dispatcher *d = (Dispatcher *)arg;
+	char msg[AV_MAX_IOCTRL_DATA_SIZE];
+	unsigned int type, idle_ms = 0, n;
+	DispatchChannel *c;
+	int got, ret;
+
+	pthread_mutex_lock(&d->lock);
+	while (!d->stop) {
+		got = 0;
+		for (c = d->channels; c != NULL; c = c->next) {
+			if (c->closed)
+				continue;
+			// The channel stays in the list while polling is set, so c->next is still valid afterwards
+			c->polling = 1;
+			for (n = 0; n < DISPATCH_SWEEP_BURST && !c->detached; n++) {
+				pthread_mutex_unlock(&d->lock);
+				ret = avRecvIOCtrl(c->av_index, &type, msg, sizeof(msg), 0);
+				pthread_mutex_lock(&d->lock);
+				if (ret == AV_ER_DATA_NOREADY || ret == AV_ER_TIMEOUT)
+					break;
+				if (ret < 0) {
+					d->stats.lastError = ret;
+					if (ext_av_channel_closed(ret))
+						c->closed = 1;
+					break;
+				}
+				got = 1;
+				dispatch_push_locked(d, c, type, msg, ret);
+			}
+			c->polling = 0;
+			if (c->detached)
+				pthread_cond_broadcast(&d->done_cond);
+		}
+		if (got) {
+			idle_ms = 0;
+			continue;
+		}
+		idle_ms = idle_ms == 0 ? 1 : idle_ms * 2;
+		if (idle_ms > d->max_idle_ms)
+			idle_ms = d->max_idle_ms;
+		if (d->channels == NULL)
+			pthread_cond_wait(&d->poll_cond, &d->lock);
+		else
+			ext_cond_wait_ms(&d->poll_cond, &d->lock, idle_ms);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+static void *dispatch_worker(void *arg)
+{
+	Dispatcher *d = (Dispatcher *)arg;
+	avIOCtrlHandlerFn fn;
+	DispatchChannel *c;
+	DispatchJob *j;
+	int rpc;
+
+	pthread_mutex_lock(&d->lock);
+	while (!d->stop) {
+		if ((c = d->ready_head) == NULL) {
+			pthread_cond_wait(&d->work_cond, &d->lock);
+			continue;
+		}
+		d->ready_head = c->ready_next;
+		if (d->ready_head == NULL)
+			d->ready_tail = NULL;
+		j = c->jobs_head;
+		c->jobs_head = j->next;
+		if (c->jobs_head == NULL)
+			c->jobs_tail = NULL;
+		c->job_count--;
+		d->stats.queued--;
+		c->running = 1;
+		pthread_mutex_unlock(&d->lock);
+
+		fn = NULL;
+		rpc = ext_rpc_input(c->av_index, j->type, j->data, j->size);
+		if (!rpc) {
+			fn = dispatch_lookup(d, j->type);
+			if (fn != NULL)
+				fn(c->av_index, j->type, j->data, j->size, c->user);
+			else if (d->default_fn != NULL)
+				d->default_fn(c->av_index, j->type, j->data, j->size, c->user);
+		}
+
+		pthread_mutex_lock(&d->lock);
+		if (rpc)
+			d->stats.rpc++;
+		else if (fn != NULL)
+			d->stats.handled++;
+		else
+			d->stats.unhandled++;
+		free(j);
+		c->running = 0;
+		if (c->detached)
+			pthread_cond_broadcast(&d->done_cond);
+		else if (c->jobs_head != NULL)
+			dispatch_ready_locked(d, c);
+		else
+			c->scheduled = 0;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+// Caller holds d->lock, which it may release while waiting. Unlinks c and frees it once nothing uses it.
+static void dispatch_remove_locked(Dispatcher *d, DispatchChannel *c)
+{
+	DispatchChannel **pp;
+	DispatchJob *j;
+
+	c->detached = 1;
+	for (pp = &d->ready_head; *pp != NULL; pp = &(*pp)->ready_next) {
+		if (*pp == c) {
+			*pp = c->ready_next;
+			break;
+		}
+	}
+	d->ready_tail = NULL;
+	for (pp = &d->ready_head; *pp != NULL; pp = &(*pp)->ready_next)
+		d->ready_tail = *pp;
+	while (c->running || c->polling)
+		pthread_cond_wait(&d->done_cond, &d->lock);
+	for (pp = &d->channels; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == c) {
+			*pp = c->next;
+			break;
+		}
+	}
+	while ((j = c->jobs_head) != NULL) {
+		c->jobs_head = j->next;
+		d->stats.queued--;
+		free(j);
+	}
+	d->stats.channels--;
+	free(c);
+}
+
+static void dispatch_free(Dispatcher *d)
+{
+	pthread_cond_destroy(&d->work_cond);
+	pthread_cond_destroy(&d->poll_cond);
+	pthread_cond_destroy(&d->done_cond);
+	pthread_mutex_destroy(&d->lock);
+	free(d->table_copy);
+	free(d->dense);
+	free(d);
+}
+
+// Stop and join the threads started so far
+static void dispatch_stop(Dispatcher *d, int poll_started)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&d->lock);
+	d->stop = 1;
+	pthread_cond_broadcast(&d->work_cond);
+	pthread_cond_broadcast(&d->poll_cond);
+	pthread_mutex_unlock(&d->lock);
+	if (poll_started)
+		pthread_join(d->poll_thread, NULL);
+	for (i = 0; i < d->worker_count; i++)
+		pthread_join(d->workers[i], NULL);
+}
+
+int avIOCtrlDispatcherCreate(const AVIOCtrlHandler *pTable, int nCount, const AVIOCtrlDispatchConfig *pConfig)
+{
+	unsigned int workers;
+	Dispatcher *d;
+	int ret, id;
+
+	if (nCount < 0 || (nCount > 0 && pTable == NULL) ||
+		(pConfig != NULL && (pConfig->cb != sizeof(AVIOCtrlDispatchConfig) ||
+							 pConfig->workers > AV_IOCTRL_DISPATCH_MAX_WORKERS)))
+		return AV_ER_INVALID_ARG;
+	d = (Dispatcher *)calloc(1, sizeof(Dispatcher));
+	if (d == NULL)
+		return AV_ER_MEM_INSUFF;
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->work_cond, NULL);
+	pthread_cond_init(&d->poll_cond, NULL);
+	pthread_cond_init(&d->done_cond, NULL);
+	ret = dispatch_build_table(d, pTable, nCount);
+	if (ret < 0) {
+		dispatch_free(d);
+		return ret;
+	}
+	workers = pConfig != NULL && pConfig->workers != 0 ? pConfig->workers : AV_IOCTRL_DISPATCH_DEFAULT_WORKERS;
+	d->max_queue = pConfig != NULL && pConfig->maxQueue != 0 ? pConfig->maxQueue : AV_IOCTRL_DISPATCH_DEFAULT_QUEUE;
+	d->max_idle_ms = pConfig != NULL && pConfig->maxIdleMs != 0 ? pConfig->maxIdleMs
+																: AV_IOCTRL_DISPATCH_DEFAULT_IDLE;
+	d->default_fn = pConfig != NULL ? pConfig->pfxDefaultFn : NULL;
+
+	if (pthread_create(&d->poll_thread, NULL, dispatch_poll_thread, d) != 0) {
+		dispatch_free(d);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	for (; d->worker_count < workers; d->worker_count++) {
+		if (pthread_create(&d->workers[d->worker_count], NULL, dispatch_worker, d) != 0) {
+			dispatch_stop(d, 1);
+			dispatch_free(d);
+			return AV_ER_FAIL_CREATE_THREAD;
+		}
+	}
+	id = ext_table_add(&gDispatchers, d);
+	if (id < 0) {
+		dispatch_stop(d, 1);
+		dispatch_free(d);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avIOCtrlDispatcherDestroy(int nDispatcherID)
+{
+	Dispatcher *d = (Dispatcher *)ext_table_take(&gDispatchers, nDispatcherID);
+	DispatchChannel *c;
+
+	if (d == NULL)
+		return;
+	pthread_mutex_lock(&d->lock);
+	while ((c = d->channels) != NULL) {
+		ext_table_take(&gDispatchChannels, c->av_index);
+		dispatch_remove_locked(d, c);
+	}
+	pthread_mutex_unlock(&d->lock);
+	dispatch_stop(d, 1);
+	dispatch_free(d);
+}
+
+int avIOCtrlDispatchAttach(int nDispatcherID, int nAVChannelID, void *pUserData)
+{
+	Dispatcher *d = (Dispatcher *)ext_table_get(&gDispatchers, nDispatcherID);
+	DispatchChannel *c;
+
+	if (d == NULL || nAVChannelID < 0 || ext_rpc_receiving(nAVChannelID))
+		return AV_ER_INVALID_ARG;
+	c = (DispatchChannel *)calloc(1, sizeof(DispatchChannel));
+	if (c == NULL)
+		return AV_ER_MEM_INSUFF;
+	c->d = d;
+	c->av_index = nAVChannelID;
+	c->user = pUserData;
+	if (ext_table_set(&gDispatchChannels, nAVChannelID, c) < 0) {
+		free(c);
+		return AV_ER_INVALID_ARG;
+	}
+	pthread_mutex_lock(&d->lock);
+	c->next = d->channels;
+	d->channels = c;
+	d->stats.channels++;
+	pthread_cond_signal(&d->poll_cond);
+	pthread_mutex_unlock(&d->lock);
+	return AV_ER_NoERROR;
+}
+
+void avIOCtrlDispatchDetach(int nAVChannelID)
+{
+	DispatchChannel *c = (DispatchChannel *)ext_table_take(&gDispatchChannels, nAVChannelID);
+	Dispatcher *d;
+
+	if (c == NULL)
+		return;
+	d = c->d;
+	pthread_mutex_lock(&d->lock);
+	dispatch_remove_locked(d, c);
+	pthread_mutex_unlock(&d->lock);
+}
+
+int avIOCtrlDispatchGetStats(int nDispatcherID, AVIOCtrlDispatchStats *pStats)
+{
+	Dispatcher *d = (Dispatcher *)ext_table_get(&gDispatchers, nDispatcherID);
+
+	if (d == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&d->lock);
+	*pStats = d->stats;
+	pthread_mutex_unlock(&d->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,865 @@
+/*! \file av_ioctrlrpc.c
+IO control RPC, see AVIOCtrlRpcAPIs.h.
+
+Requests and replies wait in the out queue until the sender thread packs
+them. Each IO control takes at most one chunk of each queued payload, and
+a payload which is not done goes back to the end of the queue, so a large
+reply does not hold up the small ones behind it. Chunks of one payload
+leave in order and IO controls arrive in order, so the receiver appends
+each chunk to the payload started by the chunk flagged RPC_FIRST.
+The sender thread also times out calls; the receiver thread completes them.
+On an AV channel attached to an IOCtrl dispatcher there is no receiver
+thread; the dispatcher hands RPC messages to ext_rpc_input() on its workers.
+Such a call is counted in r->inputs, and the detach waits for the count to
+drop to zero before freeing the RPC layer.
+Callbacks always run without the lock.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVIOCtrlRpcAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+#include "ext_av.h"
+
+#define RPC_KIND_REQUEST		1
+#define RPC_KIND_REPLY			2
+
+#define RPC_FIRST				0x01
+#define RPC_LAST				0x02
+
+// The avRecvIOCtrl() timeout of the receiver thread, how long a detach may wait for it
+#define RPC_RECV_POLL_MS		100
+
+// The wait before trying again when another thread is in avSendIOCtrl()
+#define RPC_SEND_RETRY_MS		2
+
+typedef struct RpcOut {
+	struct RpcOut *next;
+	unsigned char kind;
+	unsigned int id;
+	unsigned int word; // The method of a request, the result of a reply
+	int size;
+	int sent;
+	char data[];
+} RpcOut;
+
+typedef struct RpcPending {
+	struct RpcPending *next;
+	unsigned int id;
+	uint64_t deadline_ms;
+	avRpcResponseFn fn;
+	void *user;
+} RpcPending;
+
+typedef struct RpcAssembly {
+	struct RpcAssembly *next;
+	unsigned char kind;
+	unsigned int id;
+	unsigned int word;
+	int size;
+	int filled;
+	char *data;
+} RpcAssembly;
+
+typedef struct RpcRaw {
+	struct RpcRaw *next;
+	unsigned int type;
+	int size;
+	char data[];
+} RpcRaw;
+
+typedef struct Rpc {
+	int av_index;
+	unsigned int io_type;
+	unsigned int default_timeout_ms;
+	unsigned int max_payload;
+	avRpcRequestFn request_fn;
+	void *request_user;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t raw_cond;
+	pthread_t send_thread;
+	pthread_t recv_thread;
+	int own_recv; // 0 when an IOCtrl dispatcher receives for the AV channel
+	unsigned int inputs; // ext_rpc_input() calls in progress
+	int stop;
+	int sending;
+	int error; // The error which closed the AV channel, 0 while it is open
+	unsigned int next_id;
+	RpcOut *out_head, *out_tail;
+	RpcPending *pending;
+	RpcAssembly *assemblies;
+	RpcRaw *raw_head, *raw_tail;
+	unsigned int raw_count;
+	AVRpcStats stats;
+} Rpc;
+
+typedef struct RpcWait {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done;
+	int result;
+	char *buf;
+	int max;
+	int size;
+} RpcWait;
+
+static ExtTable gRpcs = EXT_TABLE_INITIALIZER;
+
+static void rpc_put16(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static void rpc_put32(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int rpc_get16(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned int rpc_get32(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Caller holds r->lock
+static void rpc_queue_locked(Rpc *r, RpcOut *o)
+{
+	o->next = NULL;
+	if (r->out_tail != NULL)
+		r->out_tail->next = o;
+	else
+		r->out_head = o;
+	r->out_tail = o;
+	r->stats.queuedBytes += (unsigned int)(o->size - o->sent);
+	pthread_cond_signal(&r->cond);
+}
+
+static RpcOut *rpc_out_new(unsigned char kind, unsigned int id, unsigned int word, const char *data, int size)
+{
+	RpcOut *o = (RpcOut *)malloc(sizeof(RpcOut) + (size_t)size);
+
+	if (o == NULL)
+		return NULL;
+	o->next = NULL;
+	o->kind = kind;
+	o->id = id;
+	o->word = word;
+	o->size = size;
+	o->sent = 0;
+	if (size > 0)
+		memcpy(o->data, data, (size_t)size);
+	return o;
+}
+
+// Caller holds r->lock
+static RpcPending *rpc_take_pending_locked(Rpc *r, unsigned int id)
+{
+	RpcPending **pp, *p;
+
+	for (pp = &r->pending; (p = *pp) != NULL; pp = &p->next) {
+		if (p->id == id) {
+			*pp = p->next;
+			r->stats.outstanding--;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+// Call back and free a list of calls taken off r->pending, without the lock
+static void rpc_complete_list(Rpc *r, RpcPending *list, int result)
+{
+	RpcPending *p;
+
+	while ((p = list) != NULL) {
+		list = p->next;
+		p->fn(r->av_index, p->id, result, NULL, 0, p->user);
+		free(p);
+	}
+}
+
+// Caller holds r->lock, which is released. Records the error which closed the AV channel and fails all calls.
+static void rpc_close_locked(Rpc *r, int error)
+{
+	RpcPending *list = r->pending;
+	RpcOut *o;
+
+	if (r->error == 0)
+		r->error = error;
+	r->pending = NULL;
+	r->stats.outstanding = 0;
+	while ((o = r->out_head) != NULL) {
+		r->out_head = o->next;
+		free(o);
+	}
+	r->out_tail = NULL;
+	r->stats.queuedBytes = 0;
+	pthread_cond_broadcast(&r->raw_cond);
+	pthread_mutex_unlock(&r->lock);
+	rpc_complete_list(r, list, error);
+}
+
+// Caller holds r->lock. Packs queued chunks into msg and returns its size, 0 if nothing is queued.
+static int rpc_pack_locked(Rpc *r, unsigned char *msg, unsigned int *records)
+{
+	int pos = AV_RPC_HEADER_SIZE, n;
+	unsigned int count = 0, flags;
+	RpcOut *o, *partial = NULL;
+	unsigned char *p;
+
+	while ((o = r->out_head) != NULL && count < 255) {
+		n = o->size - o->sent;
+		if (n > AV_MAX_IOCTRL_DATA_SIZE - pos - AV_RPC_RECORD_HEADER_SIZE)
+			n = AV_MAX_IOCTRL_DATA_SIZE - pos - AV_RPC_RECORD_HEADER_SIZE;
+		if (n < 0 || (n == 0 && o->size > o->sent))
+			break;
+		flags = (o->sent == 0 ? RPC_FIRST : 0) | (o->sent + n == o->size ? RPC_LAST : 0);
+		p = msg + pos;
+		p[0] = o->kind;
+		p[1] = (unsigned char)flags;
+		rpc_put16(p + 2, (unsigned int)n);
+		rpc_put32(p + 4, o->id);
+		rpc_put32(p + 8, o->word);
+		rpc_put32(p + 12, (unsigned int)o->size);
+		if (n > 0)
+			memcpy(p + AV_RPC_RECORD_HEADER_SIZE, o->data + o->sent, (size_t)n);
+		pos += AV_RPC_RECORD_HEADER_SIZE + n;
+		count++;
+		o->sent += n;
+		r->stats.queuedBytes -= (unsigned int)n;
+
+		r->out_head = o->next;
+		if (r->out_head == NULL)
+			r->out_tail = NULL;
+		if (flags & RPC_LAST) {
+			free(o);
+		} else {
+			// It filled the IO control; the rest goes behind what is queued
+			partial = o;
+			break;
+		}
+	}
+	if (partial != NULL) {
+		r->stats.queuedBytes -= (unsigned int)(partial->size - partial->sent);
+		rpc_queue_locked(r, partial);
+	}
+	if (count == 0)
+		return 0;
+	msg[0] = AV_RPC_VERSION;
+	msg[1] = (unsigned char)count;
+	*records = count;
+	return pos;
+}
+
+// Caller holds r->lock. Takes the calls whose deadline passed and returns the time to the next deadline.
+static unsigned int rpc_expire_locked(Rpc *r, uint64_t now, RpcPending **expired)
+{
+	RpcPending **pp = &r->pending, *p;
+	unsigned int wait_ms = 0;
+
+	while ((p = *pp) != NULL) {
+		if (p->deadline_ms <= now) {
+			*pp = p->next;
+			p->next = *expired;
+			*expired = p;
+			r->stats.outstanding--;
+			r->stats.timeouts++;
+			continue;
+		}
+		if (wait_ms == 0 || p->deadline_ms - now < wait_ms)
+			wait_ms = (unsigned int)(p->deadline_ms - now);
+		pp = &p->next;
+	}
+	return wait_ms;
+}
+
+static void *rpc_send_thread(void *arg)
+{
+	Rpc *r = (Rpc *)arg;
+	unsigned char msg[AV_MAX_IOCTRL_DATA_SIZE];
+	RpcPending *expired;
+	unsigned int wait_ms, records = 0;
+	int len, ret;
+
+	pthread_mutex_lock(&r->lock);
+	while (!r->stop) {
+		expired = NULL;
+		wait_ms = rpc_expire_locked(r, ext_now_ms(), &expired);
+		if (expired != NULL) {
+			pthread_mutex_unlock(&r->lock);
+			rpc_complete_list(r, expired, AV_ER_TIMEOUT);
+			pthread_mutex_lock(&r->lock);
+			continue;
+		}
+		len = r->error == 0 ? rpc_pack_locked(r, msg, &records) : 0;
+		if (len == 0) {
+			if (wait_ms > 0)
+				ext_cond_wait_ms(&r->cond, &r->lock, wait_ms);
+			else
+				pthread_cond_wait(&r->cond, &r->lock);
+			continue;
+		}
+
+		r->sending = 1;
+		pthread_mutex_unlock(&r->lock);
+		while ((ret = avSendIOCtrl(r->av_index, r->io_type, (const char *)msg, len)) ==
+			   AV_ER_SENDIOCTRL_ALREADY_CALLED) {
+			// The application is in avSendIOCtrl() itself
+			pthread_mutex_lock(&r->lock);
+			if (r->stop)
+				break;
+			pthread_mutex_unlock(&r->lock);
+			ext_sleep_ms(RPC_SEND_RETRY_MS);
+		}
+		if (ret != AV_ER_SENDIOCTRL_ALREADY_CALLED)
+			pthread_mutex_lock(&r->lock);
+		r->sending = 0;
+		if (ret < 0) {
+			r->stats.lastError = ret;
+			if (ext_av_channel_closed(ret)) {
+				rpc_close_locked(r, ret);
+				pthread_mutex_lock(&r->lock);
+			}
+			// Otherwise the records are lost; their calls time out
+			continue;
+		}
+		r->stats.ioCtrlsSent++;
+		r->stats.recordsSent += records;
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+// Caller holds r->lock
+static void rpc_queue_raw_locked(Rpc *r, unsigned int type, const char *data, int size)
+{
+	RpcRaw *m;
+
+	r->stats.passthrough++;
+	if (r->raw_count >= AV_RPC_PASSTHROUGH_QUEUE ||
+		(m = (RpcRaw *)malloc(sizeof(RpcRaw) + (size_t)size)) == NULL) {
+		r->stats.passthroughDropped++;
+		return;
+	}
+	m->next = NULL;
+	m->type = type;
+	m->size = size;
+	if (size > 0)
+		memcpy(m->data, data, (size_t)size);
+	if (r->raw_tail != NULL)
+		r->raw_tail->next = m;
+	else
+		r->raw_head = m;
+	r->raw_tail = m;
+	r->raw_count++;
+	pthread_cond_signal(&r->raw_cond);
+}
+
+// Caller holds r->lock
+static RpcAssembly *rpc_take_assembly_locked(Rpc *r, unsigned char kind, unsigned int id)
+{
+	RpcAssembly **pp, *a;
+
+	for (pp = &r->assemblies; (a = *pp) != NULL; pp = &a->next) {
+		if (a->kind == kind && a->id == id) {
+			*pp = a->next;
+			return a;
+		}
+	}
+	return NULL;
+}
+
+// Hand a complete payload, or a refused one with size < 0, to its owner. Called without the lock.
+static void rpc_deliver(Rpc *r, unsigned char kind, unsigned int id, unsigned int word, const char *data, int size)
+{
+	RpcPending *p;
+	RpcOut *o;
+
+	pthread_mutex_lock(&r->lock);
+	if (kind == RPC_KIND_REPLY) {
+		p = rpc_take_pending_locked(r, id);
+		if (p != NULL)
+			r->stats.responses++;
+		pthread_mutex_unlock(&r->lock);
+		if (p == NULL)
+			return; // Timed out already
+		if (size < 0)
+			p->fn(r->av_index, id, AV_ER_EXCEED_MAX_SIZE, NULL, 0, p->user);
+		else
+			p->fn(r->av_index, id, (int)word, data, size, p->user);
+		free(p);
+		return;
+	}
+
+	r->stats.served++;
+	if (size >= 0 && r->request_fn != NULL) {
+		pthread_mutex_unlock(&r->lock);
+		r->request_fn(r->av_index, id, word, data, size, r->request_user);
+		return;
+	}
+	// Refuse it here, so the caller does not wait for its timeout
+	o = rpc_out_new(RPC_KIND_REPLY, id, (unsigned int)(size < 0 ? AV_ER_EXCEED_MAX_SIZE : AV_ER_REMOTE_NOT_SUPPORT),
+					NULL, 0);
+	if (o != NULL && r->error == 0) {
+		r->stats.replies++;
+		rpc_queue_locked(r, o);
+	} else {
+		free(o);
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+// Handle one record; the receiver thread is the only one touching r->assemblies besides detach
+static void rpc_input_record(Rpc *r, const unsigned char *p, const unsigned char *chunk, int n)
+{
+	unsigned char kind = p[0], flags = p[1];
+	unsigned int id = rpc_get32(p + 4), word = rpc_get32(p + 8), total = rpc_get32(p + 12);
+	RpcAssembly *a;
+
+	if (kind != RPC_KIND_REQUEST && kind != RPC_KIND_REPLY)
+		return;
+	if ((flags & (RPC_FIRST | RPC_LAST)) == (RPC_FIRST | RPC_LAST) && (unsigned int)n == total) {
+		// The whole payload in one chunk needs no copy
+		rpc_deliver(r, kind, id, word, (const char *)chunk, total <= r->max_payload ? n : -1);
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	a = rpc_take_assembly_locked(r, kind, id);
+	if (flags & RPC_FIRST) {
+		if (a != NULL) {
+			free(a->data);
+			free(a);
+		}
+		if (total > r->max_payload) {
+			pthread_mutex_unlock(&r->lock);
+			rpc_deliver(r, kind, id, word, NULL, -1);
+			return;
+		}
+		a = (RpcAssembly *)calloc(1, sizeof(RpcAssembly));
+		if (a != NULL && (a->data = (char *)malloc(total > 0 ? total : 1)) == NULL) {
+			free(a);
+			a = NULL;
+		}
+		if (a == NULL) {
+			pthread_mutex_unlock(&r->lock);
+			return;
+		}
+		a->kind = kind;
+		a->id = id;
+		a->word = word;
+		a->size = (int)total;
+	}
+	if (a == NULL || a->size - a->filled < n) {
+		// A chunk without its start, e.g. after a refused or lost one
+		if (a != NULL) {
+			free(a->data);
+			free(a);
+		}
+		pthread_mutex_unlock(&r->lock);
+		return;
+	}
+	memcpy(a->data + a->filled, chunk, (size_t)n);
+	a->filled += n;
+	if (!(flags & RPC_LAST)) {
+		a->next = r->assemblies;
+		r->assemblies = a;
+		pthread_mutex_unlock(&r->lock);
+		return;
+	}
+	pthread_mutex_unlock(&r->lock);
+	if (a->filled == a->size)
+		rpc_deliver(r, kind, id, a->word, a->data, a->size);
+	free(a->data);
+	free(a);
+}
+
+static void rpc_input(Rpc *r, const unsigned char *msg, int len)
+{
+	unsigned int count, i, n;
+	int pos = AV_RPC_HEADER_SIZE;
+
+	if (len < AV_RPC_HEADER_SIZE || msg[0] != AV_RPC_VERSION)
+		return;
+	count = msg[1];
+	for (i = 0; i < count; i++) {
+		if (pos + AV_RPC_RECORD_HEADER_SIZE > len)
+			return;
+		n = rpc_get16(msg + pos + 2);
+		if ((int)n > len - pos - AV_RPC_RECORD_HEADER_SIZE)
+			return;
+		rpc_input_record(r, msg + pos, msg + pos + AV_RPC_RECORD_HEADER_SIZE, (int)n);
+		pos += AV_RPC_RECORD_HEADER_SIZE + (int)n;
+	}
+}
+
+static void *rpc_recv_thread(void *arg)
+{
+	Rpc *r = (Rpc *)arg;
+	char msg[AV_MAX_IOCTRL_DATA_SIZE];
+	unsigned int type;
+	int ret;
+
+	pthread_mutex_lock(&r->lock);
+	while (!r->stop) {
+		pthread_mutex_unlock(&r->lock);
+		ret = avRecvIOCtrl(r->av_index, &type, msg, sizeof(msg), RPC_RECV_POLL_MS);
+		pthread_mutex_lock(&r->lock);
+		if (ret == AV_ER_TIMEOUT || ret == AV_ER_DATA_NOREADY)
+			continue;
+		if (ret < 0) {
+			r->stats.lastError = ret;
+			if (ext_av_channel_closed(ret)) {
+				rpc_close_locked(r, ret);
+				return NULL;
+			}
+			continue;
+		}
+		if (type != r->io_type) {
+			rpc_queue_raw_locked(r, type, msg, ret);
+			continue;
+		}
+		r->stats.ioCtrlsReceived++;
+		pthread_mutex_unlock(&r->lock);
+		rpc_input(r, (const unsigned char *)msg, ret);
+		pthread_mutex_lock(&r->lock);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+int ext_rpc_receiving(int nAVChannelID)
+{
+	int receiving = 0;
+	Rpc *r;
+
+	if (nAVChannelID < 0)
+		return 0;
+	pthread_mutex_lock(&gRpcs.lock);
+	if (nAVChannelID < gRpcs.size && (r = (Rpc *)gRpcs.items[nAVChannelID]) != NULL)
+		receiving = r->own_recv;
+	pthread_mutex_unlock(&gRpcs.lock);
+	return receiving;
+}
+
+/** The RPC layer of an AV channel with an input counted in r->inputs, NULL if there is none or it stops. */
+static Rpc *rpc_input_begin(int av, unsigned int type)
+{
+	Rpc *r = NULL;
+
+	if (av < 0)
+		return NULL;
+	// Under the table lock, so a detach either finds the input counted or makes us find nothing
+	pthread_mutex_lock(&gRpcs.lock);
+	if (av < gRpcs.size && (r = (Rpc *)gRpcs.items[av]) != NULL) {
+		pthread_mutex_lock(&r->lock);
+		if (r->stop || type != r->io_type) {
+			pthread_mutex_unlock(&r->lock);
+			r = NULL;
+		} else {
+			r->inputs++;
+			r->stats.ioCtrlsReceived++;
+			pthread_mutex_unlock(&r->lock);
+		}
+	}
+	pthread_mutex_unlock(&gRpcs.lock);
+	return r;
+}
+
+int ext_rpc_input(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData, int nDataSize)
+{
+	Rpc *r = rpc_input_begin(nAVChannelID, nIOCtrlType);
+
+	if (r == NULL)
+		return 0;
+	rpc_input(r, (const unsigned char *)cabData, nDataSize);
+	pthread_mutex_lock(&r->lock);
+	if (--r->inputs == 0 && r->stop)
+		pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	return 1;
+}
+
+static void rpc_free(Rpc *r)
+{
+	RpcAssembly *a;
+	RpcRaw *m;
+	RpcOut *o;
+
+	while ((a = r->assemblies) != NULL) {
+		r->assemblies = a->next;
+		free(a->data);
+		free(a);
+	}
+	while ((m = r->raw_head) != NULL) {
+		r->raw_head = m->next;
+		free(m);
+	}
+	while ((o = r->out_head) != NULL) {
+		r->out_head = o->next;
+		free(o);
+	}
+	pthread_cond_destroy(&r->cond);
+	pthread_cond_destroy(&r->raw_cond);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+}
+
+int avRpcAttach(int nAVChannelID, const AVRpcConfig *pConfig, avRpcRequestFn pfxRequestFn, void *pUserData)
+{
+	Rpc *r;
+
+	if (nAVChannelID < 0 || (pConfig != NULL && pConfig->cb != sizeof(AVRpcConfig)))
+		return AV_ER_INVALID_ARG;
+	if (pConfig != NULL && pConfig->ioCtrlType != 0 && pConfig->ioCtrlType < IOTYPE_USER_DEFINED_START)
+		return AV_ER_INVALID_ARG;
+	r = (Rpc *)calloc(1, sizeof(Rpc));
+	if (r == NULL)
+		return AV_ER_MEM_INSUFF;
+	r->av_index = nAVChannelID;
+	r->io_type = pConfig != NULL && pConfig->ioCtrlType != 0 ? pConfig->ioCtrlType : AV_RPC_DEFAULT_IOTYPE;
+	r->default_timeout_ms = pConfig != NULL && pConfig->defaultTimeoutMs != 0 ? pConfig->defaultTimeoutMs
+																			  : AV_RPC_DEFAULT_TIMEOUT;
+	r->max_payload = pConfig != NULL && pConfig->maxPayloadSize != 0 ? pConfig->maxPayloadSize
+																	 : AV_RPC_DEFAULT_MAX_PAYLOAD;
+	r->request_fn = pfxRequestFn;
+	r->request_user = pUserData;
+	r->next_id = 1;
+	r->own_recv = !ext_ioctrl_dispatched(nAVChannelID);
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	pthread_cond_init(&r->raw_cond, NULL);
+
+	if (ext_table_set(&gRpcs, nAVChannelID, r) < 0) {
+		rpc_free(r);
+		return AV_ER_INVALID_ARG;
+	}
+	if (pthread_create(&r->send_thread, NULL, rpc_send_thread, r) != 0) {
+		ext_table_take(&gRpcs, nAVChannelID);
+		rpc_free(r);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	if (r->own_recv && pthread_create(&r->recv_thread, NULL, rpc_recv_thread, r) != 0) {
+		ext_table_take(&gRpcs, nAVChannelID);
+		pthread_mutex_lock(&r->lock);
+		r->stop = 1;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		pthread_join(r->send_thread, NULL);
+		rpc_free(r);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avRpcDetach(int nAVChannelID)
+{
+	Rpc *r = (Rpc *)ext_table_take(&gRpcs, nAVChannelID);
+	RpcPending *list;
+
+	if (r == NULL)
+		return;
+	pthread_mutex_lock(&r->lock);
+	r->stop = 1;
+	if (r->sending)
+		avSendIOCtrlExit(nAVChannelID);
+	pthread_cond_broadcast(&r->cond);
+	pthread_cond_broadcast(&r->raw_cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->send_thread, NULL);
+	if (r->own_recv)
+		pthread_join(r->recv_thread, NULL);
+	// The sender thread is gone, so only the inputs of a dispatcher signal r->cond now
+	pthread_mutex_lock(&r->lock);
+	while (r->inputs > 0)
+		pthread_cond_wait(&r->cond, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+
+	list = r->pending;
+	r->pending = NULL;
+	rpc_complete_list(r, list, AV_ER_SENDIOCTRL_EXIT);
+	rpc_free(r);
+}
+
+int avRpcCallAsync(int nAVChannelID, unsigned int nMethod, const char *cabData, int nDataSize,
+				   unsigned int nTimeoutMs, avRpcResponseFn pfxResponseFn, void *pUserData,
+				   unsigned int *pnRequestID)
+{
+	Rpc *r = (Rpc *)ext_table_get(&gRpcs, nAVChannelID);
+	RpcPending *p;
+	RpcOut *o;
+	unsigned int id;
+	int error;
+
+	if (r == NULL || pfxResponseFn == NULL || nDataSize < 0 || (nDataSize > 0 && cabData == NULL))
+		return AV_ER_INVALID_ARG;
+	p = (RpcPending *)calloc(1, sizeof(RpcPending));
+	o = rpc_out_new(RPC_KIND_REQUEST, 0, nMethod, cabData, nDataSize);
+	if (p == NULL || o == NULL) {
+		free(p);
+		free(o);
+		return AV_ER_MEM_INSUFF;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	if ((error = r->error) != 0) {
+		pthread_mutex_unlock(&r->lock);
+		free(p);
+		free(o);
+		return error;
+	}
+	id = r->next_id++;
+	if (r->next_id == 0)
+		r->next_id = 1;
+	o->id = id;
+	p->id = id;
+	p->deadline_ms = ext_now_ms() + (nTimeoutMs != 0 ? nTimeoutMs : r->default_timeout_ms);
+	p->fn = pfxResponseFn;
+	p->user = pUserData;
+	p->next = r->pending;
+	r->pending = p;
+	r->stats.calls++;
+	r->stats.outstanding++;
+	rpc_queue_locked(r, o);
+	pthread_mutex_unlock(&r->lock);
+	if (pnRequestID != NULL)
+		*pnRequestID = id;
+	return AV_ER_NoERROR;
+}
+
+static void __stdcall rpc_wait_done(int nAVChannelID, unsigned int nRequestID, int nResult, const char *cabData,
+									int nDataSize, void *pUserData)
+{
+	RpcWait *w = (RpcWait *)pUserData;
+
+	(void)nAVChannelID;
+	(void)nRequestID;
+	pthread_mutex_lock(&w->lock);
+	w->result = nResult;
+	w->size = nDataSize;
+	if (nDataSize > w->max)
+		w->result = AV_ER_BUFPARA_MAXSIZE_INSUFF;
+	else if (nDataSize > 0)
+		memcpy(w->buf, cabData, (size_t)nDataSize);
+	w->done = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int avRpcCall(int nAVChannelID, unsigned int nMethod, const char *cabData, int nDataSize,
+			  char *abReply, int nReplyMaxSize, int *pnReplySize, unsigned int nTimeoutMs)
+{
+	RpcWait w;
+	int ret;
+
+	if (nReplyMaxSize < 0 || (nReplyMaxSize > 0 && abReply == NULL))
+		return AV_ER_INVALID_ARG;
+	memset(&w, 0, sizeof(w));
+	pthread_mutex_init(&w.lock, NULL);
+	pthread_cond_init(&w.cond, NULL);
+	w.buf = abReply;
+	w.max = nReplyMaxSize;
+
+	ret = avRpcCallAsync(nAVChannelID, nMethod, cabData, nDataSize, nTimeoutMs, rpc_wait_done, &w, NULL);
+	if (ret == AV_ER_NoERROR) {
+		// The call always completes: by a reply, its timeout or the detach
+		pthread_mutex_lock(&w.lock);
+		while (!w.done)
+			pthread_cond_wait(&w.cond, &w.lock);
+		pthread_mutex_unlock(&w.lock);
+		ret = w.result;
+		if (pnReplySize != NULL)
+			*pnReplySize = w.size;
+	}
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.lock);
+	return ret;
+}
+
+int avRpcReply(int nAVChannelID, unsigned int nRequestID, int nStatus, const char *cabData, int nDataSize)
+{
+	Rpc *r = (Rpc *)ext_table_get(&gRpcs, nAVChannelID);
+	RpcOut *o;
+	int error;
+
+	if (r == NULL || nStatus < 0 || nDataSize < 0 || (nDataSize > 0 && cabData == NULL))
+		return AV_ER_INVALID_ARG;
+	o = rpc_out_new(RPC_KIND_REPLY, nRequestID, (unsigned int)nStatus, cabData, nDataSize);
+	if (o == NULL)
+		return AV_ER_MEM_INSUFF;
+	pthread_mutex_lock(&r->lock);
+	if ((error = r->error) != 0) {
+		pthread_mutex_unlock(&r->lock);
+		free(o);
+		return error;
+	}
+	r->stats.replies++;
+	rpc_queue_locked(r, o);
+	pthread_mutex_unlock(&r->lock);
+	return AV_ER_NoERROR;
+}
+
+int avRpcRecvIOCtrl(int nAVChannelID, unsigned int *pnIOCtrlType, char *abIOCtrlData, int nIOCtrlMaxDataSize,
+					unsigned int nTimeout)
+{
+	Rpc *r = (Rpc *)ext_table_get(&gRpcs, nAVChannelID);
+	uint64_t deadline = ext_now_ms() + nTimeout, now;
+	RpcRaw *m;
+	int ret;
+
+	if (r == NULL || pnIOCtrlType == NULL || abIOCtrlData == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&r->lock);
+	while ((m = r->raw_head) == NULL) {
+		if (r->error != 0 || r->stop) {
+			ret = r->error != 0 ? r->error : AV_ER_INVALID_ARG;
+			pthread_mutex_unlock(&r->lock);
+			return ret;
+		}
+		now = ext_now_ms();
+		if (now >= deadline) {
+			pthread_mutex_unlock(&r->lock);
+			return nTimeout == 0 ? AV_ER_DATA_NOREADY : AV_ER_TIMEOUT;
+		}
+		ext_cond_wait_ms(&r->raw_cond, &r->lock, (unsigned int)(deadline - now));
+	}
+	if (m->size > nIOCtrlMaxDataSize) {
+		pthread_mutex_unlock(&r->lock);
+		return AV_ER_BUFPARA_MAXSIZE_INSUFF;
+	}
+	r->raw_head = m->next;
+	if (r->raw_head == NULL)
+		r->raw_tail = NULL;
+	r->raw_count--;
+	pthread_mutex_unlock(&r->lock);
+
+	*pnIOCtrlType = m->type;
+	ret = m->size;
+	if (ret > 0)
+		memcpy(abIOCtrlData, m->data, (size_t)ret);
+	free(m);
+	return ret;
+}
+
+int avRpcGetStats(int nAVChannelID, AVRpcStats *pStats)
+{
+	Rpc *r = (Rpc *)ext_table_get(&gRpcs, nAVChannelID);
+
+	if (r == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&r->lock);
+	*pStats = r->stats;
+	pthread_mutex_unlock(&r->lock);
+	return AV_ER_NoERROR;
+}
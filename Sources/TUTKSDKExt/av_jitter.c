@@ -0,0 +1,494 @@
+/*! \file av_jitter.c
+Jitter buffers, see AVJitterBufferAPIs.h.
+
+Timestamps are extended to 64 bits so they may wrap. The transit time of a
+frame is its arrival time minus its timestamp; the smallest transit seen in
+the last two windows is taken as the clock offset, so the fastest frame of
+the recent past defines "no delay" and a sender clock drifting against ours
+is followed. The playout time of a frame is its timestamp plus that offset
+plus the applied delay. The target delay is a multiple of the RFC 3550
+jitter estimate plus a boost that grows on every underrun and decays
+slowly. The applied delay rises to the target at once, so a rising target
+never causes an underrun, and falls by at most
+JITTER_DELAY_DECREASE_MS per frame so playback speeds up smoothly.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVJitterBufferAPIs.h"
+#include "ext_platform.h"
+#include "ext_table.h"
+#include "ext_frame.h"
+#include "ext_av.h"
+
+#define JITTER_K					3.0		// target delay in units of jitter
+#define JITTER_UNDERRUN_BOOST_MS	20.0
+#define JITTER_BOOST_HALF_LIFE_S	8.0
+#define JITTER_DELAY_DECREASE_MS	1.0
+#define JITTER_OFFSET_WINDOW_US		5000000ULL
+#define JITTER_DISCONTINUITY_MS		10000
+#define JITTER_DEFAULT_INTERVAL_MS	40.0
+#define JITTER_AUDIO_MAX_SIZE		4096
+
+typedef struct JitterEntry {
+	AVFrame *frame;
+	int64_t ts;
+	double arrival_ms;
+} JitterEntry;
+
+typedef struct JitterBuffer {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	AVJitterBufferConfig config;
+	JitterEntry *entries;			// sorted by timestamp
+	unsigned int count;
+
+	int has_clock;
+	uint32_t last_raw_ts;
+	int64_t last_ext_ts;
+	double interval_ms;				// average timestamp step between frames
+
+	int has_offset;
+	double offset_ms;
+	double window_min[2];			// smallest transit of the previous and the current window
+	uint64_t window_start_us;
+
+	int has_transit;
+	double prev_transit_ms;
+	double jitter_ms;
+
+	double boost_ms;
+	double applied_ms;
+	uint64_t boost_update_us;
+
+	int started;
+	int64_t last_out_ts;
+	int in_underrun;
+	double underrun_start_ms;
+	double avg_latency_ms;
+	AVJitterBufferStats stats;
+
+	int attached;
+	int stopping;
+	pthread_t thread;
+	int av_index;
+	int audio;
+	avFrameTimestampFn timestamp_fn;
+	void *user_data;
+} JitterBuffer;
+
+static ExtTable gJitterBuffers = EXT_TABLE_INITIALIZER;
+
+static double jitter_now_ms(void)
+{
+	return (double)ext_now_us() / 1000.0;
+}
+
+// Caller holds jb->lock
+static double jitter_target(JitterBuffer *jb)
+{
+	double target = JITTER_K * jb->jitter_ms + jb->boost_ms;
+
+	if (target < jb->config.minDelayMs)
+		target = jb->config.minDelayMs;
+	if (target > jb->config.maxDelayMs)
+		target = jb->config.maxDelayMs;
+	return target;
+}
+
+// Caller holds jb->lock
+static double jitter_playout(JitterBuffer *jb, const JitterEntry *e)
+{
+	return (double)e->ts + jb->offset_ms + jb->applied_ms;
+}
+
+// Caller holds jb->lock. Decay the underrun boost and raise the applied delay to the target.
+static void jitter_update_delay(JitterBuffer *jb)
+{
+	uint64_t now = ext_now_us();
+	double target;
+
+	if (jb->boost_update_us != 0 && jb->boost_ms > 0.0) {
+		double dt = (double)(now - jb->boost_update_us) / 1000000.0;
+		jb->boost_ms -= jb->boost_ms * (dt / JITTER_BOOST_HALF_LIFE_S) * 0.693;
+		if (jb->boost_ms < 0.5)
+			jb->boost_ms = 0.0;
+	}
+	jb->boost_update_us = now;
+
+	target = jitter_target(jb);
+	if (target > jb->applied_ms)
+		jb->applied_ms = target;
+}
+
+// Caller holds jb->lock
+static void jitter_update_offset(JitterBuffer *jb, double transit, uint64_t now_us)
+{
+	if (!jb->has_offset) {
+		jb->window_min[0] = jb->window_min[1] = transit;
+		jb->window_start_us = now_us;
+		jb->has_offset = 1;
+	} else if (now_us - jb->window_start_us >= JITTER_OFFSET_WINDOW_US) {
+		jb->window_min[0] = jb->window_min[1];
+		jb->window_min[1] = transit;
+		jb->window_start_us = now_us;
+	} else if (transit < jb->window_min[1]) {
+		jb->window_min[1] = transit;
+	}
+	jb->offset_ms = jb->window_min[0] < jb->window_min[1] ? jb->window_min[0] : jb->window_min[1];
+}
+
+// Caller holds jb->lock. Returns AV_ER_NoERROR or AV_ER_LOSED_THIS_FRAME, and always consumes pFrame.
+static int jitter_put_locked(JitterBuffer *jb, AVFrame *pFrame, unsigned int nTimestampMs)
+{
+	uint64_t now_us = ext_now_us();
+	double now_ms = (double)now_us / 1000.0, transit;
+	JitterEntry e;
+	unsigned int i;
+
+	if (jb->has_clock) {
+		int32_t step = (int32_t)(nTimestampMs - jb->last_raw_ts);
+		if (step > JITTER_DISCONTINUITY_MS || step < -JITTER_DISCONTINUITY_MS) {
+			// The sender restarted its clock; start over with a new offset
+			jb->has_offset = 0;
+			jb->has_transit = 0;
+			jb->started = 0;
+			e.ts = jb->last_ext_ts + (int64_t)jb->interval_ms;
+		} else {
+			e.ts = jb->last_ext_ts + step;
+			if (step > 0)
+				jb->interval_ms += ((double)step - jb->interval_ms) / 16.0;
+		}
+	} else {
+		e.ts = nTimestampMs;
+		jb->interval_ms = JITTER_DEFAULT_INTERVAL_MS;
+		jb->has_clock = 1;
+	}
+	if (e.ts > jb->last_ext_ts || jb->stats.framesIn == 0) {
+		jb->last_ext_ts = e.ts;
+		jb->last_raw_ts = nTimestampMs;
+	}
+	e.frame = pFrame;
+	e.arrival_ms = now_ms;
+	jb->stats.framesIn++;
+
+	// RFC 3550 section 6.4.1 interarrival jitter
+	transit = now_ms - (double)e.ts;
+	if (jb->has_transit) {
+		double d = transit - jb->prev_transit_ms;
+		jb->jitter_ms += ((d < 0 ? -d : d) - jb->jitter_ms) / 16.0;
+	}
+	jb->prev_transit_ms = transit;
+	jb->has_transit = 1;
+	jitter_update_offset(jb, transit, now_us);
+	jitter_update_delay(jb);
+
+	if (jitter_playout(jb, &e) < now_ms || (jb->started && e.ts <= jb->last_out_ts)) {
+		jb->stats.lateCount++;
+		if (jb->config.dropLate && jb->started && e.ts <= jb->last_out_ts) {
+			jb->stats.dropCount++;
+			avFrameRelease(pFrame);
+			return AV_ER_LOSED_THIS_FRAME;
+		}
+	}
+
+	if (jb->count == jb->config.maxFrames) {
+		avFrameRelease(jb->entries[0].frame);
+		memmove(jb->entries, jb->entries + 1, (jb->count - 1) * sizeof(JitterEntry));
+		jb->count--;
+		jb->stats.dropCount++;
+	}
+	for (i = jb->count; i > 0 && jb->entries[i - 1].ts > e.ts; i--)
+		jb->entries[i] = jb->entries[i - 1];
+	jb->entries[i] = e;
+	jb->count++;
+	pthread_cond_broadcast(&jb->cond);
+	return AV_ER_NoERROR;
+}
+
+// Caller holds jb->lock
+static int jitter_get_locked(JitterBuffer *jb, AVFrame **ppFrame, double *wait_ms)
+{
+	double now_ms = jitter_now_ms(), playout, latency;
+	JitterEntry e;
+
+	jitter_update_delay(jb);
+	if (jb->count == 0) {
+		// The next frame is due one interval after the last one; it is missing if that has passed
+		double due_ms = (double)jb->last_out_ts + jb->interval_ms + jb->offset_ms + jb->applied_ms;
+		if (jb->started && !jb->in_underrun && now_ms > due_ms) {
+			jb->in_underrun = 1;
+			jb->underrun_start_ms = due_ms;
+			jb->stats.underrunCount++;
+			jb->boost_ms += JITTER_UNDERRUN_BOOST_MS;
+			jitter_update_delay(jb);
+		}
+		*wait_ms = -1.0;
+		return AV_ER_DATA_NOREADY;
+	}
+
+	e = jb->entries[0];
+	playout = jitter_playout(jb, &e);
+	if (playout > now_ms) {
+		*wait_ms = playout - now_ms;
+		return AV_ER_DATA_NOREADY;
+	}
+
+	memmove(jb->entries, jb->entries + 1, (jb->count - 1) * sizeof(JitterEntry));
+	jb->count--;
+	if (jb->in_underrun) {
+		jb->stats.underrunMs += (unsigned int)(now_ms - jb->underrun_start_ms);
+		jb->in_underrun = 0;
+	}
+	latency = now_ms - e.arrival_ms;
+	jb->avg_latency_ms = jb->stats.framesOut == 0 ? latency : jb->avg_latency_ms + (latency - jb->avg_latency_ms) / 16.0;
+	jb->stats.framesOut++;
+	jb->started = 1;
+	if (e.ts > jb->last_out_ts || jb->stats.framesOut == 1)
+		jb->last_out_ts = e.ts;
+
+	if (jb->applied_ms > jitter_target(jb)) {
+		jb->applied_ms -= JITTER_DELAY_DECREASE_MS;
+		if (jb->applied_ms < jitter_target(jb))
+			jb->applied_ms = jitter_target(jb);
+	}
+	*ppFrame = e.frame;
+	return AV_ER_NoERROR;
+}
+
+static void *jitter_recv_thread(void *arg)
+{
+	JitterBuffer *jb = (JitterBuffer *)arg;
+	int stopping = 0;
+
+	while (!stopping) {
+		AVFrame *f = NULL;
+		int ret;
+
+		if (jb->audio) {
+			unsigned int frame_index = 0;
+			f = ext_frame_alloc(JITTER_AUDIO_MAX_SIZE);
+			if (f == NULL) {
+				ret = AV_ER_MEM_INSUFF;
+			} else {
+				ret = avRecvAudioData(jb->av_index, f->data, f->capacity, f->info, AV_FRAME_INFO_MAX_SIZE, &frame_index);
+				if (ret >= 0) {
+					f->dataSize = ret;
+					f->expectedSize = ret;
+					f->infoSize = AV_FRAME_INFO_MAX_SIZE;	// avRecvAudioData() does not report it
+					f->frameIndex = frame_index;
+				} else {
+					avFrameRelease(f);
+					f = NULL;
+				}
+			}
+		} else {
+			ret = avRecvFrameDataPooled(jb->av_index, &f);
+		}
+
+		if (f != NULL) {
+			unsigned int ts = jb->timestamp_fn(f, jb->user_data);
+			pthread_mutex_lock(&jb->lock);
+			jitter_put_locked(jb, f, ts);
+			pthread_mutex_unlock(&jb->lock);
+		} else if (ext_av_channel_closed(ret)) {
+			break;
+		} else if (ret == AV_ER_DATA_NOREADY || ret == AV_ER_MEM_INSUFF) {
+			ext_sleep_ms(AV_JITTER_RECV_POLL_INTERVAL);
+		}
+
+		pthread_mutex_lock(&jb->lock);
+		stopping = jb->stopping;
+		pthread_mutex_unlock(&jb->lock);
+	}
+	return NULL;
+}
+
+int avJitterBufferCreate(const AVJitterBufferConfig *pConfig)
+{
+	JitterBuffer *jb;
+	int id;
+
+	if (pConfig != NULL && (pConfig->cb != sizeof(AVJitterBufferConfig) ||
+		(pConfig->maxDelayMs != 0 && pConfig->minDelayMs > pConfig->maxDelayMs)))
+		return AV_ER_INVALID_ARG;
+
+	jb = (JitterBuffer *)calloc(1, sizeof(JitterBuffer));
+	if (jb == NULL)
+		return AV_ER_MEM_INSUFF;
+	if (pConfig != NULL)
+		jb->config = *pConfig;
+	if (jb->config.minDelayMs == 0)
+		jb->config.minDelayMs = AV_JITTER_DEFAULT_MIN_DELAY;
+	if (jb->config.maxDelayMs == 0)
+		jb->config.maxDelayMs = AV_JITTER_DEFAULT_MAX_DELAY;
+	if (jb->config.minDelayMs > jb->config.maxDelayMs)
+		jb->config.minDelayMs = jb->config.maxDelayMs;
+	if (jb->config.maxFrames == 0)
+		jb->config.maxFrames = AV_JITTER_DEFAULT_MAX_FRAMES;
+	jb->applied_ms = jb->config.minDelayMs;
+	jb->interval_ms = JITTER_DEFAULT_INTERVAL_MS;
+
+	jb->entries = (JitterEntry *)malloc(jb->config.maxFrames * sizeof(JitterEntry));
+	if (jb->entries == NULL) {
+		free(jb);
+		return AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_init(&jb->lock, NULL);
+	pthread_cond_init(&jb->cond, NULL);
+
+	id = ext_table_add(&gJitterBuffers, jb);
+	if (id < 0) {
+		pthread_cond_destroy(&jb->cond);
+		pthread_mutex_destroy(&jb->lock);
+		free(jb->entries);
+		free(jb);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avJitterBufferDestroy(int nJitterBufferID)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_take(&gJitterBuffers, nJitterBufferID);
+	unsigned int i;
+
+	if (jb == NULL)
+		return;
+	if (jb->attached) {
+		pthread_mutex_lock(&jb->lock);
+		jb->stopping = 1;
+		pthread_mutex_unlock(&jb->lock);
+		pthread_join(jb->thread, NULL);
+	}
+	for (i = 0; i < jb->count; i++)
+		avFrameRelease(jb->entries[i].frame);
+	pthread_cond_destroy(&jb->cond);
+	pthread_mutex_destroy(&jb->lock);
+	free(jb->entries);
+	free(jb);
+}
+
+int avJitterBufferPut(int nJitterBufferID, AVFrame *pFrame, unsigned int nTimestampMs)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_get(&gJitterBuffers, nJitterBufferID);
+	int ret;
+
+	if (pFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	if (jb == NULL) {
+		avFrameRelease(pFrame);
+		return AV_ER_INVALID_ARG;
+	}
+	pthread_mutex_lock(&jb->lock);
+	ret = jitter_put_locked(jb, pFrame, nTimestampMs);
+	pthread_mutex_unlock(&jb->lock);
+	return ret;
+}
+
+int avJitterBufferAttach(int nJitterBufferID, int nAVChannelID, int bAudio,
+						 avFrameTimestampFn pfxTimestampFn, void *pUserData)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_get(&gJitterBuffers, nJitterBufferID);
+	int ret = AV_ER_NoERROR;
+
+	if (jb == NULL || nAVChannelID < 0 || pfxTimestampFn == NULL)
+		return AV_ER_INVALID_ARG;
+
+	pthread_mutex_lock(&jb->lock);
+	if (jb->attached) {
+		ret = AV_ER_INVALID_ARG;
+	} else {
+		jb->av_index = nAVChannelID;
+		jb->audio = bAudio != 0;
+		jb->timestamp_fn = pfxTimestampFn;
+		jb->user_data = pUserData;
+		if (pthread_create(&jb->thread, NULL, jitter_recv_thread, jb) != 0)
+			ret = AV_ER_FAIL_CREATE_THREAD;
+		else
+			jb->attached = 1;
+	}
+	pthread_mutex_unlock(&jb->lock);
+	return ret;
+}
+
+static int jitter_wait_ms(double wait_ms)
+{
+	if (wait_ms < 0.0)
+		return -1;
+	return (int)(wait_ms + 0.999);
+}
+
+int avJitterBufferGetFrame(int nJitterBufferID, AVFrame **ppFrame, unsigned int *pnWaitMs)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_get(&gJitterBuffers, nJitterBufferID);
+	double wait_ms = 0.0;
+	int ret;
+
+	if (jb == NULL || ppFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	*ppFrame = NULL;
+	pthread_mutex_lock(&jb->lock);
+	ret = jitter_get_locked(jb, ppFrame, &wait_ms);
+	pthread_mutex_unlock(&jb->lock);
+	if (pnWaitMs != NULL) {
+		int ms = ret == AV_ER_NoERROR ? 0 : jitter_wait_ms(wait_ms);
+		*pnWaitMs = ms < 0 ? AV_JITTER_WAIT_INFINITE : (unsigned int)ms;
+	}
+	return ret;
+}
+
+int avJitterBufferWaitFrame(int nJitterBufferID, AVFrame **ppFrame, unsigned int nTimeout)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_get(&gJitterBuffers, nJitterBufferID);
+	uint64_t deadline = ext_now_us() + (uint64_t)nTimeout * 1000ULL;
+	int ret;
+
+	if (jb == NULL || ppFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	*ppFrame = NULL;
+
+	pthread_mutex_lock(&jb->lock);
+	for (;;) {
+		double wait_ms = 0.0;
+		uint64_t now;
+		unsigned int left_ms;
+		int ms;
+
+		ret = jitter_get_locked(jb, ppFrame, &wait_ms);
+		if (ret == AV_ER_NoERROR)
+			break;
+		now = ext_now_us();
+		if (now >= deadline) {
+			ret = AV_ER_TIMEOUT;
+			break;
+		}
+		left_ms = (unsigned int)((deadline - now + 999) / 1000);
+		ms = jitter_wait_ms(wait_ms);
+		// An empty buffer still wakes up now and then to notice an underrun
+		if (ms < 0)
+			ms = (int)(jb->interval_ms + 0.999);
+		ext_cond_wait_ms(&jb->cond, &jb->lock, (unsigned int)ms < left_ms ? (unsigned int)(ms > 0 ? ms : 1) : left_ms);
+	}
+	pthread_mutex_unlock(&jb->lock);
+	return ret;
+}
+
+int avJitterBufferGetStats(int nJitterBufferID, AVJitterBufferStats *pStats)
+{
+	JitterBuffer *jb = (JitterBuffer *)ext_table_get(&gJitterBuffers, nJitterBufferID);
+
+	if (jb == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&jb->lock);
+	*pStats = jb->stats;
+	pStats->jitterMs = (unsigned int)(jb->jitter_ms + 0.5);
+	pStats->targetDelayMs = (unsigned int)(jitter_target(jb) + 0.5);
+	pStats->avgLatencyMs = (unsigned int)(jb->avg_latency_ms + 0.5);
+	pStats->bufferedFrames = jb->count;
+	pStats->bufferedMs = jb->count > 1 ? (unsigned int)(jb->entries[jb->count - 1].ts - jb->entries[0].ts) : 0;
+	pthread_mutex_unlock(&jb->lock);
+	return AV_ER_NoERROR;
+}
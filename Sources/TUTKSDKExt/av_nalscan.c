@@ -0,0 +1,423 @@
+/*! \file av_nalscan.c
+Annex-B NAL scanner, see AVNalScanAPIs.h.
+
+Everything is built on one kernel that finds the next 00 00 01. The SIMD
+engines compare a block at offsets 0, 1 and 2 against 0, 0 and 1 and AND
+the results, so each set bit is a start code. The portable engine is the
+usual skip search, looking at every third byte while it is above 1.
+A four byte start code 00 00 00 01 is found one byte in, and its leading
+zero is trimmed off the end of the previous NAL unit.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "AVNalScanAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "AVGopGateAPIs.h"
+#include "ext_av.h"
+#include "ext_platform.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+	#define NAL_HAVE_X86 1
+	#include <cpuid.h>
+	#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+	#define NAL_HAVE_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#define NAL_H264_IDR				5
+#define NAL_H264_SPS				7
+#define NAL_H264_PPS				8
+#define NAL_H265_IRAP_FIRST			16
+#define NAL_H265_IRAP_LAST			23
+#define NAL_H265_VPS				32
+#define NAL_H265_PPS				34
+
+typedef const unsigned char *(*NalFindFn)(const unsigned char *p, const unsigned char *end);
+
+static pthread_once_t gNalOnce = PTHREAD_ONCE_INIT;
+static AVNalEngine gDetectedEngine = AV_NAL_ENGINE_PORTABLE;
+static AVNalEngine gForcedEngine = AV_NAL_ENGINE_AUTO;
+
+static int nal_detect_sse2(void)
+{
+#ifdef NAL_HAVE_X86
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// EDX bit 26: SSE2
+	return (edx & (1u << 26)) != 0;
+#else
+	return 0;
+#endif
+}
+
+static int nal_detect_avx2(void)
+{
+#ifdef NAL_HAVE_X86
+	unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// ECX bit 27: OSXSAVE, bit 28: AVX
+	if ((ecx & (3u << 27)) != (3u << 27))
+		return 0;
+	// The OS must save the YMM state: XCR0 bits 1 and 2
+	__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & 6) != 6)
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// EBX bit 5: AVX2
+	return (ebx & (1u << 5)) != 0;
+#else
+	return 0;
+#endif
+}
+
+static int nal_detect_neon(void)
+{
+#ifdef NAL_HAVE_NEON
+	// Advanced SIMD is mandatory on arm64
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void nal_detect(void)
+{
+	if (nal_detect_neon())
+		gDetectedEngine = AV_NAL_ENGINE_NEON;
+	else if (nal_detect_avx2())
+		gDetectedEngine = AV_NAL_ENGINE_AVX2;
+	else if (nal_detect_sse2())
+		gDetectedEngine = AV_NAL_ENGINE_SSE2;
+	else
+		gDetectedEngine = AV_NAL_ENGINE_PORTABLE;
+}
+
+/* ============================================================================
+ * Start code search
+ * ============================================================================
+ */
+
+// Returns the first 00 00 01 at or after p, or end
+static const unsigned char *nal_find_portable(const unsigned char *p, const unsigned char *end)
+{
+	while (p + 3 <= end) {
+		if (p[2] > 1)
+			p += 3;
+		else if (p[2] == 0)
+			p++;
+		else if (p[0] == 0 && p[1] == 0)
+			return p;
+		else
+			p += 3;
+	}
+	return end;
+}
+
+#ifdef NAL_HAVE_X86
+__attribute__((target("sse2")))
+static const unsigned char *nal_find_sse2(const unsigned char *p, const unsigned char *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+
+	// Offset 2 reads 18 bytes, which must stay inside the frame
+	for (; p + 18 <= end; p += 16) {
+		__m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+		__m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero);
+		__m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), one);
+		int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+		if (mask != 0)
+			return p + __builtin_ctz((unsigned int)mask);
+	}
+	return nal_find_portable(p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *nal_find_avx2(const unsigned char *p, const unsigned char *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+
+	for (; p + 34 <= end; p += 32) {
+		__m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+		__m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), zero);
+		__m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), one);
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+	}
+	return nal_find_sse2(p, end);
+}
+#endif
+
+#ifdef NAL_HAVE_NEON
+static const unsigned char *nal_find_neon(const unsigned char *p, const unsigned char *end)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t one = vdupq_n_u8(1);
+
+	for (; p + 18 <= end; p += 16) {
+		uint8x16_t a = vceqq_u8(vld1q_u8(p), zero);
+		uint8x16_t b = vceqq_u8(vld1q_u8(p + 1), zero);
+		uint8x16_t c = vceqq_u8(vld1q_u8(p + 2), one);
+		uint8x16_t m = vandq_u8(vandq_u8(a, b), c);
+		if (vmaxvq_u8(m) != 0) {
+			// Narrow each byte of the mask to a nibble to find the first match
+			uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+			return p + (__builtin_ctzll(bits) >> 2);
+		}
+	}
+	return nal_find_portable(p, end);
+}
+#endif
+
+static NalFindFn nal_finder(AVNalEngine engine)
+{
+	switch (engine) {
+#ifdef NAL_HAVE_X86
+	case AV_NAL_ENGINE_SSE2:
+		return nal_find_sse2;
+	case AV_NAL_ENGINE_AVX2:
+		return nal_find_avx2;
+#endif
+#ifdef NAL_HAVE_NEON
+	case AV_NAL_ENGINE_NEON:
+		return nal_find_neon;
+#endif
+	default:
+		return nal_find_portable;
+	}
+}
+
+/* ============================================================================
+ * Scanner
+ * ============================================================================
+ */
+
+static unsigned char nal_type(AVNalCodec codec, unsigned char header)
+{
+	return codec == AV_NAL_CODEC_H264 ? (unsigned char)(header & 0x1f) : (unsigned char)((header >> 1) & 0x3f);
+}
+
+static int nal_scan(NalFindFn find, AVNalCodec codec, const unsigned char *data, int size,
+					AVNalUnit *units, int max_units)
+{
+	const unsigned char *end = data + size, *hdr, *next;
+	unsigned int len;
+	int n = 0;
+
+	hdr = find(data, end);
+	while (hdr < end) {
+		hdr += 3;
+		next = find(hdr, end);
+		if (hdr < next) {
+			if (n < max_units) {
+				len = (unsigned int)(next - hdr);
+				while (len > 0 && hdr[len - 1] == 0)
+					len--;
+				units[n].offset = (unsigned int)(hdr - data);
+				units[n].size = len;
+				units[n].type = nal_type(codec, hdr[0]);
+			}
+			n++;
+		}
+		hdr = next;
+	}
+	return n;
+}
+
+static AVNalFrameType nal_slice_frame_type(AVNalCodec codec, const unsigned char *hdr, unsigned char type)
+{
+	if (codec == AV_NAL_CODEC_H264) {
+		if (type == NAL_H264_IDR)
+			return AV_NAL_FRAME_KEY;
+		// nal_ref_idc 0: nothing refers to this picture
+		return (hdr[0] & 0x60) == 0 ? AV_NAL_FRAME_DISPOSABLE : AV_NAL_FRAME_DELTA;
+	}
+	if (type >= NAL_H265_IRAP_FIRST && type <= NAL_H265_IRAP_LAST)
+		return AV_NAL_FRAME_KEY;
+	// The even types up to RSV_VCL_N14 are sub-layer non-reference pictures
+	return type <= 14 && (type & 1) == 0 ? AV_NAL_FRAME_DISPOSABLE : AV_NAL_FRAME_DELTA;
+}
+
+static int nal_is_slice(AVNalCodec codec, unsigned char type)
+{
+	return codec == AV_NAL_CODEC_H264 ? type >= 1 && type <= NAL_H264_IDR : type < NAL_H265_VPS;
+}
+
+static int nal_is_param_set(AVNalCodec codec, unsigned char type)
+{
+	if (codec == AV_NAL_CODEC_H264)
+		return type == NAL_H264_SPS || type == NAL_H264_PPS;
+	return type >= NAL_H265_VPS && type <= NAL_H265_PPS;
+}
+
+static int nal_valid(AVNalCodec codec, const unsigned char *data, int size)
+{
+	return data != NULL && size >= 0 && (codec == AV_NAL_CODEC_H264 || codec == AV_NAL_CODEC_H265);
+}
+
+int avNalScan(AVNalCodec codec, const unsigned char *cabData, int nSize, AVNalUnit *pUnits, int nMaxUnits)
+{
+	if (!nal_valid(codec, cabData, nSize) || nMaxUnits < 0 || (pUnits == NULL && nMaxUnits > 0))
+		return AV_ER_INVALID_ARG;
+	return nal_scan(nal_finder(avNalGetEngine()), codec, cabData, nSize, pUnits, nMaxUnits);
+}
+
+int avNalClassify(AVNalCodec codec, const unsigned char *cabData, int nSize, AVNalFrameInfo *pInfo)
+{
+	NalFindFn find;
+	const unsigned char *end = cabData + nSize, *hdr;
+	AVNalFrameInfo info;
+	unsigned char type;
+
+	if (!nal_valid(codec, cabData, nSize))
+		return AV_ER_INVALID_ARG;
+	find = nal_finder(avNalGetEngine());
+	memset(&info, 0, sizeof(info));
+	for (hdr = find(cabData, end); hdr < end; hdr = find(hdr, end)) {
+		hdr += 3;
+		if (hdr == end)
+			break;
+		type = nal_type(codec, hdr[0]);
+		if (nal_is_slice(codec, type)) {
+			info.frameType = nal_slice_frame_type(codec, hdr, type);
+			info.sliceType = type;
+			info.sliceOffset = (unsigned int)(hdr - cabData);
+			break;
+		}
+		if (nal_is_param_set(codec, type))
+			info.hasParamSets = 1;
+	}
+	if (pInfo != NULL)
+		*pInfo = info;
+	return info.frameType;
+}
+
+int avSendFrameDataNal(int nAVChannelID, AVNalCodec codec, const char *cabFrameData, int nFrameDataSize,
+					   const void *cabFrameInfo, int nFrameInfoSize, int nFlagOffset,
+					   AVNalFrameType *pFrameType)
+{
+	unsigned char info[AV_NAL_MAX_FRAME_INFO];
+	const void *send_info = cabFrameInfo;
+	int type, key;
+
+	if (nFlagOffset != AV_NAL_FLAG_OFFSET_NONE &&
+		(cabFrameInfo == NULL || nFlagOffset < 0 || nFlagOffset >= nFrameInfoSize ||
+		 nFrameInfoSize > AV_NAL_MAX_FRAME_INFO))
+		return AV_ER_INVALID_ARG;
+	type = avNalClassify(codec, (const unsigned char *)cabFrameData, nFrameDataSize, NULL);
+	if (type < 0)
+		return type;
+	key = type == AV_NAL_FRAME_KEY;
+	if (pFrameType != NULL)
+		*pFrameType = (AVNalFrameType)type;
+	if (nFlagOffset != AV_NAL_FLAG_OFFSET_NONE) {
+		memcpy(info, cabFrameInfo, (size_t)nFrameInfoSize);
+		info[nFlagOffset] = (unsigned char)key;
+		send_info = info;
+	}
+	if (ext_gopgate_attached(nAVChannelID))
+		return avSendFrameDataGop(nAVChannelID, cabFrameData, nFrameDataSize, send_info, nFrameInfoSize, key);
+	return avSendFrameDataPaced(nAVChannelID, cabFrameData, nFrameDataSize, send_info, nFrameInfoSize, NULL);
+}
+
+/* ============================================================================
+ * Engines
+ * ============================================================================
+ */
+
+int avNalEngineSupported(AVNalEngine engine)
+{
+	switch (engine) {
+	case AV_NAL_ENGINE_AUTO:
+	case AV_NAL_ENGINE_PORTABLE:
+		return 1;
+	case AV_NAL_ENGINE_SSE2:
+		return nal_detect_sse2();
+	case AV_NAL_ENGINE_AVX2:
+		return nal_detect_avx2();
+	case AV_NAL_ENGINE_NEON:
+		return nal_detect_neon();
+	default:
+		return 0;
+	}
+}
+
+AVNalEngine avNalGetEngine(void)
+{
+	pthread_once(&gNalOnce, nal_detect);
+	return gForcedEngine != AV_NAL_ENGINE_AUTO ? gForcedEngine : gDetectedEngine;
+}
+
+int avNalSetEngine(AVNalEngine engine)
+{
+	if (engine < AV_NAL_ENGINE_AUTO || engine > AV_NAL_ENGINE_NEON || !avNalEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	gForcedEngine = engine;
+	return AV_ER_NoERROR;
+}
+
+// A parameter set, an SEI and one slice of random bytes with emulation prevention
+static void nal_bench_frame(unsigned char *buf, unsigned int size)
+{
+	static const unsigned char head[] = {
+		0, 0, 0, 1, 0x67, 0x64, 0x00, 0x33, 0xac,
+		0, 0, 0, 1, 0x68, 0xee, 0x3c, 0xb0,
+		0, 0, 0, 1, 0x06, 0x05, 0x10, 0x80,
+		0, 0, 0, 1, 0x65, 0x88, 0x84
+	};
+	unsigned int seed = 0x2545f491, i, zeros = 0;
+
+	memcpy(buf, head, sizeof(head));
+	for (i = sizeof(head); i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (unsigned char)(seed >> 16);
+		if (zeros >= 2 && buf[i] <= 3) {
+			buf[i] = 3;
+			zeros = 0;
+			continue;
+		}
+		zeros = buf[i] == 0 ? zeros + 1 : 0;
+	}
+}
+
+int avNalBenchmark(AVNalEngine engine, unsigned int nFrameSize, unsigned int nDurationMs, float *pfGBps)
+{
+	AVNalUnit units[8];
+	unsigned char *buf;
+	NalFindFn find;
+	uint64_t start, elapsed, bytes;
+
+	if (pfGBps == NULL || nDurationMs == 0 || nFrameSize < 64 || nFrameSize > 0x7fffffff ||
+		!avNalEngineSupported(engine))
+		return AV_ER_INVALID_ARG;
+	if (engine == AV_NAL_ENGINE_AUTO)
+		engine = avNalGetEngine();
+	buf = (unsigned char *)malloc(nFrameSize);
+	if (buf == NULL)
+		return AV_ER_MEM_INSUFF;
+	nal_bench_frame(buf, nFrameSize);
+	find = nal_finder(engine);
+
+	bytes = 0;
+	start = ext_now_us();
+	do {
+		nal_scan(find, AV_NAL_CODEC_H264, buf, (int)nFrameSize, units, 8);
+		bytes += nFrameSize;
+		elapsed = ext_now_us() - start;
+	} while (elapsed < (uint64_t)nDurationMs * 1000ULL);
+	*pfGBps = (float)((double)bytes / (double)elapsed / 1000.0);
+
+	free(buf);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,693 @@
+/*! \file av_playback.c
+Playback of recorder segments, see AVPlaybackAPIs.h.
+
+The index keeps one entry per segment, sorted by segment number, which is
+also time order. Keyframe lists are read from a segment only when a seek
+lands in it and are kept until the segment grows. Players read records
+with pread() from their own file descriptor and never go past the dataEnd
+in the header, so they can follow a segment the recorder is still writing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "AVPlaybackAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+
+#define PB_ALIGN(n)				(((n) + AV_REC_ALIGN - 1) & ~(size_t)(AV_REC_ALIGN - 1))
+#define PB_TAIL_POLL_MS			100
+#define PB_MAX_GAP_MS			10000	// a larger jump in timestamps restarts the pacing clock
+
+typedef struct PbKey {
+	unsigned long long time_ms;
+	unsigned int offset;
+} PbKey;
+
+typedef struct PbSegment {
+	unsigned int no;
+	int complete;
+	unsigned long long start_ms;
+	unsigned long long end_ms;
+	unsigned long long index_offset;
+	unsigned int index_count;
+	PbKey *keys;
+	unsigned int key_count;
+	unsigned int keys_index_count;	// index_count the keys were read at
+} PbSegment;
+
+typedef struct PbIndex {
+	char *dir;
+	char *prefix;
+	pthread_mutex_t lock;
+	PbSegment *segs;
+	unsigned int count;
+	unsigned int capacity;
+} PbIndex;
+
+typedef struct Player {
+	int av_index;
+	PbIndex *index;
+	avPlaybackEndFn end_fn;
+	void *user_data;
+	AVPlaybackPosition start;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	int rebase;
+	pthread_t thread;
+	AVPlaybackStats stats;
+} Player;
+
+static ExtTable gIndexes = EXT_TABLE_INITIALIZER;
+static ExtTable gPlayers = EXT_TABLE_INITIALIZER;
+
+static char *pb_segment_path(const PbIndex *x, unsigned int no)
+{
+	int len = snprintf(NULL, 0, AV_REC_SEGMENT_NAME_FORMAT, x->dir, x->prefix, no);
+	char *path = (char *)malloc((size_t)len + 1);
+
+	if (path != NULL)
+		snprintf(path, (size_t)len + 1, AV_REC_SEGMENT_NAME_FORMAT, x->dir, x->prefix, no);
+	return path;
+}
+
+static int pb_read_header(int fd, AVRecSegmentHeader *h)
+{
+	if (pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) || h->magic != AV_REC_SEGMENT_MAGIC ||
+		h->version != AV_REC_SEGMENT_VERSION)
+		return -1;
+	return 0;
+}
+
+// Caller holds x->lock. Read the header of a segment into seg; returns 1 if it has frames.
+static int pb_segment_load(PbIndex *x, unsigned int no, PbSegment *seg)
+{
+	AVRecSegmentHeader h;
+	struct stat st;
+	char *path = pb_segment_path(x, no);
+	int fd, ret = 0;
+
+	if (path == NULL)
+		return 0;
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return 0;
+	if (pb_read_header(fd, &h) == 0 && h.indexCount > 0 && fstat(fd, &st) == 0) {
+		seg->no = no;
+		seg->complete = (h.flags & AV_REC_SEGMENT_COMPLETE) != 0;
+		seg->start_ms = h.startTimeMs;
+		seg->end_ms = h.endTimeMs;
+		// While open, the index is at the end of the file, entry 0 last
+		seg->index_offset = seg->complete ? h.indexOffset : (unsigned long long)st.st_size;
+		seg->index_count = h.indexCount;
+		ret = 1;
+	}
+	close(fd);
+	return ret;
+}
+
+// Caller holds x->lock. Binary search for segment no; returns its slot or where it would go.
+static unsigned int pb_find_no(const PbIndex *x, unsigned int no)
+{
+	unsigned int lo = 0, hi = x->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (x->segs[mid].no < no)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int pb_refresh_locked(PbIndex *x)
+{
+	size_t prefix_len = strlen(x->prefix);
+	struct dirent *e;
+	PbSegment seg, *segs;
+	unsigned int no, slot;
+	char *end;
+	DIR *d;
+
+	d = opendir(x->dir);
+	if (d == NULL)
+		return AV_ER_RECORDER_IO_FAIL;
+	while ((e = readdir(d)) != NULL) {
+		if (strncmp(e->d_name, x->prefix, prefix_len) != 0 || e->d_name[prefix_len] != '_' ||
+			!isdigit((unsigned char)e->d_name[prefix_len + 1]))
+			continue;
+		no = (unsigned int)strtoul(e->d_name + prefix_len + 1, &end, 10);
+		if (strcmp(end, ".avs") != 0)
+			continue;
+		slot = pb_find_no(x, no);
+		// Complete segments never change; open ones may have grown
+		if (slot < x->count && x->segs[slot].no == no && x->segs[slot].complete)
+			continue;
+		memset(&seg, 0, sizeof(seg));
+		if (!pb_segment_load(x, no, &seg))
+			continue;
+		if (slot < x->count && x->segs[slot].no == no) {
+			seg.keys = x->segs[slot].keys;
+			seg.key_count = x->segs[slot].key_count;
+			seg.keys_index_count = x->segs[slot].keys_index_count;
+			x->segs[slot] = seg;
+			continue;
+		}
+		if (x->count == x->capacity) {
+			segs = (PbSegment *)realloc(x->segs, (x->capacity ? x->capacity * 2 : 64) * sizeof(PbSegment));
+			if (segs == NULL) {
+				closedir(d);
+				return AV_ER_MEM_INSUFF;
+			}
+			x->segs = segs;
+			x->capacity = x->capacity ? x->capacity * 2 : 64;
+		}
+		memmove(&x->segs[slot + 1], &x->segs[slot], (x->count - slot) * sizeof(PbSegment));
+		x->segs[slot] = seg;
+		x->count++;
+	}
+	closedir(d);
+	return AV_ER_NoERROR;
+}
+
+// Caller holds x->lock. Read the keyframes of a segment unless they are up to date.
+static int pb_load_keys(PbIndex *x, PbSegment *seg)
+{
+	AVRecIndexEntry *entries;
+	size_t bytes = (size_t)seg->index_count * sizeof(AVRecIndexEntry);
+	off_t where = (off_t)(seg->complete ? seg->index_offset : seg->index_offset - bytes);
+	PbKey *keys;
+	unsigned int i, n = 0;
+	char *path;
+	int fd, ok;
+
+	if (seg->keys != NULL && seg->keys_index_count == seg->index_count)
+		return AV_ER_NoERROR;
+	path = pb_segment_path(x, seg->no);
+	entries = (AVRecIndexEntry *)malloc(bytes);
+	keys = (PbKey *)malloc(seg->index_count * sizeof(PbKey));
+	if (path == NULL || entries == NULL || keys == NULL) {
+		free(path);
+		free(entries);
+		free(keys);
+		return AV_ER_MEM_INSUFF;
+	}
+	fd = open(path, O_RDONLY);
+	free(path);
+	ok = fd >= 0 && pread(fd, entries, bytes, where) == (ssize_t)bytes;
+	if (fd >= 0)
+		close(fd);
+	if (!ok) {
+		free(entries);
+		free(keys);
+		return AV_ER_RECORDER_IO_FAIL;
+	}
+	for (i = 0; i < seg->index_count; i++) {
+		const AVRecIndexEntry *en = &entries[seg->complete ? i : seg->index_count - 1 - i];
+
+		if (en->flags & AV_REC_FRAME_KEY) {
+			keys[n].time_ms = seg->start_ms + en->timeOffsetMs;
+			keys[n].offset = en->offset;
+			n++;
+		}
+	}
+	free(entries);
+	free(seg->keys);
+	seg->keys = keys;
+	seg->key_count = n;
+	seg->keys_index_count = seg->index_count;
+	return AV_ER_NoERROR;
+}
+
+// Caller holds x->lock
+static int pb_seek_locked(PbIndex *x, unsigned long long t, AVPlaybackPosition *pos)
+{
+	unsigned int lo = 0, hi = x->count, mid, i;
+	int ret;
+
+	if (x->count == 0 || t > x->segs[x->count - 1].end_ms)
+		return AV_ER_DATA_NOREADY;
+	// The last segment starting at or before t
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (x->segs[mid].start_ms <= t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	// Walk back in case the segment starts after a size rotation without a keyframe
+	for (i = lo; i-- > 0;) {
+		PbSegment *seg = &x->segs[i];
+
+		ret = pb_load_keys(x, seg);
+		if (ret < 0)
+			return ret;
+		lo = 0;
+		hi = seg->key_count;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (seg->keys[mid].time_ms <= t)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo > 0) {
+			pos->segmentNo = seg->no;
+			pos->offset = seg->keys[lo - 1].offset;
+			pos->timeMs = seg->keys[lo - 1].time_ms;
+			return AV_ER_NoERROR;
+		}
+	}
+	// t is before the first keyframe
+	for (i = 0; i < x->count; i++) {
+		ret = pb_load_keys(x, &x->segs[i]);
+		if (ret < 0)
+			return ret;
+		if (x->segs[i].key_count > 0) {
+			pos->segmentNo = x->segs[i].no;
+			pos->offset = x->segs[i].keys[0].offset;
+			pos->timeMs = x->segs[i].keys[0].time_ms;
+			return AV_ER_NoERROR;
+		}
+	}
+	return AV_ER_DATA_NOREADY;
+}
+
+static void pb_index_free(PbIndex *x)
+{
+	unsigned int i;
+
+	for (i = 0; i < x->count; i++)
+		free(x->segs[i].keys);
+	free(x->segs);
+	free(x->dir);
+	free(x->prefix);
+	pthread_mutex_destroy(&x->lock);
+	free(x);
+}
+
+int avPlaybackIndexOpen(const char *pszDirectory, const char *pszPrefix)
+{
+	PbIndex *x;
+	int ret;
+
+	if (pszDirectory == NULL || pszPrefix == NULL)
+		return AV_ER_INVALID_ARG;
+	x = (PbIndex *)calloc(1, sizeof(PbIndex));
+	if (x == NULL)
+		return AV_ER_MEM_INSUFF;
+	pthread_mutex_init(&x->lock, NULL);
+	x->dir = strdup(pszDirectory);
+	x->prefix = strdup(pszPrefix);
+	if (x->dir == NULL || x->prefix == NULL) {
+		pb_index_free(x);
+		return AV_ER_MEM_INSUFF;
+	}
+	ret = pb_refresh_locked(x);
+	if (ret < 0) {
+		pb_index_free(x);
+		return ret;
+	}
+	ret = ext_table_add(&gIndexes, x);
+	if (ret < 0) {
+		pb_index_free(x);
+		return AV_ER_MEM_INSUFF;
+	}
+	return ret;
+}
+
+int avPlaybackIndexRefresh(int nIndexID)
+{
+	PbIndex *x = (PbIndex *)ext_table_get(&gIndexes, nIndexID);
+	int ret;
+
+	if (x == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&x->lock);
+	ret = pb_refresh_locked(x);
+	pthread_mutex_unlock(&x->lock);
+	return ret;
+}
+
+void avPlaybackIndexClose(int nIndexID)
+{
+	PbIndex *x = (PbIndex *)ext_table_take(&gIndexes, nIndexID);
+
+	if (x != NULL)
+		pb_index_free(x);
+}
+
+int avPlaybackIndexGetRange(int nIndexID, unsigned long long *pStartTimeMs, unsigned long long *pEndTimeMs)
+{
+	PbIndex *x = (PbIndex *)ext_table_get(&gIndexes, nIndexID);
+	int ret = AV_ER_DATA_NOREADY;
+
+	if (x == NULL || pStartTimeMs == NULL || pEndTimeMs == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&x->lock);
+	if (x->count > 0) {
+		*pStartTimeMs = x->segs[0].start_ms;
+		*pEndTimeMs = x->segs[x->count - 1].end_ms;
+		ret = AV_ER_NoERROR;
+	}
+	pthread_mutex_unlock(&x->lock);
+	return ret;
+}
+
+int avPlaybackIndexSeek(int nIndexID, unsigned long long nTimeMs, AVPlaybackPosition *pPos)
+{
+	PbIndex *x = (PbIndex *)ext_table_get(&gIndexes, nIndexID);
+	int ret;
+
+	if (x == NULL || pPos == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&x->lock);
+	ret = pb_seek_locked(x, nTimeMs, pPos);
+	pthread_mutex_unlock(&x->lock);
+	return ret;
+}
+
+int avPlaybackParseStartTime(const VSaaSPullStreamAttr *pAttr, unsigned long long *pTimeMs)
+{
+	const char *s;
+	char *end;
+	unsigned long long t;
+
+	if (pAttr == NULL || pTimeMs == NULL)
+		return AV_ER_INVALID_ARG;
+	s = pAttr->starttime;
+	while (isspace((unsigned char)*s))
+		s++;
+	if (strncasecmp(s, "live", 4) == 0)
+		return AV_ER_NOT_SUPPORT;
+	if (!isdigit((unsigned char)*s))
+		return AV_ER_INVALID_ARG;
+	t = strtoull(s, &end, 10);
+	while (isspace((unsigned char)*end))
+		end++;
+	if (*end != '\0')
+		return AV_ER_INVALID_ARG;
+	// Seconds until the year 5138, milliseconds after 1973
+	*pTimeMs = t < 100000000000ULL ? t * 1000 : t;
+	return AV_ER_NoERROR;
+}
+
+/* ============================================================================
+ * Players
+ * ============================================================================
+ */
+
+// Player thread. Wait until due_us or until stopped; returns 0 if stopped.
+static int pb_wait_until(Player *p, uint64_t due_us)
+{
+	uint64_t now;
+	int running;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->stop && !p->rebase && (now = ext_now_us()) < due_us)
+		ext_cond_wait_ms(&p->cond, &p->lock, (unsigned int)((due_us - now + 999) / 1000));
+	running = !p->stop;
+	pthread_mutex_unlock(&p->lock);
+	return running;
+}
+
+// Player thread. Open the next segment after no, waiting for the recorder if there is none yet.
+static int pb_open_next(Player *p, unsigned int no, unsigned int *next_no)
+{
+	PbIndex *x = p->index;
+	uint64_t deadline = ext_now_us() + (uint64_t)AV_PLAYBACK_TAIL_TIMEOUT * 1000;
+	unsigned int slot;
+	char *path;
+	int fd;
+
+	for (;;) {
+		pthread_mutex_lock(&x->lock);
+		slot = pb_find_no(x, no + 1);
+		if (slot == x->count) {
+			pb_refresh_locked(x);
+			slot = pb_find_no(x, no + 1);
+		}
+		*next_no = slot < x->count ? x->segs[slot].no : 0;
+		pthread_mutex_unlock(&x->lock);
+		if (slot < x->count)
+			break;
+		if (ext_now_us() >= deadline || !pb_wait_until(p, ext_now_us() + PB_TAIL_POLL_MS * 1000))
+			return -1;
+	}
+	path = pb_segment_path(x, *next_no);
+	if (path == NULL)
+		return -1;
+	fd = open(path, O_RDONLY);
+	free(path);
+	return fd;
+}
+
+static void *pb_player_thread(void *arg)
+{
+	Player *p = (Player *)arg;
+	AVRecSegmentHeader h;
+	AVRecFrameHeader fh;
+	unsigned char *buf = NULL;
+	size_t buf_size = 0, rec_size;
+	unsigned int no = p->start.segmentNo, speed;
+	unsigned long long offset = p->start.offset, base_ts = 0;
+	uint64_t base_us = 0, due_us, tail_deadline = 0;
+	int fd, ret = AV_ER_NoERROR, rebase = 1, has_next;
+	char *path = pb_segment_path(p->index, no);
+
+	fd = path != NULL ? open(path, O_RDONLY) : -1;
+	free(path);
+	if (fd < 0 || pb_read_header(fd, &h) < 0)
+		ret = AV_ER_RECORDER_IO_FAIL;
+	else
+		p->stats.segmentsRead = 1;
+
+	while (ret == AV_ER_NoERROR) {
+		pthread_mutex_lock(&p->lock);
+		if (p->stop) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		speed = p->stats.speed;
+		if (p->rebase) {
+			p->rebase = 0;
+			rebase = 1;
+		}
+		pthread_mutex_unlock(&p->lock);
+
+		if (offset >= h.dataEnd) {
+			// An open segment may still grow; the recorder moves on to the next one when it is full
+			if (!(h.flags & AV_REC_SEGMENT_COMPLETE) && pb_read_header(fd, &h) == 0 && offset < h.dataEnd) {
+				tail_deadline = 0;
+				continue;
+			}
+			if (!(h.flags & AV_REC_SEGMENT_COMPLETE)) {
+				if (tail_deadline == 0)
+					tail_deadline = ext_now_us() + (uint64_t)AV_PLAYBACK_TAIL_TIMEOUT * 1000;
+				// Only a recorder that died leaves an open segment behind a newer one
+				pthread_mutex_lock(&p->index->lock);
+				pb_refresh_locked(p->index);
+				has_next = pb_find_no(p->index, no + 1) < p->index->count;
+				pthread_mutex_unlock(&p->index->lock);
+				if (!has_next) {
+					if (ext_now_us() >= tail_deadline ||
+						!pb_wait_until(p, ext_now_us() + PB_TAIL_POLL_MS * 1000))
+						break;
+					continue;
+				}
+			}
+			close(fd);
+			fd = pb_open_next(p, no, &no);
+			if (fd < 0)
+				break;
+			if (pb_read_header(fd, &h) < 0) {
+				ret = AV_ER_RECORDER_IO_FAIL;
+				break;
+			}
+			tail_deadline = 0;
+			offset = sizeof(AVRecSegmentHeader);
+			pthread_mutex_lock(&p->lock);
+			p->stats.segmentsRead++;
+			pthread_mutex_unlock(&p->lock);
+			continue;
+		}
+
+		if (pread(fd, &fh, sizeof(fh), (off_t)offset) != (ssize_t)sizeof(fh)) {
+			ret = AV_ER_RECORDER_IO_FAIL;
+			break;
+		}
+		rec_size = PB_ALIGN(sizeof(fh) + fh.infoSize + (size_t)fh.size);
+		if (fh.size == 0 || offset + rec_size > h.dataEnd) {
+			ret = AV_ER_RECORDER_IO_FAIL;
+			break;
+		}
+		if (rec_size > buf_size) {
+			unsigned char *b = (unsigned char *)realloc(buf, rec_size);
+
+			if (b == NULL) {
+				ret = AV_ER_MEM_INSUFF;
+				break;
+			}
+			buf = b;
+			buf_size = rec_size;
+		}
+		if (pread(fd, buf, fh.infoSize + (size_t)fh.size, (off_t)(offset + sizeof(fh))) !=
+			(ssize_t)(fh.infoSize + (size_t)fh.size)) {
+			ret = AV_ER_RECORDER_IO_FAIL;
+			break;
+		}
+
+		if (speed != AV_PLAYBACK_SPEED_UNLIMITED) {
+			due_us = base_us + (fh.timestampMs - base_ts) * 1000 * 100 / speed;
+			// Start the clock again after a speed change or a gap between recordings
+			if (rebase || fh.timestampMs < base_ts || due_us > ext_now_us() + (uint64_t)PB_MAX_GAP_MS * 1000) {
+				base_ts = fh.timestampMs;
+				base_us = ext_now_us();
+				due_us = base_us;
+				rebase = 0;
+			}
+			if (!pb_wait_until(p, due_us))
+				break;
+		}
+
+		for (;;) {
+			ret = avSendFrameDataPaced(p->av_index, (const char *)buf + fh.infoSize, (int)fh.size,
+									   fh.infoSize > 0 ? buf : NULL, fh.infoSize, NULL);
+			if (ret != AV_ER_EXCEED_MAX_SIZE && ret != AV_ER_SOCKET_QUEUE_FULL)
+				break;
+			// Faster than real time the resend buffer fills up; let the client drain it
+			pthread_mutex_lock(&p->lock);
+			p->stats.retries++;
+			pthread_mutex_unlock(&p->lock);
+			if (!pb_wait_until(p, ext_now_us() + AV_PLAYBACK_RETRY_INTERVAL * 1000))
+				break;
+		}
+		if (ret == AV_ER_EXCEED_MAX_SIZE || ret == AV_ER_SOCKET_QUEUE_FULL) {
+			// Stopped while waiting
+			ret = AV_ER_NoERROR;
+			break;
+		}
+		if (ret < 0 && ret != AV_ER_EXCEED_MAX_ALARM)
+			break;
+		ret = AV_ER_NoERROR;
+
+		pthread_mutex_lock(&p->lock);
+		p->stats.framesSent++;
+		p->stats.bytesSent += fh.size;
+		p->stats.currentTimeMs = fh.timestampMs;
+		pthread_mutex_unlock(&p->lock);
+		offset += rec_size;
+	}
+
+	if (fd >= 0)
+		close(fd);
+	free(buf);
+	pthread_mutex_lock(&p->lock);
+	if (p->stop) {
+		pthread_mutex_unlock(&p->lock);
+		return NULL;
+	}
+	pthread_mutex_unlock(&p->lock);
+	if (p->end_fn != NULL)
+		p->end_fn(p->av_index, ret, p->user_data);
+	return NULL;
+}
+
+static void pb_player_free(Player *p)
+{
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+int avPlaybackStart(int nAVChannelID, int nIndexID, unsigned long long nTimeMs, unsigned int nSpeedPercent,
+					avPlaybackEndFn pfxEndFn, void *pUserData)
+{
+	PbIndex *x = (PbIndex *)ext_table_get(&gIndexes, nIndexID);
+	Player *p;
+	int ret;
+
+	if (nAVChannelID < 0 || x == NULL)
+		return AV_ER_INVALID_ARG;
+	p = (Player *)calloc(1, sizeof(Player));
+	if (p == NULL)
+		return AV_ER_MEM_INSUFF;
+	p->av_index = nAVChannelID;
+	p->index = x;
+	p->end_fn = pfxEndFn;
+	p->user_data = pUserData;
+	p->stats.speed = nSpeedPercent;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	pthread_mutex_lock(&x->lock);
+	ret = pb_seek_locked(x, nTimeMs, &p->start);
+	pthread_mutex_unlock(&x->lock);
+	if (ret < 0) {
+		pb_player_free(p);
+		return ret;
+	}
+	if (ext_table_set(&gPlayers, nAVChannelID, p) < 0) {
+		pb_player_free(p);
+		return AV_ER_INVALID_ARG;
+	}
+	if (pthread_create(&p->thread, NULL, pb_player_thread, p) != 0) {
+		ext_table_take(&gPlayers, nAVChannelID);
+		pb_player_free(p);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	return AV_ER_NoERROR;
+}
+
+int avPlaybackSetSpeed(int nAVChannelID, unsigned int nSpeedPercent)
+{
+	Player *p = (Player *)ext_table_get(&gPlayers, nAVChannelID);
+
+	if (p == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&p->lock);
+	if (p->stats.speed != nSpeedPercent) {
+		p->stats.speed = nSpeedPercent;
+		p->rebase = 1;
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return AV_ER_NoERROR;
+}
+
+void avPlaybackStop(int nAVChannelID)
+{
+	Player *p = (Player *)ext_table_take(&gPlayers, nAVChannelID);
+
+	if (p == NULL)
+		return;
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+	pb_player_free(p);
+}
+
+int avPlaybackGetStats(int nAVChannelID, AVPlaybackStats *pStats)
+{
+	Player *p = (Player *)ext_table_get(&gPlayers, nAVChannelID);
+
+	if (p == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&p->lock);
+	*pStats = p->stats;
+	pthread_mutex_unlock(&p->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,376 @@
+/*! \file av_preroll.c
+Pre-roll buffers, see AVPreRollAPIs.h.
+
+Frames are stored whole, frame info first, in a byte arena used as a ring:
+a frame that does not fit before the end of the arena goes to its start.
+A ring of slots describes them in order, the oldest at head. Frames leave
+only a GOP at a time, so the oldest frame is always a keyframe. A clip
+pins the frames from its first sequence number on; since clips start on a
+keyframe, the GOP at head is pinned exactly when its keyframe is.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "AVPreRollAPIs.h"
+#include "ext_table.h"
+
+#define PREROLL_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+typedef struct PreRollSlot {
+	size_t offset;
+	int size;
+	int info_size;
+	unsigned long long ts;
+	int key;
+} PreRollSlot;
+
+typedef struct PreRoll {
+	pthread_mutex_t lock;
+	unsigned char *arena;
+	size_t arena_size;
+	PreRollSlot *slots;
+	unsigned int slot_count;
+	unsigned int head;
+	unsigned int count;
+	unsigned long long head_seq;
+	size_t write_pos;
+	int need_key;
+	unsigned int config_ms;
+	unsigned int max_gop_ms;
+	unsigned int pre_roll_ms;
+	// First sequence number pinned by each clip, 0 if the entry is free
+	unsigned long long pins[AV_PREROLL_MAX_CLIPS];
+	AVPreRollStats stats;
+} PreRoll;
+
+typedef struct PreRollClip {
+	AVPreRollClip clip;
+	PreRoll *owner;
+	int pin;
+	AVPreRollFrame frames[];
+} PreRollClip;
+
+static ExtTable gPreRolls = EXT_TABLE_INITIALIZER;
+
+static unsigned int preroll_window_ms(unsigned int config_ms, const VSaaSContractInfo *c)
+{
+	unsigned int max_ms = c->event_recording_max_sec * 1000;
+
+	if (c->event_recording_max_sec > 0 && max_ms < config_ms)
+		return max_ms;
+	return config_ms;
+}
+
+// Caller holds p->lock
+static PreRollSlot *preroll_slot(PreRoll *p, unsigned int i)
+{
+	return &p->slots[(p->head + i) % p->slot_count];
+}
+
+// Caller holds p->lock. Sequence numbers start at 1 so that 0 marks a free pin.
+static int preroll_pinned(PreRoll *p, unsigned long long seq)
+{
+	int i;
+
+	for (i = 0; i < AV_PREROLL_MAX_CLIPS; i++) {
+		if (p->pins[i] != 0 && p->pins[i] <= seq)
+			return 1;
+	}
+	return 0;
+}
+
+// Caller holds p->lock. Drops the GOP at head; returns -1 if a clip pins it.
+static int preroll_evict_gop(PreRoll *p)
+{
+	if (p->count == 0 || preroll_pinned(p, p->head_seq))
+		return -1;
+	do {
+		p->stats.usedBytes -= (unsigned int)PREROLL_ALIGN((size_t)preroll_slot(p, 0)->size +
+														  (size_t)preroll_slot(p, 0)->info_size);
+		p->head = (p->head + 1) % p->slot_count;
+		p->head_seq++;
+		p->count--;
+	} while (p->count > 0 && !preroll_slot(p, 0)->key);
+	if (p->count == 0)
+		p->write_pos = 0;
+	return 0;
+}
+
+// Caller holds p->lock. Returns where len bytes fit, or -1 if they do not without evicting.
+static long preroll_place(PreRoll *p, size_t len)
+{
+	size_t tail;
+
+	if (p->count == p->slot_count)
+		return -1;
+	if (p->count == 0)
+		return len <= p->arena_size ? 0 : -1;
+	tail = preroll_slot(p, 0)->offset;
+	if (p->write_pos > tail) {
+		if (p->write_pos + len <= p->arena_size)
+			return (long)p->write_pos;
+		return len <= tail ? 0 : -1;
+	}
+	return p->write_pos + len <= tail ? (long)p->write_pos : -1;
+}
+
+// Caller holds p->lock. Drops GOPs wholly before the window, unless pinned.
+static void preroll_trim(PreRoll *p)
+{
+	unsigned long long newest;
+	unsigned int i;
+
+	if (p->count == 0)
+		return;
+	newest = preroll_slot(p, p->count - 1)->ts;
+	while (p->count > 1 && newest - preroll_slot(p, 0)->ts > p->pre_roll_ms) {
+		// Find the next keyframe; the head GOP goes only if that one is old enough
+		for (i = 1; i < p->count && !preroll_slot(p, i)->key; i++)
+			;
+		if (i == p->count || newest - preroll_slot(p, i)->ts < p->pre_roll_ms)
+			break;
+		if (preroll_evict_gop(p) < 0)
+			break;
+	}
+}
+
+static void preroll_free(PreRoll *p)
+{
+	pthread_mutex_destroy(&p->lock);
+	free(p->arena);
+	free(p->slots);
+	free(p);
+}
+
+int avPreRollCreate(const VSaaSContractInfo *pContract, const AVPreRollConfig *pConfig)
+{
+	AVPreRollConfig config = { sizeof(AVPreRollConfig), AV_PREROLL_DEFAULT_SEC, AV_PREROLL_DEFAULT_MAX_GOP, 0 };
+	unsigned long long kbps, fps, span_ms, frames, bytes;
+	PreRoll *p;
+	int id;
+
+	if (pContract == NULL || (pConfig != NULL && pConfig->cb != sizeof(AVPreRollConfig)))
+		return AV_ER_INVALID_ARG;
+	if (pConfig != NULL) {
+		config.reserveBytes = pConfig->reserveBytes;
+		if (pConfig->preRollSec > 0)
+			config.preRollSec = pConfig->preRollSec;
+		if (pConfig->maxGopMs > 0)
+			config.maxGopMs = pConfig->maxGopMs;
+	}
+	if (config.preRollSec > UINT_MAX / 1000)
+		return AV_ER_INVALID_ARG;
+
+	p = (PreRoll *)calloc(1, sizeof(PreRoll));
+	if (p == NULL)
+		return AV_ER_MEM_INSUFF;
+	pthread_mutex_init(&p->lock, NULL);
+	p->config_ms = config.preRollSec * 1000;
+	p->max_gop_ms = config.maxGopMs;
+	p->pre_roll_ms = preroll_window_ms(p->config_ms, pContract);
+	p->head_seq = 1;
+
+	// Room for the pre-roll plus the GOP that starts before it, with headroom
+	kbps = pContract->recording_max_kbps > 0 ? pContract->recording_max_kbps : AV_PREROLL_DEFAULT_KBPS;
+	fps = pContract->video_max_fps > 0 ? pContract->video_max_fps : AV_PREROLL_DEFAULT_FPS;
+	span_ms = (unsigned long long)p->pre_roll_ms + p->max_gop_ms;
+	frames = fps * span_ms / 1000 * AV_PREROLL_HEADROOM / 100 + 1;
+	bytes = kbps * 125 * span_ms / 1000 * AV_PREROLL_HEADROOM / 100;
+	if (bytes < config.reserveBytes) {
+		frames = frames * config.reserveBytes / (bytes > 0 ? bytes : 1);
+		bytes = config.reserveBytes;
+	}
+	if (bytes > INT_MAX || frames > INT_MAX / sizeof(PreRollSlot)) {
+		preroll_free(p);
+		return AV_ER_INVALID_ARG;
+	}
+	p->arena_size = (size_t)bytes;
+	p->slot_count = (unsigned int)frames;
+	p->arena = (unsigned char *)malloc(p->arena_size);
+	p->slots = (PreRollSlot *)calloc(p->slot_count, sizeof(PreRollSlot));
+	if (p->arena == NULL || p->slots == NULL) {
+		preroll_free(p);
+		return AV_ER_MEM_INSUFF;
+	}
+	p->stats.capacityBytes = (unsigned int)p->arena_size;
+	p->stats.capacityFrames = p->slot_count;
+	p->stats.targetMs = p->pre_roll_ms;
+
+	id = ext_table_add(&gPreRolls, p);
+	if (id < 0) {
+		preroll_free(p);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avPreRollDestroy(int nPreRollID)
+{
+	PreRoll *p = (PreRoll *)ext_table_take(&gPreRolls, nPreRollID);
+
+	if (p != NULL)
+		preroll_free(p);
+}
+
+int avPreRollUpdateContract(int nPreRollID, const VSaaSContractInfo *pContract)
+{
+	PreRoll *p = (PreRoll *)ext_table_get(&gPreRolls, nPreRollID);
+
+	if (p == NULL || pContract == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&p->lock);
+	p->pre_roll_ms = preroll_window_ms(p->config_ms, pContract);
+	p->stats.targetMs = p->pre_roll_ms;
+	preroll_trim(p);
+	pthread_mutex_unlock(&p->lock);
+	return AV_ER_NoERROR;
+}
+
+int avPreRollWrite(int nPreRollID, const char *cabFrameData, int nFrameDataSize, const void *cabFrameInfo,
+				   int nFrameInfoSize, unsigned long long nTimestampMs, int bKeyFrame)
+{
+	PreRoll *p = (PreRoll *)ext_table_get(&gPreRolls, nPreRollID);
+	PreRollSlot *s;
+	size_t len;
+	long pos;
+	int ret = AV_ER_NoERROR;
+
+	if (p == NULL || cabFrameData == NULL || nFrameDataSize <= 0 || nFrameInfoSize < 0 ||
+		(nFrameInfoSize > 0 && cabFrameInfo == NULL))
+		return AV_ER_INVALID_ARG;
+	len = PREROLL_ALIGN((size_t)nFrameDataSize + (size_t)nFrameInfoSize);
+
+	pthread_mutex_lock(&p->lock);
+	if (bKeyFrame)
+		p->need_key = 0;
+	if (p->need_key || (p->count == 0 && !bKeyFrame)) {
+		ret = AV_ER_WAIT_KEY_FRAME;
+		goto drop;
+	}
+	while ((pos = preroll_place(p, len)) < 0) {
+		if (len > p->arena_size || preroll_evict_gop(p) < 0) {
+			ret = AV_ER_EXCEED_MAX_SIZE;
+			goto drop;
+		}
+	}
+	if (p->count == 0 && !bKeyFrame) {
+		// This frame's own GOP had to go to make room
+		ret = AV_ER_WAIT_KEY_FRAME;
+		goto drop;
+	}
+
+	s = preroll_slot(p, p->count);
+	s->offset = (size_t)pos;
+	s->size = nFrameDataSize;
+	s->info_size = nFrameInfoSize;
+	s->ts = nTimestampMs;
+	s->key = bKeyFrame ? 1 : 0;
+	if (nFrameInfoSize > 0)
+		memcpy(p->arena + pos, cabFrameInfo, (size_t)nFrameInfoSize);
+	memcpy(p->arena + pos + nFrameInfoSize, cabFrameData, (size_t)nFrameDataSize);
+	p->write_pos = (size_t)pos + len;
+	p->count++;
+	p->stats.usedBytes += (unsigned int)len;
+	preroll_trim(p);
+	pthread_mutex_unlock(&p->lock);
+	return AV_ER_NoERROR;
+
+drop:
+	// Frames after a dropped one cannot be decoded without it
+	p->need_key = 1;
+	p->stats.droppedFrames++;
+	pthread_mutex_unlock(&p->lock);
+	return ret;
+}
+
+int avPreRollCapture(int nPreRollID, AVPreRollClip **ppClip)
+{
+	PreRoll *p = (PreRoll *)ext_table_get(&gPreRolls, nPreRollID);
+	PreRollClip *c;
+	PreRollSlot *s;
+	unsigned long long newest;
+	unsigned int first = 0, i, n;
+	int pin;
+
+	if (p == NULL || ppClip == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&p->lock);
+	if (p->count == 0) {
+		pthread_mutex_unlock(&p->lock);
+		return AV_ER_DATA_NOREADY;
+	}
+	for (pin = 0; pin < AV_PREROLL_MAX_CLIPS && p->pins[pin] != 0; pin++)
+		;
+	if (pin == AV_PREROLL_MAX_CLIPS) {
+		pthread_mutex_unlock(&p->lock);
+		return AV_ER_EXCEED_MAX_CHANNEL;
+	}
+
+	// The last keyframe at least pre_roll_ms old, else the oldest frame
+	newest = preroll_slot(p, p->count - 1)->ts;
+	for (i = 1; i < p->count; i++) {
+		s = preroll_slot(p, i);
+		if (newest - s->ts < p->pre_roll_ms)
+			break;
+		if (s->key)
+			first = i;
+	}
+	n = p->count - first;
+	c = (PreRollClip *)malloc(sizeof(PreRollClip) + n * sizeof(AVPreRollFrame));
+	if (c == NULL) {
+		pthread_mutex_unlock(&p->lock);
+		return AV_ER_MEM_INSUFF;
+	}
+	c->owner = p;
+	c->pin = pin;
+	c->clip.frameCount = n;
+	c->clip.frames = c->frames;
+	c->clip.totalBytes = 0;
+	for (i = 0; i < n; i++) {
+		s = preroll_slot(p, first + i);
+		c->frames[i].info = s->info_size > 0 ? p->arena + s->offset : NULL;
+		c->frames[i].infoSize = s->info_size;
+		c->frames[i].data = (const char *)p->arena + s->offset + s->info_size;
+		c->frames[i].size = s->size;
+		c->frames[i].timestampMs = s->ts;
+		c->frames[i].bKeyFrame = s->key;
+		c->clip.totalBytes += (unsigned int)s->size;
+	}
+	c->clip.startTimeMs = c->frames[0].timestampMs;
+	c->clip.endTimeMs = c->frames[n - 1].timestampMs;
+	p->pins[pin] = p->head_seq + first;
+	p->stats.captures++;
+	pthread_mutex_unlock(&p->lock);
+
+	*ppClip = &c->clip;
+	return AV_ER_NoERROR;
+}
+
+void avPreRollClipRelease(AVPreRollClip *pClip)
+{
+	PreRollClip *c = (PreRollClip *)pClip;
+
+	if (c == NULL)
+		return;
+	pthread_mutex_lock(&c->owner->lock);
+	c->owner->pins[c->pin] = 0;
+	pthread_mutex_unlock(&c->owner->lock);
+	free(c);
+}
+
+int avPreRollGetStats(int nPreRollID, AVPreRollStats *pStats)
+{
+	PreRoll *p = (PreRoll *)ext_table_get(&gPreRolls, nPreRollID);
+
+	if (p == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&p->lock);
+	*pStats = p->stats;
+	pStats->frames = p->count;
+	pStats->windowMs = p->count > 0 ?
+		(unsigned int)(preroll_slot(p, p->count - 1)->ts - preroll_slot(p, 0)->ts) : 0;
+	pthread_mutex_unlock(&p->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,564 @@
+/*! \file av_recorder.c
+Segment recorders, see AVRecorderAPIs.h.
+
+The recording thread only copies into the mapping of the current segment
+and bumps data_end. Everything that can block is left to the writer thread:
+msync, dropping pages, creating the spare segment and finalizing full ones.
+The writer only touches bytes below the data_end it read under the lock, so
+the copies run without the lock. A spare is created by one thread at a time,
+which keeps the segment numbers in file order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "AVRecorderAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+
+#define REC_ALIGN(n)	(((n) + AV_REC_ALIGN - 1) & ~(size_t)(AV_REC_ALIGN - 1))
+
+typedef struct RecSegment {
+	int fd;
+	unsigned char *base;
+	size_t size;
+	unsigned int no;
+	char *path;
+	// Written by the recording thread under the recorder lock
+	size_t data_end;
+	unsigned int index_count;
+	unsigned long long start_ms;
+	unsigned long long end_ms;
+	// How far the writer thread has flushed
+	size_t flushed_end;
+	unsigned int flushed_index;
+	struct RecSegment *next;
+} RecSegment;
+
+typedef struct Recorder {
+	AVRecorderConfig config;
+	char *dir;
+	char *prefix;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	RecSegment *cur;
+	RecSegment *spare;
+	int spare_pending;
+	RecSegment *finished;
+	unsigned int next_no;
+	int closing;
+	int closed;
+	AVRecorderStats stats;
+	struct Recorder *link;
+} Recorder;
+
+static ExtTable gRecorders = EXT_TABLE_INITIALIZER;
+
+// The writer thread serves every recorder on gRecList and exits once the list is empty
+static pthread_mutex_t gRecWriterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gRecWriterCond = PTHREAD_COND_INITIALIZER;
+static Recorder *gRecList;
+static int gRecWriterRunning;
+static int gRecWriterKicked;
+
+static size_t rec_page_size(void)
+{
+	static size_t page;
+
+	if (page == 0)
+		page = (size_t)sysconf(_SC_PAGESIZE);
+	return page;
+}
+
+static unsigned long long rec_wall_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+}
+
+static AVRecIndexEntry *rec_index_entry(const RecSegment *s, unsigned int i)
+{
+	return (AVRecIndexEntry *)(s->base + s->size - (size_t)(i + 1) * sizeof(AVRecIndexEntry));
+}
+
+// Let the kernel write back [start, end) and forget the pages, which bounds the page cache per stream
+static int rec_flush_range(RecSegment *s, size_t start, size_t end, int drop)
+{
+	size_t page = rec_page_size(), first = start & ~(page - 1), last = end & ~(page - 1);
+
+	if (end <= start)
+		return 0;
+	if (msync(s->base + first, end - first, MS_SYNC) < 0)
+		return -1;
+	if (drop && last > first) {
+		madvise(s->base + first, last - first, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+		posix_fadvise(s->fd, (off_t)first, (off_t)(last - first), POSIX_FADV_DONTNEED);
+#endif
+	}
+	return 0;
+}
+
+static void rec_segment_free(RecSegment *s)
+{
+	if (s->base != NULL)
+		munmap(s->base, s->size);
+	if (s->fd >= 0)
+		close(s->fd);
+	free(s->path);
+	free(s);
+}
+
+static RecSegment *rec_segment_create(const Recorder *r, unsigned int no)
+{
+	RecSegment *s = (RecSegment *)calloc(1, sizeof(RecSegment));
+	AVRecSegmentHeader *h;
+	int len;
+
+	if (s == NULL)
+		return NULL;
+	s->fd = -1;
+	s->size = r->config.segmentSize;
+	s->no = no;
+	len = snprintf(NULL, 0, AV_REC_SEGMENT_NAME_FORMAT, r->dir, r->prefix, no);
+	s->path = (char *)malloc((size_t)len + 1);
+	if (s->path == NULL) {
+		rec_segment_free(s);
+		return NULL;
+	}
+	snprintf(s->path, (size_t)len + 1, AV_REC_SEGMENT_NAME_FORMAT, r->dir, r->prefix, no);
+
+	s->fd = open(s->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (s->fd < 0)
+		goto fail;
+#if defined(__linux__)
+	// Reserve the blocks now so the mapping cannot fault with SIGBUS on a full disk
+	if (posix_fallocate(s->fd, 0, (off_t)s->size) != 0 && ftruncate(s->fd, (off_t)s->size) < 0)
+		goto fail;
+#else
+	if (ftruncate(s->fd, (off_t)s->size) < 0)
+		goto fail;
+#endif
+	s->base = (unsigned char *)mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->base == MAP_FAILED) {
+		s->base = NULL;
+		goto fail;
+	}
+
+	h = (AVRecSegmentHeader *)s->base;
+	h->magic = AV_REC_SEGMENT_MAGIC;
+	h->version = AV_REC_SEGMENT_VERSION;
+	h->segmentNo = no;
+	h->dataEnd = sizeof(AVRecSegmentHeader);
+	h->indexOffset = s->size;
+	s->data_end = sizeof(AVRecSegmentHeader);
+	s->flushed_end = 0;
+	return s;
+
+fail:
+	if (s->fd >= 0)
+		unlink(s->path);
+	rec_segment_free(s);
+	return NULL;
+}
+
+// Writer thread. Flush what the recording thread has written up to data_end and index_count;
+// the caller then moves flushed_end and flushed_index there.
+static int rec_segment_flush(RecSegment *s, size_t data_end, unsigned int index_count,
+							 unsigned long long start_ms, unsigned long long end_ms)
+{
+	AVRecSegmentHeader *h = (AVRecSegmentHeader *)s->base;
+	size_t index_start = s->size - (size_t)index_count * sizeof(AVRecIndexEntry);
+	size_t index_end = s->size - (size_t)s->flushed_index * sizeof(AVRecIndexEntry);
+	int ret = 0;
+
+	if (rec_flush_range(s, s->flushed_end, data_end, 1) < 0 ||
+		rec_flush_range(s, index_start, index_end, 0) < 0)
+		ret = -1;
+	// The header goes last, so it never claims records that are not on disk yet
+	h->startTimeMs = start_ms;
+	h->endTimeMs = end_ms;
+	h->dataEnd = data_end;
+	h->indexCount = index_count;
+	if (msync(s->base, rec_page_size(), MS_SYNC) < 0)
+		ret = -1;
+	return ret;
+}
+
+// Writer thread. Move the index after the records, mark the segment complete, trim the file and release it.
+// An empty segment is removed.
+static int rec_segment_finish(RecSegment *s)
+{
+	AVRecSegmentHeader *h = (AVRecSegmentHeader *)s->base;
+	size_t index_offset = REC_ALIGN(s->data_end), index_bytes = (size_t)s->index_count * sizeof(AVRecIndexEntry);
+	AVRecIndexEntry *index;
+	unsigned int i;
+	int ret = 0;
+
+	if (s->index_count == 0) {
+		unlink(s->path);
+		rec_segment_free(s);
+		return 0;
+	}
+	if (rec_segment_flush(s, s->data_end, s->index_count, s->start_ms, s->end_ms) < 0)
+		ret = -1;
+
+	// The two areas can overlap in a full segment, so go through a copy
+	index = (AVRecIndexEntry *)malloc(index_bytes);
+	if (index == NULL) {
+		// Leave it incomplete; the index at the end of the file is still valid
+		rec_segment_free(s);
+		return -1;
+	}
+	for (i = 0; i < s->index_count; i++)
+		index[i] = *rec_index_entry(s, i);
+	memset(s->base + s->data_end, 0, index_offset - s->data_end);
+	memcpy(s->base + index_offset, index, index_bytes);
+	free(index);
+	if (msync(s->base + (s->data_end & ~(rec_page_size() - 1)),
+			  index_offset + index_bytes - (s->data_end & ~(rec_page_size() - 1)), MS_SYNC) < 0)
+		ret = -1;
+	h->indexOffset = index_offset;
+	h->flags |= AV_REC_SEGMENT_COMPLETE;
+	if (msync(s->base, rec_page_size(), MS_SYNC) < 0)
+		ret = -1;
+
+	munmap(s->base, s->size);
+	s->base = NULL;
+	if (ftruncate(s->fd, (off_t)(index_offset + index_bytes)) < 0 || fsync(s->fd) < 0)
+		ret = -1;
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(s->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	rec_segment_free(s);
+	return ret;
+}
+
+static void rec_writer_kick(void)
+{
+	pthread_mutex_lock(&gRecWriterLock);
+	gRecWriterKicked = 1;
+	pthread_cond_signal(&gRecWriterCond);
+	pthread_mutex_unlock(&gRecWriterLock);
+}
+
+// Writer thread. Returns 1 once a closing recorder is done.
+static int rec_writer_serve(Recorder *r)
+{
+	RecSegment *finished, *cur, *spare = NULL, *next;
+	size_t data_end;
+	unsigned int index_count, no = 0;
+	unsigned long long start_ms, end_ms;
+	int closing, make_spare, failed = 0;
+
+	pthread_mutex_lock(&r->lock);
+	finished = r->finished;
+	r->finished = NULL;
+	cur = r->cur;
+	data_end = cur->data_end;
+	index_count = cur->index_count;
+	start_ms = cur->start_ms;
+	end_ms = cur->end_ms;
+	closing = r->closing;
+	// Have the next segment ready by the time the current one is half full
+	make_spare = !closing && r->spare == NULL && !r->spare_pending && data_end > cur->size / 2;
+	if (make_spare) {
+		r->spare_pending = 1;
+		no = r->next_no++;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	for (; finished != NULL; finished = next) {
+		next = finished->next;
+		if (rec_segment_finish(finished) < 0)
+			failed = 1;
+	}
+	if (data_end > cur->flushed_end || index_count > cur->flushed_index) {
+		if (rec_segment_flush(cur, data_end, index_count, start_ms, end_ms) < 0)
+			failed = 1;
+		pthread_mutex_lock(&r->lock);
+		cur->flushed_end = data_end;
+		cur->flushed_index = index_count;
+		r->stats.flushes++;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+	if (make_spare)
+		spare = rec_segment_create(r, no);
+
+	pthread_mutex_lock(&r->lock);
+	if (make_spare) {
+		r->spare = spare;
+		r->spare_pending = 0;
+		if (spare == NULL)
+			failed = 1;
+	}
+	if (failed)
+		r->stats.lastError = AV_ER_RECORDER_IO_FAIL;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+
+	if (!closing)
+		return 0;
+	// avRecorderClose() comes from the recording thread, so nothing writes any more
+	if (rec_segment_finish(r->cur) < 0)
+		r->stats.lastError = AV_ER_RECORDER_IO_FAIL;
+	r->cur = NULL;
+	if (r->spare != NULL)
+		rec_segment_finish(r->spare);
+	r->spare = NULL;
+	return 1;
+}
+
+static void *rec_writer_thread(void *arg)
+{
+	Recorder **pp, *r;
+	int done;
+
+	(void)arg;
+	pthread_mutex_lock(&gRecWriterLock);
+	while (gRecList != NULL) {
+		if (!gRecWriterKicked)
+			ext_cond_wait_ms(&gRecWriterCond, &gRecWriterLock, AV_REC_FLUSH_INTERVAL);
+		gRecWriterKicked = 0;
+		// Only this thread removes recorders, so they stay valid while the lock is released
+		pp = &gRecList;
+		while ((r = *pp) != NULL) {
+			pthread_mutex_unlock(&gRecWriterLock);
+			done = rec_writer_serve(r);
+			pthread_mutex_lock(&gRecWriterLock);
+			if (!done) {
+				pp = &r->link;
+				continue;
+			}
+			*pp = r->link;
+			pthread_mutex_lock(&r->lock);
+			r->closed = 1;
+			pthread_cond_broadcast(&r->cond);
+			pthread_mutex_unlock(&r->lock);
+		}
+	}
+	gRecWriterRunning = 0;
+	pthread_mutex_unlock(&gRecWriterLock);
+	return NULL;
+}
+
+static void rec_free(Recorder *r)
+{
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->lock);
+	free(r->dir);
+	free(r->prefix);
+	free(r);
+}
+
+int avRecorderCreate(const AVRecorderConfig *pConfig)
+{
+	Recorder *r;
+	pthread_t thread;
+	int id;
+
+	if (pConfig == NULL || pConfig->cb != sizeof(AVRecorderConfig) || pConfig->pszDirectory == NULL ||
+		pConfig->pszPrefix == NULL || (pConfig->segmentSize != 0 && pConfig->segmentSize < AV_REC_MIN_SEGMENT_SIZE))
+		return AV_ER_INVALID_ARG;
+
+	r = (Recorder *)calloc(1, sizeof(Recorder));
+	if (r == NULL)
+		return AV_ER_MEM_INSUFF;
+	r->config = *pConfig;
+	if (r->config.segmentSize == 0)
+		r->config.segmentSize = AV_REC_DEFAULT_SEGMENT_SIZE;
+	// The index entries hold 32-bit offsets and must stay aligned at the end of the file
+	r->config.segmentSize &= ~(unsigned int)(AV_REC_ALIGN - 1);
+	if (r->config.maxDirtyBytes == 0)
+		r->config.maxDirtyBytes = AV_REC_DEFAULT_MAX_DIRTY;
+	r->dir = strdup(pConfig->pszDirectory);
+	r->prefix = strdup(pConfig->pszPrefix);
+	r->config.pszDirectory = r->dir;
+	r->config.pszPrefix = r->prefix;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	if (r->dir == NULL || r->prefix == NULL) {
+		rec_free(r);
+		return AV_ER_MEM_INSUFF;
+	}
+
+	r->cur = rec_segment_create(r, r->next_no++);
+	if (r->cur == NULL) {
+		rec_free(r);
+		return AV_ER_RECORDER_IO_FAIL;
+	}
+	r->stats.segments = 1;
+
+	id = ext_table_add(&gRecorders, r);
+	if (id < 0) {
+		rec_segment_finish(r->cur);
+		rec_free(r);
+		return AV_ER_MEM_INSUFF;
+	}
+
+	pthread_mutex_lock(&gRecWriterLock);
+	if (!gRecWriterRunning) {
+		if (pthread_create(&thread, NULL, rec_writer_thread, NULL) != 0) {
+			pthread_mutex_unlock(&gRecWriterLock);
+			ext_table_take(&gRecorders, id);
+			rec_segment_finish(r->cur);
+			rec_free(r);
+			return AV_ER_FAIL_CREATE_THREAD;
+		}
+		pthread_detach(thread);
+		gRecWriterRunning = 1;
+	}
+	r->link = gRecList;
+	gRecList = r;
+	pthread_mutex_unlock(&gRecWriterLock);
+	return id;
+}
+
+// Caller holds r->lock. Make the spare, or a new segment if there is none, the current one.
+static int rec_rotate_locked(Recorder *r)
+{
+	RecSegment *s, **pp;
+	unsigned int no;
+
+	while (r->spare == NULL && r->spare_pending)
+		pthread_cond_wait(&r->cond, &r->lock);
+	s = r->spare;
+	r->spare = NULL;
+	if (s == NULL) {
+		no = r->next_no++;
+		pthread_mutex_unlock(&r->lock);
+		s = rec_segment_create(r, no);
+		pthread_mutex_lock(&r->lock);
+		if (s == NULL)
+			return AV_ER_RECORDER_IO_FAIL;
+		r->stats.syncSegmentCreates++;
+	}
+	for (pp = &r->finished; *pp != NULL; pp = &(*pp)->next)
+		;
+	*pp = r->cur;
+	r->cur = s;
+	r->stats.segments++;
+	r->stats.currentSegment = s->no;
+	return AV_ER_NoERROR;
+}
+
+int avRecorderWrite(int nRecorderID, const char *cabFrameData, int nFrameDataSize,
+					const void *cabFrameInfo, int nFrameInfoSize, unsigned long long nTimestampMs,
+					int bKeyFrame)
+{
+	Recorder *r = (Recorder *)ext_table_get(&gRecorders, nRecorderID);
+	AVRecFrameHeader fh;
+	AVRecIndexEntry *entry;
+	RecSegment *s;
+	size_t rec_size, used;
+	unsigned char *p;
+	int ret, kick = 0, waited = 0, full, expired;
+
+	if (r == NULL || cabFrameData == NULL || nFrameDataSize <= 0 || nFrameInfoSize < 0 || nFrameInfoSize > 0xFFFF ||
+		(nFrameInfoSize > 0 && cabFrameInfo == NULL))
+		return AV_ER_INVALID_ARG;
+	rec_size = REC_ALIGN(sizeof(AVRecFrameHeader) + (size_t)nFrameInfoSize + (size_t)nFrameDataSize);
+	if (rec_size + sizeof(AVRecSegmentHeader) + sizeof(AVRecIndexEntry) > r->config.segmentSize)
+		return AV_ER_EXCEED_MAX_SIZE;
+	if (nTimestampMs == 0)
+		nTimestampMs = rec_wall_ms();
+
+	pthread_mutex_lock(&r->lock);
+	s = r->cur;
+	// The index grows down from the end, one more entry for this frame
+	used = s->data_end + (size_t)s->index_count * sizeof(AVRecIndexEntry);
+	full = used + sizeof(AVRecIndexEntry) + rec_size > s->size;
+	expired = r->config.segmentDurationMs != 0 && bKeyFrame && s->index_count > 0 &&
+			  nTimestampMs - s->start_ms >= r->config.segmentDurationMs;
+	if (full || expired) {
+		ret = rec_rotate_locked(r);
+		if (ret < 0) {
+			pthread_mutex_unlock(&r->lock);
+			return ret;
+		}
+		s = r->cur;
+		kick = 1;
+	}
+	while (s->data_end - s->flushed_end > r->config.maxDirtyBytes) {
+		if (!waited) {
+			r->stats.writerWaits++;
+			waited = 1;
+		}
+		pthread_mutex_unlock(&r->lock);
+		rec_writer_kick();
+		pthread_mutex_lock(&r->lock);
+		if (s->data_end - s->flushed_end > r->config.maxDirtyBytes)
+			ext_cond_wait_ms(&r->cond, &r->lock, AV_REC_FLUSH_INTERVAL);
+	}
+	if (s->index_count == 0)
+		s->start_ms = nTimestampMs;
+	pthread_mutex_unlock(&r->lock);
+	if (kick)
+		rec_writer_kick();
+
+	// The writer thread stays below data_end, so the copy needs no lock
+	fh.size = (unsigned int)nFrameDataSize;
+	fh.infoSize = (unsigned short)nFrameInfoSize;
+	fh.flags = bKeyFrame ? AV_REC_FRAME_KEY : 0;
+	fh.timestampMs = nTimestampMs;
+	p = s->base + s->data_end;
+	memcpy(p, &fh, sizeof(fh));
+	p += sizeof(fh);
+	if (nFrameInfoSize > 0)
+		memcpy(p, cabFrameInfo, (size_t)nFrameInfoSize);
+	p += nFrameInfoSize;
+	memcpy(p, cabFrameData, (size_t)nFrameDataSize);
+	p += nFrameDataSize;
+	memset(p, 0, (size_t)(s->base + s->data_end + rec_size - p));
+	entry = rec_index_entry(s, s->index_count);
+	entry->timeOffsetMs = (unsigned int)(nTimestampMs > s->start_ms ? nTimestampMs - s->start_ms : 0);
+	entry->offset = (unsigned int)s->data_end;
+	entry->flags = fh.flags;
+
+	pthread_mutex_lock(&r->lock);
+	s->data_end += rec_size;
+	s->index_count++;
+	s->end_ms = nTimestampMs;
+	r->stats.frames++;
+	r->stats.bytes += rec_size;
+	pthread_mutex_unlock(&r->lock);
+	return AV_ER_NoERROR;
+}
+
+void avRecorderClose(int nRecorderID)
+{
+	Recorder *r = (Recorder *)ext_table_take(&gRecorders, nRecorderID);
+
+	if (r == NULL)
+		return;
+	pthread_mutex_lock(&r->lock);
+	r->closing = 1;
+	pthread_mutex_unlock(&r->lock);
+	rec_writer_kick();
+	pthread_mutex_lock(&r->lock);
+	while (!r->closed)
+		pthread_cond_wait(&r->cond, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+	rec_free(r);
+}
+
+int avRecorderGetStats(int nRecorderID, AVRecorderStats *pStats)
+{
+	Recorder *r = (Recorder *)ext_table_get(&gRecorders, nRecorderID);
+
+	if (r == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&r->lock);
+	*pStats = r->stats;
+	pthread_mutex_unlock(&r->lock);
+	return AV_ER_NoERROR;
+}
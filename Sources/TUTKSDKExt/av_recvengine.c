@@ -0,0 +1,655 @@
+/*! \file av_recvengine.c
+Receive engines, see AVRecvEngineAPIs.h.
+
+A stream is in exactly one place at a time: the run queue of a worker, the
+timer heap, being run by a worker, or nowhere once its AV channel is
+closed. All of that is under the engine lock, which a worker takes twice
+per turn; the turn itself, up to burst calls of avRecvFrameDataPooled(),
+runs without it. The decoder queue of a stream has its own lock, which may
+be taken under the engine lock but not the other way round.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVRecvEngineAPIs.h"
+#include "ext_platform.h"
+#include "ext_table.h"
+#include "ext_av.h"
+
+// Idle streams due within this many milliseconds of each other are polled on the same wakeup
+#define RECV_COALESCE_MS		2
+
+// How a turn ended
+#define RECV_TURN_MORE			0 // Received burst frames, there may be more
+#define RECV_TURN_IDLE			1
+#define RECV_TURN_CLOSED		2
+
+struct RecvEngine;
+
+typedef struct RecvStream {
+	struct RecvStream *next; // In the stream list of the engine
+	struct RecvStream *run_next; // In a run queue
+	struct RecvEngine *e;
+	int av_index;
+	int flag_offset;
+	unsigned int max_queue;
+	avRecvReadyFn ready_fn;
+	void *user;
+	// Under the engine lock
+	int heap_index; // -1 if not in the timer heap
+	int run_queue; // The worker whose run queue holds the stream, -1 if none
+	int running;
+	int removed;
+	unsigned int delay_ms;
+	uint64_t due_ms;
+	// Under the stream lock
+	pthread_mutex_t lock;
+	pthread_cond_t cond; // Signalled when a frame is queued or the stream is closed or removed
+	AVFrame **ring;
+	unsigned int head;
+	unsigned int count;
+	int skipping; // Dropping frames up to the next keyframe
+	int notified; // The ready callback was called and the queue has not been emptied since
+	int error; // The error which closed the AV channel, 0 if none
+	int gone; // Removed, avRecvEngineGetFrame() must not wait
+	int waiters;
+	AVRecvStreamStats stats;
+} RecvStream;
+
+typedef struct RecvWorker {
+	struct RecvEngine *e;
+	int index;
+	pthread_t thread;
+	RecvStream *run_head, *run_tail;
+} RecvWorker;
+
+typedef struct RecvEngine {
+	unsigned int burst;
+	unsigned int max_idle_ms;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond; // Signalled when streams are runnable or due earlier
+	pthread_cond_t done_cond; // Signalled when a removed stream stops being run
+	int stop;
+	unsigned int idle_workers;
+	unsigned int worker_count;
+	RecvWorker workers[AV_RECV_ENGINE_MAX_WORKERS];
+	RecvStream **heap; // Min-heap by due_ms
+	int heap_size;
+	int heap_cap;
+	RecvStream *streams;
+	AVRecvEngineStats stats;
+} RecvEngine;
+
+static ExtTable gRecvEngines = EXT_TABLE_INITIALIZER;
+static ExtTable gRecvStreams = EXT_TABLE_INITIALIZER;
+
+/* ============================================================================
+ * Timer heap and run queues, all under the engine lock
+ * ============================================================================
+ */
+
+static void recv_heap_place(RecvEngine *e, RecvStream *s, int i)
+{
+	e->heap[i] = s;
+	s->heap_index = i;
+}
+
+static void recv_heap_up(RecvEngine *e, int i)
+{
+	RecvStream *s = e->heap[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (e->heap[parent]->due_ms <= s->due_ms)
+			break;
+		recv_heap_place(e, e->heap[parent], i);
+		i = parent;
+	}
+	recv_heap_place(e, s, i);
+}
+
+static void recv_heap_down(RecvEngine *e, int i)
+{
+	RecvStream *s = e->heap[i];
+	int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= e->heap_size)
+			break;
+		if (child + 1 < e->heap_size && e->heap[child + 1]->due_ms < e->heap[child]->due_ms)
+			child++;
+		if (s->due_ms <= e->heap[child]->due_ms)
+			break;
+		recv_heap_place(e, e->heap[child], i);
+		i = child;
+	}
+	recv_heap_place(e, s, i);
+}
+
+// Caller holds e->lock. The heap has room for every stream, see avRecvEngineAdd().
+static void recv_heap_push(RecvEngine *e, RecvStream *s)
+{
+	e->heap[e->heap_size] = s;
+	s->heap_index = e->heap_size++;
+	recv_heap_up(e, s->heap_index);
+	// Wake a sleeping worker if s is now the first one due
+	if (s->heap_index == 0 && e->idle_workers > 0)
+		pthread_cond_signal(&e->work_cond);
+}
+
+// Caller holds e->lock
+static void recv_heap_remove(RecvEngine *e, RecvStream *s)
+{
+	int i = s->heap_index;
+	RecvStream *last;
+
+	s->heap_index = -1;
+	last = e->heap[--e->heap_size];
+	if (last == s)
+		return;
+	recv_heap_place(e, last, i);
+	recv_heap_up(e, i);
+	recv_heap_down(e, last->heap_index);
+}
+
+// Caller holds e->lock
+static void recv_run_push(RecvWorker *w, RecvStream *s)
+{
+	s->run_next = NULL;
+	s->run_queue = w->index;
+	if (w->run_tail != NULL)
+		w->run_tail->run_next = s;
+	else
+		w->run_head = s;
+	w->run_tail = s;
+}
+
+// Caller holds e->lock
+static RecvStream *recv_run_pop(RecvWorker *w)
+{
+	RecvStream *s = w->run_head;
+
+	if (s == NULL)
+		return NULL;
+	w->run_head = s->run_next;
+	if (w->run_head == NULL)
+		w->run_tail = NULL;
+	s->run_next = NULL;
+	s->run_queue = -1;
+	return s;
+}
+
+// Caller holds e->lock
+static void recv_run_remove(RecvEngine *e, RecvStream *s)
+{
+	RecvWorker *w = &e->workers[s->run_queue];
+	RecvStream **pp;
+
+	for (pp = &w->run_head; *pp != NULL; pp = &(*pp)->run_next) {
+		if (*pp == s) {
+			*pp = s->run_next;
+			break;
+		}
+	}
+	w->run_tail = NULL;
+	for (pp = &w->run_head; *pp != NULL; pp = &(*pp)->run_next)
+		w->run_tail = *pp;
+	s->run_next = NULL;
+	s->run_queue = -1;
+}
+
+// Caller holds e->lock. Takes the next stream of w, or steals the longest waiting one of another worker.
+static RecvStream *recv_next(RecvEngine *e, RecvWorker *w)
+{
+	RecvStream *s = recv_run_pop(w);
+	unsigned int i;
+
+	for (i = 1; s == NULL && i < e->worker_count; i++) {
+		s = recv_run_pop(&e->workers[(w->index + i) % e->worker_count]);
+		if (s != NULL)
+			e->stats.steals++;
+	}
+	return s;
+}
+
+// Caller holds e->lock. Moves the streams due by now to the run queue of w and returns how many.
+static unsigned int recv_wake_due(RecvEngine *e, RecvWorker *w, uint64_t now)
+{
+	unsigned int n = 0;
+	RecvStream *s;
+
+	while (e->heap_size > 0 && e->heap[0]->due_ms <= now + RECV_COALESCE_MS) {
+		s = e->heap[0];
+		recv_heap_remove(e, s);
+		recv_run_push(w, s);
+		n++;
+	}
+	return n;
+}
+
+/* ============================================================================
+ * Decoder queues
+ * ============================================================================
+ */
+
+// Caller holds s->lock
+static void recv_queue_clear(RecvStream *s)
+{
+	while (s->count > 0) {
+		avFrameRelease(s->ring[s->head]);
+		s->head = (s->head + 1) % s->max_queue;
+		s->count--;
+		s->stats.dropped++;
+	}
+}
+
+// Queue a frame received by avRecvFrameDataPooled(), which returned ret. Returns 1 if the ready callback is due.
+static int recv_deliver(RecvStream *s, int ret, AVFrame *f)
+{
+	int known = s->flag_offset != AV_RECV_FLAG_OFFSET_NONE;
+	int key = known && f->infoSize > s->flag_offset && f->info[s->flag_offset] == 1;
+	int notify = 0;
+
+	pthread_mutex_lock(&s->lock);
+	s->stats.received++;
+	if (ret < 0) {
+		// An incomplete frame cannot be decoded, nor can what follows it up to a keyframe
+		s->stats.lastError = ret;
+		s->skipping = known;
+		s->stats.dropped++;
+		avFrameRelease(f);
+	} else if (s->skipping && !key) {
+		s->stats.dropped++;
+		avFrameRelease(f);
+	} else {
+		s->skipping = 0;
+		if (s->count == s->max_queue) {
+			// The decoder fell behind: with keyframes known, jump to live at the next one
+			if (known) {
+				recv_queue_clear(s);
+				s->skipping = !key;
+			} else {
+				avFrameRelease(s->ring[s->head]);
+				s->head = (s->head + 1) % s->max_queue;
+				s->count--;
+				s->stats.dropped++;
+			}
+		}
+		if (s->skipping) {
+			s->stats.dropped++;
+			avFrameRelease(f);
+		} else {
+			s->ring[(s->head + s->count) % s->max_queue] = f;
+			s->count++;
+			pthread_cond_signal(&s->cond);
+			if (!s->notified && s->ready_fn != NULL) {
+				s->notified = 1;
+				notify = 1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	return notify;
+}
+
+// Run one turn of s without the engine lock. *pFrames is set to the frames received.
+static int recv_turn(RecvEngine *e, RecvStream *s, unsigned int *pFrames)
+{
+	unsigned int n;
+	AVFrame *f;
+	int ret;
+
+	for (n = 0; n < e->burst; n++) {
+		ret = avRecvFrameDataPooled(s->av_index, &f);
+		if (f == NULL) {
+			*pFrames = n;
+			if (ret == AV_ER_DATA_NOREADY)
+				return RECV_TURN_IDLE;
+			pthread_mutex_lock(&s->lock);
+			s->stats.lastError = ret;
+			if (ret == AV_ER_LOSED_THIS_FRAME || ret == AV_ER_BUFPARA_MAXSIZE_INSUFF)
+				s->skipping = s->flag_offset != AV_RECV_FLAG_OFFSET_NONE;
+			if (ext_av_channel_closed(ret)) {
+				s->error = ret;
+				pthread_cond_broadcast(&s->cond);
+			}
+			pthread_mutex_unlock(&s->lock);
+			// Other errors, such as a frame lost to a small buffer, end the turn as well
+			return ext_av_channel_closed(ret) ? RECV_TURN_CLOSED : RECV_TURN_IDLE;
+		}
+		if (recv_deliver(s, ret, f))
+			s->ready_fn(s->av_index, s->user);
+	}
+	*pFrames = n;
+	return RECV_TURN_MORE;
+}
+
+/* ============================================================================
+ * Workers
+ * ============================================================================
+ */
+
+static void *recv_worker(void *arg)
+{
+	RecvWorker *w = (RecvWorker *)arg;
+	RecvEngine *e = w->e;
+	unsigned int frames, woken;
+	uint64_t now;
+	RecvStream *s;
+	int turn;
+
+	pthread_mutex_lock(&e->lock);
+	while (!e->stop) {
+		s = recv_next(e, w);
+		if (s == NULL) {
+			now = ext_now_ms();
+			woken = recv_wake_due(e, w, now);
+			if (woken > 0) {
+				// Let sleeping workers steal the rest
+				if (woken > 1 && e->idle_workers > 0)
+					pthread_cond_broadcast(&e->work_cond);
+				continue;
+			}
+			e->idle_workers++;
+			if (e->heap_size == 0)
+				pthread_cond_wait(&e->work_cond, &e->lock);
+			else
+				ext_cond_wait_ms(&e->work_cond, &e->lock, (unsigned int)(e->heap[0]->due_ms - now));
+			e->idle_workers--;
+			e->stats.wakeups++;
+			continue;
+		}
+
+		s->running = 1;
+		pthread_mutex_unlock(&e->lock);
+		turn = recv_turn(e, s, &frames);
+		pthread_mutex_lock(&e->lock);
+		s->running = 0;
+		e->stats.turns++;
+		e->stats.frames += frames;
+		if (frames == 0)
+			e->stats.emptyTurns++;
+		if (s->removed) {
+			pthread_cond_broadcast(&e->done_cond);
+		} else if (turn == RECV_TURN_MORE) {
+			s->delay_ms = 0;
+			recv_run_push(w, s);
+		} else if (turn == RECV_TURN_IDLE) {
+			if (frames > 0 || s->delay_ms == 0)
+				s->delay_ms = 1;
+			else if (s->delay_ms < e->max_idle_ms)
+				s->delay_ms = s->delay_ms * 2 < e->max_idle_ms ? s->delay_ms * 2 : e->max_idle_ms;
+			s->due_ms = ext_now_ms() + s->delay_ms;
+			recv_heap_push(e, s);
+		}
+		// A closed stream is not run again; it stays added until it is removed
+	}
+	pthread_mutex_unlock(&e->lock);
+	return NULL;
+}
+
+static void recv_stream_free(RecvStream *s)
+{
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+	free(s->ring);
+	free(s);
+}
+
+// Caller holds e->lock, which it may release while waiting. Unlinks s and frees it once nothing uses it.
+static void recv_remove_locked(RecvEngine *e, RecvStream *s)
+{
+	RecvStream **pp;
+
+	s->removed = 1;
+	if (s->run_queue >= 0)
+		recv_run_remove(e, s);
+	if (s->heap_index >= 0)
+		recv_heap_remove(e, s);
+	while (s->running)
+		pthread_cond_wait(&e->done_cond, &e->lock);
+	for (pp = &e->streams; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == s) {
+			*pp = s->next;
+			break;
+		}
+	}
+	e->stats.streams--;
+
+	pthread_mutex_lock(&s->lock);
+	s->gone = 1;
+	pthread_cond_broadcast(&s->cond);
+	while (s->waiters > 0)
+		pthread_cond_wait(&s->cond, &s->lock);
+	recv_queue_clear(s);
+	pthread_mutex_unlock(&s->lock);
+	recv_stream_free(s);
+}
+
+static void recv_engine_free(RecvEngine *e)
+{
+	pthread_cond_destroy(&e->work_cond);
+	pthread_cond_destroy(&e->done_cond);
+	pthread_mutex_destroy(&e->lock);
+	free(e->heap);
+	free(e);
+}
+
+// Stop and join the first started workers
+static void recv_engine_stop(RecvEngine *e, unsigned int started)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&e->lock);
+	e->stop = 1;
+	pthread_cond_broadcast(&e->work_cond);
+	pthread_mutex_unlock(&e->lock);
+	for (i = 0; i < started; i++)
+		pthread_join(e->workers[i].thread, NULL);
+}
+
+/* ============================================================================
+ * APIs
+ * ============================================================================
+ */
+
+int avRecvEngineCreate(const AVRecvEngineConfig *pConfig)
+{
+	unsigned int workers, i;
+	RecvEngine *e;
+	int id;
+
+	if (pConfig != NULL &&
+		(pConfig->cb != sizeof(AVRecvEngineConfig) || pConfig->workers > AV_RECV_ENGINE_MAX_WORKERS))
+		return AV_ER_INVALID_ARG;
+	e = (RecvEngine *)calloc(1, sizeof(RecvEngine));
+	if (e == NULL)
+		return AV_ER_MEM_INSUFF;
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->work_cond, NULL);
+	pthread_cond_init(&e->done_cond, NULL);
+	workers = pConfig != NULL && pConfig->workers != 0 ? pConfig->workers : AV_RECV_ENGINE_DEFAULT_WORKERS;
+	e->burst = pConfig != NULL && pConfig->burst != 0 ? pConfig->burst : AV_RECV_ENGINE_DEFAULT_BURST;
+	e->max_idle_ms = pConfig != NULL && pConfig->maxIdleMs != 0 ? pConfig->maxIdleMs : AV_RECV_ENGINE_DEFAULT_IDLE;
+	e->stats.workers = workers;
+	// Workers steal from each other, so they all exist before the first one starts
+	e->worker_count = workers;
+	for (i = 0; i < workers; i++) {
+		e->workers[i].e = e;
+		e->workers[i].index = (int)i;
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&e->workers[i].thread, NULL, recv_worker, &e->workers[i]) != 0) {
+			recv_engine_stop(e, i);
+			recv_engine_free(e);
+			return AV_ER_FAIL_CREATE_THREAD;
+		}
+	}
+	id = ext_table_add(&gRecvEngines, e);
+	if (id < 0) {
+		recv_engine_stop(e, workers);
+		recv_engine_free(e);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+void avRecvEngineDestroy(int nEngineID)
+{
+	RecvEngine *e = (RecvEngine *)ext_table_take(&gRecvEngines, nEngineID);
+	RecvStream *s;
+
+	if (e == NULL)
+		return;
+	pthread_mutex_lock(&e->lock);
+	while ((s = e->streams) != NULL) {
+		ext_table_take(&gRecvStreams, s->av_index);
+		recv_remove_locked(e, s);
+	}
+	pthread_mutex_unlock(&e->lock);
+	recv_engine_stop(e, e->worker_count);
+	recv_engine_free(e);
+}
+
+int avRecvEngineAdd(int nEngineID, int nAVChannelID, const AVRecvStreamConfig *pConfig,
+					avRecvReadyFn pfxReadyFn, void *pUserData)
+{
+	RecvEngine *e = (RecvEngine *)ext_table_get(&gRecvEngines, nEngineID);
+	RecvStream *s, **heap;
+
+	if (e == NULL || nAVChannelID < 0 ||
+		(pConfig != NULL && (pConfig->cb != sizeof(AVRecvStreamConfig) ||
+							 pConfig->flagOffset < AV_RECV_FLAG_OFFSET_NONE ||
+							 pConfig->flagOffset >= AV_FRAME_INFO_MAX_SIZE)))
+		return AV_ER_INVALID_ARG;
+	s = (RecvStream *)calloc(1, sizeof(RecvStream));
+	if (s == NULL)
+		return AV_ER_MEM_INSUFF;
+	s->e = e;
+	s->av_index = nAVChannelID;
+	s->flag_offset = pConfig != NULL ? pConfig->flagOffset : AV_RECV_FLAG_OFFSET_NONE;
+	s->max_queue = pConfig != NULL && pConfig->maxQueue != 0 ? pConfig->maxQueue : AV_RECV_STREAM_DEFAULT_QUEUE;
+	s->ready_fn = pfxReadyFn;
+	s->user = pUserData;
+	s->heap_index = -1;
+	s->run_queue = -1;
+	s->ring = (AVFrame **)calloc(s->max_queue, sizeof(AVFrame *));
+	if (s->ring == NULL) {
+		free(s);
+		return AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	pthread_mutex_lock(&e->lock);
+	// Every stream may be asleep at the same time
+	if ((int)e->stats.streams == e->heap_cap) {
+		heap = (RecvStream **)realloc(e->heap, (size_t)(e->heap_cap + 16) * sizeof(RecvStream *));
+		if (heap == NULL) {
+			pthread_mutex_unlock(&e->lock);
+			recv_stream_free(s);
+			return AV_ER_MEM_INSUFF;
+		}
+		e->heap = heap;
+		e->heap_cap += 16;
+	}
+	if (ext_table_set(&gRecvStreams, nAVChannelID, s) < 0) {
+		pthread_mutex_unlock(&e->lock);
+		recv_stream_free(s);
+		return AV_ER_INVALID_ARG;
+	}
+	s->next = e->streams;
+	e->streams = s;
+	e->stats.streams++;
+	// Due at once
+	s->due_ms = ext_now_ms();
+	recv_heap_push(e, s);
+	pthread_mutex_unlock(&e->lock);
+	return AV_ER_NoERROR;
+}
+
+void avRecvEngineRemove(int nAVChannelID)
+{
+	RecvStream *s = (RecvStream *)ext_table_take(&gRecvStreams, nAVChannelID);
+	RecvEngine *e;
+
+	if (s == NULL)
+		return;
+	e = s->e;
+	pthread_mutex_lock(&e->lock);
+	recv_remove_locked(e, s);
+	pthread_mutex_unlock(&e->lock);
+}
+
+int avRecvEngineGetFrame(int nAVChannelID, AVFrame **ppFrame, unsigned int nTimeoutMs)
+{
+	RecvStream *s = (RecvStream *)ext_table_get(&gRecvStreams, nAVChannelID);
+	uint64_t deadline = ext_now_ms() + nTimeoutMs, now;
+	AVFrame *f;
+	int ret;
+
+	if (ppFrame != NULL)
+		*ppFrame = NULL;
+	if (s == NULL || ppFrame == NULL)
+		return AV_ER_INVALID_ARG;
+
+	pthread_mutex_lock(&s->lock);
+	while (s->count == 0 && s->error == 0 && !s->gone && (now = ext_now_ms()) < deadline) {
+		s->waiters++;
+		ext_cond_wait_ms(&s->cond, &s->lock, (unsigned int)(deadline - now));
+		s->waiters--;
+	}
+	if (s->gone) {
+		// avRecvEngineRemove() waits for the last waiter
+		if (s->waiters == 0)
+			pthread_cond_broadcast(&s->cond);
+		ret = AV_ER_INVALID_ARG;
+	} else if (s->count > 0) {
+		f = s->ring[s->head];
+		s->head = (s->head + 1) % s->max_queue;
+		s->count--;
+		s->stats.delivered++;
+		*ppFrame = f;
+		ret = f->dataSize;
+	} else {
+		ret = s->error != 0 ? s->error : AV_ER_DATA_NOREADY;
+	}
+	if (s->count == 0)
+		s->notified = 0;
+	pthread_mutex_unlock(&s->lock);
+	return ret;
+}
+
+int avRecvEngineGetStats(int nEngineID, AVRecvEngineStats *pStats)
+{
+	RecvEngine *e = (RecvEngine *)ext_table_get(&gRecvEngines, nEngineID);
+
+	if (e == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&e->lock);
+	*pStats = e->stats;
+	pthread_mutex_unlock(&e->lock);
+	return AV_ER_NoERROR;
+}
+
+int avRecvStreamGetStats(int nAVChannelID, AVRecvStreamStats *pStats)
+{
+	RecvStream *s = (RecvStream *)ext_table_get(&gRecvStreams, nAVChannelID);
+	unsigned int delay;
+
+	if (s == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&s->e->lock);
+	delay = s->delay_ms;
+	pthread_mutex_unlock(&s->e->lock);
+	pthread_mutex_lock(&s->lock);
+	*pStats = s->stats;
+	pStats->queued = s->count;
+	pStats->pollIntervalMs = delay;
+	pthread_mutex_unlock(&s->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,178 @@
+/*! \file av_sendqueue.c
+Asynchronous send queues, see AVSendQueueAPIs.h.
+
+Each queue is a fixed ring of frame references allocated at start, so
+queueing a frame never allocates. The send thread pops one frame at a time
+and calls the AV module without holding the queue lock.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVSendQueueAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_av.h"
+
+typedef struct SendQueue {
+	int av_index;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	AVFrame **ring;
+	unsigned int max_frames;
+	unsigned int head;
+	int stopping;
+	int closed_error;		// error which ended the AV channel, AV_ER_NoERROR while it is usable
+	pthread_t thread;
+	AVSendQueueStats stats;
+} SendQueue;
+
+static ExtTable gSendQueues = EXT_TABLE_INITIALIZER;
+
+static void *sendqueue_thread(void *arg)
+{
+	SendQueue *q = (SendQueue *)arg;
+
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		AVFrame *f;
+		int ret;
+
+		while (!q->stopping && q->stats.queuedFrames == 0)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (q->stopping)
+			break;
+
+		f = q->ring[q->head];
+		q->ring[q->head] = NULL;
+		q->head = (q->head + 1) % q->max_frames;
+		q->stats.queuedFrames--;
+		q->stats.queuedBytes -= (unsigned int)f->dataSize;
+		pthread_mutex_unlock(&q->lock);
+
+		ret = avSendFrameDataPaced(q->av_index, f->data, f->dataSize, f->info, f->infoSize, NULL);
+		avFrameRelease(f);
+
+		pthread_mutex_lock(&q->lock);
+		if (ret < 0 && ret != AV_ER_EXCEED_MAX_ALARM) {
+			q->stats.failCount++;
+			q->stats.lastError = ret;
+			if (ext_av_channel_closed(ret))
+				q->closed_error = ret;
+		} else {
+			q->stats.sentCount++;
+		}
+	}
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+int avSendQueueStart(int nAVChannelID, unsigned int nMaxFrames)
+{
+	SendQueue *q;
+
+	if (nAVChannelID < 0 || ext_table_get(&gSendQueues, nAVChannelID) != NULL)
+		return AV_ER_INVALID_ARG;
+
+	q = (SendQueue *)calloc(1, sizeof(SendQueue));
+	if (q == NULL)
+		return AV_ER_MEM_INSUFF;
+	q->av_index = nAVChannelID;
+	q->max_frames = nMaxFrames != 0 ? nMaxFrames : AV_SEND_QUEUE_DEFAULT_MAX_FRAMES;
+	q->ring = (AVFrame **)calloc(q->max_frames, sizeof(AVFrame *));
+	if (q->ring == NULL) {
+		free(q);
+		return AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+
+	if (pthread_create(&q->thread, NULL, sendqueue_thread, q) != 0) {
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->lock);
+		free(q->ring);
+		free(q);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	if (ext_table_set(&gSendQueues, nAVChannelID, q) < 0) {
+		// Lost a race with another start on the same AV channel
+		pthread_mutex_lock(&q->lock);
+		q->stopping = 1;
+		pthread_cond_signal(&q->cond);
+		pthread_mutex_unlock(&q->lock);
+		pthread_join(q->thread, NULL);
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->lock);
+		free(q->ring);
+		free(q);
+		return AV_ER_INVALID_ARG;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avSendQueueStop(int nAVChannelID)
+{
+	SendQueue *q = (SendQueue *)ext_table_take(&gSendQueues, nAVChannelID);
+	unsigned int i;
+
+	if (q == NULL)
+		return;
+
+	pthread_mutex_lock(&q->lock);
+	q->stopping = 1;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	pthread_join(q->thread, NULL);
+
+	for (i = 0; i < q->max_frames; i++)
+		avFrameRelease(q->ring[i]);
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free(q->ring);
+	free(q);
+}
+
+int avSendFrameDataAsync(int nAVChannelID, AVFrame *pFrame)
+{
+	SendQueue *q = (SendQueue *)ext_table_get(&gSendQueues, nAVChannelID);
+	int ret = AV_ER_NoERROR;
+
+	if (pFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	if (q == NULL) {
+		avFrameRelease(pFrame);
+		return AV_ER_INVALID_ARG;
+	}
+
+	pthread_mutex_lock(&q->lock);
+	if (q->closed_error != AV_ER_NoERROR) {
+		ret = q->closed_error;
+	} else if (q->stats.queuedFrames >= q->max_frames) {
+		q->stats.rejectCount++;
+		ret = AV_ER_EXCEED_MAX_SIZE;
+	} else {
+		q->ring[(q->head + q->stats.queuedFrames) % q->max_frames] = pFrame;
+		q->stats.queuedFrames++;
+		q->stats.queuedBytes += (unsigned int)pFrame->dataSize;
+		if (q->stats.queuedFrames > q->stats.maxQueuedFrames)
+			q->stats.maxQueuedFrames = q->stats.queuedFrames;
+		pthread_cond_signal(&q->cond);
+		pFrame = NULL;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	avFrameRelease(pFrame);
+	return ret;
+}
+
+int avSendQueueGetStats(int nAVChannelID, AVSendQueueStats *pStats)
+{
+	SendQueue *q = (SendQueue *)ext_table_get(&gSendQueues, nAVChannelID);
+
+	if (pStats == NULL || q == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&q->lock);
+	*pStats = q->stats;
+	pthread_mutex_unlock(&q->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,368 @@
+/*! \file av_standby.c
+Standby AV channels, see AVStandbyAPIs.h.
+
+The AV server side is a filter in front of the usual send. The AV client
+side is a thread per AV channel in standby which keeps the receive buffer
+empty and the last keyframe at hand.
+
+The mode change message:
+	[0] #AV_STANDBY_VERSION
+	[1] AVStandbyMode
+	[2..3] reserved, 0
+	[4..7] key interval in millisecond, little endian
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVStandbyAPIs.h"
+#include "AVGopGateAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_platform.h"
+#include "ext_table.h"
+#include "ext_av.h"
+
+// How long the client thread waits when no frame is ready
+#define STANDBY_POLL_MS			20
+
+// The wait before trying again when another thread is in avSendIOCtrl()
+#define STANDBY_SEND_RETRY_MS	2
+
+typedef struct StandbyServ {
+	int av_index;
+	avStandbyModeFn mode_fn;
+	void *user_data;
+	pthread_mutex_t lock;
+	int need_key; // Promoted and no keyframe sent since
+	int sent_key; // A keyframe was sent in standby, at last_key_ms
+	uint64_t last_key_ms;
+	AVStandbyServStats stats;
+} StandbyServ;
+
+typedef struct StandbyClient {
+	int av_index;
+	int flag_offset;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	int has_thread;
+	pthread_t thread;
+	AVFrame *key;
+	uint64_t key_ms;
+	AVStandbyClientStats stats;
+} StandbyClient;
+
+static ExtTable gStandbyServs = EXT_TABLE_INITIALIZER;
+static ExtTable gStandbyClients = EXT_TABLE_INITIALIZER;
+
+/* ============================================================================
+ * AV server
+ * ============================================================================
+ */
+
+int avServStandbyAttach(int nAVChannelID, avStandbyModeFn pfxModeFn, void *pUserData)
+{
+	StandbyServ *s;
+
+	if (nAVChannelID < 0 || pfxModeFn == NULL)
+		return AV_ER_INVALID_ARG;
+
+	s = (StandbyServ *)calloc(1, sizeof(StandbyServ));
+	if (s == NULL)
+		return AV_ER_MEM_INSUFF;
+	s->av_index = nAVChannelID;
+	s->mode_fn = pfxModeFn;
+	s->user_data = pUserData;
+	s->stats.mode = AV_STANDBY_MODE_FULL;
+	pthread_mutex_init(&s->lock, NULL);
+
+	if (ext_table_set(&gStandbyServs, nAVChannelID, s) < 0) {
+		pthread_mutex_destroy(&s->lock);
+		free(s);
+		return AV_ER_INVALID_ARG;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avServStandbyDetach(int nAVChannelID)
+{
+	StandbyServ *s = (StandbyServ *)ext_table_take(&gStandbyServs, nAVChannelID);
+
+	if (s == NULL)
+		return;
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+void __stdcall avServStandbyIOCtrlHandler(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData,
+										  int nDataSize, void *pUserData)
+{
+	const unsigned char *msg = (const unsigned char *)cabData;
+	StandbyServ *s;
+	AVStandbyMode mode;
+	unsigned int interval;
+	int changed;
+
+	(void)pUserData;
+	if (nIOCtrlType != AV_STANDBY_IOTYPE || msg == NULL || nDataSize < AV_STANDBY_MESSAGE_SIZE ||
+		msg[0] != AV_STANDBY_VERSION || msg[1] > AV_STANDBY_MODE_STANDBY)
+		return;
+	mode = (AVStandbyMode)msg[1];
+	interval = (unsigned int)msg[4] | (unsigned int)msg[5] << 8 | (unsigned int)msg[6] << 16 |
+			   (unsigned int)msg[7] << 24;
+	if (interval == 0)
+		interval = AV_STANDBY_DEFAULT_KEY_INTERVAL;
+
+	s = (StandbyServ *)ext_table_get(&gStandbyServs, nAVChannelID);
+	if (s == NULL)
+		return;
+	pthread_mutex_lock(&s->lock);
+	changed = s->stats.mode != mode;
+	s->stats.mode = mode;
+	s->stats.keyIntervalMs = interval;
+	if (changed && mode == AV_STANDBY_MODE_FULL) {
+		s->need_key = 1;
+		s->stats.promoteCount++;
+	} else if (changed) {
+		// The first keyframe in standby goes out at once
+		s->need_key = 0;
+		s->sent_key = 0;
+		s->stats.standbyCount++;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if (changed)
+		s->mode_fn(nAVChannelID, mode, interval, s->user_data);
+}
+
+int avSendFrameDataStandby(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+						   const void *cabFrameInfo, int nFrameInfoSize, int bKeyFrame)
+{
+	StandbyServ *s = (StandbyServ *)ext_table_get(&gStandbyServs, nAVChannelID);
+	uint64_t now = ext_now_ms();
+	int send, standby, ret;
+
+	if (s == NULL)
+		return AV_ER_INVALID_ARG;
+
+	pthread_mutex_lock(&s->lock);
+	standby = s->stats.mode == AV_STANDBY_MODE_STANDBY;
+	if (standby) {
+		send = bKeyFrame && (!s->sent_key || now - s->last_key_ms >= s->stats.keyIntervalMs);
+	} else {
+		if (bKeyFrame)
+			s->need_key = 0;
+		send = !s->need_key;
+	}
+	if (!send) {
+		s->stats.droppedFrames++;
+		pthread_mutex_unlock(&s->lock);
+		return AV_ER_WAIT_KEY_FRAME;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if (ext_gopgate_attached(nAVChannelID))
+		ret = avSendFrameDataGop(nAVChannelID, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize,
+								 bKeyFrame);
+	else
+		ret = avSendFrameDataPaced(nAVChannelID, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize,
+								   NULL);
+
+	pthread_mutex_lock(&s->lock);
+	if (ret >= 0 || ret == AV_ER_EXCEED_MAX_ALARM) {
+		s->stats.sentFrames++;
+		if (standby) {
+			s->sent_key = 1;
+			s->last_key_ms = now;
+		}
+	} else if (ret == AV_ER_WAIT_KEY_FRAME) {
+		s->stats.droppedFrames++;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return ret;
+}
+
+int avServStandbyGetStats(int nAVChannelID, AVStandbyServStats *pStats)
+{
+	StandbyServ *s = (StandbyServ *)ext_table_get(&gStandbyServs, nAVChannelID);
+
+	if (s == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&s->lock);
+	*pStats = s->stats;
+	pthread_mutex_unlock(&s->lock);
+	return AV_ER_NoERROR;
+}
+
+/* ============================================================================
+ * AV client
+ * ============================================================================
+ */
+
+static int standby_send(int av, AVStandbyMode mode, unsigned int interval)
+{
+	unsigned char msg[AV_STANDBY_MESSAGE_SIZE];
+	uint64_t deadline = ext_now_ms() + AV_STANDBY_SEND_TIMEOUT;
+	int ret;
+
+	memset(msg, 0, sizeof(msg));
+	msg[0] = AV_STANDBY_VERSION;
+	msg[1] = (unsigned char)mode;
+	msg[4] = (unsigned char)interval;
+	msg[5] = (unsigned char)(interval >> 8);
+	msg[6] = (unsigned char)(interval >> 16);
+	msg[7] = (unsigned char)(interval >> 24);
+	// The application may be in avSendIOCtrl() itself
+	while ((ret = avSendIOCtrl(av, AV_STANDBY_IOTYPE, (const char *)msg, (int)sizeof(msg))) ==
+			   AV_ER_SENDIOCTRL_ALREADY_CALLED &&
+		   ext_now_ms() < deadline)
+		ext_sleep_ms(STANDBY_SEND_RETRY_MS);
+	return ret;
+}
+
+static void *standby_client_thread(void *arg)
+{
+	StandbyClient *c = (StandbyClient *)arg;
+	AVFrame *f, *old;
+	int ret;
+
+	pthread_mutex_lock(&c->lock);
+	while (!c->stop) {
+		pthread_mutex_unlock(&c->lock);
+		ret = avRecvFrameDataPooled(c->av_index, &f);
+		old = f;
+		pthread_mutex_lock(&c->lock);
+		if (ret != AV_ER_DATA_NOREADY && ret < 0)
+			c->stats.lastError = ret;
+		if (ret >= 0 && f->infoSize > c->flag_offset && f->info[c->flag_offset] == 1) {
+			old = c->key;
+			c->key = f;
+			c->key_ms = ext_now_ms();
+			c->stats.keyFrames++;
+		} else if (f != NULL) {
+			c->stats.otherFrames++;
+		}
+		if (old != NULL) {
+			pthread_mutex_unlock(&c->lock);
+			avFrameRelease(old);
+			pthread_mutex_lock(&c->lock);
+		}
+		if (f == NULL) {
+			if (ext_av_channel_closed(ret))
+				break;
+			if (!c->stop)
+				ext_cond_wait_ms(&c->cond, &c->lock, STANDBY_POLL_MS);
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	return NULL;
+}
+
+static int standby_client_start(StandbyClient *c)
+{
+	c->stop = 0;
+	c->has_thread = pthread_create(&c->thread, NULL, standby_client_thread, c) == 0;
+	return c->has_thread ? AV_ER_NoERROR : AV_ER_FAIL_CREATE_THREAD;
+}
+
+static void standby_client_join(StandbyClient *c)
+{
+	if (!c->has_thread)
+		return;
+	pthread_mutex_lock(&c->lock);
+	c->stop = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->thread, NULL);
+	c->has_thread = 0;
+}
+
+static void standby_client_free(StandbyClient *c)
+{
+	standby_client_join(c);
+	avFrameRelease(c->key);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+int avClientStandbyEnter(int nAVChannelID, unsigned int nKeyIntervalMs, int nFlagOffset)
+{
+	StandbyClient *c;
+	int ret;
+
+	if (nAVChannelID < 0 || nFlagOffset < 0 || nFlagOffset >= AV_FRAME_INFO_MAX_SIZE)
+		return AV_ER_INVALID_ARG;
+	if (nKeyIntervalMs == 0)
+		nKeyIntervalMs = AV_STANDBY_DEFAULT_KEY_INTERVAL;
+
+	c = (StandbyClient *)calloc(1, sizeof(StandbyClient));
+	if (c == NULL)
+		return AV_ER_MEM_INSUFF;
+	c->av_index = nAVChannelID;
+	c->flag_offset = nFlagOffset;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+
+	if (ext_table_set(&gStandbyClients, nAVChannelID, c) < 0) {
+		standby_client_free(c);
+		return AV_ER_INVALID_ARG;
+	}
+	// Drain first, so nothing piles up while the AV server switches
+	ret = standby_client_start(c);
+	if (ret == AV_ER_NoERROR)
+		ret = standby_send(nAVChannelID, AV_STANDBY_MODE_STANDBY, nKeyIntervalMs);
+	if (ret < 0) {
+		ext_table_take(&gStandbyClients, nAVChannelID);
+		standby_client_free(c);
+		return ret;
+	}
+	return AV_ER_NoERROR;
+}
+
+int avClientStandbyPromote(int nAVChannelID, AVFrame **ppKeyFrame)
+{
+	StandbyClient *c = (StandbyClient *)ext_table_get(&gStandbyClients, nAVChannelID);
+	int ret;
+
+	if (ppKeyFrame != NULL)
+		*ppKeyFrame = NULL;
+	if (c == NULL)
+		return AV_ER_INVALID_ARG;
+
+	// Stop draining first: the frames following the request belong to the application
+	standby_client_join(c);
+	ret = standby_send(nAVChannelID, AV_STANDBY_MODE_FULL, 0);
+	if (ret < 0 && !ext_av_channel_closed(ret) && standby_client_start(c) == AV_ER_NoERROR)
+		return ret;
+
+	ext_table_take(&gStandbyClients, nAVChannelID);
+	if (ret >= 0 && ppKeyFrame != NULL) {
+		*ppKeyFrame = c->key;
+		c->key = NULL;
+	}
+	standby_client_free(c);
+	return ret < 0 ? ret : AV_ER_NoERROR;
+}
+
+void avClientStandbyStop(int nAVChannelID)
+{
+	StandbyClient *c = (StandbyClient *)ext_table_take(&gStandbyClients, nAVChannelID);
+
+	if (c != NULL)
+		standby_client_free(c);
+}
+
+int avClientStandbyGetStats(int nAVChannelID, AVStandbyClientStats *pStats)
+{
+	StandbyClient *c = (StandbyClient *)ext_table_get(&gStandbyClients, nAVChannelID);
+
+	if (c == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&c->lock);
+	*pStats = c->stats;
+	pStats->hasKeyFrame = c->key != NULL;
+	pStats->keyFrameAgeMs = c->key != NULL ? (unsigned int)(ext_now_ms() - c->key_ms) : 0;
+	pthread_mutex_unlock(&c->lock);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,308 @@
+/*! \file av_stats.c
+Statistics samplers, see AVStatsAPIs.h.
+
+Each ring has a single consumer, the reader, and one or more producers: the
+sampler thread, or the threads sending video and audio. A producer reserves
+a slot by moving head with a compare and swap, and each slot carries a
+sequence number telling whether it is free, filled or being filled. Filling
+a slot publishes it with a release store of its sequence; the consumer takes
+it with an acquire load and hands it back by the same means, so the rings
+take no lock. Finding the sampler of an AV channel briefly takes the lock of
+the table, which pins it until the caller is done, so avStatsSamplerStop()
+cannot free it under a sending thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVStatsAPIs.h"
+#include "ext_table.h"
+#include "ext_platform.h"
+#include "ext_stats.h"
+
+#define STATS_CACHE_LINE	64
+
+typedef struct StatsRing {
+	unsigned char *items;
+	// Slot i is free for position p when it holds p, filled when it holds p + 1
+	unsigned int *seqs;
+	unsigned int elem_size;
+	unsigned int mask;
+	// Written by the producers
+	unsigned int head;
+	unsigned int dropped;
+	unsigned int pushed;
+	// Keeps tail off the cache line the producers write
+	char pad[STATS_CACHE_LINE];
+	// Written by the consumer
+	unsigned int tail;
+} StatsRing;
+
+typedef struct StatsSampler {
+	int refs;				// under gSamplers.lock
+	int av_index;
+	unsigned int interval_ms;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	pthread_t thread;
+	unsigned int status_failures;
+	unsigned int frame_seq;
+	StatsRing status_ring;
+	StatsRing frame_ring;
+} StatsSampler;
+
+static ExtTable gSamplers = EXT_TABLE_INITIALIZER;
+// Number of sampled AV channels, so the send paths skip the table when it is 0
+static int gSamplerCount;
+
+static void stats_sampler_free(StatsSampler *s)
+{
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+	free(s->status_ring.items);
+	free(s->status_ring.seqs);
+	free(s->frame_ring.items);
+	free(s->frame_ring.seqs);
+	free(s);
+}
+
+/** The sampler of an AV channel, pinned until sampler_put(); NULL if there is none. */
+static StatsSampler *sampler_get(int av)
+{
+	StatsSampler *s = NULL;
+
+	if (av < 0)
+		return NULL;
+	pthread_mutex_lock(&gSamplers.lock);
+	if (av < gSamplers.size && (s = (StatsSampler *)gSamplers.items[av]) != NULL)
+		s->refs++;
+	pthread_mutex_unlock(&gSamplers.lock);
+	return s;
+}
+
+static void sampler_put(StatsSampler *s)
+{
+	int last;
+
+	if (s == NULL)
+		return;
+	pthread_mutex_lock(&gSamplers.lock);
+	last = --s->refs == 0;
+	pthread_mutex_unlock(&gSamplers.lock);
+	if (last)
+		stats_sampler_free(s);
+}
+
+static int stats_ring_init(StatsRing *r, unsigned int capacity, unsigned int elem_size)
+{
+	unsigned int size = 1, i;
+
+	while (size < capacity)
+		size <<= 1;
+	r->items = (unsigned char *)malloc((size_t)size * elem_size);
+	r->seqs = (unsigned int *)malloc((size_t)size * sizeof(unsigned int));
+	if (r->items == NULL || r->seqs == NULL)
+		return -1;
+	for (i = 0; i < size; i++)
+		r->seqs[i] = i;
+	r->elem_size = elem_size;
+	r->mask = size - 1;
+	return 0;
+}
+
+// Producer side, from any thread. Never blocks: a full ring drops the record.
+static void stats_ring_push(StatsRing *r, const void *item)
+{
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_RELAXED), seq;
+	int diff;
+
+	for (;;) {
+		seq = __atomic_load_n(&r->seqs[head & r->mask], __ATOMIC_ACQUIRE);
+		diff = (int)(seq - head);
+		if (diff == 0) {
+			// On failure head is reloaded
+			if (__atomic_compare_exchange_n(&r->head, &head, head + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// The slot still holds the record from one lap ago
+			__atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			// Another producer took this position
+			head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+	memcpy(r->items + (size_t)(head & r->mask) * r->elem_size, item, r->elem_size);
+	__atomic_store_n(&r->seqs[head & r->mask], head + 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&r->pushed, 1, __ATOMIC_RELAXED);
+}
+
+// Consumer side. Copies up to max records, stopping at a slot which is still being filled.
+static int stats_ring_pop(StatsRing *r, void *out, int max)
+{
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED), slot;
+	int count;
+
+	for (count = 0; count < max; count++, tail++) {
+		slot = tail & r->mask;
+		if (__atomic_load_n(&r->seqs[slot], __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+		memcpy((unsigned char *)out + (size_t)count * r->elem_size, r->items + (size_t)slot * r->elem_size,
+			   r->elem_size);
+		// Free for the position one lap ahead
+		__atomic_store_n(&r->seqs[slot], tail + r->mask + 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELAXED);
+	return count;
+}
+
+static void *stats_thread(void *arg)
+{
+	StatsSampler *s = (StatsSampler *)arg;
+	AVStatusSample sample;
+	uint64_t next = ext_now_us(), now;
+
+	pthread_mutex_lock(&s->lock);
+	while (!s->stop) {
+		// Keep the rate steady however long avStatusCheck() takes
+		next += (uint64_t)s->interval_ms * 1000;
+		now = ext_now_us();
+		if (next > now)
+			ext_cond_wait_ms(&s->cond, &s->lock, (unsigned int)((next - now + 999) / 1000));
+		else
+			next = now;
+		if (s->stop)
+			break;
+		pthread_mutex_unlock(&s->lock);
+
+		memset(&sample, 0, sizeof(sample));
+		sample.timeUs = ext_now_us();
+		if (avStatusCheck(s->av_index, &sample.status) == AV_ER_NoERROR) {
+			sample.resendUsage = avResendBufUsageRate(s->av_index);
+			stats_ring_push(&s->status_ring, &sample);
+		} else {
+			__atomic_add_fetch(&s->status_failures, 1, __ATOMIC_RELAXED);
+		}
+
+		pthread_mutex_lock(&s->lock);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+void ext_stats_frame_sent(int nAVChannelID, uint64_t start_us, int size, int ret, int is_audio)
+{
+	StatsSampler *s;
+	AVFrameSendSample rec;
+	uint64_t duration;
+
+	if (__atomic_load_n(&gSamplerCount, __ATOMIC_RELAXED) == 0)
+		return;
+	s = sampler_get(nAVChannelID);
+	if (s == NULL)
+		return;
+	duration = ext_now_us() - start_us;
+	memset(&rec, 0, sizeof(rec));
+	rec.timeUs = start_us;
+	rec.durationUs = duration > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)duration;
+	// Video and audio are usually sent from different threads
+	rec.seq = __atomic_fetch_add(&s->frame_seq, 1, __ATOMIC_RELAXED);
+	rec.size = size;
+	rec.result = ret;
+	rec.isAudio = (unsigned char)(is_audio != 0);
+	stats_ring_push(&s->frame_ring, &rec);
+	sampler_put(s);
+}
+
+int avStatsSamplerStart(int nAVChannelID, unsigned int nRateHz, unsigned int nCapacity)
+{
+	StatsSampler *s;
+
+	if (nRateHz == 0)
+		nRateHz = AV_STATS_DEFAULT_RATE;
+	if (nCapacity == 0)
+		nCapacity = AV_STATS_DEFAULT_CAPACITY;
+	if (nAVChannelID < 0 || nRateHz > AV_STATS_MAX_RATE || nCapacity > 0x10000000)
+		return AV_ER_INVALID_ARG;
+
+	s = (StatsSampler *)calloc(1, sizeof(StatsSampler));
+	if (s == NULL)
+		return AV_ER_MEM_INSUFF;
+	s->refs = 1;			// the table
+	s->av_index = nAVChannelID;
+	s->interval_ms = 1000 / nRateHz;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if (stats_ring_init(&s->status_ring, nCapacity, sizeof(AVStatusSample)) < 0 ||
+		stats_ring_init(&s->frame_ring, nCapacity, sizeof(AVFrameSendSample)) < 0) {
+		stats_sampler_free(s);
+		return AV_ER_MEM_INSUFF;
+	}
+
+	if (ext_table_set(&gSamplers, nAVChannelID, s) < 0) {
+		stats_sampler_free(s);
+		return AV_ER_INVALID_ARG;
+	}
+	if (pthread_create(&s->thread, NULL, stats_thread, s) != 0) {
+		sampler_put((StatsSampler *)ext_table_take(&gSamplers, nAVChannelID));
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	__atomic_add_fetch(&gSamplerCount, 1, __ATOMIC_RELAXED);
+	return AV_ER_NoERROR;
+}
+
+void avStatsSamplerStop(int nAVChannelID)
+{
+	StatsSampler *s = (StatsSampler *)ext_table_take(&gSamplers, nAVChannelID);
+
+	if (s == NULL)
+		return;
+	__atomic_sub_fetch(&gSamplerCount, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+	// A sending thread may still hold it
+	sampler_put(s);
+}
+
+int avStatsReadStatus(int nAVChannelID, AVStatusSample *pSamples, int nMaxCount)
+{
+	StatsSampler *s;
+	int count;
+
+	if (pSamples == NULL || nMaxCount < 0 || (s = sampler_get(nAVChannelID)) == NULL)
+		return AV_ER_INVALID_ARG;
+	count = stats_ring_pop(&s->status_ring, pSamples, nMaxCount);
+	sampler_put(s);
+	return count;
+}
+
+int avStatsReadFrames(int nAVChannelID, AVFrameSendSample *pSamples, int nMaxCount)
+{
+	StatsSampler *s;
+	int count;
+
+	if (pSamples == NULL || nMaxCount < 0 || (s = sampler_get(nAVChannelID)) == NULL)
+		return AV_ER_INVALID_ARG;
+	count = stats_ring_pop(&s->frame_ring, pSamples, nMaxCount);
+	sampler_put(s);
+	return count;
+}
+
+int avStatsGetSamplerStats(int nAVChannelID, AVStatsSamplerStats *pStats)
+{
+	StatsSampler *s;
+
+	if (pStats == NULL || (s = sampler_get(nAVChannelID)) == NULL)
+		return AV_ER_INVALID_ARG;
+	pStats->statusSamples = __atomic_load_n(&s->status_ring.pushed, __ATOMIC_RELAXED);
+	pStats->statusDropped = __atomic_load_n(&s->status_ring.dropped, __ATOMIC_RELAXED);
+	pStats->statusFailures = __atomic_load_n(&s->status_failures, __ATOMIC_RELAXED);
+	pStats->frameSamples = __atomic_load_n(&s->frame_ring.pushed, __ATOMIC_RELAXED);
+	pStats->frameDropped = __atomic_load_n(&s->frame_ring.dropped, __ATOMIC_RELAXED);
+	sampler_put(s);
+	return AV_ER_NoERROR;
+}
@@ -0,0 +1,348 @@
+/*! \file av_streamgroup.c
+Stream groups, see AVStreamGroupAPIs.h.
+
+The frame store is a ring indexed by a 64-bit frame sequence number; slot
+seq % capacity holds frame seq while seq is within the last capacity
+frames. Viewers keep a sequence number as their cursor and take their own
+reference to a frame before sending it, so the writer can overwrite a slot
+while a viewer is still sending the old frame. A viewer which lost frames,
+by its drop policy or because the ring moved past it, only resumes at a
+keyframe so its decoder never sees a broken reference chain.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVStreamGroupAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_table.h"
+#include "ext_av.h"
+
+#define GROUP_MAX_AUDIO_VIEWERS	64
+
+typedef struct StreamSlot {
+	AVFrame *frame;
+	int key;
+} StreamSlot;
+
+struct StreamGroup;
+
+typedef struct StreamViewer {
+	struct StreamGroup *group;
+	int av_index;
+	AVStreamDropPolicy policy;
+	unsigned int max_lag;
+	uint64_t cursor;
+	int wait_key;
+	int closed;
+	int stopping;
+	pthread_t thread;
+	AVStreamViewerStats stats;
+	struct StreamViewer *next;
+} StreamViewer;
+
+typedef struct StreamGroup {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	StreamSlot *ring;
+	unsigned int capacity;
+	uint64_t next_seq;
+	uint64_t last_key_seq;
+	int has_key;
+	unsigned long long stored_bytes;
+	StreamViewer *viewers;
+} StreamGroup;
+
+static ExtTable gGroups = EXT_TABLE_INITIALIZER;
+
+// Caller holds g->lock
+static uint64_t group_base(StreamGroup *g)
+{
+	return g->next_seq > g->capacity ? g->next_seq - g->capacity : 0;
+}
+
+// Caller holds g->lock. Move the cursor of a viewer to the latest stored keyframe, or wait for the next one.
+static void viewer_resync(StreamGroup *g, StreamViewer *v)
+{
+	uint64_t target = g->has_key && g->last_key_seq >= group_base(g) ? g->last_key_seq : g->next_seq;
+
+	if (target > v->cursor) {
+		v->stats.droppedCount += (unsigned int)(target - v->cursor);
+		v->cursor = target;
+	}
+	v->wait_key = 1;
+}
+
+static void *viewer_thread(void *arg)
+{
+	StreamViewer *v = (StreamViewer *)arg;
+	StreamGroup *g = v->group;
+
+	pthread_mutex_lock(&g->lock);
+	for (;;) {
+		StreamSlot *slot;
+		AVFrame *f;
+		int ret;
+
+		while (!v->stopping && v->cursor >= g->next_seq)
+			pthread_cond_wait(&g->cond, &g->lock);
+		if (v->stopping)
+			break;
+		if (v->closed) {
+			v->cursor = g->next_seq;
+			continue;
+		}
+
+		if (v->cursor < group_base(g) ||
+			(v->policy == AV_STREAM_DROP_TO_KEYFRAME && g->next_seq - v->cursor > (uint64_t)v->max_lag &&
+			 g->has_key && g->last_key_seq > v->cursor))
+			viewer_resync(g, v);
+		if (v->cursor >= g->next_seq)
+			continue;
+
+		slot = &g->ring[v->cursor % g->capacity];
+		v->cursor++;
+		if (v->wait_key && !slot->key) {
+			v->stats.droppedCount++;
+			continue;
+		}
+		v->wait_key = 0;
+		f = avFrameRetain(slot->frame);
+		pthread_mutex_unlock(&g->lock);
+
+		ret = avSendFrameDataPaced(v->av_index, f->data, f->dataSize, f->info, f->infoSize, NULL);
+		avFrameRelease(f);
+
+		pthread_mutex_lock(&g->lock);
+		if (ret < 0 && ret != AV_ER_EXCEED_MAX_ALARM) {
+			v->stats.failCount++;
+			v->stats.lastError = ret;
+			if (ext_av_channel_closed(ret))
+				v->closed = 1;
+			else
+				v->wait_key = 1;	// the viewer lost this frame
+		} else {
+			v->stats.sentCount++;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	return NULL;
+}
+
+int avStreamGroupCreate(unsigned int nMaxFrames)
+{
+	StreamGroup *g = (StreamGroup *)calloc(1, sizeof(StreamGroup));
+	int id;
+
+	if (g == NULL)
+		return AV_ER_MEM_INSUFF;
+	g->capacity = nMaxFrames != 0 ? nMaxFrames : AV_STREAM_GROUP_DEFAULT_MAX_FRAMES;
+	g->ring = (StreamSlot *)calloc(g->capacity, sizeof(StreamSlot));
+	if (g->ring == NULL) {
+		free(g);
+		return AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+
+	id = ext_table_add(&gGroups, g);
+	if (id < 0) {
+		pthread_cond_destroy(&g->cond);
+		pthread_mutex_destroy(&g->lock);
+		free(g->ring);
+		free(g);
+		return AV_ER_MEM_INSUFF;
+	}
+	return id;
+}
+
+static void viewer_stop(StreamGroup *g, StreamViewer *v)
+{
+	pthread_mutex_lock(&g->lock);
+	v->stopping = 1;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+	pthread_join(v->thread, NULL);
+	free(v);
+}
+
+void avStreamGroupDestroy(int nGroupID)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_take(&gGroups, nGroupID);
+	StreamViewer *v;
+	unsigned int i;
+
+	if (g == NULL)
+		return;
+
+	for (;;) {
+		pthread_mutex_lock(&g->lock);
+		v = g->viewers;
+		if (v != NULL)
+			g->viewers = v->next;
+		pthread_mutex_unlock(&g->lock);
+		if (v == NULL)
+			break;
+		viewer_stop(g, v);
+	}
+
+	for (i = 0; i < g->capacity; i++)
+		avFrameRelease(g->ring[i].frame);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g->ring);
+	free(g);
+}
+
+int avStreamGroupAddViewer(int nGroupID, int nAVChannelID, AVStreamDropPolicy ePolicy, unsigned int nMaxLag)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamViewer *v, *w;
+
+	if (g == NULL || nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+
+	v = (StreamViewer *)calloc(1, sizeof(StreamViewer));
+	if (v == NULL)
+		return AV_ER_MEM_INSUFF;
+	v->group = g;
+	v->av_index = nAVChannelID;
+	v->policy = ePolicy;
+	v->max_lag = nMaxLag != 0 ? nMaxLag : AV_STREAM_GROUP_DEFAULT_MAX_LAG;
+
+	pthread_mutex_lock(&g->lock);
+	for (w = g->viewers; w != NULL; w = w->next) {
+		if (w->av_index == nAVChannelID) {
+			pthread_mutex_unlock(&g->lock);
+			free(v);
+			return AV_ER_INVALID_ARG;
+		}
+	}
+	v->cursor = g->has_key && g->last_key_seq >= group_base(g) ? g->last_key_seq : g->next_seq;
+	v->wait_key = 1;
+	if (pthread_create(&v->thread, NULL, viewer_thread, v) != 0) {
+		pthread_mutex_unlock(&g->lock);
+		free(v);
+		return AV_ER_FAIL_CREATE_THREAD;
+	}
+	v->next = g->viewers;
+	g->viewers = v;
+	pthread_mutex_unlock(&g->lock);
+	return AV_ER_NoERROR;
+}
+
+void avStreamGroupRemoveViewer(int nGroupID, int nAVChannelID)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamViewer **pp, *v = NULL;
+
+	if (g == NULL)
+		return;
+	pthread_mutex_lock(&g->lock);
+	for (pp = &g->viewers; *pp != NULL; pp = &(*pp)->next) {
+		if ((*pp)->av_index == nAVChannelID) {
+			v = *pp;
+			*pp = v->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	if (v != NULL)
+		viewer_stop(g, v);
+}
+
+int avStreamGroupSendFrame(int nGroupID, AVFrame *pFrame, int bKeyFrame)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamSlot *slot;
+	AVFrame *old;
+
+	if (pFrame == NULL)
+		return AV_ER_INVALID_ARG;
+	if (g == NULL) {
+		avFrameRelease(pFrame);
+		return AV_ER_INVALID_ARG;
+	}
+
+	pthread_mutex_lock(&g->lock);
+	slot = &g->ring[g->next_seq % g->capacity];
+	old = slot->frame;
+	if (old != NULL)
+		g->stored_bytes -= (unsigned int)old->dataSize;
+	slot->frame = pFrame;
+	slot->key = bKeyFrame != 0;
+	g->stored_bytes += (unsigned int)pFrame->dataSize;
+	if (slot->key) {
+		g->last_key_seq = g->next_seq;
+		g->has_key = 1;
+	}
+	g->next_seq++;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+
+	avFrameRelease(old);
+	return AV_ER_NoERROR;
+}
+
+int avStreamGroupSendAudio(int nGroupID, const char *cabAudioData, int nAudioDataSize,
+						   const void *cabFrameInfo, int nFrameInfoSize)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamViewer *v;
+	int av_indexes[GROUP_MAX_AUDIO_VIEWERS], count = 0, sent = 0, i;
+
+	if (g == NULL)
+		return AV_ER_INVALID_ARG;
+
+	// Send outside the lock so a slow viewer does not block the video path
+	pthread_mutex_lock(&g->lock);
+	for (v = g->viewers; v != NULL && count < GROUP_MAX_AUDIO_VIEWERS; v = v->next) {
+		if (!v->closed)
+			av_indexes[count++] = v->av_index;
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	for (i = 0; i < count; i++) {
+		if (avSendAudioDataPaced(av_indexes[i], cabAudioData, nAudioDataSize, cabFrameInfo, nFrameInfoSize) >= 0)
+			sent++;
+	}
+	return sent;
+}
+
+int avStreamGroupGetStats(int nGroupID, AVStreamGroupStats *pStats)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamViewer *v;
+
+	if (g == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	memset(pStats, 0, sizeof(*pStats));
+	pthread_mutex_lock(&g->lock);
+	for (v = g->viewers; v != NULL; v = v->next)
+		pStats->viewerCount++;
+	pStats->storedFrames = (unsigned int)(g->next_seq - group_base(g));
+	pStats->storedBytes = g->stored_bytes;
+	pStats->frameCount = g->next_seq;
+	pthread_mutex_unlock(&g->lock);
+	return AV_ER_NoERROR;
+}
+
+int avStreamGroupGetViewerStats(int nGroupID, int nAVChannelID, AVStreamViewerStats *pStats)
+{
+	StreamGroup *g = (StreamGroup *)ext_table_get(&gGroups, nGroupID);
+	StreamViewer *v;
+
+	if (g == NULL || pStats == NULL)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&g->lock);
+	for (v = g->viewers; v != NULL; v = v->next) {
+		if (v->av_index == nAVChannelID) {
+			*pStats = v->stats;
+			pStats->lag = (unsigned int)(g->next_seq > v->cursor ? g->next_seq - v->cursor : 0);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	return v != NULL ? AV_ER_NoERROR : AV_ER_INVALID_ARG;
+}
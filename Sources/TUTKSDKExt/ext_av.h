@@ -0,0 +1,39 @@
+/*! \file ext_av.h
+Internal helpers for modules which send on AV channels.
+ */
+
+#ifndef _EXT_AV_H_
+#define _EXT_AV_H_
+
+#include "AVAPIs.h"
+
+/** Is ret an error after which the AV channel cannot send anything any more? */
+static inline int ext_av_channel_closed(int ret)
+{
+	switch (ret) {
+	case AV_ER_INVALID_ARG:
+	case AV_ER_INVALID_SID:
+	case AV_ER_SESSION_CLOSE_BY_REMOTE:
+	case AV_ER_REMOTE_TIMEOUT_DISCONNECT:
+	case AV_ER_NOT_INITIALIZED:
+	case AV_ER_IOTC_SESSION_CLOSED:
+	case AV_ER_IOTC_DEINITIALIZED:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/** Is a GOP gate attached to the AV channel? Defined in av_gopgate.c. */
+int ext_gopgate_attached(int nAVChannelID);
+
+/** Is the AV channel attached to an IOCtrl dispatcher? Defined in av_ioctrldispatch.c. */
+int ext_ioctrl_dispatched(int nAVChannelID);
+
+/** Does the RPC layer of the AV channel run its own receiver thread? Defined in av_ioctrlrpc.c. */
+int ext_rpc_receiving(int nAVChannelID);
+
+/** Hand a received IO control to the RPC layer. Returns 1 if it was an RPC message. Defined in av_ioctrlrpc.c. */
+int ext_rpc_input(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData, int nDataSize);
+
+#endif /* _EXT_AV_H_ */
@@ -0,0 +1,27 @@
+/*! \file ext_fec.h
+Internal Reed-Solomon codec of av_fec_codec.c, used by the FEC channels of av_fec.c.
+A block has k data and m parity shards of the same length, k + m <= 256 and
+m <= EXT_FEC_MAX_PARITY. Parity row 0 is the XOR of the data shards.
+ */
+
+#ifndef _EXT_FEC_H_
+#define _EXT_FEC_H_
+
+#include "AVFecAPIs.h"
+
+#define EXT_FEC_MAX_PARITY		(AV_FEC_MAX_BLOCK_PACKETS / 2)
+
+/** Compute the m parity shards of the k data shards. */
+void ext_fec_encode(AVFecEngine engine, const unsigned char *const *data, int k,
+					unsigned char *const *parity, int m, int len);
+
+/**
+ * Rebuild the missing data shards in place. shards[0..k-1] are the data and
+ * shards[k..k+m-1] the parity; present[i] tells which ones arrived. Every
+ * shard needs a buffer, and the parity buffers are used as scratch.
+ * Returns 0, or -1 if fewer than k shards are present.
+ */
+int ext_fec_decode(AVFecEngine engine, unsigned char *const *shards, const unsigned char *present,
+				   int k, int m, int len);
+
+#endif /* _EXT_FEC_H_ */
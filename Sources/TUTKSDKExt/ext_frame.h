@@ -0,0 +1,16 @@
+/*! \file ext_frame.h
+Internal access to the frame pool of av_frame.c for other modules.
+ */
+
+#ifndef _EXT_FRAME_H_
+#define _EXT_FRAME_H_
+
+#include "AVFrameAPIs.h"
+
+/**
+ * Take a frame with room for size bytes of data from the pool, with one reference.
+ * Returns NULL if out of memory. Release it by avFrameRelease().
+ */
+AVFrame *ext_frame_alloc(int size);
+
+#endif /* _EXT_FRAME_H_ */
@@ -0,0 +1,51 @@
+/*! \file ext_pacer.h
+Internal view of the session pacers of iotc_pacer.c for other modules.
+ */
+
+#ifndef _EXT_PACER_H_
+#define _EXT_PACER_H_
+
+#include "IOTCPacerAPIs.h"
+
+typedef struct Pacer ExtPacer;
+
+/** The pacer of a session, pinned until ext_pacer_put(); NULL if the session has no pacer. */
+ExtPacer *ext_pacer_get(int nIOTCSessionID);
+
+/** The pacer an AV channel uses, pinned until ext_pacer_put(); NULL if the AV channel is not attached. */
+ExtPacer *ext_pacer_get_av(int nAVChannelID);
+
+void ext_pacer_put(ExtPacer *p);
+
+/** Refill a pacer and read its bucket. tokens may be negative while in debt. */
+void ext_pacer_peek(ExtPacer *p, double *tokens, unsigned int *rate, unsigned int *burst);
+
+/** The statistics of a pacer, as IOTC_Session_Pacer_Get_Stats(). */
+void ext_pacer_get_stats(ExtPacer *p, IOTCPacerStats *stats);
+
+/**
+ * Set the rate of a pacer, 0 to keep the current one, and whether the pacer then adjusts
+ * it by itself. Unlike IOTC_Session_Pacer_Setup() the bucket is not refilled, so it can
+ * be called on every sample of a controller.
+ */
+void ext_pacer_set_rate(ExtPacer *p, unsigned int rate, int auto_rate);
+
+/** The pacer of a session and the binding of its AV channel, taken out by ext_pacer_take(). */
+typedef struct ExtPacerState {
+	ExtPacer *pacer;
+	struct PacerAVBinding *binding;
+} ExtPacerState;
+
+/**
+ * Take the pacer of a session, and the binding of its AV channel if nAVChannelID >= 0, out
+ * of the tables before the session is closed, since the SDK may reuse its ID at once.
+ */
+void ext_pacer_take(int nIOTCSessionID, int nAVChannelID, ExtPacerState *state);
+
+/**
+ * Put what ext_pacer_take() took under the session and AV channel which replaced them
+ * after a reconnection, or release it if nIOTCSessionID < 0.
+ */
+void ext_pacer_restore(ExtPacerState *state, int nIOTCSessionID, int nAVChannelID);
+
+#endif /* _EXT_PACER_H_ */
@@ -0,0 +1,60 @@
+/*! \file ext_platform.h
+Internal helpers shared by the TUTKSDKExt sources: monotonic clock and
+sleep. Not part of the public API.
+ */
+
+#ifndef _EXT_PLATFORM_H_
+#define _EXT_PLATFORM_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+/** Monotonic time in microseconds. */
+static inline uint64_t ext_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/** Monotonic time in milliseconds. */
+static inline uint64_t ext_now_ms(void)
+{
+	return ext_now_us() / 1000ULL;
+}
+
+static inline void ext_sleep_us(uint64_t us)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t)(us / 1000000ULL);
+	ts.tv_nsec = (long)(us % 1000000ULL) * 1000L;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+static inline void ext_sleep_ms(unsigned int ms)
+{
+	ext_sleep_us((uint64_t)ms * 1000ULL);
+}
+
+/**
+ * Wait on a condition variable for at most timeout_ms. The wait is based on
+ * CLOCK_REALTIME since that is what pthread_cond_timedwait() uses by default
+ * on every platform we ship to.
+ */
+static inline int ext_cond_wait_ms(pthread_cond_t *cond, pthread_mutex_t *mutex, unsigned int timeout_ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+#endif /* _EXT_PLATFORM_H_ */
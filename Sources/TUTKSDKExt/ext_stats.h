@@ -0,0 +1,16 @@
+/*! \file ext_stats.h
+Internal hook of the statistics samplers of av_stats.c for the send paths.
+ */
+
+#ifndef _EXT_STATS_H_
+#define _EXT_STATS_H_
+
+#include <stdint.h>
+
+/**
+ * Record a frame sent on an AV channel which started at start_us. Costs one
+ * atomic load when no AV channel is sampled.
+ */
+void ext_stats_frame_sent(int nAVChannelID, uint64_t start_us, int size, int ret, int is_audio);
+
+#endif /* _EXT_STATS_H_ */
@@ -0,0 +1,104 @@
+/*! \file ext_table.h
+Internal table mapping a session ID or AV channel ID to per-ID state.
+Lookups are cheap and thread safe; the caller owns the stored objects and
+must not release one while another thread may still be using it.
+ */
+
+#ifndef _EXT_TABLE_H_
+#define _EXT_TABLE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct ExtTable {
+	pthread_mutex_t lock;
+	void **items;
+	int size;
+} ExtTable;
+
+#define EXT_TABLE_INITIALIZER { PTHREAD_MUTEX_INITIALIZER, NULL, 0 }
+
+static inline void *ext_table_get(ExtTable *t, int id)
+{
+	void *item = NULL;
+
+	if (id < 0)
+		return NULL;
+	pthread_mutex_lock(&t->lock);
+	if (id < t->size)
+		item = t->items[id];
+	pthread_mutex_unlock(&t->lock);
+	return item;
+}
+
+// Caller holds t->lock. Returns -1 if out of memory.
+static inline int ext_table_grow_locked(ExtTable *t, int id)
+{
+	int size = t->size > 0 ? t->size : 32;
+	void **items;
+
+	if (id < t->size)
+		return 0;
+	while (size <= id)
+		size *= 2;
+	items = (void **)realloc(t->items, (size_t)size * sizeof(void *));
+	if (items == NULL)
+		return -1;
+	memset(items + t->size, 0, (size_t)(size - t->size) * sizeof(void *));
+	t->items = items;
+	t->size = size;
+	return 0;
+}
+
+/** Store item at id. Returns -1 if id is negative, out of memory or already used. */
+static inline int ext_table_set(ExtTable *t, int id, void *item)
+{
+	int ret = 0;
+
+	if (id < 0)
+		return -1;
+	pthread_mutex_lock(&t->lock);
+	if (ext_table_grow_locked(t, id) < 0 || t->items[id] != NULL)
+		ret = -1;
+	else
+		t->items[id] = item;
+	pthread_mutex_unlock(&t->lock);
+	return ret;
+}
+
+/** Store item at the lowest free id. Returns the id, or -1 if out of memory. */
+static inline int ext_table_add(ExtTable *t, void *item)
+{
+	int id;
+
+	pthread_mutex_lock(&t->lock);
+	for (id = 0; id < t->size; id++) {
+		if (t->items[id] == NULL)
+			break;
+	}
+	if (ext_table_grow_locked(t, id) < 0)
+		id = -1;
+	else
+		t->items[id] = item;
+	pthread_mutex_unlock(&t->lock);
+	return id;
+}
+
+/** Remove and return the item at id, NULL if there is none. */
+static inline void *ext_table_take(ExtTable *t, int id)
+{
+	void *item = NULL;
+
+	if (id < 0)
+		return NULL;
+	pthread_mutex_lock(&t->lock);
+	if (id < t->size) {
+		item = t->items[id];
+		t->items[id] = NULL;
+	}
+	pthread_mutex_unlock(&t->lock);
+	return item;
+}
+
+#endif /* _EXT_TABLE_H_ */
@@ -0,0 +1,546 @@
+/*! \file iotc_cipher.c
+AES-128-CTR with run time engine selection, see IOTCCipherAPIs.h.
+
+All engines share the FIPS-197 key schedule, stored as round key bytes;
+AES-NI and the ARMv8 AESE instruction consume those bytes directly and the
+portable engine uses them as big-endian words with T-tables. The hardware
+engines keep four counter blocks in flight to hide instruction latency.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "IOTCCipherAPIs.h"
+#include "ext_platform.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+	#define CIPHER_HAVE_AESNI 1
+	#include <cpuid.h>
+	#include <wmmintrin.h>
+	#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+	#define CIPHER_HAVE_ARMV8 1
+	#include <arm_neon.h>
+	// Built for the cryptography extension whatever the -march, and only run where getauxval() reports it
+	#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+		#define CIPHER_ARMV8_TARGET
+	#elif defined(__clang__)
+		#define CIPHER_ARMV8_TARGET __attribute__((target("crypto")))
+	#else
+		#define CIPHER_ARMV8_TARGET __attribute__((target("+crypto")))
+	#endif
+	#if defined(__linux__)
+		#include <sys/auxv.h>
+		#ifndef HWCAP_AES
+			#define HWCAP_AES (1 << 3)
+		#endif
+	#endif
+#endif
+
+#define AES128_ROUNDS		10
+#define AES_BLOCK			16
+
+struct IOTCCipherCtx {
+	unsigned char rk[(AES128_ROUNDS + 1) * AES_BLOCK];
+	uint32_t rkw[(AES128_ROUNDS + 1) * 4];
+	IOTCCipherEngine engine;
+};
+
+static unsigned char gSbox[256];
+static uint32_t gTe0[256], gTe1[256], gTe2[256], gTe3[256];
+static pthread_once_t gTableOnce = PTHREAD_ONCE_INIT;
+static IOTCCipherEngine gDetectedEngine = IOTC_CIPHER_ENGINE_PORTABLE;
+static IOTCCipherEngine gForcedEngine = IOTC_CIPHER_ENGINE_AUTO;
+
+static uint32_t cipher_ror8(uint32_t x)
+{
+	return (x >> 8) | (x << 24);
+}
+
+static unsigned char cipher_xtime(unsigned char x)
+{
+	return (unsigned char)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+static int cipher_detect_aesni(void)
+{
+#ifdef CIPHER_HAVE_AESNI
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	// ECX bit 25: AES, EDX bit 26: SSE2
+	return (ecx & (1u << 25)) && (edx & (1u << 26));
+#else
+	return 0;
+#endif
+}
+
+static int cipher_detect_armv8(void)
+{
+#ifdef CIPHER_HAVE_ARMV8
+	#if defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+	#else
+	// Every arm64 Apple device implements the cryptography extension
+	return 1;
+	#endif
+#else
+	return 0;
+#endif
+}
+
+static void cipher_init_tables(void)
+{
+	unsigned char p = 1, q = 1;
+	int i;
+
+	// Walk the multiplicative group with generator 3 to get inverses, then apply the affine map
+	do {
+		unsigned char x;
+		p = (unsigned char)(p ^ cipher_xtime(p));
+		q ^= (unsigned char)(q << 1);
+		q ^= (unsigned char)(q << 2);
+		q ^= (unsigned char)(q << 4);
+		if (q & 0x80)
+			q ^= 0x09;
+		x = (unsigned char)(q ^ (q << 1 | q >> 7) ^ (q << 2 | q >> 6) ^ (q << 3 | q >> 5) ^ (q << 4 | q >> 4));
+		gSbox[p] = (unsigned char)(x ^ 0x63);
+	} while (p != 1);
+	gSbox[0] = 0x63;
+
+	for (i = 0; i < 256; i++) {
+		unsigned char s = gSbox[i];
+		unsigned char s2 = cipher_xtime(s);
+		unsigned char s3 = (unsigned char)(s2 ^ s);
+		gTe0[i] = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | s3;
+		gTe1[i] = cipher_ror8(gTe0[i]);
+		gTe2[i] = cipher_ror8(gTe1[i]);
+		gTe3[i] = cipher_ror8(gTe2[i]);
+	}
+
+	if (cipher_detect_armv8())
+		gDetectedEngine = IOTC_CIPHER_ENGINE_ARMV8;
+	else if (cipher_detect_aesni())
+		gDetectedEngine = IOTC_CIPHER_ENGINE_AESNI;
+	else
+		gDetectedEngine = IOTC_CIPHER_ENGINE_PORTABLE;
+}
+
+static void cipher_init(void)
+{
+	pthread_once(&gTableOnce, cipher_init_tables);
+}
+
+static uint32_t cipher_load_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void cipher_store_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static void cipher_expand_key(IOTCCipherCtx *ctx, const unsigned char *key)
+{
+	static const unsigned char rcon[AES128_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+	uint32_t *w = ctx->rkw;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		w[i] = cipher_load_be32(key + 4 * i);
+	for (i = 4; i < (AES128_ROUNDS + 1) * 4; i++) {
+		uint32_t t = w[i - 1];
+		if (i % 4 == 0) {
+			t = (t << 8) | (t >> 24);
+			t = ((uint32_t)gSbox[t >> 24] << 24) | ((uint32_t)gSbox[(t >> 16) & 0xff] << 16) |
+				((uint32_t)gSbox[(t >> 8) & 0xff] << 8) | gSbox[t & 0xff];
+			t ^= (uint32_t)rcon[i / 4 - 1] << 24;
+		}
+		w[i] = w[i - 4] ^ t;
+	}
+	for (i = 0; i < (AES128_ROUNDS + 1) * 4; i++)
+		cipher_store_be32(ctx->rk + 4 * i, w[i]);
+}
+
+static void cipher_ctr_increment(unsigned char *ctr)
+{
+	int i;
+	for (i = AES_BLOCK - 1; i >= 0; i--) {
+		if (++ctr[i] != 0)
+			break;
+	}
+}
+
+static void cipher_ctr_add(unsigned char *ctr, uint64_t n)
+{
+	int i;
+	for (i = AES_BLOCK - 1; i >= 0 && n != 0; i--) {
+		uint64_t sum = (uint64_t)ctr[i] + (n & 0xff);
+		ctr[i] = (unsigned char)sum;
+		n = (n >> 8) + (sum >> 8);
+	}
+}
+
+/* ============================================================================
+ * Portable engine
+ * ============================================================================
+ */
+
+static void cipher_portable_block(const IOTCCipherCtx *ctx, const unsigned char *in, unsigned char *out)
+{
+	const uint32_t *rk = ctx->rkw;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+	int r;
+
+	s0 = cipher_load_be32(in) ^ rk[0];
+	s1 = cipher_load_be32(in + 4) ^ rk[1];
+	s2 = cipher_load_be32(in + 8) ^ rk[2];
+	s3 = cipher_load_be32(in + 12) ^ rk[3];
+
+	for (r = 1; r < AES128_ROUNDS; r++) {
+		rk += 4;
+		t0 = gTe0[s0 >> 24] ^ gTe1[(s1 >> 16) & 0xff] ^ gTe2[(s2 >> 8) & 0xff] ^ gTe3[s3 & 0xff] ^ rk[0];
+		t1 = gTe0[s1 >> 24] ^ gTe1[(s2 >> 16) & 0xff] ^ gTe2[(s3 >> 8) & 0xff] ^ gTe3[s0 & 0xff] ^ rk[1];
+		t2 = gTe0[s2 >> 24] ^ gTe1[(s3 >> 16) & 0xff] ^ gTe2[(s0 >> 8) & 0xff] ^ gTe3[s1 & 0xff] ^ rk[2];
+		t3 = gTe0[s3 >> 24] ^ gTe1[(s0 >> 16) & 0xff] ^ gTe2[(s1 >> 8) & 0xff] ^ gTe3[s2 & 0xff] ^ rk[3];
+		s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+	}
+
+	rk += 4;
+	t0 = ((uint32_t)gSbox[s0 >> 24] << 24) ^ ((uint32_t)gSbox[(s1 >> 16) & 0xff] << 16) ^
+		 ((uint32_t)gSbox[(s2 >> 8) & 0xff] << 8) ^ gSbox[s3 & 0xff] ^ rk[0];
+	t1 = ((uint32_t)gSbox[s1 >> 24] << 24) ^ ((uint32_t)gSbox[(s2 >> 16) & 0xff] << 16) ^
+		 ((uint32_t)gSbox[(s3 >> 8) & 0xff] << 8) ^ gSbox[s0 & 0xff] ^ rk[1];
+	t2 = ((uint32_t)gSbox[s2 >> 24] << 24) ^ ((uint32_t)gSbox[(s3 >> 16) & 0xff] << 16) ^
+		 ((uint32_t)gSbox[(s0 >> 8) & 0xff] << 8) ^ gSbox[s1 & 0xff] ^ rk[2];
+	t3 = ((uint32_t)gSbox[s3 >> 24] << 24) ^ ((uint32_t)gSbox[(s0 >> 16) & 0xff] << 16) ^
+		 ((uint32_t)gSbox[(s1 >> 8) & 0xff] << 8) ^ gSbox[s2 & 0xff] ^ rk[3];
+
+	cipher_store_be32(out, t0);
+	cipher_store_be32(out + 4, t1);
+	cipher_store_be32(out + 8, t2);
+	cipher_store_be32(out + 12, t3);
+}
+
+static void cipher_portable_ctr(const IOTCCipherCtx *ctx, unsigned char *ctr,
+								const unsigned char *in, unsigned char *out, size_t len)
+{
+	unsigned char ks[AES_BLOCK];
+	size_t i, n;
+
+	while (len > 0) {
+		cipher_portable_block(ctx, ctr, ks);
+		cipher_ctr_increment(ctr);
+		n = len < AES_BLOCK ? len : AES_BLOCK;
+		for (i = 0; i < n; i++)
+			out[i] = in[i] ^ ks[i];
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+
+/* ============================================================================
+ * AES-NI engine
+ * ============================================================================
+ */
+
+#ifdef CIPHER_HAVE_AESNI
+__attribute__((target("sse2,aes")))
+static void cipher_aesni_ctr(const IOTCCipherCtx *ctx, unsigned char *ctr,
+							 const unsigned char *in, unsigned char *out, size_t len)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	unsigned char cb[4][AES_BLOCK];
+	int r, j;
+
+	for (r = 0; r <= AES128_ROUNDS; r++)
+		rk[r] = _mm_loadu_si128((const __m128i *)(ctx->rk + r * AES_BLOCK));
+
+	while (len >= 4 * AES_BLOCK) {
+		__m128i b0, b1, b2, b3;
+		for (j = 0; j < 4; j++) {
+			memcpy(cb[j], ctr, AES_BLOCK);
+			cipher_ctr_increment(ctr);
+		}
+		b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)cb[0]), rk[0]);
+		b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)cb[1]), rk[0]);
+		b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)cb[2]), rk[0]);
+		b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)cb[3]), rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			b0 = _mm_aesenc_si128(b0, rk[r]);
+			b1 = _mm_aesenc_si128(b1, rk[r]);
+			b2 = _mm_aesenc_si128(b2, rk[r]);
+			b3 = _mm_aesenc_si128(b3, rk[r]);
+		}
+		b0 = _mm_aesenclast_si128(b0, rk[AES128_ROUNDS]);
+		b1 = _mm_aesenclast_si128(b1, rk[AES128_ROUNDS]);
+		b2 = _mm_aesenclast_si128(b2, rk[AES128_ROUNDS]);
+		b3 = _mm_aesenclast_si128(b3, rk[AES128_ROUNDS]);
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *)in)));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *)(in + 16))));
+		_mm_storeu_si128((__m128i *)(out + 32), _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *)(in + 32))));
+		_mm_storeu_si128((__m128i *)(out + 48), _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *)(in + 48))));
+		in += 4 * AES_BLOCK;
+		out += 4 * AES_BLOCK;
+		len -= 4 * AES_BLOCK;
+	}
+
+	while (len > 0) {
+		unsigned char ks[AES_BLOCK];
+		size_t i, n = len < AES_BLOCK ? len : AES_BLOCK;
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)ctr), rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++)
+			b = _mm_aesenc_si128(b, rk[r]);
+		b = _mm_aesenclast_si128(b, rk[AES128_ROUNDS]);
+		_mm_storeu_si128((__m128i *)ks, b);
+		cipher_ctr_increment(ctr);
+		for (i = 0; i < n; i++)
+			out[i] = in[i] ^ ks[i];
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+#endif
+
+/* ============================================================================
+ * ARMv8 cryptography extension engine
+ * ============================================================================
+ */
+
+#ifdef CIPHER_HAVE_ARMV8
+CIPHER_ARMV8_TARGET
+static inline uint8x16_t cipher_armv8_block(uint8x16_t b, const uint8x16_t *rk)
+{
+	int r;
+	for (r = 0; r < AES128_ROUNDS - 1; r++)
+		b = vaesmcq_u8(vaeseq_u8(b, rk[r]));
+	b = vaeseq_u8(b, rk[AES128_ROUNDS - 1]);
+	return veorq_u8(b, rk[AES128_ROUNDS]);
+}
+
+CIPHER_ARMV8_TARGET
+static void cipher_armv8_ctr(const IOTCCipherCtx *ctx, unsigned char *ctr,
+							 const unsigned char *in, unsigned char *out, size_t len)
+{
+	uint8x16_t rk[AES128_ROUNDS + 1];
+	unsigned char cb[4][AES_BLOCK];
+	int r, j;
+
+	for (r = 0; r <= AES128_ROUNDS; r++)
+		rk[r] = vld1q_u8(ctx->rk + r * AES_BLOCK);
+
+	while (len >= 4 * AES_BLOCK) {
+		uint8x16_t b0, b1, b2, b3;
+		for (j = 0; j < 4; j++) {
+			memcpy(cb[j], ctr, AES_BLOCK);
+			cipher_ctr_increment(ctr);
+		}
+		b0 = vld1q_u8(cb[0]);
+		b1 = vld1q_u8(cb[1]);
+		b2 = vld1q_u8(cb[2]);
+		b3 = vld1q_u8(cb[3]);
+		for (r = 0; r < AES128_ROUNDS - 1; r++) {
+			b0 = vaesmcq_u8(vaeseq_u8(b0, rk[r]));
+			b1 = vaesmcq_u8(vaeseq_u8(b1, rk[r]));
+			b2 = vaesmcq_u8(vaeseq_u8(b2, rk[r]));
+			b3 = vaesmcq_u8(vaeseq_u8(b3, rk[r]));
+		}
+		b0 = veorq_u8(vaeseq_u8(b0, rk[AES128_ROUNDS - 1]), rk[AES128_ROUNDS]);
+		b1 = veorq_u8(vaeseq_u8(b1, rk[AES128_ROUNDS - 1]), rk[AES128_ROUNDS]);
+		b2 = veorq_u8(vaeseq_u8(b2, rk[AES128_ROUNDS - 1]), rk[AES128_ROUNDS]);
+		b3 = veorq_u8(vaeseq_u8(b3, rk[AES128_ROUNDS - 1]), rk[AES128_ROUNDS]);
+		vst1q_u8(out, veorq_u8(b0, vld1q_u8(in)));
+		vst1q_u8(out + 16, veorq_u8(b1, vld1q_u8(in + 16)));
+		vst1q_u8(out + 32, veorq_u8(b2, vld1q_u8(in + 32)));
+		vst1q_u8(out + 48, veorq_u8(b3, vld1q_u8(in + 48)));
+		in += 4 * AES_BLOCK;
+		out += 4 * AES_BLOCK;
+		len -= 4 * AES_BLOCK;
+	}
+
+	while (len > 0) {
+		unsigned char ks[AES_BLOCK];
+		size_t i, n = len < AES_BLOCK ? len : AES_BLOCK;
+		vst1q_u8(ks, cipher_armv8_block(vld1q_u8(ctr), rk));
+		cipher_ctr_increment(ctr);
+		for (i = 0; i < n; i++)
+			out[i] = in[i] ^ ks[i];
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+#endif
+
+/* ============================================================================
+ * Dispatch
+ * ============================================================================
+ */
+
+static void cipher_ctr_dispatch(const IOTCCipherCtx *ctx, unsigned char *ctr,
+								const unsigned char *in, unsigned char *out, size_t len)
+{
+	switch (ctx->engine) {
+#ifdef CIPHER_HAVE_AESNI
+	case IOTC_CIPHER_ENGINE_AESNI:
+		cipher_aesni_ctr(ctx, ctr, in, out, len);
+		break;
+#endif
+#ifdef CIPHER_HAVE_ARMV8
+	case IOTC_CIPHER_ENGINE_ARMV8:
+		cipher_armv8_ctr(ctx, ctr, in, out, len);
+		break;
+#endif
+	default:
+		cipher_portable_ctr(ctx, ctr, in, out, len);
+		break;
+	}
+}
+
+int IOTC_Cipher_Engine_Supported(IOTCCipherEngine engine)
+{
+	cipher_init();
+	switch (engine) {
+	case IOTC_CIPHER_ENGINE_AUTO:
+	case IOTC_CIPHER_ENGINE_PORTABLE:
+		return 1;
+	case IOTC_CIPHER_ENGINE_AESNI:
+		return cipher_detect_aesni();
+	case IOTC_CIPHER_ENGINE_ARMV8:
+		return cipher_detect_armv8();
+	default:
+		return 0;
+	}
+}
+
+IOTCCipherEngine IOTC_Cipher_Get_Engine(void)
+{
+	cipher_init();
+	return gForcedEngine != IOTC_CIPHER_ENGINE_AUTO ? gForcedEngine : gDetectedEngine;
+}
+
+int IOTC_Cipher_Set_Engine(IOTCCipherEngine engine)
+{
+	if (engine < IOTC_CIPHER_ENGINE_AUTO || engine > IOTC_CIPHER_ENGINE_ARMV8)
+		return IOTC_ER_INVALID_ARG;
+	if (!IOTC_Cipher_Engine_Supported(engine))
+		return IOTC_ER_NOT_SUPPORT;
+	gForcedEngine = engine;
+	return IOTC_ER_NoERROR;
+}
+
+static IOTCCipherCtx *cipher_create(const unsigned char *key, IOTCCipherEngine engine)
+{
+	IOTCCipherCtx *ctx = (IOTCCipherCtx *)malloc(sizeof(IOTCCipherCtx));
+	if (ctx == NULL)
+		return NULL;
+	cipher_expand_key(ctx, key);
+	ctx->engine = engine;
+	return ctx;
+}
+
+int IOTC_Cipher_Create(const unsigned char *key, IOTCCipherCtx **ppCtx)
+{
+	if (key == NULL || ppCtx == NULL)
+		return IOTC_ER_INVALID_ARG;
+	*ppCtx = cipher_create(key, IOTC_Cipher_Get_Engine());
+	return *ppCtx != NULL ? IOTC_ER_NoERROR : IOTC_ER_NOT_ENOUGH_MEMORY;
+}
+
+void IOTC_Cipher_Delete(IOTCCipherCtx *pCtx)
+{
+	if (pCtx != NULL) {
+		memset(pCtx, 0, sizeof(IOTCCipherCtx));
+		free(pCtx);
+	}
+}
+
+int IOTC_Cipher_CTR(const IOTCCipherCtx *pCtx, const unsigned char *iv,
+					const unsigned char *in, unsigned char *out, unsigned int nSize)
+{
+	unsigned char ctr[AES_BLOCK];
+
+	if (pCtx == NULL || iv == NULL || in == NULL || out == NULL)
+		return IOTC_ER_INVALID_ARG;
+	memcpy(ctr, iv, AES_BLOCK);
+	cipher_ctr_dispatch(pCtx, ctr, in, out, nSize);
+	return IOTC_ER_NoERROR;
+}
+
+int IOTC_Cipher_CTR_Partial(const IOTCCipherCtx *pCtx, const unsigned char *iv,
+							unsigned char *buf, unsigned int nSize,
+							unsigned int nPacketSize, unsigned int nPartialSize)
+{
+	unsigned char ctr[AES_BLOCK];
+	unsigned int offset;
+	uint64_t index = 0;
+
+	if (pCtx == NULL || iv == NULL || buf == NULL)
+		return IOTC_ER_INVALID_ARG;
+	if (nPacketSize == 0)
+		nPacketSize = IOTC_MAX_PACKET_SIZE;
+	if (nPartialSize == 0)
+		nPartialSize = IOTC_CIPHER_DEFAULT_PARTIAL_SIZE;
+	if (nPartialSize > nPacketSize)
+		nPartialSize = nPacketSize;
+
+	// Each packet gets its own counter range so packets can be decrypted independently
+	for (offset = 0; offset < nSize; offset += nPacketSize, index++) {
+		unsigned int n = nSize - offset < nPartialSize ? nSize - offset : nPartialSize;
+		memcpy(ctr, iv, AES_BLOCK);
+		cipher_ctr_add(ctr, index * ((nPacketSize + AES_BLOCK - 1) / AES_BLOCK));
+		cipher_ctr_dispatch(pCtx, ctr, buf + offset, buf + offset, n);
+	}
+	return IOTC_ER_NoERROR;
+}
+
+int IOTC_Cipher_Benchmark(IOTCCipherEngine engine, unsigned int nPartialSize,
+						  unsigned int nDurationMs, float *pfMBps)
+{
+	static const unsigned char key[IOTC_CIPHER_KEY_LENGTH] = { 0 };
+	const unsigned int packets = 64;
+	unsigned char iv[AES_BLOCK] = { 0 };
+	unsigned int size = packets * IOTC_MAX_PACKET_SIZE;
+	unsigned char *buf;
+	IOTCCipherCtx *ctx;
+	uint64_t start, elapsed, bytes = 0;
+
+	if (pfMBps == NULL || nDurationMs == 0)
+		return IOTC_ER_INVALID_ARG;
+	if (!IOTC_Cipher_Engine_Supported(engine))
+		return IOTC_ER_NOT_SUPPORT;
+	if (engine == IOTC_CIPHER_ENGINE_AUTO)
+		engine = IOTC_Cipher_Get_Engine();
+
+	buf = (unsigned char *)calloc(1, size);
+	ctx = cipher_create(key, engine);
+	if (buf == NULL || ctx == NULL) {
+		free(buf);
+		IOTC_Cipher_Delete(ctx);
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	}
+
+	start = ext_now_us();
+	do {
+		if (nPartialSize == 0)
+			IOTC_Cipher_CTR(ctx, iv, buf, buf, size);
+		else
+			IOTC_Cipher_CTR_Partial(ctx, iv, buf, size, IOTC_MAX_PACKET_SIZE, nPartialSize);
+		bytes += size;
+		iv[0]++;
+		elapsed = ext_now_us() - start;
+	} while (elapsed < (uint64_t)nDurationMs * 1000ULL);
+
+	*pfMBps = (float)((double)bytes / (double)elapsed);
+	free(buf);
+	IOTC_Cipher_Delete(ctx);
+	return IOTC_ER_NoERROR;
+}
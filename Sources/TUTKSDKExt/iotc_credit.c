@@ -0,0 +1,392 @@
+/*! \file iotc_credit.c
+Send credits and writable notifications, see IOTCCreditAPIs.h.
+
+Credits come from two places: the token bucket of a session pacer, which
+refills at a known rate so the time it reaches a given level can be
+computed, and the AV resend buffer, which can only be polled. Armed
+callbacks are checked by one credit thread that sleeps until the earliest
+computed deadline, or IOTC_CREDIT_POLL_INTERVAL when polling is needed.
+Neither ever holds more than its size, so waiting for more bytes than that
+waits for a full bucket or an empty resend buffer instead.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "IOTCCreditAPIs.h"
+#include "ext_platform.h"
+#include "ext_pacer.h"
+
+#define CREDIT_CLOSE_CHECK_MS		1000	// how often watches of closed sessions are dropped
+
+typedef enum {
+	CREDIT_WATCH_IOTC,
+	CREDIT_WATCH_AV
+} CreditWatchType;
+
+typedef struct CreditWatch {
+	CreditWatchType type;
+	int id;					// session ID or AV channel ID
+	unsigned char channel;
+	unsigned int low_water;
+	int armed;
+	IOTCWritableFn iotc_fn;
+	avWritableFn av_fn;
+	void *user_data;
+	struct CreditWatch *next;
+} CreditWatch;
+
+static pthread_mutex_t gCreditLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gCreditCond = PTHREAD_COND_INITIALIZER;
+static CreditWatch *gWatches = NULL;
+static int gCreditThreadRunning = 0;
+static pthread_t gCreditThread;
+
+/**
+ * Credit of a pinned pacer. Lowers *want to the burst, the most credit the bucket
+ * holds, and sets *refill_us to the microseconds until it refills to *want.
+ */
+static int credit_pacer(ExtPacer *p, unsigned int *want, uint64_t *refill_us)
+{
+	double tokens;
+	unsigned int rate, burst;
+
+	ext_pacer_peek(p, &tokens, &rate, &burst);
+	if (*want > burst)
+		*want = burst;
+	*refill_us = 0;
+	if (tokens < (double)*want && rate > 0)
+		*refill_us = (uint64_t)(((double)*want - tokens) * 1000000.0 / (double)rate) + 1;
+	return tokens > 0 ? (tokens > INT_MAX ? INT_MAX : (int)tokens) : 0;
+}
+
+/** Credit of the pacer of a session, see credit_pacer(). Returns -1 if there is none. */
+static int credit_from_pacer(int sid, unsigned int *want, uint64_t *refill_us)
+{
+	ExtPacer *p = ext_pacer_get(sid);
+	int credit;
+
+	if (p == NULL)
+		return -1;
+	credit = credit_pacer(p, want, refill_us);
+	ext_pacer_put(p);
+	return credit;
+}
+
+/** Credit of an AV channel, see credit_pacer(). Sets *polled if the resend buffer limited it. */
+static int credit_av(int nAVChannelID, unsigned int *want, uint64_t *refill_us, int *polled)
+{
+	unsigned int size_kb = 0;
+	float usage;
+	int credit = -1, pacer_credit;
+	ExtPacer *p = ext_pacer_get_av(nAVChannelID);
+
+	*refill_us = 0;
+	*polled = 0;
+
+	if (avServGetResendSize(nAVChannelID, &size_kb) == AV_ER_NoERROR && size_kb > 0) {
+		usage = avResendBufUsageRate(nAVChannelID);
+		if (usage >= 0.0f) {
+			double free_bytes = (double)size_kb * 1024.0 * (1.0 - (usage > 1.0f ? 1.0 : (double)usage));
+			credit = (int)free_bytes;
+			if (*want > size_kb * 1024)
+				*want = size_kb * 1024;
+			if ((unsigned int)credit < *want)
+				*polled = 1;
+		}
+	}
+
+	if (p != NULL) {
+		pacer_credit = credit_pacer(p, want, refill_us);
+		if (credit < 0 || pacer_credit < credit)
+			credit = pacer_credit;
+		ext_pacer_put(p);
+	}
+	return credit >= 0 ? credit : AV_ER_NOT_SUPPORT;
+}
+
+/** Is the session or AV channel of a watch gone, so that it can never fire? */
+static int credit_watch_closed(const CreditWatch *w)
+{
+	struct st_SInfoEx info;
+	unsigned int size_kb;
+	ExtPacer *p;
+
+	if (w->type == CREDIT_WATCH_AV)
+		return avServGetResendSize(w->id, &size_kb) == AV_ER_INVALID_ARG;
+	p = ext_pacer_get(w->id);
+	if (p == NULL)
+		return 1;
+	ext_pacer_put(p);
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	return IOTC_Session_Check_Ex(w->id, &info) < 0;
+}
+
+// Caller holds gCreditLock
+static void credit_drop_closed(void)
+{
+	CreditWatch **pp = &gWatches, *w;
+
+	while ((w = *pp) != NULL) {
+		if (credit_watch_closed(w)) {
+			*pp = w->next;
+			free(w);
+		} else {
+			pp = &w->next;
+		}
+	}
+}
+
+// Arm the matching watch if credit is below its low water. Caller must not hold gCreditLock.
+static void credit_arm(CreditWatchType type, int id, unsigned char channel, int credit)
+{
+	CreditWatch *w;
+	int armed = 0;
+
+	pthread_mutex_lock(&gCreditLock);
+	for (w = gWatches; w != NULL; w = w->next) {
+		if (w->type == type && w->id == id && (type == CREDIT_WATCH_AV || w->channel == channel) &&
+			(unsigned int)credit < w->low_water && !w->armed) {
+			w->armed = 1;
+			armed = 1;
+		}
+	}
+	if (armed)
+		pthread_cond_signal(&gCreditCond);
+	pthread_mutex_unlock(&gCreditLock);
+}
+
+static void *credit_thread(void *arg)
+{
+	uint64_t next_check_us = ext_now_us() + CREDIT_CLOSE_CHECK_MS * 1000ULL;
+
+	(void)arg;
+
+	pthread_mutex_lock(&gCreditLock);
+	while (gWatches != NULL) {
+		CreditWatch *w;
+		uint64_t sleep_us = UINT64_MAX, now = ext_now_us();
+		unsigned int ms;
+		int fired = 0;
+
+		if (now >= next_check_us) {
+			credit_drop_closed();
+			next_check_us = now + CREDIT_CLOSE_CHECK_MS * 1000ULL;
+			continue;
+		}
+
+		for (w = gWatches; w != NULL; w = w->next) {
+			uint64_t refill_us = 0;
+			unsigned int want = w->low_water;
+			int polled = 0, credit;
+
+			if (!w->armed)
+				continue;
+			if (w->type == CREDIT_WATCH_IOTC)
+				credit = credit_from_pacer(w->id, &want, &refill_us);
+			else
+				credit = credit_av(w->id, &want, &refill_us, &polled);
+
+			if (credit >= 0 && (unsigned int)credit >= want) {
+				// The watch may be removed while the callback runs, so call through a copy
+				// and restart the scan afterwards instead of following w->next
+				CreditWatch fire = *w;
+				w->armed = 0;
+				pthread_mutex_unlock(&gCreditLock);
+				if (fire.type == CREDIT_WATCH_IOTC)
+					fire.iotc_fn(fire.id, fire.channel, credit, fire.user_data);
+				else
+					fire.av_fn(fire.id, credit, fire.user_data);
+				pthread_mutex_lock(&gCreditLock);
+				fired = 1;
+				break;
+			}
+
+			if (credit < 0 || polled || refill_us == 0)
+				refill_us = (uint64_t)IOTC_CREDIT_POLL_INTERVAL * 1000ULL;
+			if (refill_us < sleep_us)
+				sleep_us = refill_us;
+		}
+		if (fired)
+			continue;
+
+		// Even with nothing armed, wake up for the next check of closed sessions
+		if (sleep_us > next_check_us - now)
+			sleep_us = next_check_us - now;
+		ms = (unsigned int)((sleep_us + 999) / 1000);
+		ext_cond_wait_ms(&gCreditCond, &gCreditLock, ms > 0 ? ms : 1);
+	}
+	gCreditThreadRunning = 0;
+	pthread_mutex_unlock(&gCreditLock);
+	return NULL;
+}
+
+/** Add, update or remove a watch. Returns 0, or -1 out of memory, -2 thread failure. */
+static int credit_set_watch(CreditWatchType type, int id, unsigned char channel, unsigned int low_water,
+							IOTCWritableFn iotc_fn, avWritableFn av_fn, void *user_data, int credit)
+{
+	CreditWatch **pp, *w;
+	int remove = iotc_fn == NULL && av_fn == NULL;
+	int ret = 0;
+
+	pthread_mutex_lock(&gCreditLock);
+	for (pp = &gWatches; *pp != NULL; pp = &(*pp)->next) {
+		w = *pp;
+		if (w->type == type && w->id == id && (type == CREDIT_WATCH_AV || w->channel == channel))
+			break;
+	}
+
+	w = *pp;
+	if (remove) {
+		if (w != NULL) {
+			*pp = w->next;
+			free(w);
+		}
+		pthread_cond_signal(&gCreditCond);
+		pthread_mutex_unlock(&gCreditLock);
+		return 0;
+	}
+
+	if (w == NULL) {
+		w = (CreditWatch *)calloc(1, sizeof(CreditWatch));
+		if (w == NULL) {
+			pthread_mutex_unlock(&gCreditLock);
+			return -1;
+		}
+		w->type = type;
+		w->id = id;
+		w->channel = channel;
+		w->next = gWatches;
+		gWatches = w;
+	}
+	w->low_water = low_water;
+	w->iotc_fn = iotc_fn;
+	w->av_fn = av_fn;
+	w->user_data = user_data;
+	w->armed = credit < 0 || (unsigned int)credit < low_water;
+
+	if (!gCreditThreadRunning) {
+		if (pthread_create(&gCreditThread, NULL, credit_thread, NULL) != 0) {
+			gWatches = w->next;
+			free(w);
+			ret = -2;
+		} else {
+			pthread_detach(gCreditThread);
+			gCreditThreadRunning = 1;
+		}
+	}
+	pthread_cond_signal(&gCreditCond);
+	pthread_mutex_unlock(&gCreditLock);
+	return ret;
+}
+
+int IOTC_Session_Get_Credit(int nIOTCSessionID, unsigned char nIOTCChannelID)
+{
+	unsigned int want = 0;
+	uint64_t refill_us;
+	int credit = credit_from_pacer(nIOTCSessionID, &want, &refill_us);
+
+	if (credit < 0)
+		return IOTC_ER_INVALID_SID;
+	credit_arm(CREDIT_WATCH_IOTC, nIOTCSessionID, nIOTCChannelID, credit);
+	return credit;
+}
+
+int IOTC_Session_Wait_Writable(int nIOTCSessionID, unsigned char nIOTCChannelID,
+							   unsigned int nBytes, unsigned int nTimeout)
+{
+	uint64_t deadline = ext_now_us() + (uint64_t)nTimeout * 1000ULL;
+
+	(void)nIOTCChannelID;
+	for (;;) {
+		uint64_t refill_us, now;
+		unsigned int want = nBytes;
+		int credit = credit_from_pacer(nIOTCSessionID, &want, &refill_us);
+
+		if (credit < 0)
+			return IOTC_ER_INVALID_SID;
+		if ((unsigned int)credit >= want)
+			return credit;
+		now = ext_now_us();
+		if (now >= deadline)
+			return IOTC_ER_TIMEOUT;
+		ext_sleep_us(refill_us < deadline - now ? refill_us : deadline - now);
+	}
+}
+
+int IOTC_Session_Set_Writable_Callback(int nIOTCSessionID, unsigned char nIOTCChannelID, unsigned int nLowWater,
+									   IOTCWritableFn pfxWritableFn, void *pUserData)
+{
+	unsigned int want = 0;
+	uint64_t refill_us;
+	int credit = credit_from_pacer(nIOTCSessionID, &want, &refill_us);
+	int ret;
+
+	if (credit < 0 && pfxWritableFn != NULL)
+		return IOTC_ER_INVALID_SID;
+	ret = credit_set_watch(CREDIT_WATCH_IOTC, nIOTCSessionID, nIOTCChannelID, nLowWater,
+						   pfxWritableFn, NULL, pUserData, credit);
+	if (ret == -1)
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	if (ret == -2)
+		return IOTC_ER_FAIL_CREATE_THREAD;
+	return IOTC_ER_NoERROR;
+}
+
+int avServGetCredit(int nAVChannelID)
+{
+	unsigned int want = 0;
+	uint64_t refill_us;
+	int polled, credit;
+
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+	credit = credit_av(nAVChannelID, &want, &refill_us, &polled);
+	if (credit >= 0)
+		credit_arm(CREDIT_WATCH_AV, nAVChannelID, 0, credit);
+	return credit;
+}
+
+int avServWaitWritable(int nAVChannelID, unsigned int nBytes, unsigned int nTimeout)
+{
+	uint64_t deadline = ext_now_us() + (uint64_t)nTimeout * 1000ULL;
+
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+	for (;;) {
+		uint64_t refill_us, now, sleep_us;
+		unsigned int want = nBytes;
+		int polled, credit = credit_av(nAVChannelID, &want, &refill_us, &polled);
+
+		if (credit < 0)
+			return credit;
+		if ((unsigned int)credit >= want)
+			return credit;
+		now = ext_now_us();
+		if (now >= deadline)
+			return AV_ER_TIMEOUT;
+		sleep_us = polled || refill_us == 0 ? (uint64_t)IOTC_CREDIT_POLL_INTERVAL * 1000ULL : refill_us;
+		ext_sleep_us(sleep_us < deadline - now ? sleep_us : deadline - now);
+	}
+}
+
+int avServSetWritableCallback(int nAVChannelID, unsigned int nLowWater,
+							  avWritableFn pfxWritableFn, void *pUserData)
+{
+	unsigned int want = 0;
+	uint64_t refill_us;
+	int polled, credit = 0, ret;
+
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+	if (pfxWritableFn != NULL)
+		credit = credit_av(nAVChannelID, &want, &refill_us, &polled);
+	ret = credit_set_watch(CREDIT_WATCH_AV, nAVChannelID, 0, nLowWater, NULL, pfxWritableFn, pUserData, credit);
+	if (ret == -1)
+		return AV_ER_MEM_INSUFF;
+	if (ret == -2)
+		return AV_ER_FAIL_CREATE_THREAD;
+	return AV_ER_NoERROR;
+}
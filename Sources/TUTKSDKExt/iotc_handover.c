@@ -0,0 +1,477 @@
+/*! \file iotc_handover.c
+Network handover of client connections, see IOTCHandoverAPIs.h.
+
+The SDK keeps its sessions bound to the socket IOTC_ReInitSocket() replaces,
+and its session and AV channel state cannot be moved from outside. What can
+be kept is everything above it: a handle which outlives the SID, the saved
+connect settings, and the extension state keyed by SID. After the socket is
+reopened every connection is watched for incoming packets for a short
+window; connections whose peer answered on the new path are left alone,
+the others are reconnected in parallel, one thread each, so the total
+interruption is that of the slowest connection rather than of all of them
+in a row. The SDK may hand a closed SID to the next session it opens, so
+the pacer, AV binding and presence state of every connection to reconnect
+are taken out before any of them is closed, and put back under the new
+SID by the thread reconnecting it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "IOTCHandoverAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "IOTCPresenceAPIs.h"
+#include "ext_platform.h"
+#include "ext_pacer.h"
+
+#define HANDOVER_UID_LENGTH			20
+#define HANDOVER_POLL_INTERVAL_MS	10
+
+typedef struct HandoverConn {
+	char uid[HANDOVER_UID_LENGTH + 1];
+	int has_connect_input;
+	IOTCConnectInput connect_input;
+	int has_av;
+	AVClientStartInConfig av_config;	// account and password point to the copies below
+	char *account;
+	char *password;
+	int sid;
+	int av_index;
+	int reconnecting;
+	IOTCHandoverInfo info;
+} HandoverConn;
+
+static pthread_mutex_t gHandoverLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gHandoverCond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t gHandoverChangeLock = PTHREAD_MUTEX_INITIALIZER;
+static HandoverConn **gConns = NULL;
+static int gConnSize = 0;
+static IOTCHandoverFn gHandoverFn = NULL;
+static void *gHandoverUserData = NULL;
+
+static char *handover_strdup(const char *s)
+{
+	size_t len;
+	char *copy;
+
+	if (s == NULL)
+		return NULL;
+	len = strlen(s) + 1;
+	copy = (char *)malloc(len);
+	if (copy != NULL)
+		memcpy(copy, s, len);
+	return copy;
+}
+
+static void handover_free(HandoverConn *c)
+{
+	free(c->account);
+	free(c->password);
+	free(c);
+}
+
+/** Store c in the lowest free slot. Returns the handle, or -1 if out of memory. */
+static int handover_add(HandoverConn *c)
+{
+	int handle;
+
+	pthread_mutex_lock(&gHandoverLock);
+	for (handle = 0; handle < gConnSize; handle++) {
+		if (gConns[handle] == NULL)
+			break;
+	}
+	if (handle == gConnSize) {
+		int size = gConnSize > 0 ? gConnSize * 2 : 8;
+		HandoverConn **conns = (HandoverConn **)realloc(gConns, (size_t)size * sizeof(HandoverConn *));
+		if (conns == NULL) {
+			pthread_mutex_unlock(&gHandoverLock);
+			return -1;
+		}
+		memset(conns + gConnSize, 0, (size_t)(size - gConnSize) * sizeof(HandoverConn *));
+		gConns = conns;
+		gConnSize = size;
+	}
+	gConns[handle] = c;
+	pthread_mutex_unlock(&gHandoverLock);
+	return handle;
+}
+
+// Caller holds gHandoverLock
+static HandoverConn *handover_get(int handle)
+{
+	if (handle < 0 || handle >= gConnSize)
+		return NULL;
+	return gConns[handle];
+}
+
+/** Connect with the saved settings. Returns the SID and sets *av_index, or an error code. */
+static int handover_open(HandoverConn *c, int *av_index, LPAVCLIENT_START_OUT_CONFIG avOutConfig)
+{
+	IOTCConnectInput connect_input = c->connect_input;
+	AVClientStartOutConfig out;
+	int sid, ret;
+
+	*av_index = -1;
+	sid = IOTC_Get_SessionID();
+	if (sid < 0)
+		return sid;
+	ret = IOTC_Connect_ByUIDEx(c->uid, sid, c->has_connect_input ? &connect_input : NULL);
+	if (ret < 0) {
+		IOTC_Session_Close(sid);
+		return ret;
+	}
+
+	if (c->has_av) {
+		AVClientStartInConfig av_config = c->av_config;
+		av_config.iotc_session_id = (unsigned int)sid;
+		if (avOutConfig == NULL) {
+			memset(&out, 0, sizeof(out));
+			out.cb = sizeof(out);
+			avOutConfig = &out;
+		}
+		ret = avClientStartEx(&av_config, avOutConfig);
+		if (ret < 0) {
+			IOTC_Session_Close(sid);
+			return ret;
+		}
+		*av_index = ret;
+	}
+	return sid;
+}
+
+/** Has the session received packets since *rx_count was taken? Returns 1 yes, 0 not yet, -1 dead. */
+static int handover_probe(int sid, unsigned int *rx_count, int baseline)
+{
+	struct st_SInfoEx info;
+
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	if (IOTC_Session_Check_Ex(sid, &info) < 0 || info.Mode == 255)
+		return -1;
+	if (baseline) {
+		*rx_count = info.RX_Packetcount;
+		return 0;
+	}
+	return info.RX_Packetcount != *rx_count ? 1 : 0;
+}
+
+typedef struct HandoverJob {
+	int handle;
+	HandoverConn *c;
+	int old_sid;
+	int old_av_index;
+	ExtPacerState pacer;	// taken out of the old SID until the new one is open
+	unsigned int rx_count;
+	uint64_t start_us;
+	int state;			// HANDOVER_PROBING and so on
+	int result;
+	int has_thread;
+	pthread_t thread;
+} HandoverJob;
+
+enum {
+	HANDOVER_PROBING,
+	HANDOVER_SURVIVED,
+	HANDOVER_RECONNECT
+};
+
+/** Publish the outcome of a job. The connection may be closed and freed as soon as this returns. */
+static void handover_finish(HandoverJob *job, int new_sid, int new_av_index, int result)
+{
+	uint64_t interrupt_ms = (ext_now_us() - job->start_us) / 1000ULL;
+	unsigned int ms = interrupt_ms > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)interrupt_ms;
+	HandoverConn *c = job->c;
+	IOTCHandoverFn fn;
+	void *user_data;
+
+	job->result = result;
+	pthread_mutex_lock(&gHandoverLock);
+	c->sid = new_sid;
+	c->av_index = new_av_index;
+	c->reconnecting = 0;
+	c->info.handoverCount++;
+	// A reconnected session may get its old SID back, so count by how it was handled
+	if (job->state == HANDOVER_RECONNECT || result != IOTC_ER_NoERROR)
+		c->info.reconnectCount++;
+	c->info.lastResult = result;
+	c->info.lastInterruptMs = ms;
+	if (result == IOTC_ER_NoERROR && ms > c->info.maxInterruptMs)
+		c->info.maxInterruptMs = ms;
+	fn = gHandoverFn;
+	user_data = gHandoverUserData;
+	pthread_cond_broadcast(&gHandoverCond);
+	pthread_mutex_unlock(&gHandoverLock);
+
+	if (fn != NULL)
+		fn(job->handle, job->old_sid, new_sid, job->old_av_index, new_av_index, result, ms, user_data);
+}
+
+/** Take the state keyed by the old SID out. Runs for every job before any old session is closed. */
+static void handover_detach(HandoverJob *job)
+{
+	if (job->old_sid < 0)
+		return;
+	ext_pacer_take(job->old_sid, job->old_av_index, &job->pacer);
+	IOTC_Presence_Session_Closed(job->old_sid, IOTC_ER_NoERROR);
+}
+
+static void handover_reconnect(HandoverJob *job)
+{
+	int new_sid, new_av_index;
+
+	if (job->old_sid >= 0) {
+		if (job->old_av_index >= 0)
+			avClientStop(job->old_av_index);
+		IOTC_Session_Close(job->old_sid);
+	}
+
+	new_sid = handover_open(job->c, &new_av_index, NULL);
+	if (new_sid >= 0) {
+		ext_pacer_restore(&job->pacer, new_sid, new_av_index);
+		IOTC_Presence_Session_Connected(new_sid);
+		handover_finish(job, new_sid, new_av_index, IOTC_ER_NoERROR);
+	} else {
+		ext_pacer_restore(&job->pacer, -1, -1);
+		handover_finish(job, -1, -1, new_sid);
+	}
+}
+
+static void *handover_reconnect_thread(void *arg)
+{
+	handover_reconnect((HandoverJob *)arg);
+	return NULL;
+}
+
+int IOTC_Handover_Connect(const char *cszUID, const IOTCConnectInput *connectInput,
+						  LPCAVCLIENT_START_IN_CONFIG avConfig, LPAVCLIENT_START_OUT_CONFIG avOutConfig)
+{
+	HandoverConn *c;
+	int handle, sid, av_index;
+
+	if (cszUID == NULL || strlen(cszUID) > HANDOVER_UID_LENGTH)
+		return IOTC_ER_INVALID_ARG;
+
+	c = (HandoverConn *)calloc(1, sizeof(HandoverConn));
+	if (c == NULL)
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	strcpy(c->uid, cszUID);
+	if (connectInput != NULL) {
+		c->has_connect_input = 1;
+		c->connect_input = *connectInput;
+	}
+	if (avConfig != NULL) {
+		c->has_av = 1;
+		c->av_config = *avConfig;
+		c->account = handover_strdup(avConfig->account_or_identity);
+		c->password = handover_strdup(avConfig->password_or_token);
+		if ((avConfig->account_or_identity != NULL && c->account == NULL) ||
+			(avConfig->password_or_token != NULL && c->password == NULL)) {
+			handover_free(c);
+			return IOTC_ER_NOT_ENOUGH_MEMORY;
+		}
+		c->av_config.account_or_identity = c->account;
+		c->av_config.password_or_token = c->password;
+	}
+
+	sid = handover_open(c, &av_index, avOutConfig);
+	if (sid < 0) {
+		handover_free(c);
+		return sid;
+	}
+	c->sid = sid;
+	c->av_index = av_index;
+	c->info.lastResult = IOTC_ER_NoERROR;
+
+	handle = handover_add(c);
+	if (handle < 0) {
+		if (av_index >= 0)
+			avClientStop(av_index);
+		IOTC_Session_Close(sid);
+		handover_free(c);
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	}
+	return handle;
+}
+
+void IOTC_Handover_Close(int nHandle)
+{
+	HandoverConn *c;
+
+	pthread_mutex_lock(&gHandoverLock);
+	while ((c = handover_get(nHandle)) != NULL && c->reconnecting)
+		pthread_cond_wait(&gHandoverCond, &gHandoverLock);
+	if (c != NULL)
+		gConns[nHandle] = NULL;
+	pthread_mutex_unlock(&gHandoverLock);
+	if (c == NULL)
+		return;
+
+	if (c->av_index >= 0)
+		avClientStop(c->av_index);
+	if (c->sid >= 0)
+		IOTC_Session_Close(c->sid);
+	handover_free(c);
+}
+
+int IOTC_Handover_Get_SID(int nHandle)
+{
+	HandoverConn *c;
+	int ret;
+
+	pthread_mutex_lock(&gHandoverLock);
+	c = handover_get(nHandle);
+	if (c == NULL)
+		ret = IOTC_ER_INVALID_ARG;
+	else if (c->reconnecting)
+		ret = IOTC_ER_TIMEOUT;
+	else if (c->sid < 0)
+		ret = c->info.lastResult;
+	else
+		ret = c->sid;
+	pthread_mutex_unlock(&gHandoverLock);
+	return ret;
+}
+
+int IOTC_Handover_Get_AVIndex(int nHandle)
+{
+	HandoverConn *c;
+	int ret;
+
+	pthread_mutex_lock(&gHandoverLock);
+	c = handover_get(nHandle);
+	if (c == NULL || !c->has_av)
+		ret = AV_ER_INVALID_ARG;
+	else if (c->reconnecting)
+		ret = AV_ER_TIMEOUT;
+	else if (c->av_index < 0)
+		ret = c->info.lastResult;
+	else
+		ret = c->av_index;
+	pthread_mutex_unlock(&gHandoverLock);
+	return ret;
+}
+
+int IOTC_Handover_Get_Info(int nHandle, IOTCHandoverInfo *pInfo)
+{
+	HandoverConn *c;
+
+	if (pInfo == NULL)
+		return IOTC_ER_INVALID_ARG;
+	pthread_mutex_lock(&gHandoverLock);
+	c = handover_get(nHandle);
+	if (c != NULL) {
+		*pInfo = c->info;
+		pInfo->sid = c->reconnecting ? -1 : c->sid;
+		pInfo->avIndex = c->reconnecting ? -1 : c->av_index;
+	}
+	pthread_mutex_unlock(&gHandoverLock);
+	return c != NULL ? IOTC_ER_NoERROR : IOTC_ER_INVALID_ARG;
+}
+
+void IOTC_Handover_Set_Callback(IOTCHandoverFn pfxHandoverFn, void *pUserData)
+{
+	pthread_mutex_lock(&gHandoverLock);
+	gHandoverFn = pfxHandoverFn;
+	gHandoverUserData = pUserData;
+	pthread_mutex_unlock(&gHandoverLock);
+}
+
+int IOTC_Handover_Network_Changed(unsigned short nUDPPort)
+{
+	HandoverJob *jobs = NULL;
+	uint64_t start_us, deadline_us;
+	int count = 0, pending = 0, usable = 0, handle, i, ret;
+
+	pthread_mutex_lock(&gHandoverChangeLock);
+	start_us = ext_now_us();
+
+	// Take the connections that exist now. Close waits while they are reconnecting and
+	// the getters report the change in progress; later connections are left alone.
+	pthread_mutex_lock(&gHandoverLock);
+	if (gConnSize > 0)
+		jobs = (HandoverJob *)calloc((size_t)gConnSize, sizeof(HandoverJob));
+	for (handle = 0; jobs != NULL && handle < gConnSize; handle++) {
+		HandoverConn *c = gConns[handle];
+		if (c == NULL)
+			continue;
+		c->reconnecting = 1;
+		jobs[count].handle = handle;
+		jobs[count].c = c;
+		jobs[count].old_sid = c->sid;
+		jobs[count].old_av_index = c->av_index;
+		jobs[count].start_us = start_us;
+		count++;
+	}
+	pthread_mutex_unlock(&gHandoverLock);
+	if (gConnSize > 0 && jobs == NULL) {
+		pthread_mutex_unlock(&gHandoverChangeLock);
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	}
+
+	ret = IOTC_ReInitSocket(nUDPPort);
+	if (ret < 0) {
+		pthread_mutex_lock(&gHandoverLock);
+		for (i = 0; i < count; i++)
+			jobs[i].c->reconnecting = 0;
+		pthread_cond_broadcast(&gHandoverCond);
+		pthread_mutex_unlock(&gHandoverLock);
+		pthread_mutex_unlock(&gHandoverChangeLock);
+		free(jobs);
+		return ret;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (jobs[i].old_sid >= 0 && handover_probe(jobs[i].old_sid, &jobs[i].rx_count, 1) == 0) {
+			jobs[i].state = HANDOVER_PROBING;
+			pending++;
+		} else {
+			jobs[i].state = HANDOVER_RECONNECT;
+		}
+	}
+
+	deadline_us = start_us + (uint64_t)IOTC_HANDOVER_REVALIDATE_TIME * 1000ULL;
+	while (pending > 0 && ext_now_us() < deadline_us) {
+		ext_sleep_ms(HANDOVER_POLL_INTERVAL_MS);
+		for (i = 0; i < count; i++) {
+			int probe;
+			if (jobs[i].state != HANDOVER_PROBING)
+				continue;
+			probe = handover_probe(jobs[i].old_sid, &jobs[i].rx_count, 0);
+			if (probe == 0)
+				continue;
+			pending--;
+			if (probe > 0) {
+				jobs[i].state = HANDOVER_SURVIVED;
+				handover_finish(&jobs[i], jobs[i].old_sid, jobs[i].old_av_index, IOTC_ER_NoERROR);
+			} else {
+				jobs[i].state = HANDOVER_RECONNECT;
+			}
+		}
+	}
+
+	// Sessions still silent are treated as dead. Reconnect on this thread if no thread can be created.
+	for (i = 0; i < count; i++) {
+		if (jobs[i].state == HANDOVER_SURVIVED)
+			continue;
+		jobs[i].state = HANDOVER_RECONNECT;
+		handover_detach(&jobs[i]);
+	}
+	for (i = 0; i < count; i++) {
+		if (jobs[i].state != HANDOVER_RECONNECT)
+			continue;
+		if (pthread_create(&jobs[i].thread, NULL, handover_reconnect_thread, &jobs[i]) == 0)
+			jobs[i].has_thread = 1;
+		else
+			handover_reconnect(&jobs[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (jobs[i].has_thread)
+			pthread_join(jobs[i].thread, NULL);
+		if (jobs[i].result == IOTC_ER_NoERROR)
+			usable++;
+	}
+	pthread_mutex_unlock(&gHandoverChangeLock);
+	free(jobs);
+	return usable;
+}
@@ -0,0 +1,518 @@
+/*! \file iotc_pacer.c
+Token bucket send pacing, see IOTCPacerAPIs.h.
+
+A write reserves its bytes up front: the bucket is refilled, the bytes are
+taken out and, if the bucket goes negative, the writer sleeps until the
+debt would be paid back. Reserving before sleeping keeps concurrent writers
+in arrival order and means the pacer lock is never held while sleeping.
+
+Pacers and AV bindings are reference counted, the table holding one
+reference. Every user pins the object under the table lock before touching
+it, so IOTC_Session_Pacer_Remove() or a reconnection moving it away never
+frees it under a writer or a controller thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "IOTCPacerAPIs.h"
+#include "ext_platform.h"
+#include "ext_table.h"
+#include "ext_pacer.h"
+#include "ext_stats.h"
+
+#define PACER_BURST_MS				20
+#define PACER_MIN_BURST				(8 * IOTC_MAX_PACKET_SIZE)
+#define PACER_DECREASE_GUARD_US		100000	// back off at most once per 100 ms
+#define PACER_INCREASE_INTERVAL_US	200000
+#define PACER_DELAY_INTERVAL_MS		5
+
+typedef struct Pacer {
+	int refs;				// under gPacers.lock
+	pthread_mutex_t lock;
+	double tokens;
+	uint64_t last_refill_us;
+	unsigned int rate;
+	unsigned int burst;
+	int auto_rate;
+	int auto_burst;
+	uint64_t last_decrease_us;
+	uint64_t interval_start_us;
+	int interval_limited;
+	int interval_congested;
+	IOTCPacerStats stats;
+} Pacer;
+
+typedef struct PacerAVBinding {
+	int refs;				// under gAVBindings.lock
+	int sid;
+	int delay_unsupported;	// atomic
+	unsigned int applied_rate;	// atomic
+} PacerAVBinding;
+
+static ExtTable gPacers = EXT_TABLE_INITIALIZER;
+static ExtTable gAVBindings = EXT_TABLE_INITIALIZER;
+
+/** The pacer of a session, pinned until pacer_put(); NULL if there is none. */
+static Pacer *pacer_get(int sid)
+{
+	Pacer *p = NULL;
+
+	if (sid < 0)
+		return NULL;
+	pthread_mutex_lock(&gPacers.lock);
+	if (sid < gPacers.size && (p = (Pacer *)gPacers.items[sid]) != NULL)
+		p->refs++;
+	pthread_mutex_unlock(&gPacers.lock);
+	return p;
+}
+
+static void pacer_put(Pacer *p)
+{
+	int last;
+
+	if (p == NULL)
+		return;
+	pthread_mutex_lock(&gPacers.lock);
+	last = --p->refs == 0;
+	pthread_mutex_unlock(&gPacers.lock);
+	if (last) {
+		pthread_mutex_destroy(&p->lock);
+		free(p);
+	}
+}
+
+/** The binding of an AV channel, pinned until binding_put(); NULL if there is none. */
+static PacerAVBinding *binding_get(int av)
+{
+	PacerAVBinding *b = NULL;
+
+	if (av < 0)
+		return NULL;
+	pthread_mutex_lock(&gAVBindings.lock);
+	if (av < gAVBindings.size && (b = (PacerAVBinding *)gAVBindings.items[av]) != NULL)
+		b->refs++;
+	pthread_mutex_unlock(&gAVBindings.lock);
+	return b;
+}
+
+static void binding_put(PacerAVBinding *b)
+{
+	int last;
+
+	if (b == NULL)
+		return;
+	pthread_mutex_lock(&gAVBindings.lock);
+	last = --b->refs == 0;
+	pthread_mutex_unlock(&gAVBindings.lock);
+	if (last)
+		free(b);
+}
+
+static unsigned int pacer_default_burst(unsigned int rate)
+{
+	unsigned int burst = (unsigned int)((uint64_t)rate * PACER_BURST_MS / 1000);
+	return burst > PACER_MIN_BURST ? burst : PACER_MIN_BURST;
+}
+
+// Caller holds p->lock
+static void pacer_set_rate_locked(Pacer *p, unsigned int rate)
+{
+	p->rate = rate;
+	if (p->auto_burst)
+		p->burst = pacer_default_burst(rate);
+	if (p->tokens > p->burst)
+		p->tokens = p->burst;
+}
+
+// Caller holds p->lock
+static void pacer_refill(Pacer *p, uint64_t now)
+{
+	if (now > p->last_refill_us) {
+		p->tokens += (double)p->rate * (double)(now - p->last_refill_us) / 1000000.0;
+		if (p->tokens > p->burst)
+			p->tokens = p->burst;
+	}
+	p->last_refill_us = now;
+}
+
+/** Take bytes out of the bucket and return how long the caller must wait, in microsecond. */
+static uint64_t pacer_reserve(Pacer *p, unsigned int bytes, int may_wait)
+{
+	uint64_t now = ext_now_us(), wait = 0;
+
+	pthread_mutex_lock(&p->lock);
+	pacer_refill(p, now);
+	// A send larger than the bucket only waits for a full bucket, then runs into debt
+	if (may_wait && p->tokens < (double)bytes && p->tokens < (double)p->burst) {
+		double need = (double)(bytes < p->burst ? bytes : p->burst) - p->tokens;
+		wait = (uint64_t)(need * 1000000.0 / (double)p->rate);
+		p->interval_limited = 1;
+	}
+	p->tokens -= (double)bytes;
+	pthread_mutex_unlock(&p->lock);
+	return wait;
+}
+
+/** Give back the bytes reserved for a write which did not go out. */
+static void pacer_refund(Pacer *p, unsigned int bytes)
+{
+	pthread_mutex_lock(&p->lock);
+	p->tokens += (double)bytes;
+	if (p->tokens > p->burst)
+		p->tokens = p->burst;
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void pacer_on_congestion(Pacer *p)
+{
+	uint64_t now = ext_now_us();
+
+	pthread_mutex_lock(&p->lock);
+	p->stats.queueFullCount++;
+	p->interval_congested = 1;
+	if (p->auto_rate && now - p->last_decrease_us >= PACER_DECREASE_GUARD_US) {
+		unsigned int rate = (unsigned int)((uint64_t)p->rate * 3 / 4);
+		pacer_set_rate_locked(p, rate > IOTC_PACER_AUTO_MIN_RATE ? rate : IOTC_PACER_AUTO_MIN_RATE);
+		p->last_decrease_us = now;
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void pacer_on_sent(Pacer *p, unsigned int bytes, uint64_t waited_us)
+{
+	uint64_t now = ext_now_us();
+
+	pthread_mutex_lock(&p->lock);
+	p->stats.sentBytes += bytes;
+	p->stats.sendCount++;
+	if (waited_us > 0) {
+		p->stats.pacedCount++;
+		p->stats.totalWaitUs += waited_us;
+		if (waited_us > p->stats.maxWaitUs)
+			p->stats.maxWaitUs = waited_us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)waited_us;
+	}
+	if (now - p->interval_start_us >= PACER_INCREASE_INTERVAL_US) {
+		// Grow only when the pacer, not the application, limited the rate
+		if (p->auto_rate && p->interval_limited && !p->interval_congested) {
+			unsigned int rate = (unsigned int)((uint64_t)p->rate * 108 / 100);
+			pacer_set_rate_locked(p, rate < IOTC_PACER_AUTO_MAX_RATE ? rate : IOTC_PACER_AUTO_MAX_RATE);
+		}
+		p->interval_start_us = now;
+		p->interval_limited = 0;
+		p->interval_congested = 0;
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+ExtPacer *ext_pacer_get(int nIOTCSessionID)
+{
+	return pacer_get(nIOTCSessionID);
+}
+
+ExtPacer *ext_pacer_get_av(int nAVChannelID)
+{
+	PacerAVBinding *b = binding_get(nAVChannelID);
+	Pacer *p = b != NULL ? pacer_get(b->sid) : NULL;
+
+	binding_put(b);
+	return p;
+}
+
+void ext_pacer_put(ExtPacer *p)
+{
+	pacer_put(p);
+}
+
+void ext_pacer_peek(ExtPacer *p, double *tokens, unsigned int *rate, unsigned int *burst)
+{
+	pthread_mutex_lock(&p->lock);
+	pacer_refill(p, ext_now_us());
+	*tokens = p->tokens;
+	*rate = p->rate;
+	*burst = p->burst;
+	pthread_mutex_unlock(&p->lock);
+}
+
+void ext_pacer_get_stats(ExtPacer *p, IOTCPacerStats *stats)
+{
+	pthread_mutex_lock(&p->lock);
+	*stats = p->stats;
+	stats->rate = p->rate;
+	stats->burst = p->burst;
+	stats->isAutoRate = (unsigned char)p->auto_rate;
+	pthread_mutex_unlock(&p->lock);
+}
+
+void ext_pacer_set_rate(ExtPacer *p, unsigned int rate, int auto_rate)
+{
+	pthread_mutex_lock(&p->lock);
+	p->auto_rate = auto_rate;
+	if (rate != 0)
+		pacer_set_rate_locked(p, rate);
+	pthread_mutex_unlock(&p->lock);
+}
+
+void ext_pacer_take(int nIOTCSessionID, int nAVChannelID, ExtPacerState *state)
+{
+	state->pacer = (Pacer *)ext_table_take(&gPacers, nIOTCSessionID);
+	state->binding = (PacerAVBinding *)ext_table_take(&gAVBindings, nAVChannelID);
+}
+
+void ext_pacer_restore(ExtPacerState *state, int nIOTCSessionID, int nAVChannelID)
+{
+	Pacer *p = state->pacer;
+	PacerAVBinding *b = NULL;
+
+	if (p != NULL && (nIOTCSessionID < 0 || ext_table_set(&gPacers, nIOTCSessionID, p) < 0)) {
+		pacer_put(p);
+		p = NULL;
+	}
+	// Senders may still hold the old binding, so the new AV channel gets a new one,
+	// which starts with the SDK default packet interval
+	if (state->binding != NULL && p != NULL && nAVChannelID >= 0)
+		b = (PacerAVBinding *)calloc(1, sizeof(PacerAVBinding));
+	if (b != NULL) {
+		b->refs = 1;
+		b->sid = nIOTCSessionID;
+		if (ext_table_set(&gAVBindings, nAVChannelID, b) < 0)
+			free(b);
+	}
+	binding_put(state->binding);
+	state->pacer = NULL;
+	state->binding = NULL;
+}
+
+int IOTC_Session_Pacer_Setup(int nIOTCSessionID, unsigned int nRate, unsigned int nBurst)
+{
+	Pacer *p;
+	uint64_t now = ext_now_us();
+
+	if (nIOTCSessionID < 0)
+		return IOTC_ER_INVALID_SID;
+
+	p = pacer_get(nIOTCSessionID);
+	if (p == NULL) {
+		p = (Pacer *)calloc(1, sizeof(Pacer));
+		if (p == NULL)
+			return IOTC_ER_NOT_ENOUGH_MEMORY;
+		pthread_mutex_init(&p->lock, NULL);
+		p->refs = 2;		// the table and this call
+		p->last_refill_us = now;
+		p->interval_start_us = now;
+		if (ext_table_set(&gPacers, nIOTCSessionID, p) < 0) {
+			pthread_mutex_destroy(&p->lock);
+			free(p);
+			// Lost a race with another setup of the same session, or out of memory
+			p = pacer_get(nIOTCSessionID);
+			if (p == NULL)
+				return IOTC_ER_NOT_ENOUGH_MEMORY;
+		}
+	}
+
+	pthread_mutex_lock(&p->lock);
+	p->auto_rate = nRate == 0;
+	p->auto_burst = nBurst == 0;
+	if (nBurst != 0)
+		p->burst = nBurst;
+	pacer_set_rate_locked(p, nRate != 0 ? nRate : IOTC_PACER_AUTO_INITIAL_RATE);
+	p->tokens = p->burst;
+	p->last_refill_us = now;
+	pthread_mutex_unlock(&p->lock);
+	pacer_put(p);
+	return IOTC_ER_NoERROR;
+}
+
+void IOTC_Session_Pacer_Remove(int nIOTCSessionID)
+{
+	pacer_put((Pacer *)ext_table_take(&gPacers, nIOTCSessionID));
+}
+
+int IOTC_Session_Pacer_Get_Stats(int nIOTCSessionID, IOTCPacerStats *pStats)
+{
+	Pacer *p;
+
+	if (pStats == NULL)
+		return IOTC_ER_INVALID_ARG;
+	p = pacer_get(nIOTCSessionID);
+	if (p == NULL)
+		return IOTC_ER_INVALID_SID;
+	ext_pacer_get_stats(p, pStats);
+	pacer_put(p);
+	return IOTC_ER_NoERROR;
+}
+
+/** Sleep with exponential backoff after a full queue. Returns 0 once the retry budget is spent. */
+static int pacer_backoff(uint64_t start_us, unsigned int *backoff_us)
+{
+	if (ext_now_us() - start_us >= (uint64_t)IOTC_PACER_MAX_RETRY_WAIT * 1000ULL)
+		return 0;
+	ext_sleep_us(*backoff_us);
+	if (*backoff_us < 8000)
+		*backoff_us *= 2;
+	return 1;
+}
+
+int IOTC_Session_Write_Paced(int nIOTCSessionID, const char *cabBuf, int nBufSize,
+							 unsigned char nIOTCChannelID, unsigned int *pnWaitUs)
+{
+	Pacer *p;
+	uint64_t start = ext_now_us(), wait;
+	unsigned int backoff = 1000;
+	int ret;
+
+	if (pnWaitUs != NULL)
+		*pnWaitUs = 0;
+	if (nBufSize <= 0 || (p = pacer_get(nIOTCSessionID)) == NULL)
+		return IOTC_Session_Write(nIOTCSessionID, cabBuf, nBufSize, nIOTCChannelID);
+
+	wait = pacer_reserve(p, (unsigned int)nBufSize, 1);
+	if (wait > 0)
+		ext_sleep_us(wait);
+
+	for (;;) {
+		ret = IOTC_Session_Write(nIOTCSessionID, cabBuf, nBufSize, nIOTCChannelID);
+		// In non-blocking mode a zero length write also means the socket buffer is full
+		if (ret != IOTC_ER_QUEUE_FULL && ret != 0)
+			break;
+		pacer_on_congestion(p);
+		if (!pacer_backoff(start, &backoff))
+			break;
+	}
+
+	wait = ext_now_us() - start;
+	if (ret > 0)
+		pacer_on_sent(p, (unsigned int)ret, wait);
+	if (ret < nBufSize)
+		pacer_refund(p, (unsigned int)(nBufSize - (ret > 0 ? ret : 0)));
+	if (pnWaitUs != NULL)
+		*pnWaitUs = wait > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)wait;
+	pacer_put(p);
+	return ret;
+}
+
+int avServPacerAttach(int nAVChannelID, int nIOTCSessionID)
+{
+	PacerAVBinding *b;
+
+	if (nAVChannelID < 0)
+		return AV_ER_INVALID_ARG;
+	if (ext_table_get(&gPacers, nIOTCSessionID) == NULL)
+		return AV_ER_INVALID_SID;
+
+	b = (PacerAVBinding *)calloc(1, sizeof(PacerAVBinding));
+	if (b == NULL)
+		return AV_ER_MEM_INSUFF;
+	b->refs = 1;
+	b->sid = nIOTCSessionID;
+	if (ext_table_set(&gAVBindings, nAVChannelID, b) < 0) {
+		free(b);
+		return AV_ER_INVALID_ARG;
+	}
+	return AV_ER_NoERROR;
+}
+
+void avServPacerDetach(int nAVChannelID)
+{
+	binding_put((PacerAVBinding *)ext_table_take(&gAVBindings, nAVChannelID));
+}
+
+/** Keep the SDK packet interval in line with the pacer rate so one frame is not sent as a single burst. */
+static void pacer_apply_delay_interval(int nAVChannelID, PacerAVBinding *b, Pacer *p)
+{
+	unsigned int rate, applied, packets;
+	int ret;
+
+	// Threads sending on the same AV channel share b
+	if (__atomic_load_n(&b->delay_unsupported, __ATOMIC_RELAXED))
+		return;
+	pthread_mutex_lock(&p->lock);
+	rate = p->rate;
+	pthread_mutex_unlock(&p->lock);
+	applied = __atomic_load_n(&b->applied_rate, __ATOMIC_RELAXED);
+	// Ignore changes under 10% to avoid calling into the SDK on every frame
+	if (applied != 0 && rate < applied * 11 / 10 && rate > applied * 9 / 10)
+		return;
+	// Only the thread which records the new rate applies it
+	if (!__atomic_compare_exchange_n(&b->applied_rate, &applied, rate, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+
+	packets = (unsigned int)((uint64_t)rate * PACER_DELAY_INTERVAL_MS / 1000 / IOTC_MAX_PACKET_SIZE);
+	if (packets < 1)
+		packets = 1;
+	if (packets > 0xFFFF)
+		packets = 0xFFFF;
+	ret = avServSetDelayInterval(nAVChannelID, (unsigned short)packets, PACER_DELAY_INTERVAL_MS);
+	if (ret == AV_ER_NOT_SUPPORT)
+		__atomic_store_n(&b->delay_unsupported, 1, __ATOMIC_RELAXED);
+}
+
+int avSendFrameDataPaced(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+						 const void *cabFrameInfo, int nFrameInfoSize, unsigned int *pnWaitUs)
+{
+	PacerAVBinding *b = binding_get(nAVChannelID);
+	Pacer *p = b != NULL ? pacer_get(b->sid) : NULL;
+	uint64_t start = ext_now_us(), wait;
+	unsigned int backoff = 1000;
+	unsigned int bytes;
+	int ret;
+
+	if (pnWaitUs != NULL)
+		*pnWaitUs = 0;
+	if (p == NULL || nFrameDataSize <= 0) {
+		pacer_put(p);
+		binding_put(b);
+		ret = avSendFrameData(nAVChannelID, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize);
+		ext_stats_frame_sent(nAVChannelID, start, nFrameDataSize, ret, 0);
+		return ret;
+	}
+
+	pacer_apply_delay_interval(nAVChannelID, b, p);
+	bytes = (unsigned int)nFrameDataSize + (nFrameInfoSize > 0 ? (unsigned int)nFrameInfoSize : 0);
+	wait = pacer_reserve(p, bytes, 1);
+	if (wait > 0)
+		ext_sleep_us(wait);
+
+	for (;;) {
+		ret = avSendFrameData(nAVChannelID, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize);
+		if (ret == AV_ER_EXCEED_MAX_SIZE)
+			pacer_on_congestion(p);
+		if (ret != AV_ER_SOCKET_QUEUE_FULL)
+			break;
+		pacer_on_congestion(p);
+		if (!pacer_backoff(start, &backoff))
+			break;
+	}
+
+	wait = ext_now_us() - start;
+	// The frame is queued despite the alarm; any other error means it was not sent
+	if (ret >= 0 || ret == AV_ER_EXCEED_MAX_ALARM)
+		pacer_on_sent(p, bytes, wait);
+	else
+		pacer_refund(p, bytes);
+	if (pnWaitUs != NULL)
+		*pnWaitUs = wait > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)wait;
+	pacer_put(p);
+	binding_put(b);
+	ext_stats_frame_sent(nAVChannelID, start, nFrameDataSize, ret, 0);
+	return ret;
+}
+
+int avSendAudioDataPaced(int nAVChannelID, const char *cabAudioData, int nAudioDataSize,
+						 const void *cabFrameInfo, int nFrameInfoSize)
+{
+	uint64_t start = ext_now_us();
+	unsigned int bytes;
+	Pacer *p;
+	int ret;
+
+	ret = avSendAudioData(nAVChannelID, cabAudioData, nAudioDataSize, cabFrameInfo, nFrameInfoSize);
+	ext_stats_frame_sent(nAVChannelID, start, nAudioDataSize, ret, 1);
+	if (ret >= 0 && nAudioDataSize > 0 && (p = ext_pacer_get_av(nAVChannelID)) != NULL) {
+		bytes = (unsigned int)nAudioDataSize + (nFrameInfoSize > 0 ? (unsigned int)nFrameInfoSize : 0);
+		pacer_reserve(p, bytes, 0);
+		pacer_on_sent(p, bytes, 0);
+		pacer_put(p);
+	}
+	return ret;
+}
@@ -0,0 +1,533 @@
+/*! \file iotc_presence.c
+Presence cache and batched device on line check, see IOTCPresenceAPIs.h.
+
+Every UID has one cache entry. An entry is either idle (possibly holding a
+cached result), queued for a query, or in flight. Batches attach a waiter to
+each entry they need; when the query of an entry completes, all of its
+waiters are answered and a batch whose last waiter is answered calls its
+handler. A single query thread keeps at most gMaxInFlight queries outstanding.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "IOTCPresenceAPIs.h"
+#include "ext_platform.h"
+
+#define PRESENCE_UID_LENGTH			20
+#define PRESENCE_HASH_SIZE			256
+#define PRESENCE_SWEEP_THRESHOLD	4096
+
+typedef enum {
+	PRESENCE_ST_IDLE = 0,
+	PRESENCE_ST_QUEUED,
+	PRESENCE_ST_INFLIGHT
+} PresenceState;
+
+typedef struct PresenceBatch {
+	int count;
+	int remaining;
+	char **uids;
+	int *results;
+	onLineBatchResult handler;
+	void *userData;
+	struct PresenceBatch *done_next;	// links batches completed under the lock
+} PresenceBatch;
+
+typedef struct PresenceWaiter {
+	PresenceBatch *batch;
+	int index;
+	struct PresenceWaiter *next;
+} PresenceWaiter;
+
+typedef struct PresenceEntry {
+	char uid[PRESENCE_UID_LENGTH + 1];
+	PresenceState state;
+	int result;
+	uint64_t expire_ms;			// 0 if no cached result
+	unsigned int timeout;		// timeout of the pending query
+	unsigned int generation;	// bumped on invalidation so a late answer is not cached
+	PresenceWaiter *waiters;
+	struct PresenceEntry *hash_next;
+	struct PresenceEntry *queue_next;
+} PresenceEntry;
+
+typedef struct PresenceQuery {
+	PresenceEntry *entry;
+	unsigned int generation;
+} PresenceQuery;
+
+typedef struct PresenceSession {
+	int sid;
+	char uid[PRESENCE_UID_LENGTH + 1];
+	struct PresenceSession *next;
+} PresenceSession;
+
+static pthread_mutex_t gPresenceLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gPresenceCond = PTHREAD_COND_INITIALIZER;
+static PresenceEntry *gPresenceHash[PRESENCE_HASH_SIZE];
+static PresenceEntry *gQueueHead = NULL;
+static PresenceEntry *gQueueTail = NULL;
+static PresenceSession *gSessions = NULL;
+static unsigned int gEntryCount = 0;
+static unsigned int gInFlight = 0;
+static unsigned int gMaxInFlight = IOTC_PRESENCE_DEFAULT_MAX_INFLIGHT;
+static unsigned int gPositiveTTL = IOTC_PRESENCE_DEFAULT_POSITIVE_TTL;
+static unsigned int gNegativeTTL = IOTC_PRESENCE_DEFAULT_NEGATIVE_TTL;
+static int gThreadRunning = 0;
+static int gThreadExit = 0;
+static pthread_t gThread;
+
+static unsigned int presence_hash(const char *uid)
+{
+	unsigned int h = 2166136261u;
+	while (*uid) {
+		h ^= (unsigned char)*uid++;
+		h *= 16777619u;
+	}
+	return h % PRESENCE_HASH_SIZE;
+}
+
+static int presence_is_cacheable(int result)
+{
+	return result == IOTC_ER_NoERROR || result == IOTC_ER_DEVICE_OFFLINE || result == IOTC_ER_CAN_NOT_FIND_DEVICE;
+}
+
+static unsigned int presence_ttl(int result)
+{
+	return result == IOTC_ER_NoERROR ? gPositiveTTL : gNegativeTTL;
+}
+
+// Caller holds gPresenceLock
+static void presence_sweep(uint64_t now)
+{
+	int i;
+
+	for (i = 0; i < PRESENCE_HASH_SIZE; i++) {
+		PresenceEntry **pp = &gPresenceHash[i];
+		while (*pp != NULL) {
+			PresenceEntry *e = *pp;
+			if (e->state == PRESENCE_ST_IDLE && e->expire_ms <= now) {
+				*pp = e->hash_next;
+				free(e);
+				gEntryCount--;
+			} else {
+				pp = &e->hash_next;
+			}
+		}
+	}
+}
+
+// Caller holds gPresenceLock
+static PresenceEntry *presence_find(const char *uid, int create)
+{
+	unsigned int h = presence_hash(uid);
+	PresenceEntry *e;
+
+	for (e = gPresenceHash[h]; e != NULL; e = e->hash_next) {
+		if (strcmp(e->uid, uid) == 0)
+			return e;
+	}
+	if (!create)
+		return NULL;
+
+	if (gEntryCount >= PRESENCE_SWEEP_THRESHOLD)
+		presence_sweep(ext_now_ms());
+
+	e = (PresenceEntry *)calloc(1, sizeof(PresenceEntry));
+	if (e == NULL)
+		return NULL;
+	strcpy(e->uid, uid);
+	e->hash_next = gPresenceHash[h];
+	gPresenceHash[h] = e;
+	gEntryCount++;
+	return e;
+}
+
+static void presence_free_batch(PresenceBatch *batch)
+{
+	int i;
+
+	for (i = 0; i < batch->count; i++)
+		free(batch->uids[i]);
+	free(batch->uids);
+	free(batch->results);
+	free(batch);
+}
+
+// Run handlers of completed batches. Must be called without gPresenceLock.
+static void presence_run_done(PresenceBatch *done)
+{
+	while (done != NULL) {
+		PresenceBatch *next = done->done_next;
+		done->handler((const char * const *)done->uids, done->results, done->count, done->userData);
+		presence_free_batch(done);
+		done = next;
+	}
+}
+
+// Answer all waiters of an entry. Caller holds gPresenceLock.
+static PresenceBatch *presence_answer_waiters(PresenceEntry *e, int result, PresenceBatch *done)
+{
+	PresenceWaiter *w = e->waiters;
+
+	e->waiters = NULL;
+	while (w != NULL) {
+		PresenceWaiter *next = w->next;
+		w->batch->results[w->index] = result;
+		if (--w->batch->remaining == 0) {
+			w->batch->done_next = done;
+			done = w->batch;
+		}
+		free(w);
+		w = next;
+	}
+	return done;
+}
+
+static void presence_finish(PresenceEntry *e, unsigned int generation, int result)
+{
+	PresenceBatch *done;
+
+	pthread_mutex_lock(&gPresenceLock);
+	if (generation == e->generation && presence_is_cacheable(result) && presence_ttl(result) > 0) {
+		e->result = result;
+		e->expire_ms = ext_now_ms() + presence_ttl(result);
+	}
+	e->state = PRESENCE_ST_IDLE;
+	done = presence_answer_waiters(e, result, NULL);
+	gInFlight--;
+	pthread_cond_broadcast(&gPresenceCond);
+	pthread_mutex_unlock(&gPresenceLock);
+
+	presence_run_done(done);
+}
+
+static void __stdcall presence_on_result(int result, void *userData)
+{
+	PresenceQuery *query = (PresenceQuery *)userData;
+	PresenceEntry *e = query->entry;
+	unsigned int generation = query->generation;
+
+	free(query);
+	presence_finish(e, generation, result);
+}
+
+static void *presence_thread(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&gPresenceLock);
+	for (;;) {
+		PresenceEntry *e;
+		PresenceQuery *query;
+		char uid[PRESENCE_UID_LENGTH + 1];
+		unsigned int timeout;
+		int ret;
+
+		while (!gThreadExit && (gQueueHead == NULL || gInFlight >= gMaxInFlight))
+			pthread_cond_wait(&gPresenceCond, &gPresenceLock);
+		if (gThreadExit)
+			break;
+
+		e = gQueueHead;
+		gQueueHead = e->queue_next;
+		if (gQueueHead == NULL)
+			gQueueTail = NULL;
+		e->queue_next = NULL;
+		e->state = PRESENCE_ST_INFLIGHT;
+		gInFlight++;
+		strcpy(uid, e->uid);
+		timeout = e->timeout;
+
+		query = (PresenceQuery *)malloc(sizeof(PresenceQuery));
+		if (query != NULL) {
+			query->entry = e;
+			query->generation = e->generation;
+		}
+		pthread_mutex_unlock(&gPresenceLock);
+
+		// The result handler may run on an SDK thread before this call returns
+		if (query == NULL) {
+			presence_finish(e, 0, IOTC_ER_NOT_ENOUGH_MEMORY);
+		} else {
+			ret = IOTC_Check_Device_On_Line(uid, timeout, presence_on_result, query);
+			if (ret < 0) {
+				unsigned int generation = query->generation;
+				free(query);
+				presence_finish(e, generation, ret);
+			}
+		}
+
+		pthread_mutex_lock(&gPresenceLock);
+	}
+	pthread_mutex_unlock(&gPresenceLock);
+	return NULL;
+}
+
+// Caller holds gPresenceLock
+static int presence_start_thread(void)
+{
+	if (gThreadRunning)
+		return IOTC_ER_NoERROR;
+	gThreadExit = 0;
+	if (pthread_create(&gThread, NULL, presence_thread, NULL) != 0)
+		return IOTC_ER_FAIL_CREATE_THREAD;
+	gThreadRunning = 1;
+	return IOTC_ER_NoERROR;
+}
+
+int IOTC_Presence_Setup(unsigned int nPositiveTTL, unsigned int nNegativeTTL, unsigned int nMaxInFlight)
+{
+	pthread_mutex_lock(&gPresenceLock);
+	gPositiveTTL = nPositiveTTL;
+	gNegativeTTL = nNegativeTTL;
+	gMaxInFlight = nMaxInFlight > 0 ? nMaxInFlight : IOTC_PRESENCE_DEFAULT_MAX_INFLIGHT;
+	pthread_cond_broadcast(&gPresenceCond);
+	pthread_mutex_unlock(&gPresenceLock);
+	return IOTC_ER_NoERROR;
+}
+
+int IOTC_Check_Device_On_Line_Batch(const char * const *UIDs, int nUIDCount, unsigned int timeOut,
+									onLineBatchResult handler, void *userData)
+{
+	PresenceBatch *batch, *done = NULL;
+	uint64_t now;
+	int i, ret;
+
+	if (UIDs == NULL || nUIDCount <= 0 || handler == NULL)
+		return IOTC_ER_INVALID_ARG;
+
+	batch = (PresenceBatch *)calloc(1, sizeof(PresenceBatch));
+	if (batch == NULL)
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	batch->uids = (char **)calloc((size_t)nUIDCount, sizeof(char *));
+	batch->results = (int *)calloc((size_t)nUIDCount, sizeof(int));
+	if (batch->uids == NULL || batch->results == NULL) {
+		presence_free_batch(batch);
+		return IOTC_ER_NOT_ENOUGH_MEMORY;
+	}
+	batch->count = nUIDCount;
+	for (i = 0; i < nUIDCount; i++) {
+		const char *uid = UIDs[i] != NULL ? UIDs[i] : "";
+		batch->uids[i] = strdup(uid);
+		if (batch->uids[i] == NULL) {
+			presence_free_batch(batch);
+			return IOTC_ER_NOT_ENOUGH_MEMORY;
+		}
+	}
+	batch->handler = handler;
+	batch->userData = userData;
+	// Hold one extra count so the batch cannot complete while it is being filled in
+	batch->remaining = nUIDCount + 1;
+
+	pthread_mutex_lock(&gPresenceLock);
+	ret = presence_start_thread();
+	if (ret < 0) {
+		pthread_mutex_unlock(&gPresenceLock);
+		presence_free_batch(batch);
+		return ret;
+	}
+
+	now = ext_now_ms();
+	for (i = 0; i < nUIDCount; i++) {
+		const char *uid = batch->uids[i];
+		PresenceEntry *e;
+		PresenceWaiter *w;
+		size_t len = strlen(uid);
+
+		if (len == 0 || len > PRESENCE_UID_LENGTH) {
+			batch->results[i] = IOTC_ER_INVALID_ARG;
+			batch->remaining--;
+			continue;
+		}
+
+		e = presence_find(uid, 1);
+		if (e != NULL && e->state == PRESENCE_ST_IDLE && e->expire_ms > now) {
+			batch->results[i] = e->result;
+			batch->remaining--;
+			continue;
+		}
+
+		w = (PresenceWaiter *)malloc(sizeof(PresenceWaiter));
+		if (e == NULL || w == NULL) {
+			free(w);
+			batch->results[i] = IOTC_ER_NOT_ENOUGH_MEMORY;
+			batch->remaining--;
+			continue;
+		}
+		w->batch = batch;
+		w->index = i;
+		w->next = e->waiters;
+		e->waiters = w;
+
+		if (e->state == PRESENCE_ST_IDLE) {
+			e->state = PRESENCE_ST_QUEUED;
+			e->timeout = timeOut;
+			e->queue_next = NULL;
+			if (gQueueTail != NULL)
+				gQueueTail->queue_next = e;
+			else
+				gQueueHead = e;
+			gQueueTail = e;
+		}
+	}
+
+	if (--batch->remaining == 0) {
+		batch->done_next = NULL;
+		done = batch;
+	}
+	pthread_cond_broadcast(&gPresenceCond);
+	pthread_mutex_unlock(&gPresenceLock);
+
+	presence_run_done(done);
+	return IOTC_ER_NoERROR;
+}
+
+int IOTC_Presence_Query(const char *UID)
+{
+	PresenceEntry *e;
+	int ret = IOTC_ER_TIMEOUT;
+
+	if (UID == NULL)
+		return IOTC_ER_INVALID_ARG;
+
+	pthread_mutex_lock(&gPresenceLock);
+	e = presence_find(UID, 0);
+	if (e != NULL && e->expire_ms > ext_now_ms())
+		ret = e->result;
+	pthread_mutex_unlock(&gPresenceLock);
+	return ret;
+}
+
+// Caller holds gPresenceLock
+static void presence_invalidate_entry(PresenceEntry *e)
+{
+	e->expire_ms = 0;
+	e->generation++;
+}
+
+void IOTC_Presence_Invalidate(const char *UID)
+{
+	PresenceEntry *e;
+	int i;
+
+	pthread_mutex_lock(&gPresenceLock);
+	if (UID != NULL) {
+		e = presence_find(UID, 0);
+		if (e != NULL)
+			presence_invalidate_entry(e);
+	} else {
+		for (i = 0; i < PRESENCE_HASH_SIZE; i++) {
+			for (e = gPresenceHash[i]; e != NULL; e = e->hash_next)
+				presence_invalidate_entry(e);
+		}
+		presence_sweep(ext_now_ms());
+	}
+	pthread_mutex_unlock(&gPresenceLock);
+}
+
+int IOTC_Presence_Session_Connected(int nIOTCSessionID)
+{
+	struct st_SInfoEx info;
+	PresenceSession *s;
+	PresenceEntry *e;
+	int ret;
+
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	ret = IOTC_Session_Check_Ex(nIOTCSessionID, &info);
+	if (ret < 0)
+		return ret;
+	info.UID[PRESENCE_UID_LENGTH] = '\0';
+
+	pthread_mutex_lock(&gPresenceLock);
+	for (s = gSessions; s != NULL; s = s->next) {
+		if (s->sid == nIOTCSessionID)
+			break;
+	}
+	if (s == NULL) {
+		s = (PresenceSession *)malloc(sizeof(PresenceSession));
+		if (s == NULL) {
+			pthread_mutex_unlock(&gPresenceLock);
+			return IOTC_ER_NOT_ENOUGH_MEMORY;
+		}
+		s->sid = nIOTCSessionID;
+		s->next = gSessions;
+		gSessions = s;
+	}
+	strcpy(s->uid, info.UID);
+
+	e = presence_find(info.UID, 1);
+	if (e != NULL) {
+		// A live session is the best evidence we can get; it overrides any negative entry
+		e->generation++;
+		if (gPositiveTTL > 0) {
+			e->result = IOTC_ER_NoERROR;
+			e->expire_ms = ext_now_ms() + gPositiveTTL;
+		} else {
+			e->expire_ms = 0;
+		}
+	}
+	pthread_mutex_unlock(&gPresenceLock);
+	return IOTC_ER_NoERROR;
+}
+
+void __stdcall IOTC_Presence_Session_Closed(int nIOTCSessionID, int nErrorCode)
+{
+	PresenceSession **pp, *s;
+	PresenceEntry *e;
+
+	(void)nErrorCode;
+
+	pthread_mutex_lock(&gPresenceLock);
+	for (pp = &gSessions; *pp != NULL; pp = &(*pp)->next) {
+		if ((*pp)->sid == nIOTCSessionID)
+			break;
+	}
+	s = *pp;
+	if (s != NULL) {
+		*pp = s->next;
+		e = presence_find(s->uid, 0);
+		if (e != NULL)
+			presence_invalidate_entry(e);
+		free(s);
+	}
+	pthread_mutex_unlock(&gPresenceLock);
+}
+
+void IOTC_Presence_DeInitialize(void)
+{
+	PresenceBatch *done = NULL;
+	int i, running;
+
+	pthread_mutex_lock(&gPresenceLock);
+	running = gThreadRunning;
+	gThreadExit = 1;
+	pthread_cond_broadcast(&gPresenceCond);
+	pthread_mutex_unlock(&gPresenceLock);
+	if (running)
+		pthread_join(gThread, NULL);
+
+	pthread_mutex_lock(&gPresenceLock);
+	gThreadRunning = 0;
+	for (i = 0; i < PRESENCE_HASH_SIZE; i++) {
+		while (gPresenceHash[i] != NULL) {
+			PresenceEntry *e = gPresenceHash[i];
+			gPresenceHash[i] = e->hash_next;
+			done = presence_answer_waiters(e, IOTC_ER_NOT_INITIALIZED, done);
+			free(e);
+		}
+	}
+	while (gSessions != NULL) {
+		PresenceSession *s = gSessions;
+		gSessions = s->next;
+		free(s);
+	}
+	gQueueHead = gQueueTail = NULL;
+	gEntryCount = 0;
+	gInFlight = 0;
+	pthread_mutex_unlock(&gPresenceLock);
+
+	presence_run_done(done);
+}
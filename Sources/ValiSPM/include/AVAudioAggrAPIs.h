@@ -0,0 +1,167 @@
+/*! \file AVAudioAggrAPIs.h
+This file describes the audio aggregation APIs of the AV extension module.
+G.711 and AAC frames are often 160 to 320 bytes, so sending each one with
+avSendAudioData() costs more in packet headers and per-call work than in
+payload. An aggregator packs the frames sent on an AV channel into one
+bundle of up to #AV_MAX_AUDIO_DATA_SIZE bytes. A bundle is sent when it is
+full, when it holds maxFrames frames, or when its first frame has waited
+maxDelayMs, whichever comes first. Each frame keeps its own frame info.
+The receiver calls avRecvAudioDataAggr() in place of avRecvAudioData(). It
+still returns one frame per call, so the decoder sees the frames as they
+were sent. Frames that were sent without aggregation pass through as they are.
+
+A bundle is one audio frame for the AV module. Its data is
+#AV_AUDIO_AGGR_MAGIC, a version byte, a frame count byte and then, per
+frame, a 16-bit little-endian data size, an 8-bit info size, the frame info
+and the frame data. Its frame info is the frame info of its first frame.
+ */
+
+#ifndef _AVAudioAggrAPIs_H_
+#define _AVAudioAggrAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The first four bytes of a bundle, "AVAB" */
+#define AV_AUDIO_AGGR_MAGIC							"AVAB"
+
+/** The version of the bundle format */
+#define AV_AUDIO_AGGR_VERSION						1
+
+/** The bytes of a bundle before its first frame */
+#define AV_AUDIO_AGGR_HEADER_SIZE					6
+
+/** The bytes in front of the frame info of each frame in a bundle */
+#define AV_AUDIO_AGGR_FRAME_HEADER_SIZE				3
+
+/** The largest frame info a bundled frame may have */
+#define AV_AUDIO_AGGR_MAX_FRAME_INFO				255
+
+/** The default longest time, in unit of millisecond, a frame waits in a bundle */
+#define AV_AUDIO_AGGR_DEFAULT_MAX_DELAY				40
+
+/** The most frames in one bundle */
+#define AV_AUDIO_AGGR_MAX_FRAMES					255
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details Aggregator statistics, got by avAudioAggrGetStats().
+ */
+typedef struct AVAudioAggrStats
+{
+	unsigned int frames; //!< Frames given to avSendAudioDataAggr()
+	unsigned int bundles; //!< Bundles sent
+	unsigned int directFrames; //!< Frames sent on their own since they do not fit in a bundle
+	unsigned int timerFlushes; //!< Bundles sent because the first frame waited maxDelayMs
+	unsigned int droppedFrames; //!< Frames in bundles which failed to send
+	int lastError; //!< The last error of a send, 0 if none
+} AVAudioAggrStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Start aggregating the audio sent on an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nMaxDelayMs [in] The longest time a frame waits in a bundle, 0 for #AV_AUDIO_AGGR_DEFAULT_MAX_DELAY
+ * \param nMaxFrames [in] Send a bundle once it holds this many frames, 0 for #AV_AUDIO_AGGR_MAX_FRAMES
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or an aggregator is already attached
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the flush thread
+ *
+ * \attention The receiver must use avRecvAudioDataAggr().
+ */
+AVAPI_API int avAudioAggrAttach(int nAVChannelID, unsigned int nMaxDelayMs, unsigned int nMaxFrames);
+
+/**
+ * \brief Send what is buffered and stop aggregating
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avAudioAggrDetach(int nAVChannelID);
+
+/**
+ * \brief Send an audio frame through the aggregator of an AV channel
+ *
+ * \details Takes the same arguments as avSendAudioData(). The frame goes into the current
+ *			bundle; a frame too large for a bundle is sent on its own after the bundle.
+ *			Bundles are sent with avSendAudioDataPaced().
+ *
+ * \return #AV_ER_NoERROR if the frame is buffered or sent
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG No aggregator is attached or an argument is not valid
+ *			- The error of avSendAudioDataPaced() if a bundle this call sent failed
+ */
+AVAPI_API int avSendAudioDataAggr(int nAVChannelID, const char *cabAudioData, int nAudioDataSize,
+								  const void *cabFrameInfo, int nFrameInfoSize);
+
+/**
+ * \brief Send the current bundle now, e.g. at the end of a talk
+ *
+ * \return #AV_ER_NoERROR if sending successfully or nothing is buffered
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG No aggregator is attached
+ *			- The error of avSendAudioDataPaced()
+ */
+AVAPI_API int avAudioAggrFlush(int nAVChannelID);
+
+/**
+ * \brief Get statistics of the aggregator of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG No aggregator is attached or pStats is NULL
+ */
+AVAPI_API int avAudioAggrGetStats(int nAVChannelID, AVAudioAggrStats *pStats);
+
+/**
+ * \brief Receive one audio frame, splitting bundles
+ *
+ * \details Takes the same arguments as avRecvAudioData(). The frames of a bundle are
+ *			returned by consecutive calls without receiving again, all with the frame
+ *			index of the bundle.
+ *
+ * \param nAudioDataMaxSize [in] At least #AV_MAX_AUDIO_DATA_SIZE, so a whole bundle fits
+ *
+ * \return The size of the frame data if return value >= 0
+ * \return Error code if return value < 0
+ *			- The errors of avRecvAudioData()
+ *			- #AV_ER_BUFPARA_MAXSIZE_INSUFF A frame of the bundle does not fit in the buffers;
+ *			  the frame is skipped
+ *
+ * \attention Only one thread at a time may receive audio on an AV channel.
+ */
+AVAPI_API int avRecvAudioDataAggr(int nAVChannelID, char *abAudioData, int nAudioDataMaxSize,
+								  char *abFrameInfo, int nFrameInfoMaxSize, unsigned int *pnFrameIdx);
+
+/**
+ * \brief Release what avRecvAudioDataAggr() keeps for an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Call it after the last avRecvAudioDataAggr() on the AV channel returns.
+ */
+AVAPI_API void avAudioAggrRecvClose(int nAVChannelID);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVAudioAggrAPIs_H_ */
@@ -0,0 +1,191 @@
+/*! \file AVAudioCodecAPIs.h
+This file describes the audio codec kernels of the AV extension module.
+They convert 16-bit PCM to and from G.711 mu-law and A-law around
+avSendAudioData() and avRecvAudioData(), and resample speech between 8 kHz
+and 16 kHz. The G.711 kernels compute the companding arithmetically, 8 or
+16 samples at a time, with SSE2 on x86 and NEON on ARM when the CPU has
+them. The portable engine uses the usual lookup tables. All engines give
+bit-exact results equal to the ITU-T G.711 reference code.
+The resampler uses a 6-tap half-band filter and keeps its history in an
+AVResampler, so frames of any size can be fed one after another.
+ */
+
+#ifndef _AVAudioCodecAPIs_H_
+#define _AVAudioCodecAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The input samples an AVResampler keeps between calls, at most */
+#define AV_RESAMPLE_HISTORY							12
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The G.711 companding laws
+ */
+typedef enum
+{
+	AV_G711_ULAW = 0,	///< mu-law, as used in North America and Japan
+	AV_G711_ALAW		///< A-law, as used in Europe
+} AVG711Law;
+
+/**
+ * \details The resampler conversions
+ */
+typedef enum
+{
+	AV_RESAMPLE_8K_TO_16K = 0,
+	AV_RESAMPLE_16K_TO_8K
+} AVResampleMode;
+
+/**
+ * \details The kernel engines. AV_AUDIO_ENGINE_AUTO selects the fastest
+ *			engine supported by the running CPU.
+ */
+typedef enum
+{
+	AV_AUDIO_ENGINE_AUTO = 0,
+	AV_AUDIO_ENGINE_PORTABLE,	///< Lookup tables in C, always available
+	AV_AUDIO_ENGINE_SSE2,		///< x86 SSE2, 8 samples at a time
+	AV_AUDIO_ENGINE_NEON		///< ARM NEON, 8 samples at a time
+} AVAudioEngine;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The state of a resampler, set up by avResamplerInit()
+ */
+typedef struct AVResampler
+{
+	AVResampleMode mode; //!< The conversion
+	int historyCount; //!< The input samples in history
+	short history[AV_RESAMPLE_HISTORY]; //!< The last input samples not fully used yet
+} AVResampler;
+
+/**
+ * \details The throughput measured by avAudioCodecBenchmark(), in millions of samples per second
+ */
+typedef struct AVAudioBenchmark
+{
+	float ulawEncode; //!< PCM to mu-law
+	float ulawDecode; //!< mu-law to PCM
+	float alawEncode; //!< PCM to A-law
+	float alawDecode; //!< A-law to PCM
+	float upsample; //!< 8 kHz to 16 kHz, counted in input samples
+	float downsample; //!< 16 kHz to 8 kHz, counted in input samples
+} AVAudioBenchmark;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Encode 16-bit PCM to G.711
+ *
+ * \param law [in] The companding law
+ * \param pcm [in] The samples
+ * \param nSamples [in] The number of samples
+ * \param pOut [out] nSamples bytes of G.711
+ *
+ * \return #AV_ER_NoERROR if encoding successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avG711Encode(AVG711Law law, const short *pcm, int nSamples, unsigned char *pOut);
+
+/**
+ * \brief Decode G.711 to 16-bit PCM
+ *
+ * \param law [in] The companding law
+ * \param cabIn [in] The G.711 bytes
+ * \param nSamples [in] The number of bytes
+ * \param pPcm [out] nSamples samples
+ *
+ * \return #AV_ER_NoERROR if decoding successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avG711Decode(AVG711Law law, const unsigned char *cabIn, int nSamples, short *pPcm);
+
+/**
+ * \brief Set up a resampler with empty history
+ *
+ * \return #AV_ER_NoERROR if setting up successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avResamplerInit(AVResampler *pResampler, AVResampleMode mode);
+
+/**
+ * \brief Resample the next block of a stream
+ *
+ * \details Upsampling gives 2 * nSamples samples, 3 input samples late. Downsampling
+ *			gives one sample per two input samples; an odd sample waits for the next call.
+ *
+ * \param pResampler [in] The resampler
+ * \param pcm [in] The input samples
+ * \param nSamples [in] The number of input samples
+ * \param pOut [out] Room for 2 * nSamples samples when upsampling, nSamples / 2 + 1 when downsampling
+ *
+ * \return The number of samples written if return value >= 0
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avResample(AVResampler *pResampler, const short *pcm, int nSamples, short *pOut);
+
+/**
+ * \brief Get the kernel engine in use
+ *
+ * \return The engine picked by CPU feature detection, or the one set by avAudioSetEngine()
+ */
+AVAPI_API AVAudioEngine avAudioGetEngine(void);
+
+/**
+ * \brief Check if a kernel engine is supported by the running CPU
+ *
+ * \return 1 if supported, 0 if not
+ */
+AVAPI_API int avAudioEngineSupported(AVAudioEngine engine);
+
+/**
+ * \brief Force the kernel engine, mainly for testing and benchmarking
+ *
+ * \param engine [in] The engine, or #AV_AUDIO_ENGINE_AUTO to go back to detection
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The engine is not supported by the running CPU
+ */
+AVAPI_API int avAudioSetEngine(AVAudioEngine engine);
+
+/**
+ * \brief Measure the throughput of the kernels of an engine on the running device
+ *
+ * \details Runs each kernel on 20 ms frames for nDurationMs. Compare the result for
+ *			#AV_AUDIO_ENGINE_PORTABLE with the one for #AV_AUDIO_ENGINE_AUTO to see the gain.
+ *
+ * \param engine [in] The engine to measure
+ * \param nDurationMs [in] How long to run each kernel
+ * \param pResult [out] The throughput of each kernel
+ *
+ * \return #AV_ER_NoERROR if measuring successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid or the engine is not supported
+ */
+AVAPI_API int avAudioCodecBenchmark(AVAudioEngine engine, unsigned int nDurationMs, AVAudioBenchmark *pResult);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVAudioCodecAPIs_H_ */
@@ -0,0 +1,177 @@
+/*! \file AVBitrateAPIs.h
+This file describes the bitrate controller APIs of the AV extension module.
+avDASACheck() picks one of five coarse #AV_DASA_LEVEL levels, and its only
+strong signal is #AV_ER_DASA_CLEAN_BUFFER. A bitrate controller instead
+keeps a continuous video bitrate target and tells the application "set the
+encoder to N kbps, M fps". The target follows the bandwidth of the path,
+taken from the pacer of the AV channel, and the queueing delay, taken from
+avStatusCheck() and the resend buffer usage. It drops within one RTT of the
+bandwidth going down. It only rises after the path has stayed clear for a
+while, and only by steps, so the encoder does not oscillate. The frame rate
+comes from a ladder of (kbps, fps) rungs with its own hysteresis.
+ */
+
+#ifndef _AVBitrateAPIs_H_
+#define _AVBitrateAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The interval, in unit of millisecond, the controller checks the path at */
+#define AV_BITRATE_SAMPLE_INTERVAL					20
+
+/** The default share, in percent, of the path bandwidth given to video */
+#define AV_BITRATE_DEFAULT_HEADROOM					85
+
+/** The default queueing delay, in unit of millisecond, above which the target drops */
+#define AV_BITRATE_DEFAULT_DELAY_THRESHOLD			60
+
+/** The default time, in unit of millisecond, the path must stay clear before the target rises */
+#define AV_BITRATE_DEFAULT_INCREASE_HOLD			3000
+
+/** The step, in percent, by which the target rises */
+#define AV_BITRATE_INCREASE_STEP					8
+
+/** The margin, in percent, a new rung or target must clear before the application is told */
+#define AV_BITRATE_HYSTERESIS						10
+
+/** The resend buffer usage above which the path counts as congested */
+#define AV_BITRATE_CONGESTED_USAGE					0.5f
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A rung of the bitrate ladder: at nKbps or more, run the encoder at nFps
+ */
+typedef struct AVBitrateRung
+{
+	unsigned int nKbps;
+	unsigned int nFps;
+} AVBitrateRung;
+
+/**
+ * \details The configuration of a bitrate controller
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVBitrateConfig)
+ * \param minKbps [in] The lowest target
+ * \param maxKbps [in] The highest target
+ * \param startKbps [in] The first target, 0 for minKbps
+ * \param ladder [in] The rungs in rising nKbps order, the first at minKbps or lower; NULL to always use maxFps
+ * \param ladderCount [in] The number of rungs
+ * \param maxFps [in] The frame rate when there is no ladder
+ * \param headroomPercent [in] The share of the path bandwidth given to video, 0 for #AV_BITRATE_DEFAULT_HEADROOM
+ * \param delayThresholdMs [in] The queueing delay above which the target drops,
+ *			0 for #AV_BITRATE_DEFAULT_DELAY_THRESHOLD
+ * \param increaseHoldMs [in] The time the path must stay clear before the target rises,
+ *			0 for #AV_BITRATE_DEFAULT_INCREASE_HOLD
+ */
+typedef struct AVBitrateConfig
+{
+	unsigned int cb;
+	unsigned int minKbps;
+	unsigned int maxKbps;
+	unsigned int startKbps;
+	const AVBitrateRung *ladder;
+	unsigned int ladderCount;
+	unsigned int maxFps;
+	unsigned int headroomPercent;
+	unsigned int delayThresholdMs;
+	unsigned int increaseHoldMs;
+} AVBitrateConfig;
+
+/**
+ * \details Bitrate controller statistics, got by avBitrateGetStats().
+ */
+typedef struct AVBitrateStats
+{
+	unsigned int targetKbps; //!< The current target
+	unsigned int fps; //!< The current frame rate
+	unsigned int availableKbps; //!< The bandwidth for video at the last check
+	unsigned int queueDelayMs; //!< The queueing delay at the last check
+	float resendUsage; //!< The resend buffer usage at the last check, -1 if resend is off
+	unsigned int increases; //!< Times the target rose
+	unsigned int decreases; //!< Times the target dropped
+	unsigned int notifications; //!< Times the change callback was called
+} AVBitrateStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback asking the application to reconfigure its encoder
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param nKbps [out] The bitrate to encode at, in kbit per second
+ * \param nFps [out] The frame rate to encode at
+ * \param pUserData [out] The data passed to avBitrateAttach()
+ *
+ * \attention The callback runs on the controller thread.
+ */
+typedef void(__stdcall *avBitrateChangeFn)(int nAVChannelID, unsigned int nKbps, unsigned int nFps,
+										   void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Run a bitrate controller on an AV channel
+ *
+ * \details Starts a thread which checks the path every #AV_BITRATE_SAMPLE_INTERVAL
+ *			milliseconds and calls pfxChangeFn, first with the start target and then
+ *			each time the target or the frame rate changes. Use it instead of DASA,
+ *			not together with it.
+ *
+ * \param nAVChannelID [in] The AV channel, attached to a pacer by avServPacerAttach()
+ * \param pConfig [in] The configuration
+ * \param pfxChangeFn [in] The change callback
+ * \param pUserData [in] The data passed to pfxChangeFn
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel already has a controller
+ *			- #AV_ER_INVALID_SID The AV channel is not attached to a pacer
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avBitrateAttach(int nAVChannelID, const AVBitrateConfig *pConfig, avBitrateChangeFn pfxChangeFn,
+							  void *pUserData);
+
+/**
+ * \brief Stop the bitrate controller of an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ *
+ * \attention Do not call it from the change callback.
+ */
+AVAPI_API void avBitrateDetach(int nAVChannelID);
+
+/**
+ * \brief Get statistics of the bitrate controller of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no controller or pStats is NULL
+ */
+AVAPI_API int avBitrateGetStats(int nAVChannelID, AVBitrateStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVBitrateAPIs_H_ */
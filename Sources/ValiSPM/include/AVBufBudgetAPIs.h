@@ -0,0 +1,235 @@
+/*! \file AVBufBudgetAPIs.h
+This file describes the receive buffer budget APIs of the AV extension
+module. avClientSetMaxBufSize() is one size for the whole process, so a
+client showing a grid of cameras either gives every thumbnail as much
+memory as the 4K main view or starves the main view. A budget manager
+gives each AV channel of the client its own budget instead, and keeps the
+sum of all budgets within one global cap.
+A budget is the bitrate of the stream times bufferMs. The bitrate is
+measured from the frames received with avRecvFrameDataPooled() or
+reported by avBufBudgetReceived(). When avClientRecvBufUsageRate() of an
+AV channel stays high its budget grows, and when it stays low the budget
+shrinks back. When the budgets do not fit in the cap, each AV channel
+keeps minKB and the rest is shared by weight.
+The AV module sizes the receive buffer of an AV channel when it starts.
+avClientStartBudgeted() sets avClientSetMaxBufSize() to the budget of the
+new AV channel just before it starts, one start at a time, and sets it back
+to clientBufKB afterwards. A start which would break the cap even with
+minKB is refused. Later changes
+are reported to the change callback, so the application can shed load or
+restart the AV channel with its new budget when it next switches streams.
+ */
+
+#ifndef _AVBufBudgetAPIs_H_
+#define _AVBufBudgetAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default cap, in unit of kilo-byte, of all budgets together */
+#define AV_BUFBUDGET_DEFAULT_TOTAL_KB				(16 * 1024)
+
+/** The default smallest budget, in unit of kilo-byte */
+#define AV_BUFBUDGET_DEFAULT_MIN_KB					128
+
+/** The default largest budget, in unit of kilo-byte */
+#define AV_BUFBUDGET_DEFAULT_MAX_KB					(4 * 1024)
+
+/** The receive buffer, in unit of kilo-byte, the AV module gives an AV channel by default */
+#define AV_BUFBUDGET_DEFAULT_CLIENT_BUF_KB			1024
+
+/** The default time of stream, in unit of millisecond, a budget should hold */
+#define AV_BUFBUDGET_DEFAULT_BUFFER_MS				2000
+
+/** The interval, in unit of millisecond, the budgets are recomputed */
+#define AV_BUFBUDGET_INTERVAL						500
+
+/** The receive buffer usage rate above which a budget grows */
+#define AV_BUFBUDGET_HIGH_USAGE						0.75f
+
+/** The receive buffer usage rate below which a grown budget shrinks back */
+#define AV_BUFBUDGET_LOW_USAGE						0.25f
+
+/** The most a budget grows over the one computed from the bitrate */
+#define AV_BUFBUDGET_MAX_PRESSURE					4.0f
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of the budget manager
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVBufBudgetConfig)
+ * \param totalKB [in] The cap of all budgets together, 0 for #AV_BUFBUDGET_DEFAULT_TOTAL_KB
+ * \param minKB [in] The smallest budget, 0 for #AV_BUFBUDGET_DEFAULT_MIN_KB
+ * \param maxKB [in] The largest budget, 0 for #AV_BUFBUDGET_DEFAULT_MAX_KB
+ * \param bufferMs [in] The time of stream a budget should hold, 0 for #AV_BUFBUDGET_DEFAULT_BUFFER_MS
+ * \param clientBufKB [in] The avClientSetMaxBufSize() of the application, restored after each
+ *			avClientStartBudgeted(); 0 for #AV_BUFBUDGET_DEFAULT_CLIENT_BUF_KB
+ */
+typedef struct AVBufBudgetConfig
+{
+	unsigned int cb;
+	unsigned int totalKB;
+	unsigned int minKB;
+	unsigned int maxKB;
+	unsigned int bufferMs;
+	unsigned int clientBufKB;
+} AVBufBudgetConfig;
+
+/**
+ * \details The budget of an AV channel, got by avBufBudgetGetInfo().
+ */
+typedef struct AVBufBudgetInfo
+{
+	unsigned int budgetKB; //!< The current budget
+	unsigned int startKB; //!< The receive buffer the AV module got when the AV channel started, 0 if unknown
+	unsigned int kbps; //!< The measured bitrate, or the expected one until frames are measured
+	float usage; //!< The last avClientRecvBufUsageRate(), < 0 if it failed
+	float pressure; //!< How much the budget has grown for a high usage rate, 1 ~ #AV_BUFBUDGET_MAX_PRESSURE
+	unsigned int weight; //!< The weight of the AV channel when budgets are cut to the cap
+} AVBufBudgetInfo;
+
+/**
+ * \details Budget manager statistics, got by avBufBudgetGetStats().
+ */
+typedef struct AVBufBudgetStats
+{
+	unsigned int channels; //!< AV channels with a budget
+	unsigned int totalKB; //!< The cap
+	unsigned int demandKB; //!< What the AV channels would get without the cap
+	unsigned int allocatedKB; //!< What they get
+	unsigned int changes; //!< Times the change callback was called
+} AVBufBudgetStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback reporting a new budget
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param nBudgetKB [out] The new budget, in unit of kilo-byte
+ * \param pUserData [out] The data passed to avBufBudgetSetup()
+ *
+ * \attention The callback runs on the manager thread.
+ */
+typedef void(__stdcall *avBufBudgetChangeFn)(int nAVChannelID, unsigned int nBudgetKB, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Configure the budget manager
+ *
+ * \details May be called at any time; a new cap applies at the next recomputation.
+ *
+ * \param pConfig [in] The configuration, NULL for the default one
+ * \param pfxChangeFn [in] The callback reporting budget changes, may be NULL
+ * \param pUserData [in] The data passed to pfxChangeFn
+ *
+ * \return #AV_ER_NoERROR if configuring successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avBufBudgetSetup(const AVBufBudgetConfig *pConfig, avBufBudgetChangeFn pfxChangeFn, void *pUserData);
+
+/**
+ * \brief Start an AV client with a receive buffer sized by its budget
+ *
+ * \details Computes the budget of the new AV channel from nExpectedKbps and what the
+ *			other AV channels hold, calls avClientSetMaxBufSize() with it and then
+ *			avClientStartEx(), and restores avClientSetMaxBufSize() to clientBufKB of the
+ *			configuration. Starts through this function run one at a time.
+ *
+ * \param AVClientInConfig [in] The configuration passed to avClientStartEx()
+ * \param AVClientOutConfig [out] The output of avClientStartEx()
+ * \param nExpectedKbps [in] The bitrate the stream is expected to have, e.g. 300 for a
+ *			thumbnail and 8000 for a 4K main view
+ * \param nWeight [in] The weight of the AV channel when budgets are cut to the cap, 0 for 1
+ *
+ * \return The AV channel ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_EXCEED_MAX_SIZE The other budgets leave less than minKB under the cap;
+ *			  the AV client is not started
+ *			- The errors of avClientStartEx()
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation; the AV channel is stopped
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the manager thread; the AV channel is stopped
+ */
+AVAPI_API int avClientStartBudgeted(LPCAVCLIENT_START_IN_CONFIG AVClientInConfig,
+									LPAVCLIENT_START_OUT_CONFIG AVClientOutConfig, unsigned int nExpectedKbps,
+									unsigned int nWeight);
+
+/**
+ * \brief Give an AV channel which is already started a budget
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nExpectedKbps [in] The bitrate the stream is expected to have
+ * \param nWeight [in] The weight of the AV channel when budgets are cut to the cap, 0 for 1
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel has a budget already
+ *			- #AV_ER_EXCEED_MAX_SIZE The other budgets leave less than minKB under the cap
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the manager thread
+ */
+AVAPI_API int avBufBudgetAttach(int nAVChannelID, unsigned int nExpectedKbps, unsigned int nWeight);
+
+/**
+ * \brief Remove the budget of an AV channel, e.g. before avClientStop()
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avBufBudgetDetach(int nAVChannelID);
+
+/**
+ * \brief Change the weight of an AV channel, e.g. when it moves from a thumbnail to the main view
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no budget
+ */
+AVAPI_API int avBufBudgetSetWeight(int nAVChannelID, unsigned int nWeight);
+
+/**
+ * \brief Report the bytes of a frame received by other means than avRecvFrameDataPooled()
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nBytes [in] The size of the frame, e.g. what avRecvFrameData2() returned
+ */
+AVAPI_API void avBufBudgetReceived(int nAVChannelID, int nBytes);
+
+/**
+ * \brief Get the budget of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no budget or pInfo is NULL
+ */
+AVAPI_API int avBufBudgetGetInfo(int nAVChannelID, AVBufBudgetInfo *pInfo);
+
+/**
+ * \brief Get statistics of the budget manager
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG pStats is NULL
+ */
+AVAPI_API int avBufBudgetGetStats(AVBufBudgetStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVBufBudgetAPIs_H_ */
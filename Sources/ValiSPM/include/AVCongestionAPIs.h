@@ -0,0 +1,242 @@
+/*! \file AVCongestionAPIs.h
+This file describes the congestion control APIs of the AV extension module.
+A congestion controller sets the rate of the pacer of an AV channel. Every
+#AV_CC_SAMPLE_INTERVAL milliseconds it gets a sample of the path. Each
+sample holds the avStatusCheck() figures of the AV module, MinRTT, LastRtt,
+LastBw, LastCwnd and InFlight, plus what the pacer saw in the interval. The
+controller returns the next pacing rate.
+Controllers are plugins: a BBR-style, a delay-based and a fixed-rate
+controller are built in, and an application can supply its own. A trace
+hook sees every sample with the rate chosen for it. avCongestionReplay()
+runs any controller over a recorded trace, so controllers can be compared
+offline on the same path.
+ */
+
+#ifndef _AVCongestionAPIs_H_
+#define _AVCongestionAPIs_H_
+
+#include "AVAPIs.h"
+#include "IOTCPacerAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The interval, in unit of millisecond, a controller gets samples at */
+#define AV_CC_SAMPLE_INTERVAL						20
+
+/** The queueing delay, in unit of millisecond, the delay-based controller aims for */
+#define AV_CC_DELAY_TARGET							25
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The built-in congestion controllers, see avCongestionGetBuiltin()
+ */
+typedef enum
+{
+	AV_CC_FIXED = 0,	///< Always the initial rate
+	AV_CC_BBR,			///< Paces at the estimated bottleneck bandwidth, probing for more in cycles
+	AV_CC_DELAY			///< Keeps the queueing delay, RTT over min RTT, near #AV_CC_DELAY_TARGET
+} AVCongestionType;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A sample of the path, given to a controller and to the trace hook.
+ *			The AV module figures are 0 if avStatusCheck() is not supported.
+ */
+typedef struct AVCongestionSample
+{
+	unsigned long long timeUs; //!< The monotonic time of the sample in microsecond
+	unsigned int intervalUs; //!< The time since the last sample in microsecond
+	unsigned int rttMs; //!< LastRtt of st_AvStatus, or RoundTripTime if LastRtt is 0
+	unsigned int minRttMs; //!< MinRTT of st_AvStatus
+	unsigned int lostRate; //!< LostRate of st_AvStatus
+	unsigned int sdkBandwidth; //!< LastBw of st_AvStatus
+	unsigned int sdkCwnd; //!< LastCwnd of st_AvStatus
+	unsigned int inFlight; //!< InFlight of st_AvStatus
+	unsigned int pacingRate; //!< The pacing rate during the interval, in byte per second
+	unsigned int sendRate; //!< Bytes written through the pacer per second during the interval
+	unsigned int appLimited; //!< 1 if no write waited for the pacer, so sendRate says nothing about the path
+	unsigned int queueFull; //!< Times the socket queue was full during the interval
+} AVCongestionSample;
+
+/**
+ * \details Statistics of the controller of an AV channel, got by avCongestionGetStats().
+ */
+typedef struct AVCongestionStats
+{
+	unsigned int rate; //!< The current pacing rate in byte per second
+	unsigned int sampleCount; //!< Samples taken
+	unsigned int rateChanges; //!< Samples after which the rate changed
+	AVCongestionSample lastSample; //!< The last sample
+} AVCongestionStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the function creating the state of a controller
+ *
+ * \param nInitialRate [out] The rate to start at, in byte per second
+ * \param pUserData [out] The data passed to avCongestionAttach() or avCongestionReplay()
+ *
+ * \return The state, passed to the other functions of the controller; NULL if out of memory
+ */
+typedef void *(__stdcall *avCongestionCreateFn)(unsigned int nInitialRate, void *pUserData);
+
+/**
+ * \details The prototype of the function taking a sample
+ *
+ * \param pState [out] The state of the controller
+ * \param pSample [out] The sample
+ *
+ * \return The pacing rate until the next sample, in byte per second, 0 to keep the current rate
+ */
+typedef unsigned int(__stdcall *avCongestionUpdateFn)(void *pState, const AVCongestionSample *pSample);
+
+/**
+ * \details The prototype of the function releasing the state of a controller
+ */
+typedef void(__stdcall *avCongestionDestroyFn)(void *pState);
+
+/**
+ * \details The prototype of the trace hook, called after every sample
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param pSample [out] The sample
+ * \param nRate [out] The pacing rate the controller chose for it
+ * \param pUserData [out] The data passed to avCongestionSetTrace()
+ *
+ * \attention The hook runs on the controller thread and should return ASAP, e.g. append the sample to a file.
+ */
+typedef void(__stdcall *avCongestionTraceFn)(int nAVChannelID, const AVCongestionSample *pSample,
+											 unsigned int nRate, void *pUserData);
+
+/**
+ * \details A congestion controller
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVCongestionOps)
+ * \param name [in] The name of the controller, for logs
+ * \param create [in] Creates the state of the controller
+ * \param update [in] Takes a sample and returns the next rate
+ * \param destroy [in] Releases the state of the controller
+ */
+typedef struct AVCongestionOps
+{
+	unsigned int cb;
+	const char *name;
+	avCongestionCreateFn create;
+	avCongestionUpdateFn update;
+	avCongestionDestroyFn destroy;
+} AVCongestionOps;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Get a built-in congestion controller
+ *
+ * \return The controller, NULL if eType is not valid
+ */
+AVAPI_API const AVCongestionOps *avCongestionGetBuiltin(AVCongestionType eType);
+
+/**
+ * \brief Run a congestion controller on an AV channel
+ *
+ * \details Starts a thread which samples the AV channel and sets the rate of the pacer
+ *			of its session. The pacer stops estimating the rate by itself.
+ *
+ * \param nAVChannelID [in] The AV channel, attached to a pacer by avServPacerAttach()
+ * \param pOps [in] The controller, built in or supplied by the application
+ * \param nInitialRate [in] The rate to start at, in byte per second,
+ *			0 for #IOTC_PACER_AUTO_INITIAL_RATE
+ * \param pUserData [in] The data passed to pOps->create
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG pOps is not valid or the AV channel already has a controller
+ *			- #AV_ER_INVALID_SID The AV channel is not attached to a pacer
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avCongestionAttach(int nAVChannelID, const AVCongestionOps *pOps, unsigned int nInitialRate,
+								 void *pUserData);
+
+/**
+ * \brief Stop the congestion controller of an AV channel
+ *
+ * \details The pacer gets back the mode it had before avCongestionAttach(). A pacer which
+ *			estimated the rate by itself does so again, starting from the last rate; a pacer
+ *			with a fixed rate gets that rate back.
+ *
+ * \param nAVChannelID [in] The AV channel
+ */
+AVAPI_API void avCongestionDetach(int nAVChannelID);
+
+/**
+ * \brief Set the trace hook of the congestion controller of an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ * \param pfxTraceFn [in] The hook, NULL to remove it
+ * \param pUserData [in] The data passed to pfxTraceFn
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no controller
+ */
+AVAPI_API int avCongestionSetTrace(int nAVChannelID, avCongestionTraceFn pfxTraceFn, void *pUserData);
+
+/**
+ * \brief Get statistics of the congestion controller of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no controller or pStats is NULL
+ */
+AVAPI_API int avCongestionGetStats(int nAVChannelID, AVCongestionStats *pStats);
+
+/**
+ * \brief Run a congestion controller over recorded samples
+ *
+ * \details Feeds the samples to a new instance of the controller in order, as if they
+ *			came from an AV channel, and records the rate it chose after each one. The
+ *			pacingRate of the samples is not used; what the path did is replayed, what
+ *			the controller would have done is the output.
+ *
+ * \param pOps [in] The controller
+ * \param nInitialRate [in] The rate to start at, 0 for #IOTC_PACER_AUTO_INITIAL_RATE
+ * \param pUserData [in] The data passed to pOps->create
+ * \param pSamples [in] The samples, e.g. recorded by the trace hook
+ * \param nCount [in] The number of samples
+ * \param pRates [out] The rate after each sample, nCount entries
+ *
+ * \return #AV_ER_NoERROR if replaying successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_MEM_INSUFF The controller could not create its state
+ */
+AVAPI_API int avCongestionReplay(const AVCongestionOps *pOps, unsigned int nInitialRate, void *pUserData,
+								 const AVCongestionSample *pSamples, unsigned int nCount, unsigned int *pRates);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVCongestionAPIs_H_ */
@@ -0,0 +1,304 @@
+/*! \file AVFecAPIs.h
+This file describes the forward error correction APIs of the AV extension module.
+An FEC channel carries video frames over an IOTC channel as datagrams. The
+packets of each frame are grouped into blocks, and a block of k data packets
+gets m parity packets of a systematic Reed-Solomon code over GF(256). The
+client rebuilds a block from any k of its k + m packets, so a lost packet
+costs no round trip. The first parity packet of a block is the XOR of its
+data packets, so a block with one parity packet is plain XOR parity.
+The sender picks m for each block from the packet loss the client reports
+and, if an AV channel is given, the LostRate of avStatusCheck(), so the
+redundancy follows the link. Resend can be turned on as well. The client
+then asks for the packets it still needs when FEC cannot rebuild a block.
+The coding kernels use SSSE3 on x86 and NEON on ARM when the CPU has them.
+ */
+
+#ifndef _AVFecAPIs_H_
+#define _AVFecAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+#include "IOTCAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The max number of data plus parity packets in one block */
+#define AV_FEC_MAX_BLOCK_PACKETS					128
+
+/** The default max number of data packets in one block */
+#define AV_FEC_DEFAULT_BLOCK_SIZE					16
+
+/** The default lowest redundancy, parity packets per 100 data packets */
+#define AV_FEC_DEFAULT_MIN_REDUNDANCY				10
+
+/** The default highest redundancy, parity packets per 100 data packets */
+#define AV_FEC_DEFAULT_MAX_REDUNDANCY				50
+
+/** The default time, in unit of millisecond, the client waits for an incomplete frame without resend */
+#define AV_FEC_DEFAULT_MAX_DELAY					60
+
+/** The default time, in unit of millisecond, the client waits for an incomplete frame with resend */
+#define AV_FEC_DEFAULT_MAX_DELAY_RESEND				300
+
+/** The number of sent frames the server keeps for resend */
+#define AV_FEC_RESEND_HISTORY						64
+
+/** The probability of losing a block which the redundancy is chosen for */
+#define AV_FEC_TARGET_BLOCK_LOSS					0.001
+
+/** The interval, in unit of millisecond, the client reports the packet loss it sees */
+#define AV_FEC_REPORT_INTERVAL						500
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The coding engines. AV_FEC_ENGINE_AUTO selects the fastest
+ *			engine supported by the running CPU.
+ */
+typedef enum
+{
+	AV_FEC_ENGINE_AUTO = 0,
+	AV_FEC_ENGINE_PORTABLE,		///< Table based implementation in C, always available
+	AV_FEC_ENGINE_SSSE3,		///< x86 SSSE3 byte shuffles
+	AV_FEC_ENGINE_NEON			///< ARM NEON table lookups
+} AVFecEngine;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of an FEC channel, used by avFecSenderCreate()
+ *			and avFecReceiverCreate()
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVFecConfig)
+ * \param resend [in] 1: the client asks for the packets FEC could not rebuild; 0: no resend.
+ *			Must be the same on both sides.
+ * \param blockSize [in] The max number of data packets in a block, 0 for #AV_FEC_DEFAULT_BLOCK_SIZE
+ * \param minRedundancy [in] The lowest number of parity packets per 100 data packets,
+ *			used on a clean link. 0 sends no parity until loss is seen.
+ * \param maxRedundancy [in] The highest number of parity packets per 100 data packets,
+ *			0 for #AV_FEC_DEFAULT_MAX_REDUNDANCY, at most 100
+ * \param maxDelayMs [in] Client only. The time to wait for an incomplete frame before
+ *			it is dropped, 0 for #AV_FEC_DEFAULT_MAX_DELAY or #AV_FEC_DEFAULT_MAX_DELAY_RESEND
+ */
+typedef struct AVFecConfig
+{
+	unsigned int cb;
+	int resend;
+	unsigned int blockSize;
+	unsigned int minRedundancy;
+	unsigned int maxRedundancy;
+	unsigned int maxDelayMs;
+} AVFecConfig;
+
+/**
+ * \details Statistics of the server side of an FEC channel, got by avFecSenderGetStats().
+ */
+typedef struct AVFecSenderStats
+{
+	unsigned int framesSent; //!< Frames sent
+	unsigned int dataPackets; //!< Data packets sent
+	unsigned int parityPackets; //!< Parity packets sent
+	unsigned int resentPackets; //!< Packets sent again on request of the client
+	unsigned int lossPermille; //!< The packet loss the redundancy is chosen for, in 1/1000
+	unsigned int redundancy; //!< Parity packets per 100 data packets of the last frame
+	int lastError; //!< The last error of IOTC_Session_Write(), #IOTC_ER_NoERROR if none
+} AVFecSenderStats;
+
+/**
+ * \details Statistics of the client side of an FEC channel, got by avFecReceiverGetStats().
+ */
+typedef struct AVFecReceiverStats
+{
+	unsigned int framesReceived; //!< Complete frames handed out
+	unsigned int framesLost; //!< Frames dropped as incomplete
+	unsigned int framesRecovered; //!< Complete frames which needed FEC
+	unsigned int framesResent; //!< Complete frames which needed resend
+	unsigned int packetsReceived; //!< Packets received
+	unsigned int lossPermille; //!< The packet loss before recovery, in 1/1000, of the last report interval
+	unsigned int avgDelayMs; //!< The average time from the first packet of a frame to the frame being complete
+	unsigned int maxDelayMs; //!< The longest such time
+	int lastError; //!< The error which ended the receive thread, #IOTC_ER_NoERROR if none
+} AVFecReceiverStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Get the coding engine used by FEC channels
+ *
+ * \return The engine picked by CPU feature detection, or the one set by avFecSetEngine()
+ */
+AVAPI_API AVFecEngine avFecGetEngine(void);
+
+/**
+ * \brief Check if a coding engine is supported by the running CPU
+ *
+ * \return 1 if supported, 0 otherwise
+ */
+AVAPI_API int avFecEngineSupported(AVFecEngine engine);
+
+/**
+ * \brief Force the coding engine, mainly for testing and benchmarking
+ *
+ * \param engine [in] The engine, or #AV_FEC_ENGINE_AUTO to go back to detection
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The engine is not supported by the running CPU
+ */
+AVAPI_API int avFecSetEngine(AVFecEngine engine);
+
+/**
+ * \brief Start the server side of an FEC channel
+ *
+ * \details Starts a thread which reads the loss reports and resend requests of the
+ *			client from the IOTC channel.
+ *
+ * \param nIOTCSessionID [in] The IOTC session to send on
+ * \param nIOTCChannelID [in] The IOTC channel to send on, turned on by both sides and used
+ *			for nothing else
+ * \param nAVChannelID [in] An AV channel on the same session whose avStatusCheck() LostRate,
+ *			in percent, adds to the loss the client reports, or -1 for none
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The FEC sender ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument or the configuration is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ */
+AVAPI_API int avFecSenderCreate(int nIOTCSessionID, unsigned char nIOTCChannelID, int nAVChannelID,
+								const AVFecConfig *pConfig);
+
+/**
+ * \brief Stop the server side of an FEC channel
+ *
+ * \param nFecSenderID [in] The FEC sender ID
+ *
+ * \attention Call it after the last avFecSendFrame() on it returns, before closing the session.
+ */
+AVAPI_API void avFecSenderDestroy(int nFecSenderID);
+
+/**
+ * \brief Send a video frame on an FEC channel
+ *
+ * \details Sends the data and parity packets of the frame by IOTC_Session_Write_Paced(),
+ *			so the pacer of the session is used if it has one.
+ *
+ * \param nFecSenderID [in] The FEC sender ID
+ * \param cabFrameData [in] The frame data to be sent
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The video frame information to be sent
+ * \param nFrameInfoSize [in] The size of the video frame information, at most #AV_FRAME_INFO_MAX_SIZE
+ *
+ * \return #AV_ER_NoERROR if sending successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The FEC sender ID or a size is not valid
+ *			- #AV_ER_EXCEED_MAX_SIZE The frame needs more than 255 blocks
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- The error of IOTC_Session_Write() if the session cannot send any more
+ */
+AVAPI_API int avFecSendFrame(int nFecSenderID, const char *cabFrameData, int nFrameDataSize,
+							 const void *cabFrameInfo, int nFrameInfoSize);
+
+/**
+ * \brief Get statistics of the server side of an FEC channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The FEC sender ID is not valid or pStats is NULL
+ */
+AVAPI_API int avFecSenderGetStats(int nFecSenderID, AVFecSenderStats *pStats);
+
+/**
+ * \brief Start the client side of an FEC channel
+ *
+ * \details Starts a thread which reads the IOTC channel, rebuilds the frames and
+ *			queues them in order for avFecRecvFrame().
+ *
+ * \param nIOTCSessionID [in] The IOTC session to receive on
+ * \param nIOTCChannelID [in] The IOTC channel to receive on, turned on by both sides and used
+ *			for nothing else
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The FEC receiver ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument or the configuration is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ */
+AVAPI_API int avFecReceiverCreate(int nIOTCSessionID, unsigned char nIOTCChannelID, const AVFecConfig *pConfig);
+
+/**
+ * \brief Stop the client side of an FEC channel
+ *
+ * \details Stops the receive thread and releases the queued frames.
+ *
+ * \param nFecReceiverID [in] The FEC receiver ID
+ */
+AVAPI_API void avFecReceiverDestroy(int nFecReceiverID);
+
+/**
+ * \brief Receive the next complete frame from an FEC channel
+ *
+ * \details Frames are handed out in the order they were sent. A frame which is
+ *			still incomplete after maxDelayMs is skipped, so the caller should wait
+ *			for the next keyframe after AV_ER_LOSED_THIS_FRAME.
+ *
+ * \param nFecReceiverID [in] The FEC receiver ID
+ * \param ppFrame [out] The frame, which the caller must release by avFrameRelease()
+ * \param nTimeout [in] The timeout in millisecond
+ *
+ * \return #AV_ER_NoERROR if a frame is returned
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The FEC receiver ID is not valid or ppFrame is NULL
+ *			- #AV_ER_TIMEOUT No frame arrived within nTimeout
+ *			- #AV_ER_LOSED_THIS_FRAME Frames were skipped before the frame returned, which is still returned
+ *			- The error of IOTC_Session_Read() which ended the receive thread, once the queue is empty
+ */
+AVAPI_API int avFecRecvFrame(int nFecReceiverID, AVFrame **ppFrame, unsigned int nTimeout);
+
+/**
+ * \brief Get statistics of the client side of an FEC channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The FEC receiver ID is not valid or pStats is NULL
+ */
+AVAPI_API int avFecReceiverGetStats(int nFecReceiverID, AVFecReceiverStats *pStats);
+
+/**
+ * \brief Measure the coding throughput of an engine on the running device
+ *
+ * \param engine [in] The engine to measure
+ * \param nBlockSize [in] The number of data packets per block
+ * \param nRedundancy [in] Parity packets per 100 data packets
+ * \param nDurationMs [in] How long to run the encoder, and then the decoder
+ * \param pfEncodeMBps [out] Data encoded per second in MB
+ * \param pfDecodeMBps [out] Data rebuilt per second in MB, with all parity used up
+ *
+ * \return #AV_ER_NoERROR if measuring successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the engine is not supported
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avFecBenchmark(AVFecEngine engine, unsigned int nBlockSize, unsigned int nRedundancy,
+							 unsigned int nDurationMs, float *pfEncodeMBps, float *pfDecodeMBps);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVFecAPIs_H_ */
@@ -0,0 +1,202 @@
+/*! \file AVFrameAPIs.h
+This file describes the frame buffer APIs of the AV extension module.
+An AVFrame is a reference counted frame with its frame information. Frames
+received by avRecvFrameDataPooled() are drawn from a process wide pool of
+size classed buffers and go back to the pool when the last reference is
+released, so a client can queue received frames to its decoder without
+copying them and without allocating memory per frame. avFrameWrap() turns
+a buffer owned by the caller, such as an encoder output buffer, into a
+frame without copying it; the caller gets it back through a release callback.
+ */
+
+#ifndef _AVFrameAPIs_H_
+#define _AVFrameAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The max size of the frame information kept in an AVFrame */
+#define AV_FRAME_INFO_MAX_SIZE						128
+
+/** The smallest buffer size class of the frame pool, in byte */
+#define AV_FRAME_POOL_MIN_CLASS_SIZE				(4 * 1024)
+
+/** The largest buffer size class of the frame pool, in byte. Larger frames are allocated exactly and not pooled. */
+#define AV_FRAME_POOL_MAX_CLASS_SIZE				(8 * 1024 * 1024)
+
+/** The default buffer size for the first frame of an AV channel, in byte */
+#define AV_FRAME_POOL_DEFAULT_INITIAL_SIZE			(256 * 1024)
+
+/** The default max bytes of free buffers the frame pool keeps for reuse */
+#define AV_FRAME_POOL_DEFAULT_MAX_CACHED			(16 * 1024 * 1024)
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A reference counted frame. Only get one from the AV extension APIs and
+ *			give it back by avFrameRelease(); do not allocate or copy the structure.
+ */
+typedef struct AVFrame
+{
+	char *data; //!< The frame data
+	int dataSize; //!< The size of the frame data
+	int capacity; //!< The size of the buffer data points to
+	int expectedSize; //!< The frame size the AV server sent, larger than dataSize for an incomplete frame
+	char info[AV_FRAME_INFO_MAX_SIZE]; //!< The frame information
+	int infoSize; //!< The size of the frame information
+	unsigned int frameIndex; //!< The frame index
+} AVFrame;
+
+/**
+ * \details Frame pool statistics, got by avFramePoolGetStats().
+ */
+typedef struct AVFramePoolStats
+{
+	unsigned long long getCount; //!< Buffers taken from the pool
+	unsigned long long hitCount; //!< Buffers reused from the free lists
+	float hitRate; //!< hitCount / getCount
+	unsigned int resizeCount; //!< Frames lost because the buffer was too small, see avRecvFrameDataPooled()
+	unsigned int framesInUse; //!< Frames not released yet
+	unsigned int framesInUseHighWater; //!< The most frames ever in use at the same time
+	unsigned long long bytesInUse; //!< Buffer bytes of the frames in use
+	unsigned long long bytesInUseHighWater; //!< The most buffer bytes ever in use at the same time
+	unsigned long long bytesCached; //!< Bytes of free buffers kept for reuse
+	unsigned long long bytesCachedHighWater; //!< The most bytes ever kept for reuse
+} AVFramePoolStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the release callback of a frame made by avFrameWrap(),
+ *			called when its last reference is released.
+ *
+ * \param pData [out] The data passed to avFrameWrap()
+ * \param pUserData [out] The user data passed to avFrameWrap()
+ *
+ * \attention The callback runs on the thread which releases the last reference.
+ */
+typedef void(__stdcall *avFrameReleaseFn)(char *pData, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Set up the frame pool
+ *
+ * \param nInitialFrameSize [in] The buffer size used for the first frame of an AV channel,
+ *			0 for #AV_FRAME_POOL_DEFAULT_INITIAL_SIZE
+ * \param nMaxCachedBytes [in] The max bytes of free buffers kept for reuse,
+ *			0 for #AV_FRAME_POOL_DEFAULT_MAX_CACHED
+ *
+ * \return #AV_ER_NoERROR
+ */
+AVAPI_API int avFramePoolSetup(unsigned int nInitialFrameSize, unsigned int nMaxCachedBytes);
+
+/**
+ * \brief Free all buffers the frame pool keeps for reuse
+ *
+ * \details Frames still in use are not affected and go back to the pool when released.
+ */
+AVAPI_API void avFramePoolTrim(void);
+
+/**
+ * \brief Get statistics of the frame pool
+ *
+ * \param pStats [out] The statistics
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG pStats is NULL
+ */
+AVAPI_API int avFramePoolGetStats(AVFramePoolStats *pStats);
+
+/**
+ * \brief Receive a frame into a pooled frame buffer
+ *
+ * \details Same as avRecvFrameData2() except that the frame is received into a
+ *			buffer from the frame pool. The buffer comes from the size class of the
+ *			largest frame this AV channel has received, so in steady state no memory
+ *			is allocated. If a frame is larger than that, the SDK reports
+ *			#AV_ER_BUFPARA_MAXSIZE_INSUFF and drops it; the AV channel then uses the
+ *			size class of pnExpectedFrameSize from the next frame on.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel to be received
+ * \param ppFrame [out] The received frame, which the caller owns and must release by
+ *			avFrameRelease(). Set if the return value is >= 0 or #AV_ER_INCOMPLETE_FRAME,
+ *			NULL otherwise.
+ *
+ * \return The same as avRecvFrameData2()
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG ppFrame is NULL
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- The error codes of avRecvFrameData2()
+ */
+AVAPI_API int avRecvFrameDataPooled(int nAVChannelID, AVFrame **ppFrame);
+
+/**
+ * \brief Forget what the frame pool learned about an AV channel
+ *
+ * \details Call it after avClientStop() so a new AV channel with the same ID
+ *			starts with the initial frame size.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avFramePoolResetChannel(int nAVChannelID);
+
+/**
+ * \brief Make a frame of a buffer owned by the caller
+ *
+ * \details The frame points to pData instead of copying it. The caller must keep
+ *			pData valid and unchanged until pfxReleaseFn is called. The frame
+ *			information is copied.
+ *
+ * \param pData [in] The frame data
+ * \param nDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The frame information, may be NULL
+ * \param nFrameInfoSize [in] The size of the frame information, not larger than #AV_FRAME_INFO_MAX_SIZE
+ * \param pfxReleaseFn [in] Called when the last reference is released, may be NULL
+ * \param pUserData [in] The data passed to pfxReleaseFn
+ *
+ * \return The frame with one reference, NULL if an argument is not valid or out of memory
+ */
+AVAPI_API AVFrame *avFrameWrap(char *pData, int nDataSize, const void *cabFrameInfo, int nFrameInfoSize,
+							   avFrameReleaseFn pfxReleaseFn, void *pUserData);
+
+/**
+ * \brief Add a reference to a frame
+ *
+ * \param pFrame [in] The frame
+ *
+ * \return pFrame
+ */
+AVAPI_API AVFrame *avFrameRetain(AVFrame *pFrame);
+
+/**
+ * \brief Release a reference to a frame
+ *
+ * \details The frame buffer goes back to the pool when the last reference is released.
+ *
+ * \param pFrame [in] The frame, may be NULL
+ */
+AVAPI_API void avFrameRelease(AVFrame *pFrame);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVFrameAPIs_H_ */
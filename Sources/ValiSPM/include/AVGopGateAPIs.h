@@ -0,0 +1,141 @@
+/*! \file AVGopGateAPIs.h
+This file describes the GOP gate APIs of the AV extension module.
+A GOP gate sits in front of the resend buffer of an AV channel and knows
+where each GOP starts. When the resend buffer fills up, the P-frames still
+to come in the current GOP can only add to the backlog that the client will
+throw away with #AV_ER_WAIT_KEY_FRAME anyway. So the gate drops them and
+asks the encoder for a keyframe. If the buffer is nearly full, the gate
+also flushes the stale video it holds with avServResetBuffer(). The client
+then resumes at the new keyframe and end-to-end latency stays bounded.
+ */
+
+#ifndef _AVGopGateAPIs_H_
+#define _AVGopGateAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default resend buffer usage at which the rest of the current GOP is dropped */
+#define AV_GOP_DEFAULT_HIGH_USAGE					0.7f
+
+/** The default resend buffer usage at which the stale video in the resend buffer is flushed */
+#define AV_GOP_DEFAULT_CRITICAL_USAGE				0.9f
+
+/** The timeout, in unit of millisecond, of the avServResetBuffer() call of a flush */
+#define AV_GOP_RESET_TIMEOUT						5000
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details GOP gate statistics, got by avGopGateGetStats().
+ */
+typedef struct AVGopGateStats
+{
+	unsigned int sentFrames; //!< Frames passed to the AV module
+	unsigned int droppedFrames; //!< P-frames dropped by the gate
+	unsigned int skippedGops; //!< GOPs cut short by the gate
+	unsigned int flushCount; //!< Times the resend buffer was flushed by avServResetBuffer()
+	unsigned int keyFrameRequests; //!< Times the key frame callback was called
+	float lastUsage; //!< The resend buffer usage at the last frame, -1 if unknown
+} AVGopGateStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the key frame request callback of a GOP gate,
+ *			called when the gate starts dropping a GOP.
+ *
+ * \param nAVChannelID [out] The AV channel ID
+ * \param pUserData [out] The data passed to avGopGateAttach()
+ *
+ * \attention The callback runs on the thread sending the frame and should return ASAP.
+ */
+typedef void(__stdcall *avKeyFrameRequestFn)(int nAVChannelID, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Attach a GOP gate to an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel, started with resend enabled
+ * \param fHighUsage [in] The resend buffer usage, between 0 and 1, at which the rest of
+ *			the current GOP is dropped, 0 for #AV_GOP_DEFAULT_HIGH_USAGE
+ * \param fCriticalUsage [in] The resend buffer usage at which the stale video in the
+ *			resend buffer is flushed as well, 0 for #AV_GOP_DEFAULT_CRITICAL_USAGE
+ * \param pfxKeyFrameFn [in] Called to ask the encoder for a keyframe, may be NULL
+ * \param pUserData [in] The data passed to pfxKeyFrameFn
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID or a usage is not valid, or the AV channel already has a gate
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avGopGateAttach(int nAVChannelID, float fHighUsage, float fCriticalUsage,
+							  avKeyFrameRequestFn pfxKeyFrameFn, void *pUserData);
+
+/**
+ * \brief Detach the GOP gate from an AV channel
+ *
+ * \details Waits for a flush in progress. Call it after the last avSendFrameDataGop()
+ *			on this AV channel returns, before avServStop().
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avGopGateDetach(int nAVChannelID);
+
+/**
+ * \brief Send a video frame through the GOP gate
+ *
+ * \details Sends the frame by avSendFrameDataPaced() unless the gate drops it. After a
+ *			dropped or failed frame, every P-frame is dropped until the next keyframe.
+ *			A keyframe sent while a flush is in progress waits for the flush to
+ *			finish, so it is not flushed itself.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param cabFrameData [in] The frame data to be sent
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The video frame information to be sent
+ * \param nFrameInfoSize [in] The size of the video frame information
+ * \param bKeyFrame [in] 1 if the frame is a keyframe, 0 otherwise
+ *
+ * \return The same as avSendFrameData() if the frame is sent
+ * \return #AV_ER_WAIT_KEY_FRAME The gate dropped the frame
+ * \return #AV_ER_INVALID_ARG The AV channel has no gate
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avSendFrameDataGop(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+								 const void *cabFrameInfo, int nFrameInfoSize, int bKeyFrame);
+
+/**
+ * \brief Get statistics of the GOP gate of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel has no gate or pStats is NULL
+ */
+AVAPI_API int avGopGateGetStats(int nAVChannelID, AVGopGateStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVGopGateAPIs_H_ */
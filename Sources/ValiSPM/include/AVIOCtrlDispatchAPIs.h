@@ -0,0 +1,212 @@
+/*! \file AVIOCtrlDispatchAPIs.h
+This file describes the IO control dispatcher of the AV extension module.
+Instead of a thread per AV channel looping on avRecvIOCtrl() and switching
+on the IO control type, the application declares a handler table once,
+e.g.
+
+	static const AVIOCtrlHandler gHandlers[] = {
+		{ IOTYPE_USER_PLAY, OnPlay },
+		{ IOTYPE_USER_STOP, OnStop },
+	};
+
+and creates a dispatcher from it. When the types are close together, as
+IOTYPE_USER_DEFINED_START + N types are, the dispatcher looks handlers up
+in a dense array indexed by type. Otherwise it binary searches the table,
+which is used in place if it is sorted by type. C++ code can check that at
+compile time with avIOCtrlTableIsSorted().
+One poll thread per dispatcher receives for all the AV channels attached
+to it, and a pool of worker threads runs the handlers. The IO controls of
+one AV channel are handled one at a time in the order they arrived, while
+different AV channels are handled in parallel. RPC messages of an AV
+channel with an RPC layer (see AVIOCtrlRpcAPIs.h) go to the RPC layer on
+the same workers.
+ */
+
+#ifndef _AVIOCtrlDispatchAPIs_H_
+#define _AVIOCtrlDispatchAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The N-th user defined IO control type */
+#define AV_IOCTRL_USER(n)							(IOTYPE_USER_DEFINED_START + (n))
+
+/** The number of entries of a handler table declared as an array */
+#define AV_IOCTRL_TABLE_SIZE(table)					((int)(sizeof(table) / sizeof((table)[0])))
+
+/** The default number of worker threads */
+#define AV_IOCTRL_DISPATCH_DEFAULT_WORKERS			2
+
+/** The most worker threads of a dispatcher */
+#define AV_IOCTRL_DISPATCH_MAX_WORKERS				16
+
+/** The default number of IO controls an AV channel may have waiting for a worker */
+#define AV_IOCTRL_DISPATCH_DEFAULT_QUEUE			64
+
+/** The default longest time, in unit of millisecond, the poll thread sleeps while all AV channels are idle */
+#define AV_IOCTRL_DISPATCH_DEFAULT_IDLE				10
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of an IO control handler
+ *
+ * \param nAVChannelID [out] The AV channel which received the IO control
+ * \param nIOCtrlType [out] The type of the IO control
+ * \param cabData [out] The IO control data, valid until the handler returns
+ * \param nDataSize [out] The size of the IO control data
+ * \param pUserData [out] The data passed to avIOCtrlDispatchAttach()
+ *
+ * \attention The handler runs on a worker thread. It may call avSendIOCtrl(), and may
+ *			block, but only the other AV channels are handled meanwhile.
+ */
+typedef void(__stdcall *avIOCtrlHandlerFn)(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData,
+										   int nDataSize, void *pUserData);
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details An entry of a handler table
+ */
+typedef struct AVIOCtrlHandler
+{
+	unsigned int type; //!< The IO control type, each type at most once per table
+	avIOCtrlHandlerFn fn; //!< The handler
+} AVIOCtrlHandler;
+
+/**
+ * \details The configuration of a dispatcher
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVIOCtrlDispatchConfig)
+ * \param workers [in] The number of worker threads, 0 for #AV_IOCTRL_DISPATCH_DEFAULT_WORKERS
+ * \param maxQueue [in] The IO controls an AV channel may have waiting; more are dropped.
+ *			0 for #AV_IOCTRL_DISPATCH_DEFAULT_QUEUE
+ * \param maxIdleMs [in] The longest time the poll thread sleeps while all AV channels are idle,
+ *			which bounds the added latency; 0 for #AV_IOCTRL_DISPATCH_DEFAULT_IDLE
+ * \param pfxDefaultFn [in] The handler of types not in the table, NULL to drop them
+ */
+typedef struct AVIOCtrlDispatchConfig
+{
+	unsigned int cb;
+	unsigned int workers;
+	unsigned int maxQueue;
+	unsigned int maxIdleMs;
+	avIOCtrlHandlerFn pfxDefaultFn;
+} AVIOCtrlDispatchConfig;
+
+/**
+ * \details Dispatcher statistics, got by avIOCtrlDispatchGetStats().
+ */
+typedef struct AVIOCtrlDispatchStats
+{
+	unsigned int channels; //!< AV channels attached now
+	unsigned int received; //!< IO controls received
+	unsigned int handled; //!< Of them, handled by a table handler
+	unsigned int unhandled; //!< Of them, given to the default handler or dropped for lack of a handler
+	unsigned int rpc; //!< Of them, passed to the RPC layer
+	unsigned int dropped; //!< Of them, dropped since the queue of the AV channel was full
+	unsigned int queued; //!< IO controls waiting for a worker now
+	int denseTable; //!< 1 if handlers are looked up in a dense array, 0 if by binary search
+	int lastError; //!< The last error of avRecvIOCtrl(), 0 if none
+} AVIOCtrlDispatchStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create a dispatcher with its poll thread and worker threads
+ *
+ * \param pTable [in] The handler table. A table sorted by type is used in place and must
+ *			stay valid until the dispatcher is destroyed; use a static const array.
+ * \param nCount [in] The number of entries of pTable
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The dispatcher ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid, e.g. a type is in the table twice
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the threads
+ */
+AVAPI_API int avIOCtrlDispatcherCreate(const AVIOCtrlHandler *pTable, int nCount,
+									   const AVIOCtrlDispatchConfig *pConfig);
+
+/**
+ * \brief Detach all AV channels from a dispatcher and destroy it
+ *
+ * \param nDispatcherID [in] The dispatcher ID
+ *
+ * \attention Do not call it from a handler.
+ */
+AVAPI_API void avIOCtrlDispatcherDestroy(int nDispatcherID);
+
+/**
+ * \brief Have a dispatcher receive and handle the IO controls of an AV channel
+ *
+ * \param nDispatcherID [in] The dispatcher ID
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param pUserData [in] The data passed to the handlers for this AV channel
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid, the AV channel is attached
+ *			  already, or its RPC layer runs its own receiver thread
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *
+ * \attention Do not call avRecvIOCtrl() on the AV channel while it is attached.
+ */
+AVAPI_API int avIOCtrlDispatchAttach(int nDispatcherID, int nAVChannelID, void *pUserData);
+
+/**
+ * \brief Stop handling the IO controls of an AV channel
+ *
+ * \details Waits for a handler of the AV channel which is running; the IO controls still
+ *			waiting are dropped.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Do not call it from a handler of the same AV channel.
+ */
+AVAPI_API void avIOCtrlDispatchDetach(int nAVChannelID);
+
+/**
+ * \brief Get statistics of a dispatcher
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The dispatcher ID is not valid or pStats is NULL
+ */
+AVAPI_API int avIOCtrlDispatchGetStats(int nDispatcherID, AVIOCtrlDispatchStats *pStats);
+
+#ifdef __cplusplus
+}
+
+#if __cplusplus >= 201103L
+/**
+ * \brief Check at compile time that a handler table is sorted by type without duplicates, e.g.
+ *			static_assert(avIOCtrlTableIsSorted(kHandlers), "unsorted IO control table");
+ *			for a constexpr table, so avIOCtrlDispatcherCreate() uses it in place.
+ */
+template <unsigned int N>
+constexpr bool avIOCtrlTableIsSorted(const AVIOCtrlHandler (&table)[N], unsigned int i = 1)
+{
+	return i >= N || (table[i - 1].type < table[i].type && avIOCtrlTableIsSorted(table, i + 1));
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* _AVIOCtrlDispatchAPIs_H_ */
@@ -0,0 +1,279 @@
+/*! \file AVIOCtrlRpcAPIs.h
+This file describes the IO control RPC APIs of the AV extension module.
+avSendIOCtrl() blocks until the remote site acknowledges, allows one send
+at a time per AV channel and carries at most #AV_MAX_IOCTRL_DATA_SIZE
+bytes, so an application asking for 500 SD card events one IO control at
+a time waits 500 round trips. The RPC layer runs on top of it: each call
+gets a request ID, any number of calls may be outstanding, payloads of any
+size up to maxPayloadSize are split into chunks and put back together, and
+each call has its own timeout.
+One sender thread per AV channel owns avSendIOCtrl(). While a send waits
+for its acknowledgment, new requests and replies queue up; the next IO
+control carries as many of them as fit, and chunks of large payloads take
+turns with small ones. So many calls issued together cost a few round
+trips, not one each.
+One receiver thread per AV channel owns avRecvIOCtrl(). IO controls of
+other types are kept for avRpcRecvIOCtrl(), so existing handlers keep
+working next to the RPC layer. On an AV channel attached to an IOCtrl
+dispatcher (see AVIOCtrlDispatchAPIs.h) there is no receiver thread: the
+dispatcher passes RPC messages on and runs the request callback on its
+workers.
+
+An RPC IO control has the type ioCtrlType. Its data is a version byte, a
+record count byte and then the records. A record is a kind byte, a flags
+byte, a 16-bit chunk size, a 32-bit request ID, a 32-bit method or result,
+a 32-bit total payload size and then the chunk. All numbers are little-endian.
+ */
+
+#ifndef _AVIOCtrlRpcAPIs_H_
+#define _AVIOCtrlRpcAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default IO control type of RPC messages */
+#define AV_RPC_DEFAULT_IOTYPE						0x7F00
+
+/** The version of the RPC message format */
+#define AV_RPC_VERSION								1
+
+/** The bytes of an RPC IO control before its first record */
+#define AV_RPC_HEADER_SIZE							2
+
+/** The bytes in front of the chunk of each record */
+#define AV_RPC_RECORD_HEADER_SIZE					16
+
+/** The default timeout, in unit of millisecond, of a call */
+#define AV_RPC_DEFAULT_TIMEOUT						10000
+
+/** The default largest request or reply payload */
+#define AV_RPC_DEFAULT_MAX_PAYLOAD					(256 * 1024)
+
+/** The most IO controls of other types kept for avRpcRecvIOCtrl() */
+#define AV_RPC_PASSTHROUGH_QUEUE					32
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of the RPC layer of an AV channel. Both sites must use the same ioCtrlType.
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVRpcConfig)
+ * \param ioCtrlType [in] The IO control type of RPC messages, at least #IOTYPE_USER_DEFINED_START;
+ *			0 for #AV_RPC_DEFAULT_IOTYPE
+ * \param defaultTimeoutMs [in] The timeout of calls which give none, 0 for #AV_RPC_DEFAULT_TIMEOUT
+ * \param maxPayloadSize [in] The largest payload accepted from the remote site,
+ *			0 for #AV_RPC_DEFAULT_MAX_PAYLOAD
+ */
+typedef struct AVRpcConfig
+{
+	unsigned int cb;
+	unsigned int ioCtrlType;
+	unsigned int defaultTimeoutMs;
+	unsigned int maxPayloadSize;
+} AVRpcConfig;
+
+/**
+ * \details RPC statistics, got by avRpcGetStats().
+ */
+typedef struct AVRpcStats
+{
+	unsigned int calls; //!< Calls made on this site
+	unsigned int responses; //!< Replies received for them
+	unsigned int timeouts; //!< Calls which timed out
+	unsigned int outstanding; //!< Calls waiting for a reply now
+	unsigned int served; //!< Requests received from the remote site
+	unsigned int replies; //!< Replies sent to the remote site
+	unsigned int ioCtrlsSent; //!< RPC IO controls sent
+	unsigned int recordsSent; //!< Records in them
+	unsigned int ioCtrlsReceived; //!< RPC IO controls received
+	unsigned int queuedBytes; //!< Payload bytes waiting to be sent now
+	unsigned int passthrough; //!< IO controls of other types received
+	unsigned int passthroughDropped; //!< Of them, dropped since avRpcRecvIOCtrl() fell behind
+	int lastError; //!< The last error of avSendIOCtrl() or avRecvIOCtrl(), 0 if none
+} AVRpcStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback handling a request from the remote site
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param nRequestID [out] The request ID to pass to avRpcReply()
+ * \param nMethod [out] The method the remote site called
+ * \param cabData [out] The request payload, valid until the callback returns
+ * \param nDataSize [out] The size of the request payload
+ * \param pUserData [out] The data passed to avRpcAttach()
+ *
+ * \attention The callback runs on the receiver thread or a dispatcher worker; a slow
+ *			request should be handed to another thread, which replies later.
+ */
+typedef void(__stdcall *avRpcRequestFn)(int nAVChannelID, unsigned int nRequestID, unsigned int nMethod,
+										const char *cabData, int nDataSize, void *pUserData);
+
+/**
+ * \details The prototype of the callback completing a call made by avRpcCallAsync()
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param nRequestID [out] The request ID returned by avRpcCallAsync()
+ * \param nResult [out] The status the remote handler replied with if >= 0, or the error
+ *			- #AV_ER_TIMEOUT No reply within the timeout
+ *			- #AV_ER_REMOTE_NOT_SUPPORT The remote site has no request callback
+ *			- #AV_ER_EXCEED_MAX_SIZE The request or the reply is larger than the receiving site accepts
+ *			- #AV_ER_SENDIOCTRL_EXIT The RPC layer was detached
+ *			- The error of avSendIOCtrl() or avRecvIOCtrl() which closed the AV channel
+ * \param cabData [out] The reply payload, valid until the callback returns
+ * \param nDataSize [out] The size of the reply payload
+ * \param pUserData [out] The data passed to avRpcCallAsync()
+ *
+ * \attention The callback runs on the receiver thread, a dispatcher worker or the sender thread,
+ *			and must not call avRpcCall().
+ */
+typedef void(__stdcall *avRpcResponseFn)(int nAVChannelID, unsigned int nRequestID, int nResult,
+										 const char *cabData, int nDataSize, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Start the RPC layer of an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param pConfig [in] The configuration, NULL for the default one
+ * \param pfxRequestFn [in] The callback handling requests, NULL if this site only makes calls
+ * \param pUserData [in] The data passed to pfxRequestFn
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the RPC layer is already attached
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the threads
+ *
+ * \attention (1) From now on, receive IO controls of the AV channel with avRpcRecvIOCtrl(),
+ *				unless the AV channel is attached to an IOCtrl dispatcher.
+ *			  (2) To use a dispatcher, attach the AV channel to it before calling this
+ *				function. It may be detached from the dispatcher before or after
+ *				avRpcDetach(), which waits for the RPC messages the dispatcher is handing over.
+ */
+AVAPI_API int avRpcAttach(int nAVChannelID, const AVRpcConfig *pConfig, avRpcRequestFn pfxRequestFn,
+						  void *pUserData);
+
+/**
+ * \brief Stop the RPC layer of an AV channel
+ *
+ * \details Outstanding calls complete with #AV_ER_SENDIOCTRL_EXIT; queued replies are dropped.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Do not call it from a callback of the same AV channel.
+ */
+AVAPI_API void avRpcDetach(int nAVChannelID);
+
+/**
+ * \brief Make a call without waiting for the reply
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nMethod [in] The method, passed to the request callback of the remote site
+ * \param cabData [in] The request payload, copied; may be NULL if nDataSize is 0
+ * \param nDataSize [in] The size of the request payload
+ * \param nTimeoutMs [in] The time to wait for the reply, 0 for the default timeout
+ * \param pfxResponseFn [in] The callback completing the call, called exactly once
+ * \param pUserData [in] The data passed to pfxResponseFn
+ * \param pnRequestID [out] The request ID of the call, may be NULL
+ *
+ * \return #AV_ER_NoERROR if the call is queued
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The RPC layer is not attached or an argument is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- The error which closed the AV channel
+ */
+AVAPI_API int avRpcCallAsync(int nAVChannelID, unsigned int nMethod, const char *cabData, int nDataSize,
+							 unsigned int nTimeoutMs, avRpcResponseFn pfxResponseFn, void *pUserData,
+							 unsigned int *pnRequestID);
+
+/**
+ * \brief Make a call and wait for the reply
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nMethod [in] The method, passed to the request callback of the remote site
+ * \param cabData [in] The request payload, may be NULL if nDataSize is 0
+ * \param nDataSize [in] The size of the request payload
+ * \param abReply [out] The buffer of the reply payload, may be NULL if nReplyMaxSize is 0
+ * \param nReplyMaxSize [in] The size of abReply
+ * \param pnReplySize [out] The size of the reply payload, may be NULL
+ * \param nTimeoutMs [in] The time to wait for the reply, 0 for the default timeout
+ *
+ * \return The status the remote handler replied with if return value >= 0
+ * \return Error code if return value < 0
+ *			- The errors of avRpcCallAsync() and of #avRpcResponseFn
+ *			- #AV_ER_BUFPARA_MAXSIZE_INSUFF The reply does not fit in abReply
+ *
+ * \attention Do not call it on the receiver thread, i.e. from a callback.
+ */
+AVAPI_API int avRpcCall(int nAVChannelID, unsigned int nMethod, const char *cabData, int nDataSize,
+						char *abReply, int nReplyMaxSize, int *pnReplySize, unsigned int nTimeoutMs);
+
+/**
+ * \brief Reply to a request of the remote site
+ *
+ * \details May be called from the request callback or later from any thread.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nRequestID [in] The request ID given to the request callback
+ * \param nStatus [in] The status of the request, >= 0, returned to the caller
+ * \param cabData [in] The reply payload, copied; may be NULL if nDataSize is 0
+ * \param nDataSize [in] The size of the reply payload
+ *
+ * \return #AV_ER_NoERROR if the reply is queued
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The RPC layer is not attached or an argument is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- The error which closed the AV channel
+ */
+AVAPI_API int avRpcReply(int nAVChannelID, unsigned int nRequestID, int nStatus, const char *cabData,
+						 int nDataSize);
+
+/**
+ * \brief Receive an IO control which is not an RPC message
+ *
+ * \details Takes the same arguments and returns the same errors as avRecvIOCtrl().
+ *
+ * \return The size of the IO control data if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The RPC layer is not attached or an argument is not valid
+ *			- #AV_ER_DATA_NOREADY nTimeout is 0 and no IO control is kept
+ *			- #AV_ER_TIMEOUT No IO control within nTimeout
+ *			- #AV_ER_BUFPARA_MAXSIZE_INSUFF The IO control does not fit in abIOCtrlData; it is kept
+ *			- The error which closed the AV channel
+ */
+AVAPI_API int avRpcRecvIOCtrl(int nAVChannelID, unsigned int *pnIOCtrlType, char *abIOCtrlData,
+							  int nIOCtrlMaxDataSize, unsigned int nTimeout);
+
+/**
+ * \brief Get statistics of the RPC layer of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The RPC layer is not attached or pStats is NULL
+ */
+AVAPI_API int avRpcGetStats(int nAVChannelID, AVRpcStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVIOCtrlRpcAPIs_H_ */
@@ -0,0 +1,206 @@
+/*! \file AVJitterBufferAPIs.h
+This file describes the jitter buffer APIs of the AV extension module.
+A jitter buffer holds received frames until their playout time, which is
+the frame timestamp mapped to local time plus a target delay. The target
+delay follows the measured interarrival jitter of the stream and grows
+after an underrun, so a client neither stutters on a lossy link nor builds
+up seconds of lag. The renderer pulls frames when they are due instead of
+polling avRecvFrameData2() and avCheckAudioBuf().
+ */
+
+#ifndef _AVJitterBufferAPIs_H_
+#define _AVJitterBufferAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default lowest target delay, in unit of millisecond */
+#define AV_JITTER_DEFAULT_MIN_DELAY					40
+
+/** The default highest target delay, in unit of millisecond */
+#define AV_JITTER_DEFAULT_MAX_DELAY					1000
+
+/** The default max number of frames held by a jitter buffer */
+#define AV_JITTER_DEFAULT_MAX_FRAMES				300
+
+/** The interval, in unit of millisecond, the receive thread of avJitterBufferAttach() polls the AV channel */
+#define AV_JITTER_RECV_POLL_INTERVAL				5
+
+/** The wait time reported when the jitter buffer is empty */
+#define AV_JITTER_WAIT_INFINITE						0xFFFFFFFF
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of a jitter buffer, used by avJitterBufferCreate()
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVJitterBufferConfig)
+ * \param minDelayMs [in] The lowest target delay, 0 for #AV_JITTER_DEFAULT_MIN_DELAY
+ * \param maxDelayMs [in] The highest target delay, 0 for #AV_JITTER_DEFAULT_MAX_DELAY
+ * \param maxFrames [in] The max number of frames held, 0 for #AV_JITTER_DEFAULT_MAX_FRAMES.
+ *			When full, the oldest frame is dropped.
+ * \param dropLate [in] 1: drop frames which arrive after a later frame was played,
+ *			as audio should; 0: hand them out right away, as video needs for decoding
+ */
+typedef struct AVJitterBufferConfig
+{
+	unsigned int cb;
+	unsigned int minDelayMs;
+	unsigned int maxDelayMs;
+	unsigned int maxFrames;
+	int dropLate;
+} AVJitterBufferConfig;
+
+/**
+ * \details Jitter buffer statistics, got by avJitterBufferGetStats().
+ */
+typedef struct AVJitterBufferStats
+{
+	unsigned int jitterMs; //!< The interarrival jitter estimate of RFC 3550
+	unsigned int targetDelayMs; //!< The current target delay
+	unsigned int avgLatencyMs; //!< The average time frames wait in the buffer
+	unsigned int bufferedFrames; //!< Frames in the buffer
+	unsigned int bufferedMs; //!< The timestamp span of the frames in the buffer
+	unsigned int framesIn; //!< Frames put into the buffer
+	unsigned int framesOut; //!< Frames handed out
+	unsigned int lateCount; //!< Frames which arrived after their playout time
+	unsigned int dropCount; //!< Frames dropped as late or because the buffer was full
+	unsigned int underrunCount; //!< Times the buffer ran empty while a frame was due
+	unsigned int underrunMs; //!< Total time the buffer was empty while a frame was due
+} AVJitterBufferStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback that returns the timestamp of a received frame,
+ *			used by avJitterBufferAttach().
+ *
+ * \param pFrame [out] The received frame; the timestamp is usually in pFrame->info
+ * \param pUserData [out] The data passed to avJitterBufferAttach()
+ *
+ * \return The timestamp of the frame in millisecond
+ */
+typedef unsigned int(__stdcall *avFrameTimestampFn)(const AVFrame *pFrame, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create a jitter buffer
+ *
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The jitter buffer ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG pConfig->cb is wrong or minDelayMs is larger than maxDelayMs
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avJitterBufferCreate(const AVJitterBufferConfig *pConfig);
+
+/**
+ * \brief Destroy a jitter buffer
+ *
+ * \details Stops the receive thread if attached and releases the frames in the buffer.
+ *
+ * \param nJitterBufferID [in] The jitter buffer ID
+ */
+AVAPI_API void avJitterBufferDestroy(int nJitterBufferID);
+
+/**
+ * \brief Put a received frame into a jitter buffer
+ *
+ * \details Takes over the caller's reference to pFrame.
+ *
+ * \param nJitterBufferID [in] The jitter buffer ID
+ * \param pFrame [in] The frame
+ * \param nTimestampMs [in] The timestamp of the frame in millisecond, may wrap around
+ *
+ * \return #AV_ER_NoERROR if the frame is put into the buffer
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The jitter buffer ID is not valid or pFrame is NULL
+ *			- #AV_ER_LOSED_THIS_FRAME The frame is late and the buffer drops late frames
+ */
+AVAPI_API int avJitterBufferPut(int nJitterBufferID, AVFrame *pFrame, unsigned int nTimestampMs);
+
+/**
+ * \brief Feed a jitter buffer from an AV channel
+ *
+ * \details Starts a thread which receives frames from the AV channel, by
+ *			avRecvFrameDataPooled() for video or avRecvAudioData() for audio, and
+ *			puts them into the jitter buffer with the timestamp from pfxTimestampFn.
+ *
+ * \param nJitterBufferID [in] The jitter buffer ID
+ * \param nAVChannelID [in] The AV channel to receive from
+ * \param bAudio [in] 1 to receive audio, 0 to receive video
+ * \param pfxTimestampFn [in] Returns the timestamp of a received frame
+ * \param pUserData [in] The data passed to pfxTimestampFn
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the buffer is already attached
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the receive thread
+ *
+ * \attention (1) This API can only be used by av client
+ */
+AVAPI_API int avJitterBufferAttach(int nJitterBufferID, int nAVChannelID, int bAudio,
+								   avFrameTimestampFn pfxTimestampFn, void *pUserData);
+
+/**
+ * \brief Get the next frame if it is due
+ *
+ * \param nJitterBufferID [in] The jitter buffer ID
+ * \param ppFrame [out] The frame to render now, which the caller must release by avFrameRelease()
+ * \param pnWaitMs [out] If no frame is due, the time until the next one is, or
+ *			#AV_JITTER_WAIT_INFINITE if the buffer is empty. May be NULL.
+ *
+ * \return #AV_ER_NoERROR if a frame is returned
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The jitter buffer ID is not valid or ppFrame is NULL
+ *			- #AV_ER_DATA_NOREADY No frame is due yet
+ */
+AVAPI_API int avJitterBufferGetFrame(int nJitterBufferID, AVFrame **ppFrame, unsigned int *pnWaitMs);
+
+/**
+ * \brief Wait for the next frame to become due
+ *
+ * \param nJitterBufferID [in] The jitter buffer ID
+ * \param ppFrame [out] The frame to render now, which the caller must release by avFrameRelease()
+ * \param nTimeout [in] The timeout in millisecond
+ *
+ * \return #AV_ER_NoERROR if a frame is returned
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The jitter buffer ID is not valid or ppFrame is NULL
+ *			- #AV_ER_TIMEOUT No frame became due within nTimeout
+ */
+AVAPI_API int avJitterBufferWaitFrame(int nJitterBufferID, AVFrame **ppFrame, unsigned int nTimeout);
+
+/**
+ * \brief Get statistics of a jitter buffer
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The jitter buffer ID is not valid or pStats is NULL
+ */
+AVAPI_API int avJitterBufferGetStats(int nJitterBufferID, AVJitterBufferStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVJitterBufferAPIs_H_ */
@@ -0,0 +1,204 @@
+/*! \file AVNalScanAPIs.h
+This file describes the NAL scanner APIs of the AV extension module.
+The scanner finds the Annex-B start codes of an H.264 or H.265 frame and
+reads the type of each NAL unit. It compares 16 or 32 bytes at a time
+with SSE2, AVX2 or NEON, whichever the running CPU has, and only looks
+at single bytes where a start code is. Coded slice data rarely holds two
+zero bytes in a row, so a frame costs about a memory read.
+avSendFrameDataNal() sends a frame after working out its type, so the
+encoder glue does not need to know about keyframes. It goes through the
+GOP gate of AVGopGateAPIs.h when one is attached.
+ */
+
+#ifndef _AVNalScanAPIs_H_
+#define _AVNalScanAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The largest frame info avSendFrameDataNal() can write the frame type into */
+#define AV_NAL_MAX_FRAME_INFO						256
+
+/** The nFlagOffset of avSendFrameDataNal() that leaves the frame info as it is */
+#define AV_NAL_FLAG_OFFSET_NONE						-1
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The video codecs of the scanner
+ */
+typedef enum
+{
+	AV_NAL_CODEC_H264 = 0,
+	AV_NAL_CODEC_H265
+} AVNalCodec;
+
+/**
+ * \details The frame types found by avNalClassify()
+ */
+typedef enum
+{
+	AV_NAL_FRAME_UNKNOWN = 0,	///< No coded slice was found
+	AV_NAL_FRAME_KEY,			///< An IDR picture, or an IRAP picture of H.265
+	AV_NAL_FRAME_DELTA,			///< A picture other frames refer to
+	AV_NAL_FRAME_DISPOSABLE		///< A picture no other frame refers to, safe to drop alone
+} AVNalFrameType;
+
+/**
+ * \details The scanning engines. AV_NAL_ENGINE_AUTO selects the fastest
+ *			engine supported by the running CPU.
+ */
+typedef enum
+{
+	AV_NAL_ENGINE_AUTO = 0,
+	AV_NAL_ENGINE_PORTABLE,		///< Byte by byte in C, always available
+	AV_NAL_ENGINE_SSE2,			///< x86 SSE2, 16 bytes at a time
+	AV_NAL_ENGINE_AVX2,			///< x86 AVX2, 32 bytes at a time
+	AV_NAL_ENGINE_NEON			///< ARM NEON, 16 bytes at a time
+} AVNalEngine;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A NAL unit found by avNalScan()
+ */
+typedef struct AVNalUnit
+{
+	unsigned int offset; //!< The offset of the NAL unit header, right after the start code
+	unsigned int size; //!< The size of the NAL unit up to the next start code, trailing zero bytes excluded
+	unsigned char type; //!< The nal_unit_type
+} AVNalUnit;
+
+/**
+ * \details What avNalClassify() found in a frame
+ */
+typedef struct AVNalFrameInfo
+{
+	AVNalFrameType frameType; //!< The type of the frame
+	unsigned char sliceType; //!< The nal_unit_type of the first coded slice
+	unsigned int sliceOffset; //!< The offset of the first coded slice
+	int hasParamSets; //!< 1 if a sequence or picture parameter set comes before the first slice
+} AVNalFrameInfo;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Find the NAL units of an Annex-B frame
+ *
+ * \param codec [in] The codec of the frame
+ * \param cabData [in] The frame
+ * \param nSize [in] The size of the frame
+ * \param pUnits [out] The NAL units found, in order
+ * \param nMaxUnits [in] The number of entries of pUnits
+ *
+ * \return The number of NAL units in the frame if return value >= 0; only
+ *			the first nMaxUnits are filled in
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avNalScan(AVNalCodec codec, const unsigned char *cabData, int nSize, AVNalUnit *pUnits, int nMaxUnits);
+
+/**
+ * \brief Work out the type of an Annex-B frame
+ *
+ * \details Stops at the first coded slice, so the slice data is not scanned.
+ *
+ * \param codec [in] The codec of the frame
+ * \param cabData [in] The frame
+ * \param nSize [in] The size of the frame
+ * \param pInfo [out] What was found, may be NULL
+ *
+ * \return The frame type if return value >= 0
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avNalClassify(AVNalCodec codec, const unsigned char *cabData, int nSize, AVNalFrameInfo *pInfo);
+
+/**
+ * \brief Send an Annex-B frame, working out whether it is a keyframe
+ *
+ * \details Classifies the frame, optionally writes the result into a copy of the frame
+ *			info and sends it with avSendFrameDataGop() if a GOP gate is attached to the
+ *			AV channel, or with avSendFrameDataPaced() if not.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param codec [in] The codec of the frame
+ * \param cabFrameData [in] The frame
+ * \param nFrameDataSize [in] The size of the frame
+ * \param cabFrameInfo [in] The frame info
+ * \param nFrameInfoSize [in] The size of the frame info
+ * \param nFlagOffset [in] The offset of a byte in the frame info set to 1 for a keyframe and
+ *			0 otherwise, e.g. 2 for the flags of FRAMEINFO_t in the samples;
+ *			#AV_NAL_FLAG_OFFSET_NONE to send the frame info as it is
+ * \param pFrameType [out] The frame type, may be NULL
+ *
+ * \return The same as avSendFrameData(), or #AV_ER_WAIT_KEY_FRAME if the GOP gate dropped the frame
+ * \return #AV_ER_INVALID_ARG nFlagOffset is not inside the frame info, or the frame info
+ *			is larger than #AV_NAL_MAX_FRAME_INFO
+ */
+AVAPI_API int avSendFrameDataNal(int nAVChannelID, AVNalCodec codec, const char *cabFrameData, int nFrameDataSize,
+								 const void *cabFrameInfo, int nFrameInfoSize, int nFlagOffset,
+								 AVNalFrameType *pFrameType);
+
+/**
+ * \brief Get the scanning engine in use
+ *
+ * \return The engine picked by CPU feature detection, or the one set by avNalSetEngine()
+ */
+AVAPI_API AVNalEngine avNalGetEngine(void);
+
+/**
+ * \brief Check if a scanning engine is supported by the running CPU
+ *
+ * \return 1 if supported, 0 if not
+ */
+AVAPI_API int avNalEngineSupported(AVNalEngine engine);
+
+/**
+ * \brief Force the scanning engine, mainly for testing and benchmarking
+ *
+ * \param engine [in] The engine, or #AV_NAL_ENGINE_AUTO to go back to detection
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The engine is not supported by the running CPU
+ */
+AVAPI_API int avNalSetEngine(AVNalEngine engine);
+
+/**
+ * \brief Measure the scanning throughput of an engine on the running device
+ *
+ * \details Scans a synthetic frame of nFrameSize bytes made of a few NAL units
+ *			with random slice data, as avNalScan() would.
+ *
+ * \param engine [in] The engine to measure
+ * \param nFrameSize [in] The size of the frame scanned
+ * \param nDurationMs [in] How long to scan
+ * \param pfGBps [out] Data scanned per second in GB
+ *
+ * \return #AV_ER_NoERROR if measuring successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the engine is not supported
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avNalBenchmark(AVNalEngine engine, unsigned int nFrameSize, unsigned int nDurationMs, float *pfGBps);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVNalScanAPIs_H_ */
@@ -0,0 +1,223 @@
+/*! \file AVPlaybackAPIs.h
+This file describes the playback APIs of the AV extension module.
+A playback index covers the segments written by the recorder of
+AVRecorderAPIs.h in one directory. Opening it reads only the header of
+each segment. A seek then takes two binary searches: first the segment
+whose time range holds the target, then the keyframe at or before the
+target in that segment's index. The segment index is read with one pread
+and cached, so a seek costs at most a few small reads even on a full SD
+card. This is meant for devices answering VSaaS pull-stream requests, see
+avServNotifyVSaasPullStream().
+A player streams the recording from a seek point to an AV channel through
+avSendFrameDataPaced(). It runs at real time or faster when the client
+catches up, and blocks on the resend buffer instead of dropping frames.
+ */
+
+#ifndef _AVPlaybackAPIs_H_
+#define _AVPlaybackAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVRecorderAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The speed of real time, in percent */
+#define AV_PLAYBACK_SPEED_REALTIME					100
+
+/** The speed at which frames are sent as fast as the AV channel takes them */
+#define AV_PLAYBACK_SPEED_UNLIMITED					0
+
+/** The time, in unit of millisecond, a player waits for a segment being recorded to grow before it ends */
+#define AV_PLAYBACK_TAIL_TIMEOUT					2000
+
+/** The time, in unit of millisecond, a player waits before sending again when the resend buffer is full */
+#define AV_PLAYBACK_RETRY_INTERVAL					10
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A position in a recording, found by avPlaybackIndexSeek()
+ */
+typedef struct AVPlaybackPosition
+{
+	unsigned int segmentNo; //!< The number of the segment
+	unsigned int offset; //!< The offset of the keyframe record in the segment file
+	unsigned long long timeMs; //!< The timestamp of the keyframe
+} AVPlaybackPosition;
+
+/**
+ * \details Player statistics, got by avPlaybackGetStats().
+ */
+typedef struct AVPlaybackStats
+{
+	unsigned int framesSent; //!< Frames sent
+	unsigned long long bytesSent; //!< Frame data bytes sent
+	unsigned int segmentsRead; //!< Segments opened
+	unsigned int retries; //!< Times the resend buffer was full and a frame was sent again
+	unsigned long long currentTimeMs; //!< The timestamp of the last frame sent
+	unsigned int speed; //!< The current speed in percent
+} AVPlaybackStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback called when a player stops by itself
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param nResult [out] #AV_ER_NoERROR at the end of the recording, or the error that stopped it
+ * \param pUserData [out] The data passed to avPlaybackStart()
+ *
+ * \attention The callback runs on the player thread; call avPlaybackStop() after it, not in it.
+ */
+typedef void(__stdcall *avPlaybackEndFn)(int nAVChannelID, int nResult, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Open the playback index of a recording
+ *
+ * \param pszDirectory [in] The directory of the segments
+ * \param pszPrefix [in] The prefix of the segment file names given to the recorder
+ *
+ * \return The index ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is NULL
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_RECORDER_IO_FAIL The directory cannot be read
+ */
+AVAPI_API int avPlaybackIndexOpen(const char *pszDirectory, const char *pszPrefix);
+
+/**
+ * \brief Pick up the segments written since the index was opened or last refreshed
+ *
+ * \param nIndexID [in] The index ID
+ *
+ * \return #AV_ER_NoERROR if refreshing successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The index ID is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_RECORDER_IO_FAIL The directory cannot be read
+ */
+AVAPI_API int avPlaybackIndexRefresh(int nIndexID);
+
+/**
+ * \brief Close a playback index
+ *
+ * \param nIndexID [in] The index ID
+ *
+ * \attention Stop the players using it first.
+ */
+AVAPI_API void avPlaybackIndexClose(int nIndexID);
+
+/**
+ * \brief Get the time range of a recording
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The index ID is not valid or an argument is NULL
+ *			- #AV_ER_DATA_NOREADY The recording has no frames
+ */
+AVAPI_API int avPlaybackIndexGetRange(int nIndexID, unsigned long long *pStartTimeMs, unsigned long long *pEndTimeMs);
+
+/**
+ * \brief Find the keyframe to start playing a given time from
+ *
+ * \details Finds the last keyframe at or before nTimeMs, or the first keyframe if there is none.
+ *
+ * \param nIndexID [in] The index ID
+ * \param nTimeMs [in] The time to play from
+ * \param pPos [out] The keyframe
+ *
+ * \return #AV_ER_NoERROR if seeking successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The index ID is not valid or pPos is NULL
+ *			- #AV_ER_DATA_NOREADY The recording ends before nTimeMs or has no keyframe
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_RECORDER_IO_FAIL A segment cannot be read
+ */
+AVAPI_API int avPlaybackIndexSeek(int nIndexID, unsigned long long nTimeMs, AVPlaybackPosition *pPos);
+
+/**
+ * \brief Get the time to play from out of a pull stream request
+ *
+ * \param pAttr [in] The pull stream request; starttime is in second or millisecond since the epoch
+ * \param pTimeMs [out] The time in millisecond
+ *
+ * \return #AV_ER_NoERROR if parsing successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG starttime is not a number
+ *			- #AV_ER_NOT_SUPPORT starttime is "live", which is not played from a recording
+ */
+AVAPI_API int avPlaybackParseStartTime(const VSaaSPullStreamAttr *pAttr, unsigned long long *pTimeMs);
+
+/**
+ * \brief Play a recording to an AV channel
+ *
+ * \details Seeks to nTimeMs and starts a thread sending the frames from there. When it
+ *			reaches the end, it refreshes the index and follows segments still being
+ *			recorded until nothing new comes for #AV_PLAYBACK_TAIL_TIMEOUT.
+ *
+ * \param nAVChannelID [in] The AV channel
+ * \param nIndexID [in] The index ID
+ * \param nTimeMs [in] The time to play from
+ * \param nSpeedPercent [in] The speed, #AV_PLAYBACK_SPEED_REALTIME for real time,
+ *			#AV_PLAYBACK_SPEED_UNLIMITED for as fast as possible
+ * \param pfxEndFn [in] The callback when the player stops by itself, may be NULL
+ * \param pUserData [in] The data passed to pfxEndFn
+ *
+ * \return #AV_ER_NoERROR if starting successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel is already playing
+ *			- #AV_ER_DATA_NOREADY See avPlaybackIndexSeek()
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avPlaybackStart(int nAVChannelID, int nIndexID, unsigned long long nTimeMs, unsigned int nSpeedPercent,
+							  avPlaybackEndFn pfxEndFn, void *pUserData);
+
+/**
+ * \brief Change the speed of a player, e.g. to catch up and then go back to real time
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not playing
+ */
+AVAPI_API int avPlaybackSetSpeed(int nAVChannelID, unsigned int nSpeedPercent);
+
+/**
+ * \brief Stop the player of an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ */
+AVAPI_API void avPlaybackStop(int nAVChannelID);
+
+/**
+ * \brief Get statistics of the player of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not playing or pStats is NULL
+ */
+AVAPI_API int avPlaybackGetStats(int nAVChannelID, AVPlaybackStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVPlaybackAPIs_H_ */
@@ -0,0 +1,206 @@
+/*! \file AVPreRollAPIs.h
+This file describes the pre-roll buffer APIs of the AV extension module.
+A pre-roll buffer keeps the last few seconds of encoded video, so an event
+clip can start before the event. The buffer is one fixed block of memory
+sized from the VSaaSContractInfo: recording_max_kbps and video_max_fps
+for the seconds of pre-roll plus one GOP. It never holds a partial GOP, so
+a clip always starts on a keyframe.
+avPreRollCapture() returns a clip that points into the buffer without
+copying. The frames of a clip are pinned until the clip is released: new
+frames that would overwrite them are dropped, up to the next keyframe.
+A contract change from OnVSaaSUpdateContractInfoCb only changes how many
+seconds are kept. The memory is never reallocated, so the clips already
+handed out stay valid.
+ */
+
+#ifndef _AVPreRollAPIs_H_
+#define _AVPreRollAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default seconds of video kept before an event */
+#define AV_PREROLL_DEFAULT_SEC						5
+
+/** The default longest GOP, in unit of millisecond, the buffer must hold on top of the pre-roll */
+#define AV_PREROLL_DEFAULT_MAX_GOP					2000
+
+/** The bitrate, in kbit per second, assumed when the contract gives none */
+#define AV_PREROLL_DEFAULT_KBPS						2000
+
+/** The frame rate assumed when the contract gives none */
+#define AV_PREROLL_DEFAULT_FPS						30
+
+/** The percentage of the bytes and frames computed from the contract that is allocated, for bitrate peaks */
+#define AV_PREROLL_HEADROOM							150
+
+/** The most clips of a buffer which may be held at the same time */
+#define AV_PREROLL_MAX_CLIPS						4
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of a pre-roll buffer
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVPreRollConfig)
+ * \param preRollSec [in] The seconds kept before an event, at most event_recording_max_sec
+ *			of the contract, 0 for #AV_PREROLL_DEFAULT_SEC
+ * \param maxGopMs [in] The longest GOP of the encoder, 0 for #AV_PREROLL_DEFAULT_MAX_GOP
+ * \param reserveBytes [in] Allocate at least this many bytes, to leave room for a later,
+ *			richer contract; 0 to size from the first contract only
+ */
+typedef struct AVPreRollConfig
+{
+	unsigned int cb;
+	unsigned int preRollSec;
+	unsigned int maxGopMs;
+	unsigned int reserveBytes;
+} AVPreRollConfig;
+
+/**
+ * \details A frame of a clip; data and info point into the pre-roll buffer
+ */
+typedef struct AVPreRollFrame
+{
+	const char *data; //!< The frame data
+	int size; //!< The size of the frame data
+	const void *info; //!< The frame info, NULL if none
+	int infoSize; //!< The size of the frame info
+	unsigned long long timestampMs; //!< The timestamp of the frame
+	int bKeyFrame; //!< 1 if the frame is a keyframe
+} AVPreRollFrame;
+
+/**
+ * \details A clip captured by avPreRollCapture(), valid until avPreRollClipRelease()
+ */
+typedef struct AVPreRollClip
+{
+	unsigned int frameCount; //!< The number of frames, the first one a keyframe
+	const AVPreRollFrame *frames; //!< The frames in order
+	unsigned long long startTimeMs; //!< The timestamp of the first frame
+	unsigned long long endTimeMs; //!< The timestamp of the last frame
+	unsigned int totalBytes; //!< The frame data bytes of all frames
+} AVPreRollClip;
+
+/**
+ * \details Pre-roll buffer statistics, got by avPreRollGetStats().
+ */
+typedef struct AVPreRollStats
+{
+	unsigned int capacityBytes; //!< The size of the buffer
+	unsigned int capacityFrames; //!< The most frames the buffer holds
+	unsigned int usedBytes; //!< Bytes held now
+	unsigned int frames; //!< Frames held now
+	unsigned int windowMs; //!< The time the held frames span
+	unsigned int targetMs; //!< The time the buffer should span under the current contract
+	unsigned int droppedFrames; //!< Frames dropped because a clip pinned the space or the frame was too big
+	unsigned int captures; //!< Clips captured
+} AVPreRollStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create a pre-roll buffer
+ *
+ * \param pContract [in] The contract, e.g. from avServGetVSaasContractInfo(); fields which are 0 get defaults
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The pre-roll buffer ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avPreRollCreate(const VSaaSContractInfo *pContract, const AVPreRollConfig *pConfig);
+
+/**
+ * \brief Destroy a pre-roll buffer
+ *
+ * \param nPreRollID [in] The pre-roll buffer ID
+ *
+ * \attention Release its clips first.
+ */
+AVAPI_API void avPreRollDestroy(int nPreRollID);
+
+/**
+ * \brief Apply a new contract, e.g. from OnVSaaSUpdateContractInfoCb
+ *
+ * \details Changes the seconds kept. The memory stays as it is; if the new contract needs
+ *			more than that, the buffer keeps what fits.
+ *
+ * \return #AV_ER_NoERROR if updating successfully
+ * \return #AV_ER_INVALID_ARG An argument is not valid
+ */
+AVAPI_API int avPreRollUpdateContract(int nPreRollID, const VSaaSContractInfo *pContract);
+
+/**
+ * \brief Put an encoded video frame into a pre-roll buffer
+ *
+ * \param nPreRollID [in] The pre-roll buffer ID
+ * \param cabFrameData [in] The frame data
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The frame info, may be NULL
+ * \param nFrameInfoSize [in] The size of the frame info
+ * \param nTimestampMs [in] The timestamp of the frame
+ * \param bKeyFrame [in] 1 if the frame is a keyframe
+ *
+ * \return #AV_ER_NoERROR if the frame is kept
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_WAIT_KEY_FRAME The frame is dropped until the next keyframe
+ *			- #AV_ER_EXCEED_MAX_SIZE The frame does not fit in the buffer, or clips pin the space it needs
+ */
+AVAPI_API int avPreRollWrite(int nPreRollID, const char *cabFrameData, int nFrameDataSize, const void *cabFrameInfo,
+							 int nFrameInfoSize, unsigned long long nTimestampMs, int bKeyFrame);
+
+/**
+ * \brief Capture the pre-roll when an event fires
+ *
+ * \details The clip starts at the last keyframe at least the contract's pre-roll
+ *			before the newest frame, or at the oldest frame, which is always a keyframe.
+ *
+ * \param nPreRollID [in] The pre-roll buffer ID
+ * \param ppClip [out] The clip
+ *
+ * \return #AV_ER_NoERROR if capturing successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_DATA_NOREADY The buffer has no frames yet
+ *			- #AV_ER_EXCEED_MAX_CHANNEL #AV_PREROLL_MAX_CLIPS clips are held already
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avPreRollCapture(int nPreRollID, AVPreRollClip **ppClip);
+
+/**
+ * \brief Release a clip, unpinning its frames
+ *
+ * \param pClip [in] The clip
+ */
+AVAPI_API void avPreRollClipRelease(AVPreRollClip *pClip);
+
+/**
+ * \brief Get statistics of a pre-roll buffer
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The pre-roll buffer ID is not valid or pStats is NULL
+ */
+AVAPI_API int avPreRollGetStats(int nPreRollID, AVPreRollStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVPreRollAPIs_H_ */
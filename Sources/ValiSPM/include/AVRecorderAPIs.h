@@ -0,0 +1,218 @@
+/*! \file AVRecorderAPIs.h
+This file describes the recorder APIs of the AV extension module.
+A recorder appends the frames of one received stream, e.g. from
+avRecvFrameData2(), to segment files. Segments are preallocated and memory
+mapped, so a write is a memcpy into the mapping and never a system call.
+One writer thread shared by all recorders does the rest off the receive
+threads:
+- it flushes the written pages of every recorder,
+- it drops the flushed pages from the page cache, so each stream only
+  holds about maxDirtyBytes of memory,
+- it preallocates the next segment before the current one fills up,
+- it finalizes full segments.
+That lets one host record hundreds of streams.
+
+A segment file starts with an AVRecSegmentHeader and then holds the
+records: each one is an AVRecFrameHeader, the frame info and the frame
+data, padded to #AV_REC_ALIGN. While a segment is open its index grows
+down from the end of the file. When the segment is finalized the index is
+moved right after the last record in time order, the header gets
+#AV_REC_SEGMENT_COMPLETE and the file is truncated. All fields are in host
+byte order.
+ */
+
+#ifndef _AVRecorderAPIs_H_
+#define _AVRecorderAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** A file operation of the recorder failed, errno tells why */
+#define AV_ER_RECORDER_IO_FAIL						-20900
+
+/** The default size of a segment file in byte */
+#define AV_REC_DEFAULT_SEGMENT_SIZE					(64 * 1024 * 1024)
+
+/** The smallest size of a segment file in byte */
+#define AV_REC_MIN_SEGMENT_SIZE						(1024 * 1024)
+
+/** The default written but not yet flushed bytes after which AVRecorderWrite() waits for the writer */
+#define AV_REC_DEFAULT_MAX_DIRTY					(4 * 1024 * 1024)
+
+/** The interval, in unit of millisecond, of the writer thread */
+#define AV_REC_FLUSH_INTERVAL						100
+
+/** The magic number of a segment file, "AVRS" */
+#define AV_REC_SEGMENT_MAGIC						0x53525641
+
+/** The version of the segment file format */
+#define AV_REC_SEGMENT_VERSION						1
+
+/** AVRecSegmentHeader::flags: the segment was finalized and its index is after the records */
+#define AV_REC_SEGMENT_COMPLETE						0x01
+
+/** AVRecFrameHeader::flags and AVRecIndexEntry::flags: the frame is a keyframe */
+#define AV_REC_FRAME_KEY							0x01
+
+/** The alignment of records in a segment */
+#define AV_REC_ALIGN								8
+
+/** The format of segment file names, with the directory, the prefix and the segment number */
+#define AV_REC_SEGMENT_NAME_FORMAT					"%s/%s_%08u.avs"
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The header at the start of a segment file, 64 bytes
+ */
+typedef struct AVRecSegmentHeader
+{
+	unsigned int magic; //!< #AV_REC_SEGMENT_MAGIC
+	unsigned int version; //!< #AV_REC_SEGMENT_VERSION
+	unsigned int flags; //!< #AV_REC_SEGMENT_COMPLETE
+	unsigned int segmentNo; //!< The number of the segment in the recording, from 0
+	unsigned long long startTimeMs; //!< The timestamp of the first frame
+	unsigned long long endTimeMs; //!< The timestamp of the last flushed frame
+	unsigned long long dataEnd; //!< The offset after the last flushed record
+	unsigned long long indexOffset; //!< The offset of the index if complete, the file size if not
+	unsigned int indexCount; //!< The number of index entries, one per flushed frame
+	unsigned int reserved[3];
+} AVRecSegmentHeader;
+
+/**
+ * \details The header of a record, followed by infoSize bytes of frame info and size bytes of frame data
+ */
+typedef struct AVRecFrameHeader
+{
+	unsigned int size; //!< The size of the frame data
+	unsigned short infoSize; //!< The size of the frame info
+	unsigned short flags; //!< #AV_REC_FRAME_KEY
+	unsigned long long timestampMs; //!< The timestamp of the frame
+} AVRecFrameHeader;
+
+/**
+ * \details An index entry, 12 bytes. While the segment is open entry i is at
+ *			file size - (i + 1) * sizeof(AVRecIndexEntry).
+ */
+typedef struct AVRecIndexEntry
+{
+	unsigned int timeOffsetMs; //!< The timestamp of the frame minus startTimeMs of the segment
+	unsigned int offset; //!< The offset of the AVRecFrameHeader of the frame
+	unsigned int flags; //!< #AV_REC_FRAME_KEY
+} AVRecIndexEntry;
+
+/**
+ * \details The configuration of a recorder
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVRecorderConfig)
+ * \param pszDirectory [in] The existing directory the segments are written to
+ * \param pszPrefix [in] The prefix of the segment file names, see #AV_REC_SEGMENT_NAME_FORMAT
+ * \param segmentSize [in] The size of a segment file, 0 for #AV_REC_DEFAULT_SEGMENT_SIZE
+ * \param segmentDurationMs [in] If not 0, a new segment is started at the first keyframe
+ *			this long after the start of the current one
+ * \param maxDirtyBytes [in] The written but not yet flushed bytes after which
+ *			avRecorderWrite() waits for the writer thread, 0 for #AV_REC_DEFAULT_MAX_DIRTY
+ */
+typedef struct AVRecorderConfig
+{
+	unsigned int cb;
+	const char *pszDirectory;
+	const char *pszPrefix;
+	unsigned int segmentSize;
+	unsigned int segmentDurationMs;
+	unsigned int maxDirtyBytes;
+} AVRecorderConfig;
+
+/**
+ * \details Recorder statistics, got by avRecorderGetStats().
+ */
+typedef struct AVRecorderStats
+{
+	unsigned int frames; //!< Frames written
+	unsigned long long bytes; //!< Bytes written, headers included
+	unsigned int segments; //!< Segments started
+	unsigned int currentSegment; //!< The number of the segment being written
+	unsigned int flushes; //!< Times the writer thread flushed the recorder
+	unsigned int writerWaits; //!< Times avRecorderWrite() waited for the writer thread
+	unsigned int syncSegmentCreates; //!< Times a segment was not preallocated in time and was created by avRecorderWrite()
+	int lastError; //!< The last error of the writer thread, 0 if none
+} AVRecorderStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create a recorder
+ *
+ * \details Creates and maps the first segment, so an unwritable directory is reported here.
+ *
+ * \param pConfig [in] The configuration
+ *
+ * \return The recorder ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG pConfig is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the writer thread
+ *			- #AV_ER_RECORDER_IO_FAIL Fails to create the first segment
+ */
+AVAPI_API int avRecorderCreate(const AVRecorderConfig *pConfig);
+
+/**
+ * \brief Append a frame to a recorder
+ *
+ * \param nRecorderID [in] The recorder ID
+ * \param cabFrameData [in] The frame data
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The frame info, may be NULL
+ * \param nFrameInfoSize [in] The size of the frame info, at most 65535
+ * \param nTimestampMs [in] The timestamp of the frame, not going backwards; 0 for the wall clock
+ * \param bKeyFrame [in] 1 if the frame is a keyframe
+ *
+ * \return #AV_ER_NoERROR if appending successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_EXCEED_MAX_SIZE The frame does not fit in an empty segment
+ *			- #AV_ER_RECORDER_IO_FAIL Fails to create the next segment
+ *
+ * \attention (1) Only one thread at a time may write a recorder.<br>
+ *			(2) It waits for the writer thread if maxDirtyBytes are not flushed yet.
+ */
+AVAPI_API int avRecorderWrite(int nRecorderID, const char *cabFrameData, int nFrameDataSize,
+							  const void *cabFrameInfo, int nFrameInfoSize, unsigned long long nTimestampMs,
+							  int bKeyFrame);
+
+/**
+ * \brief Close a recorder
+ *
+ * \details Waits until the writer thread has flushed and finalized the last segment.
+ *
+ * \param nRecorderID [in] The recorder ID
+ */
+AVAPI_API void avRecorderClose(int nRecorderID);
+
+/**
+ * \brief Get statistics of a recorder
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The recorder ID is not valid or pStats is NULL
+ */
+AVAPI_API int avRecorderGetStats(int nRecorderID, AVRecorderStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVRecorderAPIs_H_ */
@@ -0,0 +1,233 @@
+/*! \file AVRecvEngineAPIs.h
+This file describes the receive engine of the AV extension module.
+A client showing a wall of 16 or 36 cameras would otherwise run a thread
+per AV channel looping on avRecvFrameData2(), most of them asleep most of
+the time. A receive engine instead receives the frames of many AV channels,
+called streams here, on a few worker threads and puts them into a decoder
+queue per stream, from which the decoder takes them with
+avRecvEngineGetFrame().
+Each worker has a run queue of streams with frames waiting. A turn receives
+at most burst frames of one stream, which then goes to the end of the run
+queue, so between two turns of a stream every other stream waiting on that
+worker gets one. A worker with an empty run queue steals the stream which
+has waited longest from another worker. Idle streams sleep in a timer heap,
+polled again after 1 ms and twice as long each time up to maxIdleMs; the
+streams due at about the same time are woken together. So the workers stay
+few, and the cost of an idle stream is a handful of polls per second.
+Frames are received with avRecvFrameDataPooled(), so they come from the
+frame pool and count towards the buffer budget of the stream, if any.
+ */
+
+#ifndef _AVRecvEngineAPIs_H_
+#define _AVRecvEngineAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default number of worker threads */
+#define AV_RECV_ENGINE_DEFAULT_WORKERS				2
+
+/** The most worker threads of an engine */
+#define AV_RECV_ENGINE_MAX_WORKERS					16
+
+/** The default most frames received from one stream per turn */
+#define AV_RECV_ENGINE_DEFAULT_BURST				4
+
+/** The default longest time, in unit of millisecond, between two polls of an idle stream */
+#define AV_RECV_ENGINE_DEFAULT_IDLE					10
+
+/** The default number of frames a decoder queue holds */
+#define AV_RECV_STREAM_DEFAULT_QUEUE				30
+
+/** The flagOffset of AVRecvStreamConfig for streams whose keyframes are not known */
+#define AV_RECV_FLAG_OFFSET_NONE					-1
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The configuration of an engine
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVRecvEngineConfig)
+ * \param workers [in] The number of worker threads, 0 for #AV_RECV_ENGINE_DEFAULT_WORKERS
+ * \param burst [in] The most frames received from one stream per turn, 0 for #AV_RECV_ENGINE_DEFAULT_BURST
+ * \param maxIdleMs [in] The longest time between two polls of an idle stream, which bounds
+ *			the added latency; 0 for #AV_RECV_ENGINE_DEFAULT_IDLE
+ */
+typedef struct AVRecvEngineConfig
+{
+	unsigned int cb;
+	unsigned int workers;
+	unsigned int burst;
+	unsigned int maxIdleMs;
+} AVRecvEngineConfig;
+
+/**
+ * \details The configuration of a stream
+ *
+ * \param cb [in] The check byte of this structure, sizeof(AVRecvStreamConfig)
+ * \param maxQueue [in] The frames the decoder queue holds, 0 for #AV_RECV_STREAM_DEFAULT_QUEUE
+ * \param flagOffset [in] The offset of a byte in the frame info which is 1 for a keyframe,
+ *			e.g. 2 for the flags of FRAMEINFO_t in the samples, or #AV_RECV_FLAG_OFFSET_NONE.
+ *			When it is known, a full decoder queue is emptied and frames are dropped up to
+ *			the next keyframe, as after a lost frame; otherwise the oldest frame is dropped.
+ */
+typedef struct AVRecvStreamConfig
+{
+	unsigned int cb;
+	unsigned int maxQueue;
+	int flagOffset;
+} AVRecvStreamConfig;
+
+/**
+ * \details Engine statistics, got by avRecvEngineGetStats().
+ */
+typedef struct AVRecvEngineStats
+{
+	unsigned int streams; //!< Streams added now
+	unsigned int workers; //!< Worker threads
+	unsigned long long turns; //!< Turns run
+	unsigned long long emptyTurns; //!< Of them, turns which found no frame
+	unsigned long long frames; //!< Frames received
+	unsigned long long steals; //!< Turns a worker stole from another one
+	unsigned long long wakeups; //!< Times a worker woke up to poll idle streams
+} AVRecvEngineStats;
+
+/**
+ * \details Stream statistics, got by avRecvStreamGetStats().
+ */
+typedef struct AVRecvStreamStats
+{
+	unsigned int received; //!< Frames received
+	unsigned int delivered; //!< Frames taken by avRecvEngineGetFrame()
+	unsigned int dropped; //!< Frames dropped for a full queue, incomplete, or up to a keyframe
+	unsigned int queued; //!< Frames in the decoder queue now
+	unsigned int pollIntervalMs; //!< The current poll interval, 0 while frames are waiting
+	int lastError; //!< The last error of avRecvFrameDataPooled() other than #AV_ER_DATA_NOREADY, 0 if none
+} AVRecvStreamStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the callback telling that the decoder queue of a stream is no longer empty
+ *
+ * \param nAVChannelID [out] The AV channel of the stream
+ * \param pUserData [out] The data passed to avRecvEngineAdd()
+ *
+ * \attention The callback runs on a worker thread and should return ASAP, e.g. wake the
+ *			decoder thread, which then takes frames with a zero timeout until the queue
+ *			is empty. It is not called again before that.
+ */
+typedef void(__stdcall *avRecvReadyFn)(int nAVChannelID, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create an engine with its worker threads
+ *
+ * \param pConfig [in] The configuration, NULL for the default one
+ *
+ * \return The engine ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the threads
+ */
+AVAPI_API int avRecvEngineCreate(const AVRecvEngineConfig *pConfig);
+
+/**
+ * \brief Remove all streams of an engine and destroy it
+ *
+ * \param nEngineID [in] The engine ID
+ *
+ * \attention Do not call it from a ready callback, nor together with avRecvEngineRemove().
+ */
+AVAPI_API void avRecvEngineDestroy(int nEngineID);
+
+/**
+ * \brief Have an engine receive the frames of an AV channel
+ *
+ * \param nEngineID [in] The engine ID
+ * \param nAVChannelID [in] The channel ID of the AV channel, started by the AV client
+ * \param pConfig [in] The configuration of the stream, NULL for the default one
+ * \param pfxReadyFn [in] Called when the decoder queue is no longer empty, may be NULL
+ * \param pUserData [in] The data passed to pfxReadyFn
+ *
+ * \return #AV_ER_NoERROR if adding successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel is added already
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *
+ * \attention Do not receive frames of the AV channel otherwise while it is added, e.g. by
+ *			avRecvFrameData2() or in standby (see AVStandbyAPIs.h).
+ */
+AVAPI_API int avRecvEngineAdd(int nEngineID, int nAVChannelID, const AVRecvStreamConfig *pConfig,
+							  avRecvReadyFn pfxReadyFn, void *pUserData);
+
+/**
+ * \brief Stop receiving the frames of an AV channel, e.g. before avClientStop()
+ *
+ * \details Waits for a turn of the stream which is running and wakes avRecvEngineGetFrame()
+ *			calls waiting on it. The frames still queued are released.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Do not call it from the ready callback of the same stream.
+ */
+AVAPI_API void avRecvEngineRemove(int nAVChannelID);
+
+/**
+ * \brief Take the next frame from the decoder queue of a stream
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param ppFrame [out] The frame, which the caller owns and must release by avFrameRelease().
+ *			Set if the return value is >= 0, NULL otherwise.
+ * \param nTimeoutMs [in] The longest time to wait for a frame, 0 not to wait
+ *
+ * \return The size of the frame data if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_DATA_NOREADY No frame came within nTimeoutMs
+ *			- #AV_ER_INVALID_ARG The AV channel is not added, was removed meanwhile, or ppFrame is NULL
+ *			- The error of avRecvFrameDataPooled() after which the AV channel cannot receive
+ *			  any more, once the queued frames are taken
+ */
+AVAPI_API int avRecvEngineGetFrame(int nAVChannelID, AVFrame **ppFrame, unsigned int nTimeoutMs);
+
+/**
+ * \brief Get statistics of an engine
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The engine ID is not valid or pStats is NULL
+ */
+AVAPI_API int avRecvEngineGetStats(int nEngineID, AVRecvEngineStats *pStats);
+
+/**
+ * \brief Get statistics of a stream
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not added or pStats is NULL
+ */
+AVAPI_API int avRecvStreamGetStats(int nAVChannelID, AVRecvStreamStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVRecvEngineAPIs_H_ */
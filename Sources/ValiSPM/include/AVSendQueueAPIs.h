@@ -0,0 +1,119 @@
+/*! \file AVSendQueueAPIs.h
+This file describes the asynchronous send queue APIs of the AV extension module.
+An encoder hands each frame over as an AVFrame, for example an encoder
+output buffer wrapped by avFrameWrap(), and goes on encoding. A send thread
+per AV channel sends the queued frames and releases each one as soon as the
+AV module has taken it, so the encoder gets its buffer back without the
+frame having been copied into an intermediate queue.
+ */
+
+#ifndef _AVSendQueueAPIs_H_
+#define _AVSendQueueAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default max number of frames waiting in a send queue */
+#define AV_SEND_QUEUE_DEFAULT_MAX_FRAMES			30
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details Send queue statistics, got by avSendQueueGetStats().
+ */
+typedef struct AVSendQueueStats
+{
+	unsigned int queuedFrames; //!< Frames waiting to be sent
+	unsigned long long queuedBytes; //!< Frame data bytes waiting to be sent
+	unsigned int maxQueuedFrames; //!< The most frames ever waiting at the same time
+	unsigned int sentCount; //!< Frames the AV module has taken
+	unsigned int failCount; //!< Frames the AV module returned an error for
+	unsigned int rejectCount; //!< Frames refused by avSendFrameDataAsync() because the queue was full
+	int lastError; //!< The last error of the AV module, #AV_ER_NoERROR if none
+} AVSendQueueStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Start the send queue of an AV channel
+ *
+ * \details Starts the send thread of the AV channel. Frames are sent by
+ *			avSendFrameDataPaced(), so the pacer is used if the AV channel is attached
+ *			to one by avServPacerAttach().
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nMaxFrames [in] The max number of frames waiting, 0 for #AV_SEND_QUEUE_DEFAULT_MAX_FRAMES
+ *
+ * \return #AV_ER_NoERROR if starting successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID is not valid or its send queue is already started
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the send thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avSendQueueStart(int nAVChannelID, unsigned int nMaxFrames);
+
+/**
+ * \brief Stop the send queue of an AV channel
+ *
+ * \details Waits for the frame being sent and releases the frames still waiting
+ *			without sending them.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Call it before avServStop(), after the last avSendFrameDataAsync() returns.
+ */
+AVAPI_API void avSendQueueStop(int nAVChannelID);
+
+/**
+ * \brief Queue a frame to be sent
+ *
+ * \details Takes over the caller's reference to pFrame in any case: it is released
+ *			after the AV module has taken the frame, or right away if it is refused.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param pFrame [in] The frame, whose data and frame information are sent as by avSendFrameData()
+ *
+ * \return #AV_ER_NoERROR if the frame is queued
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG pFrame is NULL or the send queue is not started
+ *			- #AV_ER_EXCEED_MAX_SIZE The send queue is full
+ *			- The error of the AV module if the AV channel is closed, e.g.
+ *			  #AV_ER_SESSION_CLOSE_BY_REMOTE or #AV_ER_REMOTE_TIMEOUT_DISCONNECT
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avSendFrameDataAsync(int nAVChannelID, AVFrame *pFrame);
+
+/**
+ * \brief Get statistics of the send queue of an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param pStats [out] The statistics
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG pStats is NULL or the send queue is not started
+ */
+AVAPI_API int avSendQueueGetStats(int nAVChannelID, AVSendQueueStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVSendQueueAPIs_H_ */
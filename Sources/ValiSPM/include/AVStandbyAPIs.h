@@ -0,0 +1,256 @@
+/*! \file AVStandbyAPIs.h
+This file describes the standby APIs of the AV extension module.
+Switching a client from one camera to another by avClientCleanBuf() and
+waiting for the next keyframe takes up to a whole GOP. Instead the client
+keeps AV channels to the cameras it is likely to switch to started and in
+standby. In standby an AV server sends keyframes only, at most one per key
+interval, and the client keeps the last one. Promoting an AV channel hands
+the client that keyframe to decode at once, and asks the AV server to send
+full video again starting with a new keyframe. So a switch takes one IO
+control round trip rather than a GOP.
+The AV server side is a mode callback, which may also lower the frame rate
+or bitrate of the encoder while in standby, and avSendFrameDataStandby() in
+place of the usual send. The mode changes are IO controls of type
+#AV_STANDBY_IOTYPE, to be passed to avServStandbyIOCtrlHandler().
+ */
+
+#ifndef _AVStandbyAPIs_H_
+#define _AVStandbyAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The IO control type of the mode changes */
+#define AV_STANDBY_IOTYPE							0x7F10
+
+/** The version of the mode change message */
+#define AV_STANDBY_VERSION							1
+
+/** The size of the mode change message */
+#define AV_STANDBY_MESSAGE_SIZE						8
+
+/** The default shortest time, in unit of millisecond, between two keyframes in standby */
+#define AV_STANDBY_DEFAULT_KEY_INTERVAL				1000
+
+/** The longest time, in unit of millisecond, a mode change waits for another avSendIOCtrl() on the AV channel */
+#define AV_STANDBY_SEND_TIMEOUT						1000
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The mode of an AV channel
+ */
+typedef enum AVStandbyMode
+{
+	AV_STANDBY_MODE_FULL = 0, //!< Every frame is sent
+	AV_STANDBY_MODE_STANDBY = 1, //!< Only keyframes are sent, at most one per key interval
+} AVStandbyMode;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details AV server standby statistics, got by avServStandbyGetStats().
+ */
+typedef struct AVStandbyServStats
+{
+	AVStandbyMode mode; //!< The current mode
+	unsigned int keyIntervalMs; //!< The key interval the client asked for
+	unsigned int sentFrames; //!< Frames passed to the AV module
+	unsigned int droppedFrames; //!< Frames dropped for standby or while waiting for a keyframe
+	unsigned int standbyCount; //!< Times the client put the AV channel in standby
+	unsigned int promoteCount; //!< Times the client promoted the AV channel
+} AVStandbyServStats;
+
+/**
+ * \details AV client standby statistics, got by avClientStandbyGetStats().
+ */
+typedef struct AVStandbyClientStats
+{
+	unsigned int keyFrames; //!< Keyframes received in standby
+	unsigned int otherFrames; //!< Other frames received in standby and released
+	int hasKeyFrame; //!< 1 if a keyframe is kept
+	unsigned int keyFrameAgeMs; //!< Time since the kept keyframe was received
+	int lastError; //!< The last error of avRecvFrameDataPooled() other than #AV_ER_DATA_NOREADY, 0 if none
+} AVStandbyClientStats;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the mode callback of an AV server
+ *
+ * \param nAVChannelID [out] The AV channel
+ * \param mode [out] The new mode
+ * \param nKeyIntervalMs [out] The shortest time between two keyframes in standby
+ * \param pUserData [out] The data passed to avServStandbyAttach()
+ *
+ * \attention For #AV_STANDBY_MODE_FULL the encoder must produce a keyframe as soon as
+ *			possible, since frames are dropped until then. For #AV_STANDBY_MODE_STANDBY it
+ *			may lower its frame rate, but should keep its GOP no longer than nKeyIntervalMs.
+ *			The callback runs on the thread calling avServStandbyIOCtrlHandler().
+ */
+typedef void(__stdcall *avStandbyModeFn)(int nAVChannelID, AVStandbyMode mode, unsigned int nKeyIntervalMs,
+										 void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Let the client put an AV channel of the AV server in standby
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param pfxModeFn [in] The mode callback
+ * \param pUserData [in] The data passed to pfxModeFn
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel is attached already
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avServStandbyAttach(int nAVChannelID, avStandbyModeFn pfxModeFn, void *pUserData);
+
+/**
+ * \brief Stop handling standby on an AV channel
+ *
+ * \details Call it after the last avSendFrameDataStandby() and avServStandbyIOCtrlHandler()
+ *			on this AV channel return, e.g. after avIOCtrlDispatchDetach(), before avServStop().
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avServStandbyDetach(int nAVChannelID);
+
+/**
+ * \brief Handle a mode change IO control
+ *
+ * \details Call it for IO controls of type #AV_STANDBY_IOTYPE received by avRecvIOCtrl(),
+ *			or put { #AV_STANDBY_IOTYPE, avServStandbyIOCtrlHandler } in the handler table of
+ *			an IO control dispatcher (see AVIOCtrlDispatchAPIs.h). Other types, malformed
+ *			messages and AV channels which are not attached are ignored.
+ *
+ * \param nAVChannelID [in] The AV channel which received the IO control
+ * \param nIOCtrlType [in] The type of the IO control
+ * \param cabData [in] The IO control data
+ * \param nDataSize [in] The size of the IO control data
+ * \param pUserData [in] Not used
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API void __stdcall avServStandbyIOCtrlHandler(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData,
+													int nDataSize, void *pUserData);
+
+/**
+ * \brief Send a video frame in the current mode
+ *
+ * \details In standby only keyframes at least the key interval apart are sent. After a
+ *			promotion frames are dropped until the next keyframe. A frame which is not
+ *			dropped is sent with avSendFrameDataGop() if a GOP gate is attached to the AV
+ *			channel, or with avSendFrameDataPaced() if not.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param cabFrameData [in] The frame data to be sent
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The video frame information to be sent
+ * \param nFrameInfoSize [in] The size of the video frame information
+ * \param bKeyFrame [in] 1 if the frame is a keyframe, 0 otherwise
+ *
+ * \return The same as avSendFrameData() if the frame is sent
+ * \return #AV_ER_WAIT_KEY_FRAME The frame is dropped
+ * \return #AV_ER_INVALID_ARG The AV channel is not attached
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avSendFrameDataStandby(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+									 const void *cabFrameInfo, int nFrameInfoSize, int bKeyFrame);
+
+/**
+ * \brief Get standby statistics of an AV channel of the AV server
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not attached or pStats is NULL
+ */
+AVAPI_API int avServStandbyGetStats(int nAVChannelID, AVStandbyServStats *pStats);
+
+/**
+ * \brief Put an AV channel of the AV client in standby
+ *
+ * \details Starts a thread which receives the frames of the AV channel, keeps the last
+ *			keyframe and releases the rest, so the receive buffer stays empty. Then asks
+ *			the AV server to send keyframes only.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nKeyIntervalMs [in] The shortest time between two keyframes, 0 for #AV_STANDBY_DEFAULT_KEY_INTERVAL
+ * \param nFlagOffset [in] The offset of a byte in the frame info which is 1 for a keyframe,
+ *			e.g. 2 for the flags of FRAMEINFO_t in the samples
+ *
+ * \return #AV_ER_NoERROR if the AV channel is in standby
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel is in standby already
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ *			- The error codes of avSendIOCtrl()
+ *
+ * \attention Do not receive frames of the AV channel while it is in standby.
+ */
+AVAPI_API int avClientStandbyEnter(int nAVChannelID, unsigned int nKeyIntervalMs, int nFlagOffset);
+
+/**
+ * \brief Promote an AV channel of the AV client from standby to full video
+ *
+ * \details Stops the standby thread and asks the AV server to send full video, starting
+ *			with a new keyframe. The kept keyframe is handed to the caller to be decoded
+ *			first; then receive with avRecvFrameDataPooled() as usual. Do not call
+ *			avClientCleanBuf(), which would throw the new keyframe away.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param ppKeyFrame [out] The last keyframe received in standby, NULL if none. The caller
+ *			owns it and must release it by avFrameRelease(). May be NULL to release it here.
+ *
+ * \return #AV_ER_NoERROR if the AV channel is promoted
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel is not in standby
+ *			- The error codes of avSendIOCtrl(); the AV channel stays in standby unless
+ *			  the error means it is closed
+ */
+AVAPI_API int avClientStandbyPromote(int nAVChannelID, AVFrame **ppKeyFrame);
+
+/**
+ * \brief Stop the standby thread of an AV channel without telling the AV server, e.g. before avClientStop()
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ */
+AVAPI_API void avClientStandbyStop(int nAVChannelID);
+
+/**
+ * \brief Get standby statistics of an AV channel of the AV client
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not in standby or pStats is NULL
+ */
+AVAPI_API int avClientStandbyGetStats(int nAVChannelID, AVStandbyClientStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVStandbyAPIs_H_ */
@@ -0,0 +1,152 @@
+/*! \file AVStatsAPIs.h
+This file describes the statistics sampler APIs of the AV extension module.
+Polling avStatusCheck() once a second misses the short RTT spikes behind
+most video freezes. A sampler instead calls it on its own thread at up to
+#AV_STATS_MAX_RATE Hz. Each st_AvStatus sample goes into a lock-free ring
+buffer of the AV channel. A second ring gets one record per frame sent
+through avSendFrameDataPaced() or avSendAudioDataPaced(). A monitoring
+thread drains both rings in batches with avStatsReadStatus() and
+avStatsReadFrames() without ever blocking the sender or the sampler. When a
+ring is full, new records are dropped and counted.
+ */
+
+#ifndef _AVStatsAPIs_H_
+#define _AVStatsAPIs_H_
+
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default sampling rate in Hz */
+#define AV_STATS_DEFAULT_RATE						100
+
+/** The highest sampling rate in Hz */
+#define AV_STATS_MAX_RATE							1000
+
+/** The default number of records each ring can hold */
+#define AV_STATS_DEFAULT_CAPACITY					1024
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details A sample of the status of an AV channel
+ */
+typedef struct AVStatusSample
+{
+	unsigned long long timeUs; //!< The monotonic time of the sample in microsecond
+	struct st_AvStatus status; //!< What avStatusCheck() returned
+	float resendUsage; //!< What avResendBufUsageRate() returned, < 0 if resend is off
+} AVStatusSample;
+
+/**
+ * \details A frame sent through avSendFrameDataPaced() or avSendAudioDataPaced()
+ */
+typedef struct AVFrameSendSample
+{
+	unsigned long long timeUs; //!< The monotonic time the send started in microsecond
+	unsigned int durationUs; //!< The time until the AV module took the frame, pacing included
+	unsigned int seq; //!< The number of the record on this AV channel, counting dropped ones
+	int size; //!< The size of the frame data in byte
+	int result; //!< What the send returned
+	unsigned char isAudio; //!< 1 for audio, 0 for video
+} AVFrameSendSample;
+
+/**
+ * \details Sampler statistics, got by avStatsGetSamplerStats().
+ */
+typedef struct AVStatsSamplerStats
+{
+	unsigned int statusSamples; //!< Status samples put into the ring
+	unsigned int statusDropped; //!< Status samples dropped because the ring was full
+	unsigned int statusFailures; //!< Times avStatusCheck() failed
+	unsigned int frameSamples; //!< Frame records put into the ring
+	unsigned int frameDropped; //!< Frame records dropped because the ring was full
+} AVStatsSamplerStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Start sampling an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ * \param nRateHz [in] Status samples per second, 1 ~ #AV_STATS_MAX_RATE, 0 for #AV_STATS_DEFAULT_RATE
+ * \param nCapacity [in] Records each ring holds, rounded up to a power of 2,
+ *			0 for #AV_STATS_DEFAULT_CAPACITY
+ *
+ * \return #AV_ER_NoERROR if starting successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG An argument is not valid or the AV channel is already sampled
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avStatsSamplerStart(int nAVChannelID, unsigned int nRateHz, unsigned int nCapacity);
+
+/**
+ * \brief Stop sampling an AV channel and release its rings
+ *
+ * \details The rings are released once no other thread is sending, reading or getting
+ *			statistics on the AV channel; such calls started later fail or skip the record.
+ *
+ * \param nAVChannelID [in] The AV channel
+ */
+AVAPI_API void avStatsSamplerStop(int nAVChannelID);
+
+/**
+ * \brief Take the oldest status samples out of the ring of an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ * \param pSamples [out] The samples
+ * \param nMaxCount [in] The most samples to take
+ *
+ * \return The number of samples taken, 0 if the ring is empty
+ * \return #AV_ER_INVALID_ARG The AV channel is not sampled or an argument is not valid
+ *
+ * \attention Only one thread at a time may read an AV channel.
+ */
+AVAPI_API int avStatsReadStatus(int nAVChannelID, AVStatusSample *pSamples, int nMaxCount);
+
+/**
+ * \brief Take the oldest frame records out of the ring of an AV channel
+ *
+ * \param nAVChannelID [in] The AV channel
+ * \param pSamples [out] The records
+ * \param nMaxCount [in] The most records to take
+ *
+ * \return The number of records taken, 0 if the ring is empty
+ * \return #AV_ER_INVALID_ARG The AV channel is not sampled or an argument is not valid
+ *
+ * \attention (1) Only one thread at a time may read an AV channel.<br>
+ *			(2) Frames are recorded from the threads that send them, e.g. video and audio
+ *			from threads of their own. The records of frames sent at the same time from
+ *			different threads may come out of seq order.
+ */
+AVAPI_API int avStatsReadFrames(int nAVChannelID, AVFrameSendSample *pSamples, int nMaxCount);
+
+/**
+ * \brief Get statistics of the sampler of an AV channel
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The AV channel is not sampled or pStats is NULL
+ */
+AVAPI_API int avStatsGetSamplerStats(int nAVChannelID, AVStatsSamplerStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVStatsAPIs_H_ */
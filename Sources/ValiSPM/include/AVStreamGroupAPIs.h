@@ -0,0 +1,190 @@
+/*! \file AVStreamGroupAPIs.h
+This file describes the stream group APIs of the AV extension module.
+A stream group sends one encoded stream to many viewers. Each frame is put
+into the group once and kept, by reference, in a frame store shared by all
+viewers. Every viewer is an AV channel with its own read cursor into the
+store and its own send thread, so a slow viewer falls behind, and drops
+frames by its own policy, without holding up the others or making the
+encoder send the same frame once per viewer.
+ */
+
+#ifndef _AVStreamGroupAPIs_H_
+#define _AVStreamGroupAPIs_H_
+
+#include "AVAPIs.h"
+#include "AVFrameAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default number of frames the frame store of a stream group keeps */
+#define AV_STREAM_GROUP_DEFAULT_MAX_FRAMES			60
+
+/** The default number of frames a viewer may fall behind before its drop policy applies */
+#define AV_STREAM_GROUP_DEFAULT_MAX_LAG				15
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The drop policy of a viewer of a stream group
+ */
+typedef enum AVStreamDropPolicy
+{
+	/// When the viewer is more than its max lag behind, skip ahead to the latest keyframe
+	AV_STREAM_DROP_TO_KEYFRAME = 0,
+	/// Never skip frames on purpose. A viewer which falls out of the frame store
+	/// still resumes at the next keyframe.
+	AV_STREAM_DROP_NONE = 1
+} AVStreamDropPolicy;
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details Statistics of a stream group, got by avStreamGroupGetStats().
+ */
+typedef struct AVStreamGroupStats
+{
+	unsigned int viewerCount; //!< The number of viewers
+	unsigned int storedFrames; //!< Frames in the frame store
+	unsigned long long storedBytes; //!< Frame data bytes in the frame store
+	unsigned long long frameCount; //!< Frames put into the group
+} AVStreamGroupStats;
+
+/**
+ * \details Statistics of a viewer, got by avStreamGroupGetViewerStats().
+ */
+typedef struct AVStreamViewerStats
+{
+	unsigned int sentCount; //!< Frames the AV module has taken
+	unsigned int droppedCount; //!< Frames skipped by the drop policy or lost from the frame store
+	unsigned int failCount; //!< Frames the AV module returned an error for
+	unsigned int lag; //!< Frames in the frame store the viewer has not sent yet
+	int lastError; //!< The last error of the AV module, #AV_ER_NoERROR if none
+} AVStreamViewerStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Create a stream group
+ *
+ * \param nMaxFrames [in] The number of frames the frame store keeps,
+ *			0 for #AV_STREAM_GROUP_DEFAULT_MAX_FRAMES
+ *
+ * \return The stream group ID if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avStreamGroupCreate(unsigned int nMaxFrames);
+
+/**
+ * \brief Destroy a stream group
+ *
+ * \details Removes all viewers and releases the frames in the frame store.
+ *
+ * \param nGroupID [in] The stream group ID
+ *
+ * \attention Call it after the last call on this group returns.
+ */
+AVAPI_API void avStreamGroupDestroy(int nGroupID);
+
+/**
+ * \brief Add a viewer to a stream group
+ *
+ * \details The viewer starts at the latest keyframe in the frame store, or at the
+ *			next keyframe if there is none, so its decoder can start right away.
+ *
+ * \param nGroupID [in] The stream group ID
+ * \param nAVChannelID [in] The AV channel of the viewer. Frames are sent by
+ *			avSendFrameDataPaced(), so its pacer is used if it has one.
+ * \param ePolicy [in] The drop policy of the viewer
+ * \param nMaxLag [in] The frames the viewer may fall behind, 0 for #AV_STREAM_GROUP_DEFAULT_MAX_LAG
+ *
+ * \return #AV_ER_NoERROR if adding successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The group or AV channel ID is not valid, or the AV channel is already a viewer
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the send thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avStreamGroupAddViewer(int nGroupID, int nAVChannelID, AVStreamDropPolicy ePolicy, unsigned int nMaxLag);
+
+/**
+ * \brief Remove a viewer from a stream group
+ *
+ * \details Waits for the frame being sent to the viewer. Call it before avServStop().
+ *
+ * \param nGroupID [in] The stream group ID
+ * \param nAVChannelID [in] The AV channel of the viewer
+ */
+AVAPI_API void avStreamGroupRemoveViewer(int nGroupID, int nAVChannelID);
+
+/**
+ * \brief Put a video frame into a stream group
+ *
+ * \details Takes over the caller's reference to pFrame. The frame is sent to every
+ *			viewer and released when it leaves the frame store.
+ *
+ * \param nGroupID [in] The stream group ID
+ * \param pFrame [in] The frame
+ * \param bKeyFrame [in] 1 if the frame is a keyframe, 0 otherwise
+ *
+ * \return #AV_ER_NoERROR if the frame is put into the group
+ * \return #AV_ER_INVALID_ARG The group ID is not valid or pFrame is NULL
+ */
+AVAPI_API int avStreamGroupSendFrame(int nGroupID, AVFrame *pFrame, int bKeyFrame);
+
+/**
+ * \brief Send audio data to every viewer of a stream group
+ *
+ * \details Audio is not stored; it is sent right away to each viewer by
+ *			avSendAudioDataPaced().
+ *
+ * \param nGroupID [in] The stream group ID
+ * \param cabAudioData [in] The audio data to be sent
+ * \param nAudioDataSize [in] The size of the audio data
+ * \param cabFrameInfo [in] The audio frame information to be sent
+ * \param nFrameInfoSize [in] The size of the audio frame information
+ *
+ * \return The number of viewers the audio was sent to if return value >= 0
+ * \return #AV_ER_INVALID_ARG The group ID is not valid
+ */
+AVAPI_API int avStreamGroupSendAudio(int nGroupID, const char *cabAudioData, int nAudioDataSize,
+									 const void *cabFrameInfo, int nFrameInfoSize);
+
+/**
+ * \brief Get statistics of a stream group
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The group ID is not valid or pStats is NULL
+ */
+AVAPI_API int avStreamGroupGetStats(int nGroupID, AVStreamGroupStats *pStats);
+
+/**
+ * \brief Get statistics of a viewer of a stream group
+ *
+ * \return #AV_ER_NoERROR if getting successfully
+ * \return #AV_ER_INVALID_ARG The group ID is not valid, the AV channel is not a viewer or pStats is NULL
+ */
+AVAPI_API int avStreamGroupGetViewerStats(int nGroupID, int nAVChannelID, AVStreamViewerStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _AVStreamGroupAPIs_H_ */
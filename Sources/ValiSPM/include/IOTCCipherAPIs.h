@@ -0,0 +1,174 @@
+/*! \file IOTCCipherAPIs.h
+This file describes the AES cipher APIs of the IOTC extension module.
+The cipher picks a hardware engine at run time by CPU feature detection,
+AES-NI on x86 and the ARMv8 cryptography extension on ARM, and falls back
+to a portable table based implementation. A benchmark API measures the
+throughput of full and partial encryption on the running device.
+ */
+
+#ifndef _IOTCCipherAPIs_H_
+#define _IOTCCipherAPIs_H_
+
+#include "IOTCAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The length of AES-128 key, in unit of byte. */
+#define IOTC_CIPHER_KEY_LENGTH						16
+
+/** The length of the CTR mode initial counter block, in unit of byte. */
+#define IOTC_CIPHER_IV_LENGTH						16
+
+/** The default number of bytes encrypted at the head of each packet in partial mode. */
+#define IOTC_CIPHER_DEFAULT_PARTIAL_SIZE			64
+
+/* ============================================================================
+ * Enumeration Declaration
+ * ============================================================================
+ */
+
+/**
+ * \details The AES engines. IOTC_CIPHER_ENGINE_AUTO selects the fastest
+ *			engine supported by the running CPU.
+ */
+typedef enum
+{
+	IOTC_CIPHER_ENGINE_AUTO = 0,
+	IOTC_CIPHER_ENGINE_PORTABLE,	///< Table based implementation in C, always available
+	IOTC_CIPHER_ENGINE_AESNI,		///< x86 AES-NI instructions
+	IOTC_CIPHER_ENGINE_ARMV8		///< ARMv8 cryptography extension
+} IOTCCipherEngine;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/** The AES cipher context. Created by IOTC_Cipher_Create(). */
+typedef struct IOTCCipherCtx IOTCCipherCtx;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Get the AES engine used by new cipher contexts
+ *
+ * \return The engine picked by CPU feature detection, or the one set by IOTC_Cipher_Set_Engine()
+ */
+P2PAPI_API IOTCCipherEngine IOTC_Cipher_Get_Engine(void);
+
+/**
+ * \brief Check if an AES engine is supported by the running CPU
+ *
+ * \param engine [in] The engine to check
+ *
+ * \return 1 if supported, 0 if not
+ */
+P2PAPI_API int IOTC_Cipher_Engine_Supported(IOTCCipherEngine engine);
+
+/**
+ * \brief Set the AES engine used by new cipher contexts
+ *
+ * \param engine [in] The engine to use, #IOTC_CIPHER_ENGINE_AUTO restores CPU feature detection
+ *
+ * \return #IOTC_ER_NoERROR if setting successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_ARG The engine is unknown
+ *			- #IOTC_ER_NOT_SUPPORT The engine is not supported by the running CPU
+ */
+P2PAPI_API int IOTC_Cipher_Set_Engine(IOTCCipherEngine engine);
+
+/**
+ * \brief Create an AES-128 cipher context
+ *
+ * \param key [in] The key, #IOTC_CIPHER_KEY_LENGTH bytes
+ * \param ppCtx [out] The created context
+ *
+ * \return #IOTC_ER_NoERROR if creating successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_ARG key or ppCtx is NULL
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ */
+P2PAPI_API int IOTC_Cipher_Create(const unsigned char *key, IOTCCipherCtx **ppCtx);
+
+/**
+ * \brief Release an AES cipher context
+ *
+ * \param pCtx [in] The context to release, may be NULL
+ */
+P2PAPI_API void IOTC_Cipher_Delete(IOTCCipherCtx *pCtx);
+
+/**
+ * \brief Encrypt or decrypt a buffer in AES-128-CTR mode
+ *
+ * \details CTR mode is symmetric, the same call decrypts. in and out may be the same buffer.
+ *
+ * \param pCtx [in] The cipher context
+ * \param iv [in] The initial counter block, #IOTC_CIPHER_IV_LENGTH bytes. The counter
+ *			is incremented as a 128-bit big-endian number for each block.
+ * \param in [in] The input buffer
+ * \param out [out] The output buffer, at least nSize bytes
+ * \param nSize [in] The number of bytes to process
+ *
+ * \return #IOTC_ER_NoERROR if processing successfully
+ * \return #IOTC_ER_INVALID_ARG if an argument is NULL
+ */
+P2PAPI_API int IOTC_Cipher_CTR(const IOTCCipherCtx *pCtx, const unsigned char *iv,
+							   const unsigned char *in, unsigned char *out, unsigned int nSize);
+
+/**
+ * \brief Encrypt or decrypt the head of each packet of a buffer in AES-128-CTR mode
+ *
+ * \details The buffer is split into packets of nPacketSize bytes and only the first
+ *			nPartialSize bytes of each packet are processed, the same way
+ *			IOTC_Set_Partial_Encryption() trades confidentiality of the payload body
+ *			for CPU. Each packet uses iv with its packet index added to the counter.
+ *
+ * \param pCtx [in] The cipher context
+ * \param iv [in] The initial counter block, #IOTC_CIPHER_IV_LENGTH bytes
+ * \param buf [in,out] The buffer, processed in place
+ * \param nSize [in] The size of buf
+ * \param nPacketSize [in] The packet size, 0 means #IOTC_MAX_PACKET_SIZE
+ * \param nPartialSize [in] The bytes processed per packet, 0 means #IOTC_CIPHER_DEFAULT_PARTIAL_SIZE
+ *
+ * \return #IOTC_ER_NoERROR if processing successfully
+ * \return #IOTC_ER_INVALID_ARG if an argument is NULL
+ */
+P2PAPI_API int IOTC_Cipher_CTR_Partial(const IOTCCipherCtx *pCtx, const unsigned char *iv,
+									   unsigned char *buf, unsigned int nSize,
+									   unsigned int nPacketSize, unsigned int nPartialSize);
+
+/**
+ * \brief Measure cipher throughput on one core
+ *
+ * \details Encrypts #IOTC_MAX_PACKET_SIZE packets in a loop on the calling
+ *			thread for about nDurationMs and reports the payload throughput.
+ *
+ * \param engine [in] The engine to measure, #IOTC_CIPHER_ENGINE_AUTO for the detected one
+ * \param nPartialSize [in] 0 to measure full encryption, otherwise the bytes encrypted per packet
+ * \param nDurationMs [in] The measuring time in millisecond
+ * \param pfMBps [out] The payload throughput in MB (10^6 bytes) per second
+ *
+ * \return #IOTC_ER_NoERROR if measuring successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_ARG pfMBps is NULL or nDurationMs is 0
+ *			- #IOTC_ER_NOT_SUPPORT The engine is not supported by the running CPU
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ */
+P2PAPI_API int IOTC_Cipher_Benchmark(IOTCCipherEngine engine, unsigned int nPartialSize,
+									 unsigned int nDurationMs, float *pfMBps);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _IOTCCipherAPIs_H_ */
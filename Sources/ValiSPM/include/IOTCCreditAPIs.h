@@ -0,0 +1,186 @@
+/*! \file IOTCCreditAPIs.h
+This file describes the send credit APIs of the IOTC extension module.
+A credit is the number of bytes that can be written right now without
+hitting #IOTC_ER_QUEUE_FULL or #AV_ER_EXCEED_MAX_SIZE. Producers query the
+credit, and when it is too low they either drop, block in a wait function,
+or register an edge-triggered writable callback instead of retrying in a loop.
+ */
+
+#ifndef _IOTCCreditAPIs_H_
+#define _IOTCCreditAPIs_H_
+
+#include "IOTCAPIs.h"
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The interval, in unit of millisecond, credits are checked when they are
+ * limited by the AV resend buffer, which has no change notification. */
+#define IOTC_CREDIT_POLL_INTERVAL					5
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the writable callback of an IOTC channel.
+ *
+ * \param nIOTCSessionID [out] The session ID
+ * \param nIOTCChannelID [out] The IOTC channel ID
+ * \param nCredit [out] The bytes writable now
+ * \param pUserData [out] The data passed to IOTC_Session_Set_Writable_Callback()
+ *
+ * \attention The callback runs on the credit thread and should return ASAP.
+ */
+typedef void(__stdcall *IOTCWritableFn)(int nIOTCSessionID, unsigned char nIOTCChannelID, int nCredit, void *pUserData);
+
+/**
+ * \details The prototype of the writable callback of an AV channel.
+ *
+ * \param nAVChannelID [out] The AV channel ID
+ * \param nCredit [out] The bytes writable now
+ * \param pUserData [out] The data passed to avServSetWritableCallback()
+ *
+ * \attention The callback runs on the credit thread and should return ASAP.
+ */
+typedef void(__stdcall *avWritableFn)(int nAVChannelID, int nCredit, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Get the bytes writable now on an IOTC channel
+ *
+ * \details The credit of an IOTC channel is the token count of the pacer of its
+ *			session, see IOTC_Session_Pacer_Setup().
+ *
+ * \param nIOTCSessionID [in] The session ID
+ * \param nIOTCChannelID [in] The IOTC channel ID
+ *
+ * \return The bytes writable now if return value >= 0
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_SID No pacer is attached to the session
+ */
+P2PAPI_API int IOTC_Session_Get_Credit(int nIOTCSessionID, unsigned char nIOTCChannelID);
+
+/**
+ * \brief Wait until an IOTC channel can take nBytes
+ *
+ * \details The pacer bucket never holds more than its burst, and a write larger than
+ *			that goes out without waiting once the bucket is full, so nBytes above the
+ *			burst waits for a full bucket only.
+ *
+ * \param nIOTCSessionID [in] The session ID
+ * \param nIOTCChannelID [in] The IOTC channel ID
+ * \param nBytes [in] The bytes to be written
+ * \param nTimeout [in] The timeout in millisecond, 0 means return immediately
+ *
+ * \return The bytes writable now, which is at least nBytes or the burst, if return value >= 0
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_SID No pacer is attached to the session
+ *			- #IOTC_ER_TIMEOUT The credit did not reach nBytes before nTimeout
+ */
+P2PAPI_API int IOTC_Session_Wait_Writable(int nIOTCSessionID, unsigned char nIOTCChannelID,
+										  unsigned int nBytes, unsigned int nTimeout);
+
+/**
+ * \brief Set the writable callback of an IOTC channel
+ *
+ * \details The callback is edge-triggered: it is armed when IOTC_Session_Get_Credit()
+ *			returns less than nLowWater, or at registration if the credit is below
+ *			nLowWater, and fires once when the credit reaches nLowWater, or the burst
+ *			of the pacer if that is less, again. The callback is dropped once the
+ *			session is closed or its pacer removed.
+ *
+ * \param nIOTCSessionID [in] The session ID
+ * \param nIOTCChannelID [in] The IOTC channel ID
+ * \param nLowWater [in] The credit, in byte, which makes the channel writable
+ * \param pfxWritableFn [in] The callback, NULL to remove the callback
+ * \param pUserData [in] The data passed to the callback
+ *
+ * \return #IOTC_ER_NoERROR if setting successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_SID No pacer is attached to the session
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ *			- #IOTC_ER_FAIL_CREATE_THREAD Fails to create the credit thread
+ */
+P2PAPI_API int IOTC_Session_Set_Writable_Callback(int nIOTCSessionID, unsigned char nIOTCChannelID, unsigned int nLowWater,
+												  IOTCWritableFn pfxWritableFn, void *pUserData);
+
+/**
+ * \brief Get the bytes writable now on an AV channel
+ *
+ * \details The credit of an AV channel is the free space of its resend buffer,
+ *			limited by the token count of its pacer if avServPacerAttach() was called.
+ *
+ * \param nAVChannelID [in] The AV channel ID
+ *
+ * \return The bytes writable now if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID is not valid
+ *			- #AV_ER_NOT_SUPPORT The AV channel has neither a resend buffer nor a pacer
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avServGetCredit(int nAVChannelID);
+
+/**
+ * \brief Wait until an AV channel can take nBytes
+ *
+ * \details nBytes above the size of the resend buffer or the burst of the pacer waits
+ *			for an empty resend buffer or a full bucket only, see IOTC_Session_Wait_Writable().
+ *
+ * \param nAVChannelID [in] The AV channel ID
+ * \param nBytes [in] The bytes to be sent, frame data plus frame info
+ * \param nTimeout [in] The timeout in millisecond, 0 means return immediately
+ *
+ * \return The bytes writable now, which is at least nBytes or the most it can be, if return value >= 0
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID is not valid
+ *			- #AV_ER_NOT_SUPPORT The AV channel has neither a resend buffer nor a pacer
+ *			- #AV_ER_TIMEOUT The credit did not reach nBytes before nTimeout
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avServWaitWritable(int nAVChannelID, unsigned int nBytes, unsigned int nTimeout);
+
+/**
+ * \brief Set the writable callback of an AV channel
+ *
+ * \details The callback is edge-triggered: it is armed when avServGetCredit()
+ *			returns less than nLowWater, or at registration if the credit is below
+ *			nLowWater, and fires once when the credit reaches nLowWater, or the most it
+ *			can be if that is less, again. The callback is dropped once the AV channel
+ *			is stopped.
+ *
+ * \param nAVChannelID [in] The AV channel ID
+ * \param nLowWater [in] The credit, in byte, which makes the channel writable
+ * \param pfxWritableFn [in] The callback, NULL to remove the callback
+ * \param pUserData [in] The data passed to the callback
+ *
+ * \return #AV_ER_NoERROR if setting successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID is not valid
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ *			- #AV_ER_FAIL_CREATE_THREAD Fails to create the credit thread
+ *
+ * \attention (1) This API can only be used by av server
+ */
+AVAPI_API int avServSetWritableCallback(int nAVChannelID, unsigned int nLowWater,
+										avWritableFn pfxWritableFn, void *pUserData);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _IOTCCreditAPIs_H_ */
@@ -0,0 +1,175 @@
+/*! \file IOTCHandoverAPIs.h
+This file describes the network handover APIs of the IOTC extension module.
+A client opens its device connections as handover connections. Each one is
+addressed by a handle that stays the same across network changes. When the
+phone moves between networks, IOTC_Handover_Network_Changed() reopens the
+IOTC socket and revalidates every session on the new path. Sessions that
+survived keep their SID and AV channel. The rest are reconnected in parallel
+with their saved connect and AV start settings. The session state kept by
+the extension module, such as pacers and the presence cache, moves to the
+new session.
+ */
+
+#ifndef _IOTCHandoverAPIs_H_
+#define _IOTCHandoverAPIs_H_
+
+#include "IOTCAPIs.h"
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The time, in unit of millisecond, a session has to show traffic on the new path
+ * before it is considered alive after IOTC_ReInitSocket(). */
+#define IOTC_HANDOVER_REVALIDATE_TIME				150
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details Information of a handover connection, got by IOTC_Handover_Get_Info().
+ */
+typedef struct IOTCHandoverInfo
+{
+	int sid; //!< The current IOTC session ID, < 0 while reconnecting
+	int avIndex; //!< The current AV channel ID, < 0 if no AV client or while reconnecting
+	unsigned int handoverCount; //!< Network changes this connection went through
+	unsigned int reconnectCount; //!< Network changes which needed a reconnection
+	unsigned int lastInterruptMs; //!< Media interruption of the last network change, in millisecond
+	unsigned int maxInterruptMs; //!< The longest media interruption, in millisecond
+	int lastResult; //!< The result of the last network change, #IOTC_ER_NoERROR or an error code
+} IOTCHandoverInfo;
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details The prototype of the handover callback, called for each connection
+ *			after a network change is handled.
+ *
+ * \param nHandle [out] The handover connection
+ * \param nOldSID [out] The session ID before the network change
+ * \param nNewSID [out] The session ID after the network change, equal to nOldSID if the
+ *			session survived, < 0 if reconnection failed. A reconnected session may get
+ *			nOldSID again; IOTCHandoverInfo.reconnectCount tells the two apart.
+ * \param nOldAVIndex [out] The AV channel ID before the network change
+ * \param nNewAVIndex [out] The AV channel ID after the network change
+ * \param nResult [out] #IOTC_ER_NoERROR, or the error code of the failed step
+ * \param nInterruptMs [out] The time from the network change until the connection was usable again
+ * \param pUserData [out] The data passed to IOTC_Handover_Set_Callback()
+ */
+typedef void(__stdcall *IOTCHandoverFn)(int nHandle, int nOldSID, int nNewSID, int nOldAVIndex, int nNewAVIndex,
+										int nResult, unsigned int nInterruptMs, void *pUserData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Connect to a device as a handover connection
+ *
+ * \details Connects by IOTC_Connect_ByUIDEx() and, if avConfig is not NULL, starts an
+ *			AV client by avClientStartEx() on the new session. The UID, connect input
+ *			and AV configuration are copied so the connection can be re-established
+ *			after a network change.
+ *
+ * \param cszUID [in] The UID of the device
+ * \param connectInput [in] The input of IOTC_Connect_ByUIDEx(), may be NULL
+ * \param avConfig [in] The input of avClientStartEx(), may be NULL. iotc_session_id is ignored.
+ * \param avOutConfig [out] The output of avClientStartEx(), may be NULL
+ *
+ * \return The handle of the connection if return value >= 0
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_ARG cszUID is NULL
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ *			- Error codes of IOTC_Get_SessionID(), IOTC_Connect_ByUIDEx() and avClientStartEx()
+ *
+ * \attention (1) This API is a blocking function.<br><br>
+ *            (2) This API can only be used in client side
+ */
+P2PAPI_API int IOTC_Handover_Connect(const char *cszUID, const IOTCConnectInput *connectInput,
+									 LPCAVCLIENT_START_IN_CONFIG avConfig, LPAVCLIENT_START_OUT_CONFIG avOutConfig);
+
+/**
+ * \brief Close a handover connection
+ *
+ * \details Stops its AV client and closes its IOTC session.
+ *
+ * \param nHandle [in] The handover connection
+ */
+P2PAPI_API void IOTC_Handover_Close(int nHandle);
+
+/**
+ * \brief Get the current session ID of a handover connection
+ *
+ * \return The IOTC session ID if return value >= 0
+ * \return #IOTC_ER_INVALID_ARG if the handle is not valid
+ * \return #IOTC_ER_TIMEOUT if the connection is being re-established
+ * \return The error of the last reconnection if it failed; the next
+ *			IOTC_Handover_Network_Changed() tries again
+ */
+P2PAPI_API int IOTC_Handover_Get_SID(int nHandle);
+
+/**
+ * \brief Get the current AV channel ID of a handover connection
+ *
+ * \return The AV channel ID if return value >= 0
+ * \return #AV_ER_INVALID_ARG if the handle is not valid or it has no AV client
+ * \return #AV_ER_TIMEOUT if the connection is being re-established
+ * \return The error of the last reconnection if it failed
+ */
+P2PAPI_API int IOTC_Handover_Get_AVIndex(int nHandle);
+
+/**
+ * \brief Get information of a handover connection
+ *
+ * \return #IOTC_ER_NoERROR if getting successfully
+ * \return #IOTC_ER_INVALID_ARG if the handle is not valid or pInfo is NULL
+ */
+P2PAPI_API int IOTC_Handover_Get_Info(int nHandle, IOTCHandoverInfo *pInfo);
+
+/**
+ * \brief Set the handover callback
+ *
+ * \param pfxHandoverFn [in] The callback, NULL to remove it
+ * \param pUserData [in] The data passed to the callback
+ */
+P2PAPI_API void IOTC_Handover_Set_Callback(IOTCHandoverFn pfxHandoverFn, void *pUserData);
+
+/**
+ * \brief Handle a network change
+ *
+ * \details Calls IOTC_ReInitSocket() and then revalidates every handover connection:
+ *			a session which receives traffic on the new path within
+ *			#IOTC_HANDOVER_REVALIDATE_TIME keeps its SID and AV channel, the others
+ *			are closed and reconnected in parallel. The handover callback is called
+ *			for every connection.
+ *
+ * \param nUDPPort [in] The UDP port passed to IOTC_ReInitSocket(), 0 for a random port
+ *
+ * \return The number of connections usable after the change if return value >= 0
+ * \return Error code of IOTC_ReInitSocket() if return value < 0
+ *
+ * \attention (1) This API is a blocking function.<br><br>
+ *            (2) Do not start other connections while it runs; see IOTC_ReInitSocket().<br><br>
+ *            (3) A session which receives nothing within #IOTC_HANDOVER_REVALIDATE_TIME,
+ *                e.g. one that is not streaming, is reconnected as well.
+ */
+P2PAPI_API int IOTC_Handover_Network_Changed(unsigned short nUDPPort);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _IOTCHandoverAPIs_H_ */
@@ -0,0 +1,197 @@
+/*! \file IOTCPacerAPIs.h
+This file describes the send pacing APIs of the IOTC extension module.
+A pacer is a token bucket attached to an IOTC session. Writes through the
+pacer wait for enough tokens instead of bursting into the socket queue, so
+an encoder keyframe is spread over time instead of overflowing the queue
+with #IOTC_ER_QUEUE_FULL or #AV_ER_SOCKET_QUEUE_FULL.
+ */
+
+#ifndef _IOTCPacerAPIs_H_
+#define _IOTCPacerAPIs_H_
+
+#include "IOTCAPIs.h"
+#include "AVAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The starting rate of an auto-estimated pacer, in unit of byte per second. */
+#define IOTC_PACER_AUTO_INITIAL_RATE				(256 * 1024)
+
+/** The lowest rate an auto-estimated pacer backs off to, in unit of byte per second. */
+#define IOTC_PACER_AUTO_MIN_RATE					(16 * 1024)
+
+/** The highest rate an auto-estimated pacer grows to, in unit of byte per second. */
+#define IOTC_PACER_AUTO_MAX_RATE					(12 * 1024 * 1024)
+
+/** The max time, in unit of millisecond, a paced write keeps retrying a full socket queue. */
+#define IOTC_PACER_MAX_RETRY_WAIT					500
+
+/* ============================================================================
+ * Structure Definition
+ * ============================================================================
+ */
+
+/**
+ * \details Pacer statistics, got by IOTC_Session_Pacer_Get_Stats().
+ */
+typedef struct IOTCPacerStats
+{
+	unsigned int rate; //!< The current rate in byte per second
+	unsigned int burst; //!< The current bucket size in byte
+	unsigned char isAutoRate; //!< 1: rate is auto-estimated, 0: rate is fixed
+	unsigned long long sentBytes; //!< Total bytes written through the pacer
+	unsigned int sendCount; //!< Total writes through the pacer
+	unsigned int pacedCount; //!< Writes which had to wait for tokens
+	unsigned long long totalWaitUs; //!< Total time writes waited, in microsecond
+	unsigned int maxWaitUs; //!< The longest wait of a single write, in microsecond
+	unsigned int queueFullCount; //!< Times the socket queue was still reported full
+} IOTCPacerStats;
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Attach a pacer to an IOTC session
+ *
+ * \details Attach a token bucket pacer to an IOTC session, or change the settings
+ *			of the one already attached. All channels and AV channels of the session
+ *			share the pacer.
+ *
+ * \param nIOTCSessionID [in] The session ID of the IOTC session
+ * \param nRate [in] The rate in byte per second, 0 to estimate it automatically:
+ *			the rate backs off when the socket queue is full and grows while
+ *			writes are limited by the pacer without congestion.
+ * \param nBurst [in] The bucket size in byte, i.e. how much can be sent back to back,
+ *			0 to use 20 milliseconds worth of the rate
+ *
+ * \return #IOTC_ER_NoERROR if setting successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_SID The session ID is negative
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ */
+P2PAPI_API int IOTC_Session_Pacer_Setup(int nIOTCSessionID, unsigned int nRate, unsigned int nBurst);
+
+/**
+ * \brief Detach the pacer from an IOTC session
+ *
+ * \param nIOTCSessionID [in] The session ID of the IOTC session
+ *
+ * \attention Call it after the last paced write on this session returns,
+ *            e.g. before IOTC_Session_Close().
+ */
+P2PAPI_API void IOTC_Session_Pacer_Remove(int nIOTCSessionID);
+
+/**
+ * \brief Get statistics of the pacer of an IOTC session
+ *
+ * \param nIOTCSessionID [in] The session ID of the IOTC session
+ * \param pStats [out] The statistics
+ *
+ * \return #IOTC_ER_NoERROR if getting successfully
+ * \return Error code if return value < 0
+ *			- #IOTC_ER_INVALID_ARG pStats is NULL
+ *			- #IOTC_ER_INVALID_SID No pacer is attached to the session
+ */
+P2PAPI_API int IOTC_Session_Pacer_Get_Stats(int nIOTCSessionID, IOTCPacerStats *pStats);
+
+/**
+ * \brief Write data through the pacer of an IOTC session
+ *
+ * \details Same as IOTC_Session_Write() except that the call first waits until
+ *			the pacer has tokens for nBufSize bytes, and retries for up to
+ *			#IOTC_PACER_MAX_RETRY_WAIT milliseconds if the socket queue is still
+ *			full. Without a pacer attached it behaves like IOTC_Session_Write().
+ *
+ * \param nIOTCSessionID [in] The session ID of the IOTC session to write data
+ * \param cabBuf [in] The data to write, not larger than #IOTC_MAX_PACKET_SIZE
+ * \param nBufSize [in] The length of cabBuf
+ * \param nIOTCChannelID [in] The IOTC channel ID in this IOTC session to write data
+ * \param pnWaitUs [out] The time this write waited in the pacer in microsecond, may be NULL
+ *
+ * \return The same as IOTC_Session_Write()
+ */
+P2PAPI_API int IOTC_Session_Write_Paced(int nIOTCSessionID, const char *cabBuf, int nBufSize,
+										unsigned char nIOTCChannelID, unsigned int *pnWaitUs);
+
+/**
+ * \brief Pace an AV channel with the pacer of its IOTC session
+ *
+ * \details After attaching, avSendFrameDataPaced() and avSendAudioDataPaced() on this
+ *			AV channel use the pacer of nIOTCSessionID. The pacer also keeps the
+ *			packet interval of avServSetDelayInterval() in line with its rate, so the
+ *			packets of one large frame leave at the paced rate too.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ * \param nIOTCSessionID [in] The session ID of the IOTC session of this AV channel,
+ *			which must have a pacer by IOTC_Session_Pacer_Setup()
+ *
+ * \return #AV_ER_NoERROR if attaching successfully
+ * \return Error code if return value < 0
+ *			- #AV_ER_INVALID_ARG The AV channel ID is not valid or it is already attached
+ *			- #AV_ER_INVALID_SID No pacer is attached to the session
+ *			- #AV_ER_MEM_INSUFF Insufficient memory for allocation
+ */
+AVAPI_API int avServPacerAttach(int nAVChannelID, int nIOTCSessionID);
+
+/**
+ * \brief Stop pacing an AV channel
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel
+ *
+ * \attention Call it after the last paced send on this AV channel returns.
+ */
+AVAPI_API void avServPacerDetach(int nAVChannelID);
+
+/**
+ * \brief Send frame data through the pacer
+ *
+ * \details Same as avSendFrameData() except that the call first waits until the
+ *			pacer has tokens for the frame, and retries for up to
+ *			#IOTC_PACER_MAX_RETRY_WAIT milliseconds on #AV_ER_SOCKET_QUEUE_FULL.
+ *			A frame larger than the bucket is let through once the bucket is full
+ *			and the following sends wait until the debt is paid back.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel to be sent
+ * \param cabFrameData [in] The frame data to be sent
+ * \param nFrameDataSize [in] The size of the frame data
+ * \param cabFrameInfo [in] The video frame information to be sent
+ * \param nFrameInfoSize [in] The size of the video frame information
+ * \param pnWaitUs [out] The time this send waited in the pacer in microsecond, may be NULL
+ *
+ * \return The same as avSendFrameData()
+ */
+AVAPI_API int avSendFrameDataPaced(int nAVChannelID, const char *cabFrameData, int nFrameDataSize,
+								   const void *cabFrameInfo, int nFrameInfoSize, unsigned int *pnWaitUs);
+
+/**
+ * \brief Send audio data through the pacer
+ *
+ * \details Audio is never delayed by the pacer, since a few hundred bytes do not
+ *			cause bursts and waiting behind a video frame would break the audio
+ *			timing. Its bytes are charged to the bucket so video yields to it.
+ *
+ * \param nAVChannelID [in] The channel ID of the AV channel to be sent
+ * \param cabAudioData [in] The audio data to be sent
+ * \param nAudioDataSize [in] The size of the audio data
+ * \param cabFrameInfo [in] The audio frame information to be sent
+ * \param nFrameInfoSize [in] The size of the audio frame information
+ *
+ * \return The same as avSendAudioData()
+ */
+AVAPI_API int avSendAudioDataPaced(int nAVChannelID, const char *cabAudioData, int nAudioDataSize,
+								   const void *cabFrameInfo, int nFrameInfoSize);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _IOTCPacerAPIs_H_ */
@@ -0,0 +1,161 @@
+/*! \file IOTCPresenceAPIs.h
+This file describes the device presence APIs built on top of the IOTC module.
+They check the on line status of many devices at once and keep the results
+in a process wide presence cache, so that a client showing a large device
+list does not query IOTC servers once per device on every refresh.
+ */
+
+#ifndef _IOTCPresenceAPIs_H_
+#define _IOTCPresenceAPIs_H_
+
+#include "IOTCAPIs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* ============================================================================
+ * Generic Macro Definition
+ * ============================================================================
+ */
+
+/** The default time, in unit of millisecond, an on line result stays in the presence cache */
+#define IOTC_PRESENCE_DEFAULT_POSITIVE_TTL			30000
+
+/** The default time, in unit of millisecond, an off line result stays in the presence cache */
+#define IOTC_PRESENCE_DEFAULT_NEGATIVE_TTL			10000
+
+/** The default max number of IOTC_Check_Device_On_Line() queries in flight at the same time.
+ * Each query takes an IOTC session slot until it is answered. */
+#define IOTC_PRESENCE_DEFAULT_MAX_INFLIGHT			16
+
+/* ============================================================================
+ * Type Definition
+ * ============================================================================
+ */
+
+/**
+ * \details This is the handler for reporting the result of IOTC_Check_Device_On_Line_Batch().
+ *
+ * \param UIDs [out] The UIDs passed to IOTC_Check_Device_On_Line_Batch(), in the same order.
+ * \param results [out] The result of each UID, with the same meaning as the result
+ *			of #onLineResult, i.e. #IOTC_ER_NoERROR means the device is on line.
+ * \param count [out] The number of entries in UIDs and results.
+ * \param userData [in] The data which was passed during IOTC_Check_Device_On_Line_Batch() is called.
+ *
+ * \attention THE "handler" MUST NOT BE BLOCKED. IT SHOULD BE RETURNED ASAP.
+ *            The UIDs and results arrays are only valid during the call.
+ */
+typedef void(__stdcall *onLineBatchResult)(const char * const *UIDs, const int *results, int count, void *userData);
+
+/* ============================================================================
+ * Function Declaration
+ * ============================================================================
+ */
+
+/**
+ * \brief Set up the presence cache
+ *
+ * \details Set how long on line (positive) and off line (negative) results are
+ *			kept in the presence cache, and how many device queries can be in
+ *			flight at the same time. Only #IOTC_ER_NoERROR, #IOTC_ER_DEVICE_OFFLINE
+ *			and #IOTC_ER_CAN_NOT_FIND_DEVICE results are cached; network errors are
+ *			always retried on the next check.
+ *
+ * \param nPositiveTTL [in] The TTL of on line results in millisecond, 0 disables positive caching
+ * \param nNegativeTTL [in] The TTL of off line results in millisecond, 0 disables negative caching
+ * \param nMaxInFlight [in] The max number of concurrent IOTC_Check_Device_On_Line() queries,
+ *			0 means #IOTC_PRESENCE_DEFAULT_MAX_INFLIGHT
+ *
+ * \return #IOTC_ER_NoERROR if setting successfully
+ *
+ * \attention (1) This API can only be used in client side
+ */
+P2PAPI_API int IOTC_Presence_Setup(unsigned int nPositiveTTL, unsigned int nNegativeTTL, unsigned int nMaxInFlight);
+
+/**
+ * \brief Check many devices on line or not.
+ *
+ * \details This function is the batch form of IOTC_Check_Device_On_Line().
+ *			UIDs with a valid entry in the presence cache are answered from the
+ *			cache, UIDs which are already being checked share that query, and
+ *			the remaining ones are queried from IOTC servers with at most
+ *			nMaxInFlight queries outstanding. The handler is called exactly once
+ *			when every UID has a result.
+ *
+ * \param UIDs [in] The device UIDs to be checked.
+ * \param nUIDCount [in] The number of UIDs.
+ * \param timeOut [in] The time out value of checking each device in millisecond.
+ * \param handler [in] A handle function for getting the results.
+ * \param userData [in] The data would like to bring to the handler for further processing.
+ *
+ * \return IOTC_ER_NoERROR on successful. The others are error.
+ *			- #IOTC_ER_INVALID_ARG UIDs or handler is NULL, or nUIDCount is not positive
+ *			- #IOTC_ER_NOT_ENOUGH_MEMORY No enough memory to run the function.
+ *			- #IOTC_ER_FAIL_CREATE_THREAD Fails to create the query thread
+ *
+ * \attention (1) The handler may be called before this function returns
+ *                if all the UIDs are answered by the cache.<br><br>
+ *            (2) This API can only be used in client side
+ */
+P2PAPI_API int IOTC_Check_Device_On_Line_Batch(const char * const *UIDs, int nUIDCount, unsigned int timeOut,
+											   onLineBatchResult handler, void *userData);
+
+/**
+ * \brief Look up a device in the presence cache
+ *
+ * \details This function never queries IOTC servers.
+ *
+ * \param UID [in] The device UID.
+ *
+ * \return The cached result, which has the same meaning as the result of #onLineResult
+ * \return #IOTC_ER_TIMEOUT if there is no valid cache entry for UID
+ * \return #IOTC_ER_INVALID_ARG if UID is NULL
+ */
+P2PAPI_API int IOTC_Presence_Query(const char *UID);
+
+/**
+ * \brief Drop a device from the presence cache
+ *
+ * \param UID [in] The device UID, NULL to drop every entry.
+ */
+P2PAPI_API void IOTC_Presence_Invalidate(const char *UID);
+
+/**
+ * \brief Tell the presence cache that an IOTC session has been established
+ *
+ * \details Call this after IOTC_Connect_ByUIDEx() or IOTC_Connect_ByUID_Parallel()
+ *			succeeds. The device of this session is marked as on line.
+ *
+ * \param nIOTCSessionID [in] The session ID returned by the connect function
+ *
+ * \return #IOTC_ER_NoERROR if successfully
+ * \return Error code from IOTC_Session_Check_Ex() if return value < 0
+ */
+P2PAPI_API int IOTC_Presence_Session_Connected(int nIOTCSessionID);
+
+/**
+ * \brief Tell the presence cache that an IOTC session is dropped
+ *
+ * \details The device of this session is removed from the presence cache,
+ *			so the next check queries IOTC servers again. The prototype matches
+ *			#sessionStatusCB so it can be called straight from a session status handler.
+ *
+ * \param nIOTCSessionID [in] The session ID being disconnected
+ * \param nErrorCode [in] The reason of the disconnection, not used
+ */
+P2PAPI_API void __stdcall IOTC_Presence_Session_Closed(int nIOTCSessionID, int nErrorCode);
+
+/**
+ * \brief Release all resources of the presence cache
+ *
+ * \attention Must be called after IOTC_DeInitialize() so no query result
+ *            arrives after the cache is released.
+ */
+P2PAPI_API void IOTC_Presence_DeInitialize(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _IOTCPresenceAPIs_H_ */
@@ -0,0 +1,7 @@
+import XCTest
+
+import TUTKSDKExtTests
+
+var tests = [XCTestCaseEntry]()
+tests += TUTKSDKExtTests.allTests()
+XCTMain(tests)
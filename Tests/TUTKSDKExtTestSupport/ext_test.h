@@ -0,0 +1,48 @@
+/*! \file ext_test.h
+Internal helpers of the checks.
+ */
+
+#ifndef _EXT_TEST_H_
+#define _EXT_TEST_H_
+
+#include <time.h>
+
+#include "TUTKSDKExtTestSupport.h"
+
+/** Return the line of cond from the check if it does not hold */
+#define EXT_CHECK(cond) \
+	do { \
+		if (!(cond)) \
+			return __LINE__; \
+	} while (0)
+
+/** A fixed pseudo random sequence, so a failure can be reproduced */
+static inline unsigned int ext_test_rand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 8) & 0xFFFFFF;
+}
+
+static inline void ext_test_sleep_ms(unsigned int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+/** Wait up to timeout_ms for *flag, set by another thread, to reach value; 1 if it did */
+static inline int ext_test_wait_for(const int *flag, int value, unsigned int timeout_ms)
+{
+	unsigned int waited;
+
+	for (waited = 0; __atomic_load_n(flag, __ATOMIC_ACQUIRE) != value; waited++) {
+		if (waited >= timeout_ms)
+			return 0;
+		ext_test_sleep_ms(1);
+	}
+	return 1;
+}
+
+#endif /* _EXT_TEST_H_ */
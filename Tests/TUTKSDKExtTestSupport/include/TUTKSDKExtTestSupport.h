@@ -0,0 +1,172 @@
+/*! \file TUTKSDKExtTestSupport.h
+Checks of the extension module, run by the TUTKSDKExtTests test target.
+Each check returns 0 if it passes, or the line of the first condition which
+failed, so a failure points at the check in the C source. The SDK is
+replaced by the stand-ins of sdk_stub.c.
+ */
+
+#ifndef _TUTKSDKExtTestSupport_H_
+#define _TUTKSDKExtTestSupport_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Batches sharing queries, which results are cached, session events and TTL expiry */
+int ext_test_presence_cache(void);
+
+/** AES-128-CTR against every prefix of the SP 800-38A vectors, on every engine the CPU supports */
+int ext_test_cipher_ctr_vectors(void);
+
+/** Engines agreeing with the portable one on a long buffer and on the carry of the 128-bit counter */
+int ext_test_cipher_engines_agree(void);
+
+/** Reed-Solomon parity, the same on every engine, with the first parity packet the XOR of the data */
+int ext_test_fec_encode(void);
+
+/** Rebuilding a block from any k of its k + m packets, and failing with fewer */
+int ext_test_fec_recover(void);
+
+/** G.711 known values and code -> sample -> code round trips, on every engine */
+int ext_test_g711_round_trip(void);
+
+/** A sine resampled from 8 kHz to 16 kHz and back, fed in odd sized pieces */
+int ext_test_resampler_round_trip(void);
+
+/** NAL units of known H.264 and H.265 frames */
+int ext_test_nal_scan_known(void);
+
+/** The SIMD scanners finding the same units as the portable one on random data */
+int ext_test_nal_scan_engines_agree(void);
+
+/** A segment filled to the last byte, then rotated by the next frame, and its finished file */
+int ext_test_recorder_exact_fill(void);
+
+/** IO controls of two AV channels run in order, one at a time per channel */
+int ext_test_dispatch_order(void);
+
+/** A handler table spanning every IO control type */
+int ext_test_dispatch_wide_span(void);
+
+/** Calls with payloads of one and several IO controls, and IO controls passed through */
+int ext_test_rpc_calls(void);
+
+/** A refused call, a timed out one, and calls on a closed AV channel */
+int ext_test_rpc_failures(void);
+
+/** A detach of the RPC layer while a dispatcher worker is in its request handler */
+int ext_test_rpc_dispatched_detach(void);
+
+/** Status samples, frame records, and what the full rings dropped */
+int ext_test_stats_sampler(void);
+
+/** Samplers started and stopped while other threads record frames */
+int ext_test_stats_stop_while_sending(void);
+
+/** A fixed rate spaces the writes out, and a failed write is refunded */
+int ext_test_pacer_fixed_rate(void);
+
+/** Congestion backs an auto rate off, and the SDK packet interval follows the rate */
+int ext_test_pacer_auto_rate(void);
+
+/** Threads sending on one AV channel share its pacer while the rate changes */
+int ext_test_pacer_shared(void);
+
+/** A loss profile of the FEC link harness: random loss, or a Gilbert-Elliott
+ * link when enterBadPermille is set, all in 1/1000 */
+typedef struct ExtFecLinkProfile {
+	const char *name;
+	unsigned int lossPermille; //!< Loss, or loss in the good state of a bursty link
+	unsigned int burstLossPermille; //!< Loss in the bad state
+	unsigned int enterBadPermille; //!< Chance per packet of going from the good state to the bad one
+	unsigned int leaveBadPermille; //!< Chance per packet of going back
+	int resend; //!< AVFecConfig.resend
+	unsigned int seed;
+} ExtFecLinkProfile;
+
+/** What a run of the FEC link harness measured */
+typedef struct ExtFecLinkResult {
+	unsigned int framesSent;
+	unsigned int framesLost; //!< Frames which never came out of avFecRecvFrame()
+	unsigned int framesCorrupt; //!< Frames which came with the wrong data, or twice
+	unsigned int packetsSent; //!< Data, parity and resent packets
+	unsigned int packetsLost; //!< Of them, dropped by the link
+	unsigned int parityPackets;
+	unsigned int resentPackets;
+	float avgLatencyMs; //!< From avFecSendFrame() to avFecRecvFrame()
+	float maxLatencyMs;
+} ExtFecLinkResult;
+
+/** Stream frames over an FEC channel on a link with a 30 ms one way delay and
+ * the profile's loss, a 60 KB key frame every 30 frames and 8 KB frames between */
+int ext_fec_link_run(const ExtFecLinkProfile *profile, unsigned int frames, unsigned int interval_ms,
+					 ExtFecLinkResult *result);
+
+/** Print the frame loss and latency of every profile over 300 frames at 30 fps; takes over a minute */
+int ext_fec_link_table(void);
+
+/** Frames over a clean link, 5% random loss with parity, and bursty loss with resend */
+int ext_test_fec_link(void);
+
+/** What a run of the playback seek measurement took */
+typedef struct ExtPlaybackSeekResult {
+	unsigned int segments;
+	unsigned int frames;
+	float openMs; //!< avPlaybackIndexOpen()
+	unsigned long long seekAvgUs; //!< avPlaybackIndexSeek() to random times, each segment index read on first use
+	unsigned long long seekMaxUs;
+} ExtPlaybackSeekResult;
+
+/** Record about segments segments of 1 MB, then time opening the index and random seeks on it */
+int ext_playback_seek_run(unsigned int segments, ExtPlaybackSeekResult *result);
+
+/** Print the open and seek latency of recordings of 20 and 200 segments */
+int ext_playback_seek_table(void);
+
+/** Random seeks over 20 segments find the last keyframe before the time, quickly */
+int ext_test_playback_seek(void);
+
+/** Session credits from the pacer bucket, waits for a refill, and an edge-triggered callback */
+int ext_test_credit_session(void);
+
+/** AV channel credits from the resend buffer and the pacer, and a polled callback */
+int ext_test_credit_av(void);
+
+/** Connections surviving and reconnected across network changes, with their state kept */
+int ext_test_handover_changes(void);
+
+/** Received frames drawn from size classes, reused, grown, cached up to a limit and wrapped */
+int ext_test_frame_pool(void);
+
+/** One frame store sent to viewers which start at keyframes, recover from lost frames and fall behind alone */
+int ext_test_stream_group_fanout(void);
+
+/** Frames played in timestamp order after the target delay, with late, overflow and underrun handling */
+int ext_test_jitter_playout(void);
+
+/** Jitter buffers fed by their own receive threads from a video and an audio channel */
+int ext_test_jitter_attach(void);
+
+/** GOPs cut short at the high watermark or after a lost frame, and the resend buffer flushed at the critical one */
+int ext_test_gop_gate(void);
+
+/** A pre-roll buffer sized from the contract, holding whole GOPs of the window, pinned by clips */
+int ext_test_preroll_buffer(void);
+
+/** Budgets started within a global cap, then shared by need and weight and moved by buffer usage */
+int ext_test_buf_budget_share(void);
+
+/** A client switched to a camera in standby at once with the keyframe it kept, the server sending keyframes only */
+int ext_test_standby_switch(void);
+
+/** A client in standby on an AV channel which closes, which is no longer in standby once promoted */
+int ext_test_standby_closed(void);
+
+/** Streams shared by two workers, with ordered decoder queues which skip to keyframes and idle polls backed off */
+int ext_test_recv_engine_streams(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _TUTKSDKExtTestSupport_H_ */
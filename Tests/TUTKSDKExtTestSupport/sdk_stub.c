@@ -0,0 +1,1120 @@
+/*! \file sdk_stub.c
+Stand-ins for the SDK functions the extension module calls, so the checks
+link and run without the IOTC and AV libraries. What the checks drive is
+scripted through sdk_stub.h; everything else fails as if the SDK was not
+initialized.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdk_stub.h"
+
+#define STUB_MAX_DEVICES		64
+#define STUB_MAX_SESSIONS		32
+#define STUB_UID_LENGTH			20
+#define STUB_PASSWORD_LENGTH	63
+
+typedef struct StubDevice {
+	char uid[STUB_UID_LENGTH + 1];
+	int result;
+	unsigned int queries;
+	int connect_result;
+	unsigned int connects;
+} StubDevice;
+
+// An IO control or a frame on its way; the frame info, if any, is stored ahead of the data
+typedef struct StubMsg {
+	struct StubMsg *next;
+	struct timespec due; // When a packet on a link arrives
+	unsigned int type;
+	int info_size;
+	int size;
+	char data[];
+} StubMsg;
+
+typedef struct StubQueue {
+	StubMsg *head, *tail;
+	unsigned int count;
+} StubQueue;
+
+typedef struct StubAv {
+	int error; // Returned by every call once the channel is closed
+	int linked; // avSendIOCtrl() delivers to peer if set, else keeps the IO controls in ioctrl_out
+	int peer;
+	StubQueue ioctrl_in;
+	StubQueue ioctrl_out;
+	unsigned int ioctrl_exits;
+	int status_set;
+	struct st_AvStatus status;
+	float resend_usage;
+	unsigned int resend_kb;
+	StubQueue sent; // Frames sent, type 1 for audio
+	int send_error; // What the next send_failures video sends return
+	unsigned int send_failures;
+	int delay_result;
+	unsigned int delay_calls;
+	unsigned short delay_packets;
+	int reset_set; // avServResetBuffer() takes reset_ms and succeeds if set, else fails
+	unsigned int reset_ms;
+	unsigned int resets;
+	int reset_target;
+	StubQueue recv[2]; // Frames for avRecvFrameData2() and avRecvAudioData(), type is the expected size
+	unsigned int recv_index[2];
+	int started; // By avClientStartEx()
+	char password[STUB_PASSWORD_LENGTH + 1];
+	unsigned int start_buf_kb; // avClientSetMaxBufSize() when started
+	int recv_usage_set;
+	float recv_usage;
+} StubAv;
+
+typedef struct StubSession {
+	char uid[STUB_UID_LENGTH + 1]; // Empty if closed
+	int reserved; // Handed out by IOTC_Get_SessionID(), not connected yet
+	int traffic;
+	unsigned int rx;
+	unsigned long long written;
+	int write_error; // What the next write_failures writes return
+	unsigned int write_failures;
+	int linked; // Writes go to the in queue of peer, impaired by link
+	int peer;
+	ExtStubLink link;
+	int bad; // The state of link
+	unsigned int lost;
+	StubQueue in; // Packets for IOTC_Session_Read(), in order of due time
+} StubSession;
+
+static pthread_mutex_t gStubLock = PTHREAD_MUTEX_INITIALIZER;
+// Signalled whenever something is queued or a channel closes
+static pthread_cond_t gStubCond = PTHREAD_COND_INITIALIZER;
+static StubDevice gStubDevices[STUB_MAX_DEVICES];
+static int gStubDeviceCount;
+static StubSession gStubSessions[STUB_MAX_SESSIONS];
+static StubAv gStubAv[EXT_STUB_MAX_AV];
+static int gStubReinitResult;
+static unsigned int gStubMaxBufKB;
+
+// Caller holds gStubLock
+static StubDevice *stub_device(const char *uid, int create)
+{
+	int i;
+
+	for (i = 0; i < gStubDeviceCount; i++) {
+		if (strcmp(gStubDevices[i].uid, uid) == 0)
+			return &gStubDevices[i];
+	}
+	if (!create || gStubDeviceCount == STUB_MAX_DEVICES || strlen(uid) > STUB_UID_LENGTH)
+		return NULL;
+	strcpy(gStubDevices[gStubDeviceCount].uid, uid);
+	gStubDevices[gStubDeviceCount].result = IOTC_ER_CAN_NOT_FIND_DEVICE;
+	gStubDevices[gStubDeviceCount].connect_result = IOTC_ER_CAN_NOT_FIND_DEVICE;
+	return &gStubDevices[gStubDeviceCount++];
+}
+
+// Caller holds gStubLock
+static int stub_push(StubQueue *q, unsigned int type, const void *info, int info_size, const void *data, int size)
+{
+	StubMsg *m = (StubMsg *)malloc(sizeof(StubMsg) + (size_t)info_size + (size_t)size);
+
+	if (m == NULL)
+		return -1;
+	m->next = NULL;
+	m->due.tv_sec = 0;
+	m->due.tv_nsec = 0;
+	m->type = type;
+	m->info_size = info_size;
+	m->size = size;
+	if (info_size > 0)
+		memcpy(m->data, info, (size_t)info_size);
+	if (size > 0)
+		memcpy(m->data + info_size, data, (size_t)size);
+	if (q->tail != NULL)
+		q->tail->next = m;
+	else
+		q->head = m;
+	q->tail = m;
+	q->count++;
+	pthread_cond_broadcast(&gStubCond);
+	return 0;
+}
+
+// Caller holds gStubLock. The caller frees the message.
+static StubMsg *stub_pop(StubQueue *q)
+{
+	StubMsg *m = q->head;
+
+	if (m == NULL)
+		return NULL;
+	q->head = m->next;
+	if (q->head == NULL)
+		q->tail = NULL;
+	q->count--;
+	return m;
+}
+
+// Caller holds gStubLock
+static void stub_clear(StubQueue *q)
+{
+	StubMsg *m;
+
+	while ((m = stub_pop(q)) != NULL)
+		free(m);
+}
+
+// Caller holds gStubLock. Waits for gStubCond until deadline; 0 once it has passed.
+static int stub_wait(const struct timespec *deadline)
+{
+	return pthread_cond_timedwait(&gStubCond, &gStubLock, deadline) != ETIMEDOUT;
+}
+
+static void stub_deadline(struct timespec *ts, unsigned int timeout_ms)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += timeout_ms / 1000;
+	ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static int stub_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// Caller holds gStubLock. Whether the link of ss loses the next packet.
+static int stub_link_loses(StubSession *ss)
+{
+	ExtStubLink *l = &ss->link;
+	unsigned int r;
+
+	l->seed = l->seed * 1103515245u + 12345u;
+	r = (l->seed >> 8) % 1000;
+	if (ss->bad ? r < l->leaveBadPermille : r < l->enterBadPermille)
+		ss->bad = !ss->bad;
+	l->seed = l->seed * 1103515245u + 12345u;
+	r = (l->seed >> 8) % 1000;
+	return r < (ss->bad ? l->burstLossPermille : l->lossPermille);
+}
+
+// Caller holds gStubLock
+static StubAv *stub_av(int av)
+{
+	return av >= 0 && av < EXT_STUB_MAX_AV ? &gStubAv[av] : NULL;
+}
+
+void ext_stub_reset(void)
+{
+	int i;
+
+	pthread_mutex_lock(&gStubLock);
+	memset(gStubDevices, 0, sizeof(gStubDevices));
+	gStubDeviceCount = 0;
+	for (i = 0; i < STUB_MAX_SESSIONS; i++)
+		stub_clear(&gStubSessions[i].in);
+	memset(gStubSessions, 0, sizeof(gStubSessions));
+	for (i = 0; i < EXT_STUB_MAX_AV; i++) {
+		stub_clear(&gStubAv[i].ioctrl_in);
+		stub_clear(&gStubAv[i].ioctrl_out);
+		stub_clear(&gStubAv[i].sent);
+		stub_clear(&gStubAv[i].recv[0]);
+		stub_clear(&gStubAv[i].recv[1]);
+		memset(&gStubAv[i], 0, sizeof(StubAv));
+	}
+	gStubReinitResult = IOTC_ER_NoERROR;
+	gStubMaxBufKB = 0;
+	pthread_cond_broadcast(&gStubCond);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_set_online(const char *uid, int result)
+{
+	StubDevice *d;
+
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(uid, 1);
+	if (d != NULL)
+		d->result = result;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_online_queries(const char *uid)
+{
+	StubDevice *d;
+	unsigned int n;
+
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(uid, 0);
+	n = d != NULL ? d->queries : 0;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_set_connect(const char *uid, int result)
+{
+	StubDevice *d;
+
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(uid, 1);
+	if (d != NULL)
+		d->connect_result = result;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_connects(const char *uid)
+{
+	StubDevice *d;
+	unsigned int n;
+
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(uid, 0);
+	n = d != NULL ? d->connects : 0;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_session_open(int sid, const char *uid)
+{
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS || strlen(uid) > STUB_UID_LENGTH)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	strcpy(gStubSessions[sid].uid, uid);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_session_close(int sid)
+{
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	gStubSessions[sid].uid[0] = '\0';
+	gStubSessions[sid].reserved = 0;
+	gStubSessions[sid].traffic = 0;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_session_traffic(int sid, int on)
+{
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	gStubSessions[sid].traffic = on;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_set_reinit_result(int result)
+{
+	pthread_mutex_lock(&gStubLock);
+	gStubReinitResult = result;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+int ext_stub_av_started(int av, char *password, int password_max)
+{
+	StubAv *a;
+	int started = 0;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL && a->started) {
+		started = 1;
+		if (password != NULL && password_max > 0) {
+			strncpy(password, a->password, (size_t)password_max - 1);
+			password[password_max - 1] = '\0';
+		}
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return started;
+}
+
+unsigned int ext_stub_av_buf_size(int av)
+{
+	unsigned int kb = 0;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if (av < 0)
+		kb = gStubMaxBufKB;
+	else if ((a = stub_av(av)) != NULL)
+		kb = a->start_buf_kb;
+	pthread_mutex_unlock(&gStubLock);
+	return kb;
+}
+
+void ext_stub_set_recv_usage(int av, float rate)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL) {
+		a->recv_usage_set = 1;
+		a->recv_usage = rate;
+	}
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_av_close(int av, int error)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		a->error = error;
+	pthread_cond_broadcast(&gStubCond);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_ioctrl_push(int av, unsigned int type, const void *data, int size)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		stub_push(&a->ioctrl_in, type, NULL, 0, data, size);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+int ext_stub_ioctrl_pop(int av, unsigned int *type, void *data, int max_size)
+{
+	StubMsg *m = NULL;
+	StubAv *a;
+	int size = -1;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		m = stub_pop(&a->ioctrl_out);
+	pthread_mutex_unlock(&gStubLock);
+	if (m == NULL)
+		return -1;
+	if (m->size <= max_size) {
+		*type = m->type;
+		memcpy(data, m->data, (size_t)m->size);
+		size = m->size;
+	}
+	free(m);
+	return size;
+}
+
+void ext_stub_ioctrl_link(int a, int b)
+{
+	if (stub_av(a) == NULL || stub_av(b) == NULL)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	gStubAv[a].linked = gStubAv[b].linked = 1;
+	gStubAv[a].peer = b;
+	gStubAv[b].peer = a;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_ioctrl_exits(int av)
+{
+	unsigned int n = 0;
+
+	pthread_mutex_lock(&gStubLock);
+	if (stub_av(av) != NULL)
+		n = gStubAv[av].ioctrl_exits;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_set_status(int av, const struct st_AvStatus *status)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL) {
+		a->status = *status;
+		a->status_set = 1;
+	}
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_set_resend_usage(int av, float rate)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		a->resend_usage = rate;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_set_resend_size(int av, unsigned int size_kb)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		a->resend_kb = size_kb;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_set_reset(int av, unsigned int delay_ms)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL) {
+		a->reset_set = 1;
+		a->reset_ms = delay_ms;
+	}
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_resets(int av, int *target)
+{
+	unsigned int n = 0;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL) {
+		n = a->resets;
+		if (target != NULL)
+			*target = a->reset_target;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_recv_push(int av, int is_audio, const void *data, int size, int expected_size, const void *info,
+						int info_size)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		stub_push(&a->recv[is_audio ? 1 : 0], (unsigned int)(expected_size > size ? expected_size : size), info,
+				  info_size, data, size);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_send_fail(int av, int error, unsigned int count)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL) {
+		a->send_error = error;
+		a->send_failures = count;
+	}
+	pthread_mutex_unlock(&gStubLock);
+}
+
+int ext_stub_sent_pop(int av, int *is_audio, void *info, int info_max)
+{
+	StubMsg *m = NULL;
+	StubAv *a;
+	int size;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) != NULL)
+		m = stub_pop(&a->sent);
+	pthread_mutex_unlock(&gStubLock);
+	if (m == NULL)
+		return -1;
+	if (is_audio != NULL)
+		*is_audio = (int)m->type;
+	if (info != NULL)
+		memcpy(info, m->data, (size_t)(m->info_size < info_max ? m->info_size : info_max));
+	size = m->size;
+	free(m);
+	return size;
+}
+
+unsigned int ext_stub_sent_count(int av)
+{
+	unsigned int n = 0;
+
+	pthread_mutex_lock(&gStubLock);
+	if (stub_av(av) != NULL)
+		n = gStubAv[av].sent.count;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_set_delay_result(int av, int result)
+{
+	pthread_mutex_lock(&gStubLock);
+	if (stub_av(av) != NULL)
+		gStubAv[av].delay_result = result;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_delay_calls(int av, unsigned short *packets)
+{
+	unsigned int n = 0;
+
+	pthread_mutex_lock(&gStubLock);
+	if (stub_av(av) != NULL) {
+		n = gStubAv[av].delay_calls;
+		if (packets != NULL)
+			*packets = gStubAv[av].delay_packets;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+unsigned long long ext_stub_session_written(int sid)
+{
+	unsigned long long n = 0;
+
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS)
+		return 0;
+	pthread_mutex_lock(&gStubLock);
+	n = gStubSessions[sid].written;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+void ext_stub_write_fail(int sid, int error, unsigned int count)
+{
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	gStubSessions[sid].write_error = error;
+	gStubSessions[sid].write_failures = count;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+void ext_stub_session_link(int a, int b, const ExtStubLink *ab, const ExtStubLink *ba)
+{
+	StubSession *sa, *sb;
+
+	if (a < 0 || a >= STUB_MAX_SESSIONS || b < 0 || b >= STUB_MAX_SESSIONS)
+		return;
+	pthread_mutex_lock(&gStubLock);
+	sa = &gStubSessions[a];
+	sb = &gStubSessions[b];
+	memset(&sa->link, 0, sizeof(ExtStubLink));
+	memset(&sb->link, 0, sizeof(ExtStubLink));
+	if (ab != NULL)
+		sa->link = *ab;
+	if (ba != NULL)
+		sb->link = *ba;
+	sa->linked = sb->linked = 1;
+	sa->peer = b;
+	sb->peer = a;
+	sa->bad = sb->bad = 0;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+unsigned int ext_stub_session_lost(int sid)
+{
+	unsigned int n;
+
+	if (sid < 0 || sid >= STUB_MAX_SESSIONS)
+		return 0;
+	pthread_mutex_lock(&gStubLock);
+	n = gStubSessions[sid].lost;
+	pthread_mutex_unlock(&gStubLock);
+	return n;
+}
+
+/* ============================================================================
+ * IOTC module
+ * ============================================================================
+ */
+
+// Answers on the calling thread, which the SDK is allowed to do
+int IOTC_Check_Device_On_Line(const char *UID, const unsigned int timeOut, onLineResult handler, void *userData)
+{
+	StubDevice *d;
+	int result;
+
+	(void)timeOut;
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(UID, 1);
+	if (d != NULL)
+		d->queries++;
+	result = d != NULL ? d->result : IOTC_ER_CAN_NOT_FIND_DEVICE;
+	pthread_mutex_unlock(&gStubLock);
+	handler(result, userData);
+	return IOTC_ER_NoERROR;
+}
+
+// Connects at once, or fails as scripted; the SID stays reserved until closed
+int IOTC_Connect_ByUIDEx(const char *cszUID, int SID, IOTCConnectInput *connectInput)
+{
+	StubDevice *d;
+	int ret;
+
+	(void)connectInput;
+	if (SID < 0 || SID >= STUB_MAX_SESSIONS)
+		return IOTC_ER_INVALID_SID;
+	pthread_mutex_lock(&gStubLock);
+	d = stub_device(cszUID, 1);
+	if (!gStubSessions[SID].reserved) {
+		ret = IOTC_ER_INVALID_SID;
+	} else if (d == NULL) {
+		ret = IOTC_ER_CAN_NOT_FIND_DEVICE;
+	} else {
+		d->connects++;
+		ret = d->connect_result;
+		if (ret == IOTC_ER_NoERROR) {
+			strcpy(gStubSessions[SID].uid, cszUID);
+			gStubSessions[SID].reserved = 0;
+		}
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+// The lowest free SID, as the SDK hands out closed SIDs again
+int IOTC_Get_SessionID(void)
+{
+	int sid;
+
+	pthread_mutex_lock(&gStubLock);
+	for (sid = 0; sid < STUB_MAX_SESSIONS; sid++) {
+		if (gStubSessions[sid].uid[0] == '\0' && !gStubSessions[sid].reserved) {
+			gStubSessions[sid].reserved = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return sid < STUB_MAX_SESSIONS ? sid : IOTC_ER_EXCEED_MAX_SESSION;
+}
+
+int IOTC_ReInitSocket(unsigned short nUDPPort)
+{
+	int ret;
+
+	(void)nUDPPort;
+	pthread_mutex_lock(&gStubLock);
+	ret = gStubReinitResult;
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+int IOTC_Session_Check_Ex(int nIOTCSessionID, struct st_SInfoEx *psSessionInfo)
+{
+	int ret = IOTC_ER_INVALID_SID;
+
+	if (nIOTCSessionID < 0 || nIOTCSessionID >= STUB_MAX_SESSIONS || psSessionInfo == NULL)
+		return IOTC_ER_INVALID_SID;
+	pthread_mutex_lock(&gStubLock);
+	if (gStubSessions[nIOTCSessionID].uid[0] != '\0') {
+		if (gStubSessions[nIOTCSessionID].traffic)
+			gStubSessions[nIOTCSessionID].rx++;
+		strcpy(psSessionInfo->UID, gStubSessions[nIOTCSessionID].uid);
+		psSessionInfo->Mode = 0;
+		psSessionInfo->RX_Packetcount = gStubSessions[nIOTCSessionID].rx;
+		ret = IOTC_ER_NoERROR;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+void IOTC_Session_Close(int nIOTCSessionID)
+{
+	ext_stub_session_close(nIOTCSessionID);
+}
+
+// Waits up to nTimeout ms for a packet of the link which is due
+int IOTC_Session_Read(int nIOTCSessionID, char *abBuf, int nMaxBufSize, unsigned int nTimeout,
+					  unsigned char nIOTCChannelID)
+{
+	struct timespec deadline, now, *until;
+	StubSession *ss;
+	StubMsg *m = NULL;
+	int ret;
+
+	(void)nIOTCChannelID;
+	if (nIOTCSessionID < 0 || nIOTCSessionID >= STUB_MAX_SESSIONS)
+		return IOTC_ER_INVALID_SID;
+	stub_deadline(&deadline, nTimeout);
+	pthread_mutex_lock(&gStubLock);
+	ss = &gStubSessions[nIOTCSessionID];
+	for (;;) {
+		if (ss->uid[0] == '\0') {
+			ret = IOTC_ER_INVALID_SID;
+			break;
+		}
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (ss->in.head != NULL && !stub_before(&now, &ss->in.head->due)) {
+			m = stub_pop(&ss->in);
+			ret = m->size;
+			break;
+		}
+		if (!stub_before(&now, &deadline)) {
+			ret = IOTC_ER_TIMEOUT;
+			break;
+		}
+		until = ss->in.head != NULL && stub_before(&ss->in.head->due, &deadline) ? &ss->in.head->due : &deadline;
+		pthread_cond_timedwait(&gStubCond, &gStubLock, until);
+	}
+	pthread_mutex_unlock(&gStubLock);
+	if (m != NULL) {
+		if (m->size > nMaxBufSize)
+			ret = IOTC_ER_INVALID_ARG;
+		else
+			memcpy(abBuf, m->data, (size_t)m->size);
+		free(m);
+	}
+	return ret;
+}
+
+// Takes everything at once on an open session, unless a failure is scripted
+int IOTC_Session_Write(int nIOTCSessionID, const char *cabBuf, int nBufSize, unsigned char nIOTCChannelID)
+{
+	StubSession *ss;
+	int ret;
+
+	(void)nIOTCChannelID;
+	if (nIOTCSessionID < 0 || nIOTCSessionID >= STUB_MAX_SESSIONS)
+		return IOTC_ER_INVALID_SID;
+	pthread_mutex_lock(&gStubLock);
+	ss = &gStubSessions[nIOTCSessionID];
+	if (ss->uid[0] == '\0') {
+		ret = IOTC_ER_INVALID_SID;
+	} else if (ss->write_failures > 0) {
+		ss->write_failures--;
+		ret = ss->write_error;
+	} else {
+		ss->written += (unsigned long long)nBufSize;
+		ret = nBufSize;
+		if (ss->linked && stub_link_loses(ss))
+			ss->lost++;
+		else if (ss->linked && stub_push(&gStubSessions[ss->peer].in, nIOTCChannelID, NULL, 0, cabBuf, nBufSize) == 0)
+			stub_deadline(&gStubSessions[ss->peer].in.tail->due, ss->link.delayMs);
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+/* ============================================================================
+ * AV module
+ * ============================================================================
+ */
+
+float avClientRecvBufUsageRate(int nAVChannelID)
+{
+	float rate = -1.0f;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) != NULL && a->error == 0 && a->recv_usage_set)
+		rate = a->recv_usage;
+	pthread_mutex_unlock(&gStubLock);
+	return rate;
+}
+
+void avClientSetMaxBufSize(unsigned int nMaxBufSize)
+{
+	pthread_mutex_lock(&gStubLock);
+	gStubMaxBufKB = nMaxBufSize;
+	pthread_mutex_unlock(&gStubLock);
+}
+
+// Starts the AV channel of the same ID as the session, which must be connected
+int avClientStartEx(LPCAVCLIENT_START_IN_CONFIG AVClientInConfig, LPAVCLIENT_START_OUT_CONFIG AVClientOutConfig)
+{
+	unsigned int sid = AVClientInConfig->iotc_session_id;
+	const char *password = AVClientInConfig->password_or_token;
+	StubAv *a;
+
+	if (sid >= STUB_MAX_SESSIONS || (a = stub_av((int)sid)) == NULL)
+		return AV_ER_INVALID_SID;
+	pthread_mutex_lock(&gStubLock);
+	if (gStubSessions[sid].uid[0] == '\0') {
+		pthread_mutex_unlock(&gStubLock);
+		return AV_ER_INVALID_SID;
+	}
+	a->error = 0;
+	a->started = 1;
+	a->start_buf_kb = gStubMaxBufKB;
+	strncpy(a->password, password != NULL ? password : "", STUB_PASSWORD_LENGTH);
+	a->password[STUB_PASSWORD_LENGTH] = '\0';
+	pthread_mutex_unlock(&gStubLock);
+	if (AVClientOutConfig != NULL)
+		AVClientOutConfig->resend = AVClientInConfig->resend;
+	return (int)sid;
+}
+
+// A stopped AV channel is no longer valid
+void avClientStop(int nAVChannelID)
+{
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) != NULL) {
+		a->started = 0;
+		a->error = AV_ER_INVALID_ARG;
+	}
+	pthread_cond_broadcast(&gStubCond);
+	pthread_mutex_unlock(&gStubLock);
+}
+
+/**
+ * Take the next queued frame of a kind, never waiting. A frame larger than
+ * max_size is dropped as #AV_ER_BUFPARA_MAXSIZE_INSUFF, as the SDK does.
+ */
+static int stub_recv(int av, int is_audio, char *data, int max_size, int *actual, int *expected, char *info,
+					 int info_max, int *info_size, unsigned int *index)
+{
+	StubMsg *m = NULL;
+	StubAv *a;
+	int ret;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) == NULL)
+		ret = AV_ER_INVALID_ARG;
+	else if (a->error != 0)
+		ret = a->error;
+	else if ((m = stub_pop(&a->recv[is_audio])) == NULL)
+		ret = AV_ER_DATA_NOREADY;
+	else
+		ret = m->size;
+	if (m != NULL)
+		*index = a->recv_index[is_audio]++;
+	pthread_mutex_unlock(&gStubLock);
+	if (m == NULL)
+		return ret;
+
+	if (actual != NULL)
+		*actual = 0;
+	if (expected != NULL)
+		*expected = (int)m->type;
+	if (m->size > max_size) {
+		ret = AV_ER_BUFPARA_MAXSIZE_INSUFF;
+	} else {
+		memcpy(data, m->data + m->info_size, (size_t)m->size);
+		if (actual != NULL)
+			*actual = m->size;
+		if ((int)m->type > m->size)
+			ret = AV_ER_INCOMPLETE_FRAME;
+		*info_size = m->info_size < info_max ? m->info_size : info_max;
+		if (*info_size > 0)
+			memcpy(info, m->data, (size_t)*info_size);
+	}
+	free(m);
+	return ret;
+}
+
+int avRecvAudioData(int nAVChannelID, char *abAudioData, int nAudioDataMaxSize, char *abFrameInfo,
+					int nFrameInfoMaxSize, unsigned int *pnFrameIdx)
+{
+	int info_size;
+
+	return stub_recv(nAVChannelID, 1, abAudioData, nAudioDataMaxSize, NULL, NULL, abFrameInfo, nFrameInfoMaxSize,
+					 &info_size, pnFrameIdx);
+}
+
+int avRecvFrameData2(int nAVChannelID, char *abFrameData, int nFrameDataMaxSize, int *pnActualFrameSize,
+					 int *pnExpectedFrameSize, char *abFrameInfo, int nFrameInfoMaxSize,
+					 int *pnActualFrameInfoSize, unsigned int *pnFrameIdx)
+{
+	return stub_recv(nAVChannelID, 0, abFrameData, nFrameDataMaxSize, pnActualFrameSize, pnExpectedFrameSize,
+					 abFrameInfo, nFrameInfoMaxSize, pnActualFrameInfoSize, pnFrameIdx);
+}
+
+// Waits up to nTimeout ms like the SDK; a zero timeout only looks
+int avRecvIOCtrl(int nAVChannelID, unsigned int *pnIOCtrlType, char *abIOCtrlData, int nIOCtrlMaxDataSize,
+				 unsigned int nTimeout)
+{
+	struct timespec deadline;
+	StubMsg *m = NULL;
+	StubAv *a;
+	int ret;
+
+	stub_deadline(&deadline, nTimeout);
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) == NULL) {
+		pthread_mutex_unlock(&gStubLock);
+		return AV_ER_INVALID_ARG;
+	}
+	for (;;) {
+		if (a->error != 0) {
+			ret = a->error;
+			break;
+		}
+		if ((m = stub_pop(&a->ioctrl_in)) != NULL) {
+			ret = m->size;
+			break;
+		}
+		if (nTimeout == 0) {
+			ret = AV_ER_DATA_NOREADY;
+			break;
+		}
+		if (!stub_wait(&deadline)) {
+			ret = AV_ER_TIMEOUT;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gStubLock);
+	if (m != NULL) {
+		if (m->size > nIOCtrlMaxDataSize) {
+			ret = AV_ER_BUFPARA_MAXSIZE_INSUFF;
+		} else {
+			*pnIOCtrlType = m->type;
+			memcpy(abIOCtrlData, m->data, (size_t)m->size);
+		}
+		free(m);
+	}
+	return ret;
+}
+
+float avResendBufUsageRate(int nAVChannelID)
+{
+	float rate = -1.0f;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) != NULL && a->error == 0)
+		rate = a->resend_usage;
+	pthread_mutex_unlock(&gStubLock);
+	return rate;
+}
+
+// Logs the frame in a->sent, unless a failure is scripted for video
+static int stub_send(int av, int is_audio, const char *data, int size, const void *info, int info_size)
+{
+	StubAv *a;
+	int ret = AV_ER_NoERROR;
+
+	if (size < 0 || info_size < 0)
+		return AV_ER_INVALID_ARG;
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(av)) == NULL) {
+		ret = AV_ER_INVALID_ARG;
+	} else if (a->error != 0) {
+		ret = a->error;
+	} else if (!is_audio && a->send_failures > 0) {
+		a->send_failures--;
+		ret = a->send_error;
+	} else if (stub_push(&a->sent, (unsigned int)is_audio, info, info_size, data, size) < 0) {
+		ret = AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+int avSendAudioData(int nAVChannelID, const char *cabAudioData, int nAudioDataSize, const void *cabFrameInfo,
+					int nFrameInfoSize)
+{
+	return stub_send(nAVChannelID, 1, cabAudioData, nAudioDataSize, cabFrameInfo, nFrameInfoSize);
+}
+
+int avSendFrameData(int nAVChannelID, const char *cabFrameData, int nFrameDataSize, const void *cabFrameInfo,
+					int nFrameInfoSize)
+{
+	return stub_send(nAVChannelID, 0, cabFrameData, nFrameDataSize, cabFrameInfo, nFrameInfoSize);
+}
+
+// Never blocks, the peer takes any number of IO controls
+int avSendIOCtrl(int nAVChannelID, unsigned int nIOCtrlType, const char *cabIOCtrlData, int nIOCtrlDataSize)
+{
+	StubQueue *q;
+	StubAv *a;
+	int ret = AV_ER_NoERROR;
+
+	if (nIOCtrlDataSize < 0 || nIOCtrlDataSize > AV_MAX_IOCTRL_DATA_SIZE)
+		return AV_ER_EXCEED_MAX_SIZE;
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) == NULL) {
+		ret = AV_ER_INVALID_ARG;
+	} else if (a->error != 0) {
+		ret = a->error;
+	} else {
+		q = a->linked ? &gStubAv[a->peer].ioctrl_in : &a->ioctrl_out;
+		if (stub_push(q, nIOCtrlType, NULL, 0, cabIOCtrlData, nIOCtrlDataSize) < 0)
+			ret = AV_ER_MEM_INSUFF;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+int avSendIOCtrlExit(int nAVChannelID)
+{
+	int ret = AV_ER_INVALID_ARG;
+
+	pthread_mutex_lock(&gStubLock);
+	if (stub_av(nAVChannelID) != NULL) {
+		gStubAv[nAVChannelID].ioctrl_exits++;
+		ret = AV_ER_NoERROR;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+// A closed AV channel is no longer valid
+int avServGetResendSize(int avIndex, unsigned int *pnSize)
+{
+	int ret = AV_ER_INVALID_ARG;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(avIndex)) != NULL && a->error == 0) {
+		ret = a->resend_kb > 0 ? AV_ER_NoERROR : AV_ER_NOT_INITIALIZED;
+		if (a->resend_kb > 0)
+			*pnSize = a->resend_kb;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+// Takes the scripted time whatever Timeout_ms is, as if the client answered just then
+int avServResetBuffer(int avIndex, AV_RESET_TARGET eTarget, unsigned int Timeout_ms)
+{
+	struct timespec ts;
+	unsigned int delay_ms = 0;
+	int ret = AV_ER_INVALID_ARG;
+	StubAv *a;
+
+	(void)Timeout_ms;
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(avIndex)) != NULL && a->error == 0) {
+		ret = a->reset_set ? AV_ER_NoERROR : AV_ER_NOT_INITIALIZED;
+		delay_ms = a->reset_ms;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	if (ret != AV_ER_NoERROR)
+		return ret;
+
+	ts.tv_sec = delay_ms / 1000;
+	ts.tv_nsec = (long)(delay_ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+	pthread_mutex_lock(&gStubLock);
+	a->resend_usage = 0.0f;
+	a->resets++;
+	a->reset_target = (int)eTarget;
+	pthread_mutex_unlock(&gStubLock);
+	return AV_ER_NoERROR;
+}
+
+int avServSetDelayInterval(int nAVChannelID, unsigned short nPacketNum, unsigned short nDelayMs)
+{
+	StubAv *a;
+	int ret = AV_ER_INVALID_ARG;
+
+	(void)nDelayMs;
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) != NULL) {
+		a->delay_calls++;
+		a->delay_packets = nPacketNum;
+		ret = a->delay_result;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
+
+int avStatusCheck(int nAVChannelID, struct st_AvStatus *psAvStatus)
+{
+	int ret = AV_ER_NOT_INITIALIZED;
+	StubAv *a;
+
+	pthread_mutex_lock(&gStubLock);
+	if ((a = stub_av(nAVChannelID)) == NULL) {
+		ret = AV_ER_INVALID_ARG;
+	} else if (a->error != 0) {
+		ret = a->error;
+	} else if (a->status_set) {
+		*psAvStatus = a->status;
+		ret = AV_ER_NoERROR;
+	}
+	pthread_mutex_unlock(&gStubLock);
+	return ret;
+}
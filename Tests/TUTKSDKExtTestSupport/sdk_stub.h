@@ -0,0 +1,152 @@
+/*! \file sdk_stub.h
+Scripting of the SDK stand-ins in sdk_stub.c. A check sets up what the SDK
+should answer, runs the module under test and reads back what the module
+asked of the SDK. ext_stub_reset() forgets everything.
+ */
+
+#ifndef _SDK_STUB_H_
+#define _SDK_STUB_H_
+
+#include "IOTCAPIs.h"
+#include "AVAPIs.h"
+
+/** The AV channel IDs the stand-ins know, 0 to EXT_STUB_MAX_AV - 1 */
+#define EXT_STUB_MAX_AV		32
+
+/**
+ * The impairments of one direction of a link between two sessions. Losses
+ * follow a Gilbert-Elliott model: each packet may turn a good link bad or a
+ * bad one good, and is then lost with the loss of the state it found.
+ */
+typedef struct ExtStubLink
+{
+	unsigned int lossPermille; //!< The loss of a good link, in 1/1000
+	unsigned int burstLossPermille; //!< The loss of a bad link, in 1/1000
+	unsigned int enterBadPermille; //!< The chance per packet that a good link turns bad, 0 for no bursts
+	unsigned int leaveBadPermille; //!< The chance per packet that a bad link turns good
+	unsigned int delayMs; //!< The one way delay
+	unsigned int seed; //!< Seeds the losses, so a run can be repeated
+} ExtStubLink;
+
+/** Forget every device, session and AV channel */
+void ext_stub_reset(void);
+
+/** Answer IOTC_Check_Device_On_Line() for uid with result; unknown UIDs get #IOTC_ER_CAN_NOT_FIND_DEVICE */
+void ext_stub_set_online(const char *uid, int result);
+
+/** The number of IOTC_Check_Device_On_Line() calls for uid */
+unsigned int ext_stub_online_queries(const char *uid);
+
+/** Let IOTC_Session_Check_Ex() report session sid as connected to uid, and IOTC_Session_Write() take data */
+void ext_stub_session_open(int sid, const char *uid);
+
+/** Answer IOTC_Connect_ByUIDEx() to uid, on a SID of IOTC_Get_SessionID(), with result; the default fails */
+void ext_stub_set_connect(const char *uid, int result);
+
+/** The number of IOTC_Connect_ByUIDEx() calls for uid */
+unsigned int ext_stub_connects(const char *uid);
+
+/** Let IOTC_Session_Check_Ex() report session sid as closed */
+void ext_stub_session_close(int sid);
+
+/** Let session sid receive a packet before each IOTC_Session_Check_Ex(), or stop it */
+void ext_stub_session_traffic(int sid, int on);
+
+/** Answer IOTC_ReInitSocket() with result, #IOTC_ER_NoERROR until set */
+void ext_stub_set_reinit_result(int result);
+
+/**
+ * Is AV channel av started by avClientStartEx() and not stopped? The AV
+ * channel ID is the session ID; password gets the password it was started with.
+ */
+int ext_stub_av_started(int av, char *password, int password_max);
+
+/**
+ * The avClientSetMaxBufSize() in effect when AV channel av was started by
+ * avClientStartEx(), or the one in effect now if av is negative; 0 if never set
+ */
+unsigned int ext_stub_av_buf_size(int av);
+
+/** Answer avClientRecvBufUsageRate() on AV channel av with rate; until set it fails */
+void ext_stub_set_recv_usage(int av, float rate);
+
+/** Let every call on AV channel av fail with error from now on, 0 to open it again */
+void ext_stub_av_close(int av, int error);
+
+/** Queue an IO control for avRecvIOCtrl() on AV channel av */
+void ext_stub_ioctrl_push(int av, unsigned int type, const void *data, int size);
+
+/**
+ * Take the oldest IO control sent by avSendIOCtrl() on AV channel av.
+ * Returns its size, or -1 if there is none.
+ */
+int ext_stub_ioctrl_pop(int av, unsigned int *type, void *data, int max_size);
+
+/** Deliver the IO controls sent on AV channel a to avRecvIOCtrl() on b, and the other way round */
+void ext_stub_ioctrl_link(int a, int b);
+
+/** The number of avSendIOCtrlExit() calls on AV channel av */
+unsigned int ext_stub_ioctrl_exits(int av);
+
+/** Answer avStatusCheck() on AV channel av with status; until then it fails */
+void ext_stub_set_status(int av, const struct st_AvStatus *status);
+
+/** Answer avResendBufUsageRate() on AV channel av with rate, 0 until set */
+void ext_stub_set_resend_usage(int av, float rate);
+
+/** Answer avServGetResendSize() on AV channel av with size_kb; 0, the default, as if the SDK was not initialized */
+void ext_stub_set_resend_size(int av, unsigned int size_kb);
+
+/**
+ * Let avServResetBuffer() on AV channel av take delay_ms, then succeed and empty the
+ * resend buffer, so avResendBufUsageRate() answers 0; until set it fails
+ */
+void ext_stub_set_reset(int av, unsigned int delay_ms);
+
+/** The number of avServResetBuffer() calls on AV channel av which succeeded, and the target of the last one */
+unsigned int ext_stub_resets(int av, int *target);
+
+/**
+ * Queue a frame for avRecvFrameData2(), or for avRecvAudioData() if is_audio, on
+ * AV channel av. A video frame with expected_size above size is received as
+ * #AV_ER_INCOMPLETE_FRAME; 0 means size. Each kind is numbered from 0 in order.
+ */
+void ext_stub_recv_push(int av, int is_audio, const void *data, int size, int expected_size, const void *info,
+						int info_size);
+
+/** Let the next count avSendFrameData() calls on AV channel av fail with error */
+void ext_stub_send_fail(int av, int error, unsigned int count);
+
+/**
+ * Take the oldest frame sent on AV channel av by avSendFrameData() or avSendAudioData().
+ * Returns the size of its data, or -1 if there is none. *is_audio tells which it was,
+ * and info gets up to info_max bytes of its frame info; either may be NULL.
+ */
+int ext_stub_sent_pop(int av, int *is_audio, void *info, int info_max);
+
+/** The number of frames sent on AV channel av which were not taken yet */
+unsigned int ext_stub_sent_count(int av);
+
+/** Answer avServSetDelayInterval() on AV channel av with result, #AV_ER_NoERROR until set */
+void ext_stub_set_delay_result(int av, int result);
+
+/** The number of avServSetDelayInterval() calls on AV channel av, and the packets of the last one */
+unsigned int ext_stub_delay_calls(int av, unsigned short *packets);
+
+/**
+ * Deliver what IOTC_Session_Write() writes on session a to IOTC_Session_Read() on b,
+ * impaired by ab, and the other way round by ba; NULL for a clean link. Both sessions
+ * must be open. The IOTC channel is not looked at.
+ */
+void ext_stub_session_link(int a, int b, const ExtStubLink *ab, const ExtStubLink *ba);
+
+/** The packets the link of session sid lost on their way from it */
+unsigned int ext_stub_session_lost(int sid);
+
+/** The bytes IOTC_Session_Write() took on session sid */
+unsigned long long ext_stub_session_written(int sid);
+
+/** Let the next count IOTC_Session_Write() calls on session sid fail with error */
+void ext_stub_write_fail(int sid, int error, unsigned int count);
+
+#endif /* _SDK_STUB_H_ */
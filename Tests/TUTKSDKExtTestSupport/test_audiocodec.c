@@ -0,0 +1,114 @@
+/*! \file test_audiocodec.c
+Checks of the G.711 and resampler kernels, see AVAudioCodecAPIs.h.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "AVAudioCodecAPIs.h"
+#include "ext_test.h"
+
+#ifndef M_PI
+#define M_PI	3.14159265358979323846
+#endif
+
+static const AVAudioEngine gEngines[] = {
+	AV_AUDIO_ENGINE_PORTABLE, AV_AUDIO_ENGINE_SSE2, AV_AUDIO_ENGINE_NEON
+};
+
+#define ENGINE_COUNT	(int)(sizeof(gEngines) / sizeof(gEngines[0]))
+
+static int g711_check(void)
+{
+	static short pcm[65536], ref_pcm[256], out_pcm[256];
+	static unsigned char ref[65536], out[65536];
+	unsigned char codes[256];
+	short zero = 0;
+	int law, i, e;
+
+	for (i = 0; i < 65536; i++)
+		pcm[i] = (short)(i - 32768);
+	for (i = 0; i < 256; i++)
+		codes[i] = (unsigned char)i;
+
+	// Silence, and the ends of the code range, per G.711
+	EXT_CHECK(avG711Encode(AV_G711_ULAW, &zero, 1, out) == AV_ER_NoERROR && out[0] == 0xFF);
+	EXT_CHECK(avG711Encode(AV_G711_ALAW, &zero, 1, out) == AV_ER_NoERROR && out[0] == 0xD5);
+	avG711Decode(AV_G711_ULAW, codes, 256, out_pcm);
+	EXT_CHECK(out_pcm[0x00] == -32124 && out_pcm[0x80] == 32124 && out_pcm[0xFF] == 0 && out_pcm[0x7F] == 0);
+	avG711Decode(AV_G711_ALAW, codes, 256, out_pcm);
+	EXT_CHECK(out_pcm[0xD5] == 8 && out_pcm[0x55] == -8 && out_pcm[0xAA] == 32256 && out_pcm[0x2A] == -32256);
+
+	for (law = AV_G711_ULAW; law <= AV_G711_ALAW; law++) {
+		// Every code decodes to a sample which encodes back to it; mu-law has two zeros
+		EXT_CHECK(avG711Decode((AVG711Law)law, codes, 256, ref_pcm) == AV_ER_NoERROR);
+		EXT_CHECK(avG711Encode((AVG711Law)law, ref_pcm, 256, out) == AV_ER_NoERROR);
+		for (i = 0; i < 256; i++)
+			EXT_CHECK(out[i] == i || (law == AV_G711_ULAW && i == 0x7F && out[i] == 0xFF));
+
+		// Every engine agrees with the portable one on every sample and code
+		avAudioSetEngine(AV_AUDIO_ENGINE_PORTABLE);
+		avG711Encode((AVG711Law)law, pcm, 65536, ref);
+		for (e = 1; e < ENGINE_COUNT; e++) {
+			if (!avAudioEngineSupported(gEngines[e]))
+				continue;
+			avAudioSetEngine(gEngines[e]);
+			EXT_CHECK(avG711Encode((AVG711Law)law, pcm, 65536, out) == AV_ER_NoERROR);
+			EXT_CHECK(memcmp(out, ref, sizeof(ref)) == 0);
+			EXT_CHECK(avG711Decode((AVG711Law)law, codes, 256, out_pcm) == AV_ER_NoERROR);
+			EXT_CHECK(memcmp(out_pcm, ref_pcm, sizeof(ref_pcm)) == 0);
+		}
+		avAudioSetEngine(AV_AUDIO_ENGINE_AUTO);
+	}
+	return 0;
+}
+
+int ext_test_g711_round_trip(void)
+{
+	int ret = g711_check();
+
+	avAudioSetEngine(AV_AUDIO_ENGINE_AUTO);
+	return ret;
+}
+
+int ext_test_resampler_round_trip(void)
+{
+	static short in[8000], mid[16000 + 16], out[8000 + 16];
+	AVResampler up, down;
+	double best = -1.0;
+	int nmid = 0, nout = 0, i, k, lag;
+
+	for (i = 0; i < 8000; i++)
+		in[i] = (short)(10000.0 * sin(2.0 * M_PI * 1000.0 * i / 8000.0));
+	EXT_CHECK(avResamplerInit(&up, AV_RESAMPLE_8K_TO_16K) == AV_ER_NoERROR);
+	EXT_CHECK(avResamplerInit(&down, AV_RESAMPLE_16K_TO_8K) == AV_ER_NoERROR);
+
+	// Pieces of odd sizes, so the filter history is carried across calls
+	for (i = 0; i < 8000; i += k) {
+		k = 1 + (i * 7) % 333;
+		if (i + k > 8000)
+			k = 8000 - i;
+		nmid += avResample(&up, in + i, k, mid + nmid);
+	}
+	EXT_CHECK(nmid >= 16000 - 8 && nmid <= 16000);
+	for (i = 0; i < nmid; i += k) {
+		k = 1 + (i * 5) % 301;
+		if (i + k > nmid)
+			k = nmid - i;
+		nout += avResample(&down, mid + i, k, out + nout);
+	}
+	EXT_CHECK(nout >= 8000 - 8 && nout <= 8000);
+
+	// Both filters delay the signal by a few samples; compare at the best lag
+	for (lag = 0; lag < 8; lag++) {
+		double err = 0.0;
+		for (i = 100; i < 7000; i++) {
+			double d = (double)out[i + lag] - (double)in[i];
+			err += d * d;
+		}
+		if (best < 0.0 || err < best)
+			best = err;
+	}
+	EXT_CHECK(sqrt(best / 6900.0) < 300.0);	// 3% of the amplitude
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*! \file test_bufbudget.c
+Checks of receive buffer budgets, see AVBufBudgetAPIs.h. With a buffer
+time of 1 s a budget in KB is the bitrate in kbps divided by 8. The SDK
+stand-ins record the avClientSetMaxBufSize() each AV channel started with
+and answer avClientRecvBufUsageRate() as the check sets.
+ */
+
+#include <string.h>
+
+#include "AVBufBudgetAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define BUDGET_TOTAL_KB		1000
+#define BUDGET_MIN_KB		100
+#define BUDGET_MAX_KB		800
+#define BUDGET_CLIENT_KB	300
+#define BUDGET_MAIN			1		// Started, 200 KB
+#define BUDGET_THUMB		2		// Attached, 600 KB
+#define BUDGET_GRID			3		// Started, 800 KB
+#define BUDGET_LATE			4
+
+typedef struct BudgetLog {
+	int calls;
+	unsigned int kb[EXT_STUB_MAX_AV];
+} BudgetLog;
+
+// The manager thread calls back outside its lock, so the log outlives the check
+static BudgetLog gBudgetLog;
+
+static void __stdcall budget_changed(int nAVChannelID, unsigned int nBudgetKB, void *pUserData)
+{
+	BudgetLog *log = (BudgetLog *)pUserData;
+
+	__atomic_store_n(&log->kb[nAVChannelID], nBudgetKB, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&log->calls, 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int budget_reported(BudgetLog *log, int av)
+{
+	return __atomic_load_n(&log->kb[av], __ATOMIC_RELAXED);
+}
+
+static int budget_start(int sid, unsigned int kbps)
+{
+	AVClientStartInConfig in;
+	AVClientStartOutConfig out;
+
+	memset(&in, 0, sizeof(in));
+	memset(&out, 0, sizeof(out));
+	in.cb = sizeof(in);
+	in.iotc_session_id = (unsigned int)sid;
+	in.account_or_identity = "admin";
+	in.password_or_token = "secret";
+	out.cb = sizeof(out);
+	return avClientStartBudgeted(&in, &out, kbps, 0);
+}
+
+static int budget_share(BudgetLog *log)
+{
+	AVBufBudgetStats stats, before;
+	AVBufBudgetInfo info;
+	float pressure;
+
+	EXT_CHECK(avBufBudgetGetStats(&before) == AV_ER_NoERROR);
+
+	// Each AV channel starts with what it needs, while the cap has room
+	EXT_CHECK(budget_start(BUDGET_MAIN, 1600) == BUDGET_MAIN);
+	EXT_CHECK(ext_stub_av_buf_size(BUDGET_MAIN) == 200 && ext_stub_av_buf_size(-1) == BUDGET_CLIENT_KB);
+	EXT_CHECK(avBufBudgetAttach(BUDGET_THUMB, 4800, 0) == AV_ER_NoERROR);
+	EXT_CHECK(avBufBudgetAttach(BUDGET_THUMB, 4800, 0) == AV_ER_INVALID_ARG);
+	EXT_CHECK(budget_start(BUDGET_GRID, 6400) == BUDGET_GRID);
+	EXT_CHECK(ext_stub_av_buf_size(BUDGET_GRID) == BUDGET_TOTAL_KB - 800);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_MAIN, &info) == AV_ER_NoERROR);
+	EXT_CHECK(info.budgetKB == 200 && info.startKB == 200 && info.kbps == 1600 && info.weight == 1);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_THUMB, &info) == AV_ER_NoERROR && info.budgetKB == 600 && info.startKB == 0);
+
+	// Once the cap is taken a start is refused before the AV client starts
+	EXT_CHECK(avBufBudgetAttach(BUDGET_LATE, 100, 0) == AV_ER_EXCEED_MAX_SIZE);
+	EXT_CHECK(budget_start(BUDGET_LATE, 100) == AV_ER_EXCEED_MAX_SIZE && !ext_stub_av_started(BUDGET_LATE, NULL, 0));
+
+	// The manager cuts the demands to the cap: the small one is met, the others split the rest
+	EXT_CHECK(ext_test_wait_for(&log->calls, 2, 2000));
+	EXT_CHECK(budget_reported(log, BUDGET_THUMB) == 400 && budget_reported(log, BUDGET_GRID) == 400);
+	EXT_CHECK(avBufBudgetGetStats(&stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.channels == 3 && stats.totalKB == BUDGET_TOTAL_KB && stats.demandKB == 1600);
+	EXT_CHECK(stats.allocatedKB == BUDGET_TOTAL_KB && stats.changes == before.changes + 2);
+
+	// ... by weight
+	EXT_CHECK(avBufBudgetSetWeight(BUDGET_GRID, 3) == AV_ER_NoERROR);
+	EXT_CHECK(ext_test_wait_for(&log->calls, 4, 2000));
+	EXT_CHECK(budget_reported(log, BUDGET_THUMB) == 250 && budget_reported(log, BUDGET_GRID) == 550);
+
+	// A full receive buffer raises the budget, one in between keeps it, an empty one lowers it again
+	ext_stub_set_recv_usage(BUDGET_MAIN, 0.9f);
+	ext_test_sleep_ms(AV_BUFBUDGET_INTERVAL * 3);
+	ext_stub_set_recv_usage(BUDGET_MAIN, 0.5f);
+	ext_test_sleep_ms(AV_BUFBUDGET_INTERVAL * 3 / 2);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_MAIN, &info) == AV_ER_NoERROR);
+	EXT_CHECK(info.usage == 0.5f && info.pressure > 1.4f && info.budgetKB > 200);
+	pressure = info.pressure;
+	ext_stub_set_recv_usage(BUDGET_MAIN, 0.1f);
+	ext_test_sleep_ms(AV_BUFBUDGET_INTERVAL * 3);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_MAIN, &info) == AV_ER_NoERROR && info.pressure < pressure);
+
+	// Received frames replace the expected bitrate
+	avBufBudgetReceived(BUDGET_THUMB, 125000);
+	ext_test_sleep_ms(AV_BUFBUDGET_INTERVAL * 2);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_THUMB, &info) == AV_ER_NoERROR);
+	EXT_CHECK(info.kbps >= 500 && info.kbps <= 2000);
+
+	avBufBudgetDetach(BUDGET_MAIN);
+	avBufBudgetDetach(BUDGET_THUMB);
+	avBufBudgetDetach(BUDGET_GRID);
+	EXT_CHECK(avBufBudgetGetInfo(BUDGET_MAIN, &info) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avBufBudgetGetStats(&stats) == AV_ER_NoERROR && stats.channels == 0);
+	return 0;
+}
+
+/** Budgets started within a global cap, then shared by need and weight and moved by buffer usage */
+int ext_test_buf_budget_share(void)
+{
+	AVBufBudgetConfig config;
+	int ret;
+
+	ext_stub_reset();
+	memset(&gBudgetLog, 0, sizeof(gBudgetLog));
+	memset(&config, 0, sizeof(config));
+	EXT_CHECK(avBufBudgetSetup(&config, NULL, NULL) == AV_ER_INVALID_ARG);
+	config.cb = sizeof(config);
+	config.minKB = BUDGET_MAX_KB + 1;
+	config.maxKB = BUDGET_MAX_KB;
+	EXT_CHECK(avBufBudgetSetup(&config, NULL, NULL) == AV_ER_INVALID_ARG);
+	config.totalKB = BUDGET_TOTAL_KB;
+	config.minKB = BUDGET_MIN_KB;
+	config.bufferMs = 1000;
+	config.clientBufKB = BUDGET_CLIENT_KB;
+	EXT_CHECK(avBufBudgetSetup(&config, budget_changed, &gBudgetLog) == AV_ER_NoERROR);
+	ext_stub_session_open(BUDGET_MAIN, "BUDGETMAIN");
+	ext_stub_session_open(BUDGET_GRID, "BUDGETGRID");
+	ext_stub_session_open(BUDGET_LATE, "BUDGETLATE");
+	ret = budget_share(&gBudgetLog);
+
+	avBufBudgetDetach(BUDGET_MAIN);
+	avBufBudgetDetach(BUDGET_THUMB);
+	avBufBudgetDetach(BUDGET_GRID);
+	avBufBudgetSetup(NULL, NULL, NULL);
+	ext_stub_reset();
+	return ret;
+}
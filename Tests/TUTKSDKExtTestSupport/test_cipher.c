@@ -0,0 +1,113 @@
+/*! \file test_cipher.c
+Checks of the AES-128-CTR kernels, see IOTCCipherAPIs.h.
+ */
+
+#include <string.h>
+
+#include "IOTCCipherAPIs.h"
+#include "ext_test.h"
+
+// NIST SP 800-38A, F.5.1 CTR-AES128.Encrypt
+static const unsigned char gKey[IOTC_CIPHER_KEY_LENGTH] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const unsigned char gIV[IOTC_CIPHER_IV_LENGTH] = {
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+static const unsigned char gPlain[64] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+	0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+	0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+	0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+static const unsigned char gCipher[64] = {
+	0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+	0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+	0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+	0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+};
+
+static const IOTCCipherEngine gEngines[] = {
+	IOTC_CIPHER_ENGINE_PORTABLE, IOTC_CIPHER_ENGINE_AESNI, IOTC_CIPHER_ENGINE_ARMV8
+};
+
+#define ENGINE_COUNT	(int)(sizeof(gEngines) / sizeof(gEngines[0]))
+#define LONG_SIZE		5000
+
+static int cipher_ctr_vectors(void)
+{
+	unsigned char out[64];
+	IOTCCipherCtx *ctx;
+	unsigned int n;
+
+	EXT_CHECK(IOTC_Cipher_Create(gKey, &ctx) == IOTC_ER_NoERROR);
+	// CTR is a stream, so every prefix of the vector is a vector too
+	for (n = 1; n <= sizeof(gPlain); n++) {
+		EXT_CHECK(IOTC_Cipher_CTR(ctx, gIV, gPlain, out, n) == IOTC_ER_NoERROR);
+		EXT_CHECK(memcmp(out, gCipher, n) == 0);
+	}
+	// In place, and decrypting with the same call
+	memcpy(out, gCipher, sizeof(out));
+	EXT_CHECK(IOTC_Cipher_CTR(ctx, gIV, out, out, sizeof(out)) == IOTC_ER_NoERROR);
+	EXT_CHECK(memcmp(out, gPlain, sizeof(out)) == 0);
+	IOTC_Cipher_Delete(ctx);
+	return 0;
+}
+
+int ext_test_cipher_ctr_vectors(void)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < ENGINE_COUNT && ret == 0; i++) {
+		if (!IOTC_Cipher_Engine_Supported(gEngines[i]))
+			continue;
+		IOTC_Cipher_Set_Engine(gEngines[i]);
+		ret = cipher_ctr_vectors();
+	}
+	IOTC_Cipher_Set_Engine(IOTC_CIPHER_ENGINE_AUTO);
+	return ret;
+}
+
+/** Encrypt the long buffer and, from a counter about to carry into the upper 64 bits, two blocks. */
+static int cipher_run(const unsigned char *in, unsigned char *out, unsigned char *carry)
+{
+	unsigned char iv[IOTC_CIPHER_IV_LENGTH], zero[32];
+	IOTCCipherCtx *ctx;
+
+	EXT_CHECK(IOTC_Cipher_Create(gKey, &ctx) == IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Cipher_CTR(ctx, gIV, in, out, LONG_SIZE) == IOTC_ER_NoERROR);
+	memset(iv, 0, 8);
+	memset(iv + 8, 0xFF, 8);
+	memset(zero, 0, sizeof(zero));
+	EXT_CHECK(IOTC_Cipher_CTR(ctx, iv, zero, carry, sizeof(zero)) == IOTC_ER_NoERROR);
+	// The second block must use the counter incremented as one 128-bit number
+	memset(iv, 0, sizeof(iv));
+	iv[7] = 1;
+	EXT_CHECK(IOTC_Cipher_CTR(ctx, iv, zero, carry + 32, 16) == IOTC_ER_NoERROR);
+	EXT_CHECK(memcmp(carry + 16, carry + 32, 16) == 0);
+	IOTC_Cipher_Delete(ctx);
+	return 0;
+}
+
+int ext_test_cipher_engines_agree(void)
+{
+	static unsigned char in[LONG_SIZE], ref[LONG_SIZE], out[LONG_SIZE];
+	unsigned char ref_carry[48], carry[48];
+	unsigned int seed = 1, j;
+	int i, ret;
+
+	for (j = 0; j < LONG_SIZE; j++)
+		in[j] = (unsigned char)ext_test_rand(&seed);
+	IOTC_Cipher_Set_Engine(IOTC_CIPHER_ENGINE_PORTABLE);
+	ret = cipher_run(in, ref, ref_carry);
+	for (i = 1; i < ENGINE_COUNT && ret == 0; i++) {
+		if (!IOTC_Cipher_Engine_Supported(gEngines[i]))
+			continue;
+		IOTC_Cipher_Set_Engine(gEngines[i]);
+		ret = cipher_run(in, out, carry);
+		if (ret == 0 && (memcmp(out, ref, LONG_SIZE) != 0 || memcmp(carry, ref_carry, sizeof(carry)) != 0))
+			ret = __LINE__;
+	}
+	IOTC_Cipher_Set_Engine(IOTC_CIPHER_ENGINE_AUTO);
+	return ret;
+}
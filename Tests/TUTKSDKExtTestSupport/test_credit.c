@@ -0,0 +1,152 @@
+/*! \file test_credit.c
+Checks of the send credits, see IOTCCreditAPIs.h. The credit of a session
+comes from its pacer; the credit of an AV channel from the resend buffer
+the SDK stand-ins report, limited by the pacer it is attached to.
+ */
+
+#include <string.h>
+
+#include "IOTCCreditAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "ext_platform.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define CREDIT_SID			1
+#define CREDIT_CHANNEL		0
+#define CREDIT_AV			3
+#define CREDIT_RATE			100000
+#define CREDIT_BURST		10000
+#define CREDIT_RESEND_KB	100
+
+static char gCreditData[CREDIT_BURST];
+
+typedef struct CreditLog {
+	int calls;
+	int credit;
+} CreditLog;
+
+static void __stdcall credit_iotc_writable(int nIOTCSessionID, unsigned char nIOTCChannelID, int nCredit,
+										   void *pUserData)
+{
+	CreditLog *log = (CreditLog *)pUserData;
+
+	(void)nIOTCSessionID;
+	(void)nIOTCChannelID;
+	__atomic_store_n(&log->credit, nCredit, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&log->calls, 1, __ATOMIC_RELEASE);
+}
+
+static void __stdcall credit_av_writable(int nAVChannelID, int nCredit, void *pUserData)
+{
+	CreditLog *log = (CreditLog *)pUserData;
+
+	(void)nAVChannelID;
+	__atomic_store_n(&log->credit, nCredit, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&log->calls, 1, __ATOMIC_RELEASE);
+}
+
+static int credit_session(CreditLog *log)
+{
+	uint64_t start;
+	int credit;
+
+	EXT_CHECK(IOTC_Session_Get_Credit(CREDIT_SID, CREDIT_CHANNEL) == IOTC_ER_INVALID_SID);
+	EXT_CHECK(IOTC_Session_Set_Writable_Callback(CREDIT_SID, CREDIT_CHANNEL, 1, credit_iotc_writable, log) ==
+			  IOTC_ER_INVALID_SID);
+	EXT_CHECK(IOTC_Session_Pacer_Setup(CREDIT_SID, CREDIT_RATE, CREDIT_BURST) == IOTC_ER_NoERROR);
+
+	// A new bucket is full, a write empties it
+	EXT_CHECK(IOTC_Session_Get_Credit(CREDIT_SID, CREDIT_CHANNEL) == CREDIT_BURST);
+	EXT_CHECK(IOTC_Session_Write_Paced(CREDIT_SID, gCreditData, CREDIT_BURST, CREDIT_CHANNEL, NULL) == CREDIT_BURST);
+	EXT_CHECK(IOTC_Session_Wait_Writable(CREDIT_SID, CREDIT_CHANNEL, CREDIT_BURST / 2, 0) == IOTC_ER_TIMEOUT);
+
+	// Half the burst refills in 50 ms
+	start = ext_now_us();
+	credit = IOTC_Session_Wait_Writable(CREDIT_SID, CREDIT_CHANNEL, CREDIT_BURST / 2, 1000);
+	EXT_CHECK(credit >= CREDIT_BURST / 2 && credit < CREDIT_BURST);
+	EXT_CHECK(ext_now_us() - start >= 40000 && ext_now_us() - start < 500000);
+
+	// More than the burst waits for a full bucket only
+	credit = IOTC_Session_Wait_Writable(CREDIT_SID, CREDIT_CHANNEL, CREDIT_BURST * 10, 1000);
+	EXT_CHECK(credit == CREDIT_BURST);
+
+	// The callback is armed below the low water, and fires once on the way back up
+	EXT_CHECK(IOTC_Session_Write_Paced(CREDIT_SID, gCreditData, CREDIT_BURST, CREDIT_CHANNEL, NULL) == CREDIT_BURST);
+	EXT_CHECK(IOTC_Session_Set_Writable_Callback(CREDIT_SID, CREDIT_CHANNEL, CREDIT_BURST / 2, credit_iotc_writable,
+												 log) == IOTC_ER_NoERROR);
+	EXT_CHECK(ext_test_wait_for(&log->calls, 1, 1000));
+	EXT_CHECK(__atomic_load_n(&log->credit, __ATOMIC_RELAXED) >= CREDIT_BURST / 2);
+	ext_test_sleep_ms(150);
+	EXT_CHECK(__atomic_load_n(&log->calls, __ATOMIC_ACQUIRE) == 1);
+
+	// A credit below the low water arms it again
+	EXT_CHECK(IOTC_Session_Write_Paced(CREDIT_SID, gCreditData, CREDIT_BURST, CREDIT_CHANNEL, NULL) == CREDIT_BURST);
+	EXT_CHECK(IOTC_Session_Get_Credit(CREDIT_SID, CREDIT_CHANNEL) < CREDIT_BURST / 2);
+	EXT_CHECK(ext_test_wait_for(&log->calls, 2, 1000));
+	EXT_CHECK(IOTC_Session_Set_Writable_Callback(CREDIT_SID, CREDIT_CHANNEL, 0, NULL, NULL) == IOTC_ER_NoERROR);
+	return 0;
+}
+
+/** Session credits from the pacer bucket, waits for a refill, and an edge-triggered callback */
+int ext_test_credit_session(void)
+{
+	CreditLog log;
+	int ret;
+
+	ext_stub_reset();
+	memset(&log, 0, sizeof(log));
+	ext_stub_session_open(CREDIT_SID, "CREDIT");
+	ret = credit_session(&log);
+	IOTC_Session_Set_Writable_Callback(CREDIT_SID, CREDIT_CHANNEL, 0, NULL, NULL);
+	IOTC_Session_Pacer_Remove(CREDIT_SID);
+	ext_stub_reset();
+	return ret;
+}
+
+static int credit_av(CreditLog *log)
+{
+	int credit;
+
+	EXT_CHECK(avServGetCredit(CREDIT_AV) == AV_ER_NOT_SUPPORT);
+
+	// The free part of the resend buffer
+	ext_stub_set_resend_size(CREDIT_AV, CREDIT_RESEND_KB);
+	ext_stub_set_resend_usage(CREDIT_AV, 0.75f);
+	EXT_CHECK(avServGetCredit(CREDIT_AV) == CREDIT_RESEND_KB * 1024 / 4);
+	EXT_CHECK(avServWaitWritable(CREDIT_AV, CREDIT_RESEND_KB * 1024 / 2, 20) == AV_ER_TIMEOUT);
+
+	// The resend buffer is polled, so the callback fires once it drains
+	EXT_CHECK(avServSetWritableCallback(CREDIT_AV, CREDIT_RESEND_KB * 1024 / 2, credit_av_writable, log) ==
+			  AV_ER_NoERROR);
+	ext_test_sleep_ms(3 * IOTC_CREDIT_POLL_INTERVAL);
+	EXT_CHECK(__atomic_load_n(&log->calls, __ATOMIC_ACQUIRE) == 0);
+	ext_stub_set_resend_usage(CREDIT_AV, 0.25f);
+	EXT_CHECK(ext_test_wait_for(&log->calls, 1, 1000));
+	EXT_CHECK(__atomic_load_n(&log->credit, __ATOMIC_RELAXED) == CREDIT_RESEND_KB * 1024 * 3 / 4);
+
+	// A pacer limits it further
+	EXT_CHECK(IOTC_Session_Pacer_Setup(CREDIT_SID, CREDIT_RATE, CREDIT_BURST) == IOTC_ER_NoERROR);
+	EXT_CHECK(avServPacerAttach(CREDIT_AV, CREDIT_SID) == AV_ER_NoERROR);
+	EXT_CHECK(avServGetCredit(CREDIT_AV) == CREDIT_BURST);
+	credit = avServWaitWritable(CREDIT_AV, CREDIT_RESEND_KB * 1024, 1000);
+	EXT_CHECK(credit == CREDIT_BURST);
+	return 0;
+}
+
+/** AV channel credits from the resend buffer and the pacer, and a polled callback */
+int ext_test_credit_av(void)
+{
+	CreditLog log;
+	int ret;
+
+	ext_stub_reset();
+	memset(&log, 0, sizeof(log));
+	ext_stub_session_open(CREDIT_SID, "CREDIT");
+	ret = credit_av(&log);
+	avServSetWritableCallback(CREDIT_AV, 0, NULL, NULL);
+	avServPacerDetach(CREDIT_AV);
+	IOTC_Session_Pacer_Remove(CREDIT_SID);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,158 @@
+/*! \file test_dispatch.c
+Checks of the IO control dispatcher, see AVIOCtrlDispatchAPIs.h.
+ */
+
+#include <string.h>
+
+#include "AVIOCtrlDispatchAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define DISPATCH_CHANNELS	2
+#define DISPATCH_MESSAGES	200
+
+typedef struct DispatchLog {
+	int running[DISPATCH_CHANNELS]; // Handlers of each AV channel running now
+	unsigned int next[DISPATCH_CHANNELS]; // The sequence number expected next
+	int overlapped; // A handler ran while another of the same AV channel did
+	int out_of_order;
+	unsigned int types[3];
+} DispatchLog;
+
+static void __stdcall dispatch_sequence(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData,
+										int nDataSize, void *pUserData)
+{
+	DispatchLog *log = (DispatchLog *)pUserData;
+	unsigned int seq;
+
+	(void)nIOCtrlType;
+	if (__atomic_add_fetch(&log->running[nAVChannelID], 1, __ATOMIC_ACQ_REL) != 1)
+		__atomic_store_n(&log->overlapped, 1, __ATOMIC_RELAXED);
+	memcpy(&seq, cabData, sizeof(seq));
+	if (nDataSize != (int)sizeof(seq) || seq != log->next[nAVChannelID])
+		__atomic_store_n(&log->out_of_order, 1, __ATOMIC_RELAXED);
+	log->next[nAVChannelID] = seq + 1;
+	ext_test_sleep_ms(seq % 16 == 0 ? 1 : 0);
+	__atomic_sub_fetch(&log->running[nAVChannelID], 1, __ATOMIC_ACQ_REL);
+}
+
+static void __stdcall dispatch_record(int nAVChannelID, unsigned int nIOCtrlType, const char *cabData,
+									  int nDataSize, void *pUserData)
+{
+	DispatchLog *log = (DispatchLog *)pUserData;
+
+	(void)nAVChannelID;
+	(void)cabData;
+	(void)nDataSize;
+	if (nIOCtrlType == 0)
+		log->types[0]++;
+	else if (nIOCtrlType == 0xFFFFFFFFu)
+		log->types[1]++;
+	else
+		log->types[2]++;
+}
+
+/** Wait until the dispatcher has run count IO controls, and get its stats. */
+static int dispatch_wait(int id, unsigned int count, AVIOCtrlDispatchStats *stats)
+{
+	unsigned int waited;
+
+	for (waited = 0;; waited++) {
+		EXT_CHECK(avIOCtrlDispatchGetStats(id, stats) == AV_ER_NoERROR);
+		if (stats->handled + stats->unhandled + stats->rpc >= count && stats->queued == 0)
+			return 0;
+		EXT_CHECK(waited < 2000);
+		ext_test_sleep_ms(1);
+	}
+}
+
+static int dispatch_order(int id, DispatchLog *log)
+{
+	AVIOCtrlDispatchStats stats;
+	unsigned int i, seq;
+	int av, ret;
+
+	for (av = 0; av < DISPATCH_CHANNELS; av++)
+		EXT_CHECK(avIOCtrlDispatchAttach(id, av, log) == AV_ER_NoERROR);
+	EXT_CHECK(avIOCtrlDispatchAttach(id, 0, log) == AV_ER_INVALID_ARG);
+	for (i = 0; i < DISPATCH_MESSAGES; i++) {
+		for (av = 0; av < DISPATCH_CHANNELS; av++) {
+			seq = i;
+			ext_stub_ioctrl_push(av, AV_IOCTRL_USER(1 + i % 3), &seq, sizeof(seq));
+		}
+	}
+	ext_stub_ioctrl_push(0, AV_IOCTRL_USER(100), NULL, 0);
+	if ((ret = dispatch_wait(id, DISPATCH_CHANNELS * DISPATCH_MESSAGES + 1, &stats)) != 0)
+		return ret;
+	EXT_CHECK(stats.denseTable == 1 && stats.channels == DISPATCH_CHANNELS);
+	EXT_CHECK(stats.received == DISPATCH_CHANNELS * DISPATCH_MESSAGES + 1 && stats.dropped == 0);
+	EXT_CHECK(stats.handled == DISPATCH_CHANNELS * DISPATCH_MESSAGES && stats.unhandled == 1);
+	EXT_CHECK(!log->overlapped && !log->out_of_order);
+	EXT_CHECK(log->next[0] == DISPATCH_MESSAGES && log->next[1] == DISPATCH_MESSAGES);
+
+	// A closed AV channel is reported and no longer polled
+	ext_stub_av_close(1, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	for (i = 0; i < 2000 && stats.lastError == 0; i++) {
+		ext_test_sleep_ms(1);
+		EXT_CHECK(avIOCtrlDispatchGetStats(id, &stats) == AV_ER_NoERROR);
+	}
+	EXT_CHECK(stats.lastError == AV_ER_SESSION_CLOSE_BY_REMOTE);
+	avIOCtrlDispatchDetach(1);
+	EXT_CHECK(avIOCtrlDispatchGetStats(id, &stats) == AV_ER_NoERROR && stats.channels == 1);
+	return 0;
+}
+
+/** IO controls of two AV channels run in order, one at a time per channel */
+int ext_test_dispatch_order(void)
+{
+	static const AVIOCtrlHandler table[] = {
+		{ AV_IOCTRL_USER(1), dispatch_sequence },
+		{ AV_IOCTRL_USER(2), dispatch_sequence },
+		{ AV_IOCTRL_USER(3), dispatch_sequence },
+	};
+	AVIOCtrlDispatchConfig config;
+	DispatchLog log;
+	int id, ret;
+
+	ext_stub_reset();
+	memset(&log, 0, sizeof(log));
+	memset(&config, 0, sizeof(config));
+	config.cb = sizeof(config);
+	config.workers = 4;
+	config.maxQueue = DISPATCH_MESSAGES * 2;
+	config.maxIdleMs = 2;
+	EXT_CHECK((id = avIOCtrlDispatcherCreate(table, 3, &config)) >= 0);
+	ret = dispatch_order(id, &log);
+	avIOCtrlDispatcherDestroy(id);
+	ext_stub_reset();
+	return ret;
+}
+
+/** A table spanning every type is looked up by binary search */
+int ext_test_dispatch_wide_span(void)
+{
+	static const AVIOCtrlHandler table[] = {
+		{ 0, dispatch_record },
+		{ 0xFFFFFFFFu, dispatch_record },
+	};
+	AVIOCtrlDispatchStats stats;
+	DispatchLog log;
+	int id, ret;
+
+	ext_stub_reset();
+	memset(&log, 0, sizeof(log));
+	EXT_CHECK((id = avIOCtrlDispatcherCreate(table, 2, NULL)) >= 0);
+	EXT_CHECK(avIOCtrlDispatchAttach(id, 0, &log) == AV_ER_NoERROR);
+	ext_stub_ioctrl_push(0, 0xFFFFFFFFu, NULL, 0);
+	ext_stub_ioctrl_push(0, 0, NULL, 0);
+	ext_stub_ioctrl_push(0, 7, NULL, 0);
+	ret = dispatch_wait(id, 3, &stats);
+	avIOCtrlDispatcherDestroy(id);
+	ext_stub_reset();
+	if (ret != 0)
+		return ret;
+	EXT_CHECK(stats.denseTable == 0);
+	EXT_CHECK(stats.handled == 2 && stats.unhandled == 1);
+	EXT_CHECK(log.types[0] == 1 && log.types[1] == 1 && log.types[2] == 0);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*! \file test_fec.c
+Checks of the Reed-Solomon kernels of the FEC channels, see AVFecAPIs.h.
+ */
+
+#include <string.h>
+
+#include "AVFecAPIs.h"
+#include "ext_fec.h"
+#include "ext_test.h"
+
+#define FEC_K		10
+#define FEC_M		4
+#define FEC_LEN		100
+
+static const AVFecEngine gEngines[] = {
+	AV_FEC_ENGINE_PORTABLE, AV_FEC_ENGINE_SSSE3, AV_FEC_ENGINE_NEON
+};
+
+#define ENGINE_COUNT	(int)(sizeof(gEngines) / sizeof(gEngines[0]))
+
+typedef struct FecBlock {
+	unsigned char mem[FEC_K + FEC_M][FEC_LEN];
+	unsigned char *shards[FEC_K + FEC_M];
+} FecBlock;
+
+static void fec_block_init(FecBlock *b, unsigned int seed)
+{
+	int i, j;
+
+	for (i = 0; i < FEC_K + FEC_M; i++) {
+		b->shards[i] = b->mem[i];
+		for (j = 0; j < FEC_LEN; j++)
+			b->mem[i][j] = i < FEC_K ? (unsigned char)ext_test_rand(&seed) : 0;
+	}
+}
+
+static void fec_block_encode(FecBlock *b, AVFecEngine engine)
+{
+	ext_fec_encode(engine, (const unsigned char *const *)b->shards, FEC_K, b->shards + FEC_K, FEC_M, FEC_LEN);
+}
+
+int ext_test_fec_encode(void)
+{
+	static FecBlock ref, b;
+	int i, j;
+
+	fec_block_init(&ref, 7);
+	fec_block_encode(&ref, AV_FEC_ENGINE_PORTABLE);
+	for (j = 0; j < FEC_LEN; j++) {
+		unsigned char x = 0;
+		for (i = 0; i < FEC_K; i++)
+			x ^= ref.mem[i][j];
+		EXT_CHECK(ref.mem[FEC_K][j] == x);
+	}
+	for (i = 1; i < ENGINE_COUNT; i++) {
+		if (!avFecEngineSupported(gEngines[i]))
+			continue;
+		fec_block_init(&b, 7);
+		fec_block_encode(&b, gEngines[i]);
+		EXT_CHECK(memcmp(b.mem, ref.mem, sizeof(b.mem)) == 0);
+	}
+	return 0;
+}
+
+/** Lose the packets not in present, rebuild and compare with the original block. */
+static int fec_recover(AVFecEngine engine, const FecBlock *orig, const unsigned char *present, int lost)
+{
+	static FecBlock b;
+	int i, ret;
+
+	memcpy(b.mem, orig->mem, sizeof(b.mem));
+	for (i = 0; i < FEC_K + FEC_M; i++) {
+		b.shards[i] = b.mem[i];
+		if (!present[i])
+			memset(b.mem[i], 0xEE, FEC_LEN);
+	}
+	ret = ext_fec_decode(engine, b.shards, present, FEC_K, FEC_M, FEC_LEN);
+	if (lost > FEC_M) {
+		EXT_CHECK(ret < 0);
+		return 0;
+	}
+	EXT_CHECK(ret == 0);
+	EXT_CHECK(memcmp(b.mem, orig->mem, (size_t)FEC_K * FEC_LEN) == 0);
+	return 0;
+}
+
+int ext_test_fec_recover(void)
+{
+	static FecBlock orig;
+	unsigned char present[FEC_K + FEC_M];
+	unsigned int seed = 3;
+	int e, trial, lost, ret;
+
+	fec_block_init(&orig, 11);
+	fec_block_encode(&orig, AV_FEC_ENGINE_PORTABLE);
+	for (e = 0; e < ENGINE_COUNT; e++) {
+		if (!avFecEngineSupported(gEngines[e]))
+			continue;
+		// Every data packet lost alone, the first m data packets, then random patterns
+		for (trial = 0; trial < FEC_K + 1 + 200; trial++) {
+			memset(present, 1, sizeof(present));
+			if (trial < FEC_K) {
+				present[trial] = 0;
+				lost = 1;
+			} else if (trial == FEC_K) {
+				memset(present, 0, FEC_M);
+				lost = FEC_M;
+			} else {
+				int want = 1 + (int)(ext_test_rand(&seed) % (FEC_M + 1));
+				for (lost = 0; lost < want;) {
+					int x = (int)(ext_test_rand(&seed) % (FEC_K + FEC_M));
+					if (present[x]) {
+						present[x] = 0;
+						lost++;
+					}
+				}
+			}
+			ret = fec_recover(gEngines[e], &orig, present, lost);
+			if (ret != 0)
+				return ret;
+		}
+	}
+	return 0;
+}
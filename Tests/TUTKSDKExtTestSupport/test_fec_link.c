@@ -0,0 +1,242 @@
+/*! \file test_fec_link.c
+FEC channels over a loopback link simulator, see AVFecAPIs.h. The SDK
+stand-ins link two sessions with a one way delay and random or bursty
+loss; a sender on one session streams video frames, a receiver on the
+other takes them, and the harness counts the frames which never came and
+how long the others took from avFecSendFrame() to avFecRecvFrame().
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVFecAPIs.h"
+#include "ext_platform.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define LINK_SERVER_SID			4
+#define LINK_CLIENT_SID			5
+#define LINK_CHANNEL			3
+#define LINK_DELAY_MS			30
+#define LINK_KEY_SIZE			(60 * 1024)
+#define LINK_FRAME_SIZE			(8 * 1024)
+#define LINK_KEY_INTERVAL		30
+// How long the receiver keeps waiting after the last frame
+#define LINK_DRAIN_MS			(LINK_DELAY_MS + AV_FEC_DEFAULT_MAX_DELAY_RESEND + 200)
+
+// The frame info: the frame number and when it was sent
+typedef struct LinkInfo {
+	unsigned int seq;
+	unsigned long long sent_us;
+} LinkInfo;
+
+typedef struct LinkReceiver {
+	int id;
+	int stop;
+	unsigned int frames;
+	unsigned char *got; // Per frame number
+	unsigned int received;
+	unsigned int corrupt;
+	unsigned long long latency_sum_us;
+	unsigned long long latency_max_us;
+} LinkReceiver;
+
+static void link_fill(char *data, int size, unsigned int seq)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = (char)(seq * 131 + (unsigned int)i * 7);
+}
+
+static int link_frame_size(unsigned int seq)
+{
+	return seq % LINK_KEY_INTERVAL == 0 ? LINK_KEY_SIZE : LINK_FRAME_SIZE;
+}
+
+static void *link_receiver_thread(void *arg)
+{
+	LinkReceiver *r = (LinkReceiver *)arg;
+	char *want = (char *)malloc(LINK_KEY_SIZE);
+	unsigned long long latency;
+	AVFrame *f;
+	LinkInfo info;
+	int ret;
+
+	while (want != NULL && !__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		ret = avFecRecvFrame(r->id, &f, 20);
+		if (ret != AV_ER_NoERROR && ret != AV_ER_LOSED_THIS_FRAME)
+			continue;
+		latency = ext_now_us();
+		memcpy(&info, f->info, sizeof(info));
+		if (f->infoSize != (int)sizeof(info) || info.seq >= r->frames || r->got[info.seq]) {
+			r->corrupt++;
+		} else {
+			link_fill(want, link_frame_size(info.seq), info.seq);
+			if (f->dataSize != link_frame_size(info.seq) || memcmp(f->data, want, (size_t)f->dataSize) != 0)
+				r->corrupt++;
+			r->got[info.seq] = 1;
+			r->received++;
+			latency -= info.sent_us;
+			r->latency_sum_us += latency;
+			if (latency > r->latency_max_us)
+				r->latency_max_us = latency;
+		}
+		avFrameRelease(f);
+	}
+	free(want);
+	return NULL;
+}
+
+static int link_stream(int sender, unsigned int frames, unsigned int interval_ms)
+{
+	char *data = (char *)malloc(LINK_KEY_SIZE);
+	unsigned long long start = ext_now_us(), due;
+	unsigned int seq;
+	LinkInfo info;
+	int ret = AV_ER_NoERROR;
+
+	if (data == NULL)
+		return AV_ER_MEM_INSUFF;
+	for (seq = 0; seq < frames && ret == AV_ER_NoERROR; seq++) {
+		// Keep the frame rate steady however long a send takes
+		due = start + (unsigned long long)seq * interval_ms * 1000;
+		while (ext_now_us() < due)
+			ext_sleep_us((unsigned int)(due - ext_now_us()));
+		link_fill(data, link_frame_size(seq), seq);
+		memset(&info, 0, sizeof(info));
+		info.seq = seq;
+		info.sent_us = ext_now_us();
+		ret = avFecSendFrame(sender, data, link_frame_size(seq), &info, sizeof(info));
+	}
+	free(data);
+	return ret;
+}
+
+/** Stream frames over an FEC channel on a link with a 30 ms one way delay and
+ * the profile's loss, a 60 KB key frame every 30 frames and 8 KB frames between */
+int ext_fec_link_run(const ExtFecLinkProfile *profile, unsigned int frames, unsigned int interval_ms,
+					 ExtFecLinkResult *result)
+{
+	AVFecSenderStats sent;
+	AVFecConfig config;
+	ExtStubLink link;
+	LinkReceiver r;
+	pthread_t thread;
+	int sender, ret = 0;
+
+	memset(result, 0, sizeof(*result));
+	memset(&r, 0, sizeof(r));
+	memset(&link, 0, sizeof(link));
+	memset(&config, 0, sizeof(config));
+	link.lossPermille = profile->lossPermille;
+	link.burstLossPermille = profile->burstLossPermille;
+	link.enterBadPermille = profile->enterBadPermille;
+	link.leaveBadPermille = profile->leaveBadPermille;
+	link.delayMs = LINK_DELAY_MS;
+	link.seed = profile->seed;
+	config.cb = sizeof(config);
+	config.resend = profile->resend;
+	config.minRedundancy = AV_FEC_DEFAULT_MIN_REDUNDANCY;
+
+	ext_stub_reset();
+	ext_stub_session_open(LINK_SERVER_SID, "LINKSERVER");
+	ext_stub_session_open(LINK_CLIENT_SID, "LINKCLIENT");
+	ext_stub_session_link(LINK_SERVER_SID, LINK_CLIENT_SID, &link, &link);
+	r.frames = frames;
+	if ((r.got = (unsigned char *)calloc(frames, 1)) == NULL)
+		return __LINE__;
+	sender = avFecSenderCreate(LINK_SERVER_SID, LINK_CHANNEL, -1, &config);
+	r.id = avFecReceiverCreate(LINK_CLIENT_SID, LINK_CHANNEL, &config);
+	if (sender < 0 || r.id < 0 || pthread_create(&thread, NULL, link_receiver_thread, &r) != 0) {
+		avFecSenderDestroy(sender);
+		avFecReceiverDestroy(r.id);
+		free(r.got);
+		ext_stub_reset();
+		return __LINE__;
+	}
+
+	if (link_stream(sender, frames, interval_ms) != AV_ER_NoERROR)
+		ret = __LINE__;
+	ext_test_sleep_ms(LINK_DRAIN_MS);
+	__atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	if (avFecSenderGetStats(sender, &sent) != AV_ER_NoERROR)
+		ret = __LINE__;
+	avFecSenderDestroy(sender);
+	avFecReceiverDestroy(r.id);
+
+	result->framesSent = frames;
+	result->framesLost = frames - r.received;
+	result->framesCorrupt = r.corrupt;
+	result->packetsSent = sent.dataPackets + sent.parityPackets + sent.resentPackets;
+	result->packetsLost = ext_stub_session_lost(LINK_SERVER_SID);
+	result->parityPackets = sent.parityPackets;
+	result->resentPackets = sent.resentPackets;
+	result->avgLatencyMs = r.received > 0 ? (float)r.latency_sum_us / (float)r.received / 1000.0f : 0.0f;
+	result->maxLatencyMs = (float)r.latency_max_us / 1000.0f;
+	free(r.got);
+	ext_stub_reset();
+	return ret;
+}
+
+static const ExtFecLinkProfile gLinkProfiles[] = {
+	{ "0%", 0, 0, 0, 0, 0, 1 },
+	{ "2%", 20, 0, 0, 0, 0, 2 },
+	{ "5%", 50, 0, 0, 0, 0, 3 },
+	{ "10%", 100, 0, 0, 0, 0, 4 },
+	{ "bursty", 10, 500, 20, 250, 0, 5 },
+	{ "5%", 50, 0, 0, 0, 1, 6 },
+	{ "bursty", 10, 500, 20, 250, 1, 7 },
+};
+
+/** Print the frame loss and latency of every profile over 300 frames at 30 fps; takes over a minute */
+int ext_fec_link_table(void)
+{
+	ExtFecLinkResult res;
+	unsigned int i;
+	int ret;
+
+	printf("%-10s %-12s %8s %12s %12s %12s\n", "loss", "mode", "packets", "frames lost", "avg latency",
+		   "max latency");
+	for (i = 0; i < sizeof(gLinkProfiles) / sizeof(gLinkProfiles[0]); i++) {
+		if ((ret = ext_fec_link_run(&gLinkProfiles[i], 300, 33, &res)) != 0)
+			return ret;
+		printf("%-10s %-12s %7.1f%% %11.1f%% %9.1f ms %9.1f ms\n", gLinkProfiles[i].name,
+			   gLinkProfiles[i].resend ? "fec+resend" : "fec",
+			   res.packetsSent > 0 ? 100.0 * res.packetsLost / res.packetsSent : 0.0,
+			   100.0 * res.framesLost / res.framesSent, res.avgLatencyMs, res.maxLatencyMs);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/** Frames over a clean link, 5% random loss with parity, and bursty loss with resend */
+int ext_test_fec_link(void)
+{
+	ExtFecLinkResult res;
+	int ret;
+
+	// A clean link adds next to nothing to its delay
+	if ((ret = ext_fec_link_run(&gLinkProfiles[0], 60, 10, &res)) != 0)
+		return ret;
+	EXT_CHECK(res.framesLost == 0 && res.framesCorrupt == 0 && res.packetsLost == 0);
+	EXT_CHECK(res.avgLatencyMs >= LINK_DELAY_MS && res.avgLatencyMs < LINK_DELAY_MS + 30);
+
+	// Parity rebuilds nearly every frame at 5% random loss
+	if ((ret = ext_fec_link_run(&gLinkProfiles[2], 120, 10, &res)) != 0)
+		return ret;
+	EXT_CHECK(res.packetsLost > 0 && res.parityPackets > 0 && res.framesCorrupt == 0);
+	// Without parity about a third of the 8 KB frames would lose a packet
+	EXT_CHECK(res.framesLost * 100 <= res.framesSent * 6);
+
+	// Resend fills in what parity could not under bursts, at the cost of a round trip
+	if ((ret = ext_fec_link_run(&gLinkProfiles[6], 120, 10, &res)) != 0)
+		return ret;
+	EXT_CHECK(res.packetsLost > 0 && res.framesCorrupt == 0);
+	EXT_CHECK(res.framesLost * 100 <= res.framesSent * 3);
+	EXT_CHECK(res.maxLatencyMs < LINK_DELAY_MS + AV_FEC_DEFAULT_MAX_DELAY_RESEND + 50);
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*! \file test_frame.c
+Checks of the frame pool and reference counted frames, see AVFrameAPIs.h.
+The pool is process wide, so its statistics are compared before and after.
+ */
+
+#include <string.h>
+
+#include "AVFrameAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define FRAME_AV			4
+#define FRAME_INITIAL		(8 * 1024)
+#define FRAME_MAX_CACHED	(64 * 1024)
+#define FRAME_LARGE			20000
+#define FRAME_HELD			8
+
+static char gFrameData[FRAME_LARGE];
+
+static void __stdcall frame_unwrapped(char *pData, void *pUserData)
+{
+	*(char **)pUserData = pData;
+}
+
+/** Receive the next frame and check its data and info against what was queued. */
+static int frame_recv(int size, unsigned int index, AVFrame **frame)
+{
+	int ret;
+
+	EXT_CHECK((ret = avRecvFrameDataPooled(FRAME_AV, frame)) == size || ret == AV_ER_INCOMPLETE_FRAME);
+	EXT_CHECK(*frame != NULL && (*frame)->dataSize <= size && (*frame)->frameIndex == index);
+	EXT_CHECK(memcmp((*frame)->data, gFrameData, (size_t)(*frame)->dataSize) == 0);
+	EXT_CHECK((*frame)->infoSize == 4 && memcmp((*frame)->info, "info", 4) == 0);
+	return 0;
+}
+
+static int frame_pool(void)
+{
+	AVFramePoolStats before, stats;
+	AVFrame *f, *held[FRAME_HELD];
+	char *unwrapped = NULL;
+	int i, ret;
+
+	// Nothing to receive gives the buffer back at once
+	EXT_CHECK(avRecvFrameDataPooled(FRAME_AV, &f) == AV_ER_DATA_NOREADY && f == NULL);
+	avFramePoolTrim();
+	EXT_CHECK(avFramePoolGetStats(&before) == AV_ER_NoERROR && before.bytesCached == 0);
+
+	// A small frame lands in the class of the initial size, which is then reused
+	ext_stub_recv_push(FRAME_AV, 0, gFrameData, 3000, 0, "info", 4);
+	ext_stub_recv_push(FRAME_AV, 0, gFrameData, 3000, 0, "info", 4);
+	if ((ret = frame_recv(3000, 0, &f)) != 0)
+		return ret;
+	EXT_CHECK(f->capacity == FRAME_INITIAL && f->expectedSize == 3000);
+	avFrameRelease(f);
+	if ((ret = frame_recv(3000, 1, &f)) != 0)
+		return ret;
+	avFrameRelease(f);
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.getCount == before.getCount + 2 && stats.hitCount == before.hitCount + 1);
+	EXT_CHECK(stats.framesInUse == before.framesInUse);
+
+	// A frame too large for the channel's class is lost once, then the class grows
+	ext_stub_recv_push(FRAME_AV, 0, gFrameData, FRAME_LARGE, 0, "info", 4);
+	ext_stub_recv_push(FRAME_AV, 0, gFrameData, FRAME_LARGE, 0, "info", 4);
+	EXT_CHECK(avRecvFrameDataPooled(FRAME_AV, &f) == AV_ER_BUFPARA_MAXSIZE_INSUFF && f == NULL);
+	if ((ret = frame_recv(FRAME_LARGE, 3, &f)) != 0)
+		return ret;
+	EXT_CHECK(f->capacity == 32 * 1024);
+	avFrameRelease(f);
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR && stats.resizeCount == before.resizeCount + 1);
+
+	// An incomplete frame is handed over with what arrived of it
+	ext_stub_recv_push(FRAME_AV, 0, gFrameData, 1000, 2000, "info", 4);
+	if ((ret = frame_recv(1000, 4, &f)) != 0)
+		return ret;
+	EXT_CHECK(f->dataSize == 1000 && f->expectedSize == 2000);
+
+	// The buffer goes back with the last reference
+	EXT_CHECK(avFrameRetain(f) == f);
+	avFrameRelease(f);
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR && stats.framesInUse == before.framesInUse + 1);
+	avFrameRelease(f);
+
+	// Free buffers beyond the cache limit are freed
+	for (i = 0; i < FRAME_HELD; i++) {
+		ext_stub_recv_push(FRAME_AV, 0, gFrameData, 100, 0, "info", 4);
+		EXT_CHECK(avRecvFrameDataPooled(FRAME_AV, &held[i]) == 100);
+	}
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.framesInUse == before.framesInUse + FRAME_HELD);
+	EXT_CHECK(stats.framesInUseHighWater >= stats.framesInUse);
+	for (i = 0; i < FRAME_HELD; i++)
+		avFrameRelease(held[i]);
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.bytesCached <= FRAME_MAX_CACHED && stats.framesInUse == before.framesInUse);
+	avFramePoolTrim();
+	EXT_CHECK(avFramePoolGetStats(&stats) == AV_ER_NoERROR && stats.bytesCached == 0);
+
+	// A wrapped buffer is handed back by its callback
+	EXT_CHECK((f = avFrameWrap(gFrameData, 100, "info", 4, frame_unwrapped, &unwrapped)) != NULL);
+	EXT_CHECK(f->data == gFrameData && f->dataSize == 100 && f->infoSize == 4);
+	avFrameRetain(f);
+	avFrameRelease(f);
+	EXT_CHECK(unwrapped == NULL);
+	avFrameRelease(f);
+	EXT_CHECK(unwrapped == gFrameData);
+	EXT_CHECK(avFrameWrap(gFrameData, 100, "info", AV_FRAME_INFO_MAX_SIZE + 1, NULL, NULL) == NULL);
+	return 0;
+}
+
+/** Received frames drawn from size classes, reused, grown, cached up to a limit and wrapped */
+int ext_test_frame_pool(void)
+{
+	int i, ret;
+
+	ext_stub_reset();
+	for (i = 0; i < FRAME_LARGE; i++)
+		gFrameData[i] = (char)(i * 13);
+	avFramePoolResetChannel(FRAME_AV);
+	avFramePoolTrim();
+	avFramePoolSetup(FRAME_INITIAL, FRAME_MAX_CACHED);
+	ret = frame_pool();
+	avFramePoolSetup(0, 0);
+	avFramePoolResetChannel(FRAME_AV);
+	avFramePoolTrim();
+	ext_stub_reset();
+	return ret;
+}
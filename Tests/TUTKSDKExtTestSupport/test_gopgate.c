@@ -0,0 +1,90 @@
+/*! \file test_gopgate.c
+Checks of GOP gates, see AVGopGateAPIs.h. The SDK stand-ins report the
+resend buffer usage the check sets, and a flush by avServResetBuffer()
+takes a set time before it empties the resend buffer.
+ */
+
+#include <string.h>
+
+#include "AVGopGateAPIs.h"
+#include "ext_platform.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define GOP_AV				7
+#define GOP_HIGH			0.5f
+#define GOP_CRITICAL		0.8f
+#define GOP_FLUSH_MS		200
+
+static char gGopData[1000];
+
+static void __stdcall gop_key_requested(int nAVChannelID, void *pUserData)
+{
+	(void)nAVChannelID;
+	__atomic_add_fetch((int *)pUserData, 1, __ATOMIC_ACQ_REL);
+}
+
+/** Send a frame at the resend buffer usage */
+static int gop_send(float usage, int key)
+{
+	ext_stub_set_resend_usage(GOP_AV, usage);
+	return avSendFrameDataGop(GOP_AV, gGopData, sizeof(gGopData), NULL, 0, key);
+}
+
+static int gop_gate(const int *requests)
+{
+	AVGopGateStats stats;
+	uint64_t start;
+	int target;
+
+	EXT_CHECK(avGopGateAttach(GOP_AV, 0, 0, NULL, NULL) == AV_ER_INVALID_ARG);
+
+	// Frames pass while the resend buffer has room
+	EXT_CHECK(gop_send(0.1f, 1) == AV_ER_NoERROR && gop_send(0.1f, 0) == AV_ER_NoERROR);
+	EXT_CHECK(ext_stub_sent_count(GOP_AV) == 2);
+
+	// Above the high watermark the rest of the GOP is dropped, even once the buffer drains
+	EXT_CHECK(gop_send(0.6f, 0) == AV_ER_WAIT_KEY_FRAME && *requests == 1);
+	EXT_CHECK(gop_send(0.1f, 0) == AV_ER_WAIT_KEY_FRAME && *requests == 1);
+	EXT_CHECK(gop_send(0.1f, 1) == AV_ER_NoERROR && gop_send(0.1f, 0) == AV_ER_NoERROR);
+
+	// So is the rest of a GOP with a frame the SDK refused
+	ext_stub_send_fail(GOP_AV, AV_ER_MEM_INSUFF, 1);
+	EXT_CHECK(gop_send(0.1f, 0) == AV_ER_MEM_INSUFF && *requests == 2);
+	EXT_CHECK(gop_send(0.1f, 0) == AV_ER_WAIT_KEY_FRAME);
+	EXT_CHECK(avGopGateGetStats(GOP_AV, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.sentFrames == 4 && stats.droppedFrames == 3 && stats.skippedGops == 2);
+	EXT_CHECK(stats.keyFrameRequests == 2 && stats.flushCount == 0);
+
+	// Above the critical watermark the stale video is flushed, and the next keyframe waits for it
+	start = ext_now_us();
+	EXT_CHECK(gop_send(0.1f, 1) == AV_ER_NoERROR && gop_send(0.9f, 0) == AV_ER_WAIT_KEY_FRAME);
+	EXT_CHECK(ext_now_us() - start < GOP_FLUSH_MS * 1000 / 2);
+	EXT_CHECK(gop_send(0.9f, 1) == AV_ER_NoERROR && ext_now_us() - start >= GOP_FLUSH_MS * 1000 * 3 / 4);
+	EXT_CHECK(ext_stub_resets(GOP_AV, &target) == 1 && target == RESET_VIDEO);
+	EXT_CHECK(avGopGateGetStats(GOP_AV, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.flushCount == 1 && stats.keyFrameRequests == 3 && stats.lastUsage == 0.9f);
+	EXT_CHECK(ext_stub_sent_count(GOP_AV) == 6);
+
+	// Detaching waits for a flush in progress
+	EXT_CHECK(gop_send(0.95f, 0) == AV_ER_WAIT_KEY_FRAME);
+	avGopGateDetach(GOP_AV);
+	EXT_CHECK(ext_stub_resets(GOP_AV, NULL) == 2);
+	EXT_CHECK(gop_send(0.1f, 1) == AV_ER_INVALID_ARG && avGopGateGetStats(GOP_AV, &stats) == AV_ER_INVALID_ARG);
+	return 0;
+}
+
+/** GOPs cut short at the high watermark or after a lost frame, and the resend buffer flushed at the critical one */
+int ext_test_gop_gate(void)
+{
+	int requests = 0, ret;
+
+	ext_stub_reset();
+	ext_stub_set_reset(GOP_AV, GOP_FLUSH_MS);
+	EXT_CHECK(avGopGateAttach(GOP_AV, GOP_CRITICAL, GOP_HIGH, NULL, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avGopGateAttach(GOP_AV, GOP_HIGH, GOP_CRITICAL, gop_key_requested, &requests) == AV_ER_NoERROR);
+	ret = gop_gate(&requests);
+	avGopGateDetach(GOP_AV);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,162 @@
+/*! \file test_handover.c
+Checks of the network handover, see IOTCHandoverAPIs.h. The SDK stand-ins
+connect at once and hand out the lowest free SID, as the SDK does, so a
+reconnected session usually gets its old SID back; a session with traffic
+switched on answers on the new path.
+ */
+
+#include <string.h>
+
+#include "IOTCHandoverAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define HANDOVER_CAMERA		"HANDOVERCAMERA000001"
+#define HANDOVER_DOORBELL	"HANDOVERDOORBELL0001"
+#define HANDOVER_PASSWORD	"secret"
+#define HANDOVER_RATE		200000
+
+typedef struct HandoverEvent {
+	int handle;
+	int old_sid;
+	int new_sid;
+	int new_av;
+	int result;
+} HandoverEvent;
+
+typedef struct HandoverLog {
+	int count;
+	HandoverEvent events[8];
+} HandoverLog;
+
+static void __stdcall handover_changed(int nHandle, int nOldSID, int nNewSID, int nOldAVIndex, int nNewAVIndex,
+									   int nResult, unsigned int nInterruptMs, void *pUserData)
+{
+	HandoverLog *log = (HandoverLog *)pUserData;
+	HandoverEvent *e;
+	int n;
+
+	(void)nOldAVIndex;
+	(void)nInterruptMs;
+	// Reconnecting threads call in parallel
+	n = __atomic_fetch_add(&log->count, 1, __ATOMIC_ACQ_REL);
+	if (n >= 8)
+		return;
+	e = &log->events[n];
+	e->handle = nHandle;
+	e->old_sid = nOldSID;
+	e->new_sid = nNewSID;
+	e->new_av = nNewAVIndex;
+	e->result = nResult;
+}
+
+/** The event of handle in the log, or NULL */
+static const HandoverEvent *handover_event(const HandoverLog *log, int handle)
+{
+	int i;
+
+	for (i = 0; i < log->count && i < 8; i++) {
+		if (log->events[i].handle == handle)
+			return &log->events[i];
+	}
+	return NULL;
+}
+
+static int handover_changes(int camera, int doorbell, HandoverLog *log)
+{
+	const HandoverEvent *e;
+	IOTCHandoverInfo info;
+	IOTCPacerStats stats;
+	char password[16];
+	int camera_sid, doorbell_sid, av;
+
+	camera_sid = IOTC_Handover_Get_SID(camera);
+	doorbell_sid = IOTC_Handover_Get_SID(doorbell);
+	EXT_CHECK(camera_sid >= 0 && doorbell_sid >= 0 && camera_sid != doorbell_sid);
+	EXT_CHECK((av = IOTC_Handover_Get_AVIndex(camera)) >= 0 && ext_stub_av_started(av, NULL, 0));
+	EXT_CHECK(IOTC_Handover_Get_AVIndex(doorbell) == AV_ER_INVALID_ARG);
+	EXT_CHECK(IOTC_Session_Pacer_Setup(doorbell_sid, HANDOVER_RATE, 0) == IOTC_ER_NoERROR);
+
+	// The camera streams and survives, the silent doorbell is reconnected and keeps its pacer
+	ext_stub_session_traffic(camera_sid, 1);
+	EXT_CHECK(IOTC_Handover_Network_Changed(0) == 2);
+	EXT_CHECK(log->count == 2);
+	EXT_CHECK((e = handover_event(log, camera)) != NULL && e->new_sid == camera_sid && e->new_av == av);
+	EXT_CHECK((e = handover_event(log, doorbell)) != NULL && e->result == IOTC_ER_NoERROR && e->new_sid >= 0);
+	doorbell_sid = e->new_sid;
+	EXT_CHECK(IOTC_Handover_Get_SID(doorbell) == doorbell_sid);
+	EXT_CHECK(ext_stub_connects(HANDOVER_CAMERA) == 1 && ext_stub_connects(HANDOVER_DOORBELL) == 2);
+	EXT_CHECK(IOTC_Session_Pacer_Get_Stats(doorbell_sid, &stats) == IOTC_ER_NoERROR && stats.rate == HANDOVER_RATE);
+	EXT_CHECK(IOTC_Handover_Get_Info(camera, &info) == IOTC_ER_NoERROR);
+	EXT_CHECK(info.handoverCount == 1 && info.reconnectCount == 0);
+	EXT_CHECK(IOTC_Handover_Get_Info(doorbell, &info) == IOTC_ER_NoERROR);
+	EXT_CHECK(info.handoverCount == 1 && info.reconnectCount == 1 && info.sid == doorbell_sid);
+
+	// A reconnected AV client starts again with the saved password
+	ext_stub_session_traffic(camera_sid, 0);
+	ext_stub_set_connect(HANDOVER_DOORBELL, IOTC_ER_CAN_NOT_FIND_DEVICE);
+	log->count = 0;
+	EXT_CHECK(IOTC_Handover_Network_Changed(0) == 1);
+	EXT_CHECK((e = handover_event(log, camera)) != NULL && e->result == IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Handover_Get_AVIndex(camera) == e->new_av);
+	EXT_CHECK(ext_stub_av_started(e->new_av, password, sizeof(password)));
+	EXT_CHECK(strcmp(password, HANDOVER_PASSWORD) == 0);
+
+	// A failed reconnection is reported until the next change brings it back
+	EXT_CHECK((e = handover_event(log, doorbell)) != NULL && e->new_sid < 0);
+	EXT_CHECK(IOTC_Handover_Get_SID(doorbell) == IOTC_ER_CAN_NOT_FIND_DEVICE);
+	EXT_CHECK(IOTC_Handover_Get_Info(doorbell, &info) == IOTC_ER_NoERROR);
+	EXT_CHECK(info.reconnectCount == 2 && info.lastResult == IOTC_ER_CAN_NOT_FIND_DEVICE);
+	ext_stub_set_connect(HANDOVER_DOORBELL, IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Handover_Network_Changed(0) == 2);
+	EXT_CHECK(IOTC_Handover_Get_SID(doorbell) >= 0);
+
+	// A socket which cannot be reopened leaves the connections as they were
+	camera_sid = IOTC_Handover_Get_SID(camera);
+	ext_stub_set_reinit_result(IOTC_ER_NOT_INITIALIZED);
+	log->count = 0;
+	EXT_CHECK(IOTC_Handover_Network_Changed(0) == IOTC_ER_NOT_INITIALIZED);
+	EXT_CHECK(log->count == 0 && IOTC_Handover_Get_SID(camera) == camera_sid);
+	return 0;
+}
+
+/** Connections surviving and reconnected across network changes, with their state kept */
+int ext_test_handover_changes(void)
+{
+	AVClientStartInConfig av;
+	char password[16];
+	HandoverLog log;
+	int camera, doorbell, sid, av_index, ret;
+
+	ext_stub_reset();
+	memset(&log, 0, sizeof(log));
+	ext_stub_set_connect(HANDOVER_CAMERA, IOTC_ER_NoERROR);
+	ext_stub_set_connect(HANDOVER_DOORBELL, IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Handover_Connect("NOSUCHDEVICE", NULL, NULL, NULL) == IOTC_ER_CAN_NOT_FIND_DEVICE);
+
+	// The password is copied, so the buffer it came in can go
+	strcpy(password, HANDOVER_PASSWORD);
+	memset(&av, 0, sizeof(av));
+	av.cb = sizeof(av);
+	av.account_or_identity = "admin";
+	av.password_or_token = password;
+	camera = IOTC_Handover_Connect(HANDOVER_CAMERA, NULL, &av, NULL);
+	memset(password, 0, sizeof(password));
+	doorbell = IOTC_Handover_Connect(HANDOVER_DOORBELL, NULL, NULL, NULL);
+	IOTC_Handover_Set_Callback(handover_changed, &log);
+	ret = camera >= 0 && doorbell >= 0 ? handover_changes(camera, doorbell, &log) : __LINE__;
+	IOTC_Handover_Set_Callback(NULL, NULL);
+
+	// Closing stops the AV client and closes the session
+	sid = IOTC_Handover_Get_SID(camera);
+	av_index = IOTC_Handover_Get_AVIndex(camera);
+	IOTC_Session_Pacer_Remove(IOTC_Handover_Get_SID(doorbell));
+	IOTC_Handover_Close(camera);
+	IOTC_Handover_Close(doorbell);
+	if (ret == 0 && (IOTC_Handover_Get_SID(camera) != IOTC_ER_INVALID_ARG || ext_stub_av_started(av_index, NULL, 0) ||
+					 IOTC_Session_Write(sid, "x", 1, 0) != IOTC_ER_INVALID_SID))
+		ret = __LINE__;
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,175 @@
+/*! \file test_jitter.c
+Checks of jitter buffers, see AVJitterBufferAPIs.h. Each frame carries its
+timestamp as frame info. Frames are put in faster than real time, so the
+latest one sets the clock offset and the rest are due at once; only the
+first frame and the underrun depend on the playout delay.
+ */
+
+#include <string.h>
+
+#include "AVJitterBufferAPIs.h"
+#include "ext_platform.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define JITTER_MIN_DELAY	5
+#define JITTER_MAX_FRAMES	4
+#define JITTER_VIDEO_AV		5
+#define JITTER_AUDIO_AV		6
+
+static char gJitterData[1000];
+static int gJitterReleased;
+
+static void __stdcall jitter_released(char *pData, void *pUserData)
+{
+	(void)pData;
+	(void)pUserData;
+	__atomic_add_fetch(&gJitterReleased, 1, __ATOMIC_ACQ_REL);
+}
+
+static unsigned int __stdcall jitter_timestamp(const AVFrame *pFrame, void *pUserData)
+{
+	unsigned int ts;
+
+	(void)pUserData;
+	memcpy(&ts, pFrame->info, sizeof(ts));
+	return ts;
+}
+
+static int jitter_put(int jb, unsigned int ts)
+{
+	AVFrame *f = avFrameWrap(gJitterData, sizeof(gJitterData), &ts, sizeof(ts), jitter_released, NULL);
+
+	return f != NULL ? avJitterBufferPut(jb, f, ts) : AV_ER_MEM_INSUFF;
+}
+
+/** The timestamp of the next frame due within timeout_ms, or 0 if there is none */
+static unsigned int jitter_take(int jb, unsigned int timeout_ms)
+{
+	unsigned int ts;
+	AVFrame *f;
+
+	if (avJitterBufferWaitFrame(jb, &f, timeout_ms) != AV_ER_NoERROR)
+		return 0;
+	ts = jitter_timestamp(f, NULL);
+	avFrameRelease(f);
+	return ts;
+}
+
+static int jitter_playout(int jb)
+{
+	AVJitterBufferStats stats;
+	unsigned int wait, target;
+	AVFrame *f;
+	uint64_t start;
+
+	// The first frame waits for the playout delay
+	start = ext_now_us();
+	EXT_CHECK(jitter_put(jb, 1000) == AV_ER_NoERROR);
+	EXT_CHECK(avJitterBufferGetFrame(jb, &f, &wait) == AV_ER_DATA_NOREADY && f == NULL);
+	EXT_CHECK(wait > 0 && wait <= JITTER_MIN_DELAY);
+	EXT_CHECK(jitter_take(jb, 500) == 1000 && ext_now_us() - start >= (JITTER_MIN_DELAY - 1) * 1000);
+
+	// Frames come out in timestamp order, and one older than a played frame is dropped.
+	// 1020 is late too, as 1040 came before it, but is still played.
+	EXT_CHECK(jitter_put(jb, 1040) == AV_ER_NoERROR && jitter_put(jb, 1020) == AV_ER_NoERROR);
+	EXT_CHECK(jitter_take(jb, 500) == 1020 && jitter_take(jb, 500) == 1040);
+	EXT_CHECK(jitter_put(jb, 1030) == AV_ER_LOSED_THIS_FRAME);
+
+	// A full buffer drops its oldest frame
+	EXT_CHECK(jitter_put(jb, 1060) == AV_ER_NoERROR && jitter_put(jb, 1080) == AV_ER_NoERROR);
+	EXT_CHECK(jitter_put(jb, 1100) == AV_ER_NoERROR && jitter_put(jb, 1120) == AV_ER_NoERROR);
+	EXT_CHECK(jitter_put(jb, 1140) == AV_ER_NoERROR);
+	EXT_CHECK(avJitterBufferGetStats(jb, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.bufferedFrames == JITTER_MAX_FRAMES && stats.bufferedMs == 60);
+	EXT_CHECK(stats.lateCount == 2 && stats.dropCount == 2 && gJitterReleased == 5);
+	EXT_CHECK(jitter_take(jb, 500) == 1080 && jitter_take(jb, 500) == 1100);
+	EXT_CHECK(jitter_take(jb, 500) == 1120 && jitter_take(jb, 500) == 1140);
+
+	// Running empty while a frame is due raises the target delay
+	EXT_CHECK(avJitterBufferGetStats(jb, &stats) == AV_ER_NoERROR);
+	target = stats.targetDelayMs;
+	ext_test_sleep_ms(300);
+	EXT_CHECK(avJitterBufferGetFrame(jb, &f, &wait) == AV_ER_DATA_NOREADY && wait == AV_JITTER_WAIT_INFINITE);
+	EXT_CHECK(avJitterBufferGetStats(jb, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.underrunCount == 1 && stats.targetDelayMs >= target + 15);
+	EXT_CHECK(jitter_put(jb, 1160) == AV_ER_NoERROR && jitter_take(jb, 500) == 1160);
+	EXT_CHECK(avJitterBufferGetStats(jb, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.underrunMs >= 100 && stats.framesIn == 10 && stats.framesOut == 8);
+
+	// Frames still in the buffer go with it
+	EXT_CHECK(jitter_put(jb, 1180) == AV_ER_NoERROR);
+	return 0;
+}
+
+/** Frames played in timestamp order after the target delay, with late, overflow and underrun handling */
+int ext_test_jitter_playout(void)
+{
+	AVJitterBufferConfig config;
+	int jb, ret;
+
+	gJitterReleased = 0;
+	memset(&config, 0, sizeof(config));
+	config.cb = sizeof(config) - 1;
+	EXT_CHECK(avJitterBufferCreate(&config) == AV_ER_INVALID_ARG);
+	config.cb = sizeof(config);
+	config.minDelayMs = 100;
+	config.maxDelayMs = 50;
+	EXT_CHECK(avJitterBufferCreate(&config) == AV_ER_INVALID_ARG);
+	config.minDelayMs = JITTER_MIN_DELAY;
+	config.maxDelayMs = 500;
+	config.maxFrames = JITTER_MAX_FRAMES;
+	config.dropLate = 1;
+	jb = avJitterBufferCreate(&config);
+	ret = jb >= 0 ? jitter_playout(jb) : __LINE__;
+	avJitterBufferDestroy(jb);
+	if (ret == 0 && (gJitterReleased != 11 || jitter_put(jb, 0) != AV_ER_INVALID_ARG || gJitterReleased != 12))
+		ret = __LINE__;
+	return ret;
+}
+
+static int jitter_attach(int video, int audio)
+{
+	unsigned int ts;
+	AVFrame *f;
+
+	EXT_CHECK(avJitterBufferAttach(video, JITTER_VIDEO_AV, 0, NULL, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avJitterBufferAttach(video, JITTER_VIDEO_AV, 0, jitter_timestamp, NULL) == AV_ER_NoERROR);
+	EXT_CHECK(avJitterBufferAttach(video, JITTER_VIDEO_AV, 0, jitter_timestamp, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avJitterBufferAttach(audio, JITTER_AUDIO_AV, 1, jitter_timestamp, NULL) == AV_ER_NoERROR);
+
+	// Video and audio received by the threads come out of their own buffers in order
+	for (ts = 0; ts <= 80; ts += 40) {
+		ext_stub_recv_push(JITTER_VIDEO_AV, 0, gJitterData, 900, 0, &ts, sizeof(ts));
+		ext_stub_recv_push(JITTER_AUDIO_AV, 1, gJitterData, 160, 0, &ts, sizeof(ts));
+	}
+	for (ts = 0; ts <= 80; ts += 40) {
+		EXT_CHECK(avJitterBufferWaitFrame(video, &f, 1000) == AV_ER_NoERROR);
+		EXT_CHECK(jitter_timestamp(f, NULL) == ts && f->dataSize == 900 && f->frameIndex == ts / 40);
+		avFrameRelease(f);
+		EXT_CHECK(avJitterBufferWaitFrame(audio, &f, 1000) == AV_ER_NoERROR);
+		EXT_CHECK(jitter_timestamp(f, NULL) == ts && f->dataSize == 160);
+		EXT_CHECK(memcmp(f->data, gJitterData, 160) == 0);
+		avFrameRelease(f);
+	}
+	EXT_CHECK(avJitterBufferWaitFrame(video, &f, 50) == AV_ER_TIMEOUT && f == NULL);
+	return 0;
+}
+
+/** Jitter buffers fed by their own receive threads from a video and an audio channel */
+int ext_test_jitter_attach(void)
+{
+	int video, audio, i, ret;
+
+	ext_stub_reset();
+	for (i = 0; i < (int)sizeof(gJitterData); i++)
+		gJitterData[i] = (char)(i * 7);
+	video = avJitterBufferCreate(NULL);
+	audio = avJitterBufferCreate(NULL);
+	ret = video >= 0 && audio >= 0 ? jitter_attach(video, audio) : __LINE__;
+	avJitterBufferDestroy(video);
+	avJitterBufferDestroy(audio);
+	avFramePoolResetChannel(JITTER_VIDEO_AV);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,95 @@
+/*! \file test_nalscan.c
+Checks of the start code scanners, see AVNalScanAPIs.h.
+ */
+
+#include <string.h>
+
+#include "AVNalScanAPIs.h"
+#include "ext_test.h"
+
+static const AVNalEngine gEngines[] = {
+	AV_NAL_ENGINE_PORTABLE, AV_NAL_ENGINE_SSE2, AV_NAL_ENGINE_AVX2, AV_NAL_ENGINE_NEON
+};
+
+#define ENGINE_COUNT	(int)(sizeof(gEngines) / sizeof(gEngines[0]))
+#define MAX_UNITS		2048
+
+static int nal_scan_known(void)
+{
+	// SPS, PPS, IDR slice with trailing zeros, non-IDR slice
+	static const unsigned char h264[] = {
+		0, 0, 0, 1, 0x67, 1, 2, 0, 0, 1, 0x68, 5, 0, 0, 1, 0x65, 0x88, 0, 0, 0, 1, 0x41
+	};
+	// VPS, IDR_W_RADL slice
+	static const unsigned char h265[] = { 0, 0, 1, 0x40, 1, 0, 0, 1, 0x26, 1, 0xAF };
+	AVNalUnit u[8];
+	AVNalFrameInfo info;
+
+	EXT_CHECK(avNalScan(AV_NAL_CODEC_H264, h264, sizeof(h264), u, 8) == 4);
+	EXT_CHECK(u[0].offset == 4 && u[0].size == 3 && u[0].type == 7);
+	EXT_CHECK(u[1].offset == 10 && u[1].size == 2 && u[1].type == 8);
+	EXT_CHECK(u[2].offset == 15 && u[2].size == 2 && u[2].type == 5);
+	EXT_CHECK(u[3].offset == 21 && u[3].size == 1 && u[3].type == 1);
+	// Only nMaxUnits are filled, but all are counted
+	EXT_CHECK(avNalScan(AV_NAL_CODEC_H264, h264, sizeof(h264), u, 1) == 4);
+	EXT_CHECK(avNalClassify(AV_NAL_CODEC_H264, h264, sizeof(h264), &info) == AV_NAL_FRAME_KEY);
+	EXT_CHECK(info.sliceType == 5 && info.sliceOffset == 15 && info.hasParamSets);
+
+	EXT_CHECK(avNalScan(AV_NAL_CODEC_H265, h265, sizeof(h265), u, 8) == 2);
+	EXT_CHECK(u[0].offset == 3 && u[0].type == 32);
+	EXT_CHECK(u[1].offset == 8 && u[1].type == 19);
+	EXT_CHECK(avNalClassify(AV_NAL_CODEC_H265, h265, sizeof(h265), NULL) == AV_NAL_FRAME_KEY);
+	return 0;
+}
+
+int ext_test_nal_scan_known(void)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < ENGINE_COUNT && ret == 0; i++) {
+		if (!avNalEngineSupported(gEngines[i]))
+			continue;
+		avNalSetEngine(gEngines[i]);
+		ret = nal_scan_known();
+	}
+	avNalSetEngine(AV_NAL_ENGINE_AUTO);
+	return ret;
+}
+
+static int nal_scan_agree(void)
+{
+	static unsigned char buf[5000 + 64];
+	static AVNalUnit ref[MAX_UNITS], u[MAX_UNITS];
+	unsigned int seed = 5;
+	int trial, n, i, e, count, ref_count;
+
+	for (trial = 0; trial < 500; trial++) {
+		// Mostly zeros and ones, so start codes, near misses and runs of zeros are common,
+		// with sizes and offsets which do not line up with the vector width
+		n = 1 + (int)(ext_test_rand(&seed) % 5000);
+		for (i = 0; i < n; i++) {
+			unsigned int r = ext_test_rand(&seed) % 40;
+			buf[i] = r < 8 ? 0 : r == 8 ? 1 : (unsigned char)ext_test_rand(&seed);
+		}
+		avNalSetEngine(AV_NAL_ENGINE_PORTABLE);
+		ref_count = avNalScan(AV_NAL_CODEC_H264, buf, n, ref, MAX_UNITS);
+		EXT_CHECK(ref_count >= 0 && ref_count <= MAX_UNITS);
+		for (e = 1; e < ENGINE_COUNT; e++) {
+			if (!avNalEngineSupported(gEngines[e]))
+				continue;
+			avNalSetEngine(gEngines[e]);
+			count = avNalScan(AV_NAL_CODEC_H264, buf, n, u, MAX_UNITS);
+			EXT_CHECK(count == ref_count);
+			EXT_CHECK(memcmp(u, ref, (size_t)count * sizeof(AVNalUnit)) == 0);
+		}
+	}
+	return 0;
+}
+
+int ext_test_nal_scan_engines_agree(void)
+{
+	int ret = nal_scan_agree();
+
+	avNalSetEngine(AV_NAL_ENGINE_AUTO);
+	return ret;
+}
@@ -0,0 +1,168 @@
+/*! \file test_pacer.c
+Checks of the session pacer, see IOTCPacerAPIs.h.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "IOTCPacerAPIs.h"
+#include "ext_platform.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define PACER_SID			1
+#define PACER_AV			2
+#define PACER_WRITE			10000
+#define PACER_WRITES		20
+#define PACER_RATE			1000000
+#define PACER_SENDERS		2
+
+// The SDK packet interval for a rate, in packets per 5 ms
+#define PACER_PACKETS(rate)	((rate) * 5 / 1000 / IOTC_MAX_PACKET_SIZE > 0 ? (rate) * 5 / 1000 / IOTC_MAX_PACKET_SIZE : 1)
+
+static char gPacerData[PACER_WRITE];
+
+static int pacer_fixed_rate(void)
+{
+	IOTCPacerStats stats;
+	unsigned int wait_us, waited = 0;
+	uint64_t start, elapsed;
+	int i;
+
+	EXT_CHECK(IOTC_Session_Pacer_Setup(PACER_SID, PACER_RATE, PACER_WRITE) == IOTC_ER_NoERROR);
+	start = ext_now_us();
+	for (i = 0; i < PACER_WRITES; i++) {
+		EXT_CHECK(IOTC_Session_Write_Paced(PACER_SID, gPacerData, PACER_WRITE, 0, &wait_us) == PACER_WRITE);
+		waited += wait_us;
+	}
+	elapsed = ext_now_us() - start;
+
+	// The first write empties the bucket, each one after it waits for a refill
+	EXT_CHECK(elapsed >= (uint64_t)(PACER_WRITES - 1) * PACER_WRITE * 1000000 / PACER_RATE * 9 / 10);
+	EXT_CHECK(elapsed < 2000000);
+	EXT_CHECK(ext_stub_session_written(PACER_SID) == (unsigned long long)PACER_WRITES * PACER_WRITE);
+	EXT_CHECK(IOTC_Session_Pacer_Get_Stats(PACER_SID, &stats) == IOTC_ER_NoERROR);
+	EXT_CHECK(stats.rate == PACER_RATE && stats.burst == PACER_WRITE && !stats.isAutoRate);
+	EXT_CHECK(stats.sentBytes == (unsigned long long)PACER_WRITES * PACER_WRITE);
+	EXT_CHECK(stats.sendCount == PACER_WRITES && stats.pacedCount >= PACER_WRITES - 2);
+	EXT_CHECK(stats.totalWaitUs >= waited / 2);
+
+	// A failed write gives its bytes back, so the next one need not wait
+	ext_stub_write_fail(PACER_SID, IOTC_ER_INVALID_SID, 1);
+	ext_test_sleep_ms(20);
+	EXT_CHECK(IOTC_Session_Write_Paced(PACER_SID, gPacerData, PACER_WRITE, 0, &wait_us) == IOTC_ER_INVALID_SID);
+	EXT_CHECK(IOTC_Session_Write_Paced(PACER_SID, gPacerData, PACER_WRITE, 0, &wait_us) == PACER_WRITE);
+	EXT_CHECK(wait_us < 5000);
+	return 0;
+}
+
+/** A fixed rate spaces the writes out, and a failed write is refunded */
+int ext_test_pacer_fixed_rate(void)
+{
+	int ret;
+
+	ext_stub_reset();
+	ext_stub_session_open(PACER_SID, "PACED");
+	ret = pacer_fixed_rate();
+	IOTC_Session_Pacer_Remove(PACER_SID);
+	ext_stub_reset();
+	return ret;
+}
+
+static int pacer_auto_rate(void)
+{
+	IOTCPacerStats stats;
+	unsigned short packets;
+	unsigned int wait_us;
+
+	EXT_CHECK(IOTC_Session_Pacer_Setup(PACER_SID, 0, 0) == IOTC_ER_NoERROR);
+	EXT_CHECK(avServPacerAttach(PACER_AV, PACER_SID) == AV_ER_NoERROR);
+
+	// A full socket queue is retried, and backs the rate off once per guard interval
+	ext_stub_send_fail(PACER_AV, AV_ER_SOCKET_QUEUE_FULL, 2);
+	EXT_CHECK(avSendFrameDataPaced(PACER_AV, gPacerData, 1000, NULL, 0, &wait_us) == AV_ER_NoERROR);
+	EXT_CHECK(ext_stub_sent_count(PACER_AV) == 1);
+	EXT_CHECK(IOTC_Session_Pacer_Get_Stats(PACER_SID, &stats) == IOTC_ER_NoERROR);
+	EXT_CHECK(stats.isAutoRate && stats.queueFullCount == 2);
+	EXT_CHECK(stats.rate == IOTC_PACER_AUTO_INITIAL_RATE * 3 / 4);
+
+	// The packet interval follows the rate, and is not set again for a small change
+	EXT_CHECK(ext_stub_delay_calls(PACER_AV, &packets) == 1);
+	EXT_CHECK(packets == PACER_PACKETS(IOTC_PACER_AUTO_INITIAL_RATE));
+	EXT_CHECK(avSendFrameDataPaced(PACER_AV, gPacerData, 1000, NULL, 0, &wait_us) == AV_ER_NoERROR);
+	EXT_CHECK(ext_stub_delay_calls(PACER_AV, &packets) == 2);
+	EXT_CHECK(packets == PACER_PACKETS(IOTC_PACER_AUTO_INITIAL_RATE * 3 / 4));
+	EXT_CHECK(avSendFrameDataPaced(PACER_AV, gPacerData, 1000, NULL, 0, &wait_us) == AV_ER_NoERROR);
+	EXT_CHECK(ext_stub_delay_calls(PACER_AV, NULL) == 2);
+
+	// An SDK without the delay interval is not asked again
+	avServPacerDetach(PACER_AV);
+	EXT_CHECK(avServPacerAttach(PACER_AV, PACER_SID) == AV_ER_NoERROR);
+	ext_stub_set_delay_result(PACER_AV, AV_ER_NOT_SUPPORT);
+	EXT_CHECK(avSendFrameDataPaced(PACER_AV, gPacerData, 1000, NULL, 0, &wait_us) == AV_ER_NoERROR);
+	EXT_CHECK(IOTC_Session_Pacer_Setup(PACER_SID, IOTC_PACER_AUTO_MIN_RATE, 0) == IOTC_ER_NoERROR);
+	EXT_CHECK(avSendFrameDataPaced(PACER_AV, gPacerData, 1000, NULL, 0, &wait_us) == AV_ER_NoERROR);
+	EXT_CHECK(ext_stub_delay_calls(PACER_AV, NULL) == 3);
+	return 0;
+}
+
+/** Congestion backs an auto rate off, and the SDK packet interval follows the rate */
+int ext_test_pacer_auto_rate(void)
+{
+	int ret;
+
+	ext_stub_reset();
+	ext_stub_session_open(PACER_SID, "PACED");
+	ret = pacer_auto_rate();
+	avServPacerDetach(PACER_AV);
+	IOTC_Session_Pacer_Remove(PACER_SID);
+	ext_stub_reset();
+	return ret;
+}
+
+static void *pacer_sender(void *arg)
+{
+	int i, *failed = (int *)arg;
+
+	for (i = 0; i < 200; i++) {
+		if (avSendFrameDataPaced(PACER_AV, gPacerData, 100, NULL, 0, NULL) != AV_ER_NoERROR)
+			__atomic_store_n(failed, 1, __ATOMIC_RELAXED);
+		if (i % 2 == 0)
+			avSendAudioDataPaced(PACER_AV, gPacerData, 50, NULL, 0);
+	}
+	return NULL;
+}
+
+/** Threads sending on one AV channel share its pacer while the rate changes */
+int ext_test_pacer_shared(void)
+{
+	pthread_t senders[PACER_SENDERS];
+	IOTCPacerStats stats;
+	int started = 0, failed = 0, ret = 0, i;
+
+	ext_stub_reset();
+	ext_stub_session_open(PACER_SID, "PACED");
+	if (IOTC_Session_Pacer_Setup(PACER_SID, 0, 0) != IOTC_ER_NoERROR ||
+		avServPacerAttach(PACER_AV, PACER_SID) != AV_ER_NoERROR)
+		ret = __LINE__;
+	for (; ret == 0 && started < PACER_SENDERS; started++) {
+		if (pthread_create(&senders[started], NULL, pacer_sender, &failed) != 0) {
+			ret = __LINE__;
+			break;
+		}
+	}
+	for (i = 0; ret == 0 && i < 20; i++) {
+		IOTC_Session_Pacer_Setup(PACER_SID, i % 2 ? IOTC_PACER_AUTO_MIN_RATE : IOTC_PACER_AUTO_MAX_RATE, 0);
+		ext_test_sleep_ms(1);
+	}
+	while (started > 0)
+		pthread_join(senders[--started], NULL);
+	if (ret == 0 && (IOTC_Session_Pacer_Get_Stats(PACER_SID, &stats) != IOTC_ER_NoERROR ||
+					 stats.sendCount != PACER_SENDERS * 300 || failed))
+		ret = __LINE__;
+	avServPacerDetach(PACER_AV);
+	IOTC_Session_Pacer_Remove(PACER_SID);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,162 @@
+/*! \file test_playback.c
+Checks of the playback index, see AVPlaybackAPIs.h. The recorder writes a
+recording of 1 MB segments with a keyframe every 30 frames, and random
+seeks on a freshly opened index are checked against the keyframe they
+must find and timed.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "AVPlaybackAPIs.h"
+#include "ext_platform.h"
+#include "ext_test.h"
+
+#define PB_FRAME_SIZE		8000
+#define PB_FRAME_MS			40
+#define PB_KEY_INTERVAL		30
+#define PB_START_MS			1000000ULL
+#define PB_SEEKS			200
+
+static void pb_remove_dir(const char *dir)
+{
+	char path[512];
+	struct dirent *e;
+	DIR *d;
+
+	if ((d = opendir(dir)) != NULL) {
+		while ((e = readdir(d)) != NULL) {
+			if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+}
+
+/** Record frames until the recorder has started segments + 1 segments. */
+static int pb_record(const char *dir, unsigned int segments, ExtPlaybackSeekResult *result)
+{
+	static char buf[PB_FRAME_SIZE];
+	AVRecorderConfig config;
+	AVRecorderStats st;
+	unsigned int i;
+	int id, ret = 0;
+
+	memset(&st, 0, sizeof(st));
+	memset(&config, 0, sizeof(config));
+	config.cb = sizeof(config);
+	config.pszDirectory = dir;
+	config.pszPrefix = "pb";
+	config.segmentSize = AV_REC_MIN_SEGMENT_SIZE;
+	EXT_CHECK((id = avRecorderCreate(&config)) >= 0);
+	for (i = 0; ret == 0; i++) {
+		memset(buf, (int)i, sizeof(buf));
+		if (avRecorderWrite(id, buf, sizeof(buf), NULL, 0, PB_START_MS + (unsigned long long)i * PB_FRAME_MS,
+							i % PB_KEY_INTERVAL == 0) != AV_ER_NoERROR)
+			ret = __LINE__;
+		else if (i % 16 == 0 && (avRecorderGetStats(id, &st) != AV_ER_NoERROR || st.currentSegment >= segments))
+			break;
+	}
+	avRecorderClose(id);
+	result->frames = i + 1;
+	result->segments = st.segments;
+	return ret;
+}
+
+/** Seek to random times on a freshly opened index, and check each against the keyframe it must find. */
+static int pb_seek(const char *dir, unsigned int frames, ExtPlaybackSeekResult *result)
+{
+	unsigned long long start, end, t, want, begin, took, sum = 0;
+	unsigned int seed = 41, i;
+	AVPlaybackPosition pos;
+	int id, ret = 0;
+
+	begin = ext_now_us();
+	EXT_CHECK((id = avPlaybackIndexOpen(dir, "pb")) >= 0);
+	result->openMs = (float)(ext_now_us() - begin) / 1000.0f;
+	if (avPlaybackIndexGetRange(id, &start, &end) != AV_ER_NoERROR || start != PB_START_MS ||
+		end != PB_START_MS + (unsigned long long)(frames - 1) * PB_FRAME_MS)
+		ret = __LINE__;
+	for (i = 0; ret == 0 && i < PB_SEEKS; i++) {
+		t = start + (unsigned long long)ext_test_rand(&seed) % (end - start + 1);
+		want = start + (t - start) / (PB_FRAME_MS * PB_KEY_INTERVAL) * (PB_FRAME_MS * PB_KEY_INTERVAL);
+		begin = ext_now_us();
+		if (avPlaybackIndexSeek(id, t, &pos) != AV_ER_NoERROR || pos.timeMs != want)
+			ret = __LINE__;
+		took = ext_now_us() - begin;
+		sum += took;
+		if (took > result->seekMaxUs)
+			result->seekMaxUs = took;
+	}
+	result->seekAvgUs = sum / PB_SEEKS;
+
+	// A time on a keyframe finds that keyframe, a time just before it the one before
+	for (i = 1; ret == 0 && i < 8; i++) {
+		want = start + (unsigned long long)(frames / PB_KEY_INTERVAL * i / 8) * PB_FRAME_MS * PB_KEY_INTERVAL;
+		if (avPlaybackIndexSeek(id, want, &pos) != AV_ER_NoERROR || pos.timeMs != want ||
+			avPlaybackIndexSeek(id, want - 1, &pos) != AV_ER_NoERROR ||
+			pos.timeMs != want - PB_FRAME_MS * PB_KEY_INTERVAL)
+			ret = __LINE__;
+	}
+
+	// Before the recording plays from its first keyframe, after it there is nothing
+	if (ret == 0 && (avPlaybackIndexSeek(id, 0, &pos) != AV_ER_NoERROR || pos.timeMs != start || pos.segmentNo != 0))
+		ret = __LINE__;
+	if (ret == 0 && avPlaybackIndexSeek(id, end + 1, &pos) != AV_ER_DATA_NOREADY)
+		ret = __LINE__;
+	avPlaybackIndexClose(id);
+	return ret;
+}
+
+/** Record about segments segments of 1 MB, then time opening the index and random seeks on it */
+int ext_playback_seek_run(unsigned int segments, ExtPlaybackSeekResult *result)
+{
+	char dir[] = "/tmp/avpbXXXXXX";
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+	EXT_CHECK(mkdtemp(dir) != NULL);
+	if ((ret = pb_record(dir, segments, result)) == 0)
+		ret = pb_seek(dir, result->frames, result);
+	pb_remove_dir(dir);
+	return ret;
+}
+
+/** Print the open and seek latency of recordings of 20 and 200 segments */
+int ext_playback_seek_table(void)
+{
+	static const unsigned int sizes[] = { 20, 200 };
+	ExtPlaybackSeekResult res;
+	unsigned int i;
+	int ret;
+
+	printf("%8s %8s %10s %12s %12s\n", "segments", "frames", "open", "seek avg", "seek max");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if ((ret = ext_playback_seek_run(sizes[i], &res)) != 0)
+			return ret;
+		printf("%8u %8u %7.1f ms %9llu us %9llu us\n", res.segments, res.frames, res.openMs, res.seekAvgUs,
+			   res.seekMaxUs);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/** Random seeks over 20 segments find the last keyframe before the time, quickly */
+int ext_test_playback_seek(void)
+{
+	ExtPlaybackSeekResult res;
+	int ret;
+
+	if ((ret = ext_playback_seek_run(20, &res)) != 0)
+		return ret;
+	// Bounds loose enough for sanitizers and a busy machine
+	EXT_CHECK(res.openMs < 1000.0f);
+	EXT_CHECK(res.seekMaxUs < 100000);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*! \file test_preroll.c
+Checks of pre-roll buffers, see AVPreRollAPIs.h. Frame i is 500 bytes of
+the value i with i as frame info, 100 ms after frame i - 1, and every fifth
+frame is a keyframe. The contract allows 2 s of pre-roll, so the buffer
+holds 46 frames of 504 bytes each.
+ */
+
+#include <string.h>
+
+#include "AVPreRollAPIs.h"
+#include "ext_test.h"
+
+#define PR_FRAME_SIZE		500
+#define PR_FRAME_MS			100
+#define PR_GOP				5
+#define PR_WINDOW_MS		2000
+#define PR_CAPACITY_FRAMES	46		// 10 fps for 2 s plus a 1 s GOP, with headroom
+#define PR_CAPACITY_BYTES	45000	// 80 kbps for the same
+#define PR_HELD				25		// Frames 15 to 39 after the first 40
+
+static char gPrBig[PR_CAPACITY_BYTES + 1];
+
+static int pr_write(int id, int i)
+{
+	char data[PR_FRAME_SIZE];
+
+	memset(data, i, sizeof(data));
+	return avPreRollWrite(id, data, sizeof(data), &i, sizeof(i), (unsigned long long)i * PR_FRAME_MS,
+						  i % PR_GOP == 0);
+}
+
+/** Does the clip hold whole frames first to last, starting on a keyframe? */
+static int pr_clip_valid(const AVPreRollClip *clip, int first, int last)
+{
+	const AVPreRollFrame *f;
+	unsigned int k;
+	int i;
+
+	if (clip->frameCount != (unsigned int)(last - first + 1) || !clip->frames[0].bKeyFrame ||
+		clip->startTimeMs != (unsigned long long)first * PR_FRAME_MS ||
+		clip->endTimeMs != (unsigned long long)last * PR_FRAME_MS ||
+		clip->totalBytes != clip->frameCount * PR_FRAME_SIZE)
+		return 0;
+	for (k = 0; k < clip->frameCount; k++) {
+		f = &clip->frames[k];
+		if (f->size != PR_FRAME_SIZE || f->infoSize != sizeof(i))
+			return 0;
+		memcpy(&i, f->info, sizeof(i));
+		if (i != first + (int)k || f->data[0] != (char)i || f->data[PR_FRAME_SIZE - 1] != (char)i)
+			return 0;
+	}
+	return 1;
+}
+
+static int pr_buffer(int id, VSaaSContractInfo *contract)
+{
+	AVPreRollClip *clip, *clips[AV_PREROLL_MAX_CLIPS];
+	AVPreRollStats stats;
+	int i;
+
+	EXT_CHECK(avPreRollGetStats(id, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.capacityFrames == PR_CAPACITY_FRAMES && stats.capacityBytes == PR_CAPACITY_BYTES);
+	EXT_CHECK(stats.targetMs == PR_WINDOW_MS);
+	EXT_CHECK(avPreRollCapture(id, &clip) == AV_ER_DATA_NOREADY);
+	EXT_CHECK(pr_write(id, 4) == AV_ER_WAIT_KEY_FRAME);
+
+	// The buffer keeps whole GOPs covering the window, and no more
+	for (i = 0; i < 40; i++) {
+		EXT_CHECK(pr_write(id, i) == AV_ER_NoERROR);
+		EXT_CHECK(avPreRollGetStats(id, &stats) == AV_ER_NoERROR);
+		EXT_CHECK(i < 20 || stats.windowMs >= PR_WINDOW_MS);
+		EXT_CHECK(stats.windowMs < PR_WINDOW_MS + PR_GOP * PR_FRAME_MS);
+	}
+	EXT_CHECK(stats.frames == PR_HELD && stats.usedBytes == PR_HELD * 504);
+
+	// A clip starts on the last keyframe before the window and pins its frames
+	EXT_CHECK(avPreRollCapture(id, &clip) == AV_ER_NoERROR && pr_clip_valid(clip, 15, 39));
+	for (i = 40; i < 40 + PR_CAPACITY_FRAMES - PR_HELD; i++)
+		EXT_CHECK(pr_write(id, i) == AV_ER_NoERROR);
+	EXT_CHECK(pr_write(id, i++) == AV_ER_EXCEED_MAX_SIZE);
+	while (i % PR_GOP != 0)
+		EXT_CHECK(pr_write(id, i++) == AV_ER_WAIT_KEY_FRAME);
+	EXT_CHECK(pr_write(id, i) == AV_ER_EXCEED_MAX_SIZE);
+	EXT_CHECK(pr_clip_valid(clip, 15, 39));
+	avPreRollClipRelease(clip);
+	EXT_CHECK(pr_write(id, i + PR_GOP) == AV_ER_NoERROR);
+	EXT_CHECK(avPreRollCapture(id, &clip) == AV_ER_NoERROR);
+	EXT_CHECK(clip->startTimeMs == (unsigned long long)(i + PR_GOP) * PR_FRAME_MS - PR_WINDOW_MS);
+	avPreRollClipRelease(clip);
+	EXT_CHECK(avPreRollGetStats(id, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.droppedFrames == 6 && stats.captures == 2 && stats.windowMs == PR_WINDOW_MS);
+
+	// A shorter contract shrinks the window at once, a longer one keeps what fits
+	contract->event_recording_max_sec = 1;
+	EXT_CHECK(avPreRollUpdateContract(id, contract) == AV_ER_NoERROR);
+	EXT_CHECK(avPreRollGetStats(id, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.targetMs == 1000 && stats.windowMs >= 1000 && stats.windowMs < 1000 + PR_GOP * PR_FRAME_MS);
+	contract->event_recording_max_sec = 60;
+	EXT_CHECK(avPreRollUpdateContract(id, contract) == AV_ER_NoERROR);
+	for (i = 100; i < 200; i++)
+		EXT_CHECK(pr_write(id, i) == AV_ER_NoERROR);
+	EXT_CHECK(avPreRollGetStats(id, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.targetMs == 5000 && stats.capacityBytes == PR_CAPACITY_BYTES);
+	EXT_CHECK(stats.frames > 40 && stats.frames <= PR_CAPACITY_FRAMES);
+
+	// Clips are limited, and a frame bigger than the buffer never fits
+	for (i = 0; i < AV_PREROLL_MAX_CLIPS; i++)
+		EXT_CHECK(avPreRollCapture(id, &clips[i]) == AV_ER_NoERROR);
+	EXT_CHECK(avPreRollCapture(id, &clip) == AV_ER_EXCEED_MAX_CHANNEL);
+	for (i = 0; i < AV_PREROLL_MAX_CLIPS; i++)
+		avPreRollClipRelease(clips[i]);
+	EXT_CHECK(avPreRollWrite(id, gPrBig, sizeof(gPrBig), NULL, 0, 20000, 1) == AV_ER_EXCEED_MAX_SIZE);
+	return 0;
+}
+
+/** A pre-roll buffer sized from the contract, holding whole GOPs of the window, pinned by clips */
+int ext_test_preroll_buffer(void)
+{
+	VSaaSContractInfo contract;
+	AVPreRollConfig config;
+	int id, ret;
+
+	memset(&contract, 0, sizeof(contract));
+	contract.cb = sizeof(contract);
+	contract.event_recording_max_sec = PR_WINDOW_MS / 1000;
+	contract.video_max_fps = 10;
+	contract.recording_max_kbps = 80;
+	memset(&config, 0, sizeof(config));
+	EXT_CHECK(avPreRollCreate(NULL, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avPreRollCreate(&contract, &config) == AV_ER_INVALID_ARG);
+	config.cb = sizeof(config);
+	config.maxGopMs = 1000;
+	id = avPreRollCreate(&contract, &config);
+	ret = id >= 0 ? pr_buffer(id, &contract) : __LINE__;
+	avPreRollDestroy(id);
+	return ret;
+}
@@ -0,0 +1,107 @@
+/*! \file test_presence.c
+Checks of the presence cache, see IOTCPresenceAPIs.h.
+ */
+
+#include <string.h>
+
+#include "IOTCPresenceAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define PRESENCE_MAX_UIDS	8
+
+typedef struct PresenceResult {
+	int done;
+	int count;
+	int results[PRESENCE_MAX_UIDS];
+} PresenceResult;
+
+static void __stdcall presence_handler(const char * const *UIDs, const int *results, int count, void *userData)
+{
+	PresenceResult *r = (PresenceResult *)userData;
+
+	(void)UIDs;
+	r->count = count;
+	memcpy(r->results, results, (size_t)count * sizeof(int));
+	__atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+}
+
+/** Check uids in one batch and wait for the handler. */
+static int presence_check(const char * const *uids, int count, PresenceResult *r)
+{
+	memset(r, 0, sizeof(*r));
+	EXT_CHECK(IOTC_Check_Device_On_Line_Batch(uids, count, 1000, presence_handler, r) == IOTC_ER_NoERROR);
+	EXT_CHECK(ext_test_wait_for(&r->done, 1, 2000));
+	EXT_CHECK(r->count == count);
+	return 0;
+}
+
+static int presence_cache(void)
+{
+	static const char *const first[] = { "ONLINE", "OFFLINE", "UNREACHABLE", "ONLINE", "" };
+	static const char *const again[] = { "ONLINE", "OFFLINE", "UNREACHABLE" };
+	static const char *const online[] = { "ONLINE" };
+	static const char *const offline[] = { "OFFLINE" };
+	sessionStatusCB closed = IOTC_Presence_Session_Closed;
+	PresenceResult r;
+	int ret;
+
+	ext_stub_set_online("ONLINE", IOTC_ER_NoERROR);
+	ext_stub_set_online("OFFLINE", IOTC_ER_DEVICE_OFFLINE);
+	ext_stub_set_online("UNREACHABLE", IOTC_ER_TIMEOUT);
+	EXT_CHECK(IOTC_Presence_Setup(60000, 60000, 2) == IOTC_ER_NoERROR);
+
+	// The same UID twice in a batch is queried once; an empty one is not queried
+	if ((ret = presence_check(first, 5, &r)) != 0)
+		return ret;
+	EXT_CHECK(r.results[0] == IOTC_ER_NoERROR && r.results[3] == IOTC_ER_NoERROR);
+	EXT_CHECK(r.results[1] == IOTC_ER_DEVICE_OFFLINE && r.results[2] == IOTC_ER_TIMEOUT);
+	EXT_CHECK(r.results[4] == IOTC_ER_INVALID_ARG);
+	EXT_CHECK(ext_stub_online_queries("ONLINE") == 1 && ext_stub_online_queries("OFFLINE") == 1);
+
+	// On line and off line results are cached, network errors are not
+	if ((ret = presence_check(again, 3, &r)) != 0)
+		return ret;
+	EXT_CHECK(r.results[0] == IOTC_ER_NoERROR && r.results[1] == IOTC_ER_DEVICE_OFFLINE);
+	EXT_CHECK(ext_stub_online_queries("ONLINE") == 1 && ext_stub_online_queries("OFFLINE") == 1);
+	EXT_CHECK(ext_stub_online_queries("UNREACHABLE") == 2);
+	EXT_CHECK(IOTC_Presence_Query("ONLINE") == IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Presence_Query("UNREACHABLE") == IOTC_ER_TIMEOUT);
+
+	// A session overrides a negative entry, and its close drops the entry
+	ext_stub_session_open(3, "OFFLINE");
+	EXT_CHECK(IOTC_Presence_Session_Connected(3) == IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Presence_Query("OFFLINE") == IOTC_ER_NoERROR);
+	// Through a session status handler, as the header suggests
+	closed(3, IOTC_ER_NoERROR);
+	EXT_CHECK(IOTC_Presence_Query("OFFLINE") == IOTC_ER_TIMEOUT);
+	if ((ret = presence_check(offline, 1, &r)) != 0)
+		return ret;
+	EXT_CHECK(r.results[0] == IOTC_ER_DEVICE_OFFLINE && ext_stub_online_queries("OFFLINE") == 2);
+	EXT_CHECK(IOTC_Presence_Session_Connected(4) == IOTC_ER_INVALID_SID);
+
+	IOTC_Presence_Invalidate("ONLINE");
+	EXT_CHECK(IOTC_Presence_Query("ONLINE") == IOTC_ER_TIMEOUT);
+
+	// Entries expire after their TTL
+	EXT_CHECK(IOTC_Presence_Setup(50, 50, 0) == IOTC_ER_NoERROR);
+	if ((ret = presence_check(online, 1, &r)) != 0)
+		return ret;
+	EXT_CHECK(ext_stub_online_queries("ONLINE") == 2);
+	EXT_CHECK(IOTC_Presence_Query("ONLINE") == IOTC_ER_NoERROR);
+	ext_test_sleep_ms(80);
+	EXT_CHECK(IOTC_Presence_Query("ONLINE") == IOTC_ER_TIMEOUT);
+	return 0;
+}
+
+int ext_test_presence_cache(void)
+{
+	int ret;
+
+	ext_stub_reset();
+	ret = presence_cache();
+	IOTC_Presence_DeInitialize();
+	IOTC_Presence_Setup(IOTC_PRESENCE_DEFAULT_POSITIVE_TTL, IOTC_PRESENCE_DEFAULT_NEGATIVE_TTL, 0);
+	ext_stub_reset();
+	return ret;
+}
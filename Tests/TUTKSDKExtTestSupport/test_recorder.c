@@ -0,0 +1,125 @@
+/*! \file test_recorder.c
+Checks of the segment layout of the recorders, see AVRecorderAPIs.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "AVRecorderAPIs.h"
+#include "ext_test.h"
+
+#define REC_FRAMES		10
+#define REC_DATA		100000
+#define REC_RECORD(n)	((sizeof(AVRecFrameHeader) + (n) + AV_REC_ALIGN - 1) & ~(size_t)(AV_REC_ALIGN - 1))
+
+static void rec_fill(unsigned char *buf, size_t n, unsigned int frame)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		buf[i] = (unsigned char)(frame * 31 + i);
+}
+
+/** Check the finished segment 0 holds the frames of the exact fill. */
+static int rec_check_segment(const char *path, size_t last_data)
+{
+	AVRecSegmentHeader h;
+	AVRecFrameHeader fh;
+	AVRecIndexEntry e;
+	struct stat st;
+	unsigned char *data, *want;
+	FILE *f;
+	int ret = 0;
+
+	EXT_CHECK(stat(path, &st) == 0);
+	EXT_CHECK((f = fopen(path, "rb")) != NULL);
+	data = (unsigned char *)malloc(last_data);
+	want = (unsigned char *)malloc(last_data);
+	if (data == NULL || want == NULL || fread(&h, sizeof(h), 1, f) != 1)
+		ret = __LINE__;
+	else if (h.magic != AV_REC_SEGMENT_MAGIC || !(h.flags & AV_REC_SEGMENT_COMPLETE) || h.segmentNo != 0 ||
+			 h.indexCount != REC_FRAMES || h.dataEnd != h.indexOffset ||
+			 (unsigned long long)st.st_size != h.indexOffset + REC_FRAMES * sizeof(AVRecIndexEntry))
+		ret = __LINE__;
+	// The last entry points at the record which ends where the index starts
+	else if (fseek(f, (long)(h.indexOffset + (REC_FRAMES - 1) * sizeof(AVRecIndexEntry)), SEEK_SET) != 0 ||
+			 fread(&e, sizeof(e), 1, f) != 1 || e.offset + REC_RECORD(last_data) != h.indexOffset ||
+			 !(e.flags & AV_REC_FRAME_KEY))
+		ret = __LINE__;
+	else if (fseek(f, (long)e.offset, SEEK_SET) != 0 || fread(&fh, sizeof(fh), 1, f) != 1 ||
+			 fh.size != last_data || fh.infoSize != 0 || fread(data, last_data, 1, f) != 1)
+		ret = __LINE__;
+	else {
+		rec_fill(want, last_data, REC_FRAMES - 1);
+		if (memcmp(data, want, last_data) != 0)
+			ret = __LINE__;
+	}
+	free(data);
+	free(want);
+	fclose(f);
+	return ret;
+}
+
+static int rec_exact_fill(const char *dir, int id)
+{
+	static unsigned char buf[AV_REC_MIN_SEGMENT_SIZE];
+	AVRecorderStats st;
+	size_t used, last;
+	unsigned int i;
+
+	// Frames which leave room for exactly one more record and its index entry
+	used = sizeof(AVRecSegmentHeader) + (REC_FRAMES - 1) * (REC_RECORD(REC_DATA) + sizeof(AVRecIndexEntry));
+	last = AV_REC_MIN_SEGMENT_SIZE - used - sizeof(AVRecIndexEntry) - sizeof(AVRecFrameHeader);
+	EXT_CHECK(REC_RECORD(last) == last + sizeof(AVRecFrameHeader));
+	for (i = 0; i < REC_FRAMES; i++) {
+		size_t n = i + 1 < REC_FRAMES ? REC_DATA : last;
+		rec_fill(buf, n, i);
+		EXT_CHECK(avRecorderWrite(id, (const char *)buf, (int)n, NULL, 0, 1000 + i * 40, i == 0 || i + 1 == REC_FRAMES) ==
+				  AV_ER_NoERROR);
+	}
+	EXT_CHECK(avRecorderGetStats(id, &st) == AV_ER_NoERROR);
+	EXT_CHECK(st.frames == REC_FRAMES && st.segments == 1 && st.currentSegment == 0);
+
+	// A full segment has no room left, not a wrapped-around lot of it
+	rec_fill(buf, 1, REC_FRAMES);
+	EXT_CHECK(avRecorderWrite(id, (const char *)buf, 1, NULL, 0, 1000 + REC_FRAMES * 40, 0) == AV_ER_NoERROR);
+	EXT_CHECK(avRecorderGetStats(id, &st) == AV_ER_NoERROR);
+	EXT_CHECK(st.segments == 2 && st.currentSegment == 1);
+	avRecorderClose(id);
+
+	{
+		char path[512];
+		snprintf(path, sizeof(path), AV_REC_SEGMENT_NAME_FORMAT, dir, "t", 0u);
+		return rec_check_segment(path, last);
+	}
+}
+
+int ext_test_recorder_exact_fill(void)
+{
+	char dir[] = "/tmp/avrecXXXXXX", path[512];
+	AVRecorderConfig config;
+	unsigned int i;
+	int id, ret;
+
+	EXT_CHECK(mkdtemp(dir) != NULL);
+	memset(&config, 0, sizeof(config));
+	config.cb = sizeof(config);
+	config.pszDirectory = dir;
+	config.pszPrefix = "t";
+	config.segmentSize = AV_REC_MIN_SEGMENT_SIZE;
+	id = avRecorderCreate(&config);
+	ret = id < 0 ? __LINE__ : rec_exact_fill(dir, id);
+	if (ret != 0 && id >= 0)
+		avRecorderClose(id);
+
+	// The segments written, and the spare created ahead of them
+	for (i = 0; i < 4; i++) {
+		snprintf(path, sizeof(path), AV_REC_SEGMENT_NAME_FORMAT, dir, "t", i);
+		unlink(path);
+	}
+	rmdir(dir);
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*! \file test_recvengine.c
+Checks of receive engines, see AVRecvEngineAPIs.h. The frames are queued
+for the SDK stand-ins to receive before the check takes them, so a decoder
+which falls behind is one which has not taken them yet. Byte 2 of the frame
+info is 1 for a keyframe, as in FRAMEINFO_t, and byte 0 numbers the frame.
+ */
+
+#include <string.h>
+
+#include "AVRecvEngineAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define RECV_KEYED_AV		10		// Keyframes known, queue of 4
+#define RECV_PLAIN_AV		11		// Keyframes not known, queue of 3
+#define RECV_BULK_AV		12		// The default configuration
+#define RECV_FLAG			2
+#define RECV_BURST			2
+#define RECV_IDLE_MS		8
+#define RECV_FRAME_SIZE		400
+
+static char gRecvData[RECV_FRAME_SIZE];
+static int gRecvReady[EXT_STUB_MAX_AV];
+
+static void __stdcall recv_ready(int nAVChannelID, void *pUserData)
+{
+	(void)pUserData;
+	__atomic_add_fetch(&gRecvReady[nAVChannelID], 1, __ATOMIC_ACQ_REL);
+}
+
+/** Queue frame seq for the stand-ins to receive on av; an incomplete one if expected_size is above the frame size */
+static void recv_push(int av, int seq, int key, int expected_size)
+{
+	char info[4] = { (char)seq, 0, (char)key, 0 };
+
+	memset(gRecvData, seq, sizeof(gRecvData));
+	ext_stub_recv_push(av, 0, gRecvData, sizeof(gRecvData), expected_size, info, sizeof(info));
+}
+
+/** The number of the next frame in the decoder queue of av within timeout_ms, or -1 if there is none */
+static int recv_take(int av, unsigned int timeout_ms)
+{
+	AVFrame *f;
+	int seq;
+
+	if (avRecvEngineGetFrame(av, &f, timeout_ms) != RECV_FRAME_SIZE)
+		return -1;
+	seq = f->data[0] == f->info[0] ? f->info[0] : -1;
+	avFrameRelease(f);
+	return seq;
+}
+
+/** Wait until av has received frames in all; 1 if it did */
+static int recv_wait(int av, unsigned int frames)
+{
+	AVRecvStreamStats stats;
+	unsigned int waited;
+
+	for (waited = 0; waited < 2000; waited++) {
+		if (avRecvStreamGetStats(av, &stats) != AV_ER_NoERROR)
+			return 0;
+		if (stats.received == frames)
+			return 1;
+		ext_test_sleep_ms(1);
+	}
+	return 0;
+}
+
+/** Wait until engine has counted frames in all at the end of their turns; 1 if it did */
+static int recv_engine_wait(int engine, unsigned long long frames, AVRecvEngineStats *stats)
+{
+	unsigned int waited;
+
+	for (waited = 0; waited < 2000; waited++) {
+		if (avRecvEngineGetStats(engine, stats) != AV_ER_NoERROR)
+			return 0;
+		if (stats->frames == frames)
+			return 1;
+		ext_test_sleep_ms(1);
+	}
+	return 0;
+}
+
+static unsigned int recv_frames_in_use(void)
+{
+	AVFramePoolStats stats;
+
+	return avFramePoolGetStats(&stats) == AV_ER_NoERROR ? stats.framesInUse : 0;
+}
+
+static int recv_streams(int engine)
+{
+	AVRecvStreamConfig config;
+	AVRecvEngineStats es, before;
+	AVRecvStreamStats ss;
+	unsigned int in_use = recv_frames_in_use();
+	AVFrame *f;
+	int seq;
+
+	memset(&config, 0, sizeof(config));
+	config.cb = sizeof(config);
+	config.flagOffset = AV_FRAME_INFO_MAX_SIZE;
+	EXT_CHECK(avRecvEngineAdd(engine, RECV_KEYED_AV, &config, recv_ready, NULL) == AV_ER_INVALID_ARG);
+	config.flagOffset = RECV_FLAG;
+	config.maxQueue = 4;
+	EXT_CHECK(avRecvEngineAdd(engine + 1, RECV_KEYED_AV, &config, recv_ready, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avRecvEngineAdd(engine, RECV_KEYED_AV, &config, recv_ready, NULL) == AV_ER_NoERROR);
+	EXT_CHECK(avRecvEngineAdd(engine, RECV_KEYED_AV, &config, recv_ready, NULL) == AV_ER_INVALID_ARG);
+	config.flagOffset = AV_RECV_FLAG_OFFSET_NONE;
+	config.maxQueue = 3;
+	EXT_CHECK(avRecvEngineAdd(engine, RECV_PLAIN_AV, &config, NULL, NULL) == AV_ER_NoERROR);
+	EXT_CHECK(avRecvEngineAdd(engine, RECV_BULK_AV, NULL, NULL, NULL) == AV_ER_NoERROR);
+
+	// Idle streams are polled less and less often
+	ext_test_sleep_ms(RECV_IDLE_MS * 10);
+	EXT_CHECK(avRecvStreamGetStats(RECV_KEYED_AV, &ss) == AV_ER_NoERROR);
+	EXT_CHECK(ss.received == 0 && ss.pollIntervalMs == RECV_IDLE_MS && ss.lastError == 0);
+	EXT_CHECK(avRecvEngineGetStats(engine, &es) == AV_ER_NoERROR);
+	EXT_CHECK(es.streams == 3 && es.workers == 2 && es.frames == 0 && es.emptyTurns == es.turns);
+	EXT_CHECK(es.wakeups > 0 && es.turns < 3 * 20);
+	EXT_CHECK(avRecvEngineGetFrame(RECV_KEYED_AV, &f, 0) == AV_ER_DATA_NOREADY && f == NULL);
+
+	// Frames come out in order, with one ready callback until the queue is empty
+	recv_push(RECV_KEYED_AV, 0, 1, 0);
+	EXT_CHECK(recv_take(RECV_KEYED_AV, 1000) == 0);
+	recv_push(RECV_KEYED_AV, 1, 0, 0);
+	recv_push(RECV_KEYED_AV, 2, 0, 0);
+	EXT_CHECK(recv_wait(RECV_KEYED_AV, 3) && ext_test_wait_for(&gRecvReady[RECV_KEYED_AV], 2, 1000));
+	EXT_CHECK(recv_take(RECV_KEYED_AV, 0) == 1 && recv_take(RECV_KEYED_AV, 0) == 2);
+	EXT_CHECK(recv_take(RECV_KEYED_AV, 0) == -1);
+
+	// A decoder behind jumps to the next keyframe, or loses the oldest frames if keyframes are not known
+	for (seq = 3; seq <= 7; seq++) {
+		recv_push(RECV_KEYED_AV, seq, seq == 3, 0);
+		recv_push(RECV_PLAIN_AV, seq, seq == 3, 0);
+	}
+	recv_push(RECV_KEYED_AV, 8, 1, 0);
+	recv_push(RECV_KEYED_AV, 9, 0, 0);
+	EXT_CHECK(recv_wait(RECV_KEYED_AV, 10) && recv_wait(RECV_PLAIN_AV, 5));
+	EXT_CHECK(recv_take(RECV_KEYED_AV, 0) == 8 && recv_take(RECV_KEYED_AV, 0) == 9);
+	EXT_CHECK(recv_take(RECV_PLAIN_AV, 0) == 5 && recv_take(RECV_PLAIN_AV, 0) == 6);
+	EXT_CHECK(recv_take(RECV_PLAIN_AV, 0) == 7 && recv_take(RECV_PLAIN_AV, 0) == -1);
+	EXT_CHECK(avRecvStreamGetStats(RECV_KEYED_AV, &ss) == AV_ER_NoERROR && ss.dropped == 5 && ss.delivered == 5);
+	EXT_CHECK(avRecvStreamGetStats(RECV_PLAIN_AV, &ss) == AV_ER_NoERROR && ss.dropped == 2 && ss.delivered == 3);
+
+	// So does one after an incomplete frame
+	recv_push(RECV_KEYED_AV, 10, 0, RECV_FRAME_SIZE + 1);
+	recv_push(RECV_KEYED_AV, 11, 0, 0);
+	recv_push(RECV_KEYED_AV, 12, 1, 0);
+	EXT_CHECK(recv_take(RECV_KEYED_AV, 1000) == 12);
+	EXT_CHECK(avRecvStreamGetStats(RECV_KEYED_AV, &ss) == AV_ER_NoERROR);
+	EXT_CHECK(ss.received == 13 && ss.dropped == 7 && ss.lastError == AV_ER_INCOMPLETE_FRAME);
+
+	// A busy stream takes turns of burst frames, counted once the turns of the frames so far end
+	EXT_CHECK(recv_engine_wait(engine, 13 + 5, &before));
+	for (seq = 0; seq < 10; seq++)
+		recv_push(RECV_BULK_AV, seq, 0, 0);
+	EXT_CHECK(recv_engine_wait(engine, before.frames + 10, &es));
+	EXT_CHECK(es.turns >= before.turns + 10 / RECV_BURST);
+	for (seq = 0; seq < 10; seq++)
+		EXT_CHECK(recv_take(RECV_BULK_AV, 0) == seq);
+
+	// A closed AV channel gives its queued frames first, then the error
+	recv_push(RECV_BULK_AV, 10, 0, 0);
+	EXT_CHECK(recv_wait(RECV_BULK_AV, 11));
+	ext_stub_av_close(RECV_BULK_AV, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	EXT_CHECK(recv_take(RECV_BULK_AV, 0) == 10);
+	EXT_CHECK(avRecvEngineGetFrame(RECV_BULK_AV, &f, 1000) == AV_ER_SESSION_CLOSE_BY_REMOTE && f == NULL);
+	EXT_CHECK(avRecvStreamGetStats(RECV_BULK_AV, &ss) == AV_ER_NoERROR);
+	EXT_CHECK(ss.lastError == AV_ER_SESSION_CLOSE_BY_REMOTE);
+
+	// A removed stream releases its queued frames
+	recv_push(RECV_PLAIN_AV, 8, 0, 0);
+	EXT_CHECK(recv_wait(RECV_PLAIN_AV, 6));
+	EXT_CHECK(recv_frames_in_use() == in_use + 1);
+	avRecvEngineRemove(RECV_PLAIN_AV);
+	EXT_CHECK(recv_frames_in_use() == in_use);
+	EXT_CHECK(avRecvEngineGetFrame(RECV_PLAIN_AV, &f, 0) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avRecvStreamGetStats(RECV_PLAIN_AV, &ss) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avRecvEngineGetStats(engine, &es) == AV_ER_NoERROR && es.streams == 2);
+
+	// So do the streams of a destroyed engine
+	recv_push(RECV_KEYED_AV, 13, 1, 0);
+	EXT_CHECK(recv_wait(RECV_KEYED_AV, 14));
+	return 0;
+}
+
+/** Streams shared by two workers, with ordered decoder queues which skip to keyframes and idle polls backed off */
+int ext_test_recv_engine_streams(void)
+{
+	AVRecvEngineConfig config;
+	unsigned int in_use;
+	int engine, ret;
+	AVFrame *f;
+
+	ext_stub_reset();
+	memset(gRecvReady, 0, sizeof(gRecvReady));
+	memset(&config, 0, sizeof(config));
+	EXT_CHECK(avRecvEngineCreate(&config) == AV_ER_INVALID_ARG);
+	config.cb = sizeof(config);
+	config.workers = AV_RECV_ENGINE_MAX_WORKERS + 1;
+	EXT_CHECK(avRecvEngineCreate(&config) == AV_ER_INVALID_ARG);
+	config.workers = 2;
+	config.burst = RECV_BURST;
+	config.maxIdleMs = RECV_IDLE_MS;
+	in_use = recv_frames_in_use();
+	engine = avRecvEngineCreate(&config);
+	ret = engine >= 0 ? recv_streams(engine) : __LINE__;
+	avRecvEngineDestroy(engine);
+	if (ret == 0 && (recv_frames_in_use() != in_use ||
+					 avRecvEngineGetFrame(RECV_KEYED_AV, &f, 0) != AV_ER_INVALID_ARG))
+		ret = __LINE__;
+	avRecvEngineRemove(RECV_KEYED_AV);
+	avRecvEngineRemove(RECV_PLAIN_AV);
+	avRecvEngineRemove(RECV_BULK_AV);
+	avFramePoolResetChannel(RECV_KEYED_AV);
+	avFramePoolResetChannel(RECV_PLAIN_AV);
+	avFramePoolResetChannel(RECV_BULK_AV);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*! \file test_rpc.c
+Checks of the IO control RPC layer, see AVIOCtrlRpcAPIs.h. AV channels 0
+and 1 are linked by the SDK stand-ins, so 0 calls and 1 serves; nothing
+answers on AV channel 2.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVIOCtrlRpcAPIs.h"
+#include "AVIOCtrlDispatchAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define RPC_CLIENT			0
+#define RPC_SERVER			1
+#define RPC_LONELY			2
+#define RPC_LARGE			5000
+
+#define RPC_METHOD_ECHO		1
+#define RPC_METHOD_SLOW		2
+
+typedef struct RpcServer {
+	int in_handler;
+	int slow_done;
+} RpcServer;
+
+typedef struct RpcResults {
+	int completed;
+	int results[4];
+} RpcResults;
+
+static void __stdcall rpc_serve(int nAVChannelID, unsigned int nRequestID, unsigned int nMethod,
+								const char *cabData, int nDataSize, void *pUserData)
+{
+	RpcServer *s = (RpcServer *)pUserData;
+
+	if (nMethod == RPC_METHOD_ECHO) {
+		avRpcReply(nAVChannelID, nRequestID, 0, cabData, nDataSize);
+		return;
+	}
+	// The slow method holds the worker, and never replies
+	__atomic_store_n(&s->in_handler, 1, __ATOMIC_RELEASE);
+	ext_test_sleep_ms(50);
+	__atomic_store_n(&s->slow_done, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->in_handler, 0, __ATOMIC_RELEASE);
+}
+
+static void __stdcall rpc_result(int nAVChannelID, unsigned int nRequestID, int nResult, const char *cabData,
+								 int nDataSize, void *pUserData)
+{
+	RpcResults *r = (RpcResults *)pUserData;
+	int n;
+
+	(void)nAVChannelID;
+	(void)nRequestID;
+	(void)cabData;
+	(void)nDataSize;
+	n = __atomic_load_n(&r->completed, __ATOMIC_ACQUIRE);
+	if (n < 4)
+		r->results[n] = nResult;
+	__atomic_store_n(&r->completed, n + 1, __ATOMIC_RELEASE);
+}
+
+static int rpc_calls(void)
+{
+	char *data, *reply, raw[16];
+	unsigned int type;
+	AVRpcStats stats;
+	int i, size;
+
+	data = (char *)malloc(RPC_LARGE);
+	reply = (char *)malloc(RPC_LARGE);
+	if (data == NULL || reply == NULL) {
+		free(data);
+		free(reply);
+		return __LINE__;
+	}
+	for (i = 0; i < RPC_LARGE; i++)
+		data[i] = (char)(i * 7);
+
+	// A payload of several IO controls comes back whole
+	size = 0;
+	i = avRpcCall(RPC_CLIENT, RPC_METHOD_ECHO, data, RPC_LARGE, reply, RPC_LARGE, &size, 2000);
+	if (i != 0 || size != RPC_LARGE || memcmp(data, reply, RPC_LARGE) != 0) {
+		free(data);
+		free(reply);
+		return __LINE__;
+	}
+	free(data);
+	free(reply);
+	EXT_CHECK(avRpcCall(RPC_CLIENT, RPC_METHOD_ECHO, "ab", 2, raw, 1, &size, 2000) ==
+			  AV_ER_BUFPARA_MAXSIZE_INSUFF);
+
+	// Other IO controls pass through to avRpcRecvIOCtrl()
+	EXT_CHECK(avSendIOCtrl(RPC_CLIENT, AV_IOCTRL_USER(9), "xyz", 3) == AV_ER_NoERROR);
+	EXT_CHECK(avRpcRecvIOCtrl(RPC_SERVER, &type, raw, sizeof(raw), 2000) == 3);
+	EXT_CHECK(type == AV_IOCTRL_USER(9) && memcmp(raw, "xyz", 3) == 0);
+	EXT_CHECK(avRpcRecvIOCtrl(RPC_SERVER, &type, raw, sizeof(raw), 0) == AV_ER_DATA_NOREADY);
+
+	EXT_CHECK(avRpcGetStats(RPC_CLIENT, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.calls == 2 && stats.responses == 2 && stats.outstanding == 0);
+	EXT_CHECK(avRpcGetStats(RPC_SERVER, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.served == 2 && stats.passthrough == 1);
+	return 0;
+}
+
+/** Calls with payloads of one and several IO controls, and IO controls passed through */
+int ext_test_rpc_calls(void)
+{
+	RpcServer server;
+	int ret;
+
+	ext_stub_reset();
+	memset(&server, 0, sizeof(server));
+	ext_stub_ioctrl_link(RPC_CLIENT, RPC_SERVER);
+	EXT_CHECK(avRpcAttach(RPC_CLIENT, NULL, NULL, NULL) == AV_ER_NoERROR);
+	if (avRpcAttach(RPC_SERVER, NULL, rpc_serve, &server) != AV_ER_NoERROR) {
+		avRpcDetach(RPC_CLIENT);
+		return __LINE__;
+	}
+	ret = rpc_calls();
+	avRpcDetach(RPC_SERVER);
+	avRpcDetach(RPC_CLIENT);
+	ext_stub_reset();
+	return ret;
+}
+
+static int rpc_failures(void)
+{
+	AVRpcStats stats;
+	char reply[4];
+	int size;
+
+	// Without a request callback the server refuses at once
+	EXT_CHECK(avRpcCall(RPC_CLIENT, RPC_METHOD_ECHO, "a", 1, reply, sizeof(reply), &size, 2000) ==
+			  AV_ER_REMOTE_NOT_SUPPORT);
+
+	// Nobody answers on AV channel 2
+	EXT_CHECK(avRpcCall(RPC_LONELY, RPC_METHOD_ECHO, "a", 1, reply, sizeof(reply), &size, 50) == AV_ER_TIMEOUT);
+	EXT_CHECK(avRpcGetStats(RPC_LONELY, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.timeouts == 1 && stats.outstanding == 0);
+
+	// A closed AV channel fails the call with its error, and the calls after it
+	ext_stub_av_close(RPC_LONELY, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	EXT_CHECK(avRpcCall(RPC_LONELY, RPC_METHOD_ECHO, "a", 1, reply, sizeof(reply), &size, 2000) ==
+			  AV_ER_SESSION_CLOSE_BY_REMOTE);
+	EXT_CHECK(avRpcCall(RPC_LONELY, RPC_METHOD_ECHO, "a", 1, reply, sizeof(reply), &size, 2000) ==
+			  AV_ER_SESSION_CLOSE_BY_REMOTE);
+	return 0;
+}
+
+/** A refused call, a timed out one, and calls on a closed AV channel */
+int ext_test_rpc_failures(void)
+{
+	int ret = 0;
+
+	ext_stub_reset();
+	ext_stub_ioctrl_link(RPC_CLIENT, RPC_SERVER);
+	if (avRpcAttach(RPC_CLIENT, NULL, NULL, NULL) != AV_ER_NoERROR ||
+		avRpcAttach(RPC_SERVER, NULL, NULL, NULL) != AV_ER_NoERROR ||
+		avRpcAttach(RPC_LONELY, NULL, NULL, NULL) != AV_ER_NoERROR)
+		ret = __LINE__;
+	if (ret == 0)
+		ret = rpc_failures();
+	avRpcDetach(RPC_LONELY);
+	avRpcDetach(RPC_SERVER);
+	avRpcDetach(RPC_CLIENT);
+	ext_stub_reset();
+	return ret;
+}
+
+static int rpc_dispatched(int id, RpcServer *server, RpcResults *results)
+{
+	AVIOCtrlDispatchStats stats;
+	unsigned int request, waited;
+
+	EXT_CHECK(avRpcCallAsync(RPC_CLIENT, RPC_METHOD_SLOW, NULL, 0, 5000, rpc_result, results, &request) ==
+			  AV_ER_NoERROR);
+	EXT_CHECK(ext_test_wait_for(&server->in_handler, 1, 2000));
+
+	// The detach waits for the request handed over by the dispatcher
+	avRpcDetach(RPC_SERVER);
+	EXT_CHECK(__atomic_load_n(&server->slow_done, __ATOMIC_ACQUIRE) == 1);
+	// The worker counts the message once it is back from the RPC layer
+	for (waited = 0;; waited++) {
+		EXT_CHECK(avIOCtrlDispatchGetStats(id, &stats) == AV_ER_NoERROR);
+		if (stats.rpc == 1)
+			return 0;
+		EXT_CHECK(waited < 2000);
+		ext_test_sleep_ms(1);
+	}
+}
+
+/** A detach of the RPC layer while a dispatcher worker is in its request handler */
+int ext_test_rpc_dispatched_detach(void)
+{
+	RpcServer server;
+	RpcResults results;
+	int id, ret;
+
+	ext_stub_reset();
+	memset(&server, 0, sizeof(server));
+	memset(&results, 0, sizeof(results));
+	ext_stub_ioctrl_link(RPC_CLIENT, RPC_SERVER);
+	EXT_CHECK((id = avIOCtrlDispatcherCreate(NULL, 0, NULL)) >= 0);
+	ret = avIOCtrlDispatchAttach(id, RPC_SERVER, NULL) == AV_ER_NoERROR &&
+		  avRpcAttach(RPC_SERVER, NULL, rpc_serve, &server) == AV_ER_NoERROR &&
+		  avRpcAttach(RPC_CLIENT, NULL, NULL, NULL) == AV_ER_NoERROR ? 0 : __LINE__;
+	if (ret == 0)
+		ret = rpc_dispatched(id, &server, &results);
+	avRpcDetach(RPC_SERVER);
+	avIOCtrlDispatcherDestroy(id);
+	// The call got no reply, so the detach completes it
+	avRpcDetach(RPC_CLIENT);
+	ext_stub_reset();
+	if (ret != 0)
+		return ret;
+	EXT_CHECK(results.completed == 1 && results.results[0] == AV_ER_SENDIOCTRL_EXIT);
+	return 0;
+}
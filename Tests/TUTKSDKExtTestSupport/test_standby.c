@@ -0,0 +1,188 @@
+/*! \file test_standby.c
+Checks of standby AV channels, see AVStandbyAPIs.h. The check carries the
+mode changes of the client on one AV channel to the server on another, and
+queues the frames the client receives. Byte 2 of the frame info is 1 for a
+keyframe, as in FRAMEINFO_t, and byte 0 numbers the frame.
+ */
+
+#include <string.h>
+
+#include "AVStandbyAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define STANDBY_CLIENT_AV	8
+#define STANDBY_SERV_AV		9
+#define STANDBY_KEY_MS		200
+#define STANDBY_FLAG		2
+#define STANDBY_FRAME_SIZE	600
+
+typedef struct StandbyModes {
+	int calls;
+	AVStandbyMode mode;
+	unsigned int interval;
+} StandbyModes;
+
+static char gStandbyData[STANDBY_FRAME_SIZE];
+
+static void __stdcall standby_mode_changed(int nAVChannelID, AVStandbyMode mode, unsigned int nKeyIntervalMs,
+										   void *pUserData)
+{
+	StandbyModes *modes = (StandbyModes *)pUserData;
+
+	(void)nAVChannelID;
+	modes->calls++;
+	modes->mode = mode;
+	modes->interval = nKeyIntervalMs;
+}
+
+static int standby_send(int seq, int key)
+{
+	char info[4] = { (char)seq, 0, (char)key, 0 };
+
+	return avSendFrameDataStandby(STANDBY_SERV_AV, gStandbyData, sizeof(gStandbyData), info, sizeof(info), key);
+}
+
+static void standby_receive(int seq, int key)
+{
+	char info[4] = { (char)seq, 0, (char)key, 0 };
+
+	memset(gStandbyData, seq, sizeof(gStandbyData));
+	ext_stub_recv_push(STANDBY_CLIENT_AV, 0, gStandbyData, sizeof(gStandbyData), 0, info, sizeof(info));
+}
+
+/** Hand the next mode change the client sent to the server; the mode it asks for, or -1 if there is none */
+static int standby_deliver(unsigned int *interval)
+{
+	unsigned char msg[AV_STANDBY_MESSAGE_SIZE];
+	unsigned int type;
+
+	if (ext_stub_ioctrl_pop(STANDBY_CLIENT_AV, &type, msg, sizeof(msg)) != AV_STANDBY_MESSAGE_SIZE ||
+		type != AV_STANDBY_IOTYPE || msg[0] != AV_STANDBY_VERSION)
+		return -1;
+	*interval = (unsigned int)msg[4] | (unsigned int)msg[5] << 8 | (unsigned int)msg[6] << 16 |
+				(unsigned int)msg[7] << 24;
+	avServStandbyIOCtrlHandler(STANDBY_SERV_AV, type, (const char *)msg, sizeof(msg), NULL);
+	return msg[1];
+}
+
+/** Wait until the client in standby has received keys keyframes and others other frames; 1 if it did */
+static int standby_client_wait(unsigned int keys, unsigned int others)
+{
+	AVStandbyClientStats stats;
+	unsigned int waited;
+
+	for (waited = 0; waited < 2000; waited++) {
+		if (avClientStandbyGetStats(STANDBY_CLIENT_AV, &stats) != AV_ER_NoERROR)
+			return 0;
+		if (stats.keyFrames == keys && stats.otherFrames == others)
+			return 1;
+		ext_test_sleep_ms(1);
+	}
+	return 0;
+}
+
+static int standby_switch(StandbyModes *modes)
+{
+	unsigned char bad[AV_STANDBY_MESSAGE_SIZE] = { AV_STANDBY_VERSION + 1, AV_STANDBY_MODE_STANDBY };
+	AVStandbyClientStats cs;
+	AVStandbyServStats ss;
+	unsigned int interval;
+	AVFrame *key;
+
+	EXT_CHECK(avServStandbyAttach(STANDBY_SERV_AV, standby_mode_changed, modes) == AV_ER_INVALID_ARG);
+	EXT_CHECK(standby_send(0, 1) == AV_ER_NoERROR && standby_send(1, 0) == AV_ER_NoERROR);
+
+	// The client drains its AV channel and asks for keyframes only; a malformed request is ignored
+	EXT_CHECK(avClientStandbyEnter(STANDBY_CLIENT_AV, STANDBY_KEY_MS, AV_FRAME_INFO_MAX_SIZE) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avClientStandbyEnter(STANDBY_CLIENT_AV, STANDBY_KEY_MS, STANDBY_FLAG) == AV_ER_NoERROR);
+	EXT_CHECK(avClientStandbyEnter(STANDBY_CLIENT_AV, STANDBY_KEY_MS, STANDBY_FLAG) == AV_ER_INVALID_ARG);
+	avServStandbyIOCtrlHandler(STANDBY_SERV_AV, AV_STANDBY_IOTYPE, (const char *)bad, sizeof(bad), NULL);
+	EXT_CHECK(modes->calls == 0);
+	EXT_CHECK(standby_deliver(&interval) == AV_STANDBY_MODE_STANDBY && interval == STANDBY_KEY_MS);
+	EXT_CHECK(modes->calls == 1 && modes->mode == AV_STANDBY_MODE_STANDBY && modes->interval == STANDBY_KEY_MS);
+
+	// The server sends keyframes only, one per key interval
+	EXT_CHECK(standby_send(2, 0) == AV_ER_WAIT_KEY_FRAME);
+	EXT_CHECK(standby_send(3, 1) == AV_ER_NoERROR && standby_send(4, 1) == AV_ER_WAIT_KEY_FRAME);
+	ext_test_sleep_ms(STANDBY_KEY_MS + 10);
+	EXT_CHECK(standby_send(5, 1) == AV_ER_NoERROR);
+
+	// The client keeps the last keyframe and releases the rest
+	standby_receive(3, 1);
+	standby_receive(4, 0);
+	standby_receive(5, 1);
+	EXT_CHECK(standby_client_wait(2, 1));
+	EXT_CHECK(avClientStandbyGetStats(STANDBY_CLIENT_AV, &cs) == AV_ER_NoERROR);
+	EXT_CHECK(cs.hasKeyFrame && cs.keyFrameAgeMs < 1000 && cs.lastError == 0);
+
+	// A promotion hands over the kept keyframe, and the server waits for the next one
+	EXT_CHECK(avClientStandbyPromote(STANDBY_CLIENT_AV, &key) == AV_ER_NoERROR);
+	EXT_CHECK(key != NULL && key->dataSize == STANDBY_FRAME_SIZE && key->data[0] == 5 && key->info[0] == 5);
+	avFrameRelease(key);
+	EXT_CHECK(avClientStandbyGetStats(STANDBY_CLIENT_AV, &cs) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avClientStandbyPromote(STANDBY_CLIENT_AV, &key) == AV_ER_INVALID_ARG && key == NULL);
+	EXT_CHECK(standby_deliver(&interval) == AV_STANDBY_MODE_FULL && standby_deliver(&interval) == -1);
+	EXT_CHECK(modes->calls == 2 && modes->mode == AV_STANDBY_MODE_FULL);
+	EXT_CHECK(standby_send(6, 0) == AV_ER_WAIT_KEY_FRAME);
+	EXT_CHECK(standby_send(7, 1) == AV_ER_NoERROR && standby_send(8, 0) == AV_ER_NoERROR);
+
+	EXT_CHECK(avServStandbyGetStats(STANDBY_SERV_AV, &ss) == AV_ER_NoERROR);
+	EXT_CHECK(ss.mode == AV_STANDBY_MODE_FULL && ss.keyIntervalMs == AV_STANDBY_DEFAULT_KEY_INTERVAL);
+	EXT_CHECK(ss.sentFrames == 6 && ss.droppedFrames == 3 && ss.standbyCount == 1 && ss.promoteCount == 1);
+	EXT_CHECK(ext_stub_sent_count(STANDBY_SERV_AV) == 6);
+	return 0;
+}
+
+/** A client switched to a camera in standby at once with the keyframe it kept, the server sending keyframes only */
+int ext_test_standby_switch(void)
+{
+	StandbyModes modes;
+	int ret;
+
+	ext_stub_reset();
+	memset(&modes, 0, sizeof(modes));
+	memset(gStandbyData, 0, sizeof(gStandbyData));
+	EXT_CHECK(avServStandbyAttach(STANDBY_SERV_AV, NULL, NULL) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avServStandbyAttach(STANDBY_SERV_AV, standby_mode_changed, &modes) == AV_ER_NoERROR);
+	ret = standby_switch(&modes);
+	avClientStandbyStop(STANDBY_CLIENT_AV);
+	avServStandbyDetach(STANDBY_SERV_AV);
+	if (ret == 0 && standby_send(9, 1) != AV_ER_INVALID_ARG)
+		ret = __LINE__;
+	avFramePoolResetChannel(STANDBY_CLIENT_AV);
+	ext_stub_reset();
+	return ret;
+}
+
+/** A client in standby on an AV channel which closes, which is no longer in standby once promoted */
+int ext_test_standby_closed(void)
+{
+	AVStandbyClientStats stats;
+	unsigned int waited;
+	AVFrame *key;
+	int ret = 0;
+
+	ext_stub_reset();
+	memset(&stats, 0, sizeof(stats));
+	EXT_CHECK(avClientStandbyEnter(STANDBY_CLIENT_AV, 0, STANDBY_FLAG) == AV_ER_NoERROR);
+	standby_receive(0, 1);
+	ext_stub_av_close(STANDBY_CLIENT_AV, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	for (waited = 0; waited < 2000; waited++) {
+		if (avClientStandbyGetStats(STANDBY_CLIENT_AV, &stats) != AV_ER_NoERROR)
+			break;
+		if (stats.lastError == AV_ER_SESSION_CLOSE_BY_REMOTE)
+			break;
+		ext_test_sleep_ms(1);
+	}
+	if (stats.lastError != AV_ER_SESSION_CLOSE_BY_REMOTE)
+		ret = __LINE__;
+	else if (avClientStandbyPromote(STANDBY_CLIENT_AV, &key) != AV_ER_SESSION_CLOSE_BY_REMOTE || key != NULL)
+		ret = __LINE__;
+	else if (avClientStandbyGetStats(STANDBY_CLIENT_AV, &stats) != AV_ER_INVALID_ARG)
+		ret = __LINE__;
+	avClientStandbyStop(STANDBY_CLIENT_AV);
+	avFramePoolResetChannel(STANDBY_CLIENT_AV);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,119 @@
+/*! \file test_stats.c
+Checks of the statistics samplers, see AVStatsAPIs.h. Frames are recorded
+through ext_stats_frame_sent(), the hook of the paced send paths.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "AVStatsAPIs.h"
+#include "ext_stats.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define STATS_AV			0
+#define STATS_CAPACITY		8
+#define STATS_SENDERS		2
+
+static int stats_sampler(void)
+{
+	AVStatusSample samples[STATS_CAPACITY];
+	AVFrameSendSample frames[STATS_CAPACITY * 2];
+	AVStatsSamplerStats stats;
+	struct st_AvStatus status;
+	int i, n;
+
+	memset(&status, 0, sizeof(status));
+	status.RoundTripTime = 42;
+	status.BandWidth = 300;
+	ext_stub_set_status(STATS_AV, &status);
+	ext_stub_set_resend_usage(STATS_AV, 0.25f);
+	EXT_CHECK(avStatsSamplerStart(STATS_AV, AV_STATS_MAX_RATE, STATS_CAPACITY) == AV_ER_NoERROR);
+	EXT_CHECK(avStatsSamplerStart(STATS_AV, 0, 0) == AV_ER_INVALID_ARG);
+
+	// At 1000 Hz the ring of 8 is full long before it is read
+	ext_test_sleep_ms(50);
+	n = avStatsReadStatus(STATS_AV, samples, STATS_CAPACITY);
+	EXT_CHECK(n == STATS_CAPACITY);
+	for (i = 0; i < n; i++) {
+		EXT_CHECK(samples[i].status.RoundTripTime == 42 && samples[i].status.BandWidth == 300);
+		EXT_CHECK(samples[i].resendUsage == 0.25f);
+		EXT_CHECK(i == 0 || samples[i].timeUs > samples[i - 1].timeUs);
+	}
+	EXT_CHECK(avStatsGetSamplerStats(STATS_AV, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.statusDropped > 0 && stats.statusFailures == 0);
+
+	// A full frame ring drops the newest records, which still use up a seq
+	for (i = 0; i < STATS_CAPACITY + 3; i++)
+		ext_stats_frame_sent(STATS_AV, 1000 + (uint64_t)i, 100 + i, i == 1 ? AV_ER_EXCEED_MAX_SIZE : 0, i & 1);
+	n = avStatsReadFrames(STATS_AV, frames, STATS_CAPACITY * 2);
+	EXT_CHECK(n == STATS_CAPACITY);
+	for (i = 0; i < n; i++) {
+		EXT_CHECK(frames[i].seq == (unsigned int)i && frames[i].size == 100 + i);
+		EXT_CHECK(frames[i].timeUs == 1000 + (unsigned long long)i && frames[i].isAudio == (i & 1));
+	}
+	EXT_CHECK(frames[1].result == AV_ER_EXCEED_MAX_SIZE && frames[0].result == 0);
+	ext_stats_frame_sent(STATS_AV, 0, 1, 0, 0);
+	EXT_CHECK(avStatsReadFrames(STATS_AV, frames, 1) == 1 && frames[0].seq == STATS_CAPACITY + 3);
+	EXT_CHECK(avStatsGetSamplerStats(STATS_AV, &stats) == AV_ER_NoERROR);
+	EXT_CHECK(stats.frameSamples == STATS_CAPACITY + 1 && stats.frameDropped == 3);
+
+	// Failed status checks are counted, not sampled
+	ext_stub_av_close(STATS_AV, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	ext_test_sleep_ms(20);
+	EXT_CHECK(avStatsGetSamplerStats(STATS_AV, &stats) == AV_ER_NoERROR && stats.statusFailures > 0);
+	return 0;
+}
+
+/** Status samples, frame records, and what the full rings dropped */
+int ext_test_stats_sampler(void)
+{
+	AVStatsSamplerStats stats;
+	int ret;
+
+	ext_stub_reset();
+	ret = stats_sampler();
+	avStatsSamplerStop(STATS_AV);
+	ext_stub_reset();
+	if (ret != 0)
+		return ret;
+	EXT_CHECK(avStatsGetSamplerStats(STATS_AV, &stats) == AV_ER_INVALID_ARG);
+	return 0;
+}
+
+static void *stats_sender(void *arg)
+{
+	int *stop = (int *)arg, i;
+
+	for (i = 0; !__atomic_load_n(stop, __ATOMIC_ACQUIRE); i++)
+		ext_stats_frame_sent(STATS_AV, 0, i, 0, i & 1);
+	return NULL;
+}
+
+/** Samplers started and stopped while other threads record frames */
+int ext_test_stats_stop_while_sending(void)
+{
+	AVFrameSendSample frames[STATS_CAPACITY];
+	pthread_t senders[STATS_SENDERS];
+	int stop = 0, started = 0, i, ret = 0;
+
+	ext_stub_reset();
+	for (; started < STATS_SENDERS; started++) {
+		if (pthread_create(&senders[started], NULL, stats_sender, &stop) != 0) {
+			ret = __LINE__;
+			break;
+		}
+	}
+	for (i = 0; i < 200 && ret == 0; i++) {
+		if (avStatsSamplerStart(STATS_AV, AV_STATS_MAX_RATE, STATS_CAPACITY) != AV_ER_NoERROR)
+			ret = __LINE__;
+		else if (avStatsReadFrames(STATS_AV, frames, STATS_CAPACITY) < 0)
+			ret = __LINE__;
+		avStatsSamplerStop(STATS_AV);
+	}
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+	while (started > 0)
+		pthread_join(senders[--started], NULL);
+	ext_stub_reset();
+	return ret;
+}
@@ -0,0 +1,161 @@
+/*! \file test_streamgroup.c
+Checks of stream groups, see AVStreamGroupAPIs.h. Each frame carries its
+sequence number as frame info, so the frames the SDK stand-ins took on a
+viewer's AV channel show which ones it sent and which it skipped. A pacer
+on one viewer makes it slower than the frames are put in.
+ */
+
+#include <string.h>
+
+#include "AVStreamGroupAPIs.h"
+#include "IOTCPacerAPIs.h"
+#include "sdk_stub.h"
+#include "ext_test.h"
+
+#define GROUP_MAX_FRAMES	8
+#define GROUP_FAST_AV		1
+#define GROUP_SLOW_AV		2
+#define GROUP_LATE_AV		3
+#define GROUP_SID			2
+#define GROUP_MAX_LAG		4		// Of the slow viewer, below the 6 frames which make it fall behind
+#define GROUP_FRAME_SIZE	2000
+#define GROUP_RATE			20000	// 100 ms a frame
+#define GROUP_TOTAL			17		// Frames put by group_fanout()
+
+static char gGroupData[GROUP_FRAME_SIZE];
+static int gGroupReleased;
+
+static void __stdcall group_released(char *pData, void *pUserData)
+{
+	(void)pData;
+	(void)pUserData;
+	__atomic_add_fetch(&gGroupReleased, 1, __ATOMIC_ACQ_REL);
+}
+
+static int group_put(int group, int seq, int key)
+{
+	AVFrame *f = avFrameWrap(gGroupData, GROUP_FRAME_SIZE, &seq, sizeof(seq), group_released, NULL);
+
+	return f != NULL ? avStreamGroupSendFrame(group, f, key) : AV_ER_MEM_INSUFF;
+}
+
+/** Wait until the viewer on av, which joined at frame first, has dealt with every frame put since; 1 if it did. */
+static int group_wait(int group, int av, unsigned long long first)
+{
+	AVStreamViewerStats vs;
+	AVStreamGroupStats gs;
+	unsigned int waited;
+
+	for (waited = 0; waited < 3000; waited++) {
+		if (avStreamGroupGetStats(group, &gs) != AV_ER_NoERROR ||
+			avStreamGroupGetViewerStats(group, av, &vs) != AV_ER_NoERROR)
+			return 0;
+		if (vs.sentCount + vs.droppedCount + vs.failCount == gs.frameCount - first)
+			return 1;
+		ext_test_sleep_ms(1);
+	}
+	return 0;
+}
+
+/** The sequence number of the oldest frame sent on av, or -1 if there is none or it is not a whole video frame. */
+static int group_pop(int av)
+{
+	int seq = -1, is_audio;
+
+	if (ext_stub_sent_pop(av, &is_audio, &seq, sizeof(seq)) != GROUP_FRAME_SIZE || is_audio)
+		return -1;
+	return seq;
+}
+
+/** Were exactly the frames from to to sent on av? */
+static int group_sent(int av, int from, int to)
+{
+	for (; from <= to; from++) {
+		if (group_pop(av) != from)
+			return 0;
+	}
+	return ext_stub_sent_count(av) == 0;
+}
+
+static int group_fanout(int group)
+{
+	AVStreamViewerStats vs;
+	AVStreamGroupStats gs;
+	int seq, is_audio;
+
+	EXT_CHECK(avStreamGroupAddViewer(group, GROUP_FAST_AV, AV_STREAM_DROP_NONE, 0) == AV_ER_NoERROR);
+	EXT_CHECK(avStreamGroupAddViewer(group, GROUP_FAST_AV, AV_STREAM_DROP_NONE, 0) == AV_ER_INVALID_ARG);
+	EXT_CHECK(avStreamGroupAddViewer(group, GROUP_SLOW_AV, AV_STREAM_DROP_TO_KEYFRAME, GROUP_MAX_LAG) == AV_ER_NoERROR);
+
+	// Viewers start at a keyframe
+	EXT_CHECK(group_put(group, 0, 0) == AV_ER_NoERROR && group_put(group, 1, 1) == AV_ER_NoERROR);
+	EXT_CHECK(group_put(group, 2, 0) == AV_ER_NoERROR && group_put(group, 3, 0) == AV_ER_NoERROR);
+	EXT_CHECK(group_wait(group, GROUP_FAST_AV, 0) && group_wait(group, GROUP_SLOW_AV, 0));
+	EXT_CHECK(group_sent(GROUP_FAST_AV, 1, 3) && group_sent(GROUP_SLOW_AV, 1, 3));
+
+	// A frame the SDK refused breaks the reference chain of that viewer only, until the next keyframe
+	ext_stub_send_fail(GROUP_FAST_AV, AV_ER_MEM_INSUFF, 1);
+	EXT_CHECK(group_put(group, 4, 0) == AV_ER_NoERROR && group_put(group, 5, 0) == AV_ER_NoERROR);
+	EXT_CHECK(group_put(group, 6, 1) == AV_ER_NoERROR && group_put(group, 7, 0) == AV_ER_NoERROR);
+	EXT_CHECK(group_wait(group, GROUP_FAST_AV, 0) && group_wait(group, GROUP_SLOW_AV, 0));
+	EXT_CHECK(group_sent(GROUP_FAST_AV, 6, 7) && group_sent(GROUP_SLOW_AV, 4, 7));
+	EXT_CHECK(avStreamGroupGetViewerStats(group, GROUP_FAST_AV, &vs) == AV_ER_NoERROR);
+	EXT_CHECK(vs.sentCount == 5 && vs.droppedCount == 2 && vs.failCount == 1 && vs.lastError == AV_ER_MEM_INSUFF);
+	EXT_CHECK(avStreamGroupGetStats(group, &gs) == AV_ER_NoERROR);
+	EXT_CHECK(gs.viewerCount == 2 && gs.storedFrames == GROUP_MAX_FRAMES);
+	EXT_CHECK(gs.storedBytes == GROUP_MAX_FRAMES * GROUP_FRAME_SIZE && gGroupReleased == 0);
+
+	// A viewer too far behind skips to the latest keyframe, the other one gets every frame
+	EXT_CHECK(IOTC_Session_Pacer_Setup(GROUP_SID, GROUP_RATE, GROUP_FRAME_SIZE) == IOTC_ER_NoERROR);
+	EXT_CHECK(avServPacerAttach(GROUP_SLOW_AV, GROUP_SID) == AV_ER_NoERROR);
+	EXT_CHECK(group_put(group, 8, 1) == AV_ER_NoERROR && group_wait(group, GROUP_SLOW_AV, 0));
+	EXT_CHECK(group_pop(GROUP_SLOW_AV) == 8);
+	for (seq = 9; seq <= 14; seq++)
+		EXT_CHECK(group_put(group, seq, seq == 12) == AV_ER_NoERROR);
+	EXT_CHECK(group_wait(group, GROUP_FAST_AV, 0) && group_wait(group, GROUP_SLOW_AV, 0));
+	EXT_CHECK(group_sent(GROUP_FAST_AV, 8, 14));
+	// It may have taken the next frame before the rest were put in
+	EXT_CHECK((seq = group_pop(GROUP_SLOW_AV)) == 9 || seq == 12);
+	EXT_CHECK(group_sent(GROUP_SLOW_AV, seq == 9 ? 12 : 13, 14));
+	EXT_CHECK(avStreamGroupGetViewerStats(group, GROUP_SLOW_AV, &vs) == AV_ER_NoERROR);
+	EXT_CHECK(vs.droppedCount == (seq == 9 ? 3u : 4u) && vs.failCount == 0);
+	EXT_CHECK(__atomic_load_n(&gGroupReleased, __ATOMIC_ACQUIRE) == 15 - GROUP_MAX_FRAMES);
+
+	// A closed viewer gets no more audio
+	ext_stub_av_close(GROUP_SLOW_AV, AV_ER_SESSION_CLOSE_BY_REMOTE);
+	EXT_CHECK(group_put(group, 15, 1) == AV_ER_NoERROR);
+	EXT_CHECK(group_wait(group, GROUP_FAST_AV, 0) && group_wait(group, GROUP_SLOW_AV, 0));
+	EXT_CHECK(avStreamGroupSendAudio(group, gGroupData, 100, NULL, 0) == 1);
+	EXT_CHECK(group_pop(GROUP_FAST_AV) == 15);
+	EXT_CHECK(ext_stub_sent_pop(GROUP_FAST_AV, &is_audio, NULL, 0) == 100 && is_audio);
+
+	// A viewer joining late starts at the latest stored keyframe
+	EXT_CHECK(avStreamGroupAddViewer(group, GROUP_LATE_AV, AV_STREAM_DROP_TO_KEYFRAME, 0) == AV_ER_NoERROR);
+	EXT_CHECK(group_put(group, 16, 0) == AV_ER_NoERROR);
+	EXT_CHECK(group_wait(group, GROUP_LATE_AV, 15) && group_sent(GROUP_LATE_AV, 15, 16));
+	avStreamGroupRemoveViewer(group, GROUP_LATE_AV);
+	EXT_CHECK(avStreamGroupGetStats(group, &gs) == AV_ER_NoERROR && gs.viewerCount == 2 && gs.frameCount == 17);
+	EXT_CHECK(avStreamGroupGetViewerStats(group, GROUP_LATE_AV, &vs) == AV_ER_INVALID_ARG);
+	return 0;
+}
+
+/** One frame store sent to viewers which start at keyframes, recover from lost frames and fall behind alone */
+int ext_test_stream_group_fanout(void)
+{
+	int group, ret;
+
+	ext_stub_reset();
+	gGroupReleased = 0;
+	ext_stub_session_open(GROUP_SID, "GROUP");
+	group = avStreamGroupCreate(GROUP_MAX_FRAMES);
+	ret = group >= 0 ? group_fanout(group) : __LINE__;
+
+	// The frames left in the store go with the group
+	avStreamGroupDestroy(group);
+	if (ret == 0 && gGroupReleased != GROUP_TOTAL)
+		ret = __LINE__;
+	avServPacerDetach(GROUP_SLOW_AV);
+	IOTC_Session_Pacer_Remove(GROUP_SID);
+	ext_stub_reset();
+	return ret;
+}
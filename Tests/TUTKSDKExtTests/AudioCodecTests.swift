@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class AudioCodecTests: XCTestCase {
+    func testG711RoundTrip() {
+        XCTAssertEqual(ext_test_g711_round_trip(), 0, "test_audiocodec.c line")
+    }
+
+    func testResamplerRoundTrip() {
+        XCTAssertEqual(ext_test_resampler_round_trip(), 0, "test_audiocodec.c line")
+    }
+
+    static var allTests = [
+        ("testG711RoundTrip", testG711RoundTrip),
+        ("testResamplerRoundTrip", testResamplerRoundTrip),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class BufBudgetTests: XCTestCase {
+    func testBufBudgetShare() {
+        XCTAssertEqual(ext_test_buf_budget_share(), 0, "test_bufbudget.c line")
+    }
+
+    static var allTests = [
+        ("testBufBudgetShare", testBufBudgetShare),
+    ]
+}
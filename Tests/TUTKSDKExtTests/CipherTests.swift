@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class CipherTests: XCTestCase {
+    func testCTRVectors() {
+        XCTAssertEqual(ext_test_cipher_ctr_vectors(), 0, "test_cipher.c line")
+    }
+
+    func testEnginesAgree() {
+        XCTAssertEqual(ext_test_cipher_engines_agree(), 0, "test_cipher.c line")
+    }
+
+    static var allTests = [
+        ("testCTRVectors", testCTRVectors),
+        ("testEnginesAgree", testEnginesAgree),
+    ]
+}
@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class CreditTests: XCTestCase {
+    func testSession() {
+        XCTAssertEqual(ext_test_credit_session(), 0, "test_credit.c line")
+    }
+
+    func testAvChannel() {
+        XCTAssertEqual(ext_test_credit_av(), 0, "test_credit.c line")
+    }
+
+    static var allTests = [
+        ("testSession", testSession),
+        ("testAvChannel", testAvChannel),
+    ]
+}
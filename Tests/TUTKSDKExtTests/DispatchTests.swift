@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class DispatchTests: XCTestCase {
+    func testOrder() {
+        XCTAssertEqual(ext_test_dispatch_order(), 0, "test_dispatch.c line")
+    }
+
+    func testWideSpan() {
+        XCTAssertEqual(ext_test_dispatch_wide_span(), 0, "test_dispatch.c line")
+    }
+
+    static var allTests = [
+        ("testOrder", testOrder),
+        ("testWideSpan", testWideSpan),
+    ]
+}
@@ -0,0 +1,23 @@
+import Foundation
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class FecLinkTests: XCTestCase {
+    func testImpairedLink() {
+        XCTAssertEqual(ext_test_fec_link(), 0, "test_fec_link.c line")
+    }
+
+    // Set EXT_FEC_LINK_TABLE to print the loss and latency of every profile.
+    func testLinkTable() {
+        guard ProcessInfo.processInfo.environment["EXT_FEC_LINK_TABLE"] != nil else {
+            return
+        }
+        XCTAssertEqual(ext_fec_link_table(), 0, "test_fec_link.c line")
+    }
+
+    static var allTests = [
+        ("testImpairedLink", testImpairedLink),
+        ("testLinkTable", testLinkTable),
+    ]
+}
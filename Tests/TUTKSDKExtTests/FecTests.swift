@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class FecTests: XCTestCase {
+    func testEncode() {
+        XCTAssertEqual(ext_test_fec_encode(), 0, "test_fec.c line")
+    }
+
+    func testRecover() {
+        XCTAssertEqual(ext_test_fec_recover(), 0, "test_fec.c line")
+    }
+
+    static var allTests = [
+        ("testEncode", testEncode),
+        ("testRecover", testRecover),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class FramePoolTests: XCTestCase {
+    func testFramePool() {
+        XCTAssertEqual(ext_test_frame_pool(), 0, "test_frame.c line")
+    }
+
+    static var allTests = [
+        ("testFramePool", testFramePool),
+    ]
+}
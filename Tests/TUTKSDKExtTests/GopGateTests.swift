@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class GopGateTests: XCTestCase {
+    func testGopGate() {
+        XCTAssertEqual(ext_test_gop_gate(), 0, "test_gopgate.c line")
+    }
+
+    static var allTests = [
+        ("testGopGate", testGopGate),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class HandoverTests: XCTestCase {
+    func testNetworkChanges() {
+        XCTAssertEqual(ext_test_handover_changes(), 0, "test_handover.c line")
+    }
+
+    static var allTests = [
+        ("testNetworkChanges", testNetworkChanges),
+    ]
+}
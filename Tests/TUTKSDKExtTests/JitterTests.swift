@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class JitterTests: XCTestCase {
+    func testJitterPlayout() {
+        XCTAssertEqual(ext_test_jitter_playout(), 0, "test_jitter.c line")
+    }
+
+    func testJitterAttach() {
+        XCTAssertEqual(ext_test_jitter_attach(), 0, "test_jitter.c line")
+    }
+
+    static var allTests = [
+        ("testJitterPlayout", testJitterPlayout),
+        ("testJitterAttach", testJitterAttach),
+    ]
+}
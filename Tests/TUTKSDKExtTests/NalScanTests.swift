@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class NalScanTests: XCTestCase {
+    func testScanKnown() {
+        XCTAssertEqual(ext_test_nal_scan_known(), 0, "test_nalscan.c line")
+    }
+
+    func testEnginesAgree() {
+        XCTAssertEqual(ext_test_nal_scan_engines_agree(), 0, "test_nalscan.c line")
+    }
+
+    static var allTests = [
+        ("testScanKnown", testScanKnown),
+        ("testEnginesAgree", testEnginesAgree),
+    ]
+}
@@ -0,0 +1,23 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class PacerTests: XCTestCase {
+    func testFixedRate() {
+        XCTAssertEqual(ext_test_pacer_fixed_rate(), 0, "test_pacer.c line")
+    }
+
+    func testAutoRate() {
+        XCTAssertEqual(ext_test_pacer_auto_rate(), 0, "test_pacer.c line")
+    }
+
+    func testShared() {
+        XCTAssertEqual(ext_test_pacer_shared(), 0, "test_pacer.c line")
+    }
+
+    static var allTests = [
+        ("testFixedRate", testFixedRate),
+        ("testAutoRate", testAutoRate),
+        ("testShared", testShared),
+    ]
+}
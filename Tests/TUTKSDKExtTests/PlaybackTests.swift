@@ -0,0 +1,23 @@
+import Foundation
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class PlaybackTests: XCTestCase {
+    func testSeek() {
+        XCTAssertEqual(ext_test_playback_seek(), 0, "test_playback.c line")
+    }
+
+    // Set EXT_PLAYBACK_SEEK_TABLE to print the open and seek latency of larger recordings.
+    func testSeekTable() {
+        guard ProcessInfo.processInfo.environment["EXT_PLAYBACK_SEEK_TABLE"] != nil else {
+            return
+        }
+        XCTAssertEqual(ext_playback_seek_table(), 0, "test_playback.c line")
+    }
+
+    static var allTests = [
+        ("testSeek", testSeek),
+        ("testSeekTable", testSeekTable),
+    ]
+}
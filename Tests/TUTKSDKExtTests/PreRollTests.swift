@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class PreRollTests: XCTestCase {
+    func testPreRollBuffer() {
+        XCTAssertEqual(ext_test_preroll_buffer(), 0, "test_preroll.c line")
+    }
+
+    static var allTests = [
+        ("testPreRollBuffer", testPreRollBuffer),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class PresenceTests: XCTestCase {
+    func testPresenceCache() {
+        XCTAssertEqual(ext_test_presence_cache(), 0, "test_presence.c line")
+    }
+
+    static var allTests = [
+        ("testPresenceCache", testPresenceCache),
+    ]
+}
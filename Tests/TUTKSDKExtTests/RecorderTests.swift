@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class RecorderTests: XCTestCase {
+    func testExactFill() {
+        XCTAssertEqual(ext_test_recorder_exact_fill(), 0, "test_recorder.c line")
+    }
+
+    static var allTests = [
+        ("testExactFill", testExactFill),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class RecvEngineTests: XCTestCase {
+    func testRecvEngineStreams() {
+        XCTAssertEqual(ext_test_recv_engine_streams(), 0, "test_recvengine.c line")
+    }
+
+    static var allTests = [
+        ("testRecvEngineStreams", testRecvEngineStreams),
+    ]
+}
@@ -0,0 +1,23 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class RpcTests: XCTestCase {
+    func testCalls() {
+        XCTAssertEqual(ext_test_rpc_calls(), 0, "test_rpc.c line")
+    }
+
+    func testFailures() {
+        XCTAssertEqual(ext_test_rpc_failures(), 0, "test_rpc.c line")
+    }
+
+    func testDispatchedDetach() {
+        XCTAssertEqual(ext_test_rpc_dispatched_detach(), 0, "test_rpc.c line")
+    }
+
+    static var allTests = [
+        ("testCalls", testCalls),
+        ("testFailures", testFailures),
+        ("testDispatchedDetach", testDispatchedDetach),
+    ]
+}
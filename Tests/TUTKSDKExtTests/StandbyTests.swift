@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class StandbyTests: XCTestCase {
+    func testStandbySwitch() {
+        XCTAssertEqual(ext_test_standby_switch(), 0, "test_standby.c line")
+    }
+
+    func testStandbyClosed() {
+        XCTAssertEqual(ext_test_standby_closed(), 0, "test_standby.c line")
+    }
+
+    static var allTests = [
+        ("testStandbySwitch", testStandbySwitch),
+        ("testStandbyClosed", testStandbyClosed),
+    ]
+}
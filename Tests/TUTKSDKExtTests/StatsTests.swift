@@ -0,0 +1,18 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class StatsTests: XCTestCase {
+    func testSampler() {
+        XCTAssertEqual(ext_test_stats_sampler(), 0, "test_stats.c line")
+    }
+
+    func testStopWhileSending() {
+        XCTAssertEqual(ext_test_stats_stop_while_sending(), 0, "test_stats.c line")
+    }
+
+    static var allTests = [
+        ("testSampler", testSampler),
+        ("testStopWhileSending", testStopWhileSending),
+    ]
+}
@@ -0,0 +1,13 @@
+import XCTest
+import TUTKSDKExtTestSupport
+
+// Each check returns 0, or the line of the first condition which failed.
+final class StreamGroupTests: XCTestCase {
+    func testStreamGroupFanout() {
+        XCTAssertEqual(ext_test_stream_group_fanout(), 0, "test_streamgroup.c line")
+    }
+
+    static var allTests = [
+        ("testStreamGroupFanout", testStreamGroupFanout),
+    ]
+}
@@ -0,0 +1,30 @@
+import XCTest
+
+#if !canImport(ObjectiveC)
+public func allTests() -> [XCTestCaseEntry] {
+    return [
+        testCase(PresenceTests.allTests),
+        testCase(CipherTests.allTests),
+        testCase(FecTests.allTests),
+        testCase(FecLinkTests.allTests),
+        testCase(AudioCodecTests.allTests),
+        testCase(NalScanTests.allTests),
+        testCase(RecorderTests.allTests),
+        testCase(PlaybackTests.allTests),
+        testCase(DispatchTests.allTests),
+        testCase(RpcTests.allTests),
+        testCase(StatsTests.allTests),
+        testCase(PacerTests.allTests),
+        testCase(CreditTests.allTests),
+        testCase(HandoverTests.allTests),
+        testCase(FramePoolTests.allTests),
+        testCase(StreamGroupTests.allTests),
+        testCase(JitterTests.allTests),
+        testCase(GopGateTests.allTests),
+        testCase(PreRollTests.allTests),
+        testCase(BufBudgetTests.allTests),
+        testCase(StandbyTests.allTests),
+        testCase(RecvEngineTests.allTests),
+    ]
+}
+#endif